@@ -31,11 +31,13 @@
 #include "global_config.h"
 #include "rbh_cfg_helpers.h"
 #include "chglog_reader.h"
+#include "chglog_source.h"
 
 #include <pthread.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <time.h>
 #include <glib.h>
 #include "lustre_extended_types.h"
 
@@ -67,11 +69,12 @@ static void timeval_from_rec(struct timeval *tv, CL_REC_TYPE *logrec)
     tv->tv_usec = (time_t)cltime2nsec(logrec->cr_time) / 1000;
 }
 
-/** update record stats */
-static void update_rec_stats(struct rec_stats *rs, CL_REC_TYPE *logrec)
+/** set record stats from a record id and time */
+static void set_rec_stats(struct rec_stats *rs, uint64_t rec_id,
+                          const struct timeval *rec_time)
 {
-    rs->rec_id = logrec->cr_index;
-    timeval_from_rec(&rs->rec_time, logrec);
+    rs->rec_id = rec_id;
+    rs->rec_time = *rec_time;
     gettimeofday(&rs->step_time, NULL);
 
     /* if no record has been reported, save this one - 1 as the previous last */
@@ -81,6 +84,27 @@ static void update_rec_stats(struct rec_stats *rs, CL_REC_TYPE *logrec)
     }
 }
 
+/** update record stats */
+static void update_rec_stats(struct rec_stats *rs, CL_REC_TYPE *logrec)
+{
+    struct timeval rec_time;
+
+    timeval_from_rec(&rec_time, logrec);
+    set_rec_stats(rs, logrec->cr_index, &rec_time);
+}
+
+/** record pushed to the pipeline, waiting to be committed */
+struct pending_rec {
+    uint64_t        rec_id;
+    struct timeval  rec_time;
+    bool            done;
+};
+
+/* initial size of the pending record ring (power of 2) */
+#define PENDING_INIT_SIZE   4096
+/* commit_seq of records that could not be tracked */
+#define COMMIT_SEQ_NONE     UINT64_MAX
+
 /* reader thread info, one per MDT */
 typedef struct reader_thr_info_t {
     /** reader thread index */
@@ -93,6 +117,16 @@ typedef struct reader_thr_info_t {
     char *mdtdevice;
     int flags;
 
+    /** source of records, and its device (MDT or file) */
+    const cl_source_t *src;
+    const char *src_device;
+
+    /** file to save received records to (if set) */
+    FILE *record_fp;
+
+    /** when the reader started */
+    struct timeval start_time;
+
     /** nbr of records read by this thread */
     unsigned long long nb_read;
 
@@ -106,16 +140,44 @@ typedef struct reader_thr_info_t {
     struct rec_stats last_read;
     /** last record pushed to the pipeline */
     struct rec_stats last_push;
-    /** last record commited to the DB */
+    /** last record commited to the DB, such as all the records pushed
+     * before it are committed too (protected by commit_lock) */
     struct rec_stats last_commit;
-    /** last commit id saved to the DB */
+    /** last commit id saved to the DB (written by the commit thread,
+     * protected by commit_lock) */
     struct rec_stats last_commit_update;
     /** last record cleared from the changelog */
     struct rec_stats last_clear;
 
+    /** Records pushed to the pipeline and not committed yet, indexed by
+     * their commit sequence number (modulo pending_size). The pipeline
+     * commits records out of order: last_commit only moves forward when
+     * the oldest pending records are done. Protected by commit_lock. */
+    struct pending_rec *pending;
+    unsigned int pending_size;
+    uint64_t pending_first; /* sequence number of the oldest record */
+    uint64_t pending_next;  /* sequence number of the next pushed record */
+    pthread_mutex_t commit_lock;
+
+    /** last_commit must be saved to the DB by the commit thread now */
+    bool commit_flush;
+
+    /** serializes changelog clear calls (pipeline workers) */
+    pthread_mutex_t clear_lock;
+
     /* number of times the changelog has been reopened */
     unsigned int nb_reopen;
 
+    /** Effective queue parameters. They are adapted to the pipeline load
+     * if adaptive_queue is enabled (only modified by the reader thread). */
+    unsigned int queue_size;
+    time_t queue_age;
+    unsigned int push_batch;
+    /** DB_APPLY counters at last adjustment, and reference latency */
+    unsigned long long last_db_count;
+    unsigned long long last_db_usec;
+    double db_latency_ref;  /* ms/op */
+
     /** thread was asked to stop */
     unsigned int force_stop:1;
 
@@ -133,6 +195,10 @@ typedef struct reader_thr_info_t {
     struct id_hash *id_hash;
 
     ull_t cl_counters[CL_LAST]; /* since program start time */
+    /* records (and operations generated from them) considered for
+     * coalescing, and how many of them were suppressed, by type */
+    ull_t cl_ops[CL_LAST];
+    ull_t cl_suppressed[CL_LAST];
     ull_t cl_reported[CL_LAST]; /* last reported stat (for incremental diff) */
     time_t last_report;
 
@@ -163,7 +229,7 @@ static int log_close(reader_thr_info_t *p_info)
     int rc;
 
     /* close the log and clear input buffers */
-    rc = llapi_changelog_fini(&p_info->chglog_hdlr);
+    rc = p_info->src->fini(&p_info->chglog_hdlr);
 
     if (rc)
         DisplayLog(LVL_CRIT, CHGLOG_TAG, "Error %d closing changelog: %s",
@@ -197,46 +263,63 @@ static void free_extra_info2(void *ptr)
 
 /**
  * Clear the changelogs up to the last committed number seen.
+ * This can be called concurrently by several pipeline workers.
  */
 static int clear_changelog_records(reader_thr_info_t *p_info)
 {
-    int rc;
+    struct rec_stats commit;
     const char *reader_id;
+    int rc = 0;
+
+    P(p_info->clear_lock);
 
-    if (p_info->last_commit.rec_id == 0) {
+    P(p_info->commit_lock);
+    commit = p_info->last_commit;
+    V(p_info->commit_lock);
+
+    if (commit.rec_id == 0) {
         /* No record was ever committed. Stop here because calling
          * llapi_changelog_clear() with record 0 will clear all
          * records, leading to a potential record loss. */
-        return 0;
+        goto out;
     }
 
+    /* another worker already cleared these records */
+    if (commit.rec_id <= p_info->last_clear.rec_id)
+        goto out;
+
     reader_id = cl_reader_config.mdt_def[p_info->thr_index].reader_id;
 
     DisplayLog(LVL_DEBUG, CHGLOG_TAG,
                "%s: acknowledging ChangeLog records up to #%"PRIu64,
-               p_info->mdtdevice, p_info->last_commit.rec_id);
+               p_info->mdtdevice, commit.rec_id);
 
     DisplayLog(LVL_FULL, CHGLOG_TAG, "llapi_changelog_clear('%s', '%s', %"PRIu64")",
-               p_info->mdtdevice, reader_id,
-               p_info->last_commit.rec_id);
+               p_info->mdtdevice, reader_id, commit.rec_id);
 
-    rc = llapi_changelog_clear(p_info->mdtdevice, reader_id,
-                               p_info->last_commit.rec_id);
+    rc = p_info->src->clear(p_info->src_device, reader_id, commit.rec_id);
 
     if (rc) {
         DisplayLog(LVL_CRIT, CHGLOG_TAG,
                    "ERROR: llapi_changelog_clear(\"%s\", \"%s\", %"PRIu64") "
                    "returned %d", p_info->mdtdevice, reader_id,
-                   p_info->last_commit.rec_id, rc);
-        return rc;
+                   commit.rec_id, rc);
+        goto out;
     }
 
     /* update info about last cleared record */
-    p_info->last_clear.rec_id = p_info->last_commit.rec_id;
-    p_info->last_clear.rec_time =  p_info->last_commit.rec_time;
+    P(p_info->commit_lock);
+    p_info->last_clear.rec_id = commit.rec_id;
+    p_info->last_clear.rec_time = commit.rec_time;
     gettimeofday(&p_info->last_clear.step_time, NULL);
+    /* Always save the last commit after clearing records. This avoids
+     * clearing records twice. */
+    p_info->commit_flush = true;
+    V(p_info->commit_lock);
 
-    return 0;
+out:
+    V(p_info->clear_lock);
+    return rc;
 }
 
 /**
@@ -285,30 +368,122 @@ out:
 /**
  * Store the last processed record (i.e. commited to the DB)
  * at regular interval.
+ * Only called by the commit thread, and at exit.
  * @return true if the record id was saved, false in other cases.
  */
 static bool store_last_commit(lmgr_t *lmgr, reader_thr_info_t *info, bool force)
 {
-    int64_t delta_id = info->last_commit.rec_id
-                       - info->last_commit_update.rec_id;
-    time_t delta_sec = info->last_commit.step_time.tv_sec
-                       - info->last_commit_update.step_time.tv_sec;
+    struct rec_stats commit, last_update;
+    int64_t delta_id;
+    time_t delta_sec;
+
+    P(info->commit_lock);
+    commit = info->last_commit;
+    last_update = info->last_commit_update;
+    if (info->commit_flush) {
+        force = true;
+        info->commit_flush = false;
+    }
+    V(info->commit_lock);
+
+    /* nothing new to be saved */
+    if (commit.rec_id == last_update.rec_id)
+        return false;
+
+    delta_id = commit.rec_id - last_update.rec_id;
+    delta_sec = time(NULL) - last_update.step_time.tv_sec;
 
     /** check update delays */
     if (!force && delta_id < cl_reader_config.commit_update_max_delta
         && delta_sec < cl_reader_config.commit_update_max_delay)
         return false;
 
-    if (store_rec_stats(lmgr, info, CL_LAST_COMMITTED_REC, &info->last_commit))
+    if (store_rec_stats(lmgr, info, CL_LAST_COMMITTED_REC, &commit))
         return false;
 
-    info->last_commit_update.rec_id = info->last_commit.rec_id;
-    info->last_commit_update.rec_time = info->last_commit.rec_time;
+    P(info->commit_lock);
+    info->last_commit_update.rec_id = commit.rec_id;
+    info->last_commit_update.rec_time = commit.rec_time;
     gettimeofday(&info->last_commit_update.step_time, NULL);
+    V(info->commit_lock);
 
     return true;
 }
 
+/* The commit thread saves the last committed records to the DB,
+ * so pipeline workers don't have to. */
+static pthread_t commit_thr_id;
+static bool commit_thr_started = false;
+static bool commit_thr_stop = false;
+static bool commit_thr_wakeup = false;
+static pthread_mutex_t commit_thr_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t commit_thr_cond = PTHREAD_COND_INITIALIZER;
+
+/** ask the commit thread to check last committed records now */
+static void commit_thr_signal(void)
+{
+    P(commit_thr_lock);
+    commit_thr_wakeup = true;
+    pthread_cond_signal(&commit_thr_cond);
+    V(commit_thr_lock);
+}
+
+/** commit thread: save the last committed records at regular interval,
+ * or when signaled */
+static void *commit_thr(void *arg)
+{
+    lmgr_t lmgr;
+    int i;
+
+    if (ListMgr_InitAccess(&lmgr) != DB_SUCCESS) {
+        DisplayLog(LVL_CRIT, CHGLOG_TAG, "Commit thread could not connect to "
+                   "the database: last committed records will only be saved "
+                   "at exit.");
+        return NULL;
+    }
+
+    P(commit_thr_lock);
+    while (!commit_thr_stop) {
+        if (!commit_thr_wakeup) {
+            struct timespec deadline;
+
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += MAX2(cl_reader_config.commit_update_max_delay,
+                                    1);
+            pthread_cond_timedwait(&commit_thr_cond, &commit_thr_lock,
+                                   &deadline);
+        }
+        commit_thr_wakeup = false;
+        if (commit_thr_stop)
+            break;
+        V(commit_thr_lock);
+
+        for (i = 0; i < cl_reader_config.mdt_count; i++)
+            store_last_commit(&lmgr, &reader_info[i], false);
+
+        P(commit_thr_lock);
+    }
+    V(commit_thr_lock);
+
+    ListMgr_CloseAccess(&lmgr);
+    return NULL;
+}
+
+/** stop the commit thread and wait for its termination */
+static void commit_thr_terminate(void)
+{
+    if (!commit_thr_started)
+        return;
+
+    P(commit_thr_lock);
+    commit_thr_stop = true;
+    pthread_cond_signal(&commit_thr_cond);
+    V(commit_thr_lock);
+
+    pthread_join(commit_thr_id, NULL);
+    commit_thr_started = false;
+}
+
 /** drop all old changelog stats */
 static void drop_deprecated_changelog_vars(lmgr_t *lmgr, const char *mdt)
 {
@@ -417,16 +592,97 @@ static uint64_t retrieve_last_commit(lmgr_t *lmgr,
     return last_rec;
 }
 
+/** allocate a larger ring of pending records (commit_lock held) */
+static int pending_grow(reader_thr_info_t *p_info)
+{
+    unsigned int new_size = p_info->pending_size ?
+                            2 * p_info->pending_size : PENDING_INIT_SIZE;
+    struct pending_rec *new_ring;
+    uint64_t seq;
+
+    new_ring = MemAlloc(new_size * sizeof(*new_ring));
+    if (new_ring == NULL)
+        return -ENOMEM;
+
+    /* slots are indexed by sequence number */
+    for (seq = p_info->pending_first; seq < p_info->pending_next; seq++)
+        new_ring[seq & (new_size - 1)] =
+            p_info->pending[seq & (p_info->pending_size - 1)];
+
+    if (p_info->pending != NULL)
+        MemFree(p_info->pending);
+    p_info->pending = new_ring;
+    p_info->pending_size = new_size;
+    return 0;
+}
+
+/** register a record that is about to be pushed to the pipeline */
+static void pending_push(reader_thr_info_t *p_info, entry_proc_op_t *op)
+{
+    CL_REC_TYPE *rec = op->extra_info.log_record.p_log_rec;
+    struct pending_rec *slot;
+
+    P(p_info->commit_lock);
+    if (p_info->pending_next - p_info->pending_first >= p_info->pending_size
+        && pending_grow(p_info) != 0) {
+        V(p_info->commit_lock);
+        DisplayLog(LVL_CRIT, CHGLOG_TAG, "Cannot allocate memory to track "
+                   "record #%llu: it may be acknowledged before it is "
+                   "committed", rec->cr_index);
+        op->extra_info.log_record.commit_seq = COMMIT_SEQ_NONE;
+        return;
+    }
+
+    slot = &p_info->pending[p_info->pending_next
+                            & (p_info->pending_size - 1)];
+    slot->rec_id = rec->cr_index;
+    timeval_from_rec(&slot->rec_time, rec);
+    slot->done = false;
+    op->extra_info.log_record.commit_seq = p_info->pending_next++;
+    V(p_info->commit_lock);
+}
+
+/**
+ * Mark a pending record as committed, and move last_commit forward
+ * over the oldest committed records (commit_lock held).
+ * @return true if last_commit changed.
+ */
+static bool pending_done(reader_thr_info_t *p_info, uint64_t seq)
+{
+    unsigned int mask = p_info->pending_size - 1;
+    bool advanced = false;
+
+    if (seq < p_info->pending_first || seq >= p_info->pending_next)
+        return false;
+
+    p_info->pending[seq & mask].done = true;
+
+    while (p_info->pending_first < p_info->pending_next) {
+        struct pending_rec *slot =
+            &p_info->pending[p_info->pending_first & mask];
+
+        if (!slot->done)
+            break;
+
+        set_rec_stats(&p_info->last_commit, slot->rec_id, &slot->rec_time);
+        p_info->pending_first++;
+        advanced = true;
+    }
+    return advanced;
+}
+
 /**
  * DB callback function: this is called when a given ChangeLog record
  * has been successfully applied to the database.
+ * Records may be committed in a different order than they were pushed,
+ * by several pipeline workers.
  */
 static int log_record_callback(lmgr_t *lmgr, struct entry_proc_op_t *pop,
                                void *param)
 {
     reader_thr_info_t *info = (reader_thr_info_t *)param;
     CL_REC_TYPE *logrec = pop->extra_info.log_record.p_log_rec;
-    bool saved;
+    bool clear, save;
     int rc;
 
     /** Check that a log record is set for this entry
@@ -438,38 +694,52 @@ static int log_record_callback(lmgr_t *lmgr, struct entry_proc_op_t *pop,
         return EINVAL;
     }
 
+    P(info->commit_lock);
     /* update info about the last committed record */
-    update_rec_stats(&info->last_commit, logrec);
-
-    /* Save the last committed record so robinhood doesn't get old records
-     * when restarting (especially if there are multiple changelog readers). */
-    saved = store_last_commit(lmgr, info, false);
+    if (!pending_done(info, pop->extra_info.log_record.commit_seq)) {
+        /* a previous record is still being processed */
+        V(info->commit_lock);
+        return 0;
+    }
 
     /* batching llapi_changelog_clear() calls.
      * clear the record in any of those cases:
      *      - batch_ack_count = 1 (i.e. acknowledge every record).
-     *      - we reached the last pushed record.
+     *      - all pushed records are committed.
      *      - if the delta to last cleared record is high enough.
-     * do nothing in all other cases:
+     * do nothing in all other cases.
      */
-    if ((cl_reader_config.batch_ack_count > 1)
-        && (logrec->cr_index < info->last_push.rec_id)
-        && ((logrec->cr_index - info->last_clear.rec_id)
-            < cl_reader_config.batch_ack_count)) {
+    clear = (cl_reader_config.batch_ack_count <= 1)
+        || (info->pending_first == info->pending_next)
+        || ((info->last_commit.rec_id - info->last_clear.rec_id)
+            >= cl_reader_config.batch_ack_count);
+
+    /* Save the last committed record so robinhood doesn't get old records
+     * when restarting (especially if there are multiple changelog readers).
+     * This is done asynchronously by the commit thread. */
+    save = ((int64_t)(info->last_commit.rec_id
+                      - info->last_commit_update.rec_id)
+            >= cl_reader_config.commit_update_max_delta);
+
+    if (!clear)
         DisplayLog(LVL_FULL, CHGLOG_TAG, "callback - %s cl_record: %llu, "
-                   "last_cleared: %"PRIu64", last_pushed: %"PRIu64,
-                   info->mdtdevice, logrec->cr_index,
-                   info->last_clear.rec_id, info->last_push.rec_id);
+                   "last_committed: %"PRIu64", last_cleared: %"PRIu64", "
+                   "last_pushed: %"PRIu64, info->mdtdevice, logrec->cr_index,
+                   info->last_commit.rec_id, info->last_clear.rec_id,
+                   info->last_push.rec_id);
+    V(info->commit_lock);
+
+    if (!clear) {
+        if (save)
+            commit_thr_signal();
         /* do nothing, don't clear log now */
         return 0;
     }
 
     rc = clear_changelog_records(info);
 
-    /* Always save the last commit after clearing records. This avoids
-     * clearing records twice. */
-    if (!saved)
-        store_last_commit(lmgr, info, true);
+    /* the commit thread saves the last commit after clearing records */
+    commit_thr_signal();
 
     return rc;
 }
@@ -615,21 +885,21 @@ static void set_name(CL_REC_TYPE *logrec, entry_proc_op_t *p_op)
 {
     /* is there entry name in log rec? */
     if (logrec->cr_namelen == 0) {
-        ATTR(&p_op->fs_attrs, name)[0] = 0;
+        ATTR(p_op->fs_attrs, name)[0] = 0;
         return;
     }
-    ATTR_MASK_SET(&p_op->fs_attrs, name);
-    rh_strncpy(ATTR(&p_op->fs_attrs, name), rh_get_cl_cr_name(logrec),
-               MIN2(sizeof(ATTR(&p_op->fs_attrs, name)),
+    ATTR_MASK_SET(p_op->fs_attrs, name);
+    rh_strncpy(ATTR(p_op->fs_attrs, name), rh_get_cl_cr_name(logrec),
+               MIN2(sizeof(ATTR(p_op->fs_attrs, name)),
                     logrec->cr_namelen + 1));
 
     /* parent id is always set when name is (Cf. comment in lfs.c) */
     if (fid_is_sane(&logrec->cr_pfid)) {
-        ATTR_MASK_SET(&p_op->fs_attrs, parent_id);
-        ATTR(&p_op->fs_attrs, parent_id) = logrec->cr_pfid;
+        ATTR_MASK_SET(p_op->fs_attrs, parent_id);
+        ATTR(p_op->fs_attrs, parent_id) = logrec->cr_pfid;
 
-        ATTR_MASK_SET(&p_op->fs_attrs, path_update);
-        ATTR(&p_op->fs_attrs, path_update) = time(NULL);
+        ATTR_MASK_SET(p_op->fs_attrs, path_update);
+        ATTR(p_op->fs_attrs, path_update) = time(NULL);
     } else {
         DisplayLog(LVL_MAJOR, CHGLOG_TAG, "Error: insane parent fid " DFID
                    " in %s changelog record (namelen=%u)",
@@ -638,10 +908,88 @@ static void set_name(CL_REC_TYPE *logrec, entry_proc_op_t *p_op)
     }
 }
 
+/* Thresholds for adapting the queue to the pipeline load */
+#define ADAPT_HIGH_LOAD     0.8 /* pipeline occupancy considered as high */
+#define ADAPT_LOW_LOAD      0.2 /* pipeline occupancy considered as low */
+#define ADAPT_SLOW_DB       4.0 /* DB latency factor considered as slow */
+#define ADAPT_PUSH_RATIO    8   /* push batch = queue size / ratio */
+
+/**
+ * Adapt the size and the max age of the queue, and the push batch size,
+ * to the pipeline load:
+ * - if the pipeline is full or the DB gets slow, records are kept longer
+ *   in the queue (they would wait in the pipeline anyway), which gives
+ *   more chances to coalesce them. They are pushed by larger batches.
+ * - if the pipeline is almost idle, go back to configured values, to
+ *   reduce latency and memory usage.
+ * Queue size and age are bounded by queue_max_size/age_limit.
+ */
+static void adjust_queue(reader_thr_info_t *info)
+{
+    unsigned int base_size = cl_reader_config.queue_max_size;
+    unsigned int max_size = MAX2(cl_reader_config.queue_max_size_limit,
+                                 base_size);
+    time_t base_age = cl_reader_config.queue_max_age;
+    time_t max_age = MAX2(cl_reader_config.queue_max_age_limit, base_age);
+    unsigned int size = info->queue_size;
+    time_t age = info->queue_age;
+    pipeline_load_t load;
+    double occupancy;
+    double latency = 0.0;
+    bool slow_db = false;
+
+    if (!cl_reader_config.adaptive_queue) {
+        info->queue_size = base_size;
+        info->queue_age = base_age;
+        info->push_batch = 1;
+        return;
+    }
+
+    EntryProcessor_GetLoad(&load);
+    occupancy = load.capacity ? (double)load.nb_ops / load.capacity : 0.0;
+
+    /* DB_APPLY latency since last adjustment */
+    if (load.db_apply_count > info->last_db_count) {
+        latency = (load.db_apply_usec - info->last_db_usec) / 1000.0
+                  / (load.db_apply_count - info->last_db_count);
+
+        /* reference is the lowest latency, slowly forgotten */
+        if (info->db_latency_ref == 0.0 || latency < info->db_latency_ref)
+            info->db_latency_ref = latency;
+        else
+            info->db_latency_ref = 0.95 * info->db_latency_ref
+                                   + 0.05 * latency;
+
+        slow_db = (latency > ADAPT_SLOW_DB * info->db_latency_ref);
+    }
+    info->last_db_count = load.db_apply_count;
+    info->last_db_usec = load.db_apply_usec;
+
+    if (occupancy >= ADAPT_HIGH_LOAD || slow_db) {
+        size = MIN2(MAX2(size, base_size) * 2, max_size);
+        age = MIN2(MAX2(age, base_age) * 2, max_age);
+    } else if (occupancy <= ADAPT_LOW_LOAD) {
+        size = MAX2(size / 2, base_size);
+        age = MAX2(age / 2, base_age);
+    }
+
+    if (size != info->queue_size || age != info->queue_age)
+        DisplayLog(LVL_DEBUG, CHGLOG_TAG, "%s: pipeline load=%.0f%%, "
+                   "DB latency=%.2fms/op (ref=%.2f): queue size %u->%u, "
+                   "max age %lds->%lds", info->mdtdevice, 100.0 * occupancy,
+                   latency, info->db_latency_ref, info->queue_size, size,
+                   info->queue_age, age);
+
+    info->queue_size = size;
+    info->queue_age = age;
+    info->push_batch = (size > base_size) ? MAX2(size / ADAPT_PUSH_RATIO, 1)
+                                          : 1;
+}
+
 /* Push the oldest (all=FALSE) or all (all=TRUE) entries into the pipeline. */
 static void process_op_queue(reader_thr_info_t *p_info, bool push_all)
 {
-    time_t oldest = time(NULL) - cl_reader_config.queue_max_age;
+    time_t oldest = time(NULL) - p_info->queue_age;
     CL_REC_TYPE *rec;
 
     DisplayLog(LVL_FULL, CHGLOG_TAG, "processing changelog queue");
@@ -650,10 +998,11 @@ static void process_op_queue(reader_thr_info_t *p_info, bool push_all)
         entry_proc_op_t *op =
             rh_list_first_entry(&p_info->op_queue, entry_proc_op_t, list);
 
-        /* Stop when the queue is below our limit, and when the oldest
-         * element is still new enough. */
+        /* Stop when the queue is below our limit (minus the push batch
+         * size), and when the oldest element is still new enough. */
         if (!push_all &&
-            (p_info->op_queue_count < cl_reader_config.queue_max_size) &&
+            (p_info->op_queue_count + p_info->push_batch
+                <= p_info->queue_size) &&
             (op->timestamp.changelog_inserted > oldest))
             break;
 
@@ -668,7 +1017,9 @@ static void process_op_queue(reader_thr_info_t *p_info, bool push_all)
         /* Set parent_id+name from changelog record info, as they are used
          * in pipeline for stage locking. */
         set_name(rec, op);
-        /* Push the entry to the pipeline */
+        /* Track the record until it is committed, then push the entry
+         * to the pipeline */
+        pending_push(p_info, op);
         EntryProcessor_Push(op);
 
         update_rec_stats(&p_info->last_push, rec);
@@ -699,6 +1050,9 @@ static int insert_into_hash(reader_thr_info_t *p_info, CL_REC_TYPE *p_rec,
 
     /* first, it will check if it already exists in database */
     op->pipeline_stage = entry_proc_descr.GET_INFO_DB;
+    /* records of each MDT are processed (and cleared) by their own
+     * pipeline instance */
+    op->pipeline_shard = p_info->thr_index;
 
     /* set log record */
     op->extra_info_is_set = 1;
@@ -709,7 +1063,8 @@ static int insert_into_hash(reader_thr_info_t *p_info, CL_REC_TYPE *p_rec,
     op->extra_info.log_record.mdt =
         cl_reader_config.mdt_def[p_info->thr_index].mdt_name;
 
-    if (flags & PLR_FLG_FREE2)
+    /* records read from files are allocated locally too */
+    if ((flags & PLR_FLG_FREE2) || p_info->src->local_alloc)
         op->extra_info_free_func = free_extra_info2;
     else
         op->extra_info_free_func = free_extra_info;
@@ -728,6 +1083,9 @@ static int insert_into_hash(reader_thr_info_t *p_info, CL_REC_TYPE *p_rec,
     if (!op->get_fid_from_db)
         EntryProcessor_SetEntryId(op, &p_rec->cr_tfid);
 
+    if (p_rec->cr_type < CL_LAST)
+        p_info->cl_ops[p_rec->cr_type]++;
+
     /* Add the entry on the pending queue ... */
     op->timestamp.changelog_inserted = time(NULL);
     rh_list_add_tail(&op->list, &p_info->op_queue);
@@ -740,6 +1098,23 @@ static int insert_into_hash(reader_thr_info_t *p_info, CL_REC_TYPE *p_rec,
     return 0;
 }
 
+/* Records that create an entry. */
+#define CL_CREATION_MASK (1<<CL_CREATE | 1<<CL_MKNOD | 1<<CL_MKDIR \
+                          | 1<<CL_SOFTLINK)
+
+#ifdef HAVE_CL_LAYOUT
+#define CL_LAYOUT_MASK   (1<<CL_LAYOUT)
+#else
+#define CL_LAYOUT_MASK   0
+#endif
+
+/* Records that only change the attributes or the names of an entry.
+ * They are irrelevant if the entry is removed by a later record. */
+#define CL_UPDATE_MASK   (1<<CL_OPEN | 1<<CL_CLOSE | 1<<CL_TRUNC \
+                          | 1<<CL_MTIME | 1<<CL_CTIME | 1<<CL_SETATTR \
+                          | 1<<CL_XATTR | CL_LAYOUT_MASK \
+                          | 1<<CL_RENAME | 1<<CL_EXT)
+
 /* Describes which records can be safely ignored. By default a record
  * is never ignored. It is only necessary to add an entry in this
  * table if the record may be skipped (and thus has a mask defined) or
@@ -747,8 +1122,12 @@ static int insert_into_hash(reader_thr_info_t *p_info, CL_REC_TYPE *p_rec,
 static const struct {
     enum { IGNORE_NEVER = 0,    /* default */
         IGNORE_MASK,    /* mask must be set, and record has a FID */
-        IGNORE_CANCEL,  /* record could cancel a previous one
-                           (e.g. CREATE/UNLINK sequence) */
+        IGNORE_CANCEL,  /* record could cancel the whole chain of records
+                           since the entry creation (e.g. CREATE/RENAME/
+                           UNLINK sequence). mask is the allowed types
+                           in the chain. */
+        IGNORE_SUPERSEDE,   /* record replaces the previous record of the
+                               entry, if it is a similar event */
         IGNORE_ALWAYS
     } ignore;
     unsigned int ignore_mask;
@@ -776,24 +1155,173 @@ static const struct {
     [CL_SETATTR] = { IGNORE_MASK, 1<<CL_CTIME | 1<<CL_SETATTR | 1<<CL_CREATE
                    | 1<<CL_MKNOD | 1<<CL_MKDIR },
 
-    /* Note: no need to check UNLINK_LAST or HSM flags: if unlink comes just
-     * after create, there was no HARDLINK or HSM event in between, so we can
-     * safely cancel the create without missing anything. */
-    [CL_UNLINK] = { IGNORE_CANCEL, 1<<CL_CREATE | 1<<CL_MKNOD },
-    [CL_RMDIR] = { IGNORE_CANCEL, 1<<CL_MKDIR },
+    /* Repeated xattr/layout changes: the pipeline gets the current
+     * value from the filesystem anyway. */
+    [CL_XATTR] = { IGNORE_MASK, 1<<CL_XATTR },
+#ifdef HAVE_CL_LAYOUT
+    [CL_LAYOUT] = { IGNORE_MASK, 1<<CL_LAYOUT },
+#endif
+
+#ifdef _LUSTRE_HSM
+    /* The last HSM event of a given kind gives the entry status. */
+    [CL_HSM] = { .ignore = IGNORE_SUPERSEDE },
+#endif
+
+    /* Removing an entry created after the last pushed record cancels all
+     * its records. HARDLINK and UNLINK records are allowed in the chain
+     * if the last unlink is known to remove the entry. HSM records are
+     * never cancelled, as an HSM copy may have to be removed. */
+    [CL_UNLINK] = { IGNORE_CANCEL, CL_CREATION_MASK | CL_UPDATE_MASK
+                    | 1<<CL_HARDLINK | 1<<CL_UNLINK },
+    [CL_RMDIR] = { IGNORE_CANCEL, 1<<CL_MKDIR | CL_UPDATE_MASK },
 };
 
+/** Remove a queued record that is made useless by a new record. */
+static void drop_queued_op(reader_thr_info_t *p_info, entry_proc_op_t *op)
+{
+    CL_REC_TYPE *logrec = op->extra_info.log_record.p_log_rec;
+
+    if (logrec->cr_type < CL_LAST)
+        p_info->cl_suppressed[logrec->cr_type]++;
+
+    rh_list_del(&op->list);
+    rh_list_del(&op->id_hash_list);
+    p_info->op_queue_count--;
+    /* removed record was previously counted as interesting */
+    if (p_info->interesting_records > 0)
+        p_info->interesting_records--;
+    EntryProcessor_Release(op);
+}
+
+/**
+ * Check if a removal record cancels the whole chain of queued records
+ * of its entry: the first queued record must be the creation of the
+ * entry, so the entry is not known by the pipeline and the database yet.
+ * If so, drop all the queued records of the entry.
+ */
+static bool cancel_chain(reader_thr_info_t *p_info, struct id_hash_slot *slot,
+                         const CL_REC_TYPE *logrec_in)
+{
+    unsigned int chain_mask = record_filters[logrec_in->cr_type].ignore_mask;
+    entry_proc_op_t *op, *t1;
+    bool first = true;
+    bool links = false;
+    unsigned int count = 0;
+    char flag_buff[256] = "";
+
+#ifdef CLF_UNLINK_HSM_EXISTS
+    /* the entry has a copy in the HSM backend: it must be processed */
+    if (logrec_in->cr_type == CL_UNLINK
+        && (logrec_in->cr_flags & CLF_UNLINK_HSM_EXISTS))
+        return false;
+#endif
+
+    rh_list_for_each_entry(op, &slot->list, id_hash_list) {
+        CL_REC_TYPE *logrec = op->extra_info.log_record.p_log_rec;
+
+        /* fid not matching, check next records */
+        if (!entry_id_equal(&logrec->cr_tfid, &logrec_in->cr_tfid))
+            continue;
+
+        DisplayLog(LVL_FULL, CHGLOG_TAG,
+                   "    checking chain record "CL_BASE_FORMAT,
+                   CL_BASE_ARG(p_info->mdtdevice, logrec));
+
+        if (first && !(CL_CREATION_MASK & (1 << logrec->cr_type))) {
+            DisplayLog(LVL_FULL, CHGLOG_TAG, "-> Entry was created before "
+                       "the first queued record: chain must be kept");
+            return false;
+        }
+        first = false;
+
+        if (!(chain_mask & (1 << logrec->cr_type)) || op->get_fid_from_db) {
+            DisplayLog(LVL_FULL, CHGLOG_TAG, "-> Significant record "
+                       "in the chain: chain must be kept");
+            return false;
+        }
+
+        if (logrec->cr_type == CL_HARDLINK || logrec->cr_type == CL_UNLINK)
+            links = true;
+        count++;
+    }
+
+    if (count == 0)
+        return false;
+
+    /* Entry had several names: make sure the last one is removed */
+    if (links && !(cl_reader_config.mds_has_lu1331
+                   && (logrec_in->cr_flags & CLF_UNLINK_LAST))) {
+        DisplayLog(LVL_FULL, CHGLOG_TAG, "-> Entry may still have links: "
+                   "chain must be kept");
+        return false;
+    }
+
+    DisplayLog(LVL_FULL, CHGLOG_TAG, "-> Chain of %u records to be cancelled",
+               count);
+
+    rh_list_for_each_entry_safe(op, t1, &slot->list, id_hash_list) {
+        CL_REC_TYPE *logrec = op->extra_info.log_record.p_log_rec;
+
+        if (!entry_id_equal(&logrec->cr_tfid, &logrec_in->cr_tfid))
+            continue;
+
+        DisplayChangelogs("(dropped log chain %s:%llu; %s:%llu)",
+                          p_info->mdtdevice, logrec->cr_index,
+                          p_info->mdtdevice, logrec_in->cr_index);
+        drop_queued_op(p_info, op);
+    }
+
+    /* ignore the removal record as well */
+    return true;
+}
+
+#ifdef _LUSTRE_HSM
+/**
+ * If the last queued record of the entry is an HSM event of the same kind,
+ * the new record gives the resulting entry status: drop the queued one.
+ * The new record is never ignored.
+ */
+static void supersede_hsm(reader_thr_info_t *p_info, struct id_hash_slot *slot,
+                          const CL_REC_TYPE *logrec_in)
+{
+    entry_proc_op_t *op;
+
+    rh_list_for_each_entry_reverse(op, &slot->list, id_hash_list) {
+        CL_REC_TYPE *logrec = op->extra_info.log_record.p_log_rec;
+
+        /* fid not matching, check next records */
+        if (!entry_id_equal(&logrec->cr_tfid, &logrec_in->cr_tfid))
+            continue;
+
+        /* only the last record of the entry can be superseded */
+        if (logrec->cr_type == CL_HSM
+            && hsm_get_cl_event(logrec->cr_flags)
+                == hsm_get_cl_event(logrec_in->cr_flags)) {
+            DisplayLog(LVL_FULL, CHGLOG_TAG, "-> Previous HSM %s record "
+                       "superseded", get_event_name(
+                            hsm_get_cl_event(logrec_in->cr_flags)));
+            DisplayChangelogs("(superseded record %s:%llu by %s:%llu)",
+                              p_info->mdtdevice, logrec->cr_index,
+                              p_info->mdtdevice, logrec_in->cr_index);
+            drop_queued_op(p_info, op);
+        }
+        return;
+    }
+}
+#endif
+
 /* Decides whether a new changelog record can be ignored. Ignoring a
  * record should not impact the database state, however the gain is to:
  *  - reduce contention on pipeline stages with constraints,
  *  - reduce the number of DB and FS requests.
+ * Previous queued records made useless by the new record are dropped.
  *
  * Returns TRUE or FALSE.
  */
 static bool can_ignore_record(reader_thr_info_t *p_info,
                               const CL_REC_TYPE *logrec_in)
 {
-    entry_proc_op_t *op, *t1;
+    entry_proc_op_t *op;
     unsigned int ignore_mask;
     struct id_hash_slot *slot;
     char flag_buff[256] = "";
@@ -809,14 +1337,28 @@ static bool can_ignore_record(reader_thr_info_t *p_info,
 
     DisplayLog(LVL_FULL, CHGLOG_TAG, "Incoming record "CL_BASE_FORMAT,
                CL_BASE_ARG(p_info->mdtdevice, logrec_in));
-    /* The ignore field is IGNORE_MASK. At that point, the FID in the
-     * changelog record must be set. All the changelog record with the
-     * same FID will go into the same bucket, so parse that slot
-     * instead of the whole op_queue list. */
+    /* At that point, the FID in the changelog record must be set.
+     * All the changelog record with the same FID will go into the same
+     * bucket, so parse that slot instead of the whole op_queue list. */
     slot = get_hash_slot(p_info->id_hash, &logrec_in->cr_tfid);
     ignore_mask = record_filters[logrec_in->cr_type].ignore_mask;
 
-    rh_list_for_each_entry_safe_reverse(op, t1, &slot->list, id_hash_list) {
+    switch (record_filters[logrec_in->cr_type].ignore) {
+    case IGNORE_CANCEL:
+        return cancel_chain(p_info, slot, logrec_in);
+#ifdef _LUSTRE_HSM
+    case IGNORE_SUPERSEDE:
+        supersede_hsm(p_info, slot, logrec_in);
+        return false;
+#endif
+    default:
+        break;
+    }
+
+    /* the only remaining case is ignore mask */
+    assert(record_filters[logrec_in->cr_type].ignore == IGNORE_MASK);
+
+    rh_list_for_each_entry_reverse(op, &slot->list, id_hash_list) {
         CL_REC_TYPE *logrec = op->extra_info.log_record.p_log_rec;
 
         /* fid not matching, check next records */
@@ -827,34 +1369,6 @@ static bool can_ignore_record(reader_thr_info_t *p_info,
                    "    checking against previous record "CL_BASE_FORMAT,
                    CL_BASE_ARG(p_info->mdtdevice, logrec));
 
-        if (record_filters[logrec_in->cr_type].ignore == IGNORE_CANCEL) {
-            /* If there is a non-cancellable record in between, we cannot merge
-             * and cancel the whole sequence. */
-            if ((ignore_mask & (1 << logrec->cr_type)) == 0) {
-                DisplayLog(LVL_FULL, CHGLOG_TAG, "-> Significant record "
-                   "between create/unlink sequence: peer must be kept");
-                return false;
-            }
-            /* create/unlink sequence: can be cancelled */
-            DisplayLog(LVL_FULL, CHGLOG_TAG,
-                       "-> Log peer to be cancelled");
-            DisplayChangelogs("(dropped log peer %s:%llu; %s:%llu)",
-                              p_info->mdtdevice, logrec->cr_index,
-                              p_info->mdtdevice, logrec_in->cr_index);
-            /* free and remove previous record */
-            rh_list_del(&op->list);
-            rh_list_del(&op->id_hash_list);
-            p_info->op_queue_count--;
-            EntryProcessor_Release(op);
-            /* removed record was previously counted as interesting */
-            p_info->interesting_records--;
-            /* ignore second record as well */
-            return true;
-        }
-
-        /* the only remaining case is ignore mask */
-        assert(record_filters[logrec_in->cr_type].ignore == IGNORE_MASK);
-
         /* If the type of record matches what we're looking for, and
          * it's for the same FID, then we can ignore the new
          * record. */
@@ -971,6 +1485,35 @@ static CL_REC_TYPE *create_fake_unlink_record(const reader_thr_info_t *p_info,
     return rec;
 }
 
+/**
+ * Queue a fake unlink record for the target of a rename operation.
+ * If the target was created after the last pushed record, its whole chain
+ * of records is cancelled instead (e.g. temporary files renamed over).
+ */
+static void insert_fake_unlink(reader_thr_info_t *p_info, CL_REC_TYPE *rec_in)
+{
+    CL_REC_TYPE *unlink;
+    unsigned int insert_flags = 0;
+
+    unlink = create_fake_unlink_record(p_info, rec_in, &insert_flags);
+    if (unlink == NULL) {
+        DisplayLog(LVL_CRIT, CHGLOG_TAG,
+                   "Could not allocate an UNLINK record.");
+        return;
+    }
+
+    /* the fid of the target is only known if GET_FID_FROM_DB is not set */
+    if (!(insert_flags & GET_FID_FROM_DB)
+        && can_ignore_record(p_info, unlink)) {
+        p_info->cl_ops[CL_UNLINK]++;
+        p_info->cl_suppressed[CL_UNLINK]++;
+        MemFree(unlink);
+        return;
+    }
+
+    insert_into_hash(p_info, unlink, insert_flags);
+}
+
 #if defined(HAVE_CHANGELOG_EXTEND_REC) || defined(HAVE_FLEX_CL)
 /**
  * Create a fake rename record to ensure compatibility with older
@@ -1053,7 +1596,9 @@ static int process_log_rec(reader_thr_info_t *p_info, CL_REC_TYPE *p_rec)
         DisplayLog(LVL_FULL, CHGLOG_TAG, "Ignoring event %s",
                    changelog_type2str(opnum));
         p_info->suppressed_records++;
-        llapi_changelog_free(&p_rec);
+        p_info->cl_ops[opnum]++;
+        p_info->cl_suppressed[opnum]++;
+        cl_source_free(p_info->src, &p_rec);
         goto done;
     }
 
@@ -1069,7 +1614,7 @@ static int process_log_rec(reader_thr_info_t *p_info, CL_REC_TYPE *p_rec)
             dump_op_queue(p_info, LVL_CRIT, 32);
 
             /* Discarding bogus entry. */
-            llapi_changelog_free(&p_info->cl_rename);
+            cl_source_free(p_info->src, &p_info->cl_rename);
             p_info->cl_rename = NULL;
         }
 #if defined(HAVE_CHANGELOG_EXTEND_REC) || defined(HAVE_FLEX_CL)
@@ -1092,19 +1637,8 @@ static int process_log_rec(reader_thr_info_t *p_info, CL_REC_TYPE *p_rec)
                 cl_reader_config.mds_has_lu1331 = true;
             }
 
-            if (!FID_IS_ZERO(&p_rec->cr_tfid)) {
-                CL_REC_TYPE *unlink;
-                unsigned int insert_flags;
-
-                unlink = create_fake_unlink_record(p_info,
-                                                   p_rec, &insert_flags);
-                if (unlink) {
-                    insert_into_hash(p_info, unlink, insert_flags);
-                } else {
-                    DisplayLog(LVL_CRIT, CHGLOG_TAG,
-                               "Could not allocate an UNLINK record.");
-                }
-            }
+            if (!FID_IS_ZERO(&p_rec->cr_tfid))
+                insert_fake_unlink(p_info, p_rec);
 #ifdef HAVE_FLEX_CL
             cr_ren = changelog_rec_rename(p_rec);
             DisplayLog(LVL_DEBUG, CHGLOG_TAG,
@@ -1155,7 +1689,7 @@ static int process_log_rec(reader_thr_info_t *p_info, CL_REC_TYPE *p_rec)
             dump_op_queue(p_info, LVL_CRIT, 32);
 
             /* Discarding bogus entry. */
-            llapi_changelog_free(&p_rec);
+            cl_source_free(p_info->src, &p_rec);
 
             goto done;
         }
@@ -1173,20 +1707,9 @@ static int process_log_rec(reader_thr_info_t *p_info, CL_REC_TYPE *p_rec)
         /* If target fid is not zero: unlink the target.
          * e.g. "mv a b" and b exists => rm b.
          */
-        if (!FID_IS_ZERO(&p_rec->cr_tfid)) {
-            CL_REC_TYPE *unlink;
-            unsigned int insert_flags;
-
+        if (!FID_IS_ZERO(&p_rec->cr_tfid))
             /* Push an unlink. */
-            unlink = create_fake_unlink_record(p_info, p_rec, &insert_flags);
-
-            if (unlink) {
-                insert_into_hash(p_info, unlink, insert_flags);
-            } else {
-                DisplayLog(LVL_CRIT, CHGLOG_TAG,
-                           "Could not allocate an UNLINK record.");
-            }
-        }
+            insert_fake_unlink(p_info, p_rec);
 
         /* Push the rename and the ext.
          *
@@ -1224,7 +1747,7 @@ static cl_status_e cl_get_one(reader_thr_info_t *info, CL_REC_TYPE **pp_rec)
     int rc;
 
     /* get next record */
-    rc = llapi_changelog_recv(info->chglog_hdlr, pp_rec);
+    rc = info->src->recv(info->chglog_hdlr, pp_rec);
 
     if (!EMPTY_STRING(log_config.changelogs_file) && rc != 0 && rc != 1) {
         DisplayChangelogs(">>> llapi_changelog_recv returned error %d "
@@ -1238,6 +1761,17 @@ static cl_status_e cl_get_one(reader_thr_info_t *info, CL_REC_TYPE **pp_rec)
         /* Successfully retrieved a record. Update last read record. */
         update_rec_stats(&info->last_read, *pp_rec);
         info->nb_read++;
+
+        if (info->record_fp != NULL
+            && cl_file_write_rec(info->record_fp, *pp_rec) != 0) {
+            DisplayLog(LVL_CRIT, CHGLOG_TAG, "Failed to save record #%"
+                       PRIu64" to %s: %s. Stop saving records.",
+                       info->last_read.rec_id,
+                       cl_reader_config.mdt_def[info->thr_index].record_file,
+                       strerror(errno));
+            fclose(info->record_fp);
+            info->record_fp = NULL;
+        }
         return cl_ok;
 
     case 1:    /* EOF */
@@ -1271,8 +1805,8 @@ static cl_status_e cl_get_one(reader_thr_info_t *info, CL_REC_TYPE **pp_rec)
 
         info->nb_reopen++;
 
-        rc = llapi_changelog_start(&info->chglog_hdlr, info->flags,
-                                   info->mdtdevice, info->last_read.rec_id + 1);
+        rc = info->src->start(&info->chglog_hdlr, info->flags,
+                              info->src_device, info->last_read.rec_id + 1);
         if (rc) {
             /* will try to recover from this error */
             rh_sleep(1);
@@ -1311,9 +1845,13 @@ static void *chglog_reader_thr(void *arg)
 
     /* loop until a TERM signal is caught */
     while (!info->force_stop) {
+        bool check_time = (next_push_time <= time(NULL));
+
         /* Is it time to flush? */
-        if (info->op_queue_count >= cl_reader_config.queue_max_size ||
-            next_push_time <= time(NULL)) {
+        if (info->op_queue_count >= info->queue_size || check_time) {
+            if (check_time)
+                adjust_queue(info);
+
             process_op_queue(info, false);
 
             next_push_time = time(NULL) + cl_reader_config.queue_check_interval;
@@ -1454,14 +1992,40 @@ int cl_reader_start(run_flags_t flags, int mdt_index)
         memset(info, 0, sizeof(reader_thr_info_t));
         info->thr_index = i;
         rh_list_init(&info->op_queue);
+        pthread_mutex_init(&info->commit_lock, NULL);
+        pthread_mutex_init(&info->clear_lock, NULL);
         info->last_report = time(NULL);
         info->id_hash = id_hash_init(
-            max_count_to_hash_size(cl_reader_config.queue_max_size), false);
+            max_count_to_hash_size(cl_reader_config.adaptive_queue ?
+                                   MAX2(cl_reader_config.queue_max_size_limit,
+                                        cl_reader_config.queue_max_size) :
+                                   cl_reader_config.queue_max_size), false);
+        info->queue_size = cl_reader_config.queue_max_size;
+        info->queue_age = cl_reader_config.queue_max_age;
+        info->push_batch = 1;
 
         snprintf(mdtdevice, 128, "%s-%s", get_fsname(),
                  cl_reader_config.mdt_def[i].mdt_name);
 
         info->mdtdevice = strdup(mdtdevice);
+        gettimeofday(&info->start_time, NULL);
+
+        if (!EMPTY_STRING(cl_reader_config.mdt_def[i].source_file)) {
+            info->src = &cl_source_file;
+            info->src_device = cl_reader_config.mdt_def[i].source_file;
+            DisplayLog(LVL_MAJOR, CHGLOG_TAG, "Reading records for %s from "
+                       "file '%s'", mdtdevice, info->src_device);
+        } else {
+            info->src = &cl_source_lustre;
+            info->src_device = info->mdtdevice;
+        }
+
+        if (!EMPTY_STRING(cl_reader_config.mdt_def[i].record_file)) {
+            info->record_fp =
+                cl_file_open_write(cl_reader_config.mdt_def[i].record_file);
+            if (info->record_fp == NULL)
+                return EIO;
+        }
         info->flags =
             ((one_shot
               || cl_reader_config.force_polling) ? 0 : CHANGELOG_FLAG_FOLLOW)
@@ -1478,14 +2042,14 @@ int cl_reader_start(run_flags_t flags, int mdt_index)
                 last_rec++;
         }
         DisplayLog(LVL_DEBUG, CHGLOG_TAG,
-                   "Opening chglog for %s (start_rec=%llu)", mdtdevice,
+                   "Opening chglog for %s (start_rec=%llu)", info->src_device,
                    last_rec);
 
         /* open the changelog (if we are in one_shot mode,
          * don't use the CHANGELOG_FLAG_FOLLOW flag)
          */
-        rc = llapi_changelog_start(&info->chglog_hdlr,
-                                   info->flags, info->mdtdevice, last_rec);
+        rc = info->src->start(&info->chglog_hdlr, info->flags,
+                              info->src_device, last_rec);
 
         if (rc) {
             DisplayLog(LVL_CRIT, CHGLOG_TAG,
@@ -1495,12 +2059,12 @@ int cl_reader_start(run_flags_t flags, int mdt_index)
         }
 
         /* then create the thread that manages it */
-        if (pthread_create(&info->thr_id, NULL, chglog_reader_thr, info)) {
-            int err = errno;
+        rc = pthread_create(&info->thr_id, NULL, chglog_reader_thr, info);
+        if (rc) {
             DisplayLog(LVL_CRIT, CHGLOG_TAG,
                        "ERROR creating ChangeLog reader thread: %s",
-                       strerror(err));
-            return err;
+                       strerror(rc));
+            return rc;
         }
 
     }
@@ -1508,6 +2072,17 @@ int cl_reader_start(run_flags_t flags, int mdt_index)
     if (dbget)
         ListMgr_CloseAccess(&lmgr);
 
+    /* start the thread that saves last committed records */
+    commit_thr_stop = false;
+    rc = pthread_create(&commit_thr_id, NULL, commit_thr, NULL);
+    if (rc) {
+        DisplayLog(LVL_CRIT, CHGLOG_TAG,
+                   "ERROR creating ChangeLog commit thread: %s",
+                   strerror(rc));
+        return rc;
+    }
+    commit_thr_started = true;
+
     return 0;
 }
 
@@ -1551,6 +2126,9 @@ int cl_reader_done(void)
     int rc;
     int i;
 
+    /* last commits are saved below */
+    commit_thr_terminate();
+
     for (i = 0; i < cl_reader_config.mdt_count; i++) {
         reader_thr_info_t *info = &reader_info[i];
 
@@ -1558,14 +2136,42 @@ int cl_reader_done(void)
         clear_changelog_records(info);
 
         log_close(info);
+
+        if (info->pending != NULL) {
+            MemFree(info->pending);
+            info->pending = NULL;
+        }
+
+        if (info->record_fp != NULL) {
+            fclose(info->record_fp);
+            info->record_fp = NULL;
+        }
     }
 
     cl_reader_dump_stats();
 
+    /* overall throughput, from reading to DB commit */
+    for (i = 0; i < cl_reader_config.mdt_count; i++) {
+        reader_thr_info_t *info = &reader_info[i];
+        struct timeval now, elapsed;
+        double sec;
+
+        gettimeofday(&now, NULL);
+        timersub(&now, &info->start_time, &elapsed);
+        sec = elapsed.tv_sec + elapsed.tv_usec * 0.000001;
+
+        if (info->nb_read > 0 && sec > 0)
+            DisplayLog(LVL_MAJOR, "STATS", "ChangeLog reader #%u: %llu "
+                       "records processed in %.2f sec (%.2f rec/sec)", i,
+                       info->nb_read, sec, info->nb_read / sec);
+    }
+
     /* need DB access to save changelog stats */
     rc = ListMgr_InitAccess(&lmgr);
     if (rc != DB_SUCCESS)
         return 0;
+    for (i = 0; i < cl_reader_config.mdt_count; i++)
+        store_last_commit(&lmgr, &reader_info[i], true);
     cl_reader_store_stats(&lmgr);
     ListMgr_CloseAccess(&lmgr);
 
@@ -1639,6 +2245,11 @@ int cl_reader_dump_stats(void)
                    reader_info[i].suppressed_records);
         DisplayLog(LVL_MAJOR, "STATS", "   records pending     = %u",
                    reader_info[i].op_queue_count);
+        DisplayLog(LVL_MAJOR, "STATS", "   queue size          = %u "
+                   "(max age: %lds, push batch: %u)%s",
+                   reader_info[i].queue_size, reader_info[i].queue_age,
+                   reader_info[i].push_batch,
+                   cl_reader_config.adaptive_queue ? " (adaptive)" : "");
 
         if (reader_info[i].force_stop)
             DisplayLog(LVL_MAJOR, "STATS",
@@ -1694,6 +2305,34 @@ int cl_reader_dump_stats(void)
         /* last unflushed line */
         if (ptr != tmp_buff)
             DisplayLog(LVL_MAJOR, "STATS", "   %s", tmp_buff);
+
+        DisplayLog(LVL_MAJOR, "STATS", "   Coalescing (suppressed/total):");
+
+        tmp_buff[0] = '\0';
+        ptr = tmp_buff;
+        for (j = 0; j < CL_LAST; j++) {
+            const reader_thr_info_t *info = &reader_info[i];
+
+            if (info->cl_suppressed[j] == 0)
+                continue;
+
+            /* flush full line */
+            if (ptr - tmp_buff >= 80) {
+                DisplayLog(LVL_MAJOR, "STATS", "   %s", tmp_buff);
+                tmp_buff[0] = '\0';
+                ptr = tmp_buff;
+            }
+            if (ptr != tmp_buff)
+                ptr += sprintf(ptr, ", ");
+
+            ptr += sprintf(ptr, "%s: %llu/%llu (%.1f%%)",
+                           changelog_type2str(j), info->cl_suppressed[j],
+                           info->cl_ops[j],
+                           100.0 * info->cl_suppressed[j] / info->cl_ops[j]);
+        }
+        /* last unflushed line */
+        if (ptr != tmp_buff)
+            DisplayLog(LVL_MAJOR, "STATS", "   %s", tmp_buff);
     }
 
     return 0;
@@ -1709,7 +2348,7 @@ static void store_thread_info(lmgr_t *lmgr, reader_thr_info_t *info)
     store_rec_stats(lmgr, info, CL_LAST_READ_REC, &info->last_read);
     store_rec_stats(lmgr, info, CL_LAST_PUSHED_REC, &info->last_push);
     store_rec_stats(lmgr, info, CL_LAST_CLEARED_REC, &info->last_clear);
-    /* CL_LAST_COMMITTED_REC is updated by entry processor callbacks */
+    /* CL_LAST_COMMITTED_REC is updated by the commit thread */
 
     for (i = 0; i < CL_LAST; i++) {
         char last_val[256];
@@ -56,6 +56,9 @@ static void cl_reader_set_default_cfg(void *module_config)
     p_config->queue_max_size = 1000;
     p_config->queue_max_age = 5;    /* 5s */
     p_config->queue_check_interval = 1; /* every second */
+    p_config->adaptive_queue = false;
+    p_config->queue_max_size_limit = 10000;
+    p_config->queue_max_age_limit = 30; /* 30s */
     p_config->commit_update_max_delay = 5;
     p_config->commit_update_max_delta = 10000;
 
@@ -81,6 +84,9 @@ static void cl_reader_write_default(FILE *output)
     print_line(output, 1, "queue_max_size   : 1000");
     print_line(output, 1, "queue_max_age    : 5s");
     print_line(output, 1, "queue_check_interval : 1s");
+    print_line(output, 1, "adaptive_queue   : no");
+    print_line(output, 1, "queue_max_size_limit : 10000");
+    print_line(output, 1, "queue_max_age_limit  : 30s");
     print_line(output, 1, "commit_update_max_delay : 5s");
     print_line(output, 1, "commit_update_max_delta : 10k");
     print_line(output, 1, "mds_has_lu543    : no");
@@ -105,6 +111,13 @@ static void cl_reader_write_template(FILE *output)
     print_line(output, 2,
                "# as returned by \"lctl changelog_register\" command");
     print_line(output, 2, "reader_id = \"cl1\" ;");
+    fprintf(output, "\n");
+    print_line(output, 2, "# uncomment to save received records to a file,");
+    print_line(output, 2, "# to be replayed later using 'source_file'");
+    print_line(output, 2, "#record_file = \"/var/tmp/MDT0000.cl\" ;");
+    print_line(output, 2, "# uncomment to read records from a file instead"
+               " of the MDT");
+    print_line(output, 2, "#source_file = \"/var/tmp/MDT0000.cl\" ;");
 
     print_end_block(output, 1);
 
@@ -134,6 +147,11 @@ static void cl_reader_write_template(FILE *output)
     print_line(output, 1, "queue_max_size   = 1000 ;");
     print_line(output, 1, "queue_max_age    = 5s ;");
     print_line(output, 1, "queue_check_interval = 1s ;");
+    print_line(output, 1, "# grow the queue up to these limits when the "
+               "pipeline is loaded");
+    print_line(output, 1, "#adaptive_queue   = yes ;");
+    print_line(output, 1, "#queue_max_size_limit = 10000 ;");
+    print_line(output, 1, "#queue_max_age_limit  = 30s ;");
     print_line(output, 1, "# delays to update last committed record in the DB");
     print_line(output, 1, "commit_update_max_delay = 5s ;");
     print_line(output, 1, "commit_update_max_delta = 10k ;");
@@ -152,15 +170,42 @@ static void cl_reader_write_template(FILE *output)
         } \
     } while (0)
 
+/** get an optional file path from a MDT block */
+static int parse_mdt_file(config_item_t config_blk, const char *block_name,
+                          const char *var, char *path, char *msg_out)
+{
+    char *str;
+    bool unique = true;
+
+    path[0] = '\0';
+    str = rh_config_GetKeyValueByName(config_blk, var, &unique);
+    if (str == NULL)
+        return 0;
+
+    if (!unique) {
+        sprintf(msg_out, "Found duplicate parameter '%s' in %s.\n", var,
+                block_name);
+        return EEXIST;
+    } else if (strlen(str) >= RBH_PATH_MAX) {
+        sprintf(msg_out, "%s '%s' is too long (max length=%u)", var, str,
+                RBH_PATH_MAX);
+        return ENAMETOOLONG;
+    }
+    strcpy(path, str);
+    return 0;
+}
+
 static int parse_mdt_block(config_item_t config_blk, const char *block_name,
                            mdt_def_t *p_mdt_def, char *msg_out)
 {
     char *str;
     bool unique;
+    int rc;
 
-    /* 2 variables expected : 'mdt_name' and 'reader_id' */
+    /* 2 variables expected : 'mdt_name' and 'reader_id'.
+     * Source and record files are optional. */
     static const char * const expected_vars[] = {
-        "mdt_name", "reader_id", NULL
+        "mdt_name", "reader_id", "source_file", "record_file", NULL
     };
 
     /* get 'mdt_name' value */
@@ -206,6 +251,15 @@ static int parse_mdt_block(config_item_t config_blk, const char *block_name,
         strcpy(p_mdt_def->reader_id, str);
     }
 
+    rc = parse_mdt_file(config_blk, block_name, "source_file",
+                        p_mdt_def->source_file, msg_out);
+    if (rc)
+        return rc;
+    rc = parse_mdt_file(config_blk, block_name, "record_file",
+                        p_mdt_def->record_file, msg_out);
+    if (rc)
+        return rc;
+
     /* display warnings for unknown parameters */
     CheckUnknownParameters(config_blk, block_name, expected_vars);
 
@@ -224,6 +278,7 @@ static int cl_reader_read_cfg(config_file_t config, void *module_config,
     static const char *cl_cfg_allow[] = {
         "force_polling", "polling_interval", "batch_ack_count",
         "queue_max_size", "queue_max_age", "queue_check_interval",
+        "adaptive_queue", "queue_max_size_limit", "queue_max_age_limit",
         "commit_update_max_delay", "commit_update_max_delta",
         "mds_has_lu543", "mds_has_lu1331", MDT_DEF_BLOCK,
         NULL
@@ -241,6 +296,11 @@ static int cl_reader_read_cfg(config_file_t config, void *module_config,
          &p_config->queue_max_age, 0},
         {"queue_check_interval", PT_DURATION, PFLG_NOT_NULL | PFLG_POSITIVE,
          &p_config->queue_check_interval, 0},
+        {"adaptive_queue", PT_BOOL, 0, &p_config->adaptive_queue, 0},
+        {"queue_max_size_limit", PT_INT, PFLG_NOT_NULL | PFLG_POSITIVE,
+         &p_config->queue_max_size_limit, 0},
+        {"queue_max_age_limit", PT_DURATION, PFLG_NOT_NULL | PFLG_POSITIVE,
+         &p_config->queue_max_age_limit, 0},
         {"commit_update_max_delta", PT_INT64, PFLG_POSITIVE,
          &p_config->commit_update_max_delta, 0},
         {"commit_update_max_delay", PT_DURATION, PFLG_POSITIVE,
@@ -352,6 +412,12 @@ static int cl_reader_reload_cfg(chglog_reader_config_t *cfg)
                       "%ld",);
     SCALAR_PARAM_UPDT(cfg, queue_check_interval, CHGLOG_CFG_BLOCK,
                       "queue_check_interval", "%ld",);
+    SCALAR_PARAM_UPDT(cfg, adaptive_queue, CHGLOG_CFG_BLOCK, "adaptive_queue",
+                      "%s", bool2str);
+    SCALAR_PARAM_UPDT(cfg, queue_max_size_limit, CHGLOG_CFG_BLOCK,
+                      "queue_max_size_limit", "%u",);
+    SCALAR_PARAM_UPDT(cfg, queue_max_age_limit, CHGLOG_CFG_BLOCK,
+                      "queue_max_age_limit", "%ld",);
     SCALAR_PARAM_UPDT(cfg, commit_update_max_delta, CHGLOG_CFG_BLOCK,
                       "commit_update_max_delta", "%"PRIu64,);
     SCALAR_PARAM_UPDT(cfg, commit_update_max_delay, CHGLOG_CFG_BLOCK,
@@ -378,6 +444,14 @@ static int cl_reader_reload_cfg(chglog_reader_config_t *cfg)
                  cl_reader_config.mdt_def[i].reader_id))
                 NO_PARAM_UPDT_MSG(CHGLOG_CFG_BLOCK "::" MDT_DEF_BLOCK,
                                   "reader_id");
+            if (strcmp(cfg->mdt_def[i].source_file,
+                       cl_reader_config.mdt_def[i].source_file))
+                NO_PARAM_UPDT_MSG(CHGLOG_CFG_BLOCK "::" MDT_DEF_BLOCK,
+                                  "source_file");
+            if (strcmp(cfg->mdt_def[i].record_file,
+                       cl_reader_config.mdt_def[i].record_file))
+                NO_PARAM_UPDT_MSG(CHGLOG_CFG_BLOCK "::" MDT_DEF_BLOCK,
+                                  "record_file");
         }
     }
 
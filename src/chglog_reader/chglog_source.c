@@ -0,0 +1,244 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * vim:expandtab:shiftwidth=4:tabstop=4:
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the CeCILL License.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL license (http://www.cecill.info) and that you
+ * accept its terms.
+ */
+
+/**
+ * \file    chglog_source.c
+ * \brief   Sources of changelog records.
+ *
+ * Besides Lustre MDTs, changelog records can be read from files, so the
+ * changelog processing can be replayed and profiled without a live MDT.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "chglog_source.h"
+#include "rbh_logs.h"
+#include "rbh_misc.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define CLSRC_TAG "ChangeLogSrc"
+
+/* ---------- Lustre MDT changelogs ---------- */
+
+/* wrappers, as llapi prototypes vary between Lustre versions */
+static int cl_lustre_start(void **hdlr, int flags, const char *device,
+                           long long startrec)
+{
+    return llapi_changelog_start(hdlr, flags, device, startrec);
+}
+
+static int cl_lustre_recv(void *hdlr, CL_REC_TYPE **rec)
+{
+    return llapi_changelog_recv(hdlr, rec);
+}
+
+static int cl_lustre_clear(const char *device, const char *reader_id,
+                           long long endrec)
+{
+    return llapi_changelog_clear(device, reader_id, endrec);
+}
+
+static int cl_lustre_fini(void **hdlr)
+{
+    return llapi_changelog_fini(hdlr);
+}
+
+const cl_source_t cl_source_lustre = {
+    .name = "lustre",
+    .start = cl_lustre_start,
+    .recv = cl_lustre_recv,
+    .clear = cl_lustre_clear,
+    .fini = cl_lustre_fini,
+    .local_alloc = false,
+};
+
+/* ---------- record files ---------- */
+
+static void cl_file_hdr_init(cl_file_hdr_t *hdr)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, CL_FILE_MAGIC, sizeof(hdr->magic));
+    hdr->rec_struct_size = sizeof(CL_REC_TYPE);
+#ifdef HAVE_FLEX_CL
+    hdr->flags |= CL_FILE_FLAG_FLEX;
+#endif
+}
+
+FILE *cl_file_open_write(const char *path)
+{
+    struct stat st;
+    FILE *f;
+
+    f = fopen(path, "a");
+    if (f == NULL) {
+        DisplayLog(LVL_CRIT, CLSRC_TAG, "Failed to open '%s' for writing: %s",
+                   path, strerror(errno));
+        return NULL;
+    }
+
+    if (fstat(fileno(f), &st) == 0 && st.st_size == 0) {
+        cl_file_hdr_t hdr;
+
+        cl_file_hdr_init(&hdr);
+        if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+            DisplayLog(LVL_CRIT, CLSRC_TAG, "Failed to write to '%s': %s",
+                       path, strerror(errno));
+            fclose(f);
+            return NULL;
+        }
+    }
+    return f;
+}
+
+int cl_file_write_rec(FILE *f, const CL_REC_TYPE *rec)
+{
+    uint32_t size = cl_rec_size(rec);
+
+    if (fwrite(&size, sizeof(size), 1, f) != 1
+        || fwrite(rec, size, 1, f) != 1)
+        return errno ? -errno : -EIO;
+    return 0;
+}
+
+/** reader of a record file */
+struct cl_file_hdlr {
+    FILE       *f;
+    char       *path;
+    long long   startrec;
+};
+
+static int cl_file_start(void **hdlr, int flags, const char *path,
+                         long long startrec)
+{
+    struct cl_file_hdlr *h;
+    cl_file_hdr_t hdr, expected;
+    int rc;
+
+    h = calloc(1, sizeof(*h));
+    if (h == NULL)
+        return -ENOMEM;
+
+    h->f = fopen(path, "r");
+    if (h->f == NULL) {
+        rc = -errno;
+        DisplayLog(LVL_CRIT, CLSRC_TAG, "Failed to open '%s': %s", path,
+                   strerror(-rc));
+        goto free_h;
+    }
+
+    cl_file_hdr_init(&expected);
+    if (fread(&hdr, sizeof(hdr), 1, h->f) != 1
+        || memcmp(hdr.magic, expected.magic, sizeof(hdr.magic)) != 0) {
+        DisplayLog(LVL_CRIT, CLSRC_TAG, "'%s' is not a changelog record file",
+                   path);
+        rc = -EINVAL;
+        goto close_f;
+    }
+    if (hdr.rec_struct_size != expected.rec_struct_size
+        || hdr.flags != expected.flags) {
+        DisplayLog(LVL_CRIT, CLSRC_TAG, "'%s': changelog record layout "
+                   "(size=%u, flags=%#x) doesn't match this build "
+                   "(size=%u, flags=%#x)", path, hdr.rec_struct_size,
+                   hdr.flags, expected.rec_struct_size, expected.flags);
+        rc = -EPROTO;
+        goto close_f;
+    }
+
+    h->path = strdup(path);
+    h->startrec = startrec;
+    *hdlr = h;
+    return 0;
+
+ close_f:
+    fclose(h->f);
+ free_h:
+    free(h);
+    return rc;
+}
+
+static int cl_file_recv(void *hdlr, CL_REC_TYPE **prec)
+{
+    struct cl_file_hdlr *h = hdlr;
+    CL_REC_TYPE *rec;
+    uint32_t size;
+
+    for (;;) {
+        if (fread(&size, sizeof(size), 1, h->f) != 1)
+            return 1;   /* EOF */
+
+        if (size < sizeof(CL_REC_TYPE) || size > CL_FILE_REC_MAX) {
+            DisplayLog(LVL_CRIT, CLSRC_TAG, "'%s': invalid record size %u "
+                       "at offset %ld: stopping there", h->path, size,
+                       ftell(h->f) - (long)sizeof(size));
+            return 1;
+        }
+
+        /* names are not always null-terminated in records */
+        rec = malloc(size + 1);
+        if (rec == NULL)
+            return -ENOMEM;
+        ((char *)rec)[size] = '\0';
+
+        if (fread(rec, size, 1, h->f) != 1) {
+            DisplayLog(LVL_MAJOR, CLSRC_TAG, "'%s': truncated last record",
+                       h->path);
+            free(rec);
+            return 1;
+        }
+
+        /* skip records before the start record */
+        if (rec->cr_index >= h->startrec)
+            break;
+        free(rec);
+    }
+
+    *prec = rec;
+    return 0;
+}
+
+/** records are not removed from files */
+static int cl_file_clear(const char *path, const char *reader_id,
+                         long long endrec)
+{
+    DisplayLog(LVL_FULL, CLSRC_TAG, "%s: records up to #%lld acknowledged",
+               path, endrec);
+    return 0;
+}
+
+static int cl_file_fini(void **hdlr)
+{
+    struct cl_file_hdlr *h = *hdlr;
+
+    if (h == NULL)
+        return 0;
+
+    fclose(h->f);
+    free(h->path);
+    free(h);
+    *hdlr = NULL;
+    return 0;
+}
+
+const cl_source_t cl_source_file = {
+    .name = "file",
+    .start = cl_file_start,
+    .recv = cl_file_recv,
+    .clear = cl_file_clear,
+    .fini = cl_file_fini,
+    .local_alloc = true,
+};
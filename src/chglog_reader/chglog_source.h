@@ -0,0 +1,93 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * vim:expandtab:shiftwidth=4:tabstop=4:
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the CeCILL License.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL license (http://www.cecill.info) and that you
+ * accept its terms.
+ */
+
+/**
+ * \file    chglog_source.h
+ * \brief   Sources of changelog records: Lustre MDT changelogs,
+ *          or files of recorded (or generated) records.
+ */
+#ifndef _CHGLOG_SOURCE_H
+#define _CHGLOG_SOURCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "lustre_extended_types.h"
+
+/** Operations of a changelog record source.
+ *  They have the same semantics as the matching llapi_changelog_* calls.
+ */
+typedef struct cl_source {
+    const char *name;
+
+    /** open the source at record startrec */
+    int  (*start)(void **hdlr, int flags, const char *device,
+                  long long startrec);
+    /** get the next record: 0 on success, 1 at end of source,
+     *  a negative error code else */
+    int  (*recv)(void *hdlr, CL_REC_TYPE **rec);
+    /** acknowledge records up to endrec */
+    int  (*clear)(const char *device, const char *reader_id,
+                  long long endrec);
+    int  (*fini)(void **hdlr);
+
+    /** records are allocated by malloc() and must be released by free() */
+    bool local_alloc;
+} cl_source_t;
+
+/** records from a Lustre MDT */
+extern const cl_source_t cl_source_lustre;
+/** records from a file written by cl_file_write_rec() */
+extern const cl_source_t cl_source_file;
+
+/** release a record received from a source */
+static inline void cl_source_free(const cl_source_t *src, CL_REC_TYPE **rec)
+{
+    if (src->local_alloc) {
+        free(*rec);
+        *rec = NULL;
+    } else
+        llapi_changelog_free(rec);
+}
+
+/*
+ * Record files start with a cl_file_hdr_t, followed by records, each one
+ * preceded by its size as a 32 bits integer.
+ * Records are stored in the layout of the Lustre version robinhood is built
+ * for, so files can only be replayed by a build for the same layout.
+ */
+#define CL_FILE_MAGIC       "RBHCLOG1"
+#define CL_FILE_FLAG_FLEX   0x0001  /**< records have the flexible layout */
+
+typedef struct cl_file_hdr {
+    char     magic[8];
+    uint32_t rec_struct_size;   /**< sizeof(CL_REC_TYPE) */
+    uint32_t flags;
+} cl_file_hdr_t;
+
+/** max size of a record in a file */
+#define CL_FILE_REC_MAX     (64 * 1024)
+
+/** size of a record, including its extensions and names */
+static inline size_t cl_rec_size(const CL_REC_TYPE *rec)
+{
+    return (size_t)(rh_get_cl_cr_name(rec) - (char *)rec) + rec->cr_namelen;
+}
+
+/** open a record file for writing, and write its header if it is empty */
+FILE *cl_file_open_write(const char *path);
+
+/** append a record to a record file */
+int cl_file_write_rec(FILE *f, const CL_REC_TYPE *rec);
+
+#endif
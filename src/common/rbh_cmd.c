@@ -24,6 +24,7 @@
 
 #include <assert.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #define TAG "ExecCmd"
 
@@ -51,6 +52,19 @@ struct exec_ctx {
     GMainContext *gctx;
     int           ref;
     int           rc;
+    /* for asynchronous commands: called instead of stopping the loop */
+    exec_done_cb_t done_cb;
+    void         *done_arg;
+};
+
+/**
+ * Context of an asynchronous command, released when the command terminates.
+ * exec_ctx must be the first member.
+ */
+struct async_ctx {
+    struct exec_ctx    exec_ctx;
+    struct io_chan_arg out_args;
+    struct io_chan_arg err_args;
 };
 
 static inline void ctx_incref(struct exec_ctx *ctx)
@@ -62,8 +76,15 @@ static inline void ctx_incref(struct exec_ctx *ctx)
 static inline void ctx_decref(struct exec_ctx *ctx)
 {
     assert(ctx->ref > 0);
-    if (--ctx->ref == 0)
+    if (--ctx->ref > 0)
+        return;
+
+    if (ctx->done_cb == NULL) {
         g_main_loop_quit(ctx->loop);
+    } else {
+        ctx->done_cb(ctx->done_arg, ctx->rc);
+        free(ctx);
+    }
 }
 
 /** convert process return code to errno-like value */
@@ -323,6 +344,135 @@ int execute_shell_command(char **cmd, parse_cb_t cb_func, void *cb_arg)
     return rc ? rc : ctx.rc;
 }
 
+/**
+ * Event loop running the watchers of all asynchronous commands.
+ */
+static GMainContext    *async_gctx;
+static GMainLoop       *async_loop;
+static pthread_t        async_thread;
+static pthread_once_t   async_once = PTHREAD_ONCE_INIT;
+
+static void *async_loop_thr(void *arg)
+{
+    g_main_context_push_thread_default(async_gctx);
+    g_main_loop_run(async_loop);
+    g_main_context_pop_thread_default(async_gctx);
+    return NULL;
+}
+
+static void async_loop_init(void)
+{
+    int rc;
+
+    async_gctx = g_main_context_new();
+    async_loop = g_main_loop_new(async_gctx, false);
+
+    rc = pthread_create(&async_thread, NULL, async_loop_thr, NULL);
+    if (rc) {
+        DisplayLog(LVL_CRIT, TAG, "Failed to start command event loop: %s",
+                   strerror(rc));
+        g_main_loop_unref(async_loop);
+        g_main_context_unref(async_gctx);
+        async_loop = NULL;
+        async_gctx = NULL;
+    }
+}
+
+/** attach a source to the asynchronous command loop */
+static void async_attach(GSource *source, GSourceFunc func, gpointer data)
+{
+    g_source_set_callback(source, func, data, NULL);
+    g_source_attach(source, async_gctx);
+    g_source_unref(source);
+}
+
+/**
+ * Start an external command, and handle its output and termination in
+ * a single event loop thread shared by all asynchronous commands.
+ */
+int execute_shell_command_async(char **cmd, parse_cb_t cb_func, void *cb_arg,
+                                exec_done_cb_t done_cb, void *done_arg)
+{
+    struct async_ctx   *actx;
+    GPid                pid;
+    GError             *err_desc = NULL;
+    GSpawnFlags         flags = G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD;
+    GIOChannel         *out_chan = NULL;
+    GIOChannel         *err_chan = NULL;
+    char               *log_cmd;
+    int                 p_stdout;
+    int                 p_stderr;
+    bool                success;
+
+    pthread_once(&async_once, async_loop_init);
+    if (async_gctx == NULL)
+        return -ECHILD;
+
+    actx = calloc(1, sizeof(*actx));
+    if (actx == NULL)
+        return -ENOMEM;
+
+    actx->exec_ctx.done_cb = done_cb;
+    actx->exec_ctx.done_arg = done_arg;
+
+    DisplayLog(LVL_DEBUG, TAG, "Spawning external command \"%s\" "
+               "(asynchronous)", cmd[0]);
+
+    success = g_spawn_async_with_pipes(NULL, cmd, NULL, flags, NULL, NULL,
+                                       &pid, NULL,
+                                       cb_func ? &p_stdout : NULL,
+                                       cb_func ? &p_stderr : NULL,
+                                       &err_desc);
+    if (!success) {
+        log_cmd = concat_cmd(cmd);
+        DisplayLog(LVL_MAJOR, TAG, "Failed to execute \"%s\": %s",
+                   log_cmd, err_desc->message);
+        free(log_cmd);
+        g_error_free(err_desc);
+        free(actx);
+        return -ECHILD;
+    }
+
+    if (cb_func != NULL) {
+        actx->out_args.ident    = STDOUT_FILENO;
+        actx->out_args.cb       = cb_func;
+        actx->out_args.udata    = cb_arg;
+        actx->out_args.exec_ctx = &actx->exec_ctx;
+        actx->err_args.ident    = STDERR_FILENO;
+        actx->err_args.cb       = cb_func;
+        actx->err_args.udata    = cb_arg;
+        actx->err_args.exec_ctx = &actx->exec_ctx;
+
+        out_chan = g_io_channel_unix_new(p_stdout);
+        err_chan = g_io_channel_unix_new(p_stderr);
+
+        g_io_channel_set_close_on_unref(out_chan, true);
+        g_io_channel_set_close_on_unref(err_chan, true);
+
+        if (iochan_null_enc(out_chan) || iochan_null_enc(err_chan)) {
+            /* just wait for the command termination */
+            g_io_channel_unref(out_chan);
+            g_io_channel_unref(err_chan);
+            out_chan = err_chan = NULL;
+        }
+    }
+
+    /* Take all references before attaching any watcher: once attached,
+     * they can be released at any time by the loop thread. */
+    actx->exec_ctx.ref = (out_chan != NULL) ? 3 : 1;
+
+    if (out_chan != NULL) {
+        async_attach(g_io_create_watch(out_chan, G_IO_IN | G_IO_HUP),
+                     (GSourceFunc) readline_cb, &actx->out_args);
+        async_attach(g_io_create_watch(err_chan, G_IO_IN | G_IO_HUP),
+                     (GSourceFunc) readline_cb, &actx->err_args);
+    }
+    async_attach(g_child_watch_source_new(pid), (GSourceFunc) watch_child_cb,
+                 &actx->exec_ctx);
+
+    return 0;
+}
+
 /**
  * Template callback to redirect stderr to robinhood log
  * @param arg (void*)log_level.
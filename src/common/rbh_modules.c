@@ -122,6 +122,7 @@ static int module_load_from_file(const char *libfile, rbh_module_t *mod)
       {"mod_get_version",        &mod->mod_ops.mod_get_version,        true},
       {"mod_get_status_manager", &mod->mod_ops.mod_get_status_manager, false},
       {"mod_get_action",         &mod->mod_ops.mod_get_action,         false},
+      {"mod_get_batch_action",   &mod->mod_ops.mod_get_batch_action,   false},
       {"mod_get_scheduler",      &mod->mod_ops.mod_get_scheduler,      false},
     };
 
@@ -315,11 +316,11 @@ static rbh_module_t *module_get(const char *mod_name)
     return NULL;
 }
 
-action_func_t module_get_action(const char *name)
+/** get the module of a function named <module_name>.<function> */
+static rbh_module_t *module_get_by_func(const char *name)
 {
     char             mod_name[MAX_MOD_NAMELEN];
     char            *prefix;
-    rbh_module_t    *mod;
 
     prefix = strchr(name, '.');
     if (prefix == NULL)
@@ -328,13 +329,31 @@ action_func_t module_get_action(const char *name)
     memcpy(mod_name, name, prefix - name);
     mod_name[prefix - name] = '\0';
 
-    mod = module_get(mod_name);
+    return module_get(mod_name);
+}
+
+action_func_t module_get_action(const char *name)
+{
+    rbh_module_t    *mod;
+
+    mod = module_get_by_func(name);
     if (mod == NULL || mod->mod_ops.mod_get_action == NULL)
         return NULL;
 
     return mod->mod_ops.mod_get_action(name);
 }
 
+action_batch_func_t module_get_batch_action(const char *name)
+{
+    rbh_module_t    *mod;
+
+    mod = module_get_by_func(name);
+    if (mod == NULL || mod->mod_ops.mod_get_batch_action == NULL)
+        return NULL;
+
+    return mod->mod_ops.mod_get_batch_action(name);
+}
+
 status_manager_t *module_get_status_manager(const char *name)
 {
     rbh_module_t    *mod;
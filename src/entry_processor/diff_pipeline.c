@@ -44,6 +44,8 @@ static inline bool err_missing(int rc)
 /* forward declaration of EntryProc functions of pipeline */
 static int EntryProc_get_fid(struct entry_proc_op_t *, lmgr_t *);
 static int EntryProc_get_info_db(struct entry_proc_op_t *, lmgr_t *);
+static int EntryProc_get_info_db_batch(struct entry_proc_op_t **, int,
+                                       lmgr_t *);
 static int EntryProc_get_info_fs(struct entry_proc_op_t *, lmgr_t *);
 static int EntryProc_report_diff(struct entry_proc_op_t *, lmgr_t *);
 static int EntryProc_apply(struct entry_proc_op_t *, lmgr_t *);
@@ -53,6 +55,9 @@ static int EntryProc_report_rm(struct entry_proc_op_t *, lmgr_t *);
 /* forward declaration to check batchable operations for db_apply stage */
 static bool dbop_is_batchable(struct entry_proc_op_t *,
                               struct entry_proc_op_t *, attr_mask_t *);
+/* forward declaration to check batchable operations for get_info_db stage */
+static bool dbget_is_batchable(struct entry_proc_op_t *,
+                               struct entry_proc_op_t *, attr_mask_t *);
 
 /* pipeline stages */
 enum {
@@ -79,7 +84,8 @@ const pipeline_descr_t diff_pipeline_descr = {
 pipeline_stage_t diff_pipeline[] = {
     {STAGE_GET_FID, "STAGE_GET_FID", EntryProc_get_fid, NULL, NULL,
      STAGE_FLAG_PARALLEL | STAGE_FLAG_SYNC, 0},
-    {STAGE_GET_INFO_DB, "STAGE_GET_INFO_DB", EntryProc_get_info_db, NULL, NULL,
+    {STAGE_GET_INFO_DB, "STAGE_GET_INFO_DB", EntryProc_get_info_db,
+     EntryProc_get_info_db_batch, dbget_is_batchable,   /* batched DB gets */
      STAGE_FLAG_PARALLEL | STAGE_FLAG_SYNC | STAGE_FLAG_ID_CONSTRAINT, 0},
     {STAGE_GET_INFO_FS, "STAGE_GET_INFO_FS", EntryProc_get_info_fs, NULL, NULL,
      STAGE_FLAG_PARALLEL | STAGE_FLAG_SYNC, 0},
@@ -107,14 +113,14 @@ int EntryProc_get_fid(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     char *path;
 
     /* 2 possible options: get fid using parent_fid/name or from fullpath */
-    if (ATTR_MASK_TEST(&p_op->fs_attrs, parent_id)
-        && ATTR_MASK_TEST(&p_op->fs_attrs, name)) {
-        BuildFidPath(&ATTR(&p_op->fs_attrs, parent_id), buff);
+    if (ATTR_MASK_TEST(p_op->fs_attrs, parent_id)
+        && ATTR_MASK_TEST(p_op->fs_attrs, name)) {
+        BuildFidPath(&ATTR(p_op->fs_attrs, parent_id), buff);
         long len = strlen(buff);
-        sprintf(buff + len, "/%s", ATTR(&p_op->fs_attrs, name));
+        sprintf(buff + len, "/%s", ATTR(p_op->fs_attrs, name));
         path = buff;
-    } else if (ATTR_MASK_TEST(&p_op->fs_attrs, fullpath)) {
-        path = ATTR(&p_op->fs_attrs, fullpath);
+    } else if (ATTR_MASK_TEST(p_op->fs_attrs, fullpath)) {
+        path = ATTR(p_op->fs_attrs, fullpath);
     } else {
         DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
                    "Error: not enough information to get fid: parent_id/name or fullpath needed");
@@ -129,8 +135,8 @@ int EntryProc_get_fid(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
      * -EINVAL (see LU-3245).
      * In this case, get fid from full path.
      */
-    if ((rc == -EINVAL) && ATTR_MASK_TEST(&p_op->fs_attrs, fullpath)) {
-        path = ATTR(&p_op->fs_attrs, fullpath);
+    if ((rc == -EINVAL) && ATTR_MASK_TEST(p_op->fs_attrs, fullpath)) {
+        path = ATTR(p_op->fs_attrs, fullpath);
         rc = Lustre_GetFidFromPath(path, &tmp_id);
     }
 
@@ -159,23 +165,18 @@ int EntryProc_get_fid(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 }
 
 /**
- * check if the entry exists in the database and what info
- * must be retrieved.
+ * First part of GET_INFO_DB stage: determine what info must be retrieved
+ * from the database (set in p_op->db_attrs->attr_mask).
  */
-int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
+static void get_info_db_prepare(struct entry_proc_op_t *p_op)
 {
-    int rc = 0;
-    int next_stage = -1;    /* -1 = skip */
     attr_mask_t attr_allow_cached = null_mask;
     attr_mask_t attr_need_fresh = null_mask;
     uint32_t status_scope = 0;  /* status mask only */
     attr_mask_t tmp;
 
-    const pipeline_stage_t *stage_info =
-        &entry_proc_pipeline[p_op->pipeline_stage];
-
     /* check if entry is in policies scope */
-    add_matching_scopes_mask(&p_op->entry_id, &p_op->fs_attrs, true,
+    add_matching_scopes_mask(&p_op->entry_id, p_op->fs_attrs, true,
                              &status_scope);
 
     /* XXX also retrieve needed attributes to check the scope? */
@@ -183,7 +184,7 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     /* get diff attributes from DB and FS (to allow comparison) */
     p_op->db_attr_need = attr_mask_or(&p_op->db_attr_need, &diff_mask);
 
-    tmp = attr_mask_and_not(&diff_mask, &p_op->fs_attrs.attr_mask);
+    tmp = attr_mask_and_not(&diff_mask, &p_op->fs_attrs->attr_mask);
     p_op->fs_attr_need = attr_mask_or(&p_op->fs_attr_need, &tmp);
 
     if (entry_proc_conf.detect_fake_mtime)
@@ -194,18 +195,27 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     /* XXX check if entry is in policy scope? */
 
     /* what must be retrieved from DB: */
-    tmp = attr_mask_and_not(&attr_allow_cached, &p_op->fs_attrs.attr_mask);
+    tmp = attr_mask_and_not(&attr_allow_cached, &p_op->fs_attrs->attr_mask);
     p_op->db_attr_need = attr_mask_or(&p_op->db_attr_need, &tmp);
 
+    /* previous usage of the entry, to update the usage of its ancestors */
+    if (diff_arg->apply == APPLY_DB && lmgr_dir_stat())
+        p_op->db_attr_need.std |= DIRSTAT_ATTR_MASK | ATTR_MASK_nlink;
+    /* previous accounting of the entry (batched accounting) */
+    if (diff_arg->apply == APPLY_DB && lmgr_acct_batched()) {
+        p_op->db_attr_need.std |= ACCT_ATTR_MASK;
+        p_op->db_attr_need.status |= all_status_mask();
+    }
+
     /* no dircount for non-dirs */
-    if (ATTR_MASK_TEST(&p_op->fs_attrs, type) &&
-        !strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_DIR)) {
+    if (ATTR_MASK_TEST(p_op->fs_attrs, type) &&
+        !strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_DIR)) {
         attr_mask_unset_index(&p_op->db_attr_need, ATTR_INDEX_dircount);
     }
 
     /* don't get stripe for non-files */
-    if (ATTR_MASK_TEST(&p_op->fs_attrs, type)
-        && strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_FILE) != 0) {
+    if (ATTR_MASK_TEST(p_op->fs_attrs, type)
+        && strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_FILE) != 0) {
         attr_mask_unset_index(&p_op->db_attr_need, ATTR_INDEX_stripe_info);
         attr_mask_unset_index(&p_op->db_attr_need, ATTR_INDEX_stripe_items);
         attr_mask_unset_index(&p_op->fs_attr_need, ATTR_INDEX_stripe_info);
@@ -213,83 +223,91 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     }
 
     /* no readlink for non symlinks */
-    if (ATTR_MASK_TEST(&p_op->fs_attrs, type)) {
-        if (!strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_LINK))
+    if (ATTR_MASK_TEST(p_op->fs_attrs, type)) {
+        if (!strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_LINK))
             /* check if symlink's contents is known */
             attr_mask_set_index(&p_op->db_attr_need, ATTR_INDEX_link);
         else
             attr_mask_unset_index(&p_op->db_attr_need, ATTR_INDEX_link);
     }
 
-    if (!attr_mask_is_null(p_op->db_attr_need)) {
-        p_op->db_attrs.attr_mask = p_op->db_attr_need;
-        rc = ListMgr_Get(lmgr, &p_op->entry_id, &p_op->db_attrs);
-
-        if (rc == DB_SUCCESS) {
-            p_op->db_exists = 1;
-        } else if (rc == DB_NOT_EXISTS) {
-            p_op->db_exists = 0;
-            ATTR_MASK_INIT(&p_op->db_attrs);
-        } else {
-            /* ERROR */
-            DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
-                       "Error %d retrieving entry " DFID " from DB: %s.", rc,
-                       PFID(&p_op->entry_id), lmgr_err2str(rc));
-            p_op->db_exists = 0;
-            ATTR_MASK_INIT(&p_op->db_attrs);
-        }
-    } else {
-        p_op->db_exists = ListMgr_Exists(lmgr, &p_op->entry_id);
-    }
-
     /* get status for all policies with a matching scope */
-    add_matching_scopes_mask(&p_op->entry_id, &p_op->fs_attrs, true,
+    add_matching_scopes_mask(&p_op->entry_id, p_op->fs_attrs, true,
                              &p_op->fs_attr_need.status);
-    tmp = attr_mask_and_not(&attr_need_fresh, &p_op->fs_attrs.attr_mask);
+    tmp = attr_mask_and_not(&attr_need_fresh, &p_op->fs_attrs->attr_mask);
     p_op->fs_attr_need = attr_mask_or(&p_op->fs_attr_need, &tmp);
 
+    /* attributes to be retrieved (null mask: only check existence) */
+    p_op->db_attrs->attr_mask = p_op->db_attr_need;
+}
+
+/**
+ * Second part of GET_INFO_DB stage: process the information retrieved
+ * from the database and determine what must be retrieved from the filesystem.
+ * @param db_rc status of the DB request (DB_SUCCESS, DB_NOT_EXISTS or error).
+ * @return the next pipeline stage for the entry.
+ */
+static int get_info_db_process(struct entry_proc_op_t *p_op, lmgr_t *lmgr,
+                               int db_rc)
+{
+    int next_stage;
+
+    if (db_rc == DB_SUCCESS) {
+        p_op->db_exists = 1;
+    } else if (db_rc == DB_NOT_EXISTS) {
+        p_op->db_exists = 0;
+        ATTR_MASK_INIT(p_op->db_attrs);
+    } else {
+        /* ERROR */
+        DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
+                   "Error %d retrieving entry " DFID " from DB: %s.", db_rc,
+                   PFID(&p_op->entry_id), lmgr_err2str(db_rc));
+        p_op->db_exists = 0;
+        ATTR_MASK_INIT(p_op->db_attrs);
+    }
+
     if (!p_op->db_exists) {
         /* new entry */
         p_op->db_op_type = OP_TYPE_INSERT;
 
         /* set creation time if it was not set by scan module */
-        if (!ATTR_MASK_TEST(&p_op->fs_attrs, creation_time)) {
-            ATTR_MASK_SET(&p_op->fs_attrs, creation_time);
+        if (!ATTR_MASK_TEST(p_op->fs_attrs, creation_time)) {
+            ATTR_MASK_SET(p_op->fs_attrs, creation_time);
             /* XXX min(atime,mtime,ctime)? */
-            ATTR(&p_op->fs_attrs, creation_time) = time(NULL);
+            ATTR(p_op->fs_attrs, creation_time) = time(NULL);
         }
 #ifdef _LUSTRE
-        if (ATTR_MASK_TEST(&p_op->fs_attrs, type)
-            && !strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_FILE)
+        if (ATTR_MASK_TEST(p_op->fs_attrs, type)
+            && !strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_FILE)
             /* only if it was not retrieved during the scan */
-            && !(ATTR_MASK_TEST(&p_op->fs_attrs, stripe_info)
-                 && ATTR_MASK_TEST(&p_op->fs_attrs, stripe_items))) {
+            && !(ATTR_MASK_TEST(p_op->fs_attrs, stripe_info)
+                 && ATTR_MASK_TEST(p_op->fs_attrs, stripe_items))) {
             attr_mask_set_index(&p_op->fs_attr_need, ATTR_INDEX_stripe_info);
             attr_mask_set_index(&p_op->fs_attr_need, ATTR_INDEX_stripe_items);
         }
 #endif
 
         /* readlink for symlinks (if not already known) */
-        if (ATTR_MASK_TEST(&p_op->fs_attrs, type)
-            && !strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_LINK)
-            && !ATTR_MASK_TEST(&p_op->fs_attrs, link)) {
+        if (ATTR_MASK_TEST(p_op->fs_attrs, type)
+            && !strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_LINK)
+            && !ATTR_MASK_TEST(p_op->fs_attrs, link)) {
             attr_mask_set_index(&p_op->fs_attr_need, ATTR_INDEX_link);
         } else {
             attr_mask_unset_index(&p_op->fs_attr_need, ATTR_INDEX_link);
         }
 
 #ifdef ATTR_INDEX_status /** @FIXME RBHv3 drop old-style status reference */
-        if (ATTR_MASK_TEST(&p_op->fs_attrs, type)
+        if (ATTR_MASK_TEST(p_op->fs_attrs, type)
 #ifdef _LUSTRE_HSM
-            && !strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_FILE))
+            && !strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_FILE))
 #elif defined (_HSM_LITE)
-            && (strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_DIR) != 0)
+            && (strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_DIR) != 0)
             && !p_op->extra_info.not_supp)
 #endif
         {
             p_op->fs_attr_need |= ATTR_MASK_status;
 #ifdef _HSM_LITE
-            p_op->fs_attr_need |= (attr_need_fresh & ~p_op->fs_attrs.attr_mask);
+            p_op->fs_attr_need |= (attr_need_fresh & ~p_op->fs_attrs->attr_mask);
 #endif
         }
         else
@@ -305,18 +323,18 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 #ifdef ATTR_INDEX_status /** @FIXME RBHv3 drop old-style status reference */
         /* only if status is in diff_mask */
         if (diff_mask & ATTR_MASK_status) {
-            if (ATTR_MASK_TEST(&p_op->fs_attrs, type)
+            if (ATTR_MASK_TEST(p_op->fs_attrs, type)
 #ifdef _LUSTRE_HSM
-                && !strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_FILE))
+                && !strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_FILE))
 #elif defined (_HSM_LITE)
-                && (strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_DIR) != 0)
+                && (strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_DIR) != 0)
                 && !p_op->extra_info.not_supp)
 #endif
             {
                 p_op->fs_attr_need |= ATTR_MASK_status;
 #ifdef _HSM_LITE
                 p_op->fs_attr_need |=
-                    (attr_need_fresh & ~p_op->fs_attrs.attr_mask);
+                    (attr_need_fresh & ~p_op->fs_attrs->attr_mask);
 #endif
             }
             else
@@ -328,8 +346,8 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 #endif
 
         if (attr_mask_test_index(&diff_mask, ATTR_INDEX_link)) {
-            if (ATTR_MASK_TEST(&p_op->fs_attrs, type)) {    /* likely set */
-                if (strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_LINK))
+            if (ATTR_MASK_TEST(p_op->fs_attrs, type)) {    /* likely set */
+                if (strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_LINK))
                     /* non-link */
                     attr_mask_unset_index(&p_op->fs_attr_need, ATTR_INDEX_link);
                 else {
@@ -345,7 +363,7 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 #else
                     /* For non-lustre filesystems, inodes may be recycled,
                      * so re-read link even if it is is DB */
-                    if (ATTR_MASK_TEST(&p_op->fs_attrs, link))
+                    if (ATTR_MASK_TEST(p_op->fs_attrs, link))
                         attr_mask_unset_index(&p_op->fs_attr_need,
                                               ATTR_INDEX_link);
                     else
@@ -358,9 +376,9 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
         /* get parent_id+name, if not set during scan (eg. for root
          * directory) */
-        if (!ATTR_MASK_TEST(&p_op->fs_attrs, name))
+        if (!ATTR_MASK_TEST(p_op->fs_attrs, name))
             attr_mask_set_index(&p_op->fs_attr_need, ATTR_INDEX_name);
-        if (!ATTR_MASK_TEST(&p_op->fs_attrs, parent_id))
+        if (!ATTR_MASK_TEST(p_op->fs_attrs, parent_id))
             attr_mask_set_index(&p_op->fs_attr_need, ATTR_INDEX_parent_id);
 
 #ifdef _LUSTRE
@@ -368,8 +386,8 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         if ((diff_mask.std & (ATTR_MASK_stripe_info | ATTR_MASK_stripe_items))
             || (diff_arg->apply == APPLY_DB)) {
             /* get stripe only for files */
-            if (ATTR_MASK_TEST(&p_op->fs_attrs, type)
-                && !strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_FILE)
+            if (ATTR_MASK_TEST(p_op->fs_attrs, type)
+                && !strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_FILE)
                 && !strcmp(global_config.fs_type, "lustre")) {
                 check_stripe_info(p_op, lmgr);
             }
@@ -378,6 +396,37 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         next_stage = STAGE_GET_INFO_FS;
     }
 
+    return next_stage;
+}
+
+/**
+ * check if the entry exists in the database and what info
+ * must be retrieved.
+ */
+int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
+{
+    int rc = 0;
+    int next_stage;
+
+    const pipeline_stage_t *stage_info =
+        &entry_proc_pipeline[p_op->pipeline_stage];
+
+    get_info_db_prepare(p_op);
+
+    if (!attr_mask_is_null(p_op->db_attrs->attr_mask)) {
+        rc = ListMgr_Get(lmgr, &p_op->entry_id, p_op->db_attrs);
+    } else {
+        /* only check if the entry exists */
+        rc = ListMgr_Exists(lmgr, &p_op->entry_id);
+        if (rc > 0)
+            rc = DB_SUCCESS;
+        else if (rc == 0)
+            rc = DB_NOT_EXISTS;
+        else
+            rc = -rc;
+    }
+    next_stage = get_info_db_process(p_op, lmgr, rc);
+
     if (next_stage == -1)
         /* drop the entry */
         rc = EntryProcessor_Acknowledge(p_op, -1, true);
@@ -392,6 +441,62 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     return rc;
 }
 
+/**
+ * Batched version of GET_INFO_DB stage: retrieve the information of all
+ * entries from the database with a minimal count of DB requests.
+ */
+int EntryProc_get_info_db_batch(struct entry_proc_op_t **ops, int count,
+                                lmgr_t *lmgr)
+{
+    int i, rc = 0;
+    const pipeline_stage_t *stage_info =
+        &entry_proc_pipeline[ops[0]->pipeline_stage];
+    int *next_stages = NULL;
+    int *db_rcs = NULL;
+
+    next_stages = MemCalloc(count, sizeof(*next_stages));
+    db_rcs = MemCalloc(count, sizeof(*db_rcs));
+    if (!next_stages || !db_rcs) {
+        /* process the operations one by one, so they are not lost */
+        for (i = 0; i < count; i++) {
+            int rc2 = EntryProc_get_info_db(ops[i], lmgr);
+
+            if (rc2 && !rc)
+                rc = rc2;
+        }
+        goto out;
+    }
+
+    for (i = 0; i < count; i++)
+        get_info_db_prepare(ops[i]);
+
+    get_db_attrs_batch(ops, count, lmgr, db_rcs);
+
+    for (i = 0; i < count; i++)
+        next_stages[i] = get_info_db_process(ops[i], lmgr, db_rcs[i]);
+
+    rc = EntryProcessor_AcknowledgeBatchStages(ops, count, next_stages);
+    if (rc)
+        DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
+                   "Error %d acknowledging stage %s.", rc,
+                   stage_info->stage_name);
+ out:
+    MemFree(db_rcs);
+    MemFree(next_stages);
+    return rc;
+}
+
+/**
+ * Check if 2 operations can be looked up in DB in the same batch.
+ * Operations that don't have an id yet can't be part of a batch.
+ */
+static bool dbget_is_batchable(struct entry_proc_op_t *first,
+                               struct entry_proc_op_t *next,
+                               attr_mask_t *full_attr_mask)
+{
+    return first->entry_id_is_set && next->entry_id_is_set;
+}
+
 int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 {
     int rc;
@@ -422,14 +527,14 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
     /* don't retrieve info which is already fresh */
     p_op->fs_attr_need =
-        attr_mask_and_not(&p_op->fs_attr_need, &p_op->fs_attrs.attr_mask);
+        attr_mask_and_not(&p_op->fs_attr_need, &p_op->fs_attrs->attr_mask);
 
     /* scans: never need to get attr (provided in operation) */
 
 #if defined(_LUSTRE) && defined(_HAVE_FID)
     /* may be needed if parent information is missing */
     if (NEED_GETPATH(p_op)) {
-        if (path_check_update(&p_op->entry_id, path, &p_op->fs_attrs,
+        if (path_check_update(&p_op->entry_id, path, p_op->fs_attrs,
                               p_op->fs_attr_need) == PCR_ORPHAN) {
             /* ignore entries not in the namespace */
             goto skip_record;
@@ -439,7 +544,7 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
     if (entry_proc_conf.detect_fake_mtime
         && ATTR_FSorDB_TEST(p_op, creation_time)
-        && ATTR_MASK_TEST(&p_op->fs_attrs, last_mod)) {
+        && ATTR_MASK_TEST(p_op->fs_attrs, last_mod)) {
         check_and_warn_fake_mtime(p_op);
     }
 #ifdef _LUSTRE
@@ -454,14 +559,14 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     if (NEED_GETSTRIPE(p_op)) {
         /* get entry stripe */
         rc = File_GetStripeByPath(path,
-                                  &ATTR(&p_op->fs_attrs, stripe_info),
-                                  &ATTR(&p_op->fs_attrs, stripe_items));
+                                  &ATTR(p_op->fs_attrs, stripe_info),
+                                  &ATTR(p_op->fs_attrs, stripe_items));
         if (rc) {
-            ATTR_MASK_UNSET(&p_op->fs_attrs, stripe_info);
-            ATTR_MASK_UNSET(&p_op->fs_attrs, stripe_items);
+            ATTR_MASK_UNSET(p_op->fs_attrs, stripe_info);
+            ATTR_MASK_UNSET(p_op->fs_attrs, stripe_items);
         } else {
-            ATTR_MASK_SET(&p_op->fs_attrs, stripe_info);
-            ATTR_MASK_SET(&p_op->fs_attrs, stripe_items);
+            ATTR_MASK_SET(p_op->fs_attrs, stripe_info);
+            ATTR_MASK_SET(p_op->fs_attrs, stripe_items);
         }
     }   /* get_stripe needed */
 #endif
@@ -474,8 +579,8 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         /** attributes + status */
         attr_set_t new_attrs = ATTR_SET_INIT;
 
-        ListMgr_MergeAttrSets(&merged_attrs, &p_op->fs_attrs, 1);
-        ListMgr_MergeAttrSets(&merged_attrs, &p_op->db_attrs, 0);
+        ListMgr_MergeAttrSets(&merged_attrs, p_op->fs_attrs, 1);
+        ListMgr_MergeAttrSets(&merged_attrs, p_op->db_attrs, 0);
 
         /* match policy scopes according to newly set information:
          * remove needed status from mask and append the updated one. */
@@ -507,7 +612,7 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
                                    path, smi->sm->name, rc);
                     } else {
                         /* merge/update attributes */
-                        ListMgr_MergeAttrSets(&p_op->fs_attrs, &new_attrs,
+                        ListMgr_MergeAttrSets(p_op->fs_attrs, &new_attrs,
                                               true);
                     }
                     /* free allocated resources, once merged */
@@ -526,16 +631,16 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         attr_mask_unset_index(&p_op->fs_attr_need, ATTR_INDEX_link);
 
     if (NEED_READLINK(p_op)) {
-        ssize_t len = readlink(path, ATTR(&p_op->fs_attrs, link), RBH_PATH_MAX);
+        ssize_t len = readlink(path, ATTR(p_op->fs_attrs, link), RBH_PATH_MAX);
 
         if (len >= 0) {
-            ATTR_MASK_SET(&p_op->fs_attrs, link);
+            ATTR_MASK_SET(p_op->fs_attrs, link);
 
             /* add final '\0' on success */
             if (len >= RBH_PATH_MAX)
-                ATTR(&p_op->fs_attrs, link)[len - 1] = '\0';
+                ATTR(p_op->fs_attrs, link)[len - 1] = '\0';
             else
-                ATTR(&p_op->fs_attrs, link)[len] = '\0';
+                ATTR(p_op->fs_attrs, link)[len] = '\0';
         } else
             DisplayLog(LVL_MAJOR, ENTRYPROC_TAG, "readlink failed on %s: %s",
                        path, strerror(errno));
@@ -569,13 +674,13 @@ int EntryProc_report_diff(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
     /* once set, never change creation time */
     if (p_op->db_op_type != OP_TYPE_INSERT)
-        ATTR_MASK_UNSET(&p_op->fs_attrs, creation_time);
+        ATTR_MASK_UNSET(p_op->fs_attrs, creation_time);
 
     /* Only keep fields that changed */
     if (p_op->db_op_type == OP_TYPE_UPDATE) {
         attr_mask_t tmp;
         attr_mask_t loc_diff_mask =
-            ListMgr_WhatDiff(&p_op->fs_attrs, &p_op->db_attrs);
+            ListMgr_WhatDiff(p_op->fs_attrs, p_op->db_attrs);
 
         /* In scan mode, always keep md_update and path_update,
          * to avoid their cleaning at the end of the scan.
@@ -599,22 +704,22 @@ int EntryProc_report_diff(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
         /* remove other unchanged attrs or attrs not in db mask */
         tmp = attr_mask_or(&loc_diff_mask, &to_keep);
-        tmp = attr_mask_or_not(&tmp, &p_op->db_attrs.attr_mask);
-        p_op->fs_attrs.attr_mask =
-            attr_mask_and(&p_op->fs_attrs.attr_mask, &tmp);
+        tmp = attr_mask_or_not(&tmp, &p_op->db_attrs->attr_mask);
+        p_op->fs_attrs->attr_mask =
+            attr_mask_and(&p_op->fs_attrs->attr_mask, &tmp);
 
 #ifdef _LUSTRE
         if (p_op->db_stripe_ok) {
-            ATTR_MASK_UNSET(&p_op->fs_attrs, stripe_info);
-            if (ATTR_MASK_TEST(&p_op->fs_attrs, stripe_items)) {
-                ATTR_MASK_UNSET(&p_op->fs_attrs, stripe_items);
-                free_stripe_items(&ATTR(&p_op->fs_attrs, stripe_items));
+            ATTR_MASK_UNSET(p_op->fs_attrs, stripe_info);
+            if (ATTR_MASK_TEST(p_op->fs_attrs, stripe_items)) {
+                ATTR_MASK_UNSET(p_op->fs_attrs, stripe_items);
+                free_stripe_items(&ATTR(p_op->fs_attrs, stripe_items));
             }
         }
 #endif
 
         /* nothing changed => noop */
-        if (attr_mask_is_null(p_op->fs_attrs.attr_mask)) {
+        if (attr_mask_is_null(p_op->fs_attrs->attr_mask)) {
             /* no op */
             p_op->db_op_type = OP_TYPE_NONE;
         } else if (!attr_mask_is_null(attr_mask_and(&loc_diff_mask, &diff_mask))
@@ -624,19 +729,19 @@ int EntryProc_report_diff(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
             /* revert change: reverse display */
             if (diff_arg->apply == APPLY_FS) {
                 /* attr from FS */
-                print_attrs(attrchg, &p_op->fs_attrs, display_mask, 1);
+                print_attrs(attrchg, p_op->fs_attrs, display_mask, 1);
                 printf("-" DFID " %s\n", PFID(&p_op->entry_id), attrchg->str);
 
                 /* attr from DB */
-                print_attrs(attrchg, &p_op->db_attrs, display_mask, 1);
+                print_attrs(attrchg, p_op->db_attrs, display_mask, 1);
                 printf("+" DFID " %s\n", PFID(&p_op->entry_id), attrchg->str);
             } else {
                 /* attr from DB */
-                print_attrs(attrchg, &p_op->db_attrs, display_mask, 1);
+                print_attrs(attrchg, p_op->db_attrs, display_mask, 1);
                 printf("-" DFID " %s\n", PFID(&p_op->entry_id), attrchg->str);
 
                 /* attr from FS */
-                print_attrs(attrchg, &p_op->fs_attrs, display_mask, 1);
+                print_attrs(attrchg, p_op->fs_attrs, display_mask, 1);
                 printf("+" DFID " %s\n", PFID(&p_op->entry_id), attrchg->str);
             }
             g_string_free(attrchg, TRUE);
@@ -653,7 +758,7 @@ int EntryProc_report_diff(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
             } else {
                 GString *attrnew = g_string_new(NULL);
 
-                print_attrs(attrnew, &p_op->fs_attrs, p_op->fs_attrs.attr_mask,
+                print_attrs(attrnew, p_op->fs_attrs, p_op->fs_attrs->attr_mask,
                             1);
                 printf("++" DFID " %s\n", PFID(&p_op->entry_id), attrnew->str);
 
@@ -668,7 +773,7 @@ int EntryProc_report_diff(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
                 GString *attrnew = g_string_new(NULL);
 
                 /* revert change: reverse display */
-                print_attrs(attrnew, &p_op->db_attrs, p_op->db_attrs.attr_mask,
+                print_attrs(attrnew, p_op->db_attrs, p_op->db_attrs->attr_mask,
                             1);
                 printf("++" DFID " %s\n", PFID(&p_op->entry_id), attrnew->str);
 
@@ -684,7 +789,7 @@ int EntryProc_report_diff(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     }
 
     if (diff_arg->apply == APPLY_DB)
-        attr_mask_unset_readonly(&p_op->fs_attrs.attr_mask);
+        attr_mask_unset_readonly(&p_op->fs_attrs->attr_mask);
 
     /* always go to APPLY step, at least to tag the entry */
     rc = EntryProcessor_Acknowledge(p_op, STAGE_APPLY, false);
@@ -715,14 +820,46 @@ static bool dbop_is_batchable(struct entry_proc_op_t *first, struct
         return true;
     /* different masks can be mixed, as long as attributes for each table are
      * the same or 0. Ask the list manager about that. */
-    else if (lmgr_batch_compat(*full_attr_mask, next->fs_attrs.attr_mask)) {
+    else if (lmgr_batch_compat(*full_attr_mask, next->fs_attrs->attr_mask)) {
         *full_attr_mask =
-            attr_mask_or(full_attr_mask, &next->fs_attrs.attr_mask);
+            attr_mask_or(full_attr_mask, &next->fs_attrs->attr_mask);
         return true;
     } else
         return false;
 }
 
+/**
+ * Report the accounting changes of an operation (batched accounting),
+ * once it has been applied to the database.
+ */
+static void update_acct(const struct entry_proc_op_t *p_op, lmgr_t *lmgr)
+{
+    int rc;
+
+    switch (p_op->db_op_type) {
+    case OP_TYPE_INSERT:
+        rc = ListMgr_AcctUpdate(lmgr, NULL, p_op->fs_attrs);
+        break;
+    case OP_TYPE_UPDATE:
+        rc = ListMgr_AcctUpdate(lmgr, p_op->db_exists ? p_op->db_attrs : NULL,
+                                p_op->fs_attrs);
+        break;
+    case OP_TYPE_REMOVE_LAST:
+    case OP_TYPE_SOFT_REMOVE:
+        if (!p_op->db_exists)
+            return;
+        rc = ListMgr_AcctUpdate(lmgr, p_op->db_attrs, NULL);
+        break;
+    default:
+        return;
+    }
+
+    if (rc)
+        DisplayLog(LVL_MAJOR, ENTRYPROC_TAG, "Error %d updating the "
+                   "accounting of " DFID ": %s", rc, PFID(&p_op->entry_id),
+                   lmgr_err2str(rc));
+}
+
 /**
  * Perform an operation on database.
  */
@@ -733,6 +870,9 @@ int EntryProc_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         &entry_proc_pipeline[p_op->pipeline_stage];
 
     if ((diff_arg->apply == APPLY_DB) && !(pipeline_flags & RUNFLG_DRY_RUN)) {
+        /* applied in the same transaction as the operation */
+        report_dir_stat(p_op, lmgr);
+
         /* insert to DB */
         switch (p_op->db_op_type) {
         case OP_TYPE_NONE:
@@ -747,7 +887,7 @@ int EntryProc_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
             DisplayLog(LVL_FULL, ENTRYPROC_TAG, "Insert(" DFID ")",
                        PFID(&p_op->entry_id));
 #endif
-            rc = ListMgr_Insert(lmgr, &p_op->entry_id, &p_op->fs_attrs, false);
+            rc = ListMgr_Insert(lmgr, &p_op->entry_id, p_op->fs_attrs, false);
             break;
 
         case OP_TYPE_UPDATE:
@@ -755,7 +895,7 @@ int EntryProc_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
             DisplayLog(LVL_FULL, ENTRYPROC_TAG, "Update(" DFID ")",
                        PFID(&p_op->entry_id));
 #endif
-            rc = ListMgr_Update(lmgr, &p_op->entry_id, &p_op->fs_attrs);
+            rc = ListMgr_Update(lmgr, &p_op->entry_id, p_op->fs_attrs);
             break;
 
         case OP_TYPE_REMOVE_ONE:
@@ -763,7 +903,7 @@ int EntryProc_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
             DisplayLog(LVL_FULL, ENTRYPROC_TAG, "Remove(" DFID ")",
                        PFID(&p_op->entry_id));
 #endif
-            rc = ListMgr_Remove(lmgr, &p_op->entry_id, &p_op->fs_attrs, false);
+            rc = ListMgr_Remove(lmgr, &p_op->entry_id, p_op->fs_attrs, false);
             break;
 
         case OP_TYPE_REMOVE_LAST:
@@ -771,7 +911,7 @@ int EntryProc_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
             DisplayLog(LVL_FULL, ENTRYPROC_TAG, "Remove(" DFID ")",
                        PFID(&p_op->entry_id));
 #endif
-            rc = ListMgr_Remove(lmgr, &p_op->entry_id, &p_op->fs_attrs, true);
+            rc = ListMgr_Remove(lmgr, &p_op->entry_id, p_op->fs_attrs, true);
             break;
 
         case OP_TYPE_SOFT_REMOVE:
@@ -785,16 +925,16 @@ int EntryProc_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
                 tmp2 = sm_softrm_mask();
                 tmp = attr_mask_or(&tmp, &tmp2);
 
-                print_attrs(gs, &p_op->fs_attrs, tmp, true);
+                print_attrs(gs, p_op->fs_attrs, tmp, true);
                 DisplayLog(LVL_DEBUG, ENTRYPROC_TAG, "SoftRemove(" DFID ",%s)",
                            PFID(&p_op->entry_id), gs->str);
 
                 g_string_free(gs, TRUE);
             }
 
-            ATTR_MASK_SET(&p_op->fs_attrs, rm_time);
-            ATTR(&p_op->fs_attrs, rm_time) = time(NULL);
-            rc = ListMgr_SoftRemove(lmgr, &p_op->entry_id, &p_op->fs_attrs);
+            ATTR_MASK_SET(p_op->fs_attrs, rm_time);
+            ATTR(p_op->fs_attrs, rm_time) = time(NULL);
+            rc = ListMgr_SoftRemove(lmgr, &p_op->entry_id, p_op->fs_attrs);
             break;
         default:
             DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
@@ -802,10 +942,13 @@ int EntryProc_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
             rc = -1;
         }
 
-        if (rc)
+        if (rc) {
             DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
                        "Error %d performing database operation: %s.", rc,
                        lmgr_err2str(rc));
+            ListMgr_DirStatCancel(lmgr);
+        } else if (lmgr_acct_batched())
+            update_acct(p_op, lmgr);
     } else if (diff_arg->db_tag) {
         /* tag the entry in the DB */
         rc = ListMgr_TagEntry(lmgr, diff_arg->db_tag, &p_op->entry_id);
@@ -828,44 +971,44 @@ int EntryProc_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 #ifdef _HAVE_FID
             /* if fullpath is not set, but parent and name are set,
              * use parent/name as the fullpath (for fids only) */
-            if (!ATTR_MASK_TEST(&p_op->fs_attrs, fullpath)
-                && ATTR_MASK_TEST(&p_op->fs_attrs, parent_id)
-                && ATTR_MASK_TEST(&p_op->fs_attrs, name)) {
-                char *str = ATTR(&p_op->fs_attrs, fullpath);
-                BuildFidPath(&ATTR(&p_op->fs_attrs, parent_id), str);
+            if (!ATTR_MASK_TEST(p_op->fs_attrs, fullpath)
+                && ATTR_MASK_TEST(p_op->fs_attrs, parent_id)
+                && ATTR_MASK_TEST(p_op->fs_attrs, name)) {
+                char *str = ATTR(p_op->fs_attrs, fullpath);
+                BuildFidPath(&ATTR(p_op->fs_attrs, parent_id), str);
                 long len = strlen(str);
-                sprintf(str + len, "/%s", ATTR(&p_op->fs_attrs, name));
-                ATTR_MASK_SET(&p_op->fs_attrs, fullpath);
+                sprintf(str + len, "/%s", ATTR(p_op->fs_attrs, name));
+                ATTR_MASK_SET(p_op->fs_attrs, fullpath);
             }
 #endif
 
             /* unlink or rmdir */
-            if (ATTR_MASK_TEST(&p_op->fs_attrs, type)
-                && ATTR_MASK_TEST(&p_op->fs_attrs, fullpath)) {
-                if (!strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_DIR)) {
+            if (ATTR_MASK_TEST(p_op->fs_attrs, type)
+                && ATTR_MASK_TEST(p_op->fs_attrs, fullpath)) {
+                if (!strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_DIR)) {
                     /* rmdir */
                     DisplayReport("%srmdir(%s)",
                                   (pipeline_flags & RUNFLG_DRY_RUN) ?
-                                  "(dry-run) " : "", ATTR(&p_op->fs_attrs,
+                                  "(dry-run) " : "", ATTR(p_op->fs_attrs,
                                                           fullpath));
                     if (!(pipeline_flags & RUNFLG_DRY_RUN)) {
-                        if (rmdir(ATTR(&p_op->fs_attrs, fullpath)))
+                        if (rmdir(ATTR(p_op->fs_attrs, fullpath)))
                             DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
                                        "rmdir(%s) failed: %s",
-                                       ATTR(&p_op->fs_attrs, fullpath),
+                                       ATTR(p_op->fs_attrs, fullpath),
                                        strerror(errno));
                     }
                 } else {
                     /* unlink */
                     DisplayReport("%sunlink(%s)",
                                   (pipeline_flags & RUNFLG_DRY_RUN) ?
-                                  "(dry-run) " : "", ATTR(&p_op->fs_attrs,
+                                  "(dry-run) " : "", ATTR(p_op->fs_attrs,
                                                           fullpath));
                     if (!(pipeline_flags & RUNFLG_DRY_RUN)) {
-                        if (unlink(ATTR(&p_op->fs_attrs, fullpath)))
+                        if (unlink(ATTR(p_op->fs_attrs, fullpath)))
                             DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
                                        "unlink(%s) failed: %s",
-                                       ATTR(&p_op->fs_attrs, fullpath),
+                                       ATTR(p_op->fs_attrs, fullpath),
                                        strerror(errno));
                     }
                 }
@@ -876,13 +1019,13 @@ int EntryProc_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
             break;
         case OP_TYPE_UPDATE:
             tmp =
-                attr_mask_and(&p_op->db_attrs.attr_mask,
-                              &p_op->fs_attrs.attr_mask);
+                attr_mask_and(&p_op->db_attrs->attr_mask,
+                              &p_op->fs_attrs->attr_mask);
             tmp = attr_mask_and(&tmp, &diff_mask);
 
-            /*attributes to be changed: p_op->db_attrs.attr_mask
-             *                       & p_op->fs_attrs.attr_mask & diff_mask */
-            rc = ApplyAttrs(&p_op->entry_id, &p_op->db_attrs, &p_op->fs_attrs,
+            /*attributes to be changed: p_op->db_attrs->attr_mask
+             *                       & p_op->fs_attrs->attr_mask & diff_mask */
+            rc = ApplyAttrs(&p_op->entry_id, p_op->db_attrs, p_op->fs_attrs,
                             tmp, pipeline_flags & RUNFLG_DRY_RUN);
             break;
 
@@ -922,7 +1065,9 @@ int EntryProc_batch_apply(struct entry_proc_op_t **ops, int count,
     }
     for (i = 0; i < count; i++) {
         ids[i] = &ops[i]->entry_id;
-        attrs[i] = &ops[i]->fs_attrs;
+        attrs[i] = ops[i]->fs_attrs;
+        /* aggregated and applied in the same transaction as the batch */
+        report_dir_stat(ops[i], lmgr);
     }
 
     /* insert to DB */
@@ -952,10 +1097,14 @@ int EntryProc_batch_apply(struct entry_proc_op_t **ops, int count,
         rc = -1;
     }
 
-    if (rc)
+    if (rc) {
         DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
                    "Error %d performing batch database operation: %s.", rc,
                    lmgr_err2str(rc));
+        ListMgr_DirStatCancel(lmgr);
+    } else if (lmgr_acct_batched())
+        for (i = 0; i < count; i++)
+            update_acct(ops[i], lmgr);
 
     rc = EntryProcessor_AcknowledgeBatch(ops, count, -1, true);
     if (rc)
@@ -1169,7 +1318,7 @@ static int EntryProc_report_rm(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
             lmgr_simple_filter_init(&filter);
 
             if (p_op->gc_entries) {
-                val.value.val_uint = ATTR(&p_op->fs_attrs, md_update);
+                val.value.val_uint = ATTR(p_op->fs_attrs, md_update);
                 lmgr_simple_filter_add(&filter, ATTR_INDEX_md_update,
                                        LESSTHAN_STRICT, val, 0);
             }
@@ -1177,16 +1326,16 @@ static int EntryProc_report_rm(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
             if (p_op->gc_names) {
                 /* use the same timestamp for cleaning paths that have not been
                  * seen during the scan */
-                val.value.val_uint = ATTR(&p_op->fs_attrs, md_update);
+                val.value.val_uint = ATTR(p_op->fs_attrs, md_update);
                 lmgr_simple_filter_add(&filter, ATTR_INDEX_path_update,
                                        LESSTHAN_STRICT, val, 0);
             }
 
             /* partial scan: remove non-updated entries from a subset of the
              * namespace */
-            if (ATTR_MASK_TEST(&p_op->fs_attrs, fullpath)) {
+            if (ATTR_MASK_TEST(p_op->fs_attrs, fullpath)) {
                 char tmp[RBH_PATH_MAX];
-                strcpy(tmp, ATTR(&p_op->fs_attrs, fullpath));
+                strcpy(tmp, ATTR(p_op->fs_attrs, fullpath));
                 strcat(tmp, "/*");
                 val.value.val_str = tmp;
                 lmgr_simple_filter_add(&filter, ATTR_INDEX_fullpath, LIKE, val,
@@ -141,8 +141,8 @@ void id_hash_dump(struct id_hash *id_hash, bool parent)
         } else {
             rh_list_for_each_entry(op, &slot->list, name_hash_list)
                 printf("[%u] " DFID "/%s:" DFID "\n", i,
-                       PFID(&ATTR(&op->fs_attrs, parent_id)),
-                       ATTR(&op->fs_attrs, name), PFID(&op->entry_id));
+                       PFID(&op->name_key_parent), op->name_key,
+                       PFID(&op->entry_id));
         }
         V(slot->lock);
     }
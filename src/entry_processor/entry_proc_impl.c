@@ -49,6 +49,8 @@ typedef struct __list_by_stage__ {
     struct timeval total_processing_time;   /**< total amount of time for
                                              * processing entries at this
                                              * stage */
+    int flags;                  /**< STAGE_FLAG_FORCE_SEQ for this stage of
+                                 * this pipeline instance */
     pthread_mutex_t stage_mutex;
 } list_by_stage_t;
 
@@ -57,7 +59,25 @@ typedef struct __list_by_stage__ {
 /* stages mutex must always be taken from lower stage to upper to avoid
  * deadlocks */
 
+/* Pipeline instances: each one has its own stage lists, so its sequential
+ * stages (like old entries removal) are processed independently from
+ * other instances. Constraints on ids are common to all instances, so
+ * operations on a given id are still processed in order. */
 static list_by_stage_t *pipeline = NULL;
+static unsigned int nb_pipelines = 1;
+
+/* stage of a pipeline instance */
+#define STAGE_LIST(_shard, _stage) \
+            (&pipeline[(_shard) * entry_proc_descr.stage_count + (_stage)])
+
+/* number of threads working on each stage, for all pipeline instances
+ * (stage thread limits are global) */
+static unsigned int *stage_threads = NULL;
+
+/* cumulated DB_APPLY processing time and operation count (never reset,
+ * unlike stage stats), to report DB latency to producers */
+static unsigned long long db_apply_usec = 0;
+static unsigned long long db_apply_count = 0;
 
 /* EXPORTED VARIABLES: current pipeline in operation */
 pipeline_stage_t *entry_proc_pipeline = NULL;
@@ -69,6 +89,25 @@ static pthread_mutex_t work_avail_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t work_avail_cond = PTHREAD_COND_INITIALIZER;
 unsigned int nb_waiting_threads = 0;
 
+/* Work event counter: incremented each time new work may be available.
+ * Workers look for work without holding work_avail_lock, and only take it
+ * to sleep if this counter did not change during their lookup
+ * (this avoids lost wake-ups without serializing lookups). */
+static unsigned int work_avail_seq = 0;
+
+#ifdef _BENCH_PIPELINE
+/* for comparison: serialize lookups on work_avail_lock like the former
+ * scheduler did (set RBH_BENCH_LEGACY_SCHED=1 in the environment) */
+static bool legacy_sched = false;
+#else
+#define legacy_sched false
+#endif
+
+/* Lock-free read of a stage counter.
+ * The value is only a hint and must be checked again under stage_mutex. */
+#define STAGE_HINT(_pl, _field) __atomic_load_n(&(_pl)->_field, \
+                                                __ATOMIC_RELAXED)
+
 /* termination mecanism  */
 static pthread_mutex_t terminate_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t terminate_cond = PTHREAD_COND_INITIALIZER;
@@ -76,19 +115,368 @@ static pthread_cond_t terminate_cond = PTHREAD_COND_INITIALIZER;
 static enum { NONE = 0, FLUSH = 1, BREAK = 2 } terminate_flag = NONE;
 static int nb_finished_threads = 0;
 
-/* forward declarations */
-static entry_proc_op_t **EntryProcessor_GetNextOp(int *count);
-static void print_op_stats(entry_proc_op_t *p_op, unsigned int stage,
-                           const char *what);
-
 typedef struct worker_info__ {
     unsigned int index;
     pthread_t thread_id;
     lmgr_t lmgr;
+
+    /* scheduler statistics (updated by the worker only) */
+    unsigned long long nb_lookups;  /**< number of lookups for work */
+    unsigned long long nb_stage_locks; /**< number of stage locks taken */
+    unsigned long long nb_idle_waits;  /**< number of times it went idle */
 } worker_info_t;
 
+/* forward declarations */
+static entry_proc_op_t **EntryProcessor_GetNextOp(worker_info_t *worker,
+                                                  int *count);
+static void print_op_stats(entry_proc_op_t *p_op, unsigned int stage,
+                           const char *what);
+
 static worker_info_t *worker_params = NULL;
 
+/* Allocation pools for pipeline operations.
+ * Released operations are kept in a pool and recycled, instead of
+ * allocating a new structure for each entry. Pools are sharded by
+ * allocating thread, and operations are released to the pool they come
+ * from. Each pool keeps at most OP_POOL_MAX_FREE unused operations: the
+ * excess is freed, so the memory used after a peak of activity is given
+ * back.
+ *
+ * The attribute sets of an operation are big (fixed-size path, link,
+ * fileclass... buffers), but they are only needed while the operation is
+ * built or processed. While it waits in the pipeline, they are packed in
+ * a buffer that only keeps the actual length of their strings, and the
+ * expanded sets go back to the pool of the operation, with the same
+ * limit. So the number of expanded sets follows the number of operations
+ * being processed, not max_pending_operations. */
+#define OP_POOL_COUNT 16
+#define OP_POOL_MAX_FREE 64
+
+typedef struct op_pool__ {
+    pthread_mutex_t  lock;
+    /* unused operations, chained by their pipeline list field */
+    struct rh_list_head free_ops;
+    unsigned int     nb_free;
+    unsigned int     nb_used;
+    /* unused attribute sets, chained by their first bytes */
+    struct rh_list_head free_sets;
+    unsigned int     nb_free_sets;
+    unsigned int     nb_used_sets;
+} op_pool_t;
+
+static op_pool_t op_pools[OP_POOL_COUNT];
+static pthread_once_t op_pools_once = PTHREAD_ONCE_INIT;
+/* pool to be used by the current thread */
+static __thread int thread_pool_index = -1;
+static unsigned int next_pool_index = 0;
+
+/* string attributes of an attribute set, in the order of the structure */
+typedef struct set_string__ {
+    unsigned int attr_index;
+    size_t       offset;    /* offset in attr_set_t */
+    size_t       size;      /* size of the buffer */
+} set_string_t;
+
+static set_string_t set_strings[ATTR_COUNT];
+static unsigned int set_string_count = 0;
+
+/* packed operations and the size of their attributes (for stats) */
+static unsigned int nb_packed_ops = 0;
+static unsigned long long packed_bytes = 0;
+
+static void op_pools_init(void)
+{
+    int i;
+
+    for (i = 0; i < OP_POOL_COUNT; i++) {
+        pthread_mutex_init(&op_pools[i].lock, NULL);
+        rh_list_init(&op_pools[i].free_ops);
+        op_pools[i].nb_free = 0;
+        op_pools[i].nb_used = 0;
+        rh_list_init(&op_pools[i].free_sets);
+        op_pools[i].nb_free_sets = 0;
+        op_pools[i].nb_used_sets = 0;
+    }
+
+    /* fields of entry_info_t are defined in the order of attribute
+     * indexes, so strings are sorted by offset */
+    for (i = 0; i < ATTR_COUNT; i++) {
+        if (field_infos[i].db_type != DB_TEXT)
+            continue;
+
+        set_strings[set_string_count].attr_index = i;
+        set_strings[set_string_count].offset = offsetof(attr_set_t,
+                                                        attr_values)
+            + field_infos[i].offset;
+        set_strings[set_string_count].size = field_infos[i].db_type_size + 1;
+        set_string_count++;
+    }
+}
+
+/** get overall stats about operation pools */
+static void op_pools_stats(mem_stat_t *p_op_stats, mem_stat_t *p_set_stats)
+{
+    int i;
+
+    p_op_stats->nb_prealloc = 0;
+    p_op_stats->nb_used = 0;
+    p_set_stats->nb_prealloc = 0;
+    p_set_stats->nb_used = 0;
+
+    /* no locks here, because it's just for information */
+    for (i = 0; i < OP_POOL_COUNT; i++) {
+        p_op_stats->nb_prealloc += op_pools[i].nb_free;
+        p_op_stats->nb_used += op_pools[i].nb_used;
+        p_set_stats->nb_prealloc += op_pools[i].nb_free_sets;
+        p_set_stats->nb_used += op_pools[i].nb_used_sets;
+    }
+}
+
+/** get an attribute set from a pool (its contents are undefined) */
+static attr_set_t *attr_set_get(op_pool_t *pool)
+{
+    attr_set_t *p_set = NULL;
+
+    P(pool->lock);
+    if (!rh_list_empty(&pool->free_sets)) {
+        struct rh_list_head *item = pool->free_sets.next;
+
+        rh_list_del(item);
+        p_set = (attr_set_t *)item;
+        pool->nb_free_sets--;
+    }
+    pool->nb_used_sets++;
+    V(pool->lock);
+
+    if (p_set == NULL) {
+        p_set = (attr_set_t *)MemAlloc(sizeof(attr_set_t));
+        if (!p_set) {
+            P(pool->lock);
+            pool->nb_used_sets--;
+            V(pool->lock);
+        }
+    }
+    return p_set;
+}
+
+/** give an attribute set back to a pool, or free it if the pool is full */
+static void attr_set_put(op_pool_t *pool, attr_set_t *p_set)
+{
+    P(pool->lock);
+    pool->nb_used_sets--;
+    if (pool->nb_free_sets < OP_POOL_MAX_FREE) {
+        rh_list_add((struct rh_list_head *)p_set, &pool->free_sets);
+        pool->nb_free_sets++;
+        p_set = NULL;
+    }
+    V(pool->lock);
+
+    if (p_set != NULL)
+        MemFree(p_set);
+}
+
+/**
+ * Clear an attribute set. Strings are only emptied, so the unused
+ * part of their buffers is not touched.
+ */
+static void attr_set_clear(attr_set_t *p_set)
+{
+    char *set = (char *)p_set;
+    size_t pos = 0;
+    unsigned int i;
+
+    for (i = 0; i < set_string_count; i++) {
+        memset(set + pos, 0, set_strings[i].offset - pos);
+        set[set_strings[i].offset] = '\0';
+        pos = set_strings[i].offset + set_strings[i].size;
+    }
+    memset(set + pos, 0, sizeof(attr_set_t) - pos);
+}
+
+/** length of a string attribute in a packed set (0 if not set) */
+static size_t set_string_len(const attr_set_t *p_set, const set_string_t *str)
+{
+    if (!attr_mask_test_index(&p_set->attr_mask, str->attr_index))
+        return 0;
+
+    return strnlen((const char *)p_set + str->offset, str->size - 1);
+}
+
+/** size of an attribute set once packed */
+static size_t attr_set_packed_size(const attr_set_t *p_set)
+{
+    size_t size = sizeof(attr_set_t);
+    unsigned int i;
+
+    for (i = 0; i < set_string_count; i++)
+        size += set_string_len(p_set, &set_strings[i]) + 1
+            - set_strings[i].size;
+
+    return size;
+}
+
+/**
+ * Pack an attribute set: other attributes are copied as is, strings
+ * only take their length.
+ * @return the end of the packed set in buff.
+ */
+static char *attr_set_pack(const attr_set_t *p_set, char *buff)
+{
+    const char *set = (const char *)p_set;
+    size_t pos = 0;
+    unsigned int i;
+
+    for (i = 0; i < set_string_count; i++) {
+        const set_string_t *str = &set_strings[i];
+        size_t len = set_string_len(p_set, str);
+
+        memcpy(buff, set + pos, str->offset - pos);
+        buff += str->offset - pos;
+
+        memcpy(buff, set + str->offset, len);
+        buff[len] = '\0';
+        buff += len + 1;
+
+        pos = str->offset + str->size;
+    }
+    memcpy(buff, set + pos, sizeof(attr_set_t) - pos);
+
+    return buff + sizeof(attr_set_t) - pos;
+}
+
+/**
+ * Expand an attribute set packed by attr_set_pack().
+ * @return the end of the packed set in buff.
+ */
+static const char *attr_set_unpack(attr_set_t *p_set, const char *buff)
+{
+    char *set = (char *)p_set;
+    size_t pos = 0;
+    unsigned int i;
+
+    for (i = 0; i < set_string_count; i++) {
+        const set_string_t *str = &set_strings[i];
+        size_t len;
+
+        memcpy(set + pos, buff, str->offset - pos);
+        buff += str->offset - pos;
+
+        len = strlen(buff) + 1;
+        memcpy(set + str->offset, buff, len);
+        buff += len;
+
+        pos = str->offset + str->size;
+    }
+    memcpy(set + pos, buff, sizeof(attr_set_t) - pos);
+
+    return buff + sizeof(attr_set_t) - pos;
+}
+
+/**
+ * Set the parent/name key of an operation for the parent/name constraint.
+ * It is kept as long as the operation is registered with it.
+ */
+static void op_set_name_key(entry_proc_op_t *p_op)
+{
+    if (p_op->name_is_referenced)
+        return;
+
+    free(p_op->name_key);
+    p_op->name_key = NULL;
+
+    if (ATTR_MASK_TEST(p_op->fs_attrs, parent_id)
+        && ATTR_MASK_TEST(p_op->fs_attrs, name)) {
+        p_op->name_key = strdup(ATTR(p_op->fs_attrs, name));
+        p_op->name_key_parent = ATTR(p_op->fs_attrs, parent_id);
+    }
+}
+
+/**
+ * Pack the attributes of an operation that waits in the pipeline.
+ * If this fails, the operation keeps its expanded attributes.
+ */
+static void op_pack(entry_proc_op_t *p_op)
+{
+    op_pool_t *pool = &op_pools[p_op->pool_index];
+    size_t fs_size, db_size;
+    char *buff;
+
+    if (p_op->packed_attrs != NULL)
+        return;
+
+    op_set_name_key(p_op);
+
+    fs_size = attr_set_packed_size(p_op->fs_attrs);
+    db_size = attr_set_packed_size(p_op->db_attrs);
+    buff = (char *)MemAlloc(fs_size + db_size);
+    if (!buff)
+        return;
+
+    attr_set_pack(p_op->db_attrs, attr_set_pack(p_op->fs_attrs, buff));
+
+    attr_set_put(pool, p_op->fs_attrs);
+    attr_set_put(pool, p_op->db_attrs);
+    p_op->fs_attrs = NULL;
+    p_op->db_attrs = NULL;
+    p_op->packed_attrs = buff;
+    p_op->packed_size = fs_size + db_size;
+
+    __sync_fetch_and_add(&nb_packed_ops, 1);
+    __sync_fetch_and_add(&packed_bytes, p_op->packed_size);
+}
+
+/**
+ * Expand the attributes of an operation before processing it.
+ * @return 0 on success, -ENOMEM if the operation is left packed.
+ */
+static int op_unpack(entry_proc_op_t *p_op)
+{
+    op_pool_t *pool = &op_pools[p_op->pool_index];
+    attr_set_t *fs_set, *db_set;
+
+    if (p_op->packed_attrs == NULL)
+        return 0;
+
+    fs_set = attr_set_get(pool);
+    if (!fs_set)
+        return -ENOMEM;
+    db_set = attr_set_get(pool);
+    if (!db_set) {
+        attr_set_put(pool, fs_set);
+        return -ENOMEM;
+    }
+
+    attr_set_unpack(db_set, attr_set_unpack(fs_set, p_op->packed_attrs));
+
+    __sync_fetch_and_sub(&nb_packed_ops, 1);
+    __sync_fetch_and_sub(&packed_bytes, p_op->packed_size);
+
+    MemFree(p_op->packed_attrs);
+    p_op->packed_attrs = NULL;
+    p_op->packed_size = 0;
+    p_op->fs_attrs = fs_set;
+    p_op->db_attrs = db_set;
+    return 0;
+}
+
+/**
+ * Notify idle workers that some work may be available.
+ */
+static void notify_work_avail(void)
+{
+    /* full barrier: the counter is incremented before nb_waiting_threads
+     * is read (matches the barrier in EntryProcessor_GetNextOp) */
+    __sync_fetch_and_add(&work_avail_seq, 1);
+
+    /* signal only if threads are waiting */
+    if (__atomic_load_n(&nb_waiting_threads, __ATOMIC_RELAXED) > 0) {
+        P(work_avail_lock);
+        if (nb_waiting_threads > 0)
+            pthread_cond_signal(&work_avail_cond);
+        V(work_avail_lock);
+    }
+}
+
 #ifdef _DEBUG_ENTRYPROC
 static void dump_entry_op(entry_proc_op_t *p_op)
 {
@@ -97,7 +485,7 @@ static void dump_entry_op(entry_proc_op_t *p_op)
         printf("id=" DFID "\n", PFID(&p_op->entry_id));
 #endif
     /* mask is always set, even if fs/db_attrs is not set */
-    if (ATTR_FSorDB_TEST(p_op, fullpath))
+    if (p_op->packed_attrs == NULL && ATTR_FSorDB_TEST(p_op, fullpath))
         printf("path=%s\n", ATTR_FSorDB(p_op, fullpath));
 
     if (p_op->extra_info.is_changelog_record)
@@ -136,7 +524,7 @@ static void *entry_proc_worker_thr(void *arg)
         exit(1);
     }
 
-    while ((list_op = EntryProcessor_GetNextOp(&count)) != NULL) {
+    while ((list_op = EntryProcessor_GetNextOp(myinfo, &count)) != NULL) {
         const pipeline_stage_t *stage_info =
             &entry_proc_pipeline[list_op[0]->pipeline_stage];
         if (count == 1) {
@@ -252,12 +640,19 @@ int EntryProcessor_Init(pipeline_flavor_e flavor, run_flags_t flags, void *arg)
         return rc;
     entry_proc_pipeline = bench_pipeline;   /* pointer */
     entry_proc_descr = bench_pipeline_descr;    /* full copy */
+
+    legacy_sched = (getenv("RBH_BENCH_LEGACY_SCHED") != NULL);
+    DisplayLog(LVL_MAJOR, ENTRYPROC_TAG, "Pipeline benchmark: %u stages, "
+               "%s scheduler", bench_pipeline_descr.stage_count,
+               legacy_sched ? "legacy" : "lock-free");
 #else
     switch (flavor) {
     case STD_PIPELINE:
         entry_proc_pipeline = std_pipeline; /* pointer */
         entry_proc_descr = std_pipeline_descr;  /* full copy */
         /* arg is a diff_mask */
+        /* this pipeline invalidates cached paths on renames */
+        ListMgr_EnablePathCache();
         break;
     case DIFF_PIPELINE:
         entry_proc_pipeline = diff_pipeline;    /* pointer */
@@ -287,10 +682,19 @@ int EntryProcessor_Init(pipeline_flavor_e flavor, run_flags_t flags, void *arg)
                        entry_proc_pipeline[i].max_thread_count);
     }
 
+    if (entry_proc_conf.nb_pipelines > 1) {
+        nb_pipelines = entry_proc_conf.nb_pipelines;
+        DisplayLog(LVL_EVENT, ENTRYPROC_TAG, "Starting %u pipeline instances",
+                   nb_pipelines);
+    }
+
     pipeline =
-        (list_by_stage_t *) MemCalloc(entry_proc_descr.stage_count,
+        (list_by_stage_t *) MemCalloc(nb_pipelines *
+                                      entry_proc_descr.stage_count,
                                       sizeof(list_by_stage_t));
-    if (!pipeline)
+    stage_threads = MemCalloc(entry_proc_descr.stage_count,
+                              sizeof(unsigned int));
+    if (!pipeline || !stage_threads)
         return ENOMEM;
 
     if (entry_proc_conf.match_classes && policies.fileset_count == 0) {
@@ -303,13 +707,13 @@ int EntryProcessor_Init(pipeline_flavor_e flavor, run_flags_t flags, void *arg)
     if (entry_proc_conf.max_pending_operations > 0)
         sem_init(&pipeline_token, 0, entry_proc_conf.max_pending_operations);
 
-    for (i = 0; i < entry_proc_descr.stage_count; i++) {
+    for (i = 0; i < nb_pipelines * entry_proc_descr.stage_count; i++) {
         memset(&pipeline[i], 0, sizeof(*pipeline));
         rh_list_init(&pipeline[i].entries);
 #ifdef _DEBUG_ENTRYPROC
         printf("entry list for stage %u: list=%p, next=%p, prev=%p\n",
-               i, &pipeline[i].entries, pipeline[i].entries.next,
-               pipeline[i].entries.prev);
+               i % entry_proc_descr.stage_count, &pipeline[i].entries,
+               pipeline[i].entries.next, pipeline[i].entries.prev);
 #endif
         timerclear(&pipeline[i].total_processing_time);
         pthread_mutex_init(&pipeline[i].stage_mutex, NULL);
@@ -354,6 +758,7 @@ void EntryProcessor_Push(entry_proc_op_t *p_entry)
 {
     int i;
     unsigned int insert_stage;
+    unsigned int shard = p_entry->pipeline_shard % nb_pipelines;
 
     /* if a limit of pending operations is specified, wait for a token */
     if (entry_proc_conf.max_pending_operations > 0)
@@ -368,12 +773,17 @@ void EntryProcessor_Push(entry_proc_op_t *p_entry)
      * except if there is a non empty stage before
      */
     insert_stage = p_entry->pipeline_stage;
+    p_entry->pipeline_shard = shard;
+
+    /* the operation is complete: pack its attributes until it is
+     * processed */
+    op_pack(p_entry);
 
     /* take all locks for stage0 to insert_stage or first non empty stage */
     for (i = 0; i <= p_entry->pipeline_stage; i++) {
-        P(pipeline[i].stage_mutex);
+        P(STAGE_LIST(shard, i)->stage_mutex);
 
-        if (!rh_list_empty(&pipeline[i].entries)) {
+        if (!rh_list_empty(&STAGE_LIST(shard, i)->entries)) {
             insert_stage = i;
             break;
         }
@@ -393,37 +803,34 @@ void EntryProcessor_Push(entry_proc_op_t *p_entry)
     }
 #ifdef _DEBUG_ENTRYPROC
     printf("inserting to stage %u: list=%p, next=%p, prev=%p\n",
-           insert_stage, &pipeline[insert_stage].entries,
-           pipeline[insert_stage].entries.next,
-           pipeline[insert_stage].entries.prev);
+           insert_stage, &STAGE_LIST(shard, insert_stage)->entries,
+           STAGE_LIST(shard, insert_stage)->entries.next,
+           STAGE_LIST(shard, insert_stage)->entries.prev);
 #endif
 
     /* insert entry */
-    rh_list_add_tail(&p_entry->list, &pipeline[insert_stage].entries);
+    rh_list_add_tail(&p_entry->list, &STAGE_LIST(shard, insert_stage)->entries);
 
     if (insert_stage < p_entry->pipeline_stage)
-        pipeline[insert_stage].nb_processed_entries++;
+        STAGE_LIST(shard, insert_stage)->nb_processed_entries++;
     else
-        pipeline[insert_stage].nb_unprocessed_entries++;
+        STAGE_LIST(shard, insert_stage)->nb_unprocessed_entries++;
 
     /* release all lists lock */
     for (i = 0; i <= insert_stage; i++)
-        V(pipeline[i].stage_mutex);
+        V(STAGE_LIST(shard, i)->stage_mutex);
 
-    /* there is a new entry to be processed ! (signal only if threads
-     * are waiting) */
-    P(work_avail_lock);
-    if (nb_waiting_threads > 0)
-        pthread_cond_signal(&work_avail_cond);
-    V(work_avail_lock);
+    /* there is a new entry to be processed ! */
+    notify_work_avail();
 
 }   /* EntryProcessor_Push */
 
 /*
- * Move terminated operations to next stage.
+ * Move terminated operations to next stage of a pipeline instance.
  * The source stage is locked.
  */
-static int move_stage_entries(const unsigned int source_stage_index)
+static int move_stage_entries(const unsigned int shard,
+                              const unsigned int source_stage_index)
 {
     entry_proc_op_t *p_first = NULL;
     entry_proc_op_t *p_last = NULL;
@@ -439,7 +846,7 @@ static int move_stage_entries(const unsigned int source_stage_index)
     if (source_stage_index >= entry_proc_descr.stage_count - 1)
         return 0;
 
-    pl = &pipeline[source_stage_index];
+    pl = STAGE_LIST(shard, source_stage_index);
 
     /* is there at least 1 entry to be moved ? */
     if (rh_list_empty(&pl->entries))
@@ -483,13 +890,13 @@ static int move_stage_entries(const unsigned int source_stage_index)
     /* take all locks from next stage to insert_stage
      * or first non-empty stage */
     for (i = source_stage_index + 1; i <= pipeline_stage_min; i++) {
-        P(pipeline[i].stage_mutex);
+        P(STAGE_LIST(shard, i)->stage_mutex);
 
         /* make sure this stage has correctly been flushed */
-        if (!rh_list_empty(&pipeline[i].entries))
-            move_stage_entries(i);
+        if (!rh_list_empty(&STAGE_LIST(shard, i)->entries))
+            move_stage_entries(shard, i);
 
-        if (!rh_list_empty(&pipeline[i].entries)) {
+        if (!rh_list_empty(&STAGE_LIST(shard, i)->entries)) {
             insert_stage = i;
             break;
         }
@@ -500,17 +907,17 @@ static int move_stage_entries(const unsigned int source_stage_index)
         printf("Entries to be moved: %u\n", count);
         printf("INSERT STAGE (%u) != NEXT STAGE MIN(%u)\n", insert_stage,
                pipeline_stage_min);
-        printf("STAGE[%u].FIRST=%s, stage=%u\n", insert_stage,
-               ATTR(&rh_list_first_entry
-                    (&pipeline[insert_stage].entries, entry_proc_op_t,
-                     list)->fs_attrs, fullpath),
-               rh_list_first_entry(&pipeline[insert_stage].entries,
+        printf("STAGE[%u].FIRST=" DFID ", stage=%u\n", insert_stage,
+               PFID(&rh_list_first_entry
+                    (&STAGE_LIST(shard, insert_stage)->entries,
+                     entry_proc_op_t, list)->entry_id),
+               rh_list_first_entry(&STAGE_LIST(shard, insert_stage)->entries,
                                    entry_proc_op_t, list)->pipeline_stage);
-        printf("STAGE[%u].LAST=%s, stage=%u\n", insert_stage,
-               ATTR(&rh_list_last_entry
-                    (&pipeline[insert_stage].entries, entry_proc_op_t,
-                     list)->fs_attrs, fullpath),
-               rh_list_last_entry(&pipeline[insert_stage].entries,
+        printf("STAGE[%u].LAST=" DFID ", stage=%u\n", insert_stage,
+               PFID(&rh_list_last_entry
+                    (&STAGE_LIST(shard, insert_stage)->entries,
+                     entry_proc_op_t, list)->entry_id),
+               rh_list_last_entry(&STAGE_LIST(shard, insert_stage)->entries,
                                   entry_proc_op_t, list)->pipeline_stage);
     }
 #endif
@@ -548,45 +955,70 @@ static int move_stage_entries(const unsigned int source_stage_index)
          * And no thread can process it for now because the list is locked.
          */
         if (insert_stage < p_curr->pipeline_stage)
-            pipeline[insert_stage].nb_processed_entries++;
+            STAGE_LIST(shard, insert_stage)->nb_processed_entries++;
         else
-            pipeline[insert_stage].nb_unprocessed_entries++;
+            STAGE_LIST(shard, insert_stage)->nb_unprocessed_entries++;
     }
 
     /* insert entry list */
-    rh_list_splice_tail(&pipeline[insert_stage].entries, &rem);
+    rh_list_splice_tail(&STAGE_LIST(shard, insert_stage)->entries, &rem);
 
     /* release all lists lock (except the source one) */
     for (i = source_stage_index + 1; i <= insert_stage; i++)
-        V(pipeline[i].stage_mutex);
+        V(STAGE_LIST(shard, i)->stage_mutex);
 
  out:
     return count;
 }   /* move_stage_entries */
 
 /**
- * Return an entry to be processed.
+ * Return an entry to be processed in the given pipeline instance.
  * This entry is tagged "being_processed" and stage info is updated.
- * @param p_empty Output Boolean. In the case no entry is returned,
- *        this indicates if it is because the pipeline is empty.
+ * @param p_empty Output Boolean, set to false if the pipeline instance
+ *        is not empty.
  */
-static entry_proc_op_t **next_work_avail(bool *p_empty, int *op_count)
+static entry_proc_op_t **next_shard_work(worker_info_t *worker,
+                                         unsigned int shard,
+                                         bool *p_empty, int *op_count)
 {
     entry_proc_op_t *p_curr;
     int i;
     int tot_entries = 0;
 
-    if (terminate_flag == BREAK)
-        return NULL;
-
-    *p_empty = true;
-
     /* check every stage from the last to the first */
     for (i = entry_proc_descr.stage_count - 1; i >= 0; i--) {
-        list_by_stage_t *pl = &pipeline[i];
+        list_by_stage_t *pl = STAGE_LIST(shard, i);
+        const pipeline_stage_t *stage_info = &entry_proc_pipeline[i];
+
+        if (!legacy_sched) {
+            /* First check the stage counters without locking it,
+             * so that idle or saturated stages don't make all workers
+             * contend on their mutex. Counters are checked again under
+             * the stage lock. */
+            unsigned int ready = STAGE_HINT(pl, nb_unprocessed_entries);
+            unsigned int nb_thr = STAGE_HINT(pl, nb_threads);
+            bool busy;
+
+            if (stage_info->stage_flags & STAGE_FLAG_SEQUENTIAL)
+                busy = (nb_thr != 0);
+            else
+                busy = (stage_info->max_thread_count != 0
+                        && __atomic_load_n(&stage_threads[i], __ATOMIC_RELAXED)
+                            >= stage_info->max_thread_count);
+
+            if (ready == 0 || busy) {
+                /* Accumulate the number of entries in the upper stages. */
+                tot_entries += STAGE_HINT(pl, nb_current_entries) + ready
+                    + STAGE_HINT(pl, nb_processed_entries);
+                if (ready != 0)
+                    *p_empty = false;
+                continue;
+            }
+        }
 
         /* entries have not been processed at this stage. */
         P(pl->stage_mutex);
+        worker->nb_stage_locks++;
 
         /* Accumulate the number of entries in the upper stages. */
         tot_entries +=
@@ -650,10 +1082,17 @@ static entry_proc_op_t **next_work_avail(bool *p_empty, int *op_count)
                         return NULL;
                     }
 
+                    /* no memory to expand its attributes: retry later */
+                    if (op_unpack(p_curr) != 0) {
+                        V(pl->stage_mutex);
+                        return NULL;
+                    }
+
                     /* tag the entry and update stage info */
                     pl->nb_unprocessed_entries--;
                     pl->nb_current_entries++;
                     pl->nb_threads++;
+                    __sync_fetch_and_add(&stage_threads[i], 1);
                     p_curr->being_processed = 1;
 
                     V(pl->stage_mutex);
@@ -672,9 +1111,19 @@ static entry_proc_op_t **next_work_avail(bool *p_empty, int *op_count)
         else if ((entry_proc_pipeline[i].stage_flags & STAGE_FLAG_MAX_THREADS)
                  || (entry_proc_pipeline[i].stage_flags
                      & STAGE_FLAG_PARALLEL)) {
-            if ((entry_proc_pipeline[i].max_thread_count != 0)
-                && (pl->nb_threads
-                    >= entry_proc_pipeline[i].max_thread_count)) {
+            if (pl->flags & STAGE_FLAG_FORCE_SEQ) {
+                /* One thread is processing an operation, and that one
+                 * must be the only one in this stage. */
+                V(pl->stage_mutex);
+                continue;
+            }
+
+            /* Reserve a thread for this stage. Thread limits are common
+             * to all pipeline instances. */
+            if ((__sync_add_and_fetch(&stage_threads[i], 1)
+                 > entry_proc_pipeline[i].max_thread_count)
+                && (entry_proc_pipeline[i].max_thread_count != 0)) {
+                __sync_fetch_and_sub(&stage_threads[i], 1);
                 *p_empty = false;
                 /* thread quota for this stage is at maximum */
                 V(pl->stage_mutex);
@@ -687,13 +1136,6 @@ static entry_proc_op_t **next_work_avail(bool *p_empty, int *op_count)
                 continue;
             }
 
-            if (entry_proc_pipeline[i].stage_flags & STAGE_FLAG_FORCE_SEQ) {
-                /* One thread is processing an operation, and that one
-                 * must be the only one in this stage. */
-                V(pl->stage_mutex);
-                continue;
-            }
-
             /* check entries at this stage */
             rh_list_for_each_entry(p_curr, &pl->entries, list) {
                 /* the pipeline is not empty */
@@ -713,8 +1155,7 @@ static entry_proc_op_t **next_work_avail(bool *p_empty, int *op_count)
                         /* This is the first entry, and there is no
                          * other entry being processed in this or the
                          * upper stages. So we can process it */
-                        entry_proc_pipeline[i].stage_flags |=
-                            STAGE_FLAG_FORCE_SEQ;
+                        pl->flags |= STAGE_FLAG_FORCE_SEQ;
                     } else {
                         break;
                     }
@@ -757,6 +1198,12 @@ static entry_proc_op_t **next_work_avail(bool *p_empty, int *op_count)
                     continue;
                 }
 
+                /* no memory to expand its attributes: retry later */
+                if (op_unpack(p_curr) != 0) {
+                    pl->flags &= ~STAGE_FLAG_FORCE_SEQ;
+                    break;
+                }
+
                 /* this entry can be processed */
                 /* tag the entry and update stage info */
                 pl->nb_unprocessed_entries--;
@@ -777,7 +1224,7 @@ static entry_proc_op_t **next_work_avail(bool *p_empty, int *op_count)
                     && entry_proc_pipeline[i].test_batchable != NULL
                     && entry_proc_pipeline[i].stage_batch_function != NULL) {
                     entry_proc_op_t *p_next;
-                    attr_mask_t batch_mask = p_curr->fs_attrs.attr_mask;
+                    attr_mask_t batch_mask = p_curr->fs_attrs->attr_mask;
 
                     rh_list_for_each_entry_after(p_next, &pl->entries, p_curr,
                                                  list) {
@@ -788,6 +1235,15 @@ static entry_proc_op_t **next_work_avail(bool *p_empty, int *op_count)
                             /* entry is already beeing processed or is at
                              * a different stage */
                             break;
+                        else if ((entry_proc_pipeline[i].stage_flags
+                                  & STAGE_FLAG_ID_CONSTRAINT)
+                                 && (!p_next->entry_id_is_set
+                                     || !id_constraint_is_first_op(p_next)))
+                            /* a previous operation on the same id must
+                             * be processed first */
+                            break;
+                        else if (op_unpack(p_next) != 0)
+                            break;
 
                         if (entry_proc_pipeline[i].
                             test_batchable(p_curr, p_next, &batch_mask)) {
@@ -808,6 +1264,9 @@ static entry_proc_op_t **next_work_avail(bool *p_empty, int *op_count)
                 return listop;
             }
 
+            /* nothing to be processed: release the reserved thread */
+            __sync_fetch_and_sub(&stage_threads[i], 1);
+
         } else {
             /* unspecified stage flag */
             DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
@@ -830,20 +1289,50 @@ static entry_proc_op_t **next_work_avail(bool *p_empty, int *op_count)
 }
 
 /**
- * This function returns the next operation to be processed
- * according to pipeline stage/ordering constrains.
+ * Return an entry to be processed.
+ * This entry is tagged "being_processed" and stage info is updated.
+ * @param p_empty Output Boolean. In the case no entry is returned,
+ *        this indicates if it is because the pipeline is empty.
  */
-static entry_proc_op_t **EntryProcessor_GetNextOp(int *count)
+static entry_proc_op_t **next_work_avail(worker_info_t *worker,
+                                          bool *p_empty, int *op_count)
+{
+    entry_proc_op_t **list_op;
+    unsigned int i;
+
+    if (terminate_flag == BREAK)
+        return NULL;
+
+    *p_empty = true;
+    worker->nb_lookups++;
+
+    /* look in the pipeline instance of the worker first, then help
+     * the other ones */
+    for (i = 0; i < nb_pipelines; i++) {
+        list_op = next_shard_work(worker, (worker->index + i) % nb_pipelines,
+                                  p_empty, op_count);
+        if (list_op != NULL)
+            return list_op;
+    }
+
+    /* nothing found */
+    return NULL;
+}
+
+/**
+ * Former implementation of EntryProcessor_GetNextOp(), holding
+ * work_avail_lock while looking for work (kept for benchmarking).
+ */
+#ifdef _BENCH_PIPELINE
+static entry_proc_op_t **legacy_get_next_op(worker_info_t *worker, int *count)
 {
     bool is_empty;
     entry_proc_op_t **list_op;
-    int i;
-    *count = 0;
 
     P(work_avail_lock);
     nb_waiting_threads++;
 
-    while ((list_op = next_work_avail(&is_empty, count)) == NULL) {
+    while ((list_op = next_work_avail(worker, &is_empty, count)) == NULL) {
         if ((terminate_flag == BREAK)
             || ((terminate_flag == FLUSH) && is_empty)) {
             nb_waiting_threads--;
@@ -856,10 +1345,7 @@ static entry_proc_op_t **EntryProcessor_GetNextOp(int *count)
 
             return NULL;
         }
-#ifdef _DEBUG_ENTRYPROC
-        DisplayLog(LVL_FULL, ENTRYPROC_TAG, "Thread %#lx: no work available",
-                   pthread_self());
-#endif
+        worker->nb_idle_waits++;
         pthread_cond_wait(&work_avail_cond, &work_avail_lock);
     }
 
@@ -871,6 +1357,85 @@ static entry_proc_op_t **EntryProcessor_GetNextOp(int *count)
 
     V(work_avail_lock);
 
+    return list_op;
+}
+#endif
+
+/**
+ * This function returns the next operation to be processed
+ * according to pipeline stage/ordering constrains.
+ */
+static entry_proc_op_t **EntryProcessor_GetNextOp(worker_info_t *worker,
+                                                  int *count)
+{
+    bool is_empty;
+    entry_proc_op_t **list_op;
+    unsigned int seq;
+    int i;
+    *count = 0;
+
+#ifdef _BENCH_PIPELINE
+    if (legacy_sched) {
+        list_op = legacy_get_next_op(worker, count);
+        goto out;
+    }
+#endif
+
+    for (;;) {
+        /* snapshot the work event counter before looking for work */
+        seq = __atomic_load_n(&work_avail_seq, __ATOMIC_ACQUIRE);
+
+        list_op = next_work_avail(worker, &is_empty, count);
+        if (list_op != NULL)
+            break;
+
+        /* don't keep accounting changes unwritten while idle */
+        if (lmgr_acct_batched())
+            ListMgr_AcctFlush(&worker->lmgr);
+
+        P(work_avail_lock);
+        if ((terminate_flag == BREAK)
+            || ((terminate_flag == FLUSH) && is_empty)) {
+            /* maybe other threads can also terminate ? */
+            if (nb_waiting_threads > 0)
+                pthread_cond_signal(&work_avail_cond);
+
+            V(work_avail_lock);
+
+            return NULL;
+        }
+
+        nb_waiting_threads++;
+        /* full barrier: nb_waiting_threads is incremented before the counter
+         * is read again (matches the barrier in notify_work_avail) */
+        __sync_synchronize();
+
+        /* only sleep if no new work was notified since the lookup started */
+        if (seq == __atomic_load_n(&work_avail_seq, __ATOMIC_ACQUIRE)) {
+#ifdef _DEBUG_ENTRYPROC
+            DisplayLog(LVL_FULL, ENTRYPROC_TAG, "Thread %#lx: no work available",
+                       pthread_self());
+#endif
+            worker->nb_idle_waits++;
+            pthread_cond_wait(&work_avail_cond, &work_avail_lock);
+        }
+        nb_waiting_threads--;
+        V(work_avail_lock);
+    }
+
+    /* maybe other entries can be processed after this one ? */
+    if (__atomic_load_n(&nb_waiting_threads, __ATOMIC_RELAXED) > 0) {
+        P(work_avail_lock);
+        if (nb_waiting_threads > 0)
+            pthread_cond_signal(&work_avail_cond);
+        V(work_avail_lock);
+    }
+
+#ifdef _BENCH_PIPELINE
+ out:
+    if (list_op == NULL)
+        return NULL;
+#endif
     gettimeofday(&(list_op[0]->timestamp.start_processing_time), NULL);
     for (i = 1; i < *count; i++)
         list_op[i]->timestamp.start_processing_time =
@@ -884,6 +1449,8 @@ static entry_proc_op_t **EntryProcessor_GetNextOp(int *count)
  */
 void EntryProcessor_Release(entry_proc_op_t *p_op)
 {
+    op_pool_t *pool;
+
     /* @todo free entry_info */
 
     /* free specific info */
@@ -892,28 +1459,67 @@ void EntryProcessor_Release(entry_proc_op_t *p_op)
         p_op->extra_info_free_func(&p_op->extra_info);
     }
 
-    ListMgr_FreeAttrs(&p_op->fs_attrs);
-    ListMgr_FreeAttrs(&p_op->db_attrs);
+    pool = &op_pools[p_op->pool_index];
+
+    /* attributes must be expanded to free what they refer to */
+    if (op_unpack(p_op) != 0) {
+        DisplayLog(LVL_CRIT, ENTRYPROC_TAG, "Failed to expand the attributes "
+                   "of a released operation: some memory is lost");
+        __sync_fetch_and_sub(&nb_packed_ops, 1);
+        __sync_fetch_and_sub(&packed_bytes, p_op->packed_size);
+        MemFree(p_op->packed_attrs);
+    } else {
+        ListMgr_FreeAttrs(p_op->fs_attrs);
+        ListMgr_FreeAttrs(p_op->db_attrs);
+        attr_set_put(pool, p_op->fs_attrs);
+        attr_set_put(pool, p_op->db_attrs);
+    }
+    free(p_op->name_key);
+
+    /* put it back to its allocation pool, or free it if the pool
+     * is full */
+    P(pool->lock);
+    pool->nb_used--;
+    if (pool->nb_free < OP_POOL_MAX_FREE) {
+        rh_list_add(&p_op->list, &pool->free_ops);
+        pool->nb_free++;
+        p_op = NULL;
+    }
+    V(pool->lock);
 
-    /* free the memory */
-    MemFree(p_op);
+    if (p_op != NULL)
+        MemFree(p_op);
 }
 
 /**
- * Acknownledge a batch of operations.
+ * Acknowledge a batch of operations.
+ * If next_stages is not NULL, it gives the next stage of each operation
+ * (-1 to remove it from the pipeline). Else, all operations go to next_stage
+ * (or are removed if remove is true).
  */
-int EntryProcessor_AcknowledgeBatch(entry_proc_op_t **ops, unsigned int count,
-                                    unsigned int next_stage, bool remove)
+static int acknowledge_ops(entry_proc_op_t **ops, unsigned int count,
+                           const int *next_stages, unsigned int next_stage,
+                           bool remove)
 {
     const unsigned int curr_stage = ops[0]->pipeline_stage;
-    list_by_stage_t *pl = &pipeline[curr_stage];
+    const unsigned int shard = ops[0]->pipeline_shard;
+    list_by_stage_t *pl = STAGE_LIST(shard, curr_stage);
     int nb_moved;
+    unsigned int nb_removed = 0;
     struct timeval now, diff;
     int i;
 
     gettimeofday(&now, NULL);
     timersub(&now, &ops[0]->timestamp.start_processing_time, &diff);
 
+    /* pack the attributes of operations that go on waiting in the
+     * pipeline (other threads don't access them until they are released
+     * under the stage lock) */
+    for (i = 0; i < count; i++) {
+        if (next_stages != NULL ? next_stages[i] != -1 : !remove)
+            op_pack(ops[i]);
+    }
+
     /* lock current stage */
     P(pl->stage_mutex);
 
@@ -927,14 +1533,29 @@ int EntryProcessor_AcknowledgeBatch(entry_proc_op_t **ops, unsigned int count,
         pl->total_batched_entries += count;
     }
     pl->nb_threads--;
+    __sync_fetch_and_sub(&stage_threads[curr_stage], 1);
     timeradd(&diff, &pl->total_processing_time, &pl->total_processing_time);
 
+    if (curr_stage == entry_proc_descr.DB_APPLY) {
+        __sync_fetch_and_add(&db_apply_usec,
+                             diff.tv_sec * 1000000ULL + diff.tv_usec);
+        __sync_fetch_and_add(&db_apply_count, count);
+    }
+
     for (i = 0; i < count; i++) {
+        unsigned int op_next_stage = next_stage;
+        bool op_remove = remove;
+
+        if (next_stages != NULL) {
+            op_next_stage = next_stages[i];
+            op_remove = (next_stages[i] == -1);
+        }
+
         /* sanity check */
-        if ((!remove) && (ops[i]->pipeline_stage >= next_stage)) {
+        if ((!op_remove) && (ops[i]->pipeline_stage >= op_next_stage)) {
             DisplayLog(LVL_CRIT, ENTRYPROC_TAG, "CRITICAL: entry is already"
                        " in a higher pipeline stage %u >= %u !!!",
-                       ops[i]->pipeline_stage, next_stage);
+                       ops[i]->pipeline_stage, op_next_stage);
 
             V(pl->stage_mutex);
             RBH_BUG("Entry is already in a higher pipeline stage.");
@@ -942,10 +1563,10 @@ int EntryProcessor_AcknowledgeBatch(entry_proc_op_t **ops, unsigned int count,
 
         /* update their status */
         ops[i]->being_processed = 0;
-        ops[i]->pipeline_stage = next_stage;
+        ops[i]->pipeline_stage = op_next_stage;
 
         /* remove the entry, if it must be */
-        if (remove) {
+        if (op_remove) {
             /* update stage info. */
             pl->nb_processed_entries--;
             rh_list_del_init(&ops[i]->list);
@@ -953,13 +1574,15 @@ int EntryProcessor_AcknowledgeBatch(entry_proc_op_t **ops, unsigned int count,
             /* remove entry constraints on this id */
             if (ops[i]->id_is_referenced)
                 id_constraint_unregister(ops[i]);
+
+            nb_removed++;
         }
     }
 
     /* We're done with the entries in that stage. */
 
     /* check if entries are to be moved from this stage */
-    nb_moved = move_stage_entries(curr_stage);
+    nb_moved = move_stage_entries(shard, curr_stage);
 
     /* unlock current stage */
     V(pl->stage_mutex);
@@ -972,17 +1595,16 @@ int EntryProcessor_AcknowledgeBatch(entry_proc_op_t **ops, unsigned int count,
      * so it must have been moved.
      */
     /* @TODO check configuration for max_thread_count */
-    if (remove || (nb_moved > 0)
-        || (entry_proc_pipeline[curr_stage].max_thread_count != 0)) {
-        P(work_avail_lock);
-        if (nb_waiting_threads > 0)
-            pthread_cond_signal(&work_avail_cond);
-        V(work_avail_lock);
-    }
+    if ((nb_removed > 0) || (nb_moved > 0)
+        || (entry_proc_pipeline[curr_stage].max_thread_count != 0))
+        notify_work_avail();
 
-    /* free entry resources if asked */
-    if (remove) {
+    /* free entry resources of removed entries */
+    if (nb_removed > 0) {
         for (i = 0; i < count; i++) {
+            if (next_stages != NULL ? next_stages[i] != -1 : !remove)
+                continue;
+
             /* If a limit of pending operations is specified, release a token */
             if (entry_proc_conf.max_pending_operations > 0)
                 sem_post(&pipeline_token);
@@ -994,6 +1616,25 @@ int EntryProcessor_AcknowledgeBatch(entry_proc_op_t **ops, unsigned int count,
     return 0;
 }
 
+/**
+ * Acknownledge a batch of operations.
+ */
+int EntryProcessor_AcknowledgeBatch(entry_proc_op_t **ops, unsigned int count,
+                                    unsigned int next_stage, bool remove)
+{
+    return acknowledge_ops(ops, count, NULL, next_stage, remove);
+}
+
+/**
+ * Acknowledge a batch of operations that go to different stages.
+ */
+int EntryProcessor_AcknowledgeBatchStages(entry_proc_op_t **ops,
+                                          unsigned int count,
+                                          const int *next_stages)
+{
+    return acknowledge_ops(ops, count, next_stages, 0, false);
+}
+
 /**
  * Advise that the entry is ready for next step of the pipeline.
  * @param next_stage The next stage to be performed for this entry
@@ -1033,7 +1674,10 @@ static void print_op_stats(entry_proc_op_t *p_op, unsigned int stage,
                    entry_status_str(p_op, stage));
     } else
 #endif
-    if (ATTR_FSorDB_TEST(p_op, fullpath)) {
+    /* attributes of an operation are only readable while it waits
+     * (not being processed) with expanded attributes */
+    if (!p_op->being_processed && p_op->packed_attrs == NULL
+        && ATTR_FSorDB_TEST(p_op, fullpath)) {
         DisplayLog(LVL_EVENT, "STATS", "%-14s: %s: %s, status=%s",
                    strchr(entry_proc_pipeline[stage].stage_name, '_') + 1, what,
                    ATTR_FSorDB(p_op, fullpath), entry_status_str(p_op, stage));
@@ -1047,12 +1691,57 @@ static void print_op_stats(entry_proc_op_t *p_op, unsigned int stage,
                    entry_status_str(p_op, stage));
 }
 
+/**
+ * Sum the statistics of a stage for all pipeline instances,
+ * and reset them so the displayed performance is per period.
+ * @return true if there are pending operations at this stage.
+ */
+static bool stage_stats_collect(unsigned int stage, list_by_stage_t *sum)
+{
+    bool pending = false;
+    unsigned int i;
+
+    memset(sum, 0, sizeof(*sum));
+
+    for (i = 0; i < nb_pipelines; i++) {
+        list_by_stage_t *pl = STAGE_LIST(i, stage);
+
+        P(pl->stage_mutex);
+        sum->nb_threads += pl->nb_threads;
+        sum->nb_unprocessed_entries += pl->nb_unprocessed_entries;
+        sum->nb_current_entries += pl->nb_current_entries;
+        sum->nb_processed_entries += pl->nb_processed_entries;
+        sum->total_processed += pl->total_processed;
+        sum->nb_batches += pl->nb_batches;
+        sum->total_batched_entries += pl->total_batched_entries;
+        timeradd(&pl->total_processing_time, &sum->total_processing_time,
+                 &sum->total_processing_time);
+
+        /* reset stats so the displayed performance is per period */
+        timerclear(&pl->total_processing_time);
+        pl->total_processed = 0;
+        pl->total_batched_entries = 0;
+        pl->nb_batches = 0;
+
+        if (!rh_list_empty(&pl->entries))
+            pending = true;
+        V(pl->stage_mutex);
+    }
+    return pending;
+}
+
 void EntryProcessor_DumpCurrentStages(void)
 {
     unsigned int i;
     double tpe = 0.0;
     bool is_pending_op = false;
     unsigned int nb_get, nb_ins, nb_upd, nb_rm;
+    unsigned long long nb_lookups, nb_locks, nb_waits;
+    mem_stat_t op_stats, set_stats;
+    unsigned int nb_packed;
+#ifdef _BENCH_PIPELINE
+    unsigned long long nb_done = 0;
+#endif
 
     if (!entry_proc_pipeline)
         return; /* not initialized */
@@ -1067,51 +1756,64 @@ void EntryProcessor_DumpCurrentStages(void)
 
         id_constraint_stats();
 
+        op_pools_stats(&op_stats, &set_stats);
+        nb_packed = nb_packed_ops;
+        DisplayLog(LVL_MAJOR, "STATS", "Operations: %u in use, "
+                   "%u pooled (%zu bytes/op), %u with packed attributes "
+                   "(%.0f bytes/op)", op_stats.nb_used, op_stats.nb_prealloc,
+                   sizeof(entry_proc_op_t), nb_packed,
+                   nb_packed ? (double)packed_bytes / nb_packed : 0.0);
+        DisplayLog(LVL_MAJOR, "STATS", "Expanded attribute sets: %u in use, "
+                   "%u pooled (%zu bytes/set)", set_stats.nb_used,
+                   set_stats.nb_prealloc, sizeof(attr_set_t));
+        DisplayLog(LVL_MAJOR, "STATS", "Operation memory: %.1f MB",
+                   ((double)(op_stats.nb_used + op_stats.nb_prealloc)
+                        * sizeof(entry_proc_op_t)
+                    + (double)(set_stats.nb_used + set_stats.nb_prealloc)
+                        * sizeof(attr_set_t) + packed_bytes)
+                   / (1024.0 * 1024.0));
+
         DisplayLog(LVL_MAJOR, "STATS",
                    "%-18s | Wait | Curr | Done |     Total | ms/op |", "Stage");
 
         for (i = 0; i < entry_proc_descr.stage_count; i++) {
-            P(pipeline[i].stage_mutex);
+            list_by_stage_t st;
 
-            if (pipeline[i].total_processed != 0)
+            if (stage_stats_collect(i, &st))
+                is_pending_op = true;
+
+            if (st.total_processed != 0)
                 tpe =
-                    ((1000.0 * pipeline[i].total_processing_time.tv_sec) +
-                     (1E-3 * pipeline[i].total_processing_time.tv_usec)) /
-                    (double)(pipeline[i].total_processed);
+                    ((1000.0 * st.total_processing_time.tv_sec) +
+                     (1E-3 * st.total_processing_time.tv_usec)) /
+                    (double)(st.total_processed);
             else
                 tpe = 0.0;
 
-            if (pipeline[i].nb_batches > 0)
+            if (st.nb_batches > 0)
                 DisplayLog(LVL_MAJOR, "STATS", "%2u: %-14s |%5u | %4u | %4u | %9llu | %5.2f | %.2f%% batched (avg batch size: %.1f)",
                            i, strchr(entry_proc_pipeline[i].stage_name, '_') + 1, /* removes STAGE_ */
-                           pipeline[i].nb_unprocessed_entries,
-                           pipeline[i].nb_current_entries,
-                           pipeline[i].nb_processed_entries,
-                           pipeline[i].total_processed, tpe,
-                           pipeline[i].total_processed ? 100.0 *
-                           (float)pipeline[i].total_batched_entries /
-                           (float)pipeline[i].total_processed : 0.0,
-                           (float)pipeline[i].total_batched_entries /
-                           (float)pipeline[i].nb_batches);
+                           st.nb_unprocessed_entries,
+                           st.nb_current_entries,
+                           st.nb_processed_entries,
+                           st.total_processed, tpe,
+                           st.total_processed ? 100.0 *
+                           (float)st.total_batched_entries /
+                           (float)st.total_processed : 0.0,
+                           (float)st.total_batched_entries /
+                           (float)st.nb_batches);
             else
                 DisplayLog(LVL_MAJOR, "STATS", "%2u: %-14s |%5u | %4u | %4u | %9llu | %5.2f |",
                            i, strchr(entry_proc_pipeline[i].stage_name, '_') + 1, /* removes STAGE_ */
-                           pipeline[i].nb_unprocessed_entries,
-                           pipeline[i].nb_current_entries,
-                           pipeline[i].nb_processed_entries,
-                           pipeline[i].total_processed, tpe);
-
-            /* reset stats so the displayed performance is per period */
-            memset(&pipeline[i].total_processing_time, 0,
-                   sizeof(pipeline[i].total_processing_time));
-            pipeline[i].total_processed = 0;
-            pipeline[i].total_batched_entries = 0;
-            pipeline[i].nb_batches = 0;
+                           st.nb_unprocessed_entries,
+                           st.nb_current_entries,
+                           st.nb_processed_entries,
+                           st.total_processed, tpe);
 
-            V(pipeline[i].stage_mutex);
-
-            if (!rh_list_empty(&pipeline[i].entries))
-                is_pending_op = true;
+#ifdef _BENCH_PIPELINE
+            if (i == entry_proc_descr.stage_count - 1)
+                nb_done = st.total_processed;
+#endif
         }
         nb_get = nb_ins = nb_upd = nb_rm = 0;
         for (i = 0; i < entry_proc_conf.nb_thread; i++) {
@@ -1124,13 +1826,53 @@ void EntryProcessor_DumpCurrentStages(void)
         }
         DisplayLog(LVL_MAJOR, "STATS", "DB ops: get=%u/ins=%u/upd=%u/rm=%u",
                    nb_get, nb_ins, nb_upd, nb_rm);
+
+        nb_lookups = nb_locks = nb_waits = 0;
+        for (i = 0; i < entry_proc_conf.nb_thread; i++) {
+            if (worker_params) {
+                nb_lookups += worker_params[i].nb_lookups;
+                nb_locks += worker_params[i].nb_stage_locks;
+                nb_waits += worker_params[i].nb_idle_waits;
+            }
+        }
+        DisplayLog(LVL_MAJOR, "STATS", "Scheduler: lookups=%llu, "
+                   "stage locks/lookup=%.2f, idle waits=%llu", nb_lookups,
+                   nb_lookups ? (double)nb_locks / (double)nb_lookups : 0.0,
+                   nb_waits);
+#ifdef _BENCH_PIPELINE
+        {
+            static struct timeval last_dump = { 0 };
+            struct timeval now, diff;
+
+            gettimeofday(&now, NULL);
+            if (timerisset(&last_dump)) {
+                timersub(&now, &last_dump, &diff);
+                if (timerisset(&diff)) {
+                    /* entries processed by the last stage since last dump */
+                    DisplayLog(LVL_MAJOR, "STATS", "Pipeline throughput "
+                               "(%s scheduler): %.1f ops/sec",
+                               legacy_sched ? "legacy" : "lock-free",
+                               (double)nb_done / ((double)diff.tv_sec
+                                                  + 1E-6 * diff.tv_usec));
+                }
+            }
+            last_dump = now;
+        }
+#endif
     }
 
     if (TestDisplayLevel(LVL_EVENT)) {
         if (is_pending_op) {
             DisplayLog(LVL_EVENT, "STATS", "--- Pipeline stage details ---");
             /* pipeline stage details */
-            for (i = 0; i < entry_proc_descr.stage_count; i++) {
+            for (i = 0; i < nb_pipelines * entry_proc_descr.stage_count;
+                 i++) {
+                unsigned int stage = i % entry_proc_descr.stage_count;
+
+                if (nb_pipelines > 1 && stage == 0)
+                    DisplayLog(LVL_EVENT, "STATS", "Pipeline #%u:",
+                               i / entry_proc_descr.stage_count);
+
                 P(pipeline[i].stage_mutex);
                 if (!rh_list_empty(&pipeline[i].entries)) {
                     entry_proc_op_t *op1, *op2;
@@ -1142,10 +1884,10 @@ void EntryProcessor_DumpCurrentStages(void)
                                            entry_proc_op_t, list);
 
                     if (op1 != op2) {
-                        print_op_stats(op1, i, "first");
-                        print_op_stats(op2, i, "last");
+                        print_op_stats(op1, stage, "first");
+                        print_op_stats(op2, stage, "last");
                     } else
-                        print_op_stats(op1, i, "(1 op)");
+                        print_op_stats(op1, stage, "(1 op)");
                 }
                 V(pipeline[i].stage_mutex);
 
@@ -1158,15 +1900,58 @@ entry_proc_op_t *EntryProcessor_Get(void)
 {
     /* allocate a new pipeline entry */
     entry_proc_op_t *p_entry;
+    op_pool_t *pool;
+
+    pthread_once(&op_pools_once, op_pools_init);
+
+    if (thread_pool_index == -1)
+        thread_pool_index = __sync_fetch_and_add(&next_pool_index, 1)
+                                % OP_POOL_COUNT;
+    pool = &op_pools[thread_pool_index];
+
+    p_entry = NULL;
+    P(pool->lock);
+    if (!rh_list_empty(&pool->free_ops)) {
+        p_entry = rh_list_first_entry(&pool->free_ops, entry_proc_op_t,
+                                      list);
+        rh_list_del(&p_entry->list);
+        pool->nb_free--;
+    }
+    pool->nb_used++;
+    V(pool->lock);
+
+    if (p_entry == NULL) {
+        p_entry = (entry_proc_op_t *) MemAlloc(sizeof(entry_proc_op_t));
+        if (!p_entry) {
+            P(pool->lock);
+            pool->nb_used--;
+            V(pool->lock);
+            return NULL;
+        }
+    }
 
-    p_entry = (entry_proc_op_t *) MemCalloc(1, sizeof(entry_proc_op_t));
-
-    if (!p_entry)
+    /* a recycled operation must not keep any data of a previous entry */
+    memset(p_entry, 0, sizeof(entry_proc_op_t));
+    p_entry->pool_index = thread_pool_index;
+
+    /* attributes are expanded while the operation is built */
+    p_entry->fs_attrs = attr_set_get(pool);
+    p_entry->db_attrs = attr_set_get(pool);
+    if (!p_entry->fs_attrs || !p_entry->db_attrs) {
+        if (p_entry->fs_attrs)
+            attr_set_put(pool, p_entry->fs_attrs);
+        if (p_entry->db_attrs)
+            attr_set_put(pool, p_entry->db_attrs);
+        P(pool->lock);
+        pool->nb_used--;
+        V(pool->lock);
+        MemFree(p_entry);
         return NULL;
+    }
 
     /* nothing is set */
-    ATTR_MASK_INIT(&p_entry->db_attrs);
-    ATTR_MASK_INIT(&p_entry->fs_attrs);
+    attr_set_clear(p_entry->db_attrs);
+    attr_set_clear(p_entry->fs_attrs);
 
     extra_info_init(&p_entry->extra_info);
 
@@ -1179,7 +1964,7 @@ static unsigned int count_nb_ops(void)
     int i;
     unsigned int total = 0;
 
-    for (i = 0; i < entry_proc_descr.stage_count; i++) {
+    for (i = 0; i < nb_pipelines * entry_proc_descr.stage_count; i++) {
         total += pipeline[i].nb_current_entries
             + pipeline[i].nb_unprocessed_entries
             + pipeline[i].nb_processed_entries;
@@ -1188,6 +1973,43 @@ static unsigned int count_nb_ops(void)
     return total;
 }
 
+/**
+ * Get the current load of the pipeline (lock-free, values are hints).
+ */
+void EntryProcessor_GetLoad(pipeline_load_t *load)
+{
+    unsigned int i, j;
+
+    memset(load, 0, sizeof(*load));
+
+    if (!entry_proc_pipeline || !pipeline)
+        return; /* not initialized */
+
+    for (i = 0; i < nb_pipelines; i++) {
+        for (j = 0; j < entry_proc_descr.stage_count; j++) {
+            list_by_stage_t *pl = STAGE_LIST(i, j);
+            unsigned int nb = STAGE_HINT(pl, nb_unprocessed_entries)
+                + STAGE_HINT(pl, nb_current_entries)
+                + STAGE_HINT(pl, nb_processed_entries);
+
+            load->nb_ops += nb;
+            if (j == entry_proc_descr.DB_APPLY)
+                load->db_apply_waiting += nb;
+        }
+    }
+
+    /* what the pipeline can hold without blocking producers, or else
+     * what the DB_APPLY stage can absorb at once */
+    if (entry_proc_conf.max_pending_operations > 0)
+        load->capacity = entry_proc_conf.max_pending_operations;
+    else
+        load->capacity = entry_proc_conf.nb_thread
+                         * MAX2(entry_proc_conf.max_batch_size, 1);
+
+    load->db_apply_usec = __atomic_load_n(&db_apply_usec, __ATOMIC_RELAXED);
+    load->db_apply_count = __atomic_load_n(&db_apply_count, __ATOMIC_RELAXED);
+}
+
 /**
  * Terminate EntryProcessor
  * \param flush_ops: wait the queue to be flushed
@@ -1210,7 +2032,10 @@ int EntryProcessor_Terminate(bool flush_ops)
                terminate_flag == BREAK ? "BREAK" : "FLUSH");
 
     /* force idle thread to wake up */
+    __sync_fetch_and_add(&work_avail_seq, 1);
+    P(work_avail_lock);
     pthread_cond_broadcast(&work_avail_cond);
+    V(work_avail_lock);
 
     /* wait for all workers to process all pipeline entries and terminate */
     while (nb_finished_threads < entry_proc_conf.nb_thread) {
@@ -1240,12 +2065,14 @@ int EntryProcessor_Terminate(bool flush_ops)
  * A stage was blocked waiting for an operation to get its FID. This
  * is now done, so unblock the stage.
  */
-void EntryProcessor_Unblock(int stage)
+void EntryProcessor_Unblock(const entry_proc_op_t *p_op, int stage)
 {
-    P(pipeline[stage].stage_mutex);
+    list_by_stage_t *pl = STAGE_LIST(p_op->pipeline_shard, stage);
+
+    P(pl->stage_mutex);
 
     /* and unset the block. */
-    entry_proc_pipeline[stage].stage_flags &= ~STAGE_FLAG_FORCE_SEQ;
+    pl->flags &= ~STAGE_FLAG_FORCE_SEQ;
 
-    V(pipeline[stage].stage_mutex);
+    V(pl->stage_mutex);
 }
@@ -81,10 +81,9 @@ int id_constraint_register(entry_proc_op_t *p_op, int at_head)
     V(slot->lock);
 
     /* also lock parent_id/name */
-    if (ATTR_MASK_TEST(&p_op->fs_attrs, parent_id) &&
-        ATTR_MASK_TEST(&p_op->fs_attrs, name)) {
-        slot = get_name_hash_slot(name_hash, &ATTR(&p_op->fs_attrs, parent_id),
-                                  ATTR(&p_op->fs_attrs, name));
+    if (p_op->name_key != NULL) {
+        slot = get_name_hash_slot(name_hash, &p_op->name_key_parent,
+                                  p_op->name_key);
         P(slot->lock);
 
         if (at_head)
@@ -151,18 +150,14 @@ bool id_constraint_is_first_op(entry_proc_op_t *p_op_in)
 
     /* Entry may be the first (or is not registered).
      * Additional check of parent/name constraint: */
-    if (ATTR_MASK_TEST(&p_op_in->fs_attrs, parent_id) &&
-        ATTR_MASK_TEST(&p_op_in->fs_attrs, name)) {
-        slot =
-            get_name_hash_slot(name_hash, &ATTR(&p_op_in->fs_attrs, parent_id),
-                               ATTR(&p_op_in->fs_attrs, name));
+    if (p_op_in->name_key != NULL) {
+        slot = get_name_hash_slot(name_hash, &p_op_in->name_key_parent,
+                                  p_op_in->name_key);
         P(slot->lock);
         rh_list_for_each_entry(op, &slot->list, name_hash_list) {
-            if (entry_id_equal
-                (&ATTR(&p_op_in->fs_attrs, parent_id),
-                 &ATTR(&op->fs_attrs, parent_id))
-                && !strcmp(ATTR(&p_op_in->fs_attrs, name),
-                           ATTR(&op->fs_attrs, name))) {
+            if (entry_id_equal(&p_op_in->name_key_parent,
+                               &op->name_key_parent)
+                && !strcmp(p_op_in->name_key, op->name_key)) {
                 if (op == p_op_in)
                     is_first = 1;
                 else {
@@ -170,8 +165,8 @@ bool id_constraint_is_first_op(entry_proc_op_t *p_op_in)
                     DisplayLog(LVL_FULL, "IdConstraint",
                                "Pending operation with the same parent/name: "
                                DFID "/%s (%s). next op: %s",
-                               PFID(&ATTR(&p_op_in->fs_attrs, parent_id)),
-                               ATTR(&p_op_in->fs_attrs, name), op_name(op),
+                               PFID(&p_op_in->name_key_parent),
+                               p_op_in->name_key, op_name(op),
                                op_name(p_op_in));
                 }
                 break;
@@ -211,11 +206,9 @@ int id_constraint_unregister(entry_proc_op_t *p_op)
     V(slot->lock);
 
     if (p_op->name_is_referenced) {
-        if (ATTR_MASK_TEST(&p_op->fs_attrs, parent_id) &&
-            ATTR_MASK_TEST(&p_op->fs_attrs, name)) {
-            slot =
-                get_name_hash_slot(name_hash, &ATTR(&p_op->fs_attrs, parent_id),
-                                   ATTR(&p_op->fs_attrs, name));
+        if (p_op->name_key != NULL) {
+            slot = get_name_hash_slot(name_hash, &p_op->name_key_parent,
+                                      p_op->name_key);
             /* Remove the entry */
             P(slot->lock);
 
@@ -261,6 +254,9 @@ static void entry_proc_cfg_set_default(void *module_config)
 
     conf->max_pending_operations = 100;
     conf->max_batch_size = 100;
+    conf->nb_pipelines = 1;
+    conf->gc_chunk_size = 100000;
+    conf->scan_seen_set = false;
     conf->match_classes = true;
 
     conf->detect_fake_mtime = false;
@@ -277,6 +273,9 @@ static void entry_proc_cfg_write_default(FILE *output)
 
     print_line(output, 1, "max_pending_operations :  100");
     print_line(output, 1, "max_batch_size         :  100");
+    print_line(output, 1, "nb_pipelines           :  1");
+    print_line(output, 1, "gc_chunk_size          :  100000");
+    print_line(output, 1, "scan_seen_set          :  no");
     print_line(output, 1, "match_classes          :  yes");
     print_line(output, 1, "detect_fake_mtime      :  no");
     print_end_block(output, 0);
@@ -424,8 +423,8 @@ static int entry_proc_cfg_read(config_file_t config, void *module_config,
 
     /* buffer to store arg names */
     char *pipeline_names = NULL;
-    /* max size is max pipeline steps (<10) + other args (<6) */
-#define MAX_ENTRYPROC_ARGS 16
+    /* max size is max pipeline steps (<10) + other args (<10) */
+#define MAX_ENTRYPROC_ARGS 20
     char *entry_proc_allowed[MAX_ENTRYPROC_ARGS] = { 0 };
 
     const cfg_param_t cfg_params[] = {
@@ -435,6 +434,10 @@ static int entry_proc_cfg_read(config_file_t config, void *module_config,
          &conf->max_pending_operations, 0},
         {"max_batch_size", PT_INT, PFLG_POSITIVE | PFLG_NOT_NULL,
          &conf->max_batch_size, 0},
+        {"nb_pipelines", PT_INT, PFLG_POSITIVE | PFLG_NOT_NULL,
+         &conf->nb_pipelines, 0},
+        {"gc_chunk_size", PT_INT, PFLG_POSITIVE, &conf->gc_chunk_size, 0},
+        {"scan_seen_set", PT_BOOL, 0, &conf->scan_seen_set, 0},
         {"match_classes", PT_BOOL, 0, &conf->match_classes, 0},
         {"detect_fake_mtime", PT_BOOL, 0, &conf->detect_fake_mtime, 0},
 
@@ -465,6 +468,12 @@ static int entry_proc_cfg_read(config_file_t config, void *module_config,
                    ENTRYPROC_CONFIG_BLOCK " should have at least 2 threads to "
                    "avoid pipeline step starvation!");
 
+    if (conf->nb_pipelines > conf->nb_thread)
+        DisplayLog(LVL_MAJOR, "EntryProc_Config", "WARNING: "
+                   ENTRYPROC_CONFIG_BLOCK "::nb_pipelines (%u) is higher than "
+                   "nb_threads (%u): pipelines will share worker threads.",
+                   conf->nb_pipelines, conf->nb_thread);
+
     /* look for '<stage>_thread_max' parameters (for all pipelines) */
 
     /* Set default pipeline config according to EntryProc config
@@ -509,6 +518,9 @@ static int entry_proc_cfg_read(config_file_t config, void *module_config,
     entry_proc_allowed[next_idx++] = "nb_threads";
     entry_proc_allowed[next_idx++] = "max_pending_operations";
     entry_proc_allowed[next_idx++] = "max_batch_size";
+    entry_proc_allowed[next_idx++] = "nb_pipelines";
+    entry_proc_allowed[next_idx++] = "gc_chunk_size";
+    entry_proc_allowed[next_idx++] = "scan_seen_set";
     entry_proc_allowed[next_idx++] = "match_classes";
     entry_proc_allowed[next_idx++] = "detect_fake_mtime";
 
@@ -542,6 +554,11 @@ static int entry_proc_cfg_reload(entry_proc_config_t *conf)
                    ENTRYPROC_CONFIG_BLOCK
                    "::max_pending_operations changed in config file, but cannot be modified dynamically");
 
+    if (conf->nb_pipelines != entry_proc_conf.nb_pipelines)
+        DisplayLog(LVL_MAJOR, "EntryProc_Config",
+                   ENTRYPROC_CONFIG_BLOCK
+                   "::nb_pipelines changed in config file, but cannot be modified dynamically");
+
     if (conf->max_batch_size != entry_proc_conf.max_batch_size) {
         DisplayLog(LVL_MAJOR, "EntryProc_Config",
                    ENTRYPROC_CONFIG_BLOCK
@@ -550,6 +567,23 @@ static int entry_proc_cfg_reload(entry_proc_config_t *conf)
         entry_proc_conf.max_batch_size = conf->max_batch_size;
     }
 
+    if (conf->gc_chunk_size != entry_proc_conf.gc_chunk_size) {
+        DisplayLog(LVL_MAJOR, "EntryProc_Config",
+                   ENTRYPROC_CONFIG_BLOCK
+                   "::gc_chunk_size updated: '%u'->'%u'",
+                   entry_proc_conf.gc_chunk_size, conf->gc_chunk_size);
+        entry_proc_conf.gc_chunk_size = conf->gc_chunk_size;
+    }
+
+    if (conf->scan_seen_set != entry_proc_conf.scan_seen_set) {
+        DisplayLog(LVL_MAJOR, "EntryProc_Config",
+                   ENTRYPROC_CONFIG_BLOCK
+                   "::scan_seen_set updated: '%s'->'%s' (next scan)",
+                   bool2str(entry_proc_conf.scan_seen_set),
+                   bool2str(conf->scan_seen_set));
+        entry_proc_conf.scan_seen_set = conf->scan_seen_set;
+    }
+
     if (conf->match_classes != entry_proc_conf.match_classes) {
         DisplayLog(LVL_MAJOR, "EntryProc_Config",
                    ENTRYPROC_CONFIG_BLOCK "::match_classes updated: '%s'->'%s'",
@@ -608,6 +642,30 @@ static void entry_proc_cfg_write_template(FILE *output)
     print_line(output, 1, "# max batched DB operations (1=no batching)");
     print_line(output, 1, "max_batch_size = 100;");
     fprintf(output, "\n");
+    print_line(output, 1,
+               "# Number of independent pipeline instances. Changelog records");
+    print_line(output, 1,
+               "# of each MDT are processed and acknowledged by their own");
+    print_line(output, 1,
+               "# instance, so set it to the number of MDTs to process them");
+    print_line(output, 1, "# in parallel (DNE).");
+    print_line(output, 1, "nb_pipelines = 1;");
+    fprintf(output, "\n");
+    print_line(output, 1,
+               "# Max number of entries removed in each transaction when");
+    print_line(output, 1,
+               "# cleaning entries that were not seen by a scan (0: single");
+    print_line(output, 1, "# transaction).");
+    print_line(output, 1, "gc_chunk_size = 100000;");
+    fprintf(output, "\n");
+    print_line(output, 1,
+               "# Record the entries seen by full scans in memory, so that");
+    print_line(output, 1,
+               "# unchanged entries are not updated in the database");
+    print_line(output, 1,
+               "# (their md_update is then the time they last changed).");
+    print_line(output, 1, "scan_seen_set = no;");
+    fprintf(output, "\n");
 
     print_line(output, 1,
                "# Optionnaly specify a maximum thread count for each stage of the pipeline:");
@@ -673,11 +731,11 @@ void check_and_warn_fake_mtime(const struct entry_proc_op_t *p_op)
     char ct[128];
 
     /* check if mtime is before estimated creation time */
-    if (ATTR(&p_op->fs_attrs, last_mod) < ATTR_FSorDB(p_op, creation_time)) {
-        time2human_helper(ATTR(&p_op->fs_attrs, last_mod), "mtime", mt,
+    if (ATTR(p_op->fs_attrs, last_mod) < ATTR_FSorDB(p_op, creation_time)) {
+        time2human_helper(ATTR(p_op->fs_attrs, last_mod), "mtime", mt,
                           sizeof(mt), p_op);
 
-        time2human_helper(ATTR(&p_op->fs_attrs, creation_time), "crtime", ct,
+        time2human_helper(ATTR(p_op->fs_attrs, creation_time), "crtime", ct,
                           sizeof(ct), p_op);
 
         if (ATTR_FSorDB_TEST(p_op, fullpath))
@@ -691,8 +749,8 @@ void check_and_warn_fake_mtime(const struct entry_proc_op_t *p_op)
                        ct);
     }
     /* a 24h delay can be explained by different timezones */
-    else if (ATTR(&p_op->fs_attrs, last_mod) > time(NULL) + 86400) {
-        time2human_helper(ATTR(&p_op->fs_attrs, last_mod), "mtime", mt,
+    else if (ATTR(p_op->fs_attrs, last_mod) > time(NULL) + 86400) {
+        time2human_helper(ATTR(p_op->fs_attrs, last_mod), "mtime", mt,
                           sizeof(mt), p_op);
 
         if (ATTR_FSorDB_TEST(p_op, fullpath))
@@ -720,7 +778,7 @@ void check_stripe_info(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
      *      - Check stripe validator in DB: if OK, don't update DB info
      *      - if an error is reported, update with the new values.
      */
-    if (!ATTR_MASK_TEST(&p_op->fs_attrs, stripe_info)) {
+    if (!ATTR_MASK_TEST(p_op->fs_attrs, stripe_info)) {
 #endif
         /* check it exists in DB */
         if (ListMgr_CheckStripe(lmgr, &p_op->entry_id, VALID_EXISTS) !=
@@ -731,8 +789,8 @@ void check_stripe_info(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
             /* don't need to get stripe if we already have fresh stripe info
              * from FS */
-            if (!(ATTR_MASK_TEST(&p_op->fs_attrs, stripe_info)
-                  && ATTR_MASK_TEST(&p_op->fs_attrs, stripe_items))) {
+            if (!(ATTR_MASK_TEST(p_op->fs_attrs, stripe_info)
+                  && ATTR_MASK_TEST(p_op->fs_attrs, stripe_items))) {
                 attr_mask_set_index(&p_op->fs_attr_need,
                                     ATTR_INDEX_stripe_info);
                 attr_mask_set_index(&p_op->fs_attr_need,
@@ -747,7 +805,7 @@ void check_stripe_info(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
 #ifdef HAVE_LLAPI_FSWAP_LAYOUTS
     } else if (ListMgr_CheckStripe(lmgr, &p_op->entry_id,
-                                   ATTR(&p_op->fs_attrs, stripe_info).validator)
+                                   ATTR(p_op->fs_attrs, stripe_info).validator)
                == DB_SUCCESS) {
         /* Keep the stripe info in fs_attrs structure, so it is available
          * for matching.
@@ -761,6 +819,138 @@ void check_stripe_info(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 }
 #endif
 
+/** marks an operation whose DB attributes are not retrieved yet */
+#define DB_RC_PENDING   (-1)
+
+void get_db_attrs_batch(struct entry_proc_op_t **ops, unsigned int count,
+                        lmgr_t *lmgr, int *db_rcs)
+{
+    entry_id_t **ids;
+    attr_set_t **attrs;
+    unsigned int *grp;
+    int *grp_rcs;
+    unsigned int i, j, n;
+    int rc;
+
+    ids = MemCalloc(count, sizeof(*ids));
+    attrs = MemCalloc(count, sizeof(*attrs));
+    grp = MemCalloc(count, sizeof(*grp));
+    grp_rcs = MemCalloc(count, sizeof(*grp_rcs));
+
+    if (!ids || !attrs || !grp || !grp_rcs) {
+        /* fallback to per-entry requests */
+        for (i = 0; i < count; i++)
+            db_rcs[i] = ListMgr_Get(lmgr, &ops[i]->entry_id,
+                                    ops[i]->db_attrs);
+        goto out;
+    }
+
+    for (i = 0; i < count; i++)
+        db_rcs[i] = DB_RC_PENDING;
+
+    for (i = 0; i < count; i++) {
+        attr_mask_t mask;
+
+        if (db_rcs[i] != DB_RC_PENDING)
+            continue;
+
+        /* group the pending operations that request the same attributes */
+        mask = ops[i]->db_attrs->attr_mask;
+        n = 0;
+        for (j = i; j < count; j++) {
+            if (db_rcs[j] != DB_RC_PENDING
+                || !attr_mask_equal(&ops[j]->db_attrs->attr_mask, &mask))
+                continue;
+
+            grp[n] = j;
+            ids[n] = &ops[j]->entry_id;
+            attrs[n] = ops[j]->db_attrs;
+            n++;
+        }
+
+        DisplayLog(LVL_FULL, ENTRYPROC_TAG, "BatchGet(%u ops: " DFID "...)",
+                   n, PFID(ids[0]));
+
+        rc = ListMgr_GetBatch(lmgr, ids, attrs, n, grp_rcs);
+        for (j = 0; j < n; j++)
+            db_rcs[grp[j]] = (rc != DB_SUCCESS) ? rc : grp_rcs[j];
+    }
+
+ out:
+    MemFree(grp_rcs);
+    MemFree(grp);
+    MemFree(attrs);
+    MemFree(ids);
+}
+
+/**
+ * Report the usage changes of an operation to the ancestors of the entry
+ * (DIR_STAT), before it is applied to the database.
+ */
+void report_dir_stat(const struct entry_proc_op_t *p_op, lmgr_t *lmgr)
+{
+    lmgr_dirstat_entry_t old_ent, new_ent;
+    bool has_old, has_new;
+    int rc;
+
+    if (!lmgr_dir_stat())
+        return;
+
+    switch (p_op->db_op_type) {
+    case OP_TYPE_INSERT:
+        if (!dirstat_entry_from_attrs(&new_ent, p_op->fs_attrs, NULL))
+            return;
+        rc = ListMgr_DirStatUpdate(lmgr, &p_op->entry_id, NULL, &new_ent,
+                                   false);
+        break;
+
+    case OP_TYPE_UPDATE:
+        has_old = dirstat_entry_from_attrs(&old_ent, p_op->db_attrs, NULL);
+        has_new = dirstat_entry_from_attrs(&new_ent, p_op->fs_attrs,
+                                           p_op->db_attrs);
+
+        /* a new name of a file with several links: its other names
+         * are unchanged */
+        if (has_old && has_new
+            && !entry_id_equal(&old_ent.parent_id, &new_ent.parent_id)
+            && new_ent.type != TYPE_DIR && ATTR_FSorDB_TEST(p_op, nlink)
+            && ATTR_FSorDB(p_op, nlink) > 1) {
+#ifdef HAVE_CHANGELOGS
+            if (p_op->extra_info.is_changelog_record)
+                has_old = false;
+            else
+#endif
+                /* a scan can't tell a new link from a known one:
+                 * the usage will be fixed at the end of the scan */
+                return;
+        }
+
+        rc = ListMgr_DirStatUpdate(lmgr, &p_op->entry_id,
+                                   has_old ? &old_ent : NULL,
+                                   has_new ? &new_ent : NULL, false);
+        break;
+
+    case OP_TYPE_REMOVE_ONE:
+    case OP_TYPE_REMOVE_LAST:
+    case OP_TYPE_SOFT_REMOVE:
+        /* the removed name is in fs_attrs */
+        if (!dirstat_entry_from_attrs(&old_ent, p_op->fs_attrs,
+                                      p_op->db_attrs))
+            return;
+        rc = ListMgr_DirStatUpdate(lmgr, &p_op->entry_id, &old_ent, NULL,
+                                   p_op->db_op_type != OP_TYPE_REMOVE_ONE);
+        break;
+
+    default:
+        return;
+    }
+
+    if (rc)
+        DisplayLog(LVL_MAJOR, ENTRYPROC_TAG, "Error %d updating the usage of "
+                   "the ancestors of " DFID ": %s", rc, PFID(&p_op->entry_id),
+                   lmgr_err2str(rc));
+}
+
 static void *entry_proc_cfg_new(void)
 {
     return calloc(1, sizeof(entry_proc_config_t));
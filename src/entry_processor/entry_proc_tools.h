@@ -23,6 +23,17 @@ typedef struct entry_proc_config_t {
     unsigned int nb_thread;
     unsigned int max_pending_operations;
     unsigned int max_batch_size;
+    /** number of independent pipeline instances
+     * (changelog records of MDT i go to pipeline i % nb_pipelines) */
+    unsigned int nb_pipelines;
+
+    /** max number of entries removed in each transaction of the
+     * end-of-scan garbage collection (0 = single transaction) */
+    unsigned int gc_chunk_size;
+
+    /** record the entries seen by full scans in memory instead of
+     * updating their md_update/path_update */
+    bool scan_seen_set;
 
     bool match_classes;
 
@@ -70,6 +81,24 @@ void time2human_helper(time_t t, const char *attr_name, char *str,
 
 void check_and_warn_fake_mtime(const struct entry_proc_op_t *p_op);
 
+/**
+ * Retrieve DB attributes (as requested in p_op->db_attrs->attr_mask)
+ * for a set of operations, with one DB request per set of operations
+ * requesting the same attributes. A null mask only checks entry existence.
+ * @param[out] db_rcs DB status for each operation (DB_SUCCESS,
+ *                    DB_NOT_EXISTS or error).
+ */
+void get_db_attrs_batch(struct entry_proc_op_t **ops, unsigned int count,
+                        lmgr_t *lmgr, int *db_rcs);
+
+/**
+ * Report the usage changes of an operation to the ancestors of the entry
+ * (DIR_STAT), before it is applied to the database: they are written
+ * in the same transaction (see ListMgr_DirStatUpdate).
+ * If the operation fails, they must be discarded (ListMgr_DirStatCancel).
+ */
+void report_dir_stat(const struct entry_proc_op_t *p_op, lmgr_t *lmgr);
+
 #ifdef _LUSTRE
 void check_stripe_info(struct entry_proc_op_t *p_op, lmgr_t *lmgr);
 #endif
@@ -0,0 +1,191 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * vim:expandtab:shiftwidth=4:tabstop=4:
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the CeCILL License.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL license (http://www.cecill.info) and that you
+ * accept its terms.
+ */
+
+/* Set of entries seen by a scan. Each shard is an open-addressing table
+ * of 24 bytes records (id + name hash), kept at most 3/4 full.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "entry_proc_tools.h"
+#include "entry_proc_hash.h"
+#include "Memory.h"
+#include "rbh_logs.h"
+#include "rbh_misc.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#define SEEN_SHARD_BITS     8
+#define SEEN_SHARD_COUNT    (1 << SEEN_SHARD_BITS)
+#define SEEN_INIT_SIZE      1024
+
+/* a record in the set (name_hash == 0 for free slots) */
+struct seen_rec {
+    entry_id_t  id;
+    uint64_t    name_hash;
+};
+
+struct seen_shard {
+    pthread_mutex_t  lock;
+    struct seen_rec *recs;
+    size_t           size;   /* power of 2 */
+    size_t           count;
+};
+
+struct seen_set {
+    struct seen_shard shard[SEEN_SHARD_COUNT];
+};
+
+struct seen_set *seen_set_create(void)
+{
+    struct seen_set *set;
+    int i;
+
+    set = MemCalloc(1, sizeof(*set));
+    if (!set)
+        return NULL;
+
+    for (i = 0; i < SEEN_SHARD_COUNT; i++)
+        pthread_mutex_init(&set->shard[i].lock, NULL);
+
+    return set;
+}
+
+void seen_set_destroy(struct seen_set *set)
+{
+    int i;
+
+    if (!set)
+        return;
+
+    for (i = 0; i < SEEN_SHARD_COUNT; i++) {
+        free(set->shard[i].recs);
+        pthread_mutex_destroy(&set->shard[i].lock);
+    }
+    MemFree(set);
+}
+
+/** look for the slot of an id (either its record, or a free slot) */
+static struct seen_rec *shard_slot(struct seen_rec *recs, size_t size,
+                                   const entry_id_t *p_id, uint64_t hash)
+{
+    size_t i = (hash >> SEEN_SHARD_BITS) & (size - 1);
+
+    while (recs[i].name_hash != 0 && !entry_id_equal(&recs[i].id, p_id))
+        i = (i + 1) & (size - 1);
+
+    return &recs[i];
+}
+
+/** double the size of a shard table */
+static int shard_grow(struct seen_shard *shard)
+{
+    size_t new_size = shard->size ? 2 * shard->size : SEEN_INIT_SIZE;
+    struct seen_rec *new_recs;
+    size_t i;
+
+    new_recs = calloc(new_size, sizeof(*new_recs));
+    if (!new_recs)
+        return -ENOMEM;
+
+    for (i = 0; i < shard->size; i++) {
+        struct seen_rec *rec = &shard->recs[i];
+
+        if (rec->name_hash != 0)
+            *shard_slot(new_recs, new_size, &rec->id,
+                        id_hash64(&rec->id)) = *rec;
+    }
+
+    free(shard->recs);
+    shard->recs = new_recs;
+    shard->size = new_size;
+    return 0;
+}
+
+int seen_set_add(struct seen_set *set, const entry_id_t *p_id,
+                 uint64_t name_hash)
+{
+    uint64_t hash = id_hash64(p_id);
+    struct seen_shard *shard = &set->shard[hash & (SEEN_SHARD_COUNT - 1)];
+    struct seen_rec *rec;
+    int rc = 0;
+
+    P(shard->lock);
+    /* keep the load factor under 3/4 */
+    if (4 * (shard->count + 1) > 3 * shard->size) {
+        rc = shard_grow(shard);
+        if (rc)
+            goto out;
+    }
+
+    rec = shard_slot(shard->recs, shard->size, p_id, hash);
+    if (rec->name_hash == 0) {
+        rec->id = *p_id;
+        shard->count++;
+    }
+    rec->name_hash = name_hash;
+out:
+    V(shard->lock);
+    return rc;
+}
+
+bool seen_set_lookup(struct seen_set *set, const entry_id_t *p_id,
+                     uint64_t *name_hash)
+{
+    uint64_t hash = id_hash64(p_id);
+    struct seen_shard *shard = &set->shard[hash & (SEEN_SHARD_COUNT - 1)];
+    struct seen_rec *rec;
+    bool found = false;
+
+    P(shard->lock);
+    if (shard->size != 0) {
+        rec = shard_slot(shard->recs, shard->size, p_id, hash);
+        if (rec->name_hash != 0) {
+            found = true;
+            if (name_hash)
+                *name_hash = rec->name_hash;
+        }
+    }
+    V(shard->lock);
+    return found;
+}
+
+unsigned long long seen_set_count(struct seen_set *set)
+{
+    unsigned long long count = 0;
+    int i;
+
+    for (i = 0; i < SEEN_SHARD_COUNT; i++) {
+        P(set->shard[i].lock);
+        count += set->shard[i].count;
+        V(set->shard[i].lock);
+    }
+    return count;
+}
+
+uint64_t seen_name_hash(const entry_id_t *parent_id, const char *name)
+{
+    /* FNV-1a on the name, mixed with the parent id */
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const unsigned char *c;
+
+    for (c = (const unsigned char *)name; *c != '\0'; c++) {
+        h ^= *c;
+        h *= 0x100000001b3ULL;
+    }
+    h = __hash64(h ^ id_hash64(parent_id));
+
+    return h ? h : 1;
+}
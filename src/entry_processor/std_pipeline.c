@@ -23,6 +23,7 @@
 #include "rbh_misc.h"
 #include "entry_processor.h"
 #include "entry_proc_tools.h"
+#include "entry_proc_hash.h"
 #include "Memory.h"
 #include "policy_rules.h"
 #include "update_params.h"
@@ -30,6 +31,7 @@
 #include <errno.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
 
 /** Indicate if the error code means that the entry is missing */
 static inline bool err_missing(int rc)
@@ -44,18 +46,27 @@ static inline bool err_missing(int rc)
 /* forward declaration of EntryProc functions of pipeline */
 static int EntryProc_get_fid(struct entry_proc_op_t *, lmgr_t *);
 static int EntryProc_get_info_db(struct entry_proc_op_t *, lmgr_t *);
+static int EntryProc_get_info_db_batch(struct entry_proc_op_t **, int,
+                                       lmgr_t *);
 static int EntryProc_get_info_fs(struct entry_proc_op_t *, lmgr_t *);
 static int EntryProc_pre_apply(struct entry_proc_op_t *, lmgr_t *);
 static int EntryProc_db_apply(struct entry_proc_op_t *, lmgr_t *);
 static int EntryProc_db_batch_apply(struct entry_proc_op_t **, int, lmgr_t *);
 #ifdef HAVE_CHANGELOGS
 static int EntryProc_chglog_clr(struct entry_proc_op_t *, lmgr_t *);
+static int EntryProc_chglog_clr_batch(struct entry_proc_op_t **, int,
+                                      lmgr_t *);
+static bool chglog_clr_is_batchable(struct entry_proc_op_t *,
+                                    struct entry_proc_op_t *, attr_mask_t *);
 #endif
 static int EntryProc_rm_old_entries(struct entry_proc_op_t *, lmgr_t *);
 
 /* forward declaration to check batchable operations for db_apply stage */
 static bool dbop_is_batchable(struct entry_proc_op_t *,
                               struct entry_proc_op_t *, attr_mask_t *);
+/* forward declaration to check batchable operations for get_info_db stage */
+static bool dbget_is_batchable(struct entry_proc_op_t *,
+                               struct entry_proc_op_t *, attr_mask_t *);
 
 /** pipeline stages */
 enum {
@@ -86,7 +97,8 @@ const pipeline_descr_t std_pipeline_descr = {
 pipeline_stage_t std_pipeline[] = {
     {STAGE_GET_FID, "STAGE_GET_FID", EntryProc_get_fid, NULL, NULL,
      STAGE_FLAG_PARALLEL | STAGE_FLAG_SYNC, 0},
-    {STAGE_GET_INFO_DB, "STAGE_GET_INFO_DB", EntryProc_get_info_db, NULL, NULL,
+    {STAGE_GET_INFO_DB, "STAGE_GET_INFO_DB", EntryProc_get_info_db,
+     EntryProc_get_info_db_batch, dbget_is_batchable,   /* batched DB gets */
      STAGE_FLAG_PARALLEL | STAGE_FLAG_SYNC | STAGE_FLAG_ID_CONSTRAINT, 0},
     {STAGE_GET_INFO_FS, "STAGE_GET_INFO_FS", EntryProc_get_info_fs, NULL, NULL,
      STAGE_FLAG_PARALLEL | STAGE_FLAG_SYNC, 0},
@@ -104,16 +116,11 @@ pipeline_stage_t std_pipeline[] = {
 #endif
 
 #ifdef HAVE_CHANGELOGS
-    /* only 1 thread here because committing records must be sequential
-     * (in the same order as changelog) */
-    /* XXX could this stage be batched, like DB_APPLY? */
-    {STAGE_CHGLOG_CLR, "STAGE_CHGLOG_CLR", EntryProc_chglog_clr, NULL, NULL,
-     STAGE_FLAG_SEQUENTIAL | STAGE_FLAG_SYNC, 1},
-
-    /* acknowledging records must be sequential,
-     * in the order of record ids
-     * @TODO change this depending on the mode the program is started.
-     */
+    /* Records can be committed in any order: the changelog reader only
+     * clears the records up to the first one that is not committed yet. */
+    {STAGE_CHGLOG_CLR, "STAGE_CHGLOG_CLR", EntryProc_chglog_clr,
+     EntryProc_chglog_clr_batch, chglog_clr_is_batchable,
+     STAGE_FLAG_PARALLEL | STAGE_FLAG_SYNC, 0},
 #endif
     /* this step is for mass update / mass remove operations when
      * starting/ending a FS scan. */
@@ -122,6 +129,27 @@ pipeline_stage_t std_pipeline[] = {
      STAGE_FLAG_SEQUENTIAL | STAGE_FLAG_SYNC, 0}
 };
 
+/**
+ * Next stage for an operation that is dropped: changelog records must
+ * still be acknowledged, or the following records could not be cleared.
+ */
+static int drop_stage(const struct entry_proc_op_t *p_op)
+{
+#ifdef HAVE_CHANGELOGS
+    if (p_op->extra_info.is_changelog_record && p_op->callback_func != NULL)
+        return STAGE_CHGLOG_CLR;
+#endif
+    return -1;
+}
+
+/** remove an operation from the pipeline (see drop_stage()) */
+static int drop_op(struct entry_proc_op_t *p_op)
+{
+    int next_stage = drop_stage(p_op);
+
+    return EntryProcessor_Acknowledge(p_op, next_stage, next_stage == -1);
+}
+
 /**
  * For entries from FS scan, we must get the associated entry ID.
  */
@@ -134,19 +162,19 @@ int EntryProc_get_fid(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     char *path;
 
     /* 2 possible options: get fid using parent_fid/name or from fullpath */
-    if (ATTR_MASK_TEST(&p_op->fs_attrs, parent_id)
-        && ATTR_MASK_TEST(&p_op->fs_attrs, name)) {
-        BuildFidPath(&ATTR(&p_op->fs_attrs, parent_id), buff);
+    if (ATTR_MASK_TEST(p_op->fs_attrs, parent_id)
+        && ATTR_MASK_TEST(p_op->fs_attrs, name)) {
+        BuildFidPath(&ATTR(p_op->fs_attrs, parent_id), buff);
         long len = strlen(buff);
-        sprintf(buff + len, "/%s", ATTR(&p_op->fs_attrs, name));
+        sprintf(buff + len, "/%s", ATTR(p_op->fs_attrs, name));
         path = buff;
-    } else if (ATTR_MASK_TEST(&p_op->fs_attrs, fullpath)) {
-        path = ATTR(&p_op->fs_attrs, fullpath);
+    } else if (ATTR_MASK_TEST(p_op->fs_attrs, fullpath)) {
+        path = ATTR(p_op->fs_attrs, fullpath);
     } else {
         DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
                    "Error: not enough information to get fid: "
                    "parent_id/name or fullpath needed");
-        EntryProcessor_Acknowledge(p_op, -1, true);
+        drop_op(p_op);
         return EINVAL;
     }
 
@@ -156,14 +184,14 @@ int EntryProc_get_fid(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     /* Workaround for Lustre 2.3: if parent is root, llapi_path2fid returns
      * -EINVAL (see LU-3245). In this case, get fid from full path.
      */
-    if ((rc == -EINVAL) && ATTR_MASK_TEST(&p_op->fs_attrs, fullpath)) {
-        path = ATTR(&p_op->fs_attrs, fullpath);
+    if ((rc == -EINVAL) && ATTR_MASK_TEST(p_op->fs_attrs, fullpath)) {
+        path = ATTR(p_op->fs_attrs, fullpath);
         rc = Lustre_GetFidFromPath(path, &tmp_id);
     }
 
     if (rc) {
         /* remove the operation from pipeline */
-        rc = EntryProcessor_Acknowledge(p_op, -1, true);
+        rc = drop_op(p_op);
         if (rc)
             DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
                        "Error %d acknowledging stage STAGE_GET_FID.", rc);
@@ -180,7 +208,7 @@ int EntryProc_get_fid(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 #else
     DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
                "Error: unexpected stage in a filesystem with no fid: STAGE_GET_FID.");
-    EntryProcessor_Acknowledge(p_op, -1, true);
+    drop_op(p_op);
     return EINVAL;
 #endif
 }
@@ -215,8 +243,8 @@ static inline void check_path_info(struct entry_proc_op_t *p_op,
                                    const char *recname)
 {
     /* name and parent should have been provided by the CREATE record */
-    if (!ATTR_MASK_TEST(&p_op->fs_attrs, parent_id)
-        || !ATTR_MASK_TEST(&p_op->fs_attrs, name)) {
+    if (!ATTR_MASK_TEST(p_op->fs_attrs, parent_id)
+        || !ATTR_MASK_TEST(p_op->fs_attrs, name)) {
         DisplayLog(LVL_MAJOR, ENTRYPROC_TAG,
                    "WARNING: name and parent should be set by %s record",
                    recname);
@@ -258,22 +286,22 @@ static int EntryProc_FillFromLogRec(struct entry_proc_op_t *p_op,
                        "CREATE record on already existing entry " DFID "%s%s."
                        " This is normal if you scanned it previously.",
                        PFID(&p_op->entry_id),
-                       ATTR_MASK_TEST(&p_op->db_attrs, fullpath) ? ", path=" :
-                       (ATTR_MASK_TEST(&p_op->db_attrs, name) ? ", name=" : ""),
-                       ATTR_MASK_TEST(&p_op->db_attrs, fullpath) ?
-                       ATTR(&p_op->db_attrs, fullpath) :
-                       (ATTR_MASK_TEST(&p_op->db_attrs, name) ?
-                        ATTR(&p_op->db_attrs, name) : ""));
+                       ATTR_MASK_TEST(p_op->db_attrs, fullpath) ? ", path=" :
+                       (ATTR_MASK_TEST(p_op->db_attrs, name) ? ", name=" : ""),
+                       ATTR_MASK_TEST(p_op->db_attrs, fullpath) ?
+                       ATTR(p_op->db_attrs, fullpath) :
+                       (ATTR_MASK_TEST(p_op->db_attrs, name) ?
+                        ATTR(p_op->db_attrs, name) : ""));
 
             /* set insertion time, like for a new entry */
-            ATTR_MASK_SET(&p_op->fs_attrs, creation_time);
-            ATTR(&p_op->fs_attrs, creation_time)
+            ATTR_MASK_SET(p_op->fs_attrs, creation_time);
+            ATTR(p_op->fs_attrs, creation_time)
                 = cltime2sec(logrec->cr_time);
 
             /* force updating attributes */
             p_op->fs_attr_need.std |= POSIX_ATTR_MASK | ATTR_MASK_stripe_info;
             /* get status for all policies with a matching scope */
-            add_matching_scopes_mask(&p_op->entry_id, &p_op->fs_attrs, true,
+            add_matching_scopes_mask(&p_op->entry_id, p_op->fs_attrs, true,
                                      &p_op->fs_attr_need.status);
 
             /* will use the same mask for calling changelog callbacks */
@@ -288,8 +316,8 @@ static int EntryProc_FillFromLogRec(struct entry_proc_op_t *p_op,
         check_path_info(p_op, "HARDLINK");
     } else if ((logrec->cr_type == CL_MKDIR) || (logrec->cr_type == CL_RMDIR)) {
         /* entry is a directory */
-        ATTR_MASK_SET(&p_op->fs_attrs, type);
-        strcpy(ATTR(&p_op->fs_attrs, type), STR_TYPE_DIR);
+        ATTR_MASK_SET(p_op->fs_attrs, type);
+        strcpy(ATTR(p_op->fs_attrs, type), STR_TYPE_DIR);
 
         /* not a link */
         attr_mask_unset_index(&p_op->fs_attr_need, ATTR_INDEX_link);
@@ -299,15 +327,15 @@ static int EntryProc_FillFromLogRec(struct entry_proc_op_t *p_op,
         attr_mask_unset_index(&p_op->fs_attr_need, ATTR_INDEX_stripe_items);
 
         /* when a directory is created or deleted, directory is empty */
-        ATTR_MASK_SET(&p_op->fs_attrs, dircount);
-        ATTR(&p_op->fs_attrs, dircount) = 0;
+        ATTR_MASK_SET(p_op->fs_attrs, dircount);
+        ATTR(p_op->fs_attrs, dircount) = 0;
 
         /* path info should be set */
         check_path_info(p_op, changelog_type2str(logrec->cr_type));
     } else if (logrec->cr_type == CL_SOFTLINK) {
         /* entry is a symlink */
-        ATTR_MASK_SET(&p_op->fs_attrs, type);
-        strcpy(ATTR(&p_op->fs_attrs, type), STR_TYPE_LINK);
+        ATTR_MASK_SET(p_op->fs_attrs, type);
+        strcpy(ATTR(p_op->fs_attrs, type), STR_TYPE_LINK);
 
         /* need to get symlink content */
         attr_mask_set_index(&p_op->fs_attr_need, ATTR_INDEX_link);
@@ -362,13 +390,13 @@ static int EntryProc_FillFromLogRec(struct entry_proc_op_t *p_op,
          * because some information may have changed (e.g. entry status)
          * so the entry may now match the scope, and using an outdated status
          * may result in an invalid matching. */
-        add_matching_scopes_mask(&p_op->entry_id, &p_op->fs_attrs, true,
+        add_matching_scopes_mask(&p_op->entry_id, p_op->fs_attrs, true,
                                  &cl_cb_status_mask);
     } else {
         cl_cb_status_mask = p_op->fs_attr_need.status;
     }
     /* call changelog callback for policies with a matching scope */
-    run_all_cl_cb(logrec, &p_op->entry_id, &p_op->db_attrs, &p_op->fs_attrs,
+    run_all_cl_cb(logrec, &p_op->entry_id, p_op->db_attrs, p_op->fs_attrs,
                   &status_mask_need, cl_cb_status_mask, &rec_action);
     p_op->fs_attr_need = attr_mask_or(&p_op->fs_attr_need, &status_mask_need);
 
@@ -449,11 +477,11 @@ static int EntryProc_ProcessLogRec(struct entry_proc_op_t *p_op)
             /* When inserting that entry, we didn't know whether the
              * entry was the last one or not, so use the nlink
              * attribute we requested earlier to determine. */
-            if (ATTR_MASK_TEST(&p_op->db_attrs, nlink)
-                && (ATTR(&p_op->db_attrs, nlink) <= 1)) {
+            if (ATTR_MASK_TEST(p_op->db_attrs, nlink)
+                && (ATTR(p_op->db_attrs, nlink) <= 1)) {
                 DisplayLog(LVL_DEBUG, ENTRYPROC_TAG,
                            "UNLINK record for entry with nlink=%u in DB => removing it",
-                           ATTR(&p_op->db_attrs, nlink));
+                           ATTR(p_op->db_attrs, nlink));
                 logrec->cr_flags |= CLF_UNLINK_LAST;
             }
         }
@@ -522,8 +550,8 @@ static int EntryProc_ProcessLogRec(struct entry_proc_op_t *p_op)
             p_op->db_op_type = OP_TYPE_INSERT;
 
             /* new entry, set insertion time */
-            ATTR_MASK_SET(&p_op->fs_attrs, creation_time);
-            ATTR(&p_op->fs_attrs, creation_time) = cltime2sec(logrec->cr_time);
+            ATTR_MASK_SET(p_op->fs_attrs, creation_time);
+            ATTR(p_op->fs_attrs, creation_time) = cltime2sec(logrec->cr_time);
 
             /* we must get info that is not provided by the chglog:
              * fs_attr_need |=  <needed attributes> AND NOT in fs_attrs.
@@ -531,12 +559,12 @@ static int EntryProc_ProcessLogRec(struct entry_proc_op_t *p_op)
             tmp.std = (POSIX_ATTR_MASK | ATTR_MASK_name | ATTR_MASK_parent_id
                        | ATTR_MASK_stripe_info | ATTR_MASK_stripe_items
                        | ATTR_MASK_link);
-            tmp = attr_mask_and_not(&tmp, &p_op->fs_attrs.attr_mask);
+            tmp = attr_mask_and_not(&tmp, &p_op->fs_attrs->attr_mask);
             p_op->fs_attr_need = attr_mask_or(&p_op->fs_attr_need, &tmp);
 
             /* if we needed fullpath (e.g. for policies), set it */
             if (attr_mask_test_index(&p_op->db_attr_need, ATTR_INDEX_fullpath)
-                && !ATTR_MASK_TEST(&p_op->fs_attrs, fullpath))
+                && !ATTR_MASK_TEST(p_op->fs_attrs, fullpath))
                 attr_mask_set_index(&p_op->fs_attr_need, ATTR_INDEX_fullpath);
 
             /* EntryProc_FillFromLogRec() will determine
@@ -551,17 +579,17 @@ static int EntryProc_ProcessLogRec(struct entry_proc_op_t *p_op)
             /* check what information must be updated.
              * missing info = DB query - retrieved */
             db_missing = attr_mask_and_not(&p_op->db_attr_need,
-                                           &p_op->db_attrs.attr_mask);
+                                           &p_op->db_attrs->attr_mask);
 
             /* get attrs if some is missing (all std attrs) */
             if ((db_missing.std & POSIX_ATTR_MASK) &&
-                ((p_op->fs_attrs.attr_mask.std & POSIX_ATTR_MASK) !=
+                ((p_op->fs_attrs->attr_mask.std & POSIX_ATTR_MASK) !=
                  POSIX_ATTR_MASK))
                 p_op->fs_attr_need.std |= POSIX_ATTR_MASK;
 
             /* get stripe info if missing (file only) */
             if ((db_missing.std & ATTR_MASK_stripe_info)
-                && !ATTR_MASK_TEST(&p_op->fs_attrs, stripe_info)
+                && !ATTR_MASK_TEST(p_op->fs_attrs, stripe_info)
                 && (!ATTR_FSorDB_TEST(p_op, type)
                     || !strcmp(ATTR_FSorDB(p_op, type), STR_TYPE_FILE))) {
                 p_op->fs_attr_need.std |=
@@ -570,7 +598,7 @@ static int EntryProc_ProcessLogRec(struct entry_proc_op_t *p_op)
 
             /* get link content if missing (symlink only) */
             if ((db_missing.std & ATTR_MASK_link)
-                && !ATTR_MASK_TEST(&p_op->fs_attrs, link)
+                && !ATTR_MASK_TEST(p_op->fs_attrs, link)
                 && (!ATTR_FSorDB_TEST(p_op, type)
                     || !strcmp(ATTR_FSorDB(p_op, type), STR_TYPE_LINK)))
                 p_op->fs_attr_need.std |= ATTR_MASK_link;
@@ -579,14 +607,14 @@ static int EntryProc_ProcessLogRec(struct entry_proc_op_t *p_op)
              * what status are to be retrieved. */
 
             /* Check md_update policy */
-            if (need_md_update(&p_op->db_attrs, &md_allow_event_updt))
+            if (need_md_update(p_op->db_attrs, &md_allow_event_updt))
                 p_op->fs_attr_need.std |= POSIX_ATTR_MASK;
 
             /* check if path update is needed (only if it was not just
              * updated) */
-            if ((!ATTR_MASK_TEST(&p_op->fs_attrs, parent_id)
-                 || !ATTR_MASK_TEST(&p_op->fs_attrs, name))
-                && (need_path_update(&p_op->db_attrs, NULL)
+            if ((!ATTR_MASK_TEST(p_op->fs_attrs, parent_id)
+                 || !ATTR_MASK_TEST(p_op->fs_attrs, name))
+                && (need_path_update(p_op->db_attrs, NULL)
                     || (db_missing.
                         std & (ATTR_MASK_fullpath | ATTR_MASK_name |
                                ATTR_MASK_parent_id))))
@@ -690,13 +718,13 @@ static bool is_lustre_special(const struct entry_proc_op_t *p_op)
         root_id = get_root_id();
 
         /* check if parent_id is root dir and name is '.lustre' */
-        if (root_id != NULL && ATTR_MASK_TEST(&p_op->fs_attrs, parent_id)
-            && ATTR_MASK_TEST(&p_op->fs_attrs, name)
-            && entry_id_equal(root_id, &ATTR(&p_op->fs_attrs, parent_id))
-            && strcmp(ATTR(&p_op->fs_attrs, name), dot_lustre_name) == 0) {
+        if (root_id != NULL && ATTR_MASK_TEST(p_op->fs_attrs, parent_id)
+            && ATTR_MASK_TEST(p_op->fs_attrs, name)
+            && entry_id_equal(root_id, &ATTR(p_op->fs_attrs, parent_id))
+            && strcmp(ATTR(p_op->fs_attrs, name), dot_lustre_name) == 0) {
             DisplayLog(LVL_DEBUG, ENTRYPROC_TAG,
                        "Ignoring special lustre directory " DFID "/%s",
-                       PFID(root_id), ATTR(&p_op->fs_attrs, name));
+                       PFID(root_id), ATTR(p_op->fs_attrs, name));
             return true;
         }
 
@@ -732,13 +760,22 @@ static void logrec2dbneed(struct entry_proc_op_t *p_op)
 
     p_op->db_attr_need = null_mask;
 
+    /* previous usage of the entry, to update the usage of its ancestors */
+    if (lmgr_dir_stat())
+        p_op->db_attr_need.std |= DIRSTAT_ATTR_MASK | ATTR_MASK_nlink;
+    /* previous accounting of the entry (batched accounting) */
+    if (lmgr_acct_batched()) {
+        p_op->db_attr_need.std |= ACCT_ATTR_MASK;
+        p_op->db_attr_need.status |= all_status_mask();
+    }
+
     if (type_clue == TYPE_NONE) {
         /* type is a useful information to make decisions (about getstripe,
          * readlink, ...) */
         attr_mask_set_index(&p_op->db_attr_need, ATTR_INDEX_type);
     } else {
-        ATTR_MASK_SET(&p_op->fs_attrs, type);
-        strcpy(ATTR(&p_op->fs_attrs, type), type2db(type_clue));
+        ATTR_MASK_SET(p_op->fs_attrs, type);
+        strcpy(ATTR(p_op->fs_attrs, type), type2db(type_clue));
     }
 
     /* add diff mask for diff mode */
@@ -787,19 +824,19 @@ static void logrec2dbneed(struct entry_proc_op_t *p_op)
                                 ATTR_INDEX_class_update);
 
         tmp = attr_mask_and_not(&policies.global_fileset_mask,
-                                &p_op->fs_attrs.attr_mask);
+                                &p_op->fs_attrs->attr_mask);
         p_op->db_attr_need = attr_mask_or(&p_op->db_attr_need, &tmp);
     }
 
     /* check if entry is in policies scope */
-    add_matching_scopes_mask(&p_op->entry_id, &p_op->fs_attrs, true,
+    add_matching_scopes_mask(&p_op->entry_id, p_op->fs_attrs, true,
                              &status_scope);
 
     /* get missing attributes to check the scopes:
      * db_attr_need |= <attrs_for_status> and not <fs_attrs>
      */
     tmp = attrs_for_status_mask(status_scope, false);
-    tmp = attr_mask_and_not(&tmp, &p_op->fs_attrs.attr_mask);
+    tmp = attr_mask_and_not(&tmp, &p_op->fs_attrs->attr_mask);
     p_op->db_attr_need = attr_mask_or(&p_op->db_attr_need, &tmp);
 
     /* In case of a RENAME, match the new name (not the one from the DB). */
@@ -808,16 +845,109 @@ static void logrec2dbneed(struct entry_proc_op_t *p_op)
         int rc;
 
         rc = Lustre_GetFullPath(&p_op->entry_id,
-                                ATTR(&p_op->fs_attrs, fullpath),
-                                sizeof(ATTR(&p_op->fs_attrs, fullpath)));
+                                ATTR(p_op->fs_attrs, fullpath),
+                                sizeof(ATTR(p_op->fs_attrs, fullpath)));
         if (rc == 0) {
-            ATTR_MASK_SET(&p_op->fs_attrs, fullpath);
+            ATTR_MASK_SET(p_op->fs_attrs, fullpath);
             p_op->db_attr_need.std &= ~ATTR_MASK_fullpath;
         }
     }
 }
 #endif
 
+/* entries seen by the current full scan (if scan_seen_set is enabled) */
+static struct seen_set *scan_seen_set = NULL;
+static pthread_rwlock_t seen_set_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+bool EntryProcessor_SeenSetStart(void)
+{
+    struct seen_set *set = NULL;
+
+    if (entry_proc_conf.scan_seen_set) {
+        set = seen_set_create();
+        if (!set)
+            DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
+                       "Cannot allocate the set of seen entries: "
+                       "all scanned entries will be updated");
+    }
+
+    pthread_rwlock_wrlock(&seen_set_lock);
+    seen_set_destroy(scan_seen_set);
+    scan_seen_set = set;
+    pthread_rwlock_unlock(&seen_set_lock);
+
+    return (set != NULL);
+}
+
+/** detach the set of seen entries, so it is no longer updated */
+static struct seen_set *seen_set_take(void)
+{
+    struct seen_set *set;
+
+    pthread_rwlock_wrlock(&seen_set_lock);
+    set = scan_seen_set;
+    scan_seen_set = NULL;
+    pthread_rwlock_unlock(&seen_set_lock);
+
+    return set;
+}
+
+void EntryProcessor_SeenSetDrop(void)
+{
+    seen_set_destroy(seen_set_take());
+}
+
+static bool seen_set_active(void)
+{
+    bool active;
+
+    pthread_rwlock_rdlock(&seen_set_lock);
+    active = (scan_seen_set != NULL);
+    pthread_rwlock_unlock(&seen_set_lock);
+
+    return active;
+}
+
+/**
+ * If a scanned entry did not change, record it in the set of seen entries
+ * instead of updating its md_update and path_update.
+ * @param diff  attributes that differ between the FS and the DB.
+ * @return true if the entry has been recorded.
+ */
+static bool seen_set_record(const struct entry_proc_op_t *p_op,
+                            const attr_mask_t *diff)
+{
+    attr_mask_t changed = p_op->fs_attrs->attr_mask;
+    bool rc = false;
+
+    /* anything else than the scan timestamps and the name changed? */
+    changed.std &= ~(ATTR_MASK_md_update | ATTR_MASK_path_update
+                     | ATTR_MASK_parent_id | ATTR_MASK_name
+                     | ATTR_MASK_fullpath);
+    if (!attr_mask_is_null(changed)
+        || (diff->std & (ATTR_MASK_parent_id | ATTR_MASK_name)))
+        return false;
+
+    if (!ATTR_MASK_TEST(p_op->fs_attrs, parent_id)
+        || !ATTR_MASK_TEST(p_op->fs_attrs, name))
+        return false;
+
+    /* the seen set holds a single name per entry */
+    if (!(ATTR_FSorDB_TEST(p_op, type)
+          && !strcmp(ATTR_FSorDB(p_op, type), STR_TYPE_DIR))
+        && !(ATTR_FSorDB_TEST(p_op, nlink) && ATTR_FSorDB(p_op, nlink) == 1))
+        return false;
+
+    pthread_rwlock_rdlock(&seen_set_lock);
+    if (scan_seen_set != NULL)
+        rc = (seen_set_add(scan_seen_set, &p_op->entry_id,
+                           seen_name_hash(&ATTR(p_op->fs_attrs, parent_id),
+                                          ATTR(p_op->fs_attrs, name))) == 0);
+    pthread_rwlock_unlock(&seen_set_lock);
+
+    return rc;
+}
+
 /**
  * Determine needed DB attributes to process a scanned entry.
  */
@@ -828,12 +958,12 @@ static void scan2dbneed(struct entry_proc_op_t *p_op)
     attr_mask_t tmp;
 
     /* check if entry is in policies scope */
-    add_matching_scopes_mask(&p_op->entry_id, &p_op->fs_attrs, true,
+    add_matching_scopes_mask(&p_op->entry_id, p_op->fs_attrs, true,
                              &status_scope);
 
     p_op->db_attr_need = attr_mask_or(&p_op->db_attr_need, &diff_mask);
     /* retrieve missing attributes for diff */
-    tmp = attr_mask_and_not(&diff_mask, &p_op->fs_attrs.attr_mask);
+    tmp = attr_mask_and_not(&diff_mask, &p_op->fs_attrs->attr_mask);
     p_op->fs_attr_need = attr_mask_or(&p_op->fs_attr_need, &tmp);
 
     if (entry_proc_conf.detect_fake_mtime)
@@ -843,17 +973,30 @@ static void scan2dbneed(struct entry_proc_op_t *p_op)
     attr_allow_cached = attrs_for_status_mask(status_scope, false);
 
     /* what must be retrieved from DB: */
-    tmp = attr_mask_and_not(&attr_allow_cached, &p_op->fs_attrs.attr_mask);
+    tmp = attr_mask_and_not(&attr_allow_cached, &p_op->fs_attrs->attr_mask);
     p_op->db_attr_need = attr_mask_or(&p_op->db_attr_need, &tmp);
 
     /* no dircount for non-dirs */
-    if (ATTR_MASK_TEST(&p_op->fs_attrs, type) &&
-        strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_DIR))
+    if (ATTR_MASK_TEST(p_op->fs_attrs, type) &&
+        strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_DIR))
         attr_mask_unset_index(&p_op->db_attr_need, ATTR_INDEX_dircount);
+    /* get the name of directories from the DB to detect renames
+     * (cached paths of their children must be invalidated) */
+    else if (ATTR_MASK_TEST(p_op->fs_attrs, type))
+        p_op->db_attr_need.std |= ATTR_MASK_parent_id | ATTR_MASK_name;
+
+    /* previous usage of the entry, to update the usage of its ancestors */
+    if (lmgr_dir_stat())
+        p_op->db_attr_need.std |= DIRSTAT_ATTR_MASK | ATTR_MASK_nlink;
+    /* previous accounting of the entry (batched accounting) */
+    if (lmgr_acct_batched()) {
+        p_op->db_attr_need.std |= ACCT_ATTR_MASK;
+        p_op->db_attr_need.status |= all_status_mask();
+    }
 
     /* don't get stripe for non-files */
-    if (ATTR_MASK_TEST(&p_op->fs_attrs, type)
-        && strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_FILE) != 0) {
+    if (ATTR_MASK_TEST(p_op->fs_attrs, type)
+        && strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_FILE) != 0) {
         attr_mask_unset_index(&p_op->db_attr_need, ATTR_INDEX_stripe_info);
         attr_mask_unset_index(&p_op->db_attr_need, ATTR_INDEX_stripe_items);
         attr_mask_unset_index(&p_op->fs_attr_need, ATTR_INDEX_stripe_info);
@@ -861,8 +1004,8 @@ static void scan2dbneed(struct entry_proc_op_t *p_op)
     }
 
     /* no readlink for non symlinks */
-    if (ATTR_MASK_TEST(&p_op->fs_attrs, type)) { /* likely */
-        if (!strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_LINK))
+    if (ATTR_MASK_TEST(p_op->fs_attrs, type)) { /* likely */
+        if (!strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_LINK))
             /* check if symlink's contents is known */
             attr_mask_set_index(&p_op->db_attr_need, ATTR_INDEX_link);
         else
@@ -875,41 +1018,45 @@ static void scan2dbneed(struct entry_proc_op_t *p_op)
                                 ATTR_INDEX_class_update);
 
         tmp = attr_mask_and_not(&policies.global_fileset_mask,
-                                &p_op->fs_attrs.attr_mask);
+                                &p_op->fs_attrs->attr_mask);
+        p_op->db_attr_need = attr_mask_or(&p_op->db_attr_need, &tmp);
+    }
+
+    /* unchanged entries can only be detected if all scanned attributes
+     * are known from the DB */
+    if (seen_set_active()) {
+        tmp = p_op->fs_attrs->attr_mask;
+        tmp.std &= ~(ATTR_MASK_fullpath | ATTR_MASK_md_update
+                     | ATTR_MASK_path_update);
         p_op->db_attr_need = attr_mask_or(&p_op->db_attr_need, &tmp);
+        p_op->db_attr_need.std |= ATTR_MASK_parent_id | ATTR_MASK_name;
     }
 }
 
 
 /**
- * check if the entry exists in the database and what info
- * must be retrieved.
+ * First part of GET_INFO_DB stage: filter out the entries to be ignored
+ * and determine what info must be retrieved from the database.
+ * Attributes to be retrieved are set in p_op->db_attrs->attr_mask
+ * (a null mask means only checking if the entry exists in DB).
+ * @return -1 if the entry must be dropped, 0 else.
  */
-int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
+static int get_info_db_prepare(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 {
-    int rc = 0;
-    int next_stage = -1;    /* -1 = skip */
-    attr_mask_t tmp;
-
-    const pipeline_stage_t *stage_info =
-        &entry_proc_pipeline[p_op->pipeline_stage];
-
     /* always ignore root */
     if (p_op->entry_id_is_set
         && entry_id_equal(&p_op->entry_id, get_root_id())) {
         DisplayLog(LVL_DEBUG, ENTRYPROC_TAG,
                    "Ignoring record for root directory");
         /* drop the entry */
-        next_stage = -1;
-        goto next_step;
+        return -1;
     }
 
     /* ignore special files */
-    if (is_lustre_special(p_op)) {
+    if (is_lustre_special(p_op))
         /* drop the entry */
-        next_stage = -1;
-        goto next_step;
-    }
+        return -1;
+
 #ifdef HAVE_CHANGELOGS
     /* is this a changelog record? */
     if (p_op->extra_info.is_changelog_record) {
@@ -918,16 +1065,18 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         /* chglog_reader_config.mds_has_lu543 has already been tested
          * in changelog reader before pushing the entry. */
         if (logrec->cr_type == CL_UNLINK && p_op->get_fid_from_db) {
+            int rc;
+
             /* It is possible this unlink was inserted by the changelog
              * reader. Some Lustre server don't give the FID, so retrieve
              * it now from the NAMES table, given the parent FID and the
              * filename. */
             p_op->get_fid_from_db = 0;
 
-            if (ATTR_MASK_TEST(&p_op->fs_attrs, name)) {
+            if (ATTR_MASK_TEST(p_op->fs_attrs, name)) {
                 /* name was previously copied to the fs attributes */
                 rc = ListMgr_Get_FID_from_Path(lmgr, &logrec->cr_pfid,
-                                               ATTR(&p_op->fs_attrs, name),
+                                               ATTR(p_op->fs_attrs, name),
                                                &p_op->entry_id);
             } else {
                 /* Use the name from changelog. It may not be null-terminated
@@ -959,14 +1108,13 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
             }
 
             /* Unblock the pipeline stage. */
-            EntryProcessor_Unblock(STAGE_GET_INFO_DB);
+            EntryProcessor_Unblock(p_op, STAGE_GET_INFO_DB);
 
             if (rc) {
                 /* Not found. Skip the entry */
                 DisplayLog(LVL_FULL, ENTRYPROC_TAG,
                            "Warning: parent/filename for UNLINK not found");
-                next_stage = -1;
-                goto next_step;
+                return -1;
             }
         }
 
@@ -974,26 +1122,67 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         logrec2dbneed(p_op);
 
         /* attributes to be retrieved */
-        p_op->db_attrs.attr_mask = p_op->db_attr_need;
+        p_op->db_attrs->attr_mask = p_op->db_attr_need;
+        return 0;
+    }
+#endif
+    /* entry from FS scan */
 
-        rc = ListMgr_Get(lmgr, &p_op->entry_id, &p_op->db_attrs);
+    /* scan is expected to provide full path and attributes. */
+    if (!ATTR_MASK_TEST(p_op->fs_attrs, fullpath)) {
+        DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
+                   "Error: missing info from FS scan");
+        /* skip the entry */
+        return -1;
+    }
 
-        if (rc == DB_SUCCESS) {
-            p_op->db_exists = 1;
-            /* attr mask has been set by ListMgr_Get */
-        } else if (rc == DB_NOT_EXISTS) {
-            p_op->db_exists = 0;
-            /* no attrs from DB */
-            ATTR_MASK_INIT(&p_op->db_attrs);
-        } else {
-            /* ERROR */
-            DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
-                       "Error %d retrieving entry " DFID " from DB: %s.", rc,
-                       PFID(&p_op->entry_id), lmgr_err2str(rc));
-            p_op->db_exists = 0;
-            /* no attrs from DB */
-            ATTR_MASK_INIT(&p_op->db_attrs);
-        }
+    /* determined needed attributes from DB */
+    scan2dbneed(p_op);
+
+    /* attributes to be retrieved */
+    p_op->db_attrs->attr_mask = p_op->db_attr_need;
+    return 0;
+}
+
+/** set entry DB status from the result of the DB request */
+static void set_db_exists(struct entry_proc_op_t *p_op, int db_rc)
+{
+    if (db_rc == DB_SUCCESS) {
+        p_op->db_exists = 1;
+        /* attr mask has been set by ListMgr_Get */
+    } else if (db_rc == DB_NOT_EXISTS) {
+        p_op->db_exists = 0;
+        /* no attrs from DB */
+        ATTR_MASK_INIT(p_op->db_attrs);
+    } else {
+        /* ERROR */
+        DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
+                   "Error %d retrieving entry " DFID " from DB: %s.", db_rc,
+                   PFID(&p_op->entry_id), lmgr_err2str(db_rc));
+        p_op->db_exists = 0;
+        /* no attrs from DB */
+        ATTR_MASK_INIT(p_op->db_attrs);
+    }
+}
+
+/**
+ * Second part of GET_INFO_DB stage: process the information retrieved
+ * from the database and determine what must be retrieved from the filesystem.
+ * @param db_rc status of the DB request (DB_SUCCESS, DB_NOT_EXISTS or error).
+ * @return the next pipeline stage for the entry.
+ */
+static int get_info_db_process(struct entry_proc_op_t *p_op, lmgr_t *lmgr,
+                               int db_rc)
+{
+    int next_stage;
+    attr_mask_t tmp;
+
+    set_db_exists(p_op, db_rc);
+
+#ifdef HAVE_CHANGELOGS
+    /* is this a changelog record? */
+    if (p_op->extra_info.is_changelog_record) {
+        CL_REC_TYPE *logrec = p_op->extra_info.log_record.p_log_rec;
 
         /* Retrieve info from the log record, and decide what info must be
          * retrieved from filesystem. */
@@ -1020,45 +1209,16 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 #endif
         attr_mask_t attr_need_fresh = {0};
 
-        /* scan is expected to provide full path and attributes. */
-        if (!ATTR_MASK_TEST(&p_op->fs_attrs, fullpath)) {
-            DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
-                       "Error: missing info from FS scan");
-            /* skip the entry */
-            next_stage = -1;
-            goto next_step;
-        }
-
-        /* determined needed attributes from DB */
-        scan2dbneed(p_op);
-
-        if (!attr_mask_is_null(p_op->db_attr_need)) {
-            p_op->db_attrs.attr_mask = p_op->db_attr_need;
-            rc = ListMgr_Get(lmgr, &p_op->entry_id, &p_op->db_attrs);
-
-            if (rc == DB_SUCCESS) {
-                p_op->db_exists = 1;
-                tmp = attr_mask_and_not(&p_op->db_attr_need,
-                                        &p_op->db_attrs.attr_mask);
-                p_op->fs_attr_need = attr_mask_or(&p_op->fs_attr_need, &tmp);
-            } else if (rc == DB_NOT_EXISTS) {
-                p_op->db_exists = 0;
-                ATTR_MASK_INIT(&p_op->db_attrs);
-            } else {
-                /* ERROR */
-                DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
-                           "Error %d retrieving entry " DFID " from DB: %s.",
-                           rc, PFID(&p_op->entry_id), lmgr_err2str(rc));
-                p_op->db_exists = 0;
-                ATTR_MASK_INIT(&p_op->db_attrs);
-            }
-        } else {
-            p_op->db_exists = ListMgr_Exists(lmgr, &p_op->entry_id);
+        if (db_rc == DB_SUCCESS && !attr_mask_is_null(p_op->db_attr_need)) {
+            /* get missing DB attributes from the filesystem */
+            tmp = attr_mask_and_not(&p_op->db_attr_need,
+                                    &p_op->db_attrs->attr_mask);
+            p_op->fs_attr_need = attr_mask_or(&p_op->fs_attr_need, &tmp);
         }
 
         /* get status for all policies */
         p_op->fs_attr_need.status |= all_status_mask();
-        tmp = attr_mask_and_not(&attr_need_fresh, &p_op->fs_attrs.attr_mask);
+        tmp = attr_mask_and_not(&attr_need_fresh, &p_op->fs_attrs->attr_mask);
         p_op->fs_attr_need = attr_mask_or(&p_op->fs_attr_need, &tmp);
 
         if (!p_op->db_exists) {
@@ -1066,18 +1226,18 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
             p_op->db_op_type = OP_TYPE_INSERT;
 
             /* set creation time if it was not set by scan module */
-            if (!ATTR_MASK_TEST(&p_op->fs_attrs, creation_time)) {
-                ATTR_MASK_SET(&p_op->fs_attrs, creation_time);
+            if (!ATTR_MASK_TEST(p_op->fs_attrs, creation_time)) {
+                ATTR_MASK_SET(p_op->fs_attrs, creation_time);
                 /* FIXME min(atime,mtime,ctime)? */
-                ATTR(&p_op->fs_attrs, creation_time) = time(NULL);
+                ATTR(p_op->fs_attrs, creation_time) = time(NULL);
             }
 #ifdef _LUSTRE
             /* get stripe for files */
-            if (ATTR_MASK_TEST(&p_op->fs_attrs, type)
-                && !strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_FILE)
+            if (ATTR_MASK_TEST(p_op->fs_attrs, type)
+                && !strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_FILE)
                 /* only if it was not retrieved during the scan */
-                && !(ATTR_MASK_TEST(&p_op->fs_attrs, stripe_info)
-                     && ATTR_MASK_TEST(&p_op->fs_attrs, stripe_items))) {
+                && !(ATTR_MASK_TEST(p_op->fs_attrs, stripe_info)
+                     && ATTR_MASK_TEST(p_op->fs_attrs, stripe_items))) {
                 attr_mask_set_index(&p_op->fs_attr_need,
                                     ATTR_INDEX_stripe_info);
                 attr_mask_set_index(&p_op->fs_attr_need,
@@ -1086,9 +1246,9 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 #endif
 
             /* readlink for symlinks (if not already known) */
-            if (ATTR_MASK_TEST(&p_op->fs_attrs, type)
-                && !strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_LINK)
-                && !ATTR_MASK_TEST(&p_op->fs_attrs, link)) {
+            if (ATTR_MASK_TEST(p_op->fs_attrs, type)
+                && !strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_LINK)
+                && !ATTR_MASK_TEST(p_op->fs_attrs, link)) {
                 attr_mask_set_index(&p_op->fs_attr_need, ATTR_INDEX_link);
             } else {
                 attr_mask_unset_index(&p_op->fs_attr_need, ATTR_INDEX_link);
@@ -1098,8 +1258,8 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         } else {
             p_op->db_op_type = OP_TYPE_UPDATE;
 
-            if (ATTR_MASK_TEST(&p_op->fs_attrs, type)) {    /* likely set */
-                if (strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_LINK))
+            if (ATTR_MASK_TEST(p_op->fs_attrs, type)) {    /* likely set */
+                if (strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_LINK))
                     /* non-link */
                     attr_mask_unset_index(&p_op->fs_attr_need, ATTR_INDEX_link);
                 else {
@@ -1115,7 +1275,7 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 #else
                     /* For non-lustre filesystems, inodes may be recycled,
                      * so re-read link even if it is is DB */
-                    if (ATTR_MASK_TEST(&p_op->fs_attrs, link))
+                    if (ATTR_MASK_TEST(p_op->fs_attrs, link))
                         attr_mask_unset_index(&p_op->fs_attr_need,
                                               ATTR_INDEX_link);
                     else
@@ -1127,15 +1287,15 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
             /* get parent_id+name, if not set during scan
              * (eg. for root directory) */
-            if (!ATTR_MASK_TEST(&p_op->fs_attrs, name))
+            if (!ATTR_MASK_TEST(p_op->fs_attrs, name))
                 attr_mask_set_index(&p_op->fs_attr_need, ATTR_INDEX_name);
-            if (!ATTR_MASK_TEST(&p_op->fs_attrs, parent_id))
+            if (!ATTR_MASK_TEST(p_op->fs_attrs, parent_id))
                 attr_mask_set_index(&p_op->fs_attr_need, ATTR_INDEX_parent_id);
 
 #ifdef _LUSTRE
             /* check stripe only for files */
-            if (ATTR_MASK_TEST(&p_op->fs_attrs, type)
-                && !strcmp(ATTR(&p_op->fs_attrs, type), STR_TYPE_FILE)
+            if (ATTR_MASK_TEST(p_op->fs_attrs, type)
+                && !strcmp(ATTR(p_op->fs_attrs, type), STR_TYPE_FILE)
                 && !strcmp(global_config.fs_type, "lustre")) {
                 check_stripe_info(p_op, lmgr);
             }
@@ -1147,14 +1307,47 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     }   /* end if entry from FS scan */
 #endif
 
-    check_fullpath(&p_op->db_attrs, &p_op->entry_id, &p_op->fs_attr_need);
+    check_fullpath(p_op->db_attrs, &p_op->entry_id, &p_op->fs_attr_need);
 
 #ifdef _BENCH_DB
     /* don't get info from filesystem */
     next_stage = STAGE_PRE_APPLY;
 #endif
 
- next_step:
+    return next_stage;
+}
+
+/**
+ * check if the entry exists in the database and what info
+ * must be retrieved.
+ */
+int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
+{
+    int rc = 0;
+    int next_stage = -1;    /* -1 = skip */
+
+    const pipeline_stage_t *stage_info =
+        &entry_proc_pipeline[p_op->pipeline_stage];
+
+    if (get_info_db_prepare(p_op, lmgr) == 0) {
+        if (!attr_mask_is_null(p_op->db_attrs->attr_mask)) {
+            rc = ListMgr_Get(lmgr, &p_op->entry_id, p_op->db_attrs);
+        } else {
+            /* only check if the entry exists */
+            rc = ListMgr_Exists(lmgr, &p_op->entry_id);
+            if (rc > 0)
+                rc = DB_SUCCESS;
+            else if (rc == 0)
+                rc = DB_NOT_EXISTS;
+            else
+                rc = -rc;
+        }
+        next_stage = get_info_db_process(p_op, lmgr, rc);
+    }
+
+    if (next_stage == -1)
+        next_stage = drop_stage(p_op);
+
     if (next_stage == -1)
         /* drop the entry */
         rc = EntryProcessor_Acknowledge(p_op, -1, true);
@@ -1169,6 +1362,80 @@ int EntryProc_get_info_db(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     return rc;
 }
 
+/**
+ * Batched version of GET_INFO_DB stage: retrieve the information of all
+ * entries from the database with a minimal count of DB requests.
+ */
+int EntryProc_get_info_db_batch(struct entry_proc_op_t **ops, int count,
+                                lmgr_t *lmgr)
+{
+    int i, n, nb_db, rc = 0;
+    const pipeline_stage_t *stage_info =
+        &entry_proc_pipeline[ops[0]->pipeline_stage];
+    int *next_stages = NULL;
+    int *db_rcs = NULL;
+    struct entry_proc_op_t **db_ops = NULL;
+
+    next_stages = MemCalloc(count, sizeof(*next_stages));
+    db_rcs = MemCalloc(count, sizeof(*db_rcs));
+    db_ops = MemCalloc(count, sizeof(*db_ops));
+    if (!next_stages || !db_rcs || !db_ops) {
+        /* process the operations one by one, so they are not lost */
+        for (i = 0; i < count; i++) {
+            int rc2 = EntryProc_get_info_db(ops[i], lmgr);
+
+            if (rc2 && !rc)
+                rc = rc2;
+        }
+        goto out;
+    }
+
+    /* determine what must be retrieved for each entry */
+    nb_db = 0;
+    for (i = 0; i < count; i++) {
+        if (get_info_db_prepare(ops[i], lmgr) == 0)
+            db_ops[nb_db++] = ops[i];
+        else
+            next_stages[i] = -1;    /* drop the entry */
+    }
+
+    if (nb_db > 0)
+        get_db_attrs_batch(db_ops, nb_db, lmgr, db_rcs);
+
+    /* process the results (db_ops are in the same order as ops) */
+    for (i = 0, n = 0; i < count; i++) {
+        if (n < nb_db && db_ops[n] == ops[i]) {
+            next_stages[i] = get_info_db_process(ops[i], lmgr, db_rcs[n]);
+            n++;
+        }
+        if (next_stages[i] == -1)
+            next_stages[i] = drop_stage(ops[i]);
+    }
+
+    rc = EntryProcessor_AcknowledgeBatchStages(ops, count, next_stages);
+    if (rc)
+        DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
+                   "Error %d acknowledging stage %s.", rc,
+                   stage_info->stage_name);
+ out:
+    MemFree(db_ops);
+    MemFree(db_rcs);
+    MemFree(next_stages);
+    return rc;
+}
+
+/**
+ * Check if 2 operations can be looked up in DB in the same batch.
+ * Operations that don't have an id yet can't be part of a batch.
+ */
+static bool dbget_is_batchable(struct entry_proc_op_t *first,
+                               struct entry_proc_op_t *next,
+                               attr_mask_t *full_attr_mask)
+{
+    return first->entry_id_is_set && !first->get_fid_from_db
+        && next->entry_id_is_set && !next->get_fid_from_db;
+}
+
 /** skip_record a record by acknowledging current operation */
 static int skip_record(struct entry_proc_op_t *p_op)
 {
@@ -1218,8 +1485,8 @@ static int rm_record(struct entry_proc_op_t *p_op)
 
     ATTR_MASK_INIT(&merged_attrs);
 
-    ListMgr_MergeAttrSets(&merged_attrs, &p_op->fs_attrs, 1);
-    ListMgr_MergeAttrSets(&merged_attrs, &p_op->db_attrs, 0);
+    ListMgr_MergeAttrSets(&merged_attrs, p_op->fs_attrs, 1);
+    ListMgr_MergeAttrSets(&merged_attrs, p_op->db_attrs, 0);
 
     pa = match_all_softrm_filters(&p_op->entry_id, &merged_attrs);
 
@@ -1296,7 +1563,7 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
     /* don't retrieve info which is already fresh */
     p_op->fs_attr_need =
-        attr_mask_and_not(&p_op->fs_attr_need, &p_op->fs_attrs.attr_mask);
+        attr_mask_and_not(&p_op->fs_attr_need, &p_op->fs_attrs->attr_mask);
 
 #ifdef HAVE_CHANGELOGS  /* never needed for scans */
     if (NEED_GETATTR(p_op) && (p_op->extra_info.is_changelog_record)) {
@@ -1332,18 +1599,18 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
         /* convert them to internal structure */
 #if defined(_LUSTRE) && defined(_HAVE_FID) && defined(_MDS_STAT_SUPPORT)
-        stat2rbh_attrs(&entry_md, &p_op->fs_attrs,
+        stat2rbh_attrs(&entry_md, p_op->fs_attrs,
                        !global_config.direct_mds_stat);
 #else
-        stat2rbh_attrs(&entry_md, &p_op->fs_attrs, true);
+        stat2rbh_attrs(&entry_md, p_op->fs_attrs, true);
 #endif
-        ATTR_MASK_SET(&p_op->fs_attrs, md_update);
-        ATTR(&p_op->fs_attrs, md_update) = time(NULL);
+        ATTR_MASK_SET(p_op->fs_attrs, md_update);
+        ATTR(p_op->fs_attrs, md_update) = time(NULL);
 
     }
     /* getattr needed */
     if (NEED_GETPATH(p_op)) {
-        if (path_check_update(&p_op->entry_id, path, &p_op->fs_attrs,
+        if (path_check_update(&p_op->entry_id, path, p_op->fs_attrs,
                               p_op->fs_attr_need) == PCR_ORPHAN) {
             /* ignore entries not in the namespace */
             return skip_record(p_op);
@@ -1353,7 +1620,7 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
     if (entry_proc_conf.detect_fake_mtime
         && ATTR_FSorDB_TEST(p_op, creation_time)
-        && ATTR_MASK_TEST(&p_op->fs_attrs, last_mod)) {
+        && ATTR_MASK_TEST(p_op->fs_attrs, last_mod)) {
         check_and_warn_fake_mtime(p_op);
     }
 #ifdef _LUSTRE
@@ -1368,14 +1635,14 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     if (NEED_GETSTRIPE(p_op)) {
         /* get entry stripe */
         rc = File_GetStripeByPath(path,
-                                  &ATTR(&p_op->fs_attrs, stripe_info),
-                                  &ATTR(&p_op->fs_attrs, stripe_items));
+                                  &ATTR(p_op->fs_attrs, stripe_info),
+                                  &ATTR(p_op->fs_attrs, stripe_items));
         if (rc) {
-            ATTR_MASK_UNSET(&p_op->fs_attrs, stripe_info);
-            ATTR_MASK_UNSET(&p_op->fs_attrs, stripe_items);
+            ATTR_MASK_UNSET(p_op->fs_attrs, stripe_info);
+            ATTR_MASK_UNSET(p_op->fs_attrs, stripe_items);
         } else {
-            ATTR_MASK_SET(&p_op->fs_attrs, stripe_info);
-            ATTR_MASK_SET(&p_op->fs_attrs, stripe_items);
+            ATTR_MASK_SET(p_op->fs_attrs, stripe_info);
+            ATTR_MASK_SET(p_op->fs_attrs, stripe_items);
         }
     }   /* get_stripe needed */
 #endif
@@ -1388,8 +1655,8 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
         ATTR_MASK_INIT(&merged_attrs);
 
-        ListMgr_MergeAttrSets(&merged_attrs, &p_op->fs_attrs, 1);
-        ListMgr_MergeAttrSets(&merged_attrs, &p_op->db_attrs, 0);
+        ListMgr_MergeAttrSets(&merged_attrs, p_op->fs_attrs, 1);
+        ListMgr_MergeAttrSets(&merged_attrs, p_op->db_attrs, 0);
 
         /* match policy scopes according to newly set information:
          * remove needed status from mask and append the updated one. */
@@ -1425,7 +1692,7 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
                                    path, smi->sm->name, rc);
                     } else {
                         /* merge/update attributes */
-                        ListMgr_MergeAttrSets(&p_op->fs_attrs, &new_attrs,
+                        ListMgr_MergeAttrSets(p_op->fs_attrs, &new_attrs,
                                               true);
                     }
                     /* free allocated resources, once merged */
@@ -1444,15 +1711,15 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         attr_mask_unset_index(&p_op->fs_attr_need, ATTR_INDEX_link);
 
     if (NEED_READLINK(p_op)) {
-        ssize_t len = readlink(path, ATTR(&p_op->fs_attrs, link), RBH_PATH_MAX);
+        ssize_t len = readlink(path, ATTR(p_op->fs_attrs, link), RBH_PATH_MAX);
         if (len >= 0) {
-            ATTR_MASK_SET(&p_op->fs_attrs, link);
+            ATTR_MASK_SET(p_op->fs_attrs, link);
 
             /* add final '\0' on success */
             if (len >= RBH_PATH_MAX)
-                ATTR(&p_op->fs_attrs, link)[len - 1] = '\0';
+                ATTR(p_op->fs_attrs, link)[len - 1] = '\0';
             else
-                ATTR(&p_op->fs_attrs, link)[len] = '\0';
+                ATTR(p_op->fs_attrs, link)[len] = '\0';
         } else
             DisplayLog(LVL_MAJOR, ENTRYPROC_TAG, "readlink failed on %s: %s",
                        path, strerror(errno));
@@ -1466,7 +1733,7 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     /* match fileclasses if specified in config */
     /* FIXME: check fileclass update parameters */
     if (entry_proc_conf.match_classes)
-        match_classes(&p_op->entry_id, &p_op->fs_attrs, &p_op->db_attrs);
+        match_classes(&p_op->entry_id, p_op->fs_attrs, p_op->db_attrs);
 
     /* go to next step */
     rc = EntryProcessor_Acknowledge(p_op, STAGE_PRE_APPLY, false);
@@ -1476,6 +1743,19 @@ int EntryProc_get_info_fs(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     return rc;
 }
 
+/**
+ * Entries discovered by a scan can be bulk loaded (during the initial scan).
+ * Changelog records are always applied to the DB directly.
+ */
+static inline bool bulk_insert_allowed(const entry_proc_op_t *p_op)
+{
+#ifdef HAVE_CHANGELOGS
+    return !p_op->extra_info.is_changelog_record;
+#else
+    return true;
+#endif
+}
+
 static bool dbop_is_batchable(struct entry_proc_op_t *first,
                               struct entry_proc_op_t *next,
                               attr_mask_t *full_attr_mask)
@@ -1490,11 +1770,15 @@ static bool dbop_is_batchable(struct entry_proc_op_t *first,
     /* all NOOP operations can be batched */
     else if (first->db_op_type == OP_TYPE_NONE)
         return true;
+    /* entries of scans and changelogs are not inserted the same way */
+    else if (first->db_op_type == OP_TYPE_INSERT
+             && bulk_insert_allowed(first) != bulk_insert_allowed(next))
+        return false;
     /* different masks can be mixed, as long as attributes for each table are
      * the same or 0. Ask the list manager about that. */
-    else if (lmgr_batch_compat(*full_attr_mask, next->fs_attrs.attr_mask)) {
+    else if (lmgr_batch_compat(*full_attr_mask, next->fs_attrs->attr_mask)) {
         *full_attr_mask =
-            attr_mask_or(full_attr_mask, &next->fs_attrs.attr_mask);
+            attr_mask_or(full_attr_mask, &next->fs_attrs->attr_mask);
         return true;
     } else
         return false;
@@ -1509,7 +1793,7 @@ int EntryProc_pre_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
     /* once set, never change creation time */
     if (p_op->db_op_type != OP_TYPE_INSERT)
-        ATTR_MASK_UNSET(&p_op->fs_attrs, creation_time);
+        ATTR_MASK_UNSET(p_op->fs_attrs, creation_time);
 
 #ifdef HAVE_CHANGELOGS
     /* handle nlink. We don't want the values from the filesystem if
@@ -1519,14 +1803,14 @@ int EntryProc_pre_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
         if (logrec->cr_type == CL_CREATE) {
             /* New file. Hardlink is always 1. */
-            ATTR_MASK_SET(&p_op->fs_attrs, nlink);
-            ATTR(&p_op->fs_attrs, nlink) = 1;
+            ATTR_MASK_SET(p_op->fs_attrs, nlink);
+            ATTR(p_op->fs_attrs, nlink) = 1;
         } else if ((logrec->cr_type == CL_HARDLINK) &&
-                   (ATTR_MASK_TEST(&p_op->db_attrs, nlink))) {
+                   (ATTR_MASK_TEST(p_op->db_attrs, nlink))) {
             /* New hardlink. Add 1 to existing value. Ignore what came
              * from the FS, since it can be out of sync by now. */
-            ATTR_MASK_SET(&p_op->fs_attrs, nlink);
-            ATTR(&p_op->fs_attrs, nlink) = ATTR(&p_op->db_attrs, nlink) + 1;
+            ATTR_MASK_SET(p_op->fs_attrs, nlink);
+            ATTR(p_op->fs_attrs, nlink) = ATTR(p_op->db_attrs, nlink) + 1;
         }
     }
 #endif
@@ -1535,10 +1819,11 @@ int EntryProc_pre_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     if (p_op->db_op_type == OP_TYPE_UPDATE) {
         attr_mask_t tmp;
         attr_mask_t loc_diff_mask =
-            ListMgr_WhatDiff(&p_op->fs_attrs, &p_op->db_attrs);
+            ListMgr_WhatDiff(p_op->fs_attrs, p_op->db_attrs);
 
         /* In scan mode, always keep md_update and path_update,
-         * to avoid their cleaning at the end of the scan.
+         * to avoid their cleaning at the end of the scan (unless the entry
+         * is recorded in the set of seen entries, see below).
          * Also keep name and parent as they are keys in DNAMES table.
          */
         attr_mask_t to_keep = {.std =
@@ -1551,6 +1836,11 @@ int EntryProc_pre_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         if (loc_diff_mask.std & (ATTR_MASK_parent_id | ATTR_MASK_name)) {
             to_keep.std |= ATTR_MASK_fullpath;
             display_mask.std |= ATTR_MASK_fullpath;
+
+            /* a directory rename changes the path of its children */
+            if (!ATTR_FSorDB_TEST(p_op, type)
+                || !strcmp(ATTR_FSorDB(p_op, type), STR_TYPE_DIR))
+                p_op->path_changed = 1;
         }
 #ifdef HAVE_CHANGELOGS
         if (!p_op->extra_info.is_changelog_record)
@@ -1559,16 +1849,16 @@ int EntryProc_pre_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
         /* remove other unchanged attrs + attrs not in db mask */
         tmp = attr_mask_or(&loc_diff_mask, &to_keep);
-        tmp = attr_mask_or_not(&tmp, &p_op->db_attrs.attr_mask);
-        p_op->fs_attrs.attr_mask =
-            attr_mask_and(&p_op->fs_attrs.attr_mask, &tmp);
+        tmp = attr_mask_or_not(&tmp, &p_op->db_attrs->attr_mask);
+        p_op->fs_attrs->attr_mask =
+            attr_mask_and(&p_op->fs_attrs->attr_mask, &tmp);
 
 #ifdef _LUSTRE
         if (p_op->db_stripe_ok) {
-            ATTR_MASK_UNSET(&p_op->fs_attrs, stripe_info);
-            if (ATTR_MASK_TEST(&p_op->fs_attrs, stripe_items)) {
-                ATTR_MASK_UNSET(&p_op->fs_attrs, stripe_items);
-                free_stripe_items(&ATTR(&p_op->fs_attrs, stripe_items));
+            ATTR_MASK_UNSET(p_op->fs_attrs, stripe_info);
+            if (ATTR_MASK_TEST(p_op->fs_attrs, stripe_items)) {
+                ATTR_MASK_UNSET(p_op->fs_attrs, stripe_items);
+                free_stripe_items(&ATTR(p_op->fs_attrs, stripe_items));
             }
         }
 #endif
@@ -1580,11 +1870,17 @@ int EntryProc_pre_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
          * don't set update timestamp.
          */
         if ((updt_params.fileclass.when == UPDT_ALWAYS)
-            && !ATTR_MASK_TEST(&p_op->fs_attrs, fileclass))
-            ATTR_MASK_UNSET(&p_op->fs_attrs, class_update);
+            && !ATTR_MASK_TEST(p_op->fs_attrs, fileclass))
+            ATTR_MASK_UNSET(p_op->fs_attrs, class_update);
+
+#ifdef HAVE_CHANGELOGS
+        if (!p_op->extra_info.is_changelog_record)
+#endif
+            if (seen_set_record(p_op, &loc_diff_mask))
+                p_op->fs_attrs->attr_mask = null_mask;
 
         /* nothing changed => noop */
-        if (attr_mask_is_null(p_op->fs_attrs.attr_mask)) {
+        if (attr_mask_is_null(p_op->fs_attrs->attr_mask)) {
             /* no op */
             p_op->db_op_type = OP_TYPE_NONE;
         } else if (!attr_mask_is_null(attr_mask_and(&loc_diff_mask,
@@ -1594,12 +1890,12 @@ int EntryProc_pre_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
             /* attr from DB */
             if (!attr_mask_is_null(display_mask))
-                print_attrs(attrchg, &p_op->db_attrs, display_mask, 1);
+                print_attrs(attrchg, p_op->db_attrs, display_mask, 1);
 
             printf("-" DFID " %s\n", PFID(&p_op->entry_id), attrchg->str);
 
             /* attr from FS */
-            print_attrs(attrchg, &p_op->fs_attrs, display_mask, 1);
+            print_attrs(attrchg, p_op->fs_attrs, display_mask, 1);
             printf("+" DFID " %s\n", PFID(&p_op->entry_id), attrchg->str);
 
             g_string_free(attrchg, TRUE);
@@ -1608,8 +1904,8 @@ int EntryProc_pre_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         if (p_op->db_op_type == OP_TYPE_INSERT) {
             GString *attrnew = g_string_new(NULL);
 
-            print_attrs(attrnew, &p_op->fs_attrs,
-                        attr_mask_and(&p_op->fs_attrs.attr_mask, &diff_mask),
+            print_attrs(attrnew, p_op->fs_attrs,
+                        attr_mask_and(&p_op->fs_attrs->attr_mask, &diff_mask),
                         1);
 
             printf("++" DFID " %s\n", PFID(&p_op->entry_id), attrnew->str);
@@ -1624,7 +1920,7 @@ int EntryProc_pre_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
                 printf("--" DFID "\n", PFID(&p_op->entry_id));
         }
     }
-    attr_mask_unset_readonly(&p_op->fs_attrs.attr_mask);
+    attr_mask_unset_readonly(&p_op->fs_attrs->attr_mask);
 
     rc = EntryProcessor_Acknowledge(p_op, STAGE_DB_APPLY, false);
     if (rc)
@@ -1633,6 +1929,75 @@ int EntryProc_pre_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     return rc;
 }
 
+/**
+ * Invalidate the cached paths affected by an operation,
+ * once it has been applied to the database.
+ */
+static void invalidate_paths(const struct entry_proc_op_t *p_op)
+{
+    bool is_dir = !ATTR_FSorDB_TEST(p_op, type)
+                  || !strcmp(ATTR_FSorDB(p_op, type), STR_TYPE_DIR);
+
+    switch (p_op->db_op_type) {
+    case OP_TYPE_UPDATE:
+        if (p_op->path_changed)
+            ListMgr_InvalidatePath(&p_op->entry_id, true);
+        break;
+    case OP_TYPE_REMOVE_ONE:
+        /* old name of a renamed directory */
+        if (is_dir)
+            ListMgr_InvalidatePath(&p_op->entry_id, true);
+        break;
+    case OP_TYPE_REMOVE_LAST:
+    case OP_TYPE_SOFT_REMOVE:
+        /* removed directories are empty */
+        if (is_dir)
+            ListMgr_InvalidatePath(&p_op->entry_id, false);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Report the accounting changes of an operation (batched accounting),
+ * once it has been applied to the database.
+ */
+static void update_acct(const struct entry_proc_op_t *p_op, lmgr_t *lmgr)
+{
+    int rc;
+
+    if (!lmgr_acct_batched())
+        return;
+
+    switch (p_op->db_op_type) {
+    case OP_TYPE_INSERT:
+        rc = ListMgr_AcctUpdate(lmgr, NULL, p_op->fs_attrs);
+        break;
+
+    case OP_TYPE_UPDATE:
+        /* batched updates may insert entries that were not in the DB */
+        rc = ListMgr_AcctUpdate(lmgr, p_op->db_exists ? p_op->db_attrs : NULL,
+                                p_op->fs_attrs);
+        break;
+
+    case OP_TYPE_REMOVE_LAST:
+    case OP_TYPE_SOFT_REMOVE:
+        if (!p_op->db_exists)
+            return;
+        rc = ListMgr_AcctUpdate(lmgr, p_op->db_attrs, NULL);
+        break;
+
+    default:
+        return;
+    }
+
+    if (rc)
+        DisplayLog(LVL_MAJOR, ENTRYPROC_TAG, "Error %d updating the "
+                   "accounting of " DFID ": %s", rc, PFID(&p_op->entry_id),
+                   lmgr_err2str(rc));
+}
+
 /**
  * Perform a single operation on the database.
  */
@@ -1642,6 +2007,12 @@ int EntryProc_db_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     const pipeline_stage_t *stage_info =
         &entry_proc_pipeline[p_op->pipeline_stage];
 
+    /* not concurrently with a rebuild of DIR_STAT or ACCT_STAT */
+    ListMgr_ApplyBegin();
+
+    /* applied in the same transaction as the operation */
+    report_dir_stat(p_op, lmgr);
+
     /* insert to DB */
     switch (p_op->db_op_type) {
     case OP_TYPE_NONE:
@@ -1654,25 +2025,34 @@ int EntryProc_db_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     case OP_TYPE_INSERT:
         DisplayLog(LVL_FULL, ENTRYPROC_TAG, "Insert(" DFID ")",
                    PFID(&p_op->entry_id));
-        rc = ListMgr_Insert(lmgr, &p_op->entry_id, &p_op->fs_attrs, false);
+        rc = DB_NOT_SUPPORTED;
+        if (bulk_insert_allowed(p_op)) {
+            entry_id_t *p_id = &p_op->entry_id;
+            attr_set_t *p_attrs = p_op->fs_attrs;
+
+            rc = ListMgr_BulkInsert(lmgr, &p_id, &p_attrs, 1);
+        }
+        if (rc == DB_NOT_SUPPORTED)
+            rc = ListMgr_Insert(lmgr, &p_op->entry_id, p_op->fs_attrs,
+                                false);
         break;
 
     case OP_TYPE_UPDATE:
         DisplayLog(LVL_FULL, ENTRYPROC_TAG, "Update(" DFID ")",
                    PFID(&p_op->entry_id));
-        rc = ListMgr_Update(lmgr, &p_op->entry_id, &p_op->fs_attrs);
+        rc = ListMgr_Update(lmgr, &p_op->entry_id, p_op->fs_attrs);
         break;
 
     case OP_TYPE_REMOVE_ONE:
         DisplayLog(LVL_FULL, ENTRYPROC_TAG, "RemoveOne(" DFID ")",
                    PFID(&p_op->entry_id));
-        rc = ListMgr_Remove(lmgr, &p_op->entry_id, &p_op->fs_attrs, false);
+        rc = ListMgr_Remove(lmgr, &p_op->entry_id, p_op->fs_attrs, false);
         break;
 
     case OP_TYPE_REMOVE_LAST:
         DisplayLog(LVL_FULL, ENTRYPROC_TAG, "RemoveLast(" DFID ")",
                    PFID(&p_op->entry_id));
-        rc = ListMgr_Remove(lmgr, &p_op->entry_id, &p_op->fs_attrs, true);
+        rc = ListMgr_Remove(lmgr, &p_op->entry_id, p_op->fs_attrs, true);
         break;
 
     case OP_TYPE_SOFT_REMOVE:
@@ -1686,16 +2066,16 @@ int EntryProc_db_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
             tmp2 = sm_softrm_mask();
             tmp = attr_mask_or(&tmp, &tmp2);
 
-            print_attrs(gs, &p_op->fs_attrs, tmp, true);
+            print_attrs(gs, p_op->fs_attrs, tmp, true);
             DisplayLog(LVL_DEBUG, ENTRYPROC_TAG, "SoftRemove(" DFID ",%s)",
                        PFID(&p_op->entry_id), gs->str);
             g_string_free(gs, TRUE);
         }
 
         /* FIXME get remove time from changelog */
-        ATTR_MASK_SET(&p_op->fs_attrs, rm_time);
-        ATTR(&p_op->fs_attrs, rm_time) = time(NULL);
-        rc = ListMgr_SoftRemove(lmgr, &p_op->entry_id, &p_op->fs_attrs);
+        ATTR_MASK_SET(p_op->fs_attrs, rm_time);
+        ATTR(p_op->fs_attrs, rm_time) = time(NULL);
+        rc = ListMgr_SoftRemove(lmgr, &p_op->entry_id, p_op->fs_attrs);
         break;
 
     default:
@@ -1704,10 +2084,16 @@ int EntryProc_db_apply(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         rc = -1;
     }
 
-    if (rc)
+    if (rc) {
         DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
                    "Error %d performing database operation: %s.", rc,
                    lmgr_err2str(rc));
+        ListMgr_DirStatCancel(lmgr);
+    } else {
+        invalidate_paths(p_op);
+        update_acct(p_op, lmgr);
+    }
+    ListMgr_ApplyEnd();
 
     /* Acknowledge the operation if there is a callback */
 #ifdef HAVE_CHANGELOGS
@@ -1745,9 +2131,14 @@ int EntryProc_db_batch_apply(struct entry_proc_op_t **ops, int count,
         rc = -ENOMEM;
         goto free_ids;
     }
+    /* not concurrently with a rebuild of DIR_STAT or ACCT_STAT */
+    ListMgr_ApplyBegin();
+
     for (i = 0; i < count; i++) {
         ids[i] = &ops[i]->entry_id;
-        attrs[i] = &ops[i]->fs_attrs;
+        attrs[i] = ops[i]->fs_attrs;
+        /* aggregated and applied in the same transaction as the batch */
+        report_dir_stat(ops[i], lmgr);
     }
 
     /* insert to DB */
@@ -1761,7 +2152,11 @@ int EntryProc_db_batch_apply(struct entry_proc_op_t **ops, int count,
     case OP_TYPE_INSERT:
         DisplayLog(LVL_FULL, ENTRYPROC_TAG, "BatchInsert(%u ops: " DFID "...)",
                    count, PFID(ids[0]));
-        rc = ListMgr_BatchInsert(lmgr, ids, attrs, count, false);
+        rc = DB_NOT_SUPPORTED;
+        if (bulk_insert_allowed(ops[0]))
+            rc = ListMgr_BulkInsert(lmgr, ids, attrs, count);
+        if (rc == DB_NOT_SUPPORTED)
+            rc = ListMgr_BatchInsert(lmgr, ids, attrs, count, false);
         break;
     case OP_TYPE_UPDATE:
         DisplayLog(LVL_FULL, ENTRYPROC_TAG, "BatchUpdate(%u ops: " DFID "...)",
@@ -1774,10 +2169,17 @@ int EntryProc_db_batch_apply(struct entry_proc_op_t **ops, int count,
         rc = -1;
     }
 
-    if (rc)
+    if (rc) {
         DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
                    "Error %d performing batch database operation: %s.", rc,
                    lmgr_err2str(rc));
+        ListMgr_DirStatCancel(lmgr);
+    } else
+        for (i = 0; i < count; i++) {
+            invalidate_paths(ops[i]);
+            update_acct(ops[i], lmgr);
+        }
+    ListMgr_ApplyEnd();
 
     /* Acknowledge the operation if there is a callback */
 #ifdef HAVE_CHANGELOGS
@@ -1829,6 +2231,49 @@ int EntryProc_chglog_clr(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 
     return rc;
 }
+
+/**
+ * Acknowledge a batch of committed records.
+ * The changelog reader only clears changelog records once per
+ * batch_ack_count records, so callbacks are cheap.
+ */
+static int EntryProc_chglog_clr_batch(struct entry_proc_op_t **ops, int count,
+                                      lmgr_t *lmgr)
+{
+    int i, rc;
+    const pipeline_stage_t *stage_info =
+        &entry_proc_pipeline[ops[0]->pipeline_stage];
+
+    DisplayLog(LVL_FULL, ENTRYPROC_TAG, "stage %s - %d records",
+               stage_info->stage_name, count);
+
+    for (i = 0; i < count; i++) {
+        if (ops[i]->callback_func == NULL)
+            continue;
+
+        rc = ops[i]->callback_func(lmgr, ops[i], ops[i]->callback_param);
+        if (rc)
+            DisplayLog(LVL_CRIT, ENTRYPROC_TAG,
+                       "Error %d performing callback at stage %s.", rc,
+                       stage_info->stage_name);
+    }
+
+    /* Acknowledge the operations and remove them from pipeline */
+    rc = EntryProcessor_AcknowledgeBatch(ops, count, -1, true);
+    if (rc)
+        DisplayLog(LVL_CRIT, ENTRYPROC_TAG, "Error %d acknowledging stage %s.",
+                   rc, stage_info->stage_name);
+
+    return rc;
+}
+
+/** any committed records can be acknowledged together */
+static bool chglog_clr_is_batchable(struct entry_proc_op_t *first,
+                                    struct entry_proc_op_t *next,
+                                    attr_mask_t *full_attr_mask)
+{
+    return true;
+}
 #endif
 
 static void mass_rm_cb(const entry_id_t *p_id)
@@ -1836,6 +2281,148 @@ static void mass_rm_cb(const entry_id_t *p_id)
     printf("--" DFID "\n", PFID(p_id));
 }
 
+/* progress of the garbage collection of old entries */
+static gc_progress_t gc_progress = { 0 };
+static pthread_mutex_t gc_progress_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void EntryProcessor_GetGCProgress(gc_progress_t *progress)
+{
+    P(gc_progress_lock);
+    *progress = gc_progress;
+    V(gc_progress_lock);
+}
+
+/** Describe the parameters of a garbage collection, to determine if
+ * an interrupted one can be resumed by the current operation. */
+static void gc_descr(const struct entry_proc_op_t *p_op, char *buff,
+                     size_t size)
+{
+    snprintf(buff, size, "%lu:%u:%u:%s",
+             (unsigned long)ATTR(p_op->fs_attrs, md_update),
+             p_op->gc_entries, p_op->gc_names,
+             ATTR_MASK_TEST(p_op->fs_attrs, fullpath) ?
+                ATTR(p_op->fs_attrs, fullpath) : "");
+}
+
+/** keep the entries and names recorded in the set of seen entries */
+static bool gc_keep_seen(const entry_id_t *id, const entry_id_t *parent_id,
+                         const char *name, void *arg)
+{
+    uint64_t name_hash;
+
+    if (!seen_set_lookup((struct seen_set *)arg, id, &name_hash))
+        return false;
+
+    return (name == NULL) || (name_hash == seen_name_hash(parent_id, name));
+}
+
+/**
+ * Remove entries matching filter by ranges of ids, one transaction per
+ * range, so that the other pipeline threads can apply their operations
+ * between them. The cursor is saved after each range, so an interrupted
+ * garbage collection is resumed from where it stopped.
+ * @param seen  entries seen by the scan (whose md_update may be older
+ *              than the scan). In this case, the garbage collection can't be
+ *              resumed, as the seen set is lost in case of interruption.
+ */
+static int gc_by_ranges(struct entry_proc_op_t *p_op, lmgr_t *lmgr,
+                        const lmgr_filter_t *filter, rm_cb_func_t cb,
+                        struct seen_set *seen)
+{
+    char descr[MAX_VAR_LEN];
+    char value[MAX_VAR_LEN];
+    char cursor[MAX_VAR_LEN] = "";
+    unsigned long long removed = 0;
+    unsigned int count;
+    bool soft_rm = has_deletion_policy();
+    time_t rm_time = time(NULL);
+    bool last = false;
+    int rc;
+
+    gc_descr(p_op, descr, sizeof(descr));
+
+    if (seen != NULL) {
+        DisplayLog(LVL_EVENT, ENTRYPROC_TAG,
+                   "Removing old entries (%llu unchanged entries seen)",
+                   seen_set_count(seen));
+        rc = ListMgr_SetVar(lmgr, LAST_SCAN_GC_PENDING, NULL);
+        if (rc)
+            return rc;
+    } else if (ListMgr_GetVar(lmgr, LAST_SCAN_GC_PENDING, value,
+                       sizeof(value)) == DB_SUCCESS
+        && !strcmp(value, descr)
+        && ListMgr_GetVar(lmgr, LAST_SCAN_GC_CURSOR, cursor,
+                          sizeof(cursor)) == DB_SUCCESS) {
+        if (ListMgr_GetVar(lmgr, LAST_SCAN_GC_REMOVED, value,
+                           sizeof(value)) == DB_SUCCESS)
+            removed = str2bigint(value);
+
+        DisplayLog(LVL_EVENT, ENTRYPROC_TAG,
+                   "Resuming removal of old entries after id '%s' "
+                   "(%llu already removed)", cursor, removed);
+    } else {
+        cursor[0] = '\0';
+        rc = ListMgr_SetVar(lmgr, LAST_SCAN_GC_CURSOR, cursor);
+        if (rc == DB_SUCCESS)
+            rc = ListMgr_SetVar(lmgr, LAST_SCAN_GC_REMOVED, "0");
+        if (rc == DB_SUCCESS)
+            rc = ListMgr_SetVar(lmgr, LAST_SCAN_GC_PENDING, descr);
+        if (rc)
+            return rc;
+    }
+
+    P(gc_progress_lock);
+    gc_progress.running = true;
+    gc_progress.start_time = time(NULL);
+    gc_progress.nb_ranges = 0;
+    gc_progress.nb_removed = removed;
+    V(gc_progress_lock);
+
+    while (!last) {
+        /* @TODO fix soft rm for dirs */
+        rc = ListMgr_MassRemoveRange(lmgr, filter, soft_rm, rm_time, cb,
+                                     entry_proc_conf.gc_chunk_size,
+                                     cursor, sizeof(cursor), &count, &last,
+                                     seen ? gc_keep_seen : NULL, seen);
+        if (rc)
+            break;
+
+        removed += count;
+
+        P(gc_progress_lock);
+        gc_progress.nb_ranges++;
+        gc_progress.nb_removed = removed;
+        V(gc_progress_lock);
+
+        DisplayLog(LVL_DEBUG, ENTRYPROC_TAG,
+                   "Removed %u old entries up to id '%s' (total: %llu)",
+                   count, last ? "<end>" : cursor, removed);
+
+        if (last || seen != NULL)
+            continue;
+
+        /* save the cursor to resume from it in case of interruption */
+        sprintf(value, "%llu", removed);
+        rc = ListMgr_SetVar(lmgr, LAST_SCAN_GC_REMOVED, value);
+        if (rc == DB_SUCCESS)
+            rc = ListMgr_SetVar(lmgr, LAST_SCAN_GC_CURSOR, cursor);
+        if (rc)
+            break;
+    }
+
+    P(gc_progress_lock);
+    gc_progress.running = false;
+    V(gc_progress_lock);
+
+    if (rc)
+        return rc;
+
+    sprintf(value, "%llu", removed);
+    ListMgr_SetVar(lmgr, LAST_SCAN_GC_REMOVED, value);
+    ListMgr_SetVar(lmgr, LAST_SCAN_GC_CURSOR, NULL);
+    return ListMgr_SetVar(lmgr, LAST_SCAN_GC_PENDING, NULL);
+}
+
 int EntryProc_rm_old_entries(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
 {
     int rc;
@@ -1844,11 +2431,25 @@ int EntryProc_rm_old_entries(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
     lmgr_filter_t filter;
     filter_value_t val;
     rm_cb_func_t cb = NULL;
+    struct seen_set *seen = NULL;
 
     /* callback func for diff display */
     if (!attr_mask_is_null(diff_mask))
         cb = mass_rm_cb;
 
+    if (p_op->gc_seen_set) {
+        seen = seen_set_take();
+        /* md_update of unchanged entries is not up to date: they can't be
+         * distinguished from removed entries without the seen set */
+        if (seen == NULL && (p_op->gc_entries || p_op->gc_names)) {
+            DisplayLog(LVL_MAJOR, ENTRYPROC_TAG,
+                       "Set of seen entries is missing: "
+                       "skipping removal of old entries");
+            p_op->gc_entries = 0;
+            p_op->gc_names = 0;
+        }
+    }
+
     /* If gc_entries or gc_names are not set,
      * this is just a special op to wait for pipeline flush.
      * => don't clean old entries */
@@ -1858,7 +2459,7 @@ int EntryProc_rm_old_entries(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         if (p_op->gc_entries) {
             /* remove entries from all tables that have not been seen during
              * the scan */
-            val.value.val_uint = ATTR(&p_op->fs_attrs, md_update);
+            val.value.val_uint = ATTR(p_op->fs_attrs, md_update);
             lmgr_simple_filter_add(&filter, ATTR_INDEX_md_update,
                                    LESSTHAN_STRICT, val, 0);
         }
@@ -1866,16 +2467,16 @@ int EntryProc_rm_old_entries(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         if (p_op->gc_names) {
             /* use the same timestamp for cleaning paths that have not been
              * seen during the scan */
-            val.value.val_uint = ATTR(&p_op->fs_attrs, md_update);
+            val.value.val_uint = ATTR(p_op->fs_attrs, md_update);
             lmgr_simple_filter_add(&filter, ATTR_INDEX_path_update,
                                    LESSTHAN_STRICT, val, 0);
         }
 
         /* partial scan: remove non-updated entries from a subset of the
          * namespace */
-        if (ATTR_MASK_TEST(&p_op->fs_attrs, fullpath)) {
+        if (ATTR_MASK_TEST(p_op->fs_attrs, fullpath)) {
             char tmp[RBH_PATH_MAX];
-            strcpy(tmp, ATTR(&p_op->fs_attrs, fullpath));
+            strcpy(tmp, ATTR(p_op->fs_attrs, fullpath));
             strcat(tmp, "/*");
             val.value.val_str = tmp;
             lmgr_simple_filter_add(&filter, ATTR_INDEX_fullpath, LIKE, val, 0);
@@ -1885,11 +2486,7 @@ int EntryProc_rm_old_entries(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
         ListMgr_ForceCommitFlag(lmgr, true);
 
         /* remove entries listed in previous scans */
-        if (has_deletion_policy())
-            /* @TODO fix for dirs */
-            rc = ListMgr_MassSoftRemove(lmgr, &filter, time(NULL), cb);
-        else
-            rc = ListMgr_MassRemove(lmgr, &filter, cb);
+        rc = gc_by_ranges(p_op, lmgr, &filter, cb, seen);
 
         lmgr_simple_filter_free(&filter);
 
@@ -1899,6 +2496,8 @@ int EntryProc_rm_old_entries(struct entry_proc_op_t *p_op, lmgr_t *lmgr)
                        rc, lmgr_err2str(rc));
     }
 
+    seen_set_destroy(seen);
+
     /* must call callback function in any case, to unblock the scan */
     if (p_op->callback_func) {
         /* Perform callback to info collector */
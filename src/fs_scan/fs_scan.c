@@ -30,6 +30,7 @@
 #include "task_tree_mngmt.h"
 #include "xplatform_print.h"
 #include "rbh_basename.h"
+#include "scan_uring.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -44,6 +45,7 @@
 
 #include <string.h>
 #include <fcntl.h>
+#include <stddef.h>
 
 fs_scan_config_t fs_scan_config;
 run_flags_t fsscan_flags = 0;
@@ -51,9 +53,12 @@ const char *partial_scan_root = NULL;
 
 #define fsscan_once (fsscan_flags & RUNFLG_ONCE)
 #define fsscan_nogc (fsscan_flags & RUNFLG_NO_GC)
+#define fsscan_nobulk (fsscan_flags & RUNFLG_NO_BULK_LOAD)
 
 static bool is_lustre_fs = false;
 static bool is_first_scan = false;
+/* unchanged entries of the current scan are recorded in the seen set */
+static bool use_seen_set = false;
 
 /* information about scanning thread */
 
@@ -76,6 +81,17 @@ typedef struct thread_scan_info__ {
     struct timeval time_consumed;
     struct timeval last_processing_time;
 
+#ifndef _NO_AT_FUNC
+    /* buffer for reading directory entries */
+    char *dirent_buf;
+    size_t dirent_buf_size;
+    /* names of the entries in dirent_buf (for async processing) */
+    char **dirent_names;
+
+    /* context for asynchronous operations (NULL if not used) */
+    scan_uring_t *ring;
+#endif
+
 } thread_scan_info_t;
 
 /**
@@ -146,6 +162,9 @@ static int db_special_op_callback(lmgr_t *lmgr, struct entry_proc_op_t *p_op,
 
     /* Update end time for pipeline processing */
     if (lmgr) {
+        /* all entries of the scan have been processed */
+        ListMgr_BulkLoadEnd(lmgr);
+
         sprintf(timestamp, "%lu", (unsigned long)time(NULL));
         ListMgr_SetVar(lmgr, LAST_SCAN_PROCESSING_END_TIME, timestamp);
     }
@@ -204,6 +223,7 @@ static void ResetScanStats(bool do_lock)
         timerclear(&thread_list[i].time_consumed);
         timerclear(&thread_list[i].last_processing_time);
     }
+    ResetTaskStackStats(&tasks_stack);
 
     if (do_lock)
         V(lock_scan);
@@ -330,6 +350,11 @@ static int TerminateScan(int scan_complete, time_t end)
                            scan_complete ? SCAN_STATUS_DONE :
                            SCAN_STATUS_INCOMPLETE);
 
+        /* if the scan is complete, the bulk load ends when all its entries
+         * have been processed (see db_special_op_callback) */
+        if (!scan_complete)
+            ListMgr_BulkLoadEnd(&lmgr);
+
         /* no other DB actions, close the connection */
         ListMgr_CloseAccess(&lmgr);
     }
@@ -354,7 +379,7 @@ static int TerminateScan(int scan_complete, time_t end)
         op->callback_func = db_special_op_callback;
         op->callback_param = (void *)"Remove obsolete entries";
 
-        ATTR_MASK_INIT(&op->fs_attrs);
+        ATTR_MASK_INIT(op->fs_attrs);
 
         /* if this is an initial scan, don't rm old entries
          * (but flush pipeline still) */
@@ -376,14 +401,17 @@ static int TerminateScan(int scan_complete, time_t end)
                 op->gc_entries = 1;
 
             /* set the timestamp of scan in (md_update attribute) */
-            ATTR_MASK_SET(&op->fs_attrs, md_update);
-            ATTR(&op->fs_attrs, md_update) = scan_start_time;
+            ATTR_MASK_SET(op->fs_attrs, md_update);
+            ATTR(op->fs_attrs, md_update) = scan_start_time;
+
+            /* unchanged entries have not been updated */
+            op->gc_seen_set = use_seen_set;
         }
 
         /* set root (if partial scan) */
         if (partial_scan_root) {
-            ATTR_MASK_SET(&op->fs_attrs, fullpath);
-            strcpy(ATTR(&op->fs_attrs, fullpath), partial_scan_root);
+            ATTR_MASK_SET(op->fs_attrs, fullpath);
+            strcpy(ATTR(op->fs_attrs, fullpath), partial_scan_root);
         }
 
         /* set wait db flag */
@@ -395,8 +423,14 @@ static int TerminateScan(int scan_complete, time_t end)
         wait_for_db_callback();
 #else
         EntryProcessor_Release(op);
+        EntryProcessor_SeenSetDrop();
 #endif
+    } else if (use_seen_set) {
+        /* md_update of unchanged entries is not up to date:
+         * old entries can't be removed without the seen set */
+        EntryProcessor_SeenSetDrop();
     }
+    use_seen_set = false;
 
     /* take a lock on scan info */
     P(lock_scan);
@@ -741,7 +775,8 @@ static void check_dir_error(int rc)
     }
 }
 
-static int create_child_task(const char *childpath, struct stat *inode,
+static int create_child_task(thread_scan_info_t *p_info,
+                             const char *childpath, struct stat *inode,
                              robinhood_task_t *parent,
                              const char *scan_root,
                              const char *entryname)
@@ -778,8 +813,8 @@ static int create_child_task(const char *childpath, struct stat *inode,
     /* add the task to the parent's subtask list */
     AddChildTask(parent, p_task);
 
-    /* insert task to the stack */
-    InsertTask_to_Stack(&tasks_stack, p_task);
+    /* insert task to the deque of the current thread */
+    InsertTask_to_Stack(&tasks_stack, p_info->index, p_task);
     return 0;
 
  out_free:
@@ -813,10 +848,51 @@ static int stat_entry(const char *path, const char *name, int parentfd,
     return 0;
 }
 
-/* process a filesystem entry */
+#if defined(_HAVE_FID) && !defined(_NO_AT_FUNC)
+/** get the fid of an entry, using openat on parent fd */
+static int get_fid_at(int parentfd, const char *name, entry_id_t *p_id)
+{
+    int rc;
+    int fd = openat_noatime(parentfd, name, false);
+
+    if (fd < 0) {
+        rc = -errno;
+        DisplayLog(LVL_DEBUG, FSSCAN_TAG,
+                   "openat failed on <parent_fd=%d>/%s: %s", parentfd,
+                   name, strerror(-rc));
+        return rc;
+    }
+
+    rc = Lustre_GetFidByFd(fd, p_id);
+    if (rc)
+        DisplayLog(LVL_DEBUG, FSSCAN_TAG,
+                   "fd2fid failed on <parent_fd=%d>/%s: %s", parentfd,
+                   name, strerror(-rc));
+    close(fd);
+    return rc;
+}
+#endif
+
+/** entry information retrieved in advance (by asynchronous operations) */
+typedef struct entry_prefetch {
+    struct stat inode;
+    int         stat_rc;    /**< 0 or -errno */
+#ifdef _HAVE_FID
+    bool        fid_fetched;    /**< fid_rc and fid are set */
+    int         fid_rc;
+    entry_id_t  fid;
+#endif
+} entry_prefetch_t;
+
+/**
+ * Process a filesystem entry.
+ * @param prefetch entry information retrieved in advance
+ *                 (NULL to retrieve it now).
+ */
 static int process_one_entry(thread_scan_info_t *p_info,
                              robinhood_task_t *p_task,
-                             char *entry_name, int parentfd)
+                             char *entry_name, int parentfd,
+                             const entry_prefetch_t *prefetch)
 {
     char entry_path[RBH_PATH_MAX];
     struct stat inode;
@@ -834,7 +910,11 @@ static int process_one_entry(thread_scan_info_t *p_info,
 
     /* retrieve information about the entry (to know if it's a directory
      * or something else) */
-    rc = stat_entry(entry_path, entry_name, parentfd, &inode);
+    if (prefetch != NULL) {
+        inode = prefetch->inode;
+        rc = prefetch->stat_rc;
+    } else
+        rc = stat_entry(entry_path, entry_name, parentfd, &inode);
     if (rc) {
 #ifdef _LUSTRE
         if (is_lustre_fs && (rc == -ESHUTDOWN)) {
@@ -869,7 +949,8 @@ static int process_one_entry(thread_scan_info_t *p_info,
      * Note: directories are pushed in Thr_scan(), after the closedir() call.
      */
     if (S_ISDIR(inode.st_mode)) {
-        rc = create_child_task(entry_path, &inode, p_task, NULL, entry_name);
+        rc = create_child_task(p_info, entry_path, &inode, p_task, NULL,
+                               entry_name);
         if (rc)
             return rc;
     } else {
@@ -890,44 +971,44 @@ static int process_one_entry(thread_scan_info_t *p_info,
 #else
         op->pipeline_stage = entry_proc_descr.GET_INFO_DB;
 #endif
-        ATTR_MASK_INIT(&op->fs_attrs);
+        ATTR_MASK_INIT(op->fs_attrs);
 
-        ATTR_MASK_SET(&op->fs_attrs, parent_id);
-        ATTR(&op->fs_attrs, parent_id) = p_task->dir_id;
+        ATTR_MASK_SET(op->fs_attrs, parent_id);
+        ATTR(op->fs_attrs, parent_id) = p_task->dir_id;
 
-        ATTR_MASK_SET(&op->fs_attrs, name);
-        strcpy(ATTR(&op->fs_attrs, name), entry_name);
+        ATTR_MASK_SET(op->fs_attrs, name);
+        strcpy(ATTR(op->fs_attrs, name), entry_name);
 
-        ATTR_MASK_SET(&op->fs_attrs, fullpath);
-        strcpy(ATTR(&op->fs_attrs, fullpath), entry_path);
+        ATTR_MASK_SET(op->fs_attrs, fullpath);
+        strcpy(ATTR(op->fs_attrs, fullpath), entry_path);
 
 #ifdef ATTR_INDEX_invalid
-        ATTR_MASK_SET(&op->fs_attrs, invalid);
-        ATTR(&op->fs_attrs, invalid) = false;
+        ATTR_MASK_SET(op->fs_attrs, invalid);
+        ATTR(op->fs_attrs, invalid) = false;
 #endif
 
-        ATTR_MASK_SET(&op->fs_attrs, depth);
+        ATTR_MASK_SET(op->fs_attrs, depth);
         /* depth(/<mntpoint>/toto) = 0 */
-        ATTR(&op->fs_attrs, depth) = p_task->depth;
+        ATTR(op->fs_attrs, depth) = p_task->depth;
 
         if (!no_md) {
 #if defined(_LUSTRE) && defined(_MDS_STAT_SUPPORT)
-            stat2rbh_attrs(&inode, &op->fs_attrs,
+            stat2rbh_attrs(&inode, op->fs_attrs,
                            !(is_lustre_fs && global_config.direct_mds_stat));
 #else
-            stat2rbh_attrs(&inode, &op->fs_attrs, true);
+            stat2rbh_attrs(&inode, op->fs_attrs, true);
 #endif
             /* set update time  */
-            ATTR_MASK_SET(&op->fs_attrs, md_update);
-            ATTR(&op->fs_attrs, md_update) = time(NULL);
+            ATTR_MASK_SET(op->fs_attrs, md_update);
+            ATTR(op->fs_attrs, md_update) = time(NULL);
         } else {
             /* must still set it to avoid the entry to be impacted by
              * scan final GC */
-            ATTR_MASK_SET(&op->fs_attrs, md_update);
-            ATTR(&op->fs_attrs, md_update) = time(NULL);
+            ATTR_MASK_SET(op->fs_attrs, md_update);
+            ATTR(op->fs_attrs, md_update) = time(NULL);
         }
-        ATTR_MASK_SET(&op->fs_attrs, path_update);
-        ATTR(&op->fs_attrs, path_update) = time(NULL);
+        ATTR_MASK_SET(op->fs_attrs, path_update);
+        ATTR(op->fs_attrs, path_update) = time(NULL);
 
         /* Set entry id */
 #ifndef _HAVE_FID
@@ -941,22 +1022,16 @@ static int process_one_entry(thread_scan_info_t *p_info,
         op->entry_id_is_set = 0;
 #ifndef _NO_AT_FUNC
         /* get fid from fd, using openat on parent fd */
-        int fd = openat_noatime(parentfd, entry_name, false);
-        if (fd < 0)
-            DisplayLog(LVL_DEBUG, FSSCAN_TAG,
-                       "openat failed on <parent_fd=%d>/%s: %s", parentfd,
-                       entry_name, strerror(errno));
-        else {
-            rc = Lustre_GetFidByFd(fd, &op->entry_id);
-            if (rc)
-                DisplayLog(LVL_DEBUG, FSSCAN_TAG,
-                           "fd2fid failed on <parent_fd=%d>/%s: %s", parentfd,
-                           entry_name, strerror(errno));
-            else {
-                op->entry_id_is_set = 1;
-                op->pipeline_stage = entry_proc_descr.GET_INFO_DB;
-            }
-            close(fd);
+        if (prefetch != NULL && prefetch->fid_fetched) {
+            rc = prefetch->fid_rc;
+            if (rc == 0)
+                op->entry_id = prefetch->fid;
+        } else
+            rc = get_fid_at(parentfd, entry_name, &op->entry_id);
+
+        if (rc == 0) {
+            op->entry_id_is_set = 1;
+            op->pipeline_stage = entry_proc_descr.GET_INFO_DB;
         }
 #endif
 #endif
@@ -983,19 +1058,19 @@ static int process_one_entry(thread_scan_info_t *p_info,
 #ifndef _NO_AT_FUNC
             /* have a dir fd */
             rc = File_GetStripeByDirFd(parentfd, entry_name,
-                                       &ATTR(&op->fs_attrs, stripe_info),
-                                       &ATTR(&op->fs_attrs, stripe_items));
+                                       &ATTR(op->fs_attrs, stripe_info),
+                                       &ATTR(op->fs_attrs, stripe_items));
 #else
             rc = File_GetStripeByPath(entry_path,
-                                      &ATTR(&op->fs_attrs, stripe_info),
-                                      &ATTR(&op->fs_attrs, stripe_items));
+                                      &ATTR(op->fs_attrs, stripe_info),
+                                      &ATTR(op->fs_attrs, stripe_items));
 #endif
             if (rc) {
-                ATTR_MASK_UNSET(&op->fs_attrs, stripe_info);
-                ATTR_MASK_UNSET(&op->fs_attrs, stripe_items);
+                ATTR_MASK_UNSET(op->fs_attrs, stripe_info);
+                ATTR_MASK_UNSET(op->fs_attrs, stripe_items);
             } else {
-                ATTR_MASK_SET(&op->fs_attrs, stripe_info);
-                ATTR_MASK_SET(&op->fs_attrs, stripe_items);
+                ATTR_MASK_SET(op->fs_attrs, stripe_info);
+                ATTR_MASK_SET(op->fs_attrs, stripe_items);
             }
         }
 #endif
@@ -1014,7 +1089,6 @@ static int process_one_entry(thread_scan_info_t *p_info,
 
 /* directory specific types and accessors */
 #ifndef _NO_AT_FUNC
-#define GETDENTS_BUF_SZ 4096
 #define DIR_T int
 #define DIR_FD(_d) (_d)
 #define DIR_ERR(_d) ((_d) < 0)
@@ -1038,13 +1112,256 @@ static inline DIR_T dir_open(const char *path, int pfd, const char *relpath)
 #endif
 }
 
+#ifndef _NO_AT_FUNC
+/**
+ * Check if metadata operations can be performed asynchronously.
+ */
+static inline bool async_md_ops(thread_scan_info_t *p_info)
+{
+    if (p_info->ring == NULL)
+        return false;
+#if defined(_LUSTRE) && defined(_MDS_STAT_SUPPORT)
+    /* direct MDS stat can't be done asynchronously */
+    if (is_lustre_fs && global_config.direct_mds_stat)
+        return false;
+#endif
+    return true;
+}
+
+/** stop using asynchronous operations after an error */
+static void disable_async_md_ops(thread_scan_info_t *p_info, int rc)
+{
+    DisplayLog(LVL_MAJOR, FSSCAN_TAG, "ThrScan-%d: asynchronous operations "
+               "failed (%s): switching to synchronous operations",
+               p_info->index, strerror(-rc));
+    scan_uring_fini(p_info->ring);
+    p_info->ring = NULL;
+}
+
+#ifdef _HAVE_FID
+/**
+ * Get the fid of the (non-directory) entries of a directory chunk,
+ * by opening and closing them asynchronously.
+ */
+static int prefetch_fids(thread_scan_info_t *p_info, int dirfd, char **names,
+                         unsigned int count, entry_prefetch_t *pf)
+{
+    char **open_names;
+    unsigned int *open_idx;
+    int *fds;
+    unsigned int i, nb_open = 0, nb_close = 0;
+    int flags = O_RDONLY | O_NONBLOCK | O_NOFOLLOW;
+    int rc;
+
+    open_names = MemCalloc(count, sizeof(*open_names));
+    open_idx = MemCalloc(count, sizeof(*open_idx));
+    fds = MemCalloc(count, sizeof(*fds));
+    if (!open_names || !open_idx || !fds) {
+        rc = -ENOMEM;
+        goto out;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (pf[i].stat_rc == 0 && !S_ISDIR(pf[i].inode.st_mode)) {
+            open_idx[nb_open] = i;
+            open_names[nb_open] = names[i];
+            nb_open++;
+        }
+    }
+
+    if (noatime_permitted)
+        flags |= O_NOATIME;
+
+    /* fds of operations that do not complete are left unchanged */
+    for (i = 0; i < nb_open; i++)
+        fds[i] = -EINPROGRESS;
+
+    rc = scan_uring_openat(p_info->ring, dirfd, open_names, nb_open, flags,
+                           fds);
+    if (rc) {
+        /* close the files opened before the failure */
+        for (i = 0; i < nb_open; i++)
+            if (fds[i] >= 0)
+                close(fds[i]);
+        goto out;
+    }
+
+    for (i = 0; i < nb_open; i++) {
+        entry_prefetch_t *curr = &pf[open_idx[i]];
+        int fd = fds[i];
+
+        /* O_NOATIME not permitted: retry synchronously (this will also
+         * disable the flag for next operations) */
+        if (fd == -EPERM && (flags & O_NOATIME)) {
+            fd = openat_noatime(dirfd, open_names[i], false);
+            if (fd < 0)
+                fd = -errno;
+        }
+
+        curr->fid_fetched = true;
+        if (fd < 0) {
+            curr->fid_rc = fd;
+            DisplayLog(LVL_DEBUG, FSSCAN_TAG,
+                       "openat failed on <parent_fd=%d>/%s: %s", dirfd,
+                       open_names[i], strerror(-fd));
+            continue;
+        }
+
+        curr->fid_rc = Lustre_GetFidByFd(fd, &curr->fid);
+        if (curr->fid_rc)
+            DisplayLog(LVL_DEBUG, FSSCAN_TAG,
+                       "fd2fid failed on <parent_fd=%d>/%s: %s", dirfd,
+                       open_names[i], strerror(-curr->fid_rc));
+
+        fds[nb_close] = fd;
+        nb_close++;
+    }
+
+    rc = scan_uring_close(p_info->ring, fds, nb_close);
+
+ out:
+    if (fds != NULL)
+        MemFree(fds);
+    if (open_idx != NULL)
+        MemFree(open_idx);
+    if (open_names != NULL)
+        MemFree(open_names);
+    return rc;
+}
+#endif
+
+/**
+ * Process a chunk of directory entries, performing their metadata
+ * operations asynchronously. If asynchronous operations fail,
+ * entries are processed synchronously.
+ * @return 0 on success, -ECANCELED if the scan was requested to stop.
+ */
+static int process_entries_async(thread_scan_info_t *p_info,
+                                 robinhood_task_t *p_task, int dirfd,
+                                 char **names, unsigned int count,
+                                 unsigned int *nb_errors)
+{
+    entry_prefetch_t *pf = NULL;
+    struct stat *inodes = NULL;
+    int *stat_rcs = NULL;
+    bool prefetched = false;
+    unsigned int i;
+    int rc;
+
+    pf = MemCalloc(count, sizeof(*pf));
+    inodes = MemCalloc(count, sizeof(*inodes));
+    stat_rcs = MemCalloc(count, sizeof(*stat_rcs));
+    if (!pf || !inodes || !stat_rcs) {
+        rc = -ENOMEM;
+        goto sync;
+    }
+
+    rc = scan_uring_fstatat(p_info->ring, dirfd, names, count, inodes,
+                            stat_rcs);
+    if (rc) {
+        disable_async_md_ops(p_info, rc);
+        goto sync;
+    }
+
+    for (i = 0; i < count; i++) {
+        pf[i].inode = inodes[i];
+        pf[i].stat_rc = stat_rcs[i];
+    }
+    prefetched = true;
+
+    /* notify current activity */
+    p_info->last_action = time(NULL);
+
+#ifdef _HAVE_FID
+    rc = prefetch_fids(p_info, dirfd, names, count, pf);
+    if (rc) {
+        disable_async_md_ops(p_info, rc);
+        /* fids that were not retrieved will be retrieved synchronously */
+    }
+    /* notify current activity */
+    p_info->last_action = time(NULL);
+#endif
+
+ sync:
+    for (i = 0; i < count; i++) {
+        /* break ASAP if requested */
+        if (p_info->force_stop) {
+            DisplayLog(LVL_EVENT, FSSCAN_TAG, "Stop requested: "
+                       "cancelling directory scan operation "
+                       "(in '%s')", p_task->path);
+            rc = -ECANCELED;
+            goto out;
+        }
+
+        if (process_one_entry(p_info, p_task, names[i], dirfd,
+                              prefetched ? &pf[i] : NULL))
+            (*nb_errors)++;
+    }
+    rc = 0;
+
+ out:
+    if (stat_rcs != NULL)
+        MemFree(stat_rcs);
+    if (inodes != NULL)
+        MemFree(inodes);
+    if (pf != NULL)
+        MemFree(pf);
+    return rc;
+}
+
+/**
+ * Allocate the buffer for reading directory entries,
+ * according to getdents_buffer_size parameter.
+ */
+static int alloc_dirent_buf(thread_scan_info_t *p_info)
+{
+    size_t size = fs_scan_config.getdents_buffer_size;
+
+    if (p_info->dirent_buf != NULL && p_info->dirent_buf_size == size)
+        return 0;
+
+    if (p_info->dirent_buf != NULL) {
+        MemFree(p_info->dirent_buf);
+        MemFree(p_info->dirent_names);
+    }
+
+    p_info->dirent_buf = MemAlloc(size);
+    /* max number of entries in the buffer */
+    p_info->dirent_names = MemCalloc(size / (offsetof(struct dirent64, d_name)
+                                             + 2) + 1, sizeof(char *));
+    if (p_info->dirent_buf == NULL || p_info->dirent_names == NULL) {
+        if (p_info->dirent_buf != NULL)
+            MemFree(p_info->dirent_buf);
+        if (p_info->dirent_names != NULL)
+            MemFree(p_info->dirent_names);
+        p_info->dirent_buf = NULL;
+        p_info->dirent_names = NULL;
+        p_info->dirent_buf_size = 0;
+        return -ENOMEM;
+    }
+    p_info->dirent_buf_size = size;
+    return 0;
+}
+
+static void free_dirent_buf(thread_scan_info_t *p_info)
+{
+    if (p_info->dirent_buf == NULL)
+        return;
+
+    MemFree(p_info->dirent_buf);
+    MemFree(p_info->dirent_names);
+    p_info->dirent_buf = NULL;
+    p_info->dirent_names = NULL;
+    p_info->dirent_buf_size = 0;
+}
+#endif
+
 static int process_one_dir(robinhood_task_t *p_task,
                            thread_scan_info_t *p_info,
                            unsigned int *nb_entries, unsigned int *nb_errors)
 {
     DIR_T dirp;
 #ifndef _NO_AT_FUNC
-    char dirent_buf[GETDENTS_BUF_SZ];
     struct dirent64 *direntry = NULL;
 #else
     struct dirent direntry;
@@ -1054,6 +1371,17 @@ static int process_one_dir(robinhood_task_t *p_task,
 
     (*nb_entries) = 0;
 
+#ifndef _NO_AT_FUNC
+    rc = alloc_dirent_buf(p_info);
+    if (rc) {
+        DisplayLog(LVL_CRIT, FSSCAN_TAG,
+                   "Failed to allocate buffer for reading directory %s",
+                   p_task->path);
+        (*nb_errors)++;
+        return rc;
+    }
+#endif
+
     /* hearbeat before opendir */
     p_info->last_action = time(NULL);
 
@@ -1078,18 +1406,20 @@ static int process_one_dir(robinhood_task_t *p_task,
     p_info->last_action = time(NULL);
 
 #ifndef _NO_AT_FUNC
-    /* scan directory entries by chunk of 4k */
-    direntry = (struct dirent64 *)dirent_buf;
-    while ((rc = syscall(SYS_getdents64, dirp, direntry, GETDENTS_BUF_SZ))
-                    > 0) {
+    /* scan directory entries by chunk of getdents_buffer_size */
+    direntry = (struct dirent64 *)p_info->dirent_buf;
+    while ((rc = syscall(SYS_getdents64, dirp, direntry,
+                         p_info->dirent_buf_size)) > 0) {
         off_t bytepos;
         struct dirent64 *dp;
+        unsigned int nb_names = 0;
+        bool async = async_md_ops(p_info);
 
         /* notify current activity */
         p_info->last_action = time(NULL);
 
         for (bytepos = 0; bytepos < rc;) {
-            dp = (struct dirent64 *)(dirent_buf + bytepos);
+            dp = (struct dirent64 *)(p_info->dirent_buf + bytepos);
             bytepos += dp->d_reclen;
 
             /* break ASAP if requested */
@@ -1105,10 +1435,24 @@ static int process_one_dir(robinhood_task_t *p_task,
 
             (*nb_entries)++;
 
+            /* entries are processed after the whole chunk is read */
+            if (async) {
+                p_info->dirent_names[nb_names] = dp->d_name;
+                nb_names++;
+                continue;
+            }
+
             /* Handle filesystem entry. */
-            if (process_one_entry(p_info, p_task, dp->d_name, DIR_FD(dirp)))
+            if (process_one_entry(p_info, p_task, dp->d_name, DIR_FD(dirp),
+                                  NULL))
                 (*nb_errors)++;
         }
+
+        if (nb_names > 0
+            && process_entries_async(p_info, p_task, DIR_FD(dirp),
+                                     p_info->dirent_names, nb_names,
+                                     nb_errors) == -ECANCELED)
+            return -ECANCELED;
     }
     /* rc == 0 => end of dir */
     if (rc < 0) {
@@ -1151,7 +1495,8 @@ static int process_one_dir(robinhood_task_t *p_task,
 #endif
 
         /* Handle filesystem entry. */
-        if (process_one_entry(p_info, p_task, direntry.d_name, dirfd(dirp)))
+        if (process_one_entry(p_info, p_task, direntry.d_name, dirfd(dirp),
+                              NULL))
             (*nb_errors)++;
 
     }   /* end of dir */
@@ -1163,7 +1508,8 @@ static int process_one_dir(robinhood_task_t *p_task,
  * If scan is restricted to a list of subdirectories, create 1 task
  * per subdirectory.
  */
-static int push_dir_list(robinhood_task_t *parent_task)
+static int push_dir_list(thread_scan_info_t *p_info,
+                         robinhood_task_t *parent_task)
 {
     int i, rc;
 
@@ -1210,7 +1556,7 @@ static int push_dir_list(robinhood_task_t *parent_task)
         DisplayLog(LVL_FULL, FSSCAN_TAG, "Pushing dir '%s' to reach "
                    "sub-tree '%s'", new_task_path, fs_scan_config.dir_list[i]);
 
-        rc = create_child_task(new_task_path, &inode,
+        rc = create_child_task(p_info, new_task_path, &inode,
                                parent_task, fs_scan_config.dir_list[i], NULL);
         free(new_task_path);
         if (rc)
@@ -1289,7 +1635,7 @@ static int process_one_task(robinhood_task_t *p_task,
         DisplayLog(LVL_DEBUG, FSSCAN_TAG, "Partial scan: processing '%s' in %s",
                    name, p_task->path);
 
-        rc = process_one_entry(p_info, p_task, name, -1);
+        rc = process_one_entry(p_info, p_task, name, -1, NULL);
         if (rc) {
             (*nb_errors)++;
             return rc;
@@ -1297,7 +1643,7 @@ static int process_one_task(robinhood_task_t *p_task,
     } else if (p_task->depth == 0 && fs_scan_config.dir_count > 0) {
         /* If scan is restricted to subdirectories, create child tasks under
          * mother task */
-        rc = push_dir_list(p_task);
+        rc = push_dir_list(p_info, p_task);
         if (rc) {
             (*nb_errors)++;
             return rc;
@@ -1335,7 +1681,7 @@ static int process_one_task(robinhood_task_t *p_task,
                 return -ENOMEM;
             }
 
-            ATTR_MASK_INIT(&op->fs_attrs);
+            ATTR_MASK_INIT(op->fs_attrs);
 
             /* set entry ID */
             op->entry_id = p_task->dir_id;
@@ -1351,47 +1697,47 @@ static int process_one_task(robinhood_task_t *p_task,
 
 #ifndef _BENCH_DB
             if (p_task->parent_task) {
-                ATTR_MASK_SET(&op->fs_attrs, parent_id);
-                ATTR(&op->fs_attrs, parent_id) = p_task->parent_task->dir_id;
+                ATTR_MASK_SET(op->fs_attrs, parent_id);
+                ATTR(op->fs_attrs, parent_id) = p_task->parent_task->dir_id;
             }
 #else
-            ATTR_MASK_SET(&op->fs_attrs, parent_id);
-            ATTR(&op->fs_attrs, parent_id) = p_task->dir_id;
+            ATTR_MASK_SET(op->fs_attrs, parent_id);
+            ATTR(op->fs_attrs, parent_id) = p_task->dir_id;
 #endif
 
-            ATTR_MASK_SET(&op->fs_attrs, name);
-            rh_strncpy(ATTR(&op->fs_attrs, name), rh_basename(p_task->path),
+            ATTR_MASK_SET(op->fs_attrs, name);
+            rh_strncpy(ATTR(op->fs_attrs, name), rh_basename(p_task->path),
                        RBH_NAME_MAX);
 #ifdef _BENCH_DB
-            sprintf(ATTR(&op->fs_attrs, name) +
-                    strlen(ATTR(&op->fs_attrs, name)), "%d", i);
+            sprintf(ATTR(op->fs_attrs, name) +
+                    strlen(ATTR(op->fs_attrs, name)), "%d", i);
 #endif
 
-            ATTR_MASK_SET(&op->fs_attrs, fullpath);
-            strcpy(ATTR(&op->fs_attrs, fullpath), p_task->path);
+            ATTR_MASK_SET(op->fs_attrs, fullpath);
+            strcpy(ATTR(op->fs_attrs, fullpath), p_task->path);
 #ifdef _BENCH_DB
-            sprintf(ATTR(&op->fs_attrs, fullpath) +
-                    strlen(ATTR(&op->fs_attrs, fullpath)), "%d", i);
+            sprintf(ATTR(op->fs_attrs, fullpath) +
+                    strlen(ATTR(op->fs_attrs, fullpath)), "%d", i);
 #endif
 
 #ifdef ATTR_INDEX_invalid
-            ATTR_MASK_SET(&op->fs_attrs, invalid);
-            ATTR(&op->fs_attrs, invalid) = false;
+            ATTR_MASK_SET(op->fs_attrs, invalid);
+            ATTR(op->fs_attrs, invalid) = false;
 #endif
 
-            ATTR_MASK_SET(&op->fs_attrs, depth);
+            ATTR_MASK_SET(op->fs_attrs, depth);
             /* depth(/tmp/toto) = 0 */
-            ATTR(&op->fs_attrs, depth) = p_task->depth - 1;
+            ATTR(op->fs_attrs, depth) = p_task->depth - 1;
 
-            ATTR_MASK_SET(&op->fs_attrs, dircount);
-            ATTR(&op->fs_attrs, dircount) = *nb_entries;
+            ATTR_MASK_SET(op->fs_attrs, dircount);
+            ATTR(op->fs_attrs, dircount) = *nb_entries;
 
 #ifndef _BENCH_PIPELINE
 #if defined(_LUSTRE) && defined(_MDS_STAT_SUPPORT)
-            stat2rbh_attrs(&p_task->dir_md, &op->fs_attrs,
+            stat2rbh_attrs(&p_task->dir_md, op->fs_attrs,
                            !(is_lustre_fs && global_config.direct_mds_stat));
 #else
-            stat2rbh_attrs(&p_task->dir_md, &op->fs_attrs, true);
+            stat2rbh_attrs(&p_task->dir_md, op->fs_attrs, true);
 #endif
 #endif
 
@@ -1399,29 +1745,29 @@ static int process_one_task(robinhood_task_t *p_task,
             /* generate cyclic owner, group, type, size, ... */
             unsigned int u = (i + 17) % 137;
             if (global_config.uid_gid_as_numbers) {
-                ATTR(&op->fs_attrs, uid).num = u;
-                ATTR(&op->fs_attrs, gid).num = u/8;
+                ATTR(op->fs_attrs, uid).num = u;
+                ATTR(op->fs_attrs, gid).num = u/8;
             } else {
-                sprintf(ATTR(&op->fs_attrs, uid).txt, "user%u", u);
+                sprintf(ATTR(op->fs_attrs, uid).txt, "user%u", u);
                 /* 8 user per group */
-                sprintf(ATTR(&op->fs_attrs, gid).txt, "group%u", u/8);
+                sprintf(ATTR(op->fs_attrs, gid).txt, "group%u", u/8);
             }
             switch (i % 2) {
             case 0:
-                strcpy(ATTR(&op->fs_attrs, type), STR_TYPE_DIR);
+                strcpy(ATTR(op->fs_attrs, type), STR_TYPE_DIR);
                 break;
             case 1:
-                strcpy(ATTR(&op->fs_attrs, type), STR_TYPE_FILE);
+                strcpy(ATTR(op->fs_attrs, type), STR_TYPE_FILE);
                 break;
             }
-            ATTR(&op->fs_attrs, size) = ((i % 311) * 1493);
+            ATTR(op->fs_attrs, size) = ((i % 311) * 1493);
 
             p_info->entries_handled++;
 #endif
             /* set update time  */
-            ATTR_MASK_SET(&op->fs_attrs, md_update);
-            ATTR_MASK_SET(&op->fs_attrs, path_update);
-            ATTR(&op->fs_attrs, md_update) = ATTR(&op->fs_attrs, path_update)
+            ATTR_MASK_SET(op->fs_attrs, md_update);
+            ATTR_MASK_SET(op->fs_attrs, path_update);
+            ATTR(op->fs_attrs, md_update) = ATTR(op->fs_attrs, path_update)
                 = time(NULL);
 
             op->extra_info_is_set = 0;
@@ -1463,6 +1809,26 @@ static void *Thr_scan(void *arg_thread)
     }
 #endif
 
+#ifndef _NO_AT_FUNC
+    /* context left by a terminated thread */
+    if (p_info->ring != NULL) {
+        scan_uring_fini(p_info->ring);
+        p_info->ring = NULL;
+    }
+
+    if (fs_scan_config.scan_queue_depth > 0) {
+        rc = scan_uring_init(&p_info->ring, fs_scan_config.scan_queue_depth);
+        if (rc)
+            DisplayLog(LVL_EVENT, FSSCAN_TAG, "ThrScan-%d: asynchronous "
+                       "operations are not available (%s): using synchronous "
+                       "operations", p_info->index, strerror(-rc));
+        else
+            DisplayLog(LVL_DEBUG, FSSCAN_TAG, "ThrScan-%d: using asynchronous "
+                       "operations (queue depth=%u)", p_info->index,
+                       fs_scan_config.scan_queue_depth);
+    }
+#endif
+
     while (!p_info->force_stop) {
         int task_rc;
 
@@ -1470,7 +1836,7 @@ static void *Thr_scan(void *arg_thread)
                    p_info->index);
 
         /* take a task from queue */
-        p_task = GetTask_from_Stack(&tasks_stack);
+        p_task = GetTask_from_Stack(&tasks_stack, p_info->index);
 
         /* skip it if the thread was requested to stop */
         if (p_info->force_stop)
@@ -1532,6 +1898,12 @@ static void *Thr_scan(void *arg_thread)
 
     p_info->current_task = NULL;
 
+#ifndef _NO_AT_FUNC
+    scan_uring_fini(p_info->ring);
+    p_info->ring = NULL;
+    free_dirent_buf(p_info);
+#endif
+
     /* check scan termination status */
     if (all_threads_idle())
         signal_scan_finished();
@@ -1539,6 +1911,74 @@ static void *Thr_scan(void *arg_thread)
     return NULL;
 }
 
+/**
+ * If the removal of old entries at the end of a previous scan was
+ * interrupted, push it again to the pipeline, so it resumes from its last
+ * cursor. Entries updated since then have a greater md_update,
+ * so they are not affected.
+ */
+static void resume_pending_gc(void)
+{
+    char value[MAX_VAR_LEN];
+    char root[MAX_VAR_LEN];
+    unsigned long md_update;
+    unsigned int gc_entries, gc_names;
+    entry_proc_op_t *op;
+    lmgr_t lmgr;
+    int rc;
+
+    if (fsscan_nogc)
+        return;
+
+    if (ListMgr_InitAccess(&lmgr) != DB_SUCCESS)
+        return;
+
+    rc = ListMgr_GetVar(&lmgr, LAST_SCAN_GC_PENDING, value, sizeof(value));
+    ListMgr_CloseAccess(&lmgr);
+    if (rc != DB_SUCCESS)
+        return;
+
+    root[0] = '\0';
+    if (sscanf(value, "%lu:%u:%u:%1023[^\n]", &md_update, &gc_entries,
+               &gc_names, root) < 3) {
+        DisplayLog(LVL_MAJOR, FSSCAN_TAG,
+                   "Invalid value for " LAST_SCAN_GC_PENDING ": '%s'", value);
+        return;
+    }
+
+    op = EntryProcessor_Get();
+    if (!op) {
+        DisplayLog(LVL_CRIT, FSSCAN_TAG,
+                   "CRITICAL ERROR: Failed to allocate a new op");
+        return;
+    }
+
+    op->pipeline_stage = entry_proc_descr.GC_OLDENT;
+    op->callback_func = NULL;
+    op->callback_param = NULL;
+
+    ATTR_MASK_INIT(op->fs_attrs);
+    op->gc_entries = gc_entries;
+    op->gc_names = gc_names;
+    ATTR_MASK_SET(op->fs_attrs, md_update);
+    ATTR(op->fs_attrs, md_update) = md_update;
+
+    if (!EMPTY_STRING(root)) {
+        ATTR_MASK_SET(op->fs_attrs, fullpath);
+        rh_strncpy(ATTR(op->fs_attrs, fullpath), root, RBH_PATH_MAX);
+    }
+
+    DisplayLog(LVL_EVENT, FSSCAN_TAG,
+               "Resuming removal of entries not seen by the scan started "
+               "at %lu", md_update);
+
+#ifndef _BENCH_SCAN
+    EntryProcessor_Push(op);
+#else
+    EntryProcessor_Release(op);
+#endif
+}
+
 /**
  * Audit module initialization
  * (called at deamon startup)
@@ -1567,7 +2007,7 @@ int Robinhood_InitScanModule(void)
 
     /* initializing task stack */
 
-    st = InitTaskStack(&tasks_stack);
+    st = InitTaskStack(&tasks_stack, fs_scan_config.nb_threads_scan);
     if (st)
         return st;
 
@@ -1619,6 +2059,8 @@ int Robinhood_InitScanModule(void)
         }
     }
 
+    resume_pending_gc();
+
     return 0;
 
 }
@@ -1771,9 +2213,23 @@ static int StartScan(void)
                        "%" PRIu64 " entries in DB before starting the scan",
                        count);
 
+        /* load the entries of a full initial scan by large blocks */
+        if (is_first_scan && !partial_scan_root
+            && fs_scan_config.initial_bulk_load && !fsscan_nobulk
+            && ListMgr_BulkLoadStart(&lmgr) != DB_SUCCESS)
+            DisplayLog(LVL_MAJOR, FSSCAN_TAG, "Failed to start bulk load of "
+                       "the database: using regular inserts");
+
         ListMgr_CloseAccess(&lmgr);
     }
 
+    /* full scans can record unchanged entries in memory instead of updating
+     * them in the DB (only if old entries are removed at the end) */
+    if (!fsscan_nogc && !is_first_scan && !partial_scan_root)
+        use_seen_set = EntryProcessor_SeenSetStart();
+    else
+        use_seen_set = false;
+
     /* reset threads stats */
     ResetScanStats(false);
 
@@ -1783,8 +2239,8 @@ static int StartScan(void)
     /* start batching alerts */
     Alert_StartBatching();
 
-    /* insert first task in stack */
-    InsertTask_to_Stack(&tasks_stack, p_parent_task);
+    /* insert first task in stack (any thread can steal it) */
+    InsertTask_to_Stack(&tasks_stack, 0, p_parent_task);
 
     /* indicates that a scan started in logs */
     FlushLogs();
@@ -2129,6 +2585,8 @@ void Robinhood_StatsScan(robinhood_fsscan_stat_t *p_stats)
 
         p_stats->last_action = last_action;
 
+        TaskStackStats(&tasks_stack, &p_stats->nb_steals, &p_stats->nb_idle);
+
         /* avg speed */
         if (p_stats->scanned_entries)
             p_stats->avg_ms_per_entry =
@@ -2154,10 +2612,14 @@ void Robinhood_StatsScan(robinhood_fsscan_stat_t *p_stats)
         p_stats->error_count = 0;
         p_stats->avg_ms_per_entry = 0.0;
         p_stats->curr_ms_per_entry = 0.0;
+        p_stats->nb_steals = 0;
+        p_stats->nb_idle = 0;
     }
 
     p_stats->nb_hang = nb_hang_total;
 
     V(lock_scan);
 
+    EntryProcessor_GetGCProgress(&p_stats->gc);
+
 }
@@ -24,6 +24,7 @@
 
 #include "fs_scan_types.h"
 #include "fs_scan_main.h"
+#include "entry_processor.h"
 
 /* defined in fs_scan.c */
 extern fs_scan_config_t  fs_scan_config;
@@ -52,6 +53,13 @@ typedef struct robinhood_fsscan_stat__ {
     double          avg_ms_per_entry;
     double          curr_ms_per_entry;
 
+    /* task scheduling */
+    unsigned long long nb_steals;   /* tasks stolen by idle threads */
+    unsigned long long nb_idle;     /* waits of threads for a task */
+
+    /* removal of entries not seen by the scan */
+    gc_progress_t   gc;
+
 } robinhood_fsscan_stat_t;
 
 /**
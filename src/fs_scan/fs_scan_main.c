@@ -222,6 +222,18 @@ void FSScan_DumpStats(void)
                                                                   start_time),
                            stats.avg_ms_per_entry);
         }
+
+        DisplayLog(LVL_MAJOR, "STATS",
+                   "     scheduling : %llu tasks stolen, %llu idle waits",
+                   stats.nb_steals, stats.nb_idle);
+    }
+
+    if (stats.gc.running) {
+        FormatDurationFloat(tmp_buff, 256, time(NULL) - stats.gc.start_time);
+        DisplayLog(LVL_MAJOR, "STATS",
+                   "removing old entries: %llu entries removed "
+                   "(%u ranges in %s)", stats.gc.nb_removed,
+                   stats.gc.nb_ranges, tmp_buff);
     }
 
     if (stats.nb_hang > 0)
@@ -258,6 +270,9 @@ static void fs_scan_cfg_set_default(void *module_config)
     conf->exit_on_timeout = false;
     conf->spooler_check_interval = MINUTE;
     conf->nb_prealloc_tasks = 256;
+    conf->getdents_buffer_size = 4096;
+    conf->scan_queue_depth = 0;
+    conf->initial_bulk_load = true;
 
     conf->ignore_list = NULL;
     conf->ignore_count = 0;
@@ -281,6 +296,9 @@ static void fs_scan_cfg_write_default(FILE *output)
     print_line(output, 1, "exit_on_timeout        :    no");
     print_line(output, 1, "spooler_check_interval :  1min");
     print_line(output, 1, "nb_prealloc_tasks      :   256");
+    print_line(output, 1, "getdents_buffer_size   :    4KB");
+    print_line(output, 1, "scan_queue_depth       :     0 (synchronous)");
+    print_line(output, 1, "initial_bulk_load      :   yes");
     print_line(output, 1, "ignore                 :  NONE");
     print_line(output, 1, "dir_list               :  NONE");
     print_line(output, 1, "completion_command     :  NONE");
@@ -340,8 +358,8 @@ static int fs_scan_cfg_read(config_file_t config, void *module_config,
         "scan_interval", "min_scan_interval", "max_scan_interval",
         "scan_retry_delay", "nb_threads_scan", "scan_op_timeout",
         "exit_on_timeout", "spooler_check_interval", "nb_prealloc_tasks",
-        "completion_command", "scan_only",
-        IGNORE_BLOCK, NULL
+        "completion_command", "scan_only", "getdents_buffer_size",
+        "scan_queue_depth", "initial_bulk_load", IGNORE_BLOCK, NULL
     };
 
     const cfg_param_t cfg_params[] = {
@@ -356,6 +374,11 @@ static int fs_scan_cfg_read(config_file_t config, void *module_config,
          &conf->spooler_check_interval, 0},
         {"nb_prealloc_tasks", PT_INT, PFLG_POSITIVE | PFLG_NOT_NULL,
          &conf->nb_prealloc_tasks, 0},
+        {"getdents_buffer_size", PT_SIZE, PFLG_POSITIVE | PFLG_NOT_NULL,
+         &conf->getdents_buffer_size, 0},
+        {"scan_queue_depth", PT_INT, PFLG_POSITIVE,
+         &conf->scan_queue_depth, 0},
+        {"initial_bulk_load", PT_BOOL, 0, &conf->initial_bulk_load, 0},
         /* completion command can contain wildcards: {cfg}, {fspath} ... */
         {"completion_command", PT_CMD, 0,
          &conf->completion_command, 0},
@@ -373,6 +396,12 @@ static int fs_scan_cfg_read(config_file_t config, void *module_config,
     if (rc)
         return rc;
 
+    /* must be large enough for any directory entry */
+    if (conf->getdents_buffer_size < 1024) {
+        strcpy(msg_out, "getdents_buffer_size must be at least 1KB");
+        return EINVAL;
+    }
+
     /* parameters with specific management */
     rc = GetDurationParam(fsscan_block, FSSCAN_CONFIG_BLOCK,
                           "min_scan_interval", PFLG_POSITIVE | PFLG_NOT_NULL,
@@ -577,6 +606,23 @@ static int fs_scan_cfg_reload(fs_scan_config_t *conf)
         fs_scan_config.spooler_check_interval = conf->spooler_check_interval;
     }
 
+    if (conf->getdents_buffer_size != fs_scan_config.getdents_buffer_size) {
+        DisplayLog(LVL_EVENT, "FS_Scan_Config",
+                   FSSCAN_CONFIG_BLOCK
+                   "::getdents_buffer_size updated: %llu->%llu",
+                   fs_scan_config.getdents_buffer_size,
+                   conf->getdents_buffer_size);
+        fs_scan_config.getdents_buffer_size = conf->getdents_buffer_size;
+    }
+
+    if (conf->initial_bulk_load != fs_scan_config.initial_bulk_load) {
+        DisplayLog(LVL_EVENT, "FS_Scan_Config",
+                   FSSCAN_CONFIG_BLOCK "::initial_bulk_load updated: %s->%s",
+                   bool2str(fs_scan_config.initial_bulk_load),
+                   bool2str(conf->initial_bulk_load));
+        fs_scan_config.initial_bulk_load = conf->initial_bulk_load;
+    }
+
     if (compare_cmd
         (conf->completion_command, fs_scan_config.completion_command)) {
         DisplayLog(LVL_MAJOR, "FS_Scan_Config",
@@ -598,6 +644,11 @@ static int fs_scan_cfg_reload(fs_scan_config_t *conf)
                    FSSCAN_CONFIG_BLOCK
                    "::nb_prealloc_tasks changed in config file, but cannot be modified dynamically");
 
+    if (conf->scan_queue_depth != fs_scan_config.scan_queue_depth)
+        DisplayLog(LVL_MAJOR, "FS_Scan_Config",
+                   FSSCAN_CONFIG_BLOCK
+                   "::scan_queue_depth changed in config file, but cannot be modified dynamically");
+
     /* compare ignore list */
     update_ignore(fs_scan_config.ignore_list, fs_scan_config.ignore_count,
                   conf->ignore_list, conf->ignore_count, FSSCAN_CONFIG_BLOCK);
@@ -666,6 +717,22 @@ static void fs_scan_cfg_write_template(FILE *output)
     print_line(output, 1, "# Memory preallocation parameters");
     print_line(output, 1, "nb_prealloc_tasks      =   256 ;");
     fprintf(output, "\n");
+    print_line(output, 1, "# size of the buffer for reading directory entries");
+    print_line(output, 1, "#getdents_buffer_size   =   64KB ;");
+    print_line(output, 1,
+               "# max pending metadata operations (stat, open...) per scan thread,");
+    print_line(output, 1,
+               "# using io_uring (if available). 0 = synchronous operations.");
+    print_line(output, 1, "#scan_queue_depth       =    32 ;");
+    fprintf(output, "\n");
+    print_line(output, 1,
+               "# load the entries of the first scan of an empty database by large");
+    print_line(output, 1,
+               "# blocks, and build secondary indexes at the end of the scan");
+    print_line(output, 1,
+               "# (not if changelogs are processed by the same command)");
+    print_line(output, 1, "#initial_bulk_load      =   yes ;");
+    fprintf(output, "\n");
     print_begin_block(output, 1, IGNORE_BLOCK, NULL);
     print_line(output, 2,
                "# ignore \".snapshot\" and \".snapdir\" directories (don't scan them)");
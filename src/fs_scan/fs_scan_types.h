@@ -74,32 +74,46 @@ typedef struct robinhood_task__ {
 
 /* This pointer is used in 2 ways, depending
    * on the structure status :
-   * - for chaining tasks in the scheduler (in a task_stack_t)
+   * - for chaining tasks in the scheduler (in a task_deque_t)
    * - for chaining free structs in the pool manager
    */
     struct robinhood_task__ *next_task;
+    /* previous task in the scheduler deque */
+    struct robinhood_task__ *prev_task;
 
 } robinhood_task_t;
 
-/* We define a maximum value for ordering tasks into the stack,
- * but we however handle cases when it's over.
- * (we will consider that all the tasks over this limit
- * have the same prority)
- */
-#define MAX_TASK_DEPTH  255
-
-/* A stack of tasks ordered by depth,
+/* A deque of tasks owned by a scan thread,
  * handled by 'task_stack_mngmt' routines.
+ * The owner thread inserts and takes tasks at the head, so its scan
+ * is 'depth first'. Other threads steal tasks at the tail.
  */
+typedef struct task_deque__ {
+    pthread_mutex_t     deque_lock;
+
+    robinhood_task_t   *head;   /* last inserted task */
+    robinhood_task_t   *tail;   /* first inserted task */
+    unsigned int        count;
+
+    /* statistics (updated by the owner thread, reset by other threads:
+     * only accessed with atomic operations) */
+    unsigned long long  nb_steals;  /* tasks stolen from other threads */
+    unsigned long long  nb_idle;    /* waits for a task */
+
+} task_deque_t;
+
+/* The set of task deques of the scan threads. */
 typedef struct tasks_stack__ {
-    pthread_mutex_t     stack_lock; /* lock on the stack */
-    sem_t               sem_tasks;  /* token for available tasks */
+    unsigned int        nb_deques;
+    task_deque_t       *deques;
 
-    /* Indicates the depth for the first task available */
-    unsigned int        max_task_depth;
+    /* incremented each time a task is inserted */
+    unsigned int        insert_seq;
 
-    /* list of tasks, ordered by depth */
-    robinhood_task_t   *tasks_at_depth[MAX_TASK_DEPTH + 1];
+    /* idle threads wait for new tasks on this condition */
+    pthread_mutex_t     idle_lock;
+    pthread_cond_t      idle_cond;
+    unsigned int        nb_waiting;
 
 } task_stack_t;
 
@@ -0,0 +1,341 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * vim:expandtab:shiftwidth=4:tabstop=4:
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the CeCILL License.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL license (http://www.cecill.info) and that you
+ * accept its terms.
+ */
+/**
+ * Asynchronous metadata operations for FS scan, using io_uring.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "scan_uring.h"
+#include "Memory.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef HAVE_LIBURING
+
+#include <liburing.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/sysmacros.h>
+
+struct scan_uring {
+    struct io_uring ring;
+    unsigned int    depth;
+
+    /* buffers for statx results */
+    struct statx   *stx;
+    unsigned int    stx_count;
+};
+
+/** arguments of the operations of a batch */
+struct batch_args {
+    int             dirfd;
+    char          **names;
+    int             flags;
+    const int      *fds;
+    struct statx   *stx;
+    bool            opens;  /* operations return file descriptors */
+};
+
+/** prepare the submission of the idx-th operation of a batch */
+typedef void (*prep_func_t) (struct io_uring_sqe *sqe, unsigned int idx,
+                             const struct batch_args *args);
+
+/** max retries of a busy ring when waiting for in-flight operations */
+#define DRAIN_MAX_RETRY 1000
+
+/** reap available completions, return their count */
+static unsigned int reap_batch(scan_uring_t *r, int *res)
+{
+    struct io_uring_cqe *cqe;
+    unsigned int head;
+    unsigned int nb_reaped = 0;
+
+    io_uring_for_each_cqe(&r->ring, head, cqe) {
+        res[(uintptr_t)io_uring_cqe_get_data(cqe)] = cqe->res;
+        nb_reaped++;
+    }
+    io_uring_cq_advance(&r->ring, nb_reaped);
+    return nb_reaped;
+}
+
+/**
+ * After an error, wait for the operations of a batch that are still in
+ * flight: their completions must not be reaped by the next batch, and the
+ * kernel may still write to their buffers. Their results are discarded
+ * (file descriptors are closed).
+ * @return false if some operations could not be waited for.
+ */
+static bool drain_batch(scan_uring_t *r, const struct batch_args *args,
+                        unsigned int submitted, unsigned int completed)
+{
+    unsigned int retry = 0;
+
+    while (completed < submitted) {
+        struct io_uring_cqe *cqe;
+        unsigned int head;
+        unsigned int nb_reaped = 0;
+        int rc;
+
+        io_uring_for_each_cqe(&r->ring, head, cqe) {
+            if (args->opens && cqe->res >= 0)
+                close(cqe->res);
+            nb_reaped++;
+        }
+        io_uring_cq_advance(&r->ring, nb_reaped);
+        completed += nb_reaped;
+        if (completed >= submitted)
+            break;
+
+        /* also submits the operations that were not */
+        rc = io_uring_submit_and_wait(&r->ring, 1);
+        if (rc == -EINTR)
+            continue;
+        if ((rc == -EAGAIN || rc == -EBUSY) && retry++ < DRAIN_MAX_RETRY)
+            continue;
+        if (rc < 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Run a batch of count operations, with at most 'depth' pending
+ * operations at a time.
+ * @param[out] res result of each operation (unchanged for operations that
+ *                 did not complete, in case of error).
+ */
+static int run_batch(scan_uring_t *r, unsigned int count, prep_func_t prep,
+                     const struct batch_args *args, int *res)
+{
+    unsigned int submitted = 0;
+    unsigned int completed = 0;
+
+    while (completed < count) {
+        int rc;
+
+        /* queue as many operations as the queue depth allows */
+        while (submitted < count && submitted - completed < r->depth) {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&r->ring);
+
+            if (sqe == NULL)
+                break;
+
+            prep(sqe, submitted, args);
+            io_uring_sqe_set_data(sqe, (void *)(uintptr_t)submitted);
+            submitted++;
+        }
+
+        rc = io_uring_submit_and_wait(&r->ring, 1);
+        if (rc == -EINTR)
+            continue;
+
+        /* on error, still report the operations that completed */
+        completed += reap_batch(r, res);
+
+        if (rc < 0) {
+            if (!drain_batch(r, args, submitted, completed)) {
+                /* the kernel may still write statx results: never
+                 * release or reuse these buffers */
+                r->stx = NULL;
+                r->stx_count = 0;
+            }
+            return rc;
+        }
+    }
+    return 0;
+}
+
+int scan_uring_init(scan_uring_t **p_ring, unsigned int depth)
+{
+    struct io_uring_probe *probe;
+    scan_uring_t *r;
+    bool supported;
+    int rc;
+
+    *p_ring = NULL;
+
+    if (depth == 0)
+        return -EINVAL;
+
+    /* check the kernel supports the needed operations */
+    probe = io_uring_get_probe();
+    if (probe == NULL)
+        return -ENOSYS;
+
+    supported = io_uring_opcode_supported(probe, IORING_OP_STATX)
+        && io_uring_opcode_supported(probe, IORING_OP_OPENAT)
+        && io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+    io_uring_free_probe(probe);
+
+    if (!supported)
+        return -ENOSYS;
+
+    r = MemCalloc(1, sizeof(*r));
+    if (r == NULL)
+        return -ENOMEM;
+
+    rc = io_uring_queue_init(depth, &r->ring, 0);
+    if (rc < 0) {
+        MemFree(r);
+        return rc;
+    }
+    r->depth = depth;
+
+    *p_ring = r;
+    return 0;
+}
+
+void scan_uring_fini(scan_uring_t *r)
+{
+    if (r == NULL)
+        return;
+
+    io_uring_queue_exit(&r->ring);
+    if (r->stx != NULL)
+        MemFree(r->stx);
+    MemFree(r);
+}
+
+static void prep_statx(struct io_uring_sqe *sqe, unsigned int idx,
+                       const struct batch_args *args)
+{
+    io_uring_prep_statx(sqe, args->dirfd, args->names[idx],
+                        AT_SYMLINK_NOFOLLOW, STATX_BASIC_STATS,
+                        &args->stx[idx]);
+}
+
+/** convert statx result to struct stat */
+static void statx2stat(const struct statx *stx, struct stat *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    st->st_ino = stx->stx_ino;
+    st->st_mode = stx->stx_mode;
+    st->st_nlink = stx->stx_nlink;
+    st->st_uid = stx->stx_uid;
+    st->st_gid = stx->stx_gid;
+    st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+    st->st_size = stx->stx_size;
+    st->st_blksize = stx->stx_blksize;
+    st->st_blocks = stx->stx_blocks;
+    st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+    st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+    st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+    st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+    st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+int scan_uring_fstatat(scan_uring_t *r, int dirfd, char **names,
+                       unsigned int count, struct stat *st, int *rcs)
+{
+    struct batch_args args = {.dirfd = dirfd, .names = names };
+    unsigned int i;
+    int rc;
+
+    /* grow statx buffers if needed */
+    if (count > r->stx_count) {
+        if (r->stx != NULL)
+            MemFree(r->stx);
+        r->stx = MemCalloc(count, sizeof(*r->stx));
+        if (r->stx == NULL) {
+            r->stx_count = 0;
+            return -ENOMEM;
+        }
+        r->stx_count = count;
+    }
+    args.stx = r->stx;
+
+    rc = run_batch(r, count, prep_statx, &args, rcs);
+    if (rc)
+        return rc;
+
+    for (i = 0; i < count; i++)
+        if (rcs[i] == 0)
+            statx2stat(&r->stx[i], &st[i]);
+
+    return 0;
+}
+
+static void prep_openat(struct io_uring_sqe *sqe, unsigned int idx,
+                        const struct batch_args *args)
+{
+    io_uring_prep_openat(sqe, args->dirfd, args->names[idx], args->flags, 0);
+}
+
+int scan_uring_openat(scan_uring_t *r, int dirfd, char **names,
+                      unsigned int count, int flags, int *fds)
+{
+    struct batch_args args = {.dirfd = dirfd, .names = names,
+        .flags = flags, .opens = true };
+
+    return run_batch(r, count, prep_openat, &args, fds);
+}
+
+static void prep_close(struct io_uring_sqe *sqe, unsigned int idx,
+                       const struct batch_args *args)
+{
+    io_uring_prep_close(sqe, args->fds[idx]);
+}
+
+int scan_uring_close(scan_uring_t *r, const int *fds, unsigned int count)
+{
+    struct batch_args args = {.fds = fds };
+    int *rcs;
+    int rc;
+
+    rcs = MemCalloc(count, sizeof(*rcs));
+    if (rcs == NULL)
+        return -ENOMEM;
+
+    /* close errors are ignored, as for synchronous close */
+    rc = run_batch(r, count, prep_close, &args, rcs);
+    MemFree(rcs);
+    return rc;
+}
+
+#else /* no io_uring support */
+
+int scan_uring_init(scan_uring_t **p_ring, unsigned int depth)
+{
+    *p_ring = NULL;
+    return -ENOSYS;
+}
+
+void scan_uring_fini(scan_uring_t *ring)
+{
+}
+
+int scan_uring_fstatat(scan_uring_t *ring, int dirfd, char **names,
+                       unsigned int count, struct stat *st, int *rcs)
+{
+    return -ENOSYS;
+}
+
+int scan_uring_openat(scan_uring_t *ring, int dirfd, char **names,
+                      unsigned int count, int flags, int *fds)
+{
+    return -ENOSYS;
+}
+
+int scan_uring_close(scan_uring_t *ring, const int *fds, unsigned int count)
+{
+    return -ENOSYS;
+}
+
+#endif
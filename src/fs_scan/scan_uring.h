@@ -0,0 +1,65 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * vim:expandtab:shiftwidth=4:tabstop=4:
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the CeCILL License.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL license (http://www.cecill.info) and that you
+ * accept its terms.
+ */
+/**
+ * Asynchronous metadata operations for FS scan, using io_uring.
+ * This makes it possible to have several pending stat/open/close operations
+ * for a given scan thread.
+ */
+
+#ifndef _SCAN_URING_H
+#define _SCAN_URING_H
+
+#include <sys/stat.h>
+
+/** per-thread context for asynchronous operations (opaque) */
+typedef struct scan_uring scan_uring_t;
+
+/**
+ * Create an asynchronous context with the given queue depth.
+ * @return 0 on success, -ENOSYS if io_uring is not supported
+ *         (by robinhood build or by the kernel), another negative
+ *         error code else.
+ */
+int scan_uring_init(scan_uring_t **p_ring, unsigned int depth);
+
+/** Release an asynchronous context. */
+void scan_uring_fini(scan_uring_t *ring);
+
+/**
+ * Get attributes of a set of entries in directory dirfd
+ * (same semantics as fstatat with AT_SYMLINK_NOFOLLOW).
+ * @param[out] st  attributes of each entry.
+ * @param[out] rcs 0 or -errno for each entry.
+ * @return 0 if all operations completed, a negative error code else.
+ *         In this case, the context must not be used anymore.
+ */
+int scan_uring_fstatat(scan_uring_t *ring, int dirfd, char **names,
+                       unsigned int count, struct stat *st, int *rcs);
+
+/**
+ * Open a set of entries in directory dirfd.
+ * @param[out] fds file descriptor or -errno for each entry.
+ * @return 0 if all operations completed, a negative error code else.
+ *         In this case, the context must not be used anymore, and fds
+ *         is only set for the operations that completed.
+ */
+int scan_uring_openat(scan_uring_t *ring, int dirfd, char **names,
+                      unsigned int count, int flags, int *fds);
+
+/**
+ * Close a set of file descriptors.
+ * @return 0 if all operations completed, a negative error code else.
+ *         In this case, the context must not be used anymore.
+ */
+int scan_uring_close(scan_uring_t *ring, const int *fds, unsigned int count);
+
+#endif
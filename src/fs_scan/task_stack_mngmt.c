@@ -12,8 +12,20 @@
  * accept its terms.
  */
 /**
- * Module for managing FS scan tasks as a stack
- * with priorities on entry depth.
+ * Module for managing FS scan tasks as per-thread deques,
+ * with work stealing between threads.
+ *
+ * Each scan thread inserts the tasks it creates in its own deque, and takes
+ * its next task from the same end, so the scan of each thread is 'depth
+ * first' and the number of pending tasks stays bounded.
+ * Note that this bound is per thread: each deque holds about the
+ * directories found along the current branch of its owner, so the total
+ * number of pending tasks grows with the number of scan threads.
+ * There is no global bound, as a thread can't stop inserting the
+ * directories it finds without stalling its own scan.
+ * When its deque is empty, a thread steals the oldest task of another
+ * thread: this is the less deep one, so it is likely to result in more work
+ * for the thief.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -24,107 +36,191 @@
 #include "task_stack_mngmt.h"
 #include "rbh_logs.h"
 #include "rbh_misc.h"
+#include "Memory.h"
 
 /* Initialize a stack of tasks */
-int InitTaskStack(task_stack_t *p_stack)
+int InitTaskStack(task_stack_t *p_stack, unsigned int nb_threads)
 {
     unsigned int index;
-    int rc;
 
-    /* initialize each level of the priority stack */
-    for (index = 0; index <= MAX_TASK_DEPTH; index++) {
-        p_stack->tasks_at_depth[index] = NULL;
+    p_stack->deques = MemCalloc(nb_threads, sizeof(task_deque_t));
+    if (p_stack->deques == NULL) {
+        DisplayLog(LVL_CRIT, FSSCAN_TAG, "ERROR allocating task deques");
+        return ENOMEM;
     }
+    p_stack->nb_deques = nb_threads;
 
-    /* no task waiting for now */
-    p_stack->max_task_depth = 0;
-
-    /* initialize the lock and the semaphore for accessing the list */
-    pthread_mutex_init(&p_stack->stack_lock, NULL);
+    /* initially, no task available */
+    for (index = 0; index < nb_threads; index++)
+        pthread_mutex_init(&p_stack->deques[index].deque_lock, NULL);
 
-    /* initially, no task available: sem=0 */
-    if ((rc = sem_init(&p_stack->sem_tasks, 0, 0))) {
-        pthread_mutex_destroy(&p_stack->stack_lock);
-        DisplayLog(LVL_CRIT, FSSCAN_TAG, "ERROR initializing semaphore");
-        return rc;
-    }
+    p_stack->insert_seq = 0;
+    p_stack->nb_waiting = 0;
+    pthread_mutex_init(&p_stack->idle_lock, NULL);
+    pthread_cond_init(&p_stack->idle_cond, NULL);
 
     return 0;
-
 }
 
-/* insert a task in the stack */
-void InsertTask_to_Stack(task_stack_t *p_stack, robinhood_task_t *p_task)
+/* insert a task in the deque of the given thread */
+void InsertTask_to_Stack(task_stack_t *p_stack, unsigned int thr_index,
+                         robinhood_task_t *p_task)
 {
-    unsigned int prof = p_task->depth;
+    task_deque_t *deque = &p_stack->deques[thr_index % p_stack->nb_deques];
+
+    P(deque->deque_lock);
+
+    /* insert the task at the head */
+    p_task->prev_task = NULL;
+    p_task->next_task = deque->head;
+    if (deque->head != NULL)
+        deque->head->prev_task = p_task;
+    else
+        deque->tail = p_task;
+    deque->head = p_task;
+    /* read without lock by thieves */
+    __atomic_store_n(&deque->count, deque->count + 1, __ATOMIC_RELAXED);
+
+    V(deque->deque_lock);
+
+    /* full barrier: the counter is incremented before nb_waiting
+     * is read (matches the barrier in GetTask_from_Stack) */
+    __sync_fetch_and_add(&p_stack->insert_seq, 1);
+
+    /* unblock a waiting thread */
+    if (__atomic_load_n(&p_stack->nb_waiting, __ATOMIC_RELAXED) > 0) {
+        P(p_stack->idle_lock);
+        if (p_stack->nb_waiting > 0)
+            pthread_cond_signal(&p_stack->idle_cond);
+        V(p_stack->idle_lock);
+    }
+}
 
-    /* don't distinguish priorities over a given depth */
-    if (prof > MAX_TASK_DEPTH)
-        prof = MAX_TASK_DEPTH;
+/** take the last inserted task of a deque */
+static robinhood_task_t *pop_head(task_deque_t *deque)
+{
+    robinhood_task_t *p_task;
 
-    /* take the lock on stack */
-    P(p_stack->stack_lock);
+    P(deque->deque_lock);
+    p_task = deque->head;
+    if (p_task != NULL) {
+        deque->head = p_task->next_task;
+        if (deque->head != NULL)
+            deque->head->prev_task = NULL;
+        else
+            deque->tail = NULL;
+        __atomic_store_n(&deque->count, deque->count - 1, __ATOMIC_RELAXED);
+    }
+    V(deque->deque_lock);
 
-    /* insert the task at the good depth */
-    p_task->next_task = p_stack->tasks_at_depth[prof];
-    p_stack->tasks_at_depth[prof] = p_task;
+    return p_task;
+}
 
-    /* update max_task_depth, if needed */
-    if (prof > p_stack->max_task_depth)
-        p_stack->max_task_depth = prof;
+/** take the first inserted task of a deque */
+static robinhood_task_t *pop_tail(task_deque_t *deque)
+{
+    robinhood_task_t *p_task;
 
-    /* release the stack lock */
-    V(p_stack->stack_lock);
+    /* don't take the lock of empty deques */
+    if (__atomic_load_n(&deque->count, __ATOMIC_RELAXED) == 0)
+        return NULL;
 
-    /* unblock waiting worker threads */
-    sem_post_safe(&p_stack->sem_tasks);
+    P(deque->deque_lock);
+    p_task = deque->tail;
+    if (p_task != NULL) {
+        deque->tail = p_task->prev_task;
+        if (deque->tail != NULL)
+            deque->tail->next_task = NULL;
+        else
+            deque->head = NULL;
+        __atomic_store_n(&deque->count, deque->count - 1, __ATOMIC_RELAXED);
+    }
+    V(deque->deque_lock);
 
+    return p_task;
 }
 
-/* take a task (blocking until there is a task in the stack) */
-robinhood_task_t *GetTask_from_Stack(task_stack_t *p_stack)
+/** steal a task from the deque of another thread */
+static robinhood_task_t *steal_task(task_stack_t *p_stack,
+                                    unsigned int thr_index)
 {
-    robinhood_task_t *p_task;
-    int index;
+    unsigned int i;
 
-    /* wait for a task */
-    sem_wait_safe(&p_stack->sem_tasks);
+    for (i = 1; i < p_stack->nb_deques; i++) {
+        robinhood_task_t *p_task;
 
-    /* lock the stack */
-    P(p_stack->stack_lock);
+        p_task = pop_tail(&p_stack->deques[(thr_index + i)
+                                           % p_stack->nb_deques]);
+        if (p_task != NULL)
+            return p_task;
+    }
+    return NULL;
+}
 
-    /* The scan is a 'depth first' scan: directly go to the highest depth. */
-    p_task = p_stack->tasks_at_depth[p_stack->max_task_depth];
+/* take a task (blocking until there is a task available) */
+robinhood_task_t *GetTask_from_Stack(task_stack_t *p_stack,
+                                     unsigned int thr_index)
+{
+    task_deque_t *deque = &p_stack->deques[thr_index % p_stack->nb_deques];
+    robinhood_task_t *p_task;
+    unsigned int seq;
+
+    for (;;) {
+        /* snapshot the insert counter before looking for a task */
+        seq = __atomic_load_n(&p_stack->insert_seq, __ATOMIC_ACQUIRE);
+
+        /* first look in the thread's own deque */
+        p_task = pop_head(deque);
+        if (p_task != NULL)
+            return p_task;
+
+        /* then try to steal a task from other threads */
+        p_task = steal_task(p_stack, thr_index);
+        if (p_task != NULL) {
+            __atomic_fetch_add(&deque->nb_steals, 1, __ATOMIC_RELAXED);
+            return p_task;
+        }
 
-    /* sanity check */
-    if (p_task == NULL) {
-        V(p_stack->stack_lock);
-        DisplayLog(LVL_CRIT, FSSCAN_TAG, "UNEXPECTED ERROR: NO TASK FOUND");
-        return NULL;
-    }
+        P(p_stack->idle_lock);
+        p_stack->nb_waiting++;
+        /* full barrier: nb_waiting is incremented before the counter
+         * is read again (matches the barrier in InsertTask_to_Stack) */
+        __sync_synchronize();
 
-    /* update the list for this depth */
-    p_stack->tasks_at_depth[p_stack->max_task_depth] = p_task->next_task;
-
-    /* if the list at current depth is empty, we need to
-     * update max_task_depth.
-     */
-    if (p_task->next_task == NULL) {
-        for (index = p_stack->max_task_depth; index >= 0; index--) {
-            if (p_stack->tasks_at_depth[index] != NULL) {
-                p_stack->max_task_depth = index;
-                break;
-            }
+        /* only sleep if no task was inserted since the lookup started */
+        if (seq == __atomic_load_n(&p_stack->insert_seq, __ATOMIC_ACQUIRE)) {
+            __atomic_fetch_add(&deque->nb_idle, 1, __ATOMIC_RELAXED);
+            pthread_cond_wait(&p_stack->idle_cond, &p_stack->idle_lock);
         }
-        /* no item found */
-        if (index < 0)
-            p_stack->max_task_depth = 0;
+        p_stack->nb_waiting--;
+        V(p_stack->idle_lock);
     }
+}
 
-    /* unlock the stack */
-    V(p_stack->stack_lock);
+/* get scheduling statistics of all threads */
+void TaskStackStats(task_stack_t *p_stack, unsigned long long *nb_steals,
+                    unsigned long long *nb_idle)
+{
+    unsigned int i;
 
-    /* returns pointer to the task */
-    return p_task;
+    *nb_steals = 0;
+    *nb_idle = 0;
+
+    for (i = 0; i < p_stack->nb_deques; i++) {
+        *nb_steals += __atomic_load_n(&p_stack->deques[i].nb_steals,
+                                      __ATOMIC_RELAXED);
+        *nb_idle += __atomic_load_n(&p_stack->deques[i].nb_idle,
+                                    __ATOMIC_RELAXED);
+    }
+}
+
+/* reset scheduling statistics (while scan threads may update them) */
+void ResetTaskStackStats(task_stack_t *p_stack)
+{
+    unsigned int i;
 
+    for (i = 0; i < p_stack->nb_deques; i++) {
+        __atomic_store_n(&p_stack->deques[i].nb_steals, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&p_stack->deques[i].nb_idle, 0, __ATOMIC_RELAXED);
+    }
 }
@@ -21,13 +21,23 @@
 
 #include "fs_scan_types.h"
 
-/* initialize a task stack */
-int InitTaskStack(task_stack_t *p_stack);
+/* initialize a task stack with one deque per scan thread */
+int InitTaskStack(task_stack_t *p_stack, unsigned int nb_threads);
 
-/* insert a task in the stack */
-void InsertTask_to_Stack(task_stack_t *p_stack, robinhood_task_t *p_task);
+/* insert a task in the deque of the given thread */
+void InsertTask_to_Stack(task_stack_t *p_stack, unsigned int thr_index,
+                         robinhood_task_t *p_task);
 
-/* take a task in the stack (block until there is a task available) */
-robinhood_task_t *GetTask_from_Stack(task_stack_t *p_stack);
+/* take a task in the deque of the given thread, or steal one from another
+ * thread (block until there is a task available) */
+robinhood_task_t *GetTask_from_Stack(task_stack_t *p_stack,
+                                     unsigned int thr_index);
+
+/* get scheduling statistics of all threads */
+void TaskStackStats(task_stack_t *p_stack, unsigned long long *nb_steals,
+                    unsigned long long *nb_idle);
+
+/* reset scheduling statistics */
+void ResetTaskStackStats(task_stack_t *p_stack);
 
 #endif
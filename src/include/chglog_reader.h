@@ -36,6 +36,10 @@
 typedef struct mdt_def_t {
     char mdt_name[MDT_NAME_MAX];
     char reader_id[READER_ID_MAX];
+    /** if set, read records from this file instead of the MDT */
+    char source_file[RBH_PATH_MAX];
+    /** if set, append received records to this file */
+    char record_file[RBH_PATH_MAX];
 } mdt_def_t;
 
 /** Configuration for ChangeLog reader Module */
@@ -61,6 +65,12 @@ typedef struct chglog_reader_config_t {
      * internal queue have aged. */
     time_t queue_check_interval;
 
+    /* Adapt queue size and max age to the pipeline load,
+     * between queue_max_size/age and the following limits. */
+    bool adaptive_queue;
+    int queue_max_size_limit;
+    time_t queue_max_age_limit;
+
     /* Max delay to update last committed changelog record */
     time_t commit_update_max_delay;
 
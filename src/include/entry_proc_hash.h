@@ -83,6 +83,34 @@ static inline unsigned int hash_name(const entry_id_t *p_id,
     return (id_hash64(p_id) ^ g_str_hash(name)) % modulo;
 }
 
+/**
+ * Set of entries seen by a scan, with a hash of the name they were seen
+ * with. Sharded open-addressing tables, safe for concurrent insertions.
+ */
+struct seen_set;
+
+/** Create an empty set of seen entries. */
+struct seen_set *seen_set_create(void);
+
+/** Free a set of seen entries. */
+void seen_set_destroy(struct seen_set *set);
+
+/** Record an entry in the set, with the hash of its name.
+ * @return 0 on success, -ENOMEM on error.
+ */
+int seen_set_add(struct seen_set *set, const entry_id_t *p_id,
+                 uint64_t name_hash);
+
+/** Check if an entry is in the set, and get the hash of its name. */
+bool seen_set_lookup(struct seen_set *set, const entry_id_t *p_id,
+                     uint64_t *name_hash);
+
+/** Number of entries in the set. */
+unsigned long long seen_set_count(struct seen_set *set);
+
+/** Hash of an entry name (never 0). */
+uint64_t seen_name_hash(const entry_id_t *parent_id, const char *name);
+
 /* return a slot pointer. */
 static inline struct id_hash_slot *get_hash_slot(struct id_hash *id_hash,
                                                  const entry_id_t *p_id)
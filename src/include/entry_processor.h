@@ -126,6 +126,10 @@ typedef void (*free_func_t) (void *);
 typedef struct entry_proc_op_t {
     /** current stage in pipeline */
     unsigned int    pipeline_stage;
+    /** pipeline instance the operation is pushed to (modulo the number
+     *  of pipelines). Operations of a given instance are processed in the
+     *  order they were pushed. */
+    unsigned int    pipeline_shard;
 
     /* what is set in this structure ? */
     unsigned int    entry_id_is_set:1;
@@ -156,6 +160,13 @@ typedef struct entry_proc_op_t {
     /* for pipeline flush: indicate if not seen paths must be cleaned
      * (preserve entries). Used for partial scans. */
     unsigned int    gc_names:1;
+    /* for pipeline flush: entries seen by the scan are recorded in the
+     * seen set (their md_update/path_update may not be up to date) */
+    unsigned int    gc_seen_set:1;
+
+    /* the path of the entry changed: cached paths of its children
+     * must be invalidated */
+    unsigned int    path_changed:1;
 
     operation_type_e db_op_type;
     callback_func_t callback_func;
@@ -170,9 +181,15 @@ typedef struct entry_proc_op_t {
     attr_mask_t     fs_attr_need;
 
     /* attrs from DB (cached) */
-    attr_set_t      db_attrs;
+    attr_set_t     *db_attrs;
     /* attrs from FS (new) */
-    attr_set_t      fs_attrs;
+    attr_set_t     *fs_attrs;
+    /* While the operation waits in the pipeline, its attribute sets are
+     * packed in this buffer (only the length of their strings is kept)
+     * and db_attrs/fs_attrs are NULL. They are expanded again before
+     * the operation is processed. */
+    char           *packed_attrs;
+    size_t          packed_size;
     /* true if the striping in DB is up-to-date (do not require a DB update)*/
     bool            db_stripe_ok;
 
@@ -195,19 +212,26 @@ typedef struct entry_proc_op_t {
     /* double chained list for hash storage (used by constraint on parent/name)
      */
     struct rh_list_head name_hash_list;
+    /* parent/name the operation is registered with in the parent/name
+     * constraint (remains readable while attributes are packed) */
+    entry_id_t      name_key_parent;
+    char           *name_key;
+
+    /* allocation pool the operation comes from */
+    unsigned int    pool_index;
 
 } entry_proc_op_t;
 
 /* test attribute from filesystem, or else from DB */
 #define ATTR_FSorDB_TEST(_entry_op_p, _attr) \
-        (ATTR_MASK_TEST(&(_entry_op_p)->fs_attrs, _attr) || \
-         ATTR_MASK_TEST(&(_entry_op_p)->db_attrs, _attr))
+        (ATTR_MASK_TEST((_entry_op_p)->fs_attrs, _attr) || \
+         ATTR_MASK_TEST((_entry_op_p)->db_attrs, _attr))
 
 /* get attribute from filesystem, or else from DB */
 #define ATTR_FSorDB(_entry_op_p, _attr) \
-        (ATTR_MASK_TEST(&(_entry_op_p)->fs_attrs, _attr) ? \
-         ATTR(&(_entry_op_p)->fs_attrs, _attr) :           \
-         ATTR(&(_entry_op_p)->db_attrs, _attr))
+        (ATTR_MASK_TEST((_entry_op_p)->fs_attrs, _attr) ? \
+         ATTR((_entry_op_p)->fs_attrs, _attr) :           \
+         ATTR((_entry_op_p)->db_attrs, _attr))
 
 #define NEED_ANYSTATUS(_op) ((_op)->fs_attr_need.status != 0)
 #define NEED_GETSTATUS(_op, _i) ((_op)->fs_attr_need.status & SMI_MASK(_i))
@@ -253,6 +277,14 @@ int EntryProcessor_Acknowledge(entry_proc_op_t *p_op,
 int EntryProcessor_AcknowledgeBatch(entry_proc_op_t **p_op, unsigned int count,
                                     unsigned int next_stage, bool remove);
 
+/**
+ * Acknowledge a batch of operations, with a different next stage for each
+ * operation (-1 to remove the operation from the pipeline).
+ */
+int EntryProcessor_AcknowledgeBatchStages(entry_proc_op_t **p_op,
+                                          unsigned int count,
+                                          const int *next_stages);
+
 /**
  * Set entry id.
  */
@@ -267,7 +299,8 @@ static void inline EntryProcessor_SetEntryId(entry_proc_op_t *p_op,
 }
 
 /**
- *  Returns a clean new entry_proc_op_t structure.
+ *  Returns a clean new entry_proc_op_t structure, with empty attribute
+ *  sets. Released structures are recycled (up to a limit).
  */
 entry_proc_op_t *EntryProcessor_Get(void);
 
@@ -281,10 +314,52 @@ void EntryProcessor_Release(entry_proc_op_t *p_op);
  */
 void EntryProcessor_DumpCurrentStages(void);
 
+/** Load of the pipeline, for producers that adapt to its backpressure */
+typedef struct pipeline_load_t {
+    unsigned int nb_ops;            /**< operations in the pipeline */
+    unsigned int capacity;          /**< max_pending_operations, or what
+                                         DB_APPLY can process at once */
+    unsigned int db_apply_waiting;  /**< operations at DB_APPLY stage */
+    unsigned long long db_apply_count;  /**< total operations applied */
+    unsigned long long db_apply_usec;   /**< total DB_APPLY time */
+} pipeline_load_t;
+
+/**
+ * Get the current load of the pipeline.
+ */
+void EntryProcessor_GetLoad(pipeline_load_t *load);
+
+/** Progress of the removal of entries not seen by a scan */
+typedef struct gc_progress_t {
+    bool         running;
+    time_t       start_time;
+    unsigned int nb_ranges;         /**< ranges of ids processed */
+    unsigned long long nb_removed;  /**< entries removed (including before
+                                         a restart) */
+} gc_progress_t;
+
+/**
+ * Get the progress of the current (or last) removal of old entries.
+ */
+void EntryProcessor_GetGCProgress(gc_progress_t *progress);
+
+/**
+ * Start recording the entries seen by a full scan, so the update of
+ * unchanged entries can be skipped.
+ * @return true if the seen set is enabled (the removal of old entries
+ *         must then be done with gc_seen_set).
+ */
+bool EntryProcessor_SeenSetStart(void);
+
+/**
+ * Drop the set of seen entries (e.g. if the scan is aborted).
+ */
+void EntryProcessor_SeenSetDrop(void);
+
 /**
- * Unblock processing in a stage.
+ * Unblock processing in a stage of the pipeline instance of p_op.
  */
-void EntryProcessor_Unblock(int stage);
+void EntryProcessor_Unblock(const entry_proc_op_t *p_op, int stage);
 
 #endif
 /**
@@ -63,6 +63,15 @@ typedef struct fs_scan_config_t {
     /** memory management */
     unsigned        nb_prealloc_tasks;
 
+    /** size of the buffer for reading directory entries */
+    unsigned long long getdents_buffer_size;
+    /** max pending metadata operations per scan thread, using io_uring
+     * (0 = synchronous operations) */
+    unsigned int    scan_queue_depth;
+
+    /** bulk load entries of the initial scan of an empty database */
+    bool            initial_bulk_load;
+
     /** ignore list (bool expr) */
     whitelist_item_t *ignore_list;
     unsigned int    ignore_count;
@@ -194,8 +194,20 @@ typedef struct lmgr_t {
     /* operation statistics */
     unsigned int    nbop[OPCOUNT];
 
+    /* prepared statements for frequent requests */
+    struct lmgr_stmt_cache *stmt_cache;
+
+    /* DIR_STAT deltas to be written at next commit */
+    struct dirstat_pending *dirstat_pending;
+
 } lmgr_t;
 
+/** how the ACCT_STAT table is maintained */
+typedef enum {
+    ACCT_MODE_TRIGGERS = 0, /**< by triggers on the ENTRIES table */
+    ACCT_MODE_BATCHED,      /**< by client-side deltas (ListMgr_AcctUpdate) */
+} acct_mode_e;
+
 /** List manager configuration */
 typedef struct lmgr_config_t {
     db_config_t     db_config;
@@ -206,6 +218,17 @@ typedef struct lmgr_config_t {
 
     /** enable accounting */
     bool            acct;
+    /** how accounting is maintained */
+    acct_mode_e     acct_mode;
+    /** max delay before accumulated accounting deltas are written
+     * (batched mode) */
+    time_t          acct_flush_interval;
+
+    /** max number of directory paths in the path cache (0 = disabled) */
+    unsigned int    path_cache_size;
+
+    /** maintain recursive usage of directories (DIR_STAT table) */
+    bool            dir_stat;
 } lmgr_config_t;
 
 /** config handlers */
@@ -221,6 +244,16 @@ extern volatile bool lmgr_cancel_retry;
  */
 bool lmgr_parallel_batches(void);
 
+/** indicate if the accounting table is maintained by the client
+ * (callers must report their changes with ListMgr_AcctUpdate).
+ */
+bool lmgr_acct_batched(void);
+
+/** indicate if the recursive usage of directories is maintained
+ * (DIR_STAT table).
+ */
+bool lmgr_dir_stat(void);
+
 /** Container to associate an ID with its pathname. */
 typedef struct wagon {
     entry_id_t   id;
@@ -240,10 +273,12 @@ typedef struct lmgr_iter_opt_t {
     unsigned int force_no_acct:1;   /* don't use acct table for reports */
     unsigned int allow_no_attr:1;   /* allow returning entries if no attr is
                                        available */
+    unsigned int stream:1;          /* stream the result from the database
+                                       instead of loading it in memory */
 } lmgr_iter_opt_t;
 
 #define LMGR_ITER_OPT_INIT {.list_count_max = 0, .force_no_acct = 0, \
-                            .allow_no_attr = 0}
+                            .allow_no_attr = 0, .stream = 0}
 
 typedef struct attr_mask {
     uint32_t std;     /**< standard attribute mask */
@@ -655,6 +690,15 @@ void free_stripe_items(stripe_items_t *p_stripe_items);
  */
 int ListMgr_Get(lmgr_t *p_mgr, const entry_id_t *p_id, attr_set_t *p_info);
 
+/**
+ * Retrieves a set of entries from database with a single request.
+ * All entries must request the same attributes, and ids must be distinct.
+ * @param[out] rcs status for each entry (DB_SUCCESS or DB_NOT_EXISTS).
+ * @return DB_SUCCESS, or an error that applies to the whole set.
+ */
+int ListMgr_GetBatch(lmgr_t *p_mgr, entry_id_t **p_ids, attr_set_t **p_attrs,
+                     unsigned int count, int *rcs);
+
 /**
  * Retrieve the FID from the database given the parent FID and the
  * file name.
@@ -662,6 +706,197 @@ int ListMgr_Get(lmgr_t *p_mgr, const entry_id_t *p_id, attr_set_t *p_info);
 int ListMgr_Get_FID_from_Path(lmgr_t *p_mgr, const entry_id_t *parent_fid,
                               const char *name, entry_id_t *fid);
 
+/**
+ * Enable the cache of directory paths (if path_cache_size > 0).
+ * Must only be called by processes that apply namespace changes to the
+ * database (entry processor), as they are the only ones to invalidate it.
+ */
+void ListMgr_EnablePathCache(void);
+
+/**
+ * Invalidate the cached path of a directory, after it was renamed
+ * or removed. This only affects the cache of the current process:
+ * changes applied by other processes are not seen.
+ * @param subtree true if the paths of its children must also
+ *                be invalidated (rename).
+ */
+void ListMgr_InvalidatePath(const entry_id_t *p_id, bool subtree);
+
+/** Dump path cache statistics to the log */
+void ListMgr_DumpPathCacheStats(void);
+
+/** recursive usage of a directory for a given entry type */
+typedef struct lmgr_dir_usage {
+    uint64_t    count;
+    uint64_t    size;
+    uint64_t    blocks;
+} lmgr_dir_usage_t;
+
+/** what an entry accounts for in the recursive usage of its ancestors */
+typedef struct lmgr_dirstat_entry {
+    entry_id_t  parent_id;
+    obj_type_t  type;
+    uint64_t    size;
+    uint64_t    blocks;
+} lmgr_dirstat_entry_t;
+
+/** attributes needed to account an entry in DIR_STAT (standard mask) */
+#define DIRSTAT_ATTR_MASK (ATTR_MASK_parent_id | ATTR_MASK_type | \
+                           ATTR_MASK_size | ATTR_MASK_blocks)
+
+/**
+ * Fill what an entry accounts for in DIR_STAT, taking each attribute from
+ * p_attrs, or else from p_fallback (optional).
+ * @return false if the parent or the type of the entry is unknown.
+ */
+static inline bool dirstat_entry_from_attrs(lmgr_dirstat_entry_t *p_ent,
+                                            const attr_set_t *p_attrs,
+                                            const attr_set_t *p_fallback)
+{
+#define DIRSTAT_SRC(_attr) (ATTR_MASK_TEST(p_attrs, _attr) ? p_attrs : \
+        (p_fallback != NULL && ATTR_MASK_TEST(p_fallback, _attr) ? \
+         p_fallback : NULL))
+    const attr_set_t *src;
+
+    src = DIRSTAT_SRC(parent_id);
+    if (src == NULL)
+        return false;
+    p_ent->parent_id = ATTR(src, parent_id);
+
+    src = DIRSTAT_SRC(type);
+    if (src == NULL)
+        return false;
+    p_ent->type = db2type(ATTR(src, type));
+
+    src = DIRSTAT_SRC(size);
+    p_ent->size = (src != NULL) ? ATTR(src, size) : 0;
+    src = DIRSTAT_SRC(blocks);
+    p_ent->blocks = (src != NULL) ? ATTR(src, blocks) : 0;
+#undef DIRSTAT_SRC
+    return true;
+}
+
+/**
+ * Get the recursive usage of a directory (all entries under it, excluding
+ * the directory itself) from the DIR_STAT table.
+ * @param usage array indexed by obj_type_t.
+ * @retval DB_NOT_SUPPORTED if dir_stat is disabled.
+ */
+int ListMgr_GetDirStat(lmgr_t *p_mgr, const entry_id_t *p_id,
+                       lmgr_dir_usage_t usage[TYPE_SOCK + 1]);
+
+/**
+ * Report the change of an entry to the recursive usage of its ancestors,
+ * before it is applied to the database. The usage deltas are accumulated
+ * on the connection and written by its next commit, i.e. in the same
+ * transaction as the change (changes applied as a batch are aggregated).
+ * @param p_old what the entry accounted for before the change
+ *              (NULL if it had no name in the database).
+ * @param p_new what the entry accounts for after the change
+ *              (NULL if its name is removed).
+ * @param last  the entry is removed from the database.
+ */
+int ListMgr_DirStatUpdate(lmgr_t *p_mgr, const entry_id_t *p_id,
+                          const lmgr_dirstat_entry_t *p_old,
+                          const lmgr_dirstat_entry_t *p_new, bool last);
+
+/**
+ * Discard the usage deltas reported by ListMgr_DirStatUpdate(),
+ * if the change could not be applied.
+ * (they are also discarded if the transaction is rolled back)
+ */
+void ListMgr_DirStatCancel(lmgr_t *p_mgr);
+
+/**
+ * Rebuild the DIR_STAT table from the current DB contents
+ * (e.g. at the end of a bulk load).
+ * It waits for the changes enclosed in ListMgr_ApplyBegin()/End() to
+ * complete, and blocks new ones until it is done.
+ */
+int ListMgr_DirStatRebuild(lmgr_t *p_mgr);
+
+/**
+ * Enclose the application of changes to the database (entries, and their
+ * ACCT_STAT/DIR_STAT deltas), so they don't run while ACCT_STAT or DIR_STAT
+ * are rebuilt by this process: the rebuild could miss them or count them
+ * twice. Calls must not be nested.
+ */
+void ListMgr_ApplyBegin(void);
+void ListMgr_ApplyEnd(void);
+
+/** attributes needed to account an entry in ACCT_STAT (standard mask),
+ * in addition to the status of all status managers */
+#define ACCT_ATTR_MASK (ATTR_MASK_uid | ATTR_MASK_gid | ATTR_MASK_type | \
+                        ATTR_MASK_size | ATTR_MASK_blocks)
+
+/**
+ * Account a change applied to the ENTRIES table, when accounting is batched
+ * (see lmgr_acct_batched()). The change is accumulated in memory and
+ * written to ACCT_STAT later.
+ * @param p_old attributes of the entry in the database before the change
+ *              (NULL if it was not in the database).
+ * @param p_new attributes written to the database (NULL if the entry was
+ *              removed). Missing attributes are taken from p_old.
+ */
+int ListMgr_AcctUpdate(lmgr_t *p_mgr, const attr_set_t *p_old,
+                       const attr_set_t *p_new);
+
+/**
+ * Write accumulated accounting changes to ACCT_STAT (batched accounting).
+ */
+int ListMgr_AcctFlush(lmgr_t *p_mgr);
+
+/**
+ * Rebuild the ACCT_STAT table from the current DB contents
+ * (batched accounting, e.g. after entries could not be loaded).
+ * Like ListMgr_DirStatRebuild(), it excludes the changes enclosed in
+ * ListMgr_ApplyBegin()/End(). Accounting changes accumulated by other
+ * processes are not seen.
+ */
+int ListMgr_AcctRebuild(lmgr_t *p_mgr);
+
+/** Set of secondary indexes maintained in the database */
+typedef enum {
+    INDEX_PROFILE_FULL = 0, /**< default indexes + advised indexes */
+    INDEX_PROFILE_MINIMAL,  /**< only indexes needed for ingest */
+    INDEX_PROFILE_ADVISED,  /**< only indexes used by the filters of reports
+                                 and policies (see ListMgr_IndexAdvice) */
+} index_profile_e;
+
+const char *index_profile2str(index_profile_e profile);
+/** @return -1 if the string is not a valid profile name */
+int str2index_profile(const char *str);
+
+/**
+ * Get the current index profile (INDEX_PROFILE_FULL if it was never set).
+ */
+int ListMgr_GetIndexProfile(lmgr_t *p_mgr, index_profile_e *profile);
+
+/**
+ * Set the index profile, and build/drop indexes accordingly.
+ * This is done online: other processes can use the database meanwhile.
+ */
+int ListMgr_SetIndexProfile(lmgr_t *p_mgr, index_profile_e profile);
+
+/** Usage of a field in filters, and status of its index */
+typedef struct index_advice_t {
+    unsigned int attr_index;
+    const char  *table;
+    const char  *field;
+    unsigned long long uses;    /**< number of filter conditions */
+    bool         indexed;       /**< the index currently exists */
+    bool         advised;       /**< the index is worth being maintained */
+} index_advice_t;
+
+/**
+ * Get the usage of indexable fields in the filters of reports and policies,
+ * as recorded by all robinhood processes, and the resulting advice.
+ * Only fields that are used or currently indexed are listed.
+ * @param[out] advice array to be freed by the caller (MemFree).
+ */
+int ListMgr_IndexAdvice(lmgr_t *p_mgr, index_advice_t **advice,
+                        unsigned int *count);
+
 /**
  * Releases resources of an attr set.
  */
@@ -680,6 +915,31 @@ int ListMgr_BatchInsert(lmgr_t *p_mgr, entry_id_t **p_ids,
                         attr_set_t **p_attrs, unsigned int count,
                         bool update_if_exists);
 
+/**
+ * Start the initial load of an empty database (e.g. first scan).
+ * Until ListMgr_BulkLoadEnd() is called, entries inserted by
+ * ListMgr_BulkInsert() are accumulated in memory and loaded by large blocks
+ * (LOAD DATA on MySQL), and secondary indexes are dropped. Loaded entries
+ * may not be visible before the end of the load.
+ */
+int ListMgr_BulkLoadStart(lmgr_t *p_mgr);
+
+/**
+ * Insert new entries by the bulk load path.
+ * Only entries that nothing else refers to until the end of the load
+ * must be inserted this way (e.g. entries discovered by the initial scan).
+ * @retval DB_NOT_SUPPORTED if no bulk load is running: entries must be
+ *         inserted the usual way.
+ */
+int ListMgr_BulkInsert(lmgr_t *p_mgr, entry_id_t **p_ids,
+                       attr_set_t **p_attrs, unsigned int count);
+
+/**
+ * Load remaining entries of a bulk load, and build secondary indexes.
+ * Nothing is done if no bulk load is running.
+ */
+int ListMgr_BulkLoadEnd(lmgr_t *p_mgr);
+
 /**
  * Modifies an existing entry in the database.
  */
@@ -695,6 +955,15 @@ int ListMgr_MassUpdate(lmgr_t *p_mgr, const lmgr_filter_t *p_filter,
 /** remove callback function */
 typedef void (*rm_cb_func_t) (const entry_id_t *);
 
+/**
+ * Callback to keep some of the entries or names matched by a mass removal.
+ * @param parent_id, name  the name to be removed (NULL for an entry).
+ * @return true to keep the entry or name.
+ */
+typedef bool (*rm_keep_func_t) (const entry_id_t *id,
+                                const entry_id_t *parent_id,
+                                const char *name, void *arg);
+
 /**
  * Removes a name from the database. Remove the entry if last is true.
  */
@@ -707,6 +976,29 @@ int ListMgr_Remove(lmgr_t *p_mgr, const entry_id_t *p_id,
 int ListMgr_MassRemove(lmgr_t *p_mgr, const lmgr_filter_t *p_filter,
                        rm_cb_func_t);
 
+/**
+ * Removes (or soft removes if soft_rm is true) the entries that match
+ * the specified filter, in the next range of primary keys after cursor.
+ * Each range is removed in its own transaction, so the removal of a huge
+ * set of entries can be interleaved with other DB operations, and resumed
+ * from the last cursor if it is interrupted.
+ * @param[in]     chunk_size  Max number of entries in the range
+ *                            (0 to process all entries at once).
+ * @param[in,out] cursor      Last primary key of the previous range
+ *                            (empty string for the first range).
+ *                            Set to the end of the processed range.
+ * @param[out]    rm_count    Number of entries removed in the range.
+ * @param[out]    last        Set to true if this was the last range.
+ * @param[in]     keep_func   If not NULL, entries and names for which it
+ *                            returns true are not removed.
+ */
+int ListMgr_MassRemoveRange(lmgr_t *p_mgr, const lmgr_filter_t *p_filter,
+                            bool soft_rm, time_t rm_time, rm_cb_func_t cb_func,
+                            unsigned int chunk_size, char *cursor,
+                            size_t cursor_size, unsigned int *rm_count,
+                            bool *last, rm_keep_func_t keep_func,
+                            void *keep_arg);
+
 /**
  * Atomically replace an entry with another, and relink childs in the namespace if needed.
  */
@@ -742,9 +1034,11 @@ int ListMgr_SoftRemove_Discard(lmgr_t *p_mgr, const entry_id_t *p_id);
 /**
  * Initialize a list of items removed 'softly', sorted by expiration time.
  * Selecting 'expired' entries is done using an rm_time criteria in p_filter
+ * \param p_opt options for the list (only 'stream' is supported), may be NULL.
  */
 struct lmgr_rm_list_t *ListMgr_RmList(lmgr_t *p_mgr, lmgr_filter_t *filter,
-                                      const lmgr_sort_type_t *p_sort_type);
+                                      const lmgr_sort_type_t *p_sort_type,
+                                      const lmgr_iter_opt_t *p_opt);
 
 /**
  * Get next entry to be removed.
@@ -1085,6 +1379,11 @@ void ListMgr_CloseProfile(struct lmgr_profile_t *p_iter);
 #define LAST_SCAN_CURMSPE     "LastScanCurMsPerEntry"
 #define LAST_SCAN_NB_THREADS  "LastScanNbThreads"
 
+/* garbage collection of entries not seen by the last scan */
+#define LAST_SCAN_GC_PENDING  "LastScanGCPending" /* parameters of running GC */
+#define LAST_SCAN_GC_CURSOR   "LastScanGCCursor"  /* last id processed by GC */
+#define LAST_SCAN_GC_REMOVED  "LastScanGCRemoved" /* entries removed by GC */
+
 #define PREV_SCAN_START_TIME  "PrevScanStartTime"
 #define PREV_SCAN_END_TIME    "PrevScanEndTime"
 
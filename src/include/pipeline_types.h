@@ -24,6 +24,9 @@
 typedef struct changelog_record {
     CL_REC_TYPE  *p_log_rec;
     char         *mdt;
+    /** sequence number of the record in the reader's list of
+     *  uncommitted records (set when pushed to the pipeline) */
+    uint64_t      commit_seq;
 } changelog_record_t;
 #endif
 
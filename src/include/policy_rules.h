@@ -25,11 +25,17 @@
 #include "rbh_params.h"
 #include <sys/time.h>
 
+/** boolean expression compiled for matching (opaque) */
+struct bool_prog;
+/** combined matcher for all fileclasses (opaque) */
+struct class_matcher;
+
 /** whitelist item is just a boolean expression */
 typedef struct whitelist_item_t {
     bool_node_t     bool_expr;
     attr_mask_t     attr_mask; /**< summary of attributes involved in boolean
                                     expression */
+    struct bool_prog *prog;    /**< compiled bool_expr */
 } whitelist_item_t;
 
 #define POLICY_NAME_LEN  128
@@ -45,6 +51,8 @@ typedef struct fileset_item_t {
 
     /** condition for files to be in this fileset */
     bool_node_t definition;
+    /** compiled definition */
+    struct bool_prog *prog;
     /** summary of attributes involved in boolean expression */
     attr_mask_t attr_mask;
 
@@ -87,6 +95,23 @@ typedef int (*action_func_t) (const entry_id_t *id, attr_set_t *attrs,
                               post_action_e *what_after, db_cb_func_t db_cb_fn,
                               void *db_cb_arg);
 
+/** an entry passed to a batch action */
+typedef struct action_item {
+    const entry_id_t      *id;
+    attr_set_t            *attrs;
+    const action_params_t *params;
+    post_action_e         *what_after;
+    int                    rc;  /**< action status for this entry */
+} action_item_t;
+
+/**
+ * Apply an action to several entries at once.
+ * The status of each entry is set in items[i].rc.
+ * @return 0, or an error that applies to all entries.
+ */
+typedef int (*action_batch_func_t) (action_item_t *items, unsigned int count,
+                                    db_cb_func_t db_cb_fn, void *db_cb_arg);
+
 typedef enum {
     ACTION_UNSET, /**< not set */
     ACTION_NONE,  /**< explicit noop */
@@ -96,6 +121,7 @@ typedef enum {
 
 struct action_func_info {
     action_func_t call;
+    action_batch_func_t call_batch; /**< NULL if not supported */
     char *name;
 };
 
@@ -117,6 +143,8 @@ typedef struct rule_item_t {
 
     /** condition for purging/migrating files */
     bool_node_t condition;
+    /** compiled condition */
+    struct bool_prog *prog;
 
     /** if specified, overrides policy defaults */
     policy_action_t action;
@@ -171,6 +199,7 @@ typedef struct policy_descr_t {
     /** @TODO store policy info a persistent way for later check */
     char                name[POLICY_NAME_LEN];
     bool_node_t         scope;
+    struct bool_prog   *scope_prog;
     attr_mask_t         scope_mask;
 
     /* In the case of 'multi-action' status managers,indicate the implemented
@@ -189,6 +218,8 @@ typedef struct policy_descr_t {
     unsigned int        default_lru_sort_attr;
 
     policy_rules_t      rules;
+    /** lowercase fileclass name -> policy case (struct class_case) */
+    GHashTable         *class_cases;
 
     /* does this policy manage deleted entries? */
     bool                manage_deleted;
@@ -204,6 +235,7 @@ typedef struct policies_t {
     fileset_item_t     *fileset_list;
     unsigned int        fileset_count;
     attr_mask_t         global_fileset_mask;    /**< mask for all filesets */
+    struct class_matcher *class_matcher;    /**< merged fileset conditions */
 
     /* is there any policy that manages deleted entries? */
     unsigned int        manage_deleted:1;
@@ -314,6 +346,41 @@ policy_match_t entry_matches(const entry_id_t *p_entry_id,
                              const time_modifier_t *p_pol_mod,
                              const struct sm_instance *smi);
 
+/* check if entry matches the condition of a policy rule */
+policy_match_t rule_matches(const entry_id_t *p_entry_id,
+                            const attr_set_t *p_entry_attr,
+                            const rule_item_t *rule,
+                            const time_modifier_t *p_pol_mod,
+                            const struct sm_instance *smi);
+
+/**
+ * Compile a boolean expression for faster matching.
+ * The program refers to conditions of the expression, so the expression
+ * must not be released before the program.
+ * @return NULL on error (the expression is then interpreted).
+ */
+struct bool_prog *compile_boolexpr(const bool_node_t *expr);
+
+/** release a compiled expression */
+void free_bool_prog(struct bool_prog *prog);
+
+/**
+ * Merge the compiled conditions of all fileclasses, so match_classes()
+ * evaluates a condition shared by several fileclasses only once.
+ * Must be called after fileclass definitions are compiled.
+ * @return NULL on error (fileclasses are then matched one by one).
+ */
+struct class_matcher *class_matcher_build(const policies_t *p_policies);
+
+/** release a fileclass matcher */
+void class_matcher_free(struct class_matcher *cm);
+
+/** index policy cases by fileclass name, for class_policy_case() */
+int class_cases_build(policy_descr_t *policy);
+
+/** enable/disable the use of compiled expressions (for benchmarking) */
+void set_compiled_matching(bool enable);
+
 /* read an action params block from config */
 int read_action_params(config_item_t param_block, action_params_t *params,
                        attr_mask_t *mask, char *msg_out);
@@ -157,6 +157,14 @@ typedef struct policy_run_config_t {
     unsigned int        nb_threads;
     unsigned int        queue_size;
     unsigned int        db_request_limit;
+    /** run the next sorted DB request while the current one is processed */
+    bool                db_prefetch;
+    /** max number of action commands running asynchronously
+     * (0: commands are run synchronously by worker threads) */
+    unsigned int        max_async_commands;
+    /** max number of entries passed at once to actions that support
+     * batches (1: no batching) */
+    unsigned int        action_batch_size;
 
     unsigned int        max_action_nbr; /**< can also be specified in each
                                              trigger */
@@ -318,6 +326,10 @@ typedef struct policy_info_t {
                                                          trigger */
     entry_queue_t           queue;        /**< processing queue */
     pthread_t              *threads;      /**< worker threads array (size in config) */
+    sem_t                   async_slots;  /**< bound of asynchronous action
+                                               commands */
+    struct action_batch    *batch;        /**< entries waiting for a batch
+                                               action (NULL if disabled) */
     pthread_t               trigger_thr;  /**< trigger checker thread */
     lmgr_t                  lmgr;         /**< db connexion for triggers */
     trigger_info_t         *trigger_info; /**< stats about policy triggers */
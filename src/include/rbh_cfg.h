@@ -93,6 +93,7 @@ typedef enum run_flags {
     RUNFLG_NO_GC        = (1 << 5),  /* don't clean orphan entries after scan */
     RUNFLG_FORCE_RUN    = (1 << 6),  /* force running policy even if no scan was
                                         complete */
+    RUNFLG_NO_BULK_LOAD = (1 << 7),  /* don't bulk load the DB on first scan */
 } run_flags_t;
 
 /* Config module masks:
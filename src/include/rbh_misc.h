@@ -524,6 +524,25 @@ int cb_stderr_to_log(void *arg, char *line, size_t size, int stream);
  */
 int execute_shell_command(char **cmd, parse_cb_t cb_func, void *cb_arg);
 
+/**
+ * Callback function called when an asynchronous command terminates.
+ *
+ * \param[in] udata     argument passed to execute_shell_command_async()
+ * \param[in] rc        command status, as returned by execute_shell_command()
+ */
+typedef void (*exec_done_cb_t) (void *udata, int rc);
+
+/**
+ * Start a shell command without waiting for its termination.
+ * The output and termination of all asynchronous commands are handled
+ * by a single event loop thread, which calls cb_func for each output line
+ * and done_cb when the command terminates.
+ * @return 0 if the command was started (done_cb will be called),
+ *         a negative error code otherwise (done_cb is not called).
+ */
+int execute_shell_command_async(char **cmd, parse_cb_t cb_func, void *cb_arg,
+                                exec_done_cb_t done_cb, void *done_arg);
+
 /**
  * Quote an argument for shell commande line.
  * The caller must free the returned string. */
@@ -38,6 +38,7 @@ struct rbh_module_operations {
     int                 (*mod_get_version)(void);
     status_manager_t   *(*mod_get_status_manager)(void);
     action_func_t       (*mod_get_action)(const char *);
+    action_batch_func_t (*mod_get_batch_action)(const char *);
     action_scheduler_t *(*mod_get_scheduler)(const char *);
 };
 
@@ -76,6 +77,17 @@ status_manager_t *module_get_status_manager(const char *name);
  */
 action_func_t module_get_action(const char *name);
 
+/**
+ * Get the batch variant of an action function from a robinhood dynamic
+ * module, if the module provides one.
+ *
+ * \param[in] name  The function name, <module_name>.<action>
+ *
+ * \return A pointer to the batch function or NULL if the action can only
+ *         be applied to entries one by one.
+ */
+action_batch_func_t module_get_batch_action(const char *name);
+
 /**
  * Get an action scheduler from a robinhood dynamic module.
  * Scheduler are names of the form <module_name>.<sched_name>.
@@ -24,6 +24,7 @@
 #define SOFT_RM_TABLE       "SOFT_RM"
 #define VAR_TABLE           "VARS"
 #define ACCT_TABLE          "ACCT_STAT"
+#define DIR_STAT_TABLE      "DIR_STAT"
 #define ACCT_TRIGGER_INSERT "ACCT_ENTRY_INSERT"
 #define ACCT_TRIGGER_UPDATE "ACCT_ENTRY_UPDATE"
 #define ACCT_TRIGGER_DELETE "ACCT_ENTRY_DELETE"
@@ -85,6 +86,77 @@ int            db_result_nb_records( db_conn_t * conn, result_handle_t * p_resul
 /* free result resources */
 int            db_result_free( db_conn_t * conn, result_handle_t * p_result );
 
+/**
+ * Load rows into a table (LOAD DATA on MySQL). Existing rows with the same
+ * key are preserved.
+ * Rows are terminated by '\n' and their fields are separated by ','.
+ * Values are formatted as in SQL requests: escaped strings between quotes,
+ * numbers, or NULL.
+ * @param fields list of loaded fields
+ * @param set    assignment of other fields from loaded ones (optional)
+ * @retval DB_NOT_SUPPORTED if this is not supported by the database.
+ */
+int            db_load_data( db_conn_t * conn, const char *table,
+                             const char *fields, const char *set,
+                             const char *data, size_t len );
+
+/* -------------------- streamed results ---------------- */
+
+/** opaque type for a streamed result */
+typedef struct db_stream db_stream_t;
+
+/**
+ * Execute a sql query and stream its result: records are fetched
+ * from the server as they are read, instead of loading the whole result
+ * in client memory.
+ * MySQL: the result is read on a dedicated connection, so other requests can
+ * still be run on conn while reading it.
+ * SQLite: the result is read on conn, and the database remains read-locked
+ * until the stream is closed.
+ */
+int            db_stream_open( db_conn_t * conn, const char *query, bool quiet,
+                               db_stream_t ** p_stream );
+
+/* get the next record from a streamed result */
+int            db_stream_next( db_stream_t * stream,
+                               char *outtab[], unsigned int outtabsize );
+
+/* close a streamed result (remaining records are not read) */
+void           db_stream_close( db_stream_t * stream );
+
+/* -------------------- prepared statements ---------------- */
+
+/** opaque type for a prepared statement */
+typedef struct db_stmt db_stmt_t;
+
+/* prepare a sql statement with '?' parameters */
+int            db_stmt_prepare( db_conn_t * conn, const char *query,
+                                db_stmt_t ** p_stmt );
+
+/**
+ * Bind a value to the parameter at position pos (starting from 0).
+ * Only plain types are supported (DB_TEXT, integers and DB_BOOL):
+ * other types must be converted by the caller.
+ * Strings are copied. A NULL string is bound as SQL NULL.
+ */
+int            db_stmt_bind( db_stmt_t * stmt, unsigned int pos,
+                             db_type_e type, const db_type_u * value );
+
+/* execute a prepared statement with the currently bound values */
+int            db_stmt_exec( db_stmt_t * stmt );
+
+/* get the next record from the result of a prepared statement.
+ * Values are valid until the next call or db_stmt_reset(). */
+int            db_stmt_next( db_stmt_t * stmt,
+                             char *outtab[], unsigned int outtabsize );
+
+/* release the result of the last execution of a prepared statement.
+ * Must be called after each execution, before binding new values. */
+void           db_stmt_reset( db_stmt_t * stmt );
+
+/* release a prepared statement */
+void           db_stmt_close( db_stmt_t * stmt );
+
 /* indicate if the error is retryable (transaction must be restarted) */
 bool db_is_retryable(int db_err);
 
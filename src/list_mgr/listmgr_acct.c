@@ -0,0 +1,679 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * vim:expandtab:shiftwidth=4:tabstop=4:
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the CeCILL License.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL license (http://www.cecill.info) and that you
+ * accept its terms.
+ */
+/**
+ * Client-side accounting (ACCT_STAT table, accounting_mode = batched).
+ *
+ * Instead of triggers on the ENTRIES table, the callers report each change
+ * they apply to the database (ListMgr_AcctUpdate). Changes are accumulated
+ * in memory as deltas, by ACCT_STAT primary key (owner, group, type,
+ * status...), then written every accounting_flush_interval, or when too
+ * many keys are accumulated: positive parts of the deltas are added by a
+ * multi-row upsert, negative parts are subtracted by a single update.
+ * As ENTRIES has no trigger, batches of entries can be inserted in parallel.
+ *
+ * Mass removals subtract the removed entries by a grouped request, in the
+ * same transaction as the removal.
+ *
+ * Deltas are lost if the process dies before writing them, while the
+ * matching changes of ENTRIES are committed. So, while a process has
+ * unwritten deltas, a per-process DB variable is set (ACCT_PENDING_VAR
+ * followed by host:pid). It is cleared once the deltas are written when
+ * closing a connection. If the variable of a dead process is found at
+ * startup, ACCT_STAT is rebuilt.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "list_mgr.h"
+#include "listmgr_internal.h"
+#include "listmgr_common.h"
+#include "database.h"
+#include "rbh_logs.h"
+#include "rbh_misc.h"
+#include "Memory.h"
+
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <signal.h>
+
+/* flush accumulated deltas when there are more keys */
+#define ACCT_MAX_KEYS   10000
+/* number of rows per request when flushing */
+#define ACCT_BATCH      1000
+
+/* accounted values: size, blocks, count, then the size profile */
+#define VAL_SIZE        0
+#define VAL_BLOCKS      1
+#define VAL_COUNT       2
+#define VAL_SZ(_i)      (3 + (_i))
+#define ACCT_NB_VALS    VAL_SZ(SZ_PROFIL_COUNT)
+
+/** accumulated delta for an ACCT_STAT row */
+typedef struct acct_delta {
+    /* primary key values with field names (for derived tables) */
+    char    *aliased;
+    int64_t  val[ACCT_NB_VALS];
+} acct_delta_t;
+
+static struct acct_cache {
+    pthread_mutex_t lock;
+    /* serializes flushes (no concurrent requests on the same rows) */
+    pthread_mutex_t flush_lock;
+    GHashTable     *deltas;     /* primary key values => acct_delta_t */
+    time_t          first_delta;    /* time of the oldest unwritten delta */
+    bool            marker_set;     /* ACCT_PENDING_VAR is set in the DB */
+} acct_cache = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .flush_lock = PTHREAD_MUTEX_INITIALIZER,
+    .deltas = NULL,
+    .first_delta = 0,
+    .marker_set = false,
+};
+
+/** name of the DB variable marking unwritten deltas of this process */
+static void acct_marker_name(char *name, size_t size)
+{
+    char host[HOST_NAME_MAX + 1];
+
+    if (gethostname(host, sizeof(host)) != 0)
+        strcpy(host, "localhost");
+    host[HOST_NAME_MAX] = '\0';
+
+    snprintf(name, size, ACCT_PENDING_VAR "%s:%d", host, (int)getpid());
+}
+
+/** set or clear the marker of unwritten deltas
+ * (must be called with the cache lock held) */
+static void acct_marker_update(lmgr_t *p_mgr, bool set)
+{
+    char name[RBH_NAME_MAX];
+    char value[128];
+    int  rc;
+
+    if (acct_cache.marker_set == set)
+        return;
+
+    acct_marker_name(name, sizeof(name));
+    snprintf(value, sizeof(value), "%lu", (unsigned long)time(NULL));
+
+    rc = lmgr_set_var(&p_mgr->conn, name, set ? value : NULL);
+    if (rc) {
+        DisplayLog(LVL_MAJOR, LISTMGR_TAG, "Failed to %s variable '%s' "
+                   "(error %d)", set ? "set" : "clear", name, rc);
+        return;
+    }
+    acct_cache.marker_set = set;
+}
+
+static void acct_delta_free(gpointer data)
+{
+    acct_delta_t *d = data;
+
+    g_free(d->aliased);
+    MemFree(d);
+}
+
+/** name of an accounted value in ACCT_STAT */
+static const char *val_name(unsigned int i)
+{
+    switch (i) {
+    case VAL_SIZE:
+        return field_name(ATTR_INDEX_size);
+    case VAL_BLOCKS:
+        return field_name(ATTR_INDEX_blocks);
+    case VAL_COUNT:
+        return ACCT_FIELD_COUNT;
+    default:
+        return sz_field[i - VAL_SZ(0)];
+    }
+}
+
+/** index of a size in the size profile (same as SZRANGE_FUNC) */
+static inline unsigned int sz_range_index(uint64_t size)
+{
+    unsigned int i;
+
+    if (size == 0)
+        return 0;
+    /* FLOOR(LOG2(size)/5) + 1 */
+    i = (63 - __builtin_clzll(size)) / 5 + 1;
+    return (i < SZ_PROFIL_COUNT) ? i : SZ_PROFIL_COUNT - 1;
+}
+
+/** what an entry accounts for in ACCT_STAT */
+typedef struct acct_entry {
+    const attr_set_t *attrs;
+    const attr_set_t *fallback;
+    GString          *key;  /* primary key values */
+    uint64_t          size;
+    uint64_t          blocks;
+} acct_entry_t;
+
+/** get the source of an attribute: attrs, else fallback (optional),
+ * else NULL (database default) */
+static inline const attr_set_t *acct_src(const acct_entry_t *ent,
+                                         unsigned int attr_index)
+{
+    if (attr_mask_test_index(&ent->attrs->attr_mask, attr_index))
+        return ent->attrs;
+    if (ent->fallback != NULL
+        && attr_mask_test_index(&ent->fallback->attr_mask, attr_index))
+        return ent->fallback;
+    return NULL;
+}
+
+/** print the primary key values of an entry (with field names if aliased) */
+static void acct_key(lmgr_t *p_mgr, GString *str, const acct_entry_t *ent,
+                     bool aliased)
+{
+    const attr_set_t *src;
+    const db_type_u  *defval;
+    int i, cookie;
+
+    cookie = -1;
+    while ((i = attr_index_iter(0, &cookie)) != -1) {
+        if (!is_acct_pk(i))
+            continue;
+
+        if (!GSTRING_EMPTY(str))
+            g_string_append_c(str, ',');
+
+        src = acct_src(ent, i);
+        if (src != NULL)
+            print_attr_value(p_mgr, str, src, i, 0);
+        else if ((defval = default_field_value(i)) != NULL)
+            printdbtype(&p_mgr->conn, str, field_type(i), defval);
+        else
+            g_string_append(str, "NULL");
+
+        if (aliased)
+            g_string_append_printf(str, " AS %s", field_name(i));
+    }
+}
+
+static void acct_entry_init(lmgr_t *p_mgr, acct_entry_t *ent,
+                            const attr_set_t *p_attrs,
+                            const attr_set_t *p_fallback)
+{
+    const attr_set_t *src;
+
+    ent->attrs = p_attrs;
+    ent->fallback = p_fallback;
+    ent->key = g_string_new(NULL);
+    acct_key(p_mgr, ent->key, ent, false);
+
+    src = acct_src(ent, ATTR_INDEX_size);
+    ent->size = (src != NULL) ? ATTR(src, size) : 0;
+    src = acct_src(ent, ATTR_INDEX_blocks);
+    ent->blocks = (src != NULL) ? ATTR(src, blocks) : 0;
+}
+
+/** add (sign=1) or subtract (sign=-1) an entry to the accumulated deltas
+ * (must be called with the cache lock held) */
+static void acct_add_entry(lmgr_t *p_mgr, const acct_entry_t *ent, int sign)
+{
+    acct_delta_t *d;
+
+    if (acct_cache.deltas == NULL)
+        acct_cache.deltas = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                  g_free, acct_delta_free);
+    if (g_hash_table_size(acct_cache.deltas) == 0)
+        acct_cache.first_delta = time(NULL);
+
+    d = g_hash_table_lookup(acct_cache.deltas, ent->key->str);
+    if (d == NULL) {
+        GString *aliased = g_string_new(NULL);
+
+        acct_key(p_mgr, aliased, ent, true);
+        d = MemCalloc(1, sizeof(*d));
+        d->aliased = g_string_free(aliased, FALSE);
+        g_hash_table_insert(acct_cache.deltas, g_strdup(ent->key->str), d);
+    }
+
+    d->val[VAL_SIZE] += sign * (int64_t)ent->size;
+    d->val[VAL_BLOCKS] += sign * (int64_t)ent->blocks;
+    d->val[VAL_COUNT] += sign;
+    d->val[VAL_SZ(sz_range_index(ent->size))] += sign;
+}
+
+/** positive (sign=1) or negated negative (sign=-1) part of a value */
+static inline int64_t val_part(int64_t val, int sign)
+{
+    return (val * sign > 0) ? val * sign : 0;
+}
+
+static bool acct_delta_has_part(const acct_delta_t *d, int sign)
+{
+    int i;
+
+    for (i = 0; i < ACCT_NB_VALS; i++)
+        if (val_part(d->val[i], sign) != 0)
+            return true;
+    return false;
+}
+
+/** append a row to a flush request: positive part of a delta as a VALUES
+ * item, or negative part as a SELECT of a derived table */
+static void append_delta_row(GString *rows, const char *key,
+                             const acct_delta_t *d, int sign)
+{
+    int i;
+
+    if (sign > 0)
+        g_string_append_printf(rows, "%s(%s", GSTRING_EMPTY(rows) ? "" : ",",
+                               key);
+    else
+        g_string_append_printf(rows, "%sSELECT %s",
+                               GSTRING_EMPTY(rows) ? "" : " UNION ALL ",
+                               d->aliased);
+
+    for (i = 0; i < ACCT_NB_VALS; i++) {
+        g_string_append_printf(rows, ",%"PRId64, val_part(d->val[i], sign));
+        if (sign < 0)
+            g_string_append_printf(rows, " AS %s", val_name(i));
+    }
+
+    if (sign > 0)
+        g_string_append_c(rows, ')');
+}
+
+/** add (sign=1) or subtract (sign=-1) a batch of rows to ACCT_STAT */
+static int acct_exec_rows(lmgr_t *p_mgr, const GString *rows, int sign)
+{
+    GString *req;
+    int i, rc;
+
+    if (sign > 0) {
+        req = g_string_new("INSERT INTO " ACCT_TABLE "(");
+        attrmask2fieldlist(req, acct_pk_attr_set, T_ACCT, "", "", 0);
+        for (i = 0; i < ACCT_NB_VALS; i++)
+            g_string_append_printf(req, ",%s", val_name(i));
+        g_string_append_printf(req, ") VALUES %s ON DUPLICATE KEY UPDATE ",
+                               rows->str);
+        for (i = 0; i < ACCT_NB_VALS; i++)
+            g_string_append_printf(req, "%s%s=%s+VALUES(%s)", i ? "," : "",
+                                   val_name(i), val_name(i), val_name(i));
+    } else {
+        req = g_string_new(NULL);
+        g_string_printf(req, "UPDATE " ACCT_TABLE " A,(%s) D SET ", rows->str);
+        for (i = 0; i < ACCT_NB_VALS; i++)
+            g_string_append_printf(req, "%sA.%s=CAST(A.%s as SIGNED)-D.%s",
+                                   i ? "," : "", val_name(i), val_name(i),
+                                   val_name(i));
+        g_string_append(req, " WHERE ");
+        attrmask2fieldcomparison(req, acct_pk_attr_set, T_ACCT, "A.", "D.",
+                                 "=", "AND");
+    }
+
+    rc = db_exec_sql(&p_mgr->conn, req->str, NULL);
+    g_string_free(req, TRUE);
+    return rc;
+}
+
+/** write the positive (sign=1) or negative (sign=-1) parts of deltas */
+static int acct_write_part(lmgr_t *p_mgr, GList *keys, GHashTable *deltas,
+                           int sign)
+{
+    GString     *rows = g_string_new(NULL);
+    unsigned int nb = 0;
+    int          rc = DB_SUCCESS;
+    GList       *l;
+
+    for (l = keys; l != NULL; l = l->next) {
+        const acct_delta_t *d = g_hash_table_lookup(deltas, l->data);
+
+        if (!acct_delta_has_part(d, sign))
+            continue;
+
+        append_delta_row(rows, l->data, d, sign);
+        nb++;
+
+        if (nb >= ACCT_BATCH) {
+            rc = acct_exec_rows(p_mgr, rows, sign);
+            if (rc)
+                goto out;
+            g_string_truncate(rows, 0);
+            nb = 0;
+        }
+    }
+
+    if (nb > 0)
+        rc = acct_exec_rows(p_mgr, rows, sign);
+out:
+    g_string_free(rows, TRUE);
+    return rc;
+}
+
+/** write deltas to ACCT_STAT, in a single transaction */
+static int acct_write(lmgr_t *p_mgr, GHashTable *deltas)
+{
+    GList *keys;
+    int    rc;
+
+    /* same order for all flushes */
+    keys = g_list_sort(g_hash_table_get_keys(deltas),
+                       (GCompareFunc)strcmp);
+
+retry:
+    rc = lmgr_begin(p_mgr);
+    if (lmgr_delayed_retry(p_mgr, rc))
+        goto retry;
+    else if (rc)
+        goto out;
+
+    /* add first, so rows exist and don't get negative */
+    rc = acct_write_part(p_mgr, keys, deltas, 1);
+    if (rc == DB_SUCCESS)
+        rc = acct_write_part(p_mgr, keys, deltas, -1);
+
+    if (lmgr_delayed_retry(p_mgr, rc))
+        goto retry;
+    else if (rc) {
+        lmgr_rollback(p_mgr);
+        goto out;
+    }
+
+    rc = lmgr_commit(p_mgr);
+    if (lmgr_delayed_retry(p_mgr, rc))
+        goto retry;
+out:
+    g_list_free(keys);
+    return rc;
+}
+
+/** put back deltas that could not be written
+ * (must be called with the cache lock held) */
+static void acct_merge(GHashTable *deltas)
+{
+    GHashTableIter iter;
+    gpointer       key, value;
+
+    if (acct_cache.deltas == NULL) {
+        acct_cache.deltas = deltas;
+        return;
+    }
+
+    g_hash_table_iter_init(&iter, deltas);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        acct_delta_t *src = value;
+        acct_delta_t *d = g_hash_table_lookup(acct_cache.deltas, key);
+        int i;
+
+        if (d == NULL) {
+            /* move it to the current table */
+            g_hash_table_iter_steal(&iter);
+            g_hash_table_insert(acct_cache.deltas, key, src);
+            continue;
+        }
+        for (i = 0; i < ACCT_NB_VALS; i++)
+            d->val[i] += src->val[i];
+    }
+    g_hash_table_destroy(deltas);
+}
+
+/** write accumulated deltas (must be called with the flush lock held) */
+static int acct_flush(lmgr_t *p_mgr)
+{
+    GHashTable *deltas;
+    int         rc;
+
+    P(acct_cache.lock);
+    deltas = acct_cache.deltas;
+    acct_cache.deltas = NULL;
+    V(acct_cache.lock);
+
+    if (deltas == NULL || g_hash_table_size(deltas) == 0) {
+        if (deltas != NULL)
+            g_hash_table_destroy(deltas);
+        return DB_SUCCESS;
+    }
+
+    DisplayLog(LVL_FULL, LISTMGR_TAG, "Writing %u accounting deltas to "
+               ACCT_TABLE, g_hash_table_size(deltas));
+
+    rc = acct_write(p_mgr, deltas);
+    if (rc) {
+        char err_buf[1024];
+
+        DisplayLog(LVL_MAJOR, LISTMGR_TAG, "Failed to write accounting deltas"
+                   " to " ACCT_TABLE " (will retry later): Error: %s",
+                   db_errmsg(&p_mgr->conn, err_buf, sizeof(err_buf)));
+        /* keep them for the next flush */
+        P(acct_cache.lock);
+        acct_merge(deltas);
+        V(acct_cache.lock);
+        return rc;
+    }
+
+    g_hash_table_destroy(deltas);
+    return DB_SUCCESS;
+}
+
+int ListMgr_AcctUpdate(lmgr_t *p_mgr, const attr_set_t *p_old,
+                       const attr_set_t *p_new)
+{
+    acct_entry_t old_ent, new_ent;
+    bool         need_flush;
+
+    if (!lmgr_acct_batched() || (p_old == NULL && p_new == NULL))
+        return DB_SUCCESS;
+
+    if (p_old != NULL)
+        acct_entry_init(p_mgr, &old_ent, p_old, NULL);
+    if (p_new != NULL)
+        acct_entry_init(p_mgr, &new_ent, p_new, p_old);
+
+    /* nothing changed for accounting (most updates) */
+    if (p_old != NULL && p_new != NULL
+        && old_ent.size == new_ent.size && old_ent.blocks == new_ent.blocks
+        && !strcmp(old_ent.key->str, new_ent.key->str)) {
+        need_flush = false;
+        goto free_keys;
+    }
+
+    P(acct_cache.lock);
+    /* so the deltas are not silently lost if the process dies */
+    acct_marker_update(p_mgr, true);
+    if (p_old != NULL)
+        acct_add_entry(p_mgr, &old_ent, -1);
+    if (p_new != NULL)
+        acct_add_entry(p_mgr, &new_ent, 1);
+
+    need_flush = (g_hash_table_size(acct_cache.deltas) >= ACCT_MAX_KEYS
+                  || time(NULL) - acct_cache.first_delta
+                        >= lmgr_config.acct_flush_interval);
+    V(acct_cache.lock);
+
+free_keys:
+    if (p_old != NULL)
+        g_string_free(old_ent.key, TRUE);
+    if (p_new != NULL)
+        g_string_free(new_ent.key, TRUE);
+
+    /* if another thread is flushing, let it do the job */
+    if (need_flush && pthread_mutex_trylock(&acct_cache.flush_lock) == 0) {
+        int rc = acct_flush(p_mgr);
+
+        V(acct_cache.flush_lock);
+        return rc;
+    }
+    return DB_SUCCESS;
+}
+
+int ListMgr_AcctFlush(lmgr_t *p_mgr)
+{
+    int rc;
+
+    if (!lmgr_acct_batched())
+        return DB_SUCCESS;
+
+    P(acct_cache.flush_lock);
+    rc = acct_flush(p_mgr);
+    V(acct_cache.flush_lock);
+    return rc;
+}
+
+int listmgr_acct_close(lmgr_t *p_mgr)
+{
+    int rc;
+
+    if (!lmgr_acct_batched())
+        return DB_SUCCESS;
+
+    P(acct_cache.flush_lock);
+    rc = acct_flush(p_mgr);
+    V(acct_cache.flush_lock);
+    if (rc)
+        return rc;
+
+    /* all deltas are written: nothing to recover if the process dies */
+    P(acct_cache.lock);
+    if (acct_cache.deltas == NULL || g_hash_table_size(acct_cache.deltas) == 0)
+        acct_marker_update(p_mgr, false);
+    V(acct_cache.lock);
+    return DB_SUCCESS;
+}
+
+/**
+ * Check the owner of an ACCT_PENDING_VAR variable.
+ * @return true if its process is known to be dead.
+ */
+static bool marker_is_stale(const char *varname)
+{
+    char        host[HOST_NAME_MAX + 1];
+    const char *owner = varname + strlen(ACCT_PENDING_VAR);
+    const char *sep = strrchr(owner, ':');
+    int         pid;
+
+    if (sep == NULL || sscanf(sep + 1, "%d", &pid) != 1)
+        return true;
+
+    /* can't tell about processes on other hosts */
+    if (gethostname(host, sizeof(host)) != 0)
+        return false;
+    host[HOST_NAME_MAX] = '\0';
+    if (strlen(host) != (size_t)(sep - owner)
+        || strncmp(owner, host, sep - owner) != 0)
+        return false;
+
+    return pid != getpid() && kill(pid, 0) != 0 && errno == ESRCH;
+}
+
+int listmgr_acct_recover(db_conn_t *pconn)
+{
+    result_handle_t result;
+    GPtrArray      *stale;
+    char           *varname;
+    bool            others = false;
+    unsigned int    i;
+    int             rc;
+
+    if (!lmgr_acct_batched())
+        return DB_SUCCESS;
+
+    rc = db_exec_sql(pconn, "SELECT varname FROM " VAR_TABLE " WHERE varname"
+                     " LIKE '" ACCT_PENDING_VAR "%'", &result);
+    if (rc)
+        return rc;
+
+    stale = g_ptr_array_new_with_free_func(g_free);
+    while (db_next_record(pconn, &result, &varname, 1) == DB_SUCCESS) {
+        if (varname == NULL)
+            continue;
+        if (marker_is_stale(varname))
+            g_ptr_array_add(stale, g_strdup(varname));
+        else
+            others = true;
+    }
+    db_result_free(pconn, &result);
+
+    if (stale->len == 0)
+        goto out;
+
+    if (others) {
+        /* a rebuild would count the deltas of running processes twice */
+        DisplayLog(LVL_MAJOR, LISTMGR_TAG, "A process exited without writing "
+                   "its accounting changes, but other processes are running: "
+                   ACCT_TABLE " will be rebuilt at next startup");
+        goto out;
+    }
+
+    DisplayLog(LVL_MAJOR, LISTMGR_TAG, "A process exited without writing its "
+               "accounting changes: rebuilding " ACCT_TABLE);
+
+    rc = db_exec_sql(pconn, "BEGIN", NULL);
+    if (rc == DB_SUCCESS)
+        rc = db_exec_sql(pconn, "DELETE FROM " ACCT_TABLE, NULL);
+    if (rc == DB_SUCCESS)
+        rc = populate_acct_table(pconn);
+    for (i = 0; i < stale->len && rc == DB_SUCCESS; i++)
+        rc = lmgr_set_var(pconn, g_ptr_array_index(stale, i), NULL);
+    if (rc == DB_SUCCESS)
+        rc = db_exec_sql(pconn, "COMMIT", NULL);
+    else
+        db_exec_sql(pconn, "ROLLBACK", NULL);
+
+out:
+    g_ptr_array_free(stale, TRUE);
+    return rc;
+}
+
+int ListMgr_AcctRebuild(lmgr_t *p_mgr)
+{
+    int rc;
+
+    if (!lmgr_acct_batched())
+        return DB_SUCCESS;
+
+    /* no change must be applied meanwhile: accumulated deltas would not
+     * match the rebuilt contents */
+    lmgr_rebuild_lock();
+    P(acct_cache.flush_lock);
+
+    /* accumulated deltas are already part of the DB contents */
+    P(acct_cache.lock);
+    if (acct_cache.deltas != NULL) {
+        g_hash_table_destroy(acct_cache.deltas);
+        acct_cache.deltas = NULL;
+    }
+    V(acct_cache.lock);
+
+retry:
+    rc = lmgr_begin(p_mgr);
+    if (lmgr_delayed_retry(p_mgr, rc))
+        goto retry;
+    else if (rc)
+        goto out;
+
+    rc = db_exec_sql(&p_mgr->conn, "DELETE FROM " ACCT_TABLE, NULL);
+    if (rc == DB_SUCCESS)
+        rc = populate_acct_table(&p_mgr->conn);
+
+    if (lmgr_delayed_retry(p_mgr, rc))
+        goto retry;
+    else if (rc) {
+        lmgr_rollback(p_mgr);
+        goto out;
+    }
+
+    rc = lmgr_commit(p_mgr);
+    if (lmgr_delayed_retry(p_mgr, rc))
+        goto retry;
+out:
+    V(acct_cache.flush_lock);
+    lmgr_rebuild_unlock();
+    return rc;
+}
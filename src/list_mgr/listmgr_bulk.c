@@ -0,0 +1,637 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * vim:expandtab:shiftwidth=4:tabstop=4:
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the CeCILL License.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL license (http://www.cecill.info) and that you
+ * accept its terms.
+ */
+/**
+ * Bulk load of an empty database (first scan).
+ *
+ * Inserted entries are not written by each pipeline batch: their rows are
+ * accumulated in memory, by table and attribute mask, and loaded by large
+ * blocks: LOAD DATA LOCAL INFILE on MySQL (data is streamed from memory),
+ * or multi-row INSERT requests if it is not available.
+ * Only entries discovered by the scan are bulk loaded: changelog records
+ * could refer to entries that are not loaded yet. Hard links are inserted
+ * the usual way too (see bulk_allowed()).
+ * Secondary indexes are dropped at the beginning of the load, and built
+ * at the end (according to the index profile).
+ DIR_STAT is not maintained during the load: it is rebuilt at the end.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "list_mgr.h"
+#include "listmgr_internal.h"
+#include "listmgr_common.h"
+#include "listmgr_stripe.h"
+#include "database.h"
+#include "rbh_logs.h"
+#include "rbh_misc.h"
+#include "Memory.h"
+
+#include <pthread.h>
+
+/* load a block of rows when it reaches this size (LOAD DATA) */
+#define BULK_LOAD_SIZE      (16 * 1024 * 1024)
+/* max size of multi-row requests, when LOAD DATA is not available
+ * (SQLite rejects requests over 1,000,000 bytes by default) */
+#define BULK_INSERT_SIZE    (512 * 1024)
+
+/** rows to be loaded in a table, for a given attribute mask */
+typedef struct bulk_buf {
+    char         *key;      /* table and attribute mask */
+    table_enum    table;
+    GString      *fields;   /* list of loaded fields */
+    GString      *update;   /* field=VALUES(field) list (multi-row requests) */
+    GString      *rows;
+    GArray       *offsets;  /* offset of each row in 'rows' */
+} bulk_buf_t;
+
+static struct bulk_load {
+    pthread_mutex_t lock;
+    /* signaled when no thread is inserting or loading entries */
+    pthread_cond_t  idle_cond;
+    bool            active;
+    bool            load_data;  /* LOAD DATA is available */
+    unsigned int    busy;       /* threads inserting or loading entries */
+    GHashTable     *bufs;       /* key => bulk_buf_t */
+    unsigned long long loaded;  /* number of loaded rows */
+    unsigned long long failed;  /* number of rows that could not be loaded */
+} bulk = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .idle_cond = PTHREAD_COND_INITIALIZER,
+    .active = false,
+    .load_data = false,
+    .busy = 0,
+    .bufs = NULL,
+    .loaded = 0,
+    .failed = 0,
+};
+
+static void bulk_buf_free(bulk_buf_t *buf)
+{
+    g_free(buf->key);
+    g_string_free(buf->fields, TRUE);
+    if (buf->update != NULL)
+        g_string_free(buf->update, TRUE);
+    g_string_free(buf->rows, TRUE);
+    g_array_free(buf->offsets, TRUE);
+    MemFree(buf);
+}
+
+/** offset of the i-th row of a buffer (end of the buffer for i=count) */
+static inline size_t row_offset(const bulk_buf_t *buf, unsigned int i)
+{
+    if (i < buf->offsets->len)
+        return g_array_index(buf->offsets, size_t, i);
+    return buf->rows->len;
+}
+
+/** check if an entry has a row in the given table */
+static bool bulk_filter(table_enum table, const attr_set_t *p_attrs)
+{
+    switch (table) {
+    case T_MAIN:
+        return main_fields(p_attrs->attr_mask);
+    case T_DNAMES:
+        return ATTR_MASK_TEST(p_attrs, name)
+            && ATTR_MASK_TEST(p_attrs, parent_id);
+    case T_ANNEX:
+        return annex_fields(p_attrs->attr_mask);
+    default:
+        return false;
+    }
+}
+
+/**
+ * Check if an entry can be bulk loaded.
+ * Each name of a hard link results in an insert operation, and the next
+ * ones must find the entry in the DB to be processed as updates.
+ * So hard links are inserted the usual way.
+ */
+static bool bulk_allowed(const attr_set_t *p_attrs)
+{
+    if (!ATTR_MASK_TEST(p_attrs, nlink) || ATTR(p_attrs, nlink) <= 1)
+        return true;
+
+    /* directories can't be hard linked */
+    return ATTR_MASK_TEST(p_attrs, type)
+        && !strcmp(ATTR(p_attrs, type), STR_TYPE_DIR);
+}
+
+/** get the buffer of a table for the attribute mask of an entry,
+ * or create it (must be called with the bulk lock held) */
+static bulk_buf_t *bulk_buf_get(lmgr_t *p_mgr, table_enum table,
+                                const attr_set_t *p_attrs)
+{
+    bulk_buf_t *buf;
+    char       *key;
+
+    key = g_strdup_printf("%d:"DMASK, table, PMASK(&p_attrs->attr_mask));
+    buf = g_hash_table_lookup(bulk.bufs, key);
+    if (buf != NULL) {
+        g_free(key);
+        return buf;
+    }
+
+    buf = MemAlloc(sizeof(*buf));
+    buf->key = key;
+    buf->table = table;
+    buf->fields = g_string_new("id");
+    attrmask2fieldlist(buf->fields, p_attrs->attr_mask, table, "", "",
+                       AOF_LEADING_SEP);
+    buf->update = NULL;
+    if (!bulk.load_data) {
+        /* LOAD DATA sets pkn by a SET clause */
+        if (table == T_DNAMES)
+            g_string_append(buf->fields, ",pkn");
+
+        /* existing rows are merged the same way as regular inserts */
+        buf->update = g_string_new(NULL);
+        if (table == T_DNAMES)
+            g_string_append(buf->update, "id=VALUES(id),");
+        attrset2updatelist(p_mgr, buf->update, p_attrs, table,
+                           AOF_GENERIC_VAL);
+    }
+    buf->rows = g_string_new(NULL);
+    buf->offsets = g_array_new(FALSE, FALSE, sizeof(size_t));
+
+    g_hash_table_insert(bulk.bufs, buf->key, buf);
+    return buf;
+}
+
+/** append the row of an entry in a table (in LOAD DATA format, or as an
+ * item of a VALUES list) */
+static void bulk_append_row(lmgr_t *p_mgr, GString *rows, table_enum table,
+                            const PK_PARG_T pk, const attr_set_t *p_attrs)
+{
+    if (bulk.load_data)
+        g_string_append_printf(rows, DPK, pk);
+    else
+        g_string_append_printf(rows, "("DPK, pk);
+
+    attrset2valuelist(p_mgr, rows, p_attrs, table, AOF_LEADING_SEP);
+
+    if (bulk.load_data)
+        g_string_append_c(rows, '\n');
+    else if (table == T_DNAMES)
+        g_string_append(rows, ","HNAME_DEF")");
+    else
+        g_string_append_c(rows, ')');
+}
+
+/** load the rows [first, last[ of a buffer by a single request */
+static int bulk_exec(lmgr_t *p_mgr, bulk_buf_t *buf, unsigned int first,
+                     unsigned int last)
+{
+    GString     *req = NULL;
+    unsigned int i;
+    int          rc, retry_status;
+
+    if (!bulk.load_data) {
+        req = g_string_new(NULL);
+        g_string_printf(req, "INSERT INTO %s(%s) VALUES ",
+                        table2name(buf->table), buf->fields->str);
+        for (i = first; i < last; i++) {
+            if (i > first)
+                g_string_append_c(req, ',');
+            g_string_append_len(req, buf->rows->str + row_offset(buf, i),
+                                row_offset(buf, i + 1) - row_offset(buf, i));
+        }
+        g_string_append_printf(req, " ON DUPLICATE KEY UPDATE %s",
+                               buf->update->str);
+    }
+
+retry:
+    rc = lmgr_begin(p_mgr);
+    retry_status = lmgr_delayed_retry(p_mgr, rc);
+    if (retry_status == 1)
+        goto retry;
+    else if (retry_status == 2)
+        rc = DB_RBH_SIG_SHUTDOWN;
+    if (rc)
+        goto out;
+
+    if (bulk.load_data)
+        rc = db_load_data(&p_mgr->conn, table2name(buf->table),
+                          buf->fields->str,
+                          buf->table == T_DNAMES ? "pkn="HNAME_DEF : NULL,
+                          buf->rows->str + row_offset(buf, first),
+                          row_offset(buf, last) - row_offset(buf, first));
+    else
+        rc = db_exec_sql(&p_mgr->conn, req->str, NULL);
+
+    retry_status = lmgr_delayed_retry(p_mgr, rc);
+    if (retry_status == 1)
+        goto retry;
+    else if (rc || retry_status == 2) {
+        lmgr_rollback(p_mgr);
+        if (retry_status == 2)
+            rc = DB_RBH_SIG_SHUTDOWN;
+        goto out;
+    }
+
+    rc = lmgr_commit(p_mgr);
+    retry_status = lmgr_delayed_retry(p_mgr, rc);
+    if (retry_status == 1)
+        goto retry;
+    else if (retry_status == 2)
+        rc = DB_RBH_SIG_SHUTDOWN;
+out:
+    if (req != NULL)
+        g_string_free(req, TRUE);
+    return rc;
+}
+
+/**
+ * Load the rows [first, last[ of a buffer.
+ * The operations of these entries have already been acknowledged:
+ * if the request fails, rows are loaded by halves, so only the rows
+ * that can't be inserted are lost.
+ */
+static int bulk_load_rows(lmgr_t *p_mgr, bulk_buf_t *buf, unsigned int first,
+                          unsigned int last)
+{
+    unsigned int mid;
+    int          rc, rc2;
+
+    rc = bulk_exec(p_mgr, buf, first, last);
+    if (rc == DB_SUCCESS) {
+        __sync_fetch_and_add(&bulk.loaded, last - first);
+        return DB_SUCCESS;
+    }
+
+    if (rc == DB_RBH_SIG_SHUTDOWN || last - first == 1) {
+        char err_buf[1024];
+
+        DisplayLog(LVL_MAJOR, LISTMGR_TAG, "Failed to load %u rows into %s "
+                   "(they will be inserted by the next scan): Error: %s",
+                   last - first, table2name(buf->table),
+                   db_errmsg(&p_mgr->conn, err_buf, sizeof(err_buf)));
+        __sync_fetch_and_add(&bulk.failed, last - first);
+        return rc;
+    }
+
+    DisplayLog(LVL_DEBUG, LISTMGR_TAG, "Failed to load %u rows into %s: "
+               "splitting the request", last - first, table2name(buf->table));
+    mid = first + (last - first) / 2;
+    rc = bulk_load_rows(p_mgr, buf, first, mid);
+    rc2 = bulk_load_rows(p_mgr, buf, mid, last);
+    return rc ? rc : rc2;
+}
+
+/** write the rows of a buffer to the database and release it */
+static int bulk_load_buf(lmgr_t *p_mgr, bulk_buf_t *buf)
+{
+    unsigned int first, last, count = buf->offsets->len;
+    size_t       max;
+    int          rc = DB_SUCCESS;
+
+    if (bulk.load_data)
+        max = BULK_LOAD_SIZE;
+    else
+        /* INSERT INTO <table>(<fields>) VALUES ... ON DUPLICATE KEY
+         * UPDATE <update> */
+        max = BULK_INSERT_SIZE - buf->fields->len - buf->update->len - 128;
+
+    for (first = 0; first < count; first = last) {
+        size_t size = 0;
+        int    rc2;
+
+        /* +1 for the separator */
+        for (last = first; last < count; last++) {
+            size_t row_size = row_offset(buf, last + 1)
+                                - row_offset(buf, last) + 1;
+
+            if (last > first && size + row_size > max)
+                break;
+            size += row_size;
+        }
+
+        rc2 = bulk_load_rows(p_mgr, buf, first, last);
+        if (rc2 && !rc)
+            rc = rc2;
+    }
+
+    DisplayLog(LVL_FULL, LISTMGR_TAG, "%u rows written to %s", count,
+               table2name(buf->table));
+    bulk_buf_free(buf);
+    return rc;
+}
+
+#ifdef _LUSTRE
+/** stripe information is inserted the usual way */
+static int bulk_insert_stripes(lmgr_t *p_mgr, entry_id_t **p_ids,
+                               attr_set_t **p_attrs, unsigned int count)
+{
+    pktype *pklist;
+    int    *validators;
+    int     i, rc, retry_status;
+
+    pklist = MemCalloc(count, sizeof(*pklist));
+    validators = MemCalloc(count, sizeof(*validators));
+    if (pklist == NULL || validators == NULL) {
+        rc = DB_NO_MEMORY;
+        goto out_free;
+    }
+
+    for (i = 0; i < count; i++) {
+        entry_id2pk(p_ids[i], PTR_PK(pklist[i]));
+#ifdef HAVE_LLAPI_FSWAP_LAYOUTS
+        validators[i] = ATTR_MASK_TEST(p_attrs[i], stripe_info) ?
+            ATTR(p_attrs[i], stripe_info).validator : VALID_NOSTRIPE;
+#else
+        validators[i] = VALID(p_ids[i]);
+#endif
+    }
+
+retry:
+    rc = lmgr_begin(p_mgr);
+    retry_status = lmgr_delayed_retry(p_mgr, rc);
+    if (retry_status == 1)
+        goto retry;
+    else if (retry_status == 2)
+        rc = DB_RBH_SIG_SHUTDOWN;
+    if (rc)
+        goto out_free;
+
+    rc = batch_insert_stripe_info(p_mgr, pklist, validators, p_attrs, count,
+                                  true);
+    retry_status = lmgr_delayed_retry(p_mgr, rc);
+    if (retry_status == 1)
+        goto retry;
+    else if (rc || retry_status == 2) {
+        lmgr_rollback(p_mgr);
+        if (retry_status == 2)
+            rc = DB_RBH_SIG_SHUTDOWN;
+        goto out_free;
+    }
+
+    rc = lmgr_commit(p_mgr);
+    retry_status = lmgr_delayed_retry(p_mgr, rc);
+    if (retry_status == 1)
+        goto retry;
+    else if (retry_status == 2)
+        rc = DB_RBH_SIG_SHUTDOWN;
+
+out_free:
+    MemFree(validators);
+    MemFree(pklist);
+    return rc;
+}
+#endif
+
+/** insert entries with the same attribute mask */
+static int bulk_insert_group(lmgr_t *p_mgr, entry_id_t **p_ids,
+                             attr_set_t **p_attrs, unsigned int count)
+{
+    static const table_enum tables[] = { T_MAIN, T_DNAMES, T_ANNEX };
+    GString *rows = g_string_new(NULL);
+    GArray  *offsets = g_array_sized_new(FALSE, FALSE, sizeof(size_t), count);
+    int      i, t, rc = DB_SUCCESS;
+
+    for (t = 0; t < sizeof(tables) / sizeof(*tables); t++) {
+        bulk_buf_t  *buf, *full = NULL;
+        size_t       base;
+
+        if (!bulk_filter(tables[t], p_attrs[0]))
+            continue;
+
+        /* format rows without holding the lock */
+        g_string_truncate(rows, 0);
+        g_array_set_size(offsets, 0);
+        for (i = 0; i < count; i++) {
+            DEF_PK(pk);
+
+            g_array_append_val(offsets, rows->len);
+            entry_id2pk(p_ids[i], PTR_PK(pk));
+            bulk_append_row(p_mgr, rows, tables[t], pk, p_attrs[i]);
+        }
+
+        P(bulk.lock);
+        buf = bulk_buf_get(p_mgr, tables[t], p_attrs[0]);
+        base = buf->rows->len;
+        g_string_append_len(buf->rows, rows->str, rows->len);
+        for (i = 0; i < count; i++) {
+            size_t off = base + g_array_index(offsets, size_t, i);
+
+            g_array_append_val(buf->offsets, off);
+        }
+
+        /* load it outside the lock */
+        if (buf->rows->len >= (bulk.load_data ? BULK_LOAD_SIZE
+                                              : BULK_INSERT_SIZE)) {
+            g_hash_table_steal(bulk.bufs, buf->key);
+            full = buf;
+        }
+        V(bulk.lock);
+
+        if (full != NULL) {
+            int rc2 = bulk_load_buf(p_mgr, full);
+
+            if (rc2 && !rc)
+                rc = rc2;
+        }
+    }
+    g_string_free(rows, TRUE);
+    g_array_free(offsets, TRUE);
+
+#ifdef _LUSTRE
+    if (stripe_fields(p_attrs[0]->attr_mask)) {
+        int rc2 = bulk_insert_stripes(p_mgr, p_ids, p_attrs, count);
+
+        if (rc2 && !rc)
+            rc = rc2;
+    }
+#endif
+    return rc;
+}
+
+int ListMgr_BulkInsert(lmgr_t *p_mgr, entry_id_t **p_ids,
+                       attr_set_t **p_attrs, unsigned int count)
+{
+    entry_id_t **reg_ids = NULL;
+    attr_set_t **reg_attrs = NULL;
+    unsigned int i, next, reg = 0;
+    int          rc = DB_SUCCESS;
+
+    P(bulk.lock);
+    if (!bulk.active) {
+        V(bulk.lock);
+        return DB_NOT_SUPPORTED;
+    }
+    bulk.busy++;
+    V(bulk.lock);
+
+    /* entries that are inserted the usual way */
+    reg_ids = MemCalloc(count, sizeof(*reg_ids));
+    reg_attrs = MemCalloc(count, sizeof(*reg_attrs));
+    if (reg_ids == NULL || reg_attrs == NULL) {
+        rc = DB_NO_MEMORY;
+        goto out;
+    }
+
+    /* group entries with the same attribute mask */
+    for (i = 0; i < count; i = next) {
+        int rc2;
+
+        if (!bulk_allowed(p_attrs[i])) {
+            reg_ids[reg] = p_ids[i];
+            reg_attrs[reg] = p_attrs[i];
+            reg++;
+            next = i + 1;
+            continue;
+        }
+
+        for (next = i + 1; next < count; next++)
+            if (!bulk_allowed(p_attrs[next])
+                || !attr_mask_equal(&p_attrs[next]->attr_mask,
+                                    &p_attrs[i]->attr_mask))
+                break;
+
+        rc2 = bulk_insert_group(p_mgr, &p_ids[i], &p_attrs[i], next - i);
+        if (rc2 == DB_SUCCESS)
+            p_mgr->nbop[OPIDX_INSERT] += next - i;
+        else if (!rc)
+            rc = rc2;
+    }
+
+    if (reg > 0) {
+        int rc2 = ListMgr_BatchInsert(p_mgr, reg_ids, reg_attrs, reg, false);
+
+        if (rc2 && !rc)
+            rc = rc2;
+    }
+
+    /* buffered rows are loaded later, in another transaction:
+     * write the reported usage changes now */
+    if (rc == DB_SUCCESS)
+        rc = listmgr_dirstat_commit(p_mgr);
+
+out:
+    MemFree(reg_attrs);
+    MemFree(reg_ids);
+
+    P(bulk.lock);
+    bulk.busy--;
+    if (bulk.busy == 0)
+        pthread_cond_broadcast(&bulk.idle_cond);
+    V(bulk.lock);
+
+    return rc;
+}
+
+bool listmgr_bulk_active(void)
+{
+    bool active;
+
+    P(bulk.lock);
+    active = bulk.active;
+    V(bulk.lock);
+    return active;
+}
+
+int ListMgr_BulkLoadStart(lmgr_t *p_mgr)
+{
+    bool load_data = true;
+    int  rc;
+
+    P(bulk.lock);
+    if (bulk.active) {
+        V(bulk.lock);
+        return DB_SUCCESS;
+    }
+    V(bulk.lock);
+
+    /* check if LOAD DATA is allowed, by loading nothing */
+    rc = db_load_data(&p_mgr->conn, VAR_TABLE, "varname,value", NULL, "", 0);
+    if (rc == DB_NOT_SUPPORTED)
+        load_data = false;
+    else if (rc)
+        return rc;
+
+    /* if the load is interrupted, indexes are built at next startup */
+    rc = lmgr_set_var(&p_mgr->conn, DEFERRED_INDEXES_VAR, "1");
+    if (rc)
+        return rc;
+    /* drop all optional indexes */
+    rc = listmgr_set_indexes(&p_mgr->conn, &null_mask);
+    if (rc)
+        return rc;
+
+    P(bulk.lock);
+    if (bulk.bufs == NULL)
+        bulk.bufs = g_hash_table_new(g_str_hash, g_str_equal);
+    bulk.load_data = load_data;
+    bulk.loaded = 0;
+    bulk.failed = 0;
+    bulk.active = true;
+    V(bulk.lock);
+
+    DisplayLog(LVL_EVENT, LISTMGR_TAG, "Starting bulk load of the database "
+               "(using %s)", load_data ? "LOAD DATA" : "multi-row requests");
+    return DB_SUCCESS;
+}
+
+int ListMgr_BulkLoadEnd(lmgr_t *p_mgr)
+{
+    GHashTableIter iter;
+    gpointer       key, value;
+    GSList        *bufs = NULL, *l;
+    int            rc = DB_SUCCESS;
+
+    P(bulk.lock);
+    if (!bulk.active) {
+        V(bulk.lock);
+        return DB_SUCCESS;
+    }
+    /* next entries are inserted the usual way */
+    bulk.active = false;
+    while (bulk.busy > 0)
+        pthread_cond_wait(&bulk.idle_cond, &bulk.lock);
+
+    g_hash_table_iter_init(&iter, bulk.bufs);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        g_hash_table_iter_steal(&iter);
+        bufs = g_slist_prepend(bufs, value);
+    }
+    V(bulk.lock);
+
+    for (l = bufs; l != NULL; l = l->next) {
+        int rc2 = bulk_load_buf(p_mgr, l->data);
+
+        if (rc2 && !rc)
+            rc = rc2;
+    }
+    g_slist_free(bufs);
+
+    if (bulk.failed > 0)
+        DisplayLog(LVL_CRIT, LISTMGR_TAG, "Bulk load: %llu rows could not be "
+                   "loaded (their entries will be inserted by the next scan)",
+                   bulk.failed);
+    DisplayLog(LVL_EVENT, LISTMGR_TAG, "Bulk load complete: %llu rows loaded."
+               " Building secondary indexes...", bulk.loaded);
+
+    if (listmgr_apply_index_profile(&p_mgr->conn) == DB_SUCCESS) {
+        lmgr_set_var(&p_mgr->conn, DEFERRED_INDEXES_VAR, NULL);
+        DisplayLog(LVL_EVENT, LISTMGR_TAG, "Secondary indexes built");
+    }
+
+    /* directory usage is not reported during the load, as the ancestors
+     * of loaded entries may not be in the database yet */
+    ListMgr_DirStatRebuild(p_mgr);
+
+    /* accounting was updated for the entries that could not be loaded */
+    if (bulk.failed > 0 && lmgr_acct_batched())
+        ListMgr_AcctRebuild(p_mgr);
+
+    return rc;
+}
@@ -25,6 +25,7 @@
 #include "listmgr_stripe.h"
 #include "xplatform_print.h"
 #include <stdio.h>
+#include <pthread.h>
 
 volatile bool lmgr_cancel_retry = false;
 
@@ -101,6 +102,47 @@ void printdbtype(db_conn_t *pconn, GString *str, db_type_e type,
     }
 }
 
+int binddbtype(db_stmt_t *stmt, unsigned int pos, db_type_e type,
+               const db_type_u *value_ptr)
+{
+    db_type_u u;
+
+    switch (type) {
+    case DB_ID:
+        {
+            DEF_PK(tmpstr);
+
+            /* convert id to str */
+            entry_id2pk(&value_ptr->val_id, tmpstr);
+            u.val_str = tmpstr;
+            /* the value is copied by db_stmt_bind() */
+            return db_stmt_bind(stmt, pos, PK_DB_TYPE, &u);
+        }
+    case DB_UIDGID:
+        if (global_config.uid_gid_as_numbers)
+            return db_stmt_bind(stmt, pos, DB_INT, value_ptr);
+        /* UID/GID is TEXT. Fall throught ... */
+
+    case DB_TEXT:
+    case DB_ENUM_FTYPE:
+        return db_stmt_bind(stmt, pos, DB_TEXT, value_ptr);
+
+    case DB_INT:
+    case DB_UINT:
+    case DB_SHORT:
+    case DB_USHORT:
+    case DB_BIGINT:
+    case DB_BIGUINT:
+    case DB_BOOL:
+        return db_stmt_bind(stmt, pos, type, value_ptr);
+
+    case DB_STRIPE_INFO:
+    case DB_STRIPE_ITEMS:
+        RBH_BUG("Unsupported DB type");
+    }
+    return DB_INVALID_ARG;
+}
+
 /** print attribute value to display to the user
  * @param quote string to quote string types (eg. "'") */
 int ListMgr_PrintAttr(GString *str, db_type_e type,
@@ -610,6 +652,19 @@ int attrmask2fieldlist(GString *str, attr_mask_t attr_mask, table_enum table,
     return nbfields;
 }
 
+unsigned int attrmask_nb_fields(attr_mask_t attr_mask, table_enum table)
+{
+    int i, cookie;
+    unsigned int nbfields = 0;
+
+    cookie = -1;
+    while ((i = attr_index_iter(0, &cookie)) != -1) {
+        if (attr_mask_test_index(&attr_mask, i) && match_table(table, i))
+            nbfields++;
+    }
+    return nbfields;
+}
+
 /**
  * Generate operation like incrementation or decrementation on fields.
  * @param str
@@ -682,35 +737,54 @@ int attrmask2fieldcomparison(GString *str, attr_mask_t attr_mask,
     return nbfields;
 }
 
-static void print_attr_value(lmgr_t *p_mgr, GString *str,
-                             const attr_set_t *p_set, unsigned int attr_index)
+/**
+ * Get the value of an attribute, as written to the database.
+ * @param tmp buffer to store converted values.
+ */
+static db_type_e get_attr_value(const attr_set_t *p_set,
+                                unsigned int attr_index, db_type_u *typeu,
+                                char *tmp, size_t tmp_size)
 {
-    char tmp[1024];
-    db_type_u typeu;
     db_type_e t;
 
     if (attr_index < ATTR_COUNT) {
-        assign_union(&typeu, field_infos[attr_index].db_type,
+        assign_union(typeu, field_infos[attr_index].db_type,
                      attr_address_const(p_set, attr_index));
 
         if (is_sepdlist(attr_index)) {
-            separated_list2db(typeu.val_str, tmp, sizeof(tmp));
-            typeu.val_str = tmp;
+            separated_list2db(typeu->val_str, tmp, tmp_size);
+            typeu->val_str = tmp;
         }
         t = field_infos[attr_index].db_type;
     } else if (is_status_field(attr_index)) {
         unsigned int status_idx = attr2status_index(attr_index);
 
-        assign_union(&typeu, DB_TEXT, p_set->attr_values.sm_status[status_idx]);
+        assign_union(typeu, DB_TEXT, p_set->attr_values.sm_status[status_idx]);
         t = DB_TEXT;
     } else if (is_sm_info_field(attr_index)) {
         unsigned int info_idx = attr2sminfo_index(attr_index);
 
         t = sm_attr_info[info_idx].def->db_type;
-        assign_union(&typeu, t, (char *)p_set->attr_values.sm_info[info_idx]);
+        assign_union(typeu, t, (char *)p_set->attr_values.sm_info[info_idx]);
     } else
         RBH_BUG("Attribute index is not in a valid range");
 
+    return t;
+}
+
+void print_attr_value(lmgr_t *p_mgr, GString *str, const attr_set_t *p_set,
+                      unsigned int attr_index, attrset_op_flag_e flags)
+{
+    char tmp[1024];
+    db_type_u typeu;
+    db_type_e t;
+
+    if (flags & AOF_PLACEHOLDER) {
+        g_string_append_c(str, '?');
+        return;
+    }
+
+    t = get_attr_value(p_set, attr_index, &typeu, tmp, sizeof(tmp));
     printdbtype(&p_mgr->conn, str, t, &typeu);
 }
 
@@ -735,7 +809,7 @@ int attrset2valuelist(lmgr_t *p_mgr, GString *str, const attr_set_t *p_set,
                 if (leading_comma || (nbfields > 0))
                     g_string_append(str, ",");
 
-                print_attr_value(p_mgr, str, p_set, i);
+                print_attr_value(p_mgr, str, p_set, i, flags);
                 nbfields++;
             }
         }
@@ -773,8 +847,37 @@ int attrset2updatelist(lmgr_t *p_mgr, GString *str, const attr_set_t *p_set,
             if (generic_value)
                 g_string_append_printf(str, "VALUES(%s)", field_name(i));
             else
-                print_attr_value(p_mgr, str, p_set, i);
+                print_attr_value(p_mgr, str, p_set, i, flags);
+
+            nbfields++;
+        }
+    }
+    return nbfields;
+}
+
+int attrset2bindlist(db_stmt_t *stmt, unsigned int *p_pos,
+                     const attr_set_t *p_set, table_enum table)
+{
+    int i, cookie, rc;
+    unsigned int nbfields = 0;
 
+    if ((table == T_STRIPE_INFO) || (table == T_STRIPE_ITEMS))
+        return -DB_NOT_SUPPORTED;
+
+    cookie = -1;
+    while ((i = attr_index_iter(0, &cookie)) != -1) {
+        if (attr_mask_test_index(&p_set->attr_mask, i)
+            && match_table(table, i)) {
+            char tmp[1024];
+            db_type_u typeu;
+            db_type_e t;
+
+            t = get_attr_value(p_set, i, &typeu, tmp, sizeof(tmp));
+            rc = binddbtype(stmt, *p_pos, t, &typeu);
+            if (rc)
+                return -rc;
+
+            (*p_pos)++;
             nbfields++;
         }
     }
@@ -1436,6 +1539,9 @@ int filter2str(lmgr_t *p_mgr, GString *str, const lmgr_filter_t *p_filter,
                     }
                 }
                 nbfields++;
+                if (table == T_MAIN || table == T_DNAMES || table == T_ANNEX
+                    || table == T_NONE)
+                    listmgr_index_usage(index);
             } else if ((table == T_STRIPE_ITEMS || table == T_NONE)
                        && (field_type(index) == DB_STRIPE_ITEMS)) {
                 /* single value or a list? */
@@ -1465,6 +1571,7 @@ int filter2str(lmgr_t *p_mgr, GString *str, const lmgr_filter_t *p_filter,
                                            filter_value[i].value.val_uint);
                 }
                 nbfields++;
+                listmgr_index_usage(index);
             } else if ((table == T_STRIPE_INFO || table == T_NONE)
                        && (field_type(index) == DB_STRIPE_INFO)) {
                 g_string_append_printf(str, "%s'%s'",
@@ -1702,6 +1809,9 @@ int _lmgr_begin(lmgr_t *p_mgr, int behavior)
 
 void _lmgr_rollback(lmgr_t *p_mgr, int behavior)
 {
+    /* the reported changes are not applied */
+    listmgr_dirstat_discard(p_mgr);
+
     if (behavior == 0)
         return;
     else {
@@ -1715,16 +1825,23 @@ void _lmgr_rollback(lmgr_t *p_mgr, int behavior)
 
 int _lmgr_commit(lmgr_t *p_mgr, int behavior)
 {
-    if (behavior == 0)
-        return DB_SUCCESS;
-    else if (behavior == 1)
-        return db_exec_sql(&p_mgr->conn, "COMMIT", NULL);
-    else {
+    int rc;
+
+    /* write the usage changes reported for this transaction
+     * (kept until it is committed, in case it is retried) */
+    rc = listmgr_dirstat_write(p_mgr);
+    if (rc)
+        return rc;
+
+    if (behavior == 1) {
+        rc = db_exec_sql(&p_mgr->conn, "COMMIT", NULL);
+        if (rc)
+            return rc;
+    } else if (behavior > 1) {
         /* if the transaction count is reached:
          * commit operations and result transaction count
          */
         if ((p_mgr->last_commit % behavior == 0) || p_mgr->force_commit) {
-            int rc;
             rc = db_exec_sql(&p_mgr->conn, "COMMIT", NULL);
             if (rc)
                 return rc;
@@ -1732,6 +1849,8 @@ int _lmgr_commit(lmgr_t *p_mgr, int behavior)
             p_mgr->last_commit = 0;
         }
     }
+
+    listmgr_dirstat_discard(p_mgr);
     return DB_SUCCESS;
 }
 
@@ -1769,6 +1888,36 @@ int _lmgr_flush_commit(lmgr_t *p_mgr, int behavior)
         return DB_SUCCESS;
 }
 
+/* Changes applied by the pipeline and policies (shared) vs. rebuilds of
+ * ACCT_STAT and DIR_STAT (exclusive). Prefer writers, so a rebuild is not
+ * delayed forever by the flow of changes. */
+#ifdef PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP
+static pthread_rwlock_t apply_lock =
+    PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+#else
+static pthread_rwlock_t apply_lock = PTHREAD_RWLOCK_INITIALIZER;
+#endif
+
+void ListMgr_ApplyBegin(void)
+{
+    pthread_rwlock_rdlock(&apply_lock);
+}
+
+void ListMgr_ApplyEnd(void)
+{
+    pthread_rwlock_unlock(&apply_lock);
+}
+
+void lmgr_rebuild_lock(void)
+{
+    pthread_rwlock_wrlock(&apply_lock);
+}
+
+void lmgr_rebuild_unlock(void)
+{
+    pthread_rwlock_unlock(&apply_lock);
+}
+
 int lmgr_table_count(db_conn_t *pconn, const char *table, uint64_t *count)
 {
     char *str_count = NULL;
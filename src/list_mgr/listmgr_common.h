@@ -420,10 +420,35 @@ static inline bool is_recov_field(unsigned int attr_index)
 #endif
 }
 
+/** indicate if an optional secondary index can be created for the field
+ * (column of MAIN, NAMES or ANNEX table, or OST list of stripe items).
+ * Indexes of the DB schema (INDEXED fields) are always kept. */
+static inline bool is_indexable_field(unsigned int attr_index)
+{
+#ifdef _LUSTRE
+    if (attr_index == ATTR_INDEX_stripe_items)
+        return true;
+#endif
+    if (is_funcattr(attr_index) || is_read_only_field(attr_index)
+        || is_sepdlist(attr_index) || is_indexed_field(attr_index))
+        return false;
+    /* too large for an index key */
+    if (attr_index < ATTR_COUNT && field_infos[attr_index].db_type == DB_TEXT
+        && field_infos[attr_index].db_type_size > 1024)
+        return false;
+
+    return is_main_field(attr_index) || is_names_field(attr_index)
+           || is_annex_field(attr_index);
+}
+
 /** printing a value to a DB request */
 void printdbtype(db_conn_t *pconn, GString *str, db_type_e type,
                  const db_type_u *value_ptr);
 
+/** bind a value to a prepared statement parameter */
+int binddbtype(db_stmt_t *stmt, unsigned int pos, db_type_e type,
+               const db_type_u *value_ptr);
+
 /** parse a value from DB */
 int parsedbtype(char *instr, db_type_e type, db_type_u *value_out);
 
@@ -490,12 +515,17 @@ typedef enum {
                                    "on duplicate key ..." statement) */
     AOF_PREFIX      = (1 << 2), /* prefix field name with table name */
     AOF_SKIP_NAME   = (1 << 3), /* skip name record */
+    AOF_PLACEHOLDER = (1 << 4), /* use '?' placeholders as values
+                                   (for prepared statements) */
 } attrset_op_flag_e;
 
 int attrmask2fieldlist(GString *str, attr_mask_t attr_mask, table_enum table,
                        const char *prefix, const char *suffix,
                        attrset_op_flag_e flags);
 
+/** @return the number of fields of the given table in attr_mask */
+unsigned int attrmask_nb_fields(attr_mask_t attr_mask, table_enum table);
+
 int attrmask2fieldcomparison(GString *str, attr_mask_t attr_mask,
                              table_enum table, const char *left_prefix,
                              const char *right_prefix, const char *comparator,
@@ -511,11 +541,135 @@ int attrset2valuelist(lmgr_t *p_mgr, GString *str, const attr_set_t *p_set,
 int attrset2updatelist(lmgr_t *p_mgr, GString *str, const attr_set_t *p_set,
                        table_enum table, attrset_op_flag_e flags);
 
+/** print the value of an attribute, as written to the database */
+void print_attr_value(lmgr_t *p_mgr, GString *str, const attr_set_t *p_set,
+                      unsigned int attr_index, attrset_op_flag_e flags);
+
+/** default value of a field in the database (NULL if none) */
+const db_type_u *default_field_value(int attr_index);
+
+/**
+ * Bind the values of a table to the parameters of a prepared statement,
+ * in the same order as attrset2valuelist() and attrset2updatelist().
+ * @param[in,out] p_pos position of the first parameter to bind,
+ *                      incremented for each bound value.
+ * @return nbr of fields, or a negative error code.
+ */
+int attrset2bindlist(db_stmt_t *stmt, unsigned int *p_pos,
+                     const attr_set_t *p_set, table_enum table);
+
+/** requests run as prepared statements */
+typedef enum {
+    STMT_EXISTS,    /* check an entry exists */
+    STMT_GET,       /* get entry attributes */
+    STMT_INSERT,    /* insert an entry */
+    STMT_UPSERT,    /* insert an entry or update it if it exists */
+    STMT_UPDATE,    /* update entry attributes */
+    STMT_SET_NAME,  /* insert or update the name of an entry */
+    STMT_GET_PARENT, /* get the parent and the name of a directory */
+    STMT_GET_DIRSTAT, /* get the recursive usage of a directory */
+} lmgr_stmt_op_e;
+
+/**
+ * Get a prepared statement from the cache of the list manager.
+ * Statements are identified by the operation, the table and the attribute
+ * mask the request was built for.
+ * @return NULL if the statement is not in cache.
+ */
+db_stmt_t *lmgr_stmt_lookup(lmgr_t *p_mgr, lmgr_stmt_op_e op,
+                            table_enum table, attr_mask_t mask);
+
+/** prepare a statement and add it to the cache of the list manager */
+int lmgr_stmt_prepare(lmgr_t *p_mgr, lmgr_stmt_op_e op, table_enum table,
+                      attr_mask_t mask, const char *query,
+                      db_stmt_t **p_stmt);
+
+/**
+ * Handle an error executing a cached statement: it is released, as it may
+ * no longer be valid (all of them if the connection was lost).
+ */
+void lmgr_stmt_error(lmgr_t *p_mgr, db_stmt_t *stmt, int errcode);
+
+/** release all the prepared statements of a list manager */
+void lmgr_stmt_cache_free(lmgr_t *p_mgr);
+
+/**
+ * If the path cache is enabled and fullpath is in the mask, replace it
+ * by the fields it is built from (parent_id and name).
+ * @param[out] p_added fields added to the mask that were not requested.
+ * @return true if fullpath must be built by path_cache_build().
+ */
+bool path_cache_fix_mask(attr_mask_t *p_mask, attr_mask_t *p_added);
+
+/**
+ * Build fullpath from parent_id and name, using the path cache.
+ * Then unset the fields that were added by path_cache_fix_mask().
+ */
+int path_cache_build(lmgr_t *p_mgr, attr_set_t *p_info, attr_mask_t added);
+
+/**
+ * Get the primary keys of a directory and of all its ancestors,
+ * up to the first one with no name in the database.
+ * @param ancestors array of pktype.
+ */
+int path_cache_ancestors(lmgr_t *p_mgr, PK_ARG_T dir_pk, GArray *ancestors);
+
+/** Fill the DIR_STAT table from the current contents of the database */
+int dirstat_populate(db_conn_t *pconn);
+
+/** true while a bulk load is running (see ListMgr_BulkLoadStart()) */
+bool listmgr_bulk_active(void);
+
+/** write the DIR_STAT deltas reported on a connection (in the current
+ * transaction) */
+int listmgr_dirstat_write(lmgr_t *p_mgr);
+/** drop the DIR_STAT deltas reported on a connection */
+void listmgr_dirstat_discard(lmgr_t *p_mgr);
+/** write the DIR_STAT deltas reported on a connection, in their own
+ * transaction (if they are not applied with a change) */
+int listmgr_dirstat_commit(lmgr_t *p_mgr);
+
+/** subtract removed names from the usage of their ancestors
+ * (deltas are written at next commit).
+ * @param names  request returning the id and parent_id of the names
+ *               to be removed (called before they are removed).
+ *               The names under removed directories must be removed too,
+ *               as for the garbage collection of a scan.
+ */
+int listmgr_dirstat_sub_names(lmgr_t *p_mgr, const char *names);
+/** same as listmgr_dirstat_sub_names for count names of the same type */
+int listmgr_dirstat_sub_name(lmgr_t *p_mgr, const char *parent_pk,
+                             obj_type_t type, int64_t count, int64_t size,
+                             int64_t blocks);
+/** remove the usage of removed directories from DIR_STAT
+ * (after the deltas of their contents)
+ * @param ids  request returning the ids of removed entries.
+ */
+int listmgr_dirstat_rm_dirs(lmgr_t *p_mgr, const char *ids);
+
+/** Fill the ACCT_STAT table from the current contents of the database */
+int populate_acct_table(db_conn_t *pconn);
+
+/** write accumulated accounting changes when closing a connection, and
+ * clear the marker of unwritten changes if there are none left */
+int listmgr_acct_close(lmgr_t *p_mgr);
+/** rebuild ACCT_STAT if a process exited without writing its accounting
+ * changes (called at startup) */
+int listmgr_acct_recover(db_conn_t *pconn);
+/** Subtract entries from the ACCT_STAT table, before they are removed
+ * (batched accounting).
+ * @param ids  request returning the ids of the entries.
+ */
+int acct_table_sub(db_conn_t *pconn, const char *ids);
+
 char *compar2str(filter_comparator_t compar);
 
 int filter2str(lmgr_t *p_mgr, GString *str, const lmgr_filter_t *p_filter,
                table_enum table, attrset_op_flag_e flags);
 
+/** count a filter condition on the given field (index advisor) */
+void listmgr_index_usage(unsigned int attr_index);
+
 int func_filter(lmgr_t *p_mgr, GString *filter_str,
                 const lmgr_filter_t *p_filter, table_enum table,
                 attrset_op_flag_e flags);
@@ -591,6 +745,10 @@ static inline int lmgr_flush_commit(lmgr_t *p_mgr)
     return _lmgr_flush_commit(p_mgr, lmgr_config.commit_behavior);
 }
 
+/** get an exclusive access vs. ListMgr_ApplyBegin() (rebuilds) */
+void lmgr_rebuild_lock(void);
+void lmgr_rebuild_unlock(void);
+
 /** manage delayed retry of retryable errors
  * \return != 0 if the transaction must be restarted
  */
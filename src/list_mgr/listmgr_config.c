@@ -61,6 +61,10 @@ static void lmgr_cfg_set_default(void *module_config)
 #endif
 
     conf->acct = true;
+    conf->acct_mode = ACCT_MODE_TRIGGERS;
+    conf->acct_flush_interval = 10;
+    conf->path_cache_size = 100000;
+    conf->dir_stat = false;
 }
 
 static void lmgr_cfg_write_default(FILE *output)
@@ -70,6 +74,10 @@ static void lmgr_cfg_write_default(FILE *output)
     print_line(output, 1, "connect_retry_interval_min  : 1s");
     print_line(output, 1, "connect_retry_interval_max  : 30s");
     print_line(output, 1, "accounting  : enabled");
+    print_line(output, 1, "accounting_mode             : triggers");
+    print_line(output, 1, "accounting_flush_interval   : 10s");
+    print_line(output, 1, "path_cache_size             : 100000");
+    print_line(output, 1, "dir_stat                    : disabled");
     fprintf(output, "\n");
 
 #ifdef _MYSQL
@@ -107,7 +115,8 @@ static int lmgr_cfg_read(config_file_t config, void *module_config,
 
     static const char *lmgr_allowed[] = {
         "commit_behavior", "connect_retry_interval_min",
-        "connect_retry_interval_max", "accounting",
+        "connect_retry_interval_max", "accounting", "accounting_mode",
+        "accounting_flush_interval", "path_cache_size", "dir_stat",
         MYSQL_CONFIG_BLOCK, SQLITE_CONFIG_BLOCK,
         "user_acct", "group_acct",  /* deprecated => accounting */
         NULL
@@ -119,6 +128,11 @@ static int lmgr_cfg_read(config_file_t config, void *module_config,
         {"connect_retry_interval_max", PT_DURATION, PFLG_POSITIVE |
          PFLG_NOT_NULL, &conf->connect_retry_max, 0},
         {"accounting", PT_BOOL, 0, &conf->acct, 0},
+        {"accounting_flush_interval", PT_DURATION, PFLG_POSITIVE |
+         PFLG_NOT_NULL, &conf->acct_flush_interval, 0},
+        {"path_cache_size", PT_INT, PFLG_POSITIVE,
+         (int *)&conf->path_cache_size, 0},
+        {"dir_stat", PT_BOOL, 0, &conf->dir_stat, 0},
         END_OF_PARAMS
     };
 
@@ -210,6 +224,24 @@ static int lmgr_cfg_read(config_file_t config, void *module_config,
         }
     }
 
+    /* accounting_mode */
+    rc = GetStringParam(lmgr_block, LMGR_CONFIG_BLOCK, "accounting_mode",
+                        PFLG_NO_WILDCARDS, tmpstr, sizeof(tmpstr), NULL, NULL,
+                        msg_out);
+    if ((rc != 0) && (rc != ENOENT))
+        return rc;
+    else if (rc != ENOENT) {
+        if (!strcasecmp(tmpstr, "triggers"))
+            conf->acct_mode = ACCT_MODE_TRIGGERS;
+        else if (!strcasecmp(tmpstr, "batched"))
+            conf->acct_mode = ACCT_MODE_BATCHED;
+        else {
+            sprintf(msg_out, "Invalid accounting mode '%s' (expected: "
+                    "triggers, batched)", tmpstr);
+            return EINVAL;
+        }
+    }
+
     /* manage deprecated parameters */
     rc = GetBoolParam(lmgr_block, LMGR_CONFIG_BLOCK, "user_acct", 0, &bval,
                       NULL, NULL, msg_out);
@@ -325,6 +357,29 @@ static int lmgr_cfg_reload(lmgr_config_t *conf)
                    LMGR_CONFIG_BLOCK
                    "::accounting changed in config file, but cannot be modified dynamically");
 
+    if (conf->acct_mode != lmgr_config.acct_mode)
+        DisplayLog(LVL_MAJOR, TAG,
+                   LMGR_CONFIG_BLOCK
+                   "::accounting_mode changed in config file, but cannot be modified dynamically");
+
+    if (conf->acct_flush_interval != lmgr_config.acct_flush_interval) {
+        DisplayLog(LVL_EVENT, TAG,
+                   LMGR_CONFIG_BLOCK
+                   "::accounting_flush_interval updated: %ld->%ld",
+                   lmgr_config.acct_flush_interval, conf->acct_flush_interval);
+        lmgr_config.acct_flush_interval = conf->acct_flush_interval;
+    }
+
+    if (conf->path_cache_size != lmgr_config.path_cache_size)
+        DisplayLog(LVL_MAJOR, TAG,
+                   LMGR_CONFIG_BLOCK
+                   "::path_cache_size changed in config file, but cannot be modified dynamically");
+
+    if (conf->dir_stat != lmgr_config.dir_stat)
+        DisplayLog(LVL_MAJOR, TAG,
+                   LMGR_CONFIG_BLOCK
+                   "::dir_stat changed in config file, but cannot be modified dynamically");
+
     if (conf->connect_retry_min != lmgr_config.connect_retry_min) {
         DisplayLog(LVL_EVENT, TAG,
                    LMGR_CONFIG_BLOCK
@@ -414,6 +469,34 @@ static void lmgr_cfg_write_template(FILE *output)
                "# disable the following options if you are not interested in");
     print_line(output, 1, "# user or group stats (to speed up scan)");
     print_line(output, 1, "accounting  = enabled ;");
+    print_line(output, 1,
+               "# How accounting is maintained:");
+    print_line(output, 1,
+               "# - \"triggers\": by database triggers on each entry change");
+    print_line(output, 1,
+               "# - \"batched\": robinhood accumulates the changes and writes them");
+    print_line(output, 1,
+               "#   every accounting_flush_interval (allows parallel batch inserts,");
+    print_line(output, 1,
+               "#   but the last changes are lost if the process is killed)");
+    print_line(output, 1, "accounting_mode = triggers ;");
+    print_line(output, 1, "accounting_flush_interval = 10s ;");
+    fprintf(output, "\n");
+    print_line(output, 1,
+               "# Max number of directory paths cached in memory to build entry paths");
+    print_line(output, 1,
+               "# (0 to build them in the database using stored functions).");
+    print_line(output, 1,
+               "# Only used by processes that read changelogs or scan the filesystem,");
+    print_line(output, 1,
+               "# as they apply the renames that invalidate cached paths.");
+    print_line(output, 1, "path_cache_size = 100000 ;");
+    fprintf(output, "\n");
+    print_line(output, 1,
+               "# Maintain the recursive usage of directories, so 'rbh-du' can get");
+    print_line(output, 1,
+               "# the usage of a directory without walking its subtree");
+    print_line(output, 1, "dir_stat = disabled ;");
     fprintf(output, "\n");
 #ifdef _MYSQL
     print_begin_block(output, 1, MYSQL_CONFIG_BLOCK, NULL);
@@ -459,5 +542,16 @@ mod_cfg_funcs_t lmgr_cfg_hdlr = {
 
 bool lmgr_parallel_batches(void)
 {
-    return !lmgr_config.acct;
+    /* no trigger on ENTRIES: no risk of deadlock on ACCT table */
+    return !lmgr_config.acct || lmgr_config.acct_mode == ACCT_MODE_BATCHED;
+}
+
+bool lmgr_acct_batched(void)
+{
+    return lmgr_config.acct && lmgr_config.acct_mode == ACCT_MODE_BATCHED;
+}
+
+bool lmgr_dir_stat(void)
+{
+    return lmgr_config.dir_stat;
 }
@@ -0,0 +1,753 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * vim:expandtab:shiftwidth=4:tabstop=4:
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the CeCILL License.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL license (http://www.cecill.info) and that you
+ * accept its terms.
+ */
+/**
+ * Recursive usage of directories (DIR_STAT table).
+ *
+ * For each directory and each entry type, DIR_STAT holds the count, size
+ * and blocks of all the entries under it. Each name of an entry accounts
+ * for the entry itself and, for a directory, for all the entries under it.
+ *
+ * The table is filled when it is created, then it is maintained by the
+ * callers, which report each change before they apply it to the database
+ * (ListMgr_DirStatUpdate). The deltas of the ancestors are accumulated
+ * on the connection, then written at its next commit: they are applied in
+ * the same transaction as the changes, and a batch of changes updates each
+ * ancestor once. Rows are updated in the same order by all transactions.
+ * Mass removals subtract the removed names, grouped by parent directory.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "list_mgr.h"
+#include "listmgr_internal.h"
+#include "listmgr_common.h"
+#include "database.h"
+#include "rbh_logs.h"
+#include "rbh_misc.h"
+#include "Memory.h"
+
+#define DIRSTAT_TYPES   (TYPE_SOCK + 1)
+#define DIRSTAT_FIELDS  "id,type,count,size,blocks"
+/* number of rows per INSERT request */
+#define DIRSTAT_BATCH   1000
+
+/** usage delta for one entry type */
+typedef struct dirstat_delta {
+    int64_t count;
+    int64_t size;
+    int64_t blocks;
+} dirstat_delta_t;
+
+static inline void delta_add_entry(dirstat_delta_t *delta,
+                                   const lmgr_dirstat_entry_t *p_ent, int sign)
+{
+    dirstat_delta_t *d = &delta[p_ent->type > TYPE_SOCK ? TYPE_NONE
+                                                        : p_ent->type];
+    d->count += sign;
+    d->size += sign * (int64_t)p_ent->size;
+    d->blocks += sign * (int64_t)p_ent->blocks;
+}
+
+static inline void delta_add(dirstat_delta_t *delta,
+                             const dirstat_delta_t *other, int sign)
+{
+    int i;
+
+    for (i = 0; i < DIRSTAT_TYPES; i++) {
+        delta[i].count += sign * other[i].count;
+        delta[i].size += sign * other[i].size;
+        delta[i].blocks += sign * other[i].blocks;
+    }
+}
+
+static inline bool delta_is_null(const dirstat_delta_t *delta)
+{
+    int i;
+
+    for (i = 0; i < DIRSTAT_TYPES; i++)
+        if (delta[i].count != 0 || delta[i].size != 0 || delta[i].blocks != 0)
+            return false;
+    return true;
+}
+
+/** append the rows of a directory to a VALUES list */
+static void append_rows(GString *req, const char *pk,
+                        const dirstat_delta_t *delta)
+{
+    int i;
+
+    for (i = 0; i < DIRSTAT_TYPES; i++) {
+        if (delta[i].count == 0 && delta[i].size == 0 && delta[i].blocks == 0)
+            continue;
+
+        g_string_append_printf(req, "%s("DPK",'%s',%"PRId64",%"PRId64
+                               ",%"PRId64")", GSTRING_EMPTY(req) ? "" : ",",
+                               pk, type2db(i), delta[i].count, delta[i].size,
+                               delta[i].blocks);
+    }
+}
+
+/** get the usage of a directory from DIR_STAT */
+static int get_dir_usage(lmgr_t *p_mgr, PK_ARG_T pk, dirstat_delta_t *usage)
+{
+    db_stmt_t  *stmt;
+    char       *res[4];
+    db_type_u   u;
+    int         rc;
+
+    memset(usage, 0, DIRSTAT_TYPES * sizeof(*usage));
+
+    stmt = lmgr_stmt_lookup(p_mgr, STMT_GET_DIRSTAT, T_NONE, null_mask);
+    if (stmt == NULL) {
+        rc = lmgr_stmt_prepare(p_mgr, STMT_GET_DIRSTAT, T_NONE, null_mask,
+                               "SELECT type,count,size,blocks FROM "
+                               DIR_STAT_TABLE " WHERE id=?", &stmt);
+        if (rc)
+            return rc;
+    }
+
+    u.val_str = pk;
+    rc = db_stmt_bind(stmt, 0, PK_DB_TYPE, &u);
+    if (rc)
+        return rc;
+
+    rc = db_stmt_exec(stmt);
+    while (rc == DB_SUCCESS
+           && (rc = db_stmt_next(stmt, res, 4)) == DB_SUCCESS) {
+        dirstat_delta_t *d;
+
+        if (res[0] == NULL)
+            continue;
+
+        d = &usage[db2type(res[0])];
+        d->count += res[1] ? strtoll(res[1], NULL, 10) : 0;
+        d->size += res[2] ? strtoll(res[2], NULL, 10) : 0;
+        d->blocks += res[3] ? strtoll(res[3], NULL, 10) : 0;
+    }
+    db_stmt_reset(stmt);
+
+    if (rc == DB_END_OF_LIST)
+        return DB_SUCCESS;
+
+    lmgr_stmt_error(p_mgr, stmt, rc);
+    return rc;
+}
+
+/** usage deltas reported on a connection, written at its next commit */
+struct dirstat_pending {
+    GHashTable *deltas;     /* directory pk => dirstat_delta_t[DIRSTAT_TYPES] */
+    GString    *removed;    /* pks of removed directories ('pk1','pk2'...) */
+};
+
+static struct dirstat_pending *pending_get(lmgr_t *p_mgr)
+{
+    struct dirstat_pending *pending = p_mgr->dirstat_pending;
+
+    if (pending == NULL) {
+        pending = MemCalloc(1, sizeof(*pending));
+        if (pending == NULL)
+            return NULL;
+        pending->deltas = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                g_free, g_free);
+        pending->removed = g_string_new(NULL);
+        p_mgr->dirstat_pending = pending;
+    }
+    return pending;
+}
+
+/** add a delta to the pending delta of each directory in a list */
+static int pending_add(lmgr_t *p_mgr, const GArray *dirs,
+                       const dirstat_delta_t *delta)
+{
+    struct dirstat_pending *pending = pending_get(p_mgr);
+    int i;
+
+    if (pending == NULL)
+        return DB_NO_MEMORY;
+
+    for (i = 0; i < dirs->len; i++) {
+        const char      *pk = g_array_index(dirs, pktype, i);
+        dirstat_delta_t *d = g_hash_table_lookup(pending->deltas, pk);
+
+        if (d == NULL) {
+            d = g_new0(dirstat_delta_t, DIRSTAT_TYPES);
+            g_hash_table_insert(pending->deltas, g_strdup(pk), d);
+        }
+        delta_add(d, delta, 1);
+    }
+    return DB_SUCCESS;
+}
+
+/** get a directory and all its ancestors (NULL if the delta is null) */
+static int get_ancestors(lmgr_t *p_mgr, const char *dir_pk,
+                         const dirstat_delta_t *delta, GArray **ancestors)
+{
+    DEF_PK(pk);
+    int rc;
+
+    *ancestors = NULL;
+    if (delta_is_null(delta))
+        return DB_SUCCESS;
+
+    rh_strncpy(pk, dir_pk, sizeof(pk));
+    *ancestors = g_array_new(FALSE, FALSE, sizeof(pktype));
+    rc = path_cache_ancestors(p_mgr, pk, *ancestors);
+    if (rc) {
+        g_array_free(*ancestors, TRUE);
+        *ancestors = NULL;
+    }
+    return rc;
+}
+
+/** report the usage change of an entry to the pending deltas */
+static int dirstat_report(lmgr_t *p_mgr, PK_ARG_T pk,
+                          const lmgr_dirstat_entry_t *p_old,
+                          const lmgr_dirstat_entry_t *p_new, bool last)
+{
+    dirstat_delta_t old_delta[DIRSTAT_TYPES];
+    dirstat_delta_t new_delta[DIRSTAT_TYPES];
+    dirstat_delta_t subtree[DIRSTAT_TYPES];
+    GArray         *old_dirs = NULL;
+    GArray         *new_dirs = NULL;
+    bool            same_parent, is_dir;
+    DEF_PK(ppk);
+    int             rc;
+
+    same_parent = (p_old != NULL && p_new != NULL
+                   && entry_id_equal(&p_old->parent_id, &p_new->parent_id));
+    is_dir = ((p_old != NULL && p_old->type == TYPE_DIR)
+              || (p_new != NULL && p_new->type == TYPE_DIR));
+
+    /* the usage of a directory moves with it, including the changes
+     * reported in the same transaction */
+    memset(subtree, 0, sizeof(subtree));
+    if (is_dir && !same_parent) {
+        struct dirstat_pending *pending = p_mgr->dirstat_pending;
+        const dirstat_delta_t  *d;
+
+        rc = get_dir_usage(p_mgr, pk, subtree);
+        if (rc)
+            return rc;
+        if (pending != NULL
+            && (d = g_hash_table_lookup(pending->deltas, pk)) != NULL)
+            delta_add(subtree, d, 1);
+    }
+
+    memset(old_delta, 0, sizeof(old_delta));
+    memset(new_delta, 0, sizeof(new_delta));
+
+    if (p_old != NULL) {
+        delta_add_entry(old_delta, p_old, -1);
+        if (same_parent)
+            delta_add_entry(old_delta, p_new, 1);
+        else if (p_old->type == TYPE_DIR)
+            delta_add(old_delta, subtree, -1);
+
+        entry_id2pk(&p_old->parent_id, PTR_PK(ppk));
+        rc = get_ancestors(p_mgr, ppk, old_delta, &old_dirs);
+        if (rc)
+            goto out;
+    }
+
+    if (p_new != NULL && !same_parent) {
+        delta_add_entry(new_delta, p_new, 1);
+        if (p_new->type == TYPE_DIR)
+            delta_add(new_delta, subtree, 1);
+
+        entry_id2pk(&p_new->parent_id, PTR_PK(ppk));
+        rc = get_ancestors(p_mgr, ppk, new_delta, &new_dirs);
+        if (rc)
+            goto out;
+    }
+
+    /* all reads succeeded: report the deltas */
+    rc = DB_SUCCESS;
+    if (old_dirs != NULL)
+        rc = pending_add(p_mgr, old_dirs, old_delta);
+    if (rc == DB_SUCCESS && new_dirs != NULL)
+        rc = pending_add(p_mgr, new_dirs, new_delta);
+
+    if (rc == DB_SUCCESS && last && is_dir) {
+        struct dirstat_pending *pending = pending_get(p_mgr);
+
+        if (pending == NULL) {
+            rc = DB_NO_MEMORY;
+            goto out;
+        }
+        g_string_append_printf(pending->removed, "%s"DPK,
+                               GSTRING_EMPTY(pending->removed) ? "" : ",", pk);
+    }
+
+out:
+    if (old_dirs != NULL)
+        g_array_free(old_dirs, TRUE);
+    if (new_dirs != NULL)
+        g_array_free(new_dirs, TRUE);
+    return rc;
+}
+
+int ListMgr_DirStatUpdate(lmgr_t *p_mgr, const entry_id_t *p_id,
+                          const lmgr_dirstat_entry_t *p_old,
+                          const lmgr_dirstat_entry_t *p_new, bool last)
+{
+    DEF_PK(pk);
+    int rc;
+
+    if (!lmgr_config.dir_stat || (p_old == NULL && p_new == NULL))
+        return DB_SUCCESS;
+
+    /* the ancestors of the entry may still be buffered by the bulk load:
+     * DIR_STAT is rebuilt at the end of the load */
+    if (listmgr_bulk_active())
+        return DB_SUCCESS;
+
+    entry_id2pk(p_id, PTR_PK(pk));
+
+retry:
+    rc = dirstat_report(p_mgr, pk, p_old, p_new, last);
+    if (lmgr_delayed_retry(p_mgr, rc) == 1)
+        goto retry;
+    return rc;
+}
+
+void ListMgr_DirStatCancel(lmgr_t *p_mgr)
+{
+    listmgr_dirstat_discard(p_mgr);
+}
+
+/** write a batch of rows to DIR_STAT */
+static int write_rows(lmgr_t *p_mgr, GString *rows)
+{
+    g_string_prepend(rows, "INSERT INTO " DIR_STAT_TABLE "(" DIRSTAT_FIELDS
+                     ") VALUES ");
+    g_string_append(rows, " ON DUPLICATE KEY UPDATE count=count+VALUES(count),"
+                    "size=size+VALUES(size),blocks=blocks+VALUES(blocks)");
+
+    return db_exec_sql(&p_mgr->conn, rows->str, NULL);
+}
+
+int listmgr_dirstat_write(lmgr_t *p_mgr)
+{
+    struct dirstat_pending *pending = p_mgr->dirstat_pending;
+    GList       *keys, *l;
+    GString     *req;
+    unsigned int nb = 0;
+    int          rc = DB_SUCCESS;
+
+    if (pending == NULL)
+        return DB_SUCCESS;
+
+    /* same order in all transactions, to avoid deadlocks */
+    keys = g_list_sort(g_hash_table_get_keys(pending->deltas),
+                       (GCompareFunc)strcmp);
+    req = g_string_new(NULL);
+
+    for (l = keys; l != NULL; l = l->next) {
+        append_rows(req, l->data, g_hash_table_lookup(pending->deltas,
+                                                      l->data));
+        if (++nb >= DIRSTAT_BATCH) {
+            rc = write_rows(p_mgr, req);
+            if (rc)
+                goto out;
+            g_string_truncate(req, 0);
+            nb = 0;
+        }
+    }
+    if (!GSTRING_EMPTY(req))
+        rc = write_rows(p_mgr, req);
+
+    /* removed directories are removed after their contents */
+    if (rc == DB_SUCCESS && !GSTRING_EMPTY(pending->removed)) {
+        g_string_printf(req, "DELETE FROM " DIR_STAT_TABLE " WHERE id IN (%s)",
+                        pending->removed->str);
+        rc = db_exec_sql(&p_mgr->conn, req->str, NULL);
+    }
+
+out:
+    g_string_free(req, TRUE);
+    g_list_free(keys);
+    return rc;
+}
+
+int listmgr_dirstat_commit(lmgr_t *p_mgr)
+{
+    int rc;
+
+    if (p_mgr->dirstat_pending == NULL)
+        return DB_SUCCESS;
+
+retry:
+    rc = lmgr_begin(p_mgr);
+    if (lmgr_delayed_retry(p_mgr, rc))
+        goto retry;
+    else if (rc)
+        return rc;
+
+    /* the deltas are written by the commit */
+    rc = lmgr_commit(p_mgr);
+    if (lmgr_delayed_retry(p_mgr, rc))
+        goto retry;
+    return rc;
+}
+
+void listmgr_dirstat_discard(lmgr_t *p_mgr)
+{
+    struct dirstat_pending *pending = p_mgr->dirstat_pending;
+
+    if (pending == NULL)
+        return;
+
+    g_hash_table_destroy(pending->deltas);
+    g_string_free(pending->removed, TRUE);
+    MemFree(pending);
+    p_mgr->dirstat_pending = NULL;
+}
+
+int listmgr_dirstat_sub_name(lmgr_t *p_mgr, const char *parent_pk,
+                             obj_type_t type, int64_t count, int64_t size,
+                             int64_t blocks)
+{
+    dirstat_delta_t delta[DIRSTAT_TYPES];
+    dirstat_delta_t *d;
+    GArray         *dirs;
+    int             rc;
+
+    memset(delta, 0, sizeof(delta));
+    d = &delta[type > TYPE_SOCK ? TYPE_NONE : type];
+    d->count = -count;
+    d->size = -size;
+    d->blocks = -blocks;
+
+    rc = get_ancestors(p_mgr, parent_pk, delta, &dirs);
+    if (rc || dirs == NULL)
+        return rc;
+
+    rc = pending_add(p_mgr, dirs, delta);
+    g_array_free(dirs, TRUE);
+    return rc;
+}
+
+int listmgr_dirstat_sub_names(lmgr_t *p_mgr, const char *names)
+{
+    result_handle_t result;
+    GString        *req;
+    char           *res[5];
+    int             rc;
+
+    if (!lmgr_config.dir_stat)
+        return DB_SUCCESS;
+
+    req = g_string_new(NULL);
+    g_string_printf(req, "SELECT N.parent_id,E.type,COUNT(*),SUM(E.size),"
+                    "SUM(E.blocks) FROM (%s) N," MAIN_TABLE " E WHERE N.id=E.id"
+                    " GROUP BY N.parent_id,E.type", names);
+    rc = db_exec_sql(&p_mgr->conn, req->str, &result);
+    g_string_free(req, TRUE);
+    if (rc)
+        return rc;
+
+    while ((rc = db_next_record(&p_mgr->conn, &result, res, 5))
+                == DB_SUCCESS) {
+        if (res[0] == NULL || res[1] == NULL)
+            continue;
+
+        rc = listmgr_dirstat_sub_name(p_mgr, res[0], db2type(res[1]),
+                                      res[2] ? strtoll(res[2], NULL, 10) : 0,
+                                      res[3] ? strtoll(res[3], NULL, 10) : 0,
+                                      res[4] ? strtoll(res[4], NULL, 10) : 0);
+        if (rc)
+            break;
+    }
+    db_result_free(&p_mgr->conn, &result);
+
+    return (rc == DB_END_OF_LIST) ? DB_SUCCESS : rc;
+}
+
+int listmgr_dirstat_rm_dirs(lmgr_t *p_mgr, const char *ids)
+{
+    GString *req;
+    int      rc;
+
+    if (!lmgr_config.dir_stat)
+        return DB_SUCCESS;
+
+    /* write the deltas of their contents first */
+    rc = listmgr_dirstat_write(p_mgr);
+    if (rc)
+        return rc;
+    listmgr_dirstat_discard(p_mgr);
+
+    req = g_string_new(NULL);
+    g_string_printf(req, "DELETE FROM " DIR_STAT_TABLE " WHERE id IN (%s)",
+                    ids);
+    rc = db_exec_sql(&p_mgr->conn, req->str, NULL);
+    g_string_free(req, TRUE);
+    return rc;
+}
+
+int ListMgr_GetDirStat(lmgr_t *p_mgr, const entry_id_t *p_id,
+                       lmgr_dir_usage_t usage[TYPE_SOCK + 1])
+{
+    dirstat_delta_t delta[DIRSTAT_TYPES];
+    DEF_PK(pk);
+    int i, rc;
+
+    if (!lmgr_config.dir_stat)
+        return DB_NOT_SUPPORTED;
+
+    entry_id2pk(p_id, PTR_PK(pk));
+
+retry:
+    rc = get_dir_usage(p_mgr, pk, delta);
+    if (lmgr_delayed_retry(p_mgr, rc))
+        goto retry;
+    else if (rc)
+        return rc;
+
+    for (i = 0; i < DIRSTAT_TYPES; i++) {
+        /* negative values would be a bug, don't report them as huge ones */
+        usage[i].count = delta[i].count > 0 ? delta[i].count : 0;
+        usage[i].size = delta[i].size > 0 ? delta[i].size : 0;
+        usage[i].blocks = delta[i].blocks > 0 ? delta[i].blocks : 0;
+    }
+    return DB_SUCCESS;
+}
+
+/* ---------------- initial population of the table ---------------- */
+
+/** accumulated usage of a directory for one type */
+typedef struct dirstat_acc {
+    struct dirstat_acc *next;
+    obj_type_t          type;
+    dirstat_delta_t     usage;
+} dirstat_acc_t;
+
+static void acc_free(gpointer data)
+{
+    dirstat_acc_t *acc = data;
+
+    while (acc != NULL) {
+        dirstat_acc_t *next = acc->next;
+
+        MemFree(acc);
+        acc = next;
+    }
+}
+
+static void acc_add(GHashTable *accs, const char *pk, obj_type_t type,
+                    const dirstat_delta_t *usage)
+{
+    dirstat_acc_t *first, *acc;
+
+    first = g_hash_table_lookup(accs, pk);
+    for (acc = first; acc != NULL; acc = acc->next)
+        if (acc->type == type)
+            break;
+
+    if (acc == NULL) {
+        acc = MemCalloc(1, sizeof(*acc));
+        if (acc == NULL)
+            return;
+        acc->type = type;
+        if (first != NULL) {
+            acc->next = first->next;
+            first->next = acc;
+        } else
+            g_hash_table_insert(accs, g_strdup(pk), acc);
+    }
+
+    acc->usage.count += usage->count;
+    acc->usage.size += usage->size;
+    acc->usage.blocks += usage->blocks;
+}
+
+/** load the parent of all directories */
+static int load_dir_parents(db_conn_t *pconn, GHashTable *parents)
+{
+    db_stream_t *stream;
+    char        *res[2];
+    int          rc;
+
+    rc = db_stream_open(pconn, "SELECT N.id,N.parent_id FROM " DNAMES_TABLE
+                        " N," MAIN_TABLE " E WHERE N.id=E.id AND E.type='"
+                        STR_TYPE_DIR "'", false, &stream);
+    if (rc)
+        return rc;
+
+    while ((rc = db_stream_next(stream, res, 2)) == DB_SUCCESS) {
+        if (res[0] == NULL || res[1] == NULL)
+            continue;
+        /* keep a single parent (directories have a single name) */
+        if (g_hash_table_lookup(parents, res[0]) == NULL)
+            g_hash_table_insert(parents, g_strdup(res[0]), g_strdup(res[1]));
+    }
+    db_stream_close(stream);
+
+    return (rc == DB_END_OF_LIST) ? DB_SUCCESS : rc;
+}
+
+/** sum the usage of each directory to all its ancestors */
+static int sum_usage(db_conn_t *pconn, GHashTable *parents, GHashTable *accs)
+{
+    db_stream_t *stream;
+    char        *res[5];
+    int          rc;
+
+    rc = db_stream_open(pconn, "SELECT N.parent_id,E.type,COUNT(*),"
+                        "SUM(E.size),SUM(E.blocks) FROM " DNAMES_TABLE " N,"
+                        MAIN_TABLE " E WHERE N.id=E.id"
+                        " GROUP BY N.parent_id,E.type", false, &stream);
+    if (rc)
+        return rc;
+
+    while ((rc = db_stream_next(stream, res, 5)) == DB_SUCCESS) {
+        dirstat_delta_t usage;
+        const char     *pk = res[0];
+        obj_type_t      type;
+        unsigned int    depth;
+
+        if (res[0] == NULL || res[1] == NULL)
+            continue;
+
+        type = db2type(res[1]);
+        usage.count = res[2] ? strtoll(res[2], NULL, 10) : 0;
+        usage.size = res[3] ? strtoll(res[3], NULL, 10) : 0;
+        usage.blocks = res[4] ? strtoll(res[4], NULL, 10) : 0;
+
+        for (depth = 0; pk != NULL && depth <= RBH_PATH_MAX / 2; depth++) {
+            acc_add(accs, pk, type, &usage);
+            pk = g_hash_table_lookup(parents, pk);
+        }
+        if (pk != NULL)
+            DisplayLog(LVL_MAJOR, LISTMGR_TAG, "Too many ancestors for "DPK
+                       " (loop in namespace?)", res[0]);
+    }
+    db_stream_close(stream);
+
+    return (rc == DB_END_OF_LIST) ? DB_SUCCESS : rc;
+}
+
+/** insert accumulated usage into DIR_STAT */
+static int insert_usage(db_conn_t *pconn, GHashTable *accs)
+{
+    GHashTableIter  iter;
+    gpointer        key, value;
+    GString        *req;
+    unsigned int    nb = 0;
+    int             rc = DB_SUCCESS;
+
+    req = g_string_new(NULL);
+
+    g_hash_table_iter_init(&iter, accs);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        dirstat_acc_t *acc;
+
+        for (acc = value; acc != NULL; acc = acc->next) {
+            g_string_append_printf(req, "%s("DPK",'%s',%"PRId64",%"PRId64
+                                   ",%"PRId64")", nb == 0 ? "" : ",",
+                                   (char *)key, type2db(acc->type),
+                                   acc->usage.count, acc->usage.size,
+                                   acc->usage.blocks);
+            nb++;
+        }
+
+        if (nb >= DIRSTAT_BATCH) {
+            g_string_prepend(req, "INSERT INTO " DIR_STAT_TABLE "("
+                             DIRSTAT_FIELDS ") VALUES ");
+            rc = db_exec_sql(pconn, req->str, NULL);
+            if (rc)
+                goto out;
+            g_string_truncate(req, 0);
+            nb = 0;
+        }
+    }
+
+    if (nb > 0) {
+        g_string_prepend(req, "INSERT INTO " DIR_STAT_TABLE "("
+                         DIRSTAT_FIELDS ") VALUES ");
+        rc = db_exec_sql(pconn, req->str, NULL);
+    }
+out:
+    g_string_free(req, TRUE);
+    return rc;
+}
+
+int dirstat_populate(db_conn_t *pconn)
+{
+    GHashTable *parents;
+    GHashTable *accs;
+    char        err_buf[1024];
+    int         rc;
+
+    DisplayLog(LVL_MAJOR, LISTMGR_TAG,
+               "Populating " DIR_STAT_TABLE " table from existing DB contents."
+               " This can take a while...");
+    FlushLogs();
+
+    parents = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    accs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, acc_free);
+
+    rc = load_dir_parents(pconn, parents);
+    if (rc == DB_SUCCESS)
+        rc = sum_usage(pconn, parents, accs);
+    /* parents are no longer needed */
+    g_hash_table_destroy(parents);
+    if (rc == DB_SUCCESS)
+        rc = insert_usage(pconn, accs);
+    g_hash_table_destroy(accs);
+
+    if (rc)
+        DisplayLog(LVL_CRIT, LISTMGR_TAG,
+                   "Failed to populate " DIR_STAT_TABLE " table: Error: %s",
+                   db_errmsg(pconn, err_buf, sizeof(err_buf)));
+    else
+        DisplayLog(LVL_EVENT, LISTMGR_TAG, DIR_STAT_TABLE " table populated");
+    return rc;
+}
+
+int ListMgr_DirStatRebuild(lmgr_t *p_mgr)
+{
+    int rc;
+
+    if (!lmgr_config.dir_stat)
+        return DB_SUCCESS;
+
+    /* no change must be applied meanwhile */
+    lmgr_rebuild_lock();
+
+retry:
+    rc = lmgr_begin(p_mgr);
+    if (lmgr_delayed_retry(p_mgr, rc))
+        goto retry;
+    else if (rc)
+        goto out;
+
+    rc = db_exec_sql(&p_mgr->conn, "DELETE FROM " DIR_STAT_TABLE, NULL);
+    if (rc == DB_SUCCESS)
+        rc = dirstat_populate(&p_mgr->conn);
+
+    if (lmgr_delayed_retry(p_mgr, rc))
+        goto retry;
+    else if (rc) {
+        lmgr_rollback(p_mgr);
+        goto out;
+    }
+
+    rc = lmgr_commit(p_mgr);
+    if (lmgr_delayed_retry(p_mgr, rc))
+        goto retry;
+out:
+    lmgr_rebuild_unlock();
+    return rc;
+}
@@ -23,61 +23,73 @@
 #include "database.h"
 #include "rbh_logs.h"
 #include "rbh_misc.h"
+#include "Memory.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 
 
+/**
+ * Check if an entry exists in the main table.
+ * @retval DB_SUCCESS if it exists.
+ * @retval DB_END_OF_LIST if it doesn't.
+ */
+static int check_exists_by_pk(lmgr_t *p_mgr, PK_ARG_T pk)
+{
+    db_stmt_t  *stmt;
+    char       *str_id = NULL;
+    db_type_u   u;
+    int         rc;
+
+    stmt = lmgr_stmt_lookup(p_mgr, STMT_EXISTS, T_MAIN, null_mask);
+    if (stmt == NULL) {
+        rc = lmgr_stmt_prepare(p_mgr, STMT_EXISTS, T_MAIN, null_mask,
+                               "SELECT id FROM " MAIN_TABLE " WHERE id=?",
+                               &stmt);
+        if (rc)
+            return rc;
+    }
+
+    u.val_str = pk;
+    rc = db_stmt_bind(stmt, 0, PK_DB_TYPE, &u);
+    if (rc)
+        return rc;
+
+    rc = db_stmt_exec(stmt);
+    if (rc == DB_SUCCESS)
+        rc = db_stmt_next(stmt, &str_id, 1);
+    db_stmt_reset(stmt);
+
+    if (rc != DB_SUCCESS && rc != DB_END_OF_LIST)
+        lmgr_stmt_error(p_mgr, stmt, rc);
+    return rc;
+}
+
 int ListMgr_Exists(lmgr_t *p_mgr, const entry_id_t *p_id)
 {
-    GString        *req;
     int             rc;
-    result_handle_t result;
-    char           *str_count = NULL;
     DEF_PK(pk);
     int             retry_status;
 
     /* retrieve primary key */
     entry_id2pk(p_id, PTR_PK(pk));
 
+retry:
     /* verify it exists in main table */
-    req = g_string_new("SELECT id FROM " MAIN_TABLE " WHERE id=");
-    g_string_append_printf(req, DPK, pk);
+    rc = check_exists_by_pk(p_mgr, pk);
+    if (rc == DB_SUCCESS)
+        return 1; /* return 1 if entry exists */
+    else if (rc == DB_END_OF_LIST)
+        return 0;
 
-retry:
-    /* execute the request (must return negative value on error) */
-    rc = -db_exec_sql(&p_mgr->conn, req->str, &result);
-    retry_status = lmgr_delayed_retry(p_mgr, -rc);
+    retry_status = lmgr_delayed_retry(p_mgr, rc);
     if (retry_status == 1)
         goto retry;
-    else if (retry_status == 2) {
-        rc = -DB_RBH_SIG_SHUTDOWN;
-        goto free_str;
-    } else if (rc)
-        goto free_str;
-
-    rc = db_next_record(&p_mgr->conn, &result, &str_count, 1);
-    if (rc == 0)
-        rc = 1; /* return 1 if entry exists */
-    else if (rc != DB_END_OF_LIST)
-    {
-        retry_status = lmgr_delayed_retry(p_mgr, -rc);
-        if (retry_status == 1)
-            goto retry;
-        else if (retry_status == 2) {
-            rc = -DB_RBH_SIG_SHUTDOWN;
-            goto free_result;
-        }
-    }
-    else
-        rc = 0;
-
-free_result:
-    db_result_free(&p_mgr->conn, &result);
+    else if (retry_status == 2)
+        return -DB_RBH_SIG_SHUTDOWN;
 
-free_str:
-    g_string_free(req, TRUE);
-    return rc;
+    /* must return negative value on error */
+    return -rc;
 }
 
 /** retrieve directory attributes (nbr of entries, avg size of entries)*/
@@ -217,63 +229,296 @@ static void clean_std_table_bits(attr_mask_t *p_mask)
 }
 
 /**
- *  Retrieve entry attributes from its primary key
+ * Retrieve attributes that are not in main, annex and names tables
+ * (stripe info and directory attributes).
+ * @param[out] stripe_found indicates if stripe info was found for the entry.
  */
-int listmgr_get_by_pk( lmgr_t * p_mgr, PK_ARG_T pk, attr_set_t * p_info )
+static int get_stripe_and_dirattrs(lmgr_t *p_mgr, PK_ARG_T pk,
+                                   attr_set_t *p_info, bool *stripe_found)
 {
-    int             rc;
-    char           *first_table = NULL;
-    GString        *req, *from;
-    /* attribute count is up to 1 per bit (8 per byte).
-     * x2 for bullet proofing */
-    char           *result_tab[2*8*sizeof(p_info->attr_mask)];
-    result_handle_t result;
-    bool            checkmain   = true;
-    int             main_count  = 0,
-                    annex_count = 0,
-                    name_count  = 0;
-    attr_mask_t     gen = gen_fields(p_info->attr_mask);
+    *stripe_found = false;
 
-    if (p_info == NULL)
-        return 0;
+    /* remove stripe info if it is not a file */
+    if (stripe_fields(p_info->attr_mask) && ATTR_MASK_TEST(p_info, type)
+        && strcmp(ATTR(p_info, type), STR_TYPE_FILE) != 0)
+    {
+        p_info->attr_mask = attr_mask_and_not(&p_info->attr_mask, &stripe_attr_set);
+    }
 
-    /* init entry info */
-    memset(&p_info->attr_values, 0, sizeof(entry_info_t));
-    req = g_string_new("SELECT ");
-    from = g_string_new(" FROM ");
+    /* get stripe info if asked */
+#ifdef _LUSTRE
+    if (stripe_fields(p_info->attr_mask))
+    {
+        int rc;
 
-    /* retrieve source info for generated fields (only about std fields)*/
-    add_source_fields_for_gen(&p_info->attr_mask.std);
+        rc = get_stripe_info(p_mgr, pk, &ATTR(p_info, stripe_info),
+                             ATTR_MASK_TEST(p_info, stripe_items)?
+                                &ATTR(p_info, stripe_items) : NULL);
+        if (rc == DB_ATTR_MISSING || rc == DB_NOT_EXISTS)
+        {
+            /* stripe info is in std mask */
+            p_info->attr_mask.std &= ~ATTR_MASK_stripe_info;
 
-    /* don't get fields that are not in main, names, annex, stripe...
-     * This allows the caller to set all bits 'on' to get everything.
-     * Note: this also clear generated fields. They will be restored after.
-     */
-    supported_bits_only(&p_info->attr_mask);
+            if (ATTR_MASK_TEST(p_info, stripe_items))
+                p_info->attr_mask.std &= ~ATTR_MASK_stripe_items;
+        }
+        else if (rc)
+            return rc;
+        else
+            *stripe_found = true;
+    }
+#else
+    /* POSIX: always clean stripe bits */
+    p_info->attr_mask = attr_mask_and_not(&p_info->attr_mask, &stripe_attr_set);
+#endif
 
-    /* get info from main table (if asked) */
-    main_count = attrmask2fieldlist(req, p_info->attr_mask, T_MAIN, "", "", 0);
-    if (main_count < 0)
+    /* special field dircount */
+    if (dirattr_fields(p_info->attr_mask))
     {
-        rc = -main_count;
-        goto free_str;
+        if (listmgr_get_dirattrs(p_mgr, pk, p_info))
+        {
+            DisplayLog(LVL_MAJOR, LISTMGR_TAG, "listmgr_get_dirattrs failed for "DPK, pk);
+            p_info->attr_mask = attr_mask_and_not(&p_info->attr_mask, &dir_attr_set);
+        }
     }
-    else if (main_count > 0)
+    return DB_SUCCESS;
+}
+
+/** set directory attributes from the records of a grouped request
+ * (parent_id, value) */
+static int set_dirattrs_batch(lmgr_t *p_mgr, const char *req,
+                              GHashTable *pk_index, attr_set_t **p_attrs,
+                              unsigned int attr_index)
+{
+    result_handle_t result;
+    char           *str_info[2];
+    int             rc;
+
+    rc = db_exec_sql(&p_mgr->conn, req, &result);
+    if (rc)
+        return rc;
+
+    while ((rc = db_next_record(&p_mgr->conn, &result, str_info, 2))
+           == DB_SUCCESS) {
+        unsigned int idx;
+        attr_set_t  *p_info;
+
+        if (str_info[0] == NULL)
+            continue;
+        idx = GPOINTER_TO_UINT(g_hash_table_lookup(pk_index, str_info[0]));
+        if (idx == 0)
+            continue;
+        p_info = p_attrs[idx - 1];
+
+        /* NULL if no entry matches the criteria */
+        if (str_info[1] == NULL)
+            continue;
+
+        if (attr_index == ATTR_INDEX_dircount) {
+            int tmp_val = str2int(str_info[1]);
+
+            if (tmp_val == -1) {
+                rc = DB_REQUEST_FAILED;
+                break;
+            }
+            ATTR_MASK_SET(p_info, dircount);
+            ATTR(p_info, dircount) = tmp_val;
+        } else {
+            long long tmp_long = str2bigint(str_info[1]);
+
+            if (tmp_long == -1LL) {
+                rc = DB_REQUEST_FAILED;
+                break;
+            }
+            ATTR_MASK_SET(p_info, avgsize);
+            ATTR(p_info, avgsize) = tmp_long;
+        }
+    }
+    db_result_free(&p_mgr->conn, &result);
+
+    return (rc == DB_END_OF_LIST) ? DB_SUCCESS : rc;
+}
+
+/**
+ * Retrieve directory attributes of a set of directories,
+ * with one grouped request per attribute (see listmgr_get_dirattrs()).
+ */
+static int get_dirattrs_batch(lmgr_t *p_mgr, pktype *pklist,
+                              attr_set_t **p_attrs, unsigned int count)
+{
+    GHashTable  *pk_index;
+    GString     *req, *in;
+    unsigned int i;
+    bool         get_dircount = ATTR_MASK_TEST(p_attrs[0], dircount);
+    bool         get_avgsize = ATTR_MASK_TEST(p_attrs[0], avgsize);
+    int          rc = DB_SUCCESS;
+
+    /* pk => index in the arrays + 1 */
+    pk_index = g_hash_table_new(g_str_hash, g_str_equal);
+    in = g_string_new(NULL);
+    for (i = 0; i < count; i++) {
+        g_hash_table_insert(pk_index, pklist[i], GUINT_TO_POINTER(i + 1));
+        g_string_append_printf(in, i == 0 ? DPK : ","DPK, pklist[i]);
+
+        /* directories with no child are not returned by grouped requests:
+         * COUNT(*) is 0 and AVG() is NULL */
+        if (get_dircount) {
+            ATTR_MASK_SET(p_attrs[i], dircount);
+            ATTR(p_attrs[i], dircount) = 0;
+        }
+        ATTR_MASK_UNSET(p_attrs[i], avgsize);
+    }
+
+    req = g_string_new(NULL);
+    if (get_dircount) {
+        g_string_printf(req, "SELECT parent_id,%s FROM "DNAMES_TABLE
+                        " WHERE parent_id IN (%s) GROUP BY parent_id",
+                        dirattr2str(ATTR_INDEX_dircount), in->str);
+        rc = set_dirattrs_batch(p_mgr, req->str, pk_index, p_attrs,
+                                ATTR_INDEX_dircount);
+        if (rc)
+            goto out;
+    }
+
+    if (get_avgsize) {
+        g_string_printf(req, "SELECT d.parent_id,%s FROM "MAIN_TABLE" m, "
+                        DNAMES_TABLE" d WHERE m.id = d.id and type='file'"
+                        " and d.parent_id IN (%s) GROUP BY d.parent_id",
+                        dirattr2str(ATTR_INDEX_avgsize), in->str);
+        rc = set_dirattrs_batch(p_mgr, req->str, pk_index, p_attrs,
+                                ATTR_INDEX_avgsize);
+    }
+
+out:
+    g_string_free(req, TRUE);
+    g_string_free(in, TRUE);
+    g_hash_table_destroy(pk_index);
+    return rc;
+}
+
+/**
+ * Batched version of get_stripe_and_dirattrs(), for the entries of
+ * listmgr_get_batch() that were found (rcs[i] == DB_SUCCESS).
+ */
+static int get_stripe_and_dirattrs_batch(lmgr_t *p_mgr, pktype *pklist,
+                                         attr_set_t **p_attrs,
+                                         unsigned int count, const int *rcs)
+{
+    pktype      *sel_pks;
+    attr_set_t **sel_attrs;
+    unsigned int i, n;
+    int          rc = DB_SUCCESS;
+
+    sel_pks = MemCalloc(count, sizeof(*sel_pks));
+    sel_attrs = MemCalloc(count, sizeof(*sel_attrs));
+    if (sel_pks == NULL || sel_attrs == NULL) {
+        rc = DB_NO_MEMORY;
+        goto out;
+    }
+
+    /* stripe info of files */
+    n = 0;
+    for (i = 0; i < count; i++) {
+        attr_set_t *p_info = p_attrs[i];
+
+        if (rcs[i] != DB_SUCCESS || !stripe_fields(p_info->attr_mask))
+            continue;
+
+#ifdef _LUSTRE
+        if (!ATTR_MASK_TEST(p_info, type)
+            || strcmp(ATTR(p_info, type), STR_TYPE_FILE) == 0) {
+            rh_strncpy(sel_pks[n], pklist[i], sizeof(pktype));
+            sel_attrs[n] = p_info;
+            n++;
+            continue;
+        }
+#endif
+        p_info->attr_mask = attr_mask_and_not(&p_info->attr_mask,
+                                              &stripe_attr_set);
+    }
+
+#ifdef _LUSTRE
+    if (n > 0) {
+        bool *found = MemCalloc(n, sizeof(*found));
+
+        if (found == NULL) {
+            rc = DB_NO_MEMORY;
+            goto out;
+        }
+        rc = get_stripe_info_batch(p_mgr, sel_pks, sel_attrs, n, found);
+        if (rc == DB_SUCCESS) {
+            for (i = 0; i < n; i++) {
+                if (found[i])
+                    continue;
+                /* stripe info is in std mask */
+                sel_attrs[i]->attr_mask.std &= ~ATTR_MASK_stripe_info;
+                if (ATTR_MASK_TEST(sel_attrs[i], stripe_items))
+                    sel_attrs[i]->attr_mask.std &= ~ATTR_MASK_stripe_items;
+            }
+        }
+        MemFree(found);
+        if (rc)
+            goto out;
+    }
+#endif
+
+    /* special fields dircount and avgsize */
+    n = 0;
+    for (i = 0; i < count; i++) {
+        attr_set_t *p_info = p_attrs[i];
+
+        if (rcs[i] != DB_SUCCESS || !dirattr_fields(p_info->attr_mask))
+            continue;
+
+        if (ATTR_MASK_TEST(p_info, type)
+            && strcmp(ATTR(p_info, type), STR_TYPE_DIR) != 0) {
+            p_info->attr_mask = attr_mask_and_not(&p_info->attr_mask,
+                                                  &dir_attr_set);
+            continue;
+        }
+        rh_strncpy(sel_pks[n], pklist[i], sizeof(pktype));
+        sel_attrs[n] = p_info;
+        n++;
+    }
+
+    if (n > 0 && get_dirattrs_batch(p_mgr, sel_pks, sel_attrs, n)) {
+        DisplayLog(LVL_MAJOR, LISTMGR_TAG, "Failed to get directory "
+                   "attributes of %u entries", n);
+        for (i = 0; i < n; i++)
+            sel_attrs[i]->attr_mask =
+                attr_mask_and_not(&sel_attrs[i]->attr_mask, &dir_attr_set);
+    }
+
+out:
+    MemFree(sel_attrs);
+    MemFree(sel_pks);
+    return rc;
+}
+
+/**
+ * Build the request to get attributes from main, annex and names tables.
+ * The entry id is a parameter of the request.
+ */
+static void build_get_request(GString *req, attr_mask_t mask, int main_count,
+                              int annex_count, int name_count)
+{
+    GString    *from = g_string_new(" FROM ");
+    const char *first_table = NULL;
+
+    g_string_assign(req, "SELECT ");
+
+    /* get info from main table (if asked) */
+    if (main_count > 0)
     {
-        checkmain = false;
+        attrmask2fieldlist(req, mask, T_MAIN, "", "", 0);
         first_table = MAIN_TABLE;
         g_string_append(from, MAIN_TABLE);
     }
 
-    annex_count = attrmask2fieldlist(req, p_info->attr_mask, T_ANNEX, "", "",
-                                     first_table != NULL ? AOF_LEADING_SEP : 0);
-    if (annex_count < 0)
-    {
-        rc = -annex_count;
-        goto free_str;
-    }
-    else if (annex_count > 0)
+    if (annex_count > 0)
     {
+        attrmask2fieldlist(req, mask, T_ANNEX, "", "",
+                           first_table != NULL ? AOF_LEADING_SEP : 0);
         if (first_table != NULL)
             g_string_append_printf(from, " LEFT JOIN "ANNEX_TABLE" ON %s.id="
                                    ANNEX_TABLE".id", first_table);
@@ -284,15 +529,10 @@ int listmgr_get_by_pk( lmgr_t * p_mgr, PK_ARG_T pk, attr_set_t * p_info )
         }
     }
 
-    name_count = attrmask2fieldlist(req, p_info->attr_mask, T_DNAMES, "", "",
-                                    first_table != NULL ? AOF_LEADING_SEP : 0);
-    if (name_count < 0)
-    {
-        rc = -name_count;
-        goto free_str;
-    }
-    else if (name_count > 0)
+    if (name_count > 0)
     {
+        attrmask2fieldlist(req, mask, T_DNAMES, "", "",
+                           first_table != NULL ? AOF_LEADING_SEP : 0);
         if (first_table)
             /* it's OK to JOIN with NAMES table here even if there are multiple paths,
              * as we only take one result record. The important thing is to return
@@ -306,19 +546,85 @@ int listmgr_get_by_pk( lmgr_t * p_mgr, PK_ARG_T pk, attr_set_t * p_info )
         }
     }
 
-    if (first_table != NULL)
+    g_string_append_printf(req, "%s WHERE %s.id=?", from->str, first_table);
+    g_string_free(from, TRUE);
+}
+
+/**
+ *  Retrieve entry attributes from its primary key
+ */
+int listmgr_get_by_pk( lmgr_t * p_mgr, PK_ARG_T pk, attr_set_t * p_info )
+{
+    int             rc;
+    /* attribute count is up to 1 per bit (8 per byte).
+     * x2 for bullet proofing */
+    char           *result_tab[2*8*sizeof(p_info->attr_mask)];
+    db_stmt_t      *stmt = NULL;
+    bool            checkmain   = true;
+    bool            stripe_found = false;
+    int             main_count  = 0,
+                    annex_count = 0,
+                    name_count  = 0;
+    attr_mask_t     gen = gen_fields(p_info->attr_mask);
+    attr_mask_t     path_added;
+    bool            build_path;
+
+    if (p_info == NULL)
+        return 0;
+
+    /* init entry info */
+    memset(&p_info->attr_values, 0, sizeof(entry_info_t));
+
+    /* retrieve source info for generated fields (only about std fields)*/
+    add_source_fields_for_gen(&p_info->attr_mask.std);
+
+    /* don't get fields that are not in main, names, annex, stripe...
+     * This allows the caller to set all bits 'on' to get everything.
+     * Note: this also clear generated fields. They will be restored after.
+     */
+    supported_bits_only(&p_info->attr_mask);
+
+    /* build fullpath using the path cache rather than this_path() */
+    build_path = path_cache_fix_mask(&p_info->attr_mask, &path_added);
+
+    main_count = attrmask_nb_fields(p_info->attr_mask, T_MAIN);
+    annex_count = attrmask_nb_fields(p_info->attr_mask, T_ANNEX);
+    name_count = attrmask_nb_fields(p_info->attr_mask, T_DNAMES);
+
+    if (main_count > 0)
+        checkmain = false;
+
+    if (main_count + annex_count + name_count > 0)
     {
         int shift = 0;
+        db_type_u u;
 
-        g_string_append_printf(req, "%s WHERE %s.id="DPK, from->str,
-                               first_table, pk);
+        /* the request only depends on the attribute mask */
+        stmt = lmgr_stmt_lookup(p_mgr, STMT_GET, T_MAIN, p_info->attr_mask);
+        if (stmt == NULL)
+        {
+            GString *req = g_string_new(NULL);
 
-        rc = db_exec_sql(&p_mgr->conn, req->str, &result);
+            build_get_request(req, p_info->attr_mask, main_count, annex_count,
+                              name_count);
+            rc = lmgr_stmt_prepare(p_mgr, STMT_GET, T_MAIN, p_info->attr_mask,
+                                   req->str, &stmt);
+            g_string_free(req, TRUE);
+            if (rc)
+                goto out;
+        }
+
+        u.val_str = pk;
+        rc = db_stmt_bind(stmt, 0, PK_DB_TYPE, &u);
         if (rc)
-            goto free_str;
+            goto free_res;
+
+        rc = db_stmt_exec(stmt);
+        if (rc)
+            goto free_res;
 
-        rc = db_next_record(&p_mgr->conn, &result, result_tab,
-                            main_count + annex_count + name_count);
+        rc = db_stmt_next(stmt, result_tab,
+                          main_count + annex_count + name_count);
         /* END_OF_LIST means it does not exist */
         if (rc == DB_END_OF_LIST)
         {
@@ -359,68 +665,30 @@ int listmgr_get_by_pk( lmgr_t * p_mgr, PK_ARG_T pk, attr_set_t * p_info )
         }
 
 next_table:
-        db_result_free(&p_mgr->conn, &result);
-    }
-
-    /* remove stripe info if it is not a file */
-    if (stripe_fields(p_info->attr_mask) && ATTR_MASK_TEST(p_info, type)
-        && strcmp(ATTR(p_info, type), STR_TYPE_FILE) != 0)
-    {
-        p_info->attr_mask = attr_mask_and_not(&p_info->attr_mask, &stripe_attr_set);
-    }
-
-    /* get stripe info if asked */
-#ifdef _LUSTRE
-    if (stripe_fields(p_info->attr_mask))
-    {
-        rc = get_stripe_info(p_mgr, pk, &ATTR(p_info, stripe_info),
-                             ATTR_MASK_TEST(p_info, stripe_items)?
-                                &ATTR(p_info, stripe_items) : NULL);
-        if (rc == DB_ATTR_MISSING || rc == DB_NOT_EXISTS)
-        {
-            /* stripe info is in std mask */
-            p_info->attr_mask.std &= ~ATTR_MASK_stripe_info;
-
-            if (ATTR_MASK_TEST(p_info, stripe_items))
-                p_info->attr_mask.std &= ~ATTR_MASK_stripe_items;
-        }
-        else if (rc)
-            goto free_str;
-        else
-            checkmain = false; /* entry exists */
+        db_stmt_reset(stmt);
     }
-#else
-    /* POSIX: always clean stripe bits */
-    p_info->attr_mask = attr_mask_and_not(&p_info->attr_mask, &stripe_attr_set);
-#endif
 
-    /* special field dircount */
-    if (dirattr_fields(p_info->attr_mask))
-    {
-        if (listmgr_get_dirattrs(p_mgr, pk, p_info))
-        {
-            DisplayLog(LVL_MAJOR, LISTMGR_TAG, "listmgr_get_dirattrs failed for "DPK, pk);
-            p_info->attr_mask = attr_mask_and_not(&p_info->attr_mask, &dir_attr_set);
-        }
-    }
+    rc = get_stripe_and_dirattrs(p_mgr, pk, p_info, &stripe_found);
+    if (rc)
+        goto out;
+    if (stripe_found)
+        checkmain = false; /* entry exists */
 
     if (checkmain)
     {
         /* verify it exists in main table */
-        g_string_printf(req, "SELECT id FROM " MAIN_TABLE " WHERE id="DPK, pk);
-
-        /* execute the request */
-        rc = db_exec_sql(&p_mgr->conn, req->str, &result);
+        rc = check_exists_by_pk(p_mgr, pk);
+        if (rc == DB_END_OF_LIST)
+            rc = DB_NOT_EXISTS;
         if (rc)
-            goto free_str;
+            goto out;
+    }
 
-        rc = db_next_record(&p_mgr->conn, &result, result_tab, 1);
-        db_result_free(&p_mgr->conn, &result);
+    if (build_path)
+    {
+        rc = path_cache_build(p_mgr, p_info, path_added);
         if (rc)
-        {
-            rc = DB_NOT_EXISTS;
-            goto free_str;
-        }
+            goto out;
     }
 
     /* restore generated fields in attr mask */
@@ -431,14 +699,20 @@ next_table:
     /* update operation stats */
     p_mgr->nbop[OPIDX_GET]++;
 
-    rc = DB_SUCCESS;
-    goto free_str;
+    return DB_SUCCESS;
 
   free_res:
-    db_result_free(&p_mgr->conn, &result);
-  free_str:
-    g_string_free(req, TRUE);
-    g_string_free(from, TRUE);
+    db_stmt_reset(stmt);
+    /* the statement may no longer be valid */
+    if (rc != DB_NOT_EXISTS)
+        lmgr_stmt_error(p_mgr, stmt, rc);
+  out:
+    /* restore the requested mask, in case the request is retried */
+    if (build_path && rc != DB_NOT_EXISTS)
+    {
+        p_info->attr_mask = attr_mask_and_not(&p_info->attr_mask, &path_added);
+        p_info->attr_mask.std |= ATTR_MASK_fullpath;
+    }
     return rc;
 } /* listmgr_get_by_pk */
 
@@ -462,6 +736,218 @@ retry:
 }
 
 
+/**
+ * Retrieve attributes of a set of entries from their primary keys,
+ * using a single request on main, annex and names tables.
+ * All entries are assumed to request the same attributes.
+ */
+static int listmgr_get_batch(lmgr_t *p_mgr, pktype *pklist, attr_set_t **p_attrs,
+                             unsigned int count, int *rcs)
+{
+    int             rc, i, found;
+    GString        *req;
+    GHashTable     *pk_index;
+    attr_mask_t     mask = p_attrs[0]->attr_mask;
+    attr_mask_t     gen = gen_fields(mask);
+    /* id + up to 1 attribute per bit (8 per byte).
+     * x2 for bullet proofing */
+    char           *result_tab[1 + 2*8*sizeof(mask)];
+    result_handle_t result;
+    int             main_count, annex_count, name_count;
+    attr_mask_t     path_added;
+    bool            build_path;
+
+    /* retrieve source info for generated fields (only about std fields)*/
+    add_source_fields_for_gen(&mask.std);
+
+    /* don't get fields that are not in main, names, annex, stripe...
+     * Note: this also clear generated fields. They will be restored after.
+     */
+    supported_bits_only(&mask);
+
+    /* build fullpath using the path cache rather than this_path() */
+    build_path = path_cache_fix_mask(&mask, &path_added);
+
+    /* Main table is always queried, as it determines entry existence. */
+    req = g_string_new("SELECT "MAIN_TABLE".id");
+    /* pk => index in the arrays + 1 */
+    pk_index = g_hash_table_new(g_str_hash, g_str_equal);
+
+    main_count = attrmask2fieldlist(req, mask, T_MAIN, "", "", AOF_LEADING_SEP);
+    if (main_count < 0)
+    {
+        rc = -main_count;
+        goto free_str;
+    }
+    annex_count = attrmask2fieldlist(req, mask, T_ANNEX, "", "",
+                                     AOF_LEADING_SEP);
+    if (annex_count < 0)
+    {
+        rc = -annex_count;
+        goto free_str;
+    }
+    name_count = attrmask2fieldlist(req, mask, T_DNAMES, "", "",
+                                    AOF_LEADING_SEP);
+    if (name_count < 0)
+    {
+        rc = -name_count;
+        goto free_str;
+    }
+
+    g_string_append(req, " FROM "MAIN_TABLE);
+    if (annex_count > 0)
+        g_string_append(req, " LEFT JOIN "ANNEX_TABLE" ON "MAIN_TABLE".id="
+                        ANNEX_TABLE".id");
+    if (name_count > 0)
+        /* As in listmgr_get_by_pk(), only the first record is taken for
+         * entries with multiple paths. */
+        g_string_append(req, " LEFT JOIN "DNAMES_TABLE" ON "MAIN_TABLE".id="
+                        DNAMES_TABLE".id");
+
+    g_string_append(req, " WHERE "MAIN_TABLE".id IN (");
+    for (i = 0; i < count; i++)
+    {
+        g_string_append_printf(req, i == 0 ? DPK : ","DPK, pklist[i]);
+        g_hash_table_insert(pk_index, pklist[i], GUINT_TO_POINTER(i + 1));
+
+        /* init entry info */
+        memset(&p_attrs[i]->attr_values, 0, sizeof(entry_info_t));
+        ATTR_MASK_INIT(p_attrs[i]);
+        rcs[i] = DB_NOT_EXISTS;
+    }
+    g_string_append(req, ")");
+
+    rc = db_exec_sql(&p_mgr->conn, req->str, &result);
+    if (rc)
+        goto free_str;
+
+    found = 0;
+    while ((rc = db_next_record(&p_mgr->conn, &result, result_tab,
+                1 + main_count + annex_count + name_count)) == DB_SUCCESS)
+    {
+        int shift = 1;
+        attr_set_t *p_info;
+
+        if (result_tab[0] == NULL)
+            continue;
+
+        /* match the record with the requested entry */
+        i = (int)GPOINTER_TO_UINT(g_hash_table_lookup(pk_index,
+                                                      result_tab[0])) - 1;
+        /* unknown entry, or already got a record for this entry */
+        if (i < 0 || rcs[i] != DB_NOT_EXISTS)
+            continue;
+        p_info = p_attrs[i];
+
+        p_info->attr_mask = mask;
+
+        if (main_count)
+        {
+            rc = result2attrset(T_MAIN, result_tab + shift, main_count, p_info);
+            shift += main_count;
+            if (rc)
+                goto free_res;
+        }
+        if (annex_count)
+        {
+            rc = result2attrset(T_ANNEX, result_tab + shift, annex_count,
+                                p_info);
+            shift += annex_count;
+            if (rc)
+                goto free_res;
+        }
+        if (name_count)
+        {
+            rc = result2attrset(T_DNAMES, result_tab + shift, name_count,
+                                p_info);
+            shift += name_count;
+            if (rc)
+                goto free_res;
+        }
+        rcs[i] = DB_SUCCESS;
+        found++;
+    }
+
+    if (rc != DB_END_OF_LIST)
+        goto free_res;
+    db_result_free(&p_mgr->conn, &result);
+
+    /* get attributes from other tables */
+    rc = get_stripe_and_dirattrs_batch(p_mgr, pklist, p_attrs, count, rcs);
+    if (rc)
+        goto free_str;
+
+    for (i = 0; i < count; i++)
+    {
+        if (rcs[i] != DB_SUCCESS)
+            continue;
+
+        if (build_path)
+        {
+            rc = path_cache_build(p_mgr, p_attrs[i], path_added);
+            if (rc)
+                goto free_str;
+        }
+
+        /* restore generated fields in attr mask */
+        p_attrs[i]->attr_mask = attr_mask_or(&p_attrs[i]->attr_mask, &gen);
+        /* generate them */
+        generate_fields(p_attrs[i]);
+    }
+
+    /* update operation stats */
+    p_mgr->nbop[OPIDX_GET] += found;
+
+    rc = DB_SUCCESS;
+    goto free_str;
+
+  free_res:
+    db_result_free(&p_mgr->conn, &result);
+  free_str:
+    g_string_free(req, TRUE);
+    g_hash_table_destroy(pk_index);
+    return rc;
+}
+
+int ListMgr_GetBatch(lmgr_t *p_mgr, entry_id_t **p_ids, attr_set_t **p_attrs,
+                     unsigned int count, int *rcs)
+{
+    int          rc, i;
+    int          retry_status;
+    pktype      *pklist;
+    attr_mask_t  mask;
+
+    if (count == 0)
+        return DB_SUCCESS;
+
+    pklist = (pktype *)MemCalloc(count, sizeof(pktype));
+    if (pklist == NULL)
+        return DB_NO_MEMORY;
+
+    for (i = 0; i < count; i++)
+        entry_id2pk(p_ids[i], PTR_PK(pklist[i]));
+
+    /* the requested mask is overwritten by listmgr_get_batch() */
+    mask = p_attrs[0]->attr_mask;
+retry:
+    rc = listmgr_get_batch(p_mgr, pklist, p_attrs, count, rcs);
+    retry_status = lmgr_delayed_retry(p_mgr, rc);
+    if (retry_status == 1)
+    {
+        for (i = 0; i < count; i++)
+        {
+            ListMgr_FreeAttrs(p_attrs[i]);
+            p_attrs[i]->attr_mask = mask;
+        }
+        goto retry;
+    }
+    else if (retry_status == 2)
+        rc = DB_RBH_SIG_SHUTDOWN;
+
+    MemFree(pklist);
+    return rc;
+}
+
 /* Retrieve the FID from the database given the parent FID and the file name. */
 int ListMgr_Get_FID_from_Path( lmgr_t * p_mgr, const entry_id_t * parent_fid,
                                const char *name, entry_id_t * fid)
@@ -0,0 +1,427 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * vim:expandtab:shiftwidth=4:tabstop=4:
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the CeCILL License.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL license (http://www.cecill.info) and that you
+ * accept its terms.
+ */
+/**
+ * Management of secondary indexes.
+ *
+ * Secondary indexes are maintained according to an index profile
+ * (full, minimal or advised). The advice is based on the filters actually
+ * generated by reports and policies: each process counts the filter
+ * conditions on each field, and adds them to counters in the VARS table.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "list_mgr.h"
+#include "listmgr_internal.h"
+#include "listmgr_common.h"
+#include "database.h"
+#include "rbh_logs.h"
+#include "rbh_misc.h"
+#include "Memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* min delay between 2 writes of usage counters (except at disconnection) */
+#define INDEX_USAGE_FLUSH_INTERVAL  60
+/* an index is advised for fields used by at least 1% of filter conditions */
+#define INDEX_ADVICE_MIN_PERCENT    1
+
+/* filter conditions on each field, not yet written to the DB
+ * (same layout as attr_mask_t) */
+static unsigned int usage_std[32];
+static unsigned int usage_status[32];
+static unsigned int usage_sminfo[64];
+static time_t last_usage_flush = 0;
+
+static unsigned int *usage_counter(unsigned int attr_index)
+{
+    if (is_status(attr_index))
+        return &usage_status[attr2status_index(attr_index)];
+    else if (is_sm_info(attr_index))
+        return &usage_sminfo[attr2sminfo_index(attr_index)];
+    else if (attr_index < ATTR_COUNT)
+        return &usage_std[attr_index];
+    return NULL;
+}
+
+void listmgr_index_usage(unsigned int attr_index)
+{
+    unsigned int *cnt;
+
+    if (!is_indexable_field(attr_index))
+        return;
+
+    cnt = usage_counter(attr_index);
+    if (cnt != NULL)
+        __sync_fetch_and_add(cnt, 1);
+}
+
+void listmgr_index_usage_flush(db_conn_t *pconn, bool force)
+{
+    char query[1024];
+    time_t now = time(NULL);
+    int i, cookie;
+
+    if (!force && now - last_usage_flush < INDEX_USAGE_FLUSH_INTERVAL)
+        return;
+    last_usage_flush = now;
+
+    cookie = -1;
+    while ((i = attr_index_iter(0, &cookie)) != -1) {
+        unsigned int *cnt = usage_counter(i);
+        unsigned int n;
+
+        if (cnt == NULL || *cnt == 0)
+            continue;
+
+        n = __sync_fetch_and_and(cnt, 0);
+        if (n == 0)
+            continue;
+
+        snprintf(query, sizeof(query), "INSERT INTO " VAR_TABLE
+                 " (varname,value) VALUES ('" INDEX_USAGE_VAR "%s','%u') "
+                 "ON DUPLICATE KEY UPDATE value=value+%u", field_name(i), n,
+                 n);
+        if (db_exec_sql_quiet(pconn, query, NULL) != DB_SUCCESS)
+            /* try again next time */
+            __sync_fetch_and_add(cnt, n);
+    }
+}
+
+/** get the table, indexed column and index name for a field */
+static const char *field_index(unsigned int attr_index, const char **column,
+                               char *index, size_t index_size)
+{
+#ifdef _LUSTRE
+    if (attr_index == ATTR_INDEX_stripe_items) {
+        *column = "ostidx";
+        rh_strncpy(index, "ost_index", index_size);
+        return STRIPE_ITEMS_TABLE;
+    }
+#endif
+    *column = field_name(attr_index);
+    snprintf(index, index_size, "%s_index", *column);
+
+    if (is_main_field(attr_index))
+        return MAIN_TABLE;
+    else if (is_names_field(attr_index))
+        return DNAMES_TABLE;
+    else
+        return ANNEX_TABLE;
+}
+
+/** check if an index exists */
+static bool index_exists(db_conn_t *pconn, const char *table,
+                         const char *index)
+{
+    char request[1024];
+    result_handle_t result;
+    char *str_count = NULL;
+    bool exists = false;
+
+#ifdef _MYSQL
+    snprintf(request, sizeof(request), "SELECT COUNT(*) FROM "
+             "information_schema.statistics WHERE table_schema=DATABASE() "
+             "AND table_name='%s' AND index_name='%s'", table, index);
+#else
+    snprintf(request, sizeof(request), "SELECT COUNT(*) FROM sqlite_master "
+             "WHERE type='index' AND tbl_name='%s' AND name='%s'", table,
+             index);
+#endif
+    if (db_exec_sql(pconn, request, &result) != DB_SUCCESS)
+        return false;
+
+    if (db_next_record(pconn, &result, &str_count, 1) == DB_SUCCESS
+        && str_count != NULL)
+        exists = (atoi(str_count) > 0);
+
+    db_result_free(pconn, &result);
+    return exists;
+}
+
+/** create (create=true) or drop (create=false) the index of a field,
+ * if needed */
+static int set_index(db_conn_t *pconn, unsigned int attr_index, bool create)
+{
+    char request[1024];
+    char index[128];
+    char errmsg[1024];
+    const char *table, *column;
+    int rc;
+
+    table = field_index(attr_index, &column, index, sizeof(index));
+    if (index_exists(pconn, table, index) == create)
+        return DB_SUCCESS;
+
+    if (create) {
+        DisplayLog(LVL_EVENT, LISTMGR_TAG, "Building index on %s(%s)...",
+                   table, column);
+        snprintf(request, sizeof(request), "CREATE INDEX %s ON %s(%s)",
+                 index, table, column);
+    } else {
+#ifdef _MYSQL
+        snprintf(request, sizeof(request), "DROP INDEX %s ON %s", index,
+                 table);
+#else
+        snprintf(request, sizeof(request), "DROP INDEX %s", index);
+#endif
+    }
+
+    rc = db_exec_sql(pconn, request, NULL);
+    if (rc != DB_SUCCESS) {
+        DisplayLog(LVL_CRIT, LISTMGR_TAG,
+                   "Failed to %s index of %s(%s): Error: %s",
+                   create ? "create" : "drop", table, column,
+                   db_errmsg(pconn, errmsg, sizeof(errmsg)));
+        return rc;
+    }
+    DisplayLog(LVL_EVENT, LISTMGR_TAG, "Index on %s(%s) %s", table, column,
+               create ? "created" : "dropped");
+    return DB_SUCCESS;
+}
+
+/**
+ * Indexes needed to retrieve and remove entries (primary keys, id index
+ * of NAMES and STRIPE_ITEMS, indexes of INDEXED fields like
+ * NAMES.parent_id) are not affected.
+ */
+int listmgr_set_indexes(db_conn_t *pconn, const attr_mask_t *mask)
+{
+    int i, rc, cookie;
+
+    cookie = -1;
+    while ((i = attr_index_iter(0, &cookie)) != -1) {
+        if (!is_indexable_field(i))
+            continue;
+
+        rc = set_index(pconn, i, attr_mask_test_index(mask, i));
+        if (rc)
+            return rc;
+    }
+    return DB_SUCCESS;
+}
+
+static int index_advice(db_conn_t *pconn, index_advice_t **advice,
+                        unsigned int *count)
+{
+    char varname[256];
+    char value[128];
+    char index[128];
+    unsigned long long total = 0;
+    unsigned int n = 0;
+    int i, rc, cookie;
+
+    /* take the last filters of this process into account */
+    listmgr_index_usage_flush(pconn, true);
+
+    *advice = MemCalloc(ATTR_COUNT + sm_inst_count + sm_attr_count,
+                        sizeof(**advice));
+    if (*advice == NULL)
+        return DB_NO_MEMORY;
+
+    cookie = -1;
+    while ((i = attr_index_iter(0, &cookie)) != -1) {
+        index_advice_t *curr = &(*advice)[n];
+
+        if (!is_indexable_field(i))
+            continue;
+
+        snprintf(varname, sizeof(varname), INDEX_USAGE_VAR "%s",
+                 field_name(i));
+        rc = lmgr_get_var(pconn, varname, value, sizeof(value));
+        if (rc == DB_SUCCESS)
+            curr->uses = str2bigint(value);
+        else if (rc == DB_NOT_EXISTS)
+            curr->uses = 0;
+        else
+            goto free_err;
+
+        curr->attr_index = i;
+        curr->table = field_index(i, &curr->field, index, sizeof(index));
+        curr->indexed = index_exists(pconn, curr->table, index);
+
+        /* only list fields that are used or indexed */
+        if (curr->uses == 0 && !curr->indexed)
+            continue;
+
+        total += curr->uses;
+        n++;
+    }
+
+    for (i = 0; i < n; i++)
+        (*advice)[i].advised = (*advice)[i].uses > 0
+            && (*advice)[i].uses * 100 >= total * INDEX_ADVICE_MIN_PERCENT;
+
+    *count = n;
+    return DB_SUCCESS;
+
+free_err:
+    MemFree(*advice);
+    *advice = NULL;
+    return rc;
+}
+
+/** get the mask of indexed fields for a profile */
+static int profile_mask(db_conn_t *pconn, index_profile_e profile,
+                        attr_mask_t *mask)
+{
+    index_advice_t *advice;
+    unsigned int i, count;
+    int rc;
+
+    *mask = null_mask;
+
+    /* indexes of INDEXED fields are part of the schema, and are kept
+     * whatever the profile (see is_indexable_field()) */
+    if (profile == INDEX_PROFILE_MINIMAL)
+        return DB_SUCCESS;
+
+#ifdef _LUSTRE
+    /* optional index of the default schema */
+    if (profile == INDEX_PROFILE_FULL)
+        attr_mask_set_index(mask, ATTR_INDEX_stripe_items);
+#endif
+
+    rc = index_advice(pconn, &advice, &count);
+    if (rc)
+        return rc;
+
+    for (i = 0; i < count; i++)
+        if (advice[i].advised)
+            attr_mask_set_index(mask, advice[i].attr_index);
+
+    MemFree(advice);
+    return DB_SUCCESS;
+}
+
+static int apply_index_profile(db_conn_t *pconn, index_profile_e profile)
+{
+    attr_mask_t mask;
+    int rc;
+
+    rc = profile_mask(pconn, profile, &mask);
+    if (rc)
+        return rc;
+
+    return listmgr_set_indexes(pconn, &mask);
+}
+
+static int get_index_profile(db_conn_t *pconn, index_profile_e *profile)
+{
+    char value[128];
+    int rc;
+
+    rc = lmgr_get_var(pconn, INDEX_PROFILE_VAR, value, sizeof(value));
+    if (rc == DB_NOT_EXISTS) {
+        *profile = INDEX_PROFILE_FULL;
+        return DB_SUCCESS;
+    } else if (rc)
+        return rc;
+
+    rc = str2index_profile(value);
+    if (rc == -1) {
+        DisplayLog(LVL_MAJOR, LISTMGR_TAG, "Invalid value for DB variable "
+                   INDEX_PROFILE_VAR ": '%s'", value);
+        return DB_INVALID_ARG;
+    }
+    *profile = rc;
+    return DB_SUCCESS;
+}
+
+int listmgr_apply_index_profile(db_conn_t *pconn)
+{
+    index_profile_e profile;
+    int rc;
+
+    rc = get_index_profile(pconn, &profile);
+    if (rc)
+        return rc;
+
+    return apply_index_profile(pconn, profile);
+}
+
+const char *index_profile2str(index_profile_e profile)
+{
+    switch (profile) {
+    case INDEX_PROFILE_FULL:
+        return "full";
+    case INDEX_PROFILE_MINIMAL:
+        return "minimal";
+    case INDEX_PROFILE_ADVISED:
+        return "advised";
+    }
+    return "?";
+}
+
+int str2index_profile(const char *str)
+{
+    if (!strcasecmp(str, "full"))
+        return INDEX_PROFILE_FULL;
+    else if (!strcasecmp(str, "minimal"))
+        return INDEX_PROFILE_MINIMAL;
+    else if (!strcasecmp(str, "advised"))
+        return INDEX_PROFILE_ADVISED;
+    return -1;
+}
+
+int ListMgr_GetIndexProfile(lmgr_t *p_mgr, index_profile_e *profile)
+{
+    int rc;
+ retry:
+    rc = get_index_profile(&p_mgr->conn, profile);
+    if (lmgr_delayed_retry(p_mgr, rc) == 1)
+        goto retry;
+    return rc;
+}
+
+int ListMgr_SetIndexProfile(lmgr_t *p_mgr, index_profile_e profile)
+{
+    char value[128];
+    int rc;
+
+    /* indexes are built at the end of the load */
+    if (lmgr_get_var(&p_mgr->conn, DEFERRED_INDEXES_VAR, value,
+                     sizeof(value)) == DB_SUCCESS) {
+        DisplayLog(LVL_MAJOR, LISTMGR_TAG, "Cannot change index profile "
+                   "during an initial load of the database");
+        return DB_NOT_ALLOWED;
+    }
+
+ retry:
+    rc = apply_index_profile(&p_mgr->conn, profile);
+    if (lmgr_delayed_retry(p_mgr, rc) == 1)
+        goto retry;
+    else if (rc)
+        return rc;
+
+    rc = lmgr_set_var(&p_mgr->conn, INDEX_PROFILE_VAR,
+                      index_profile2str(profile));
+    if (lmgr_delayed_retry(p_mgr, rc) == 1)
+        goto retry;
+    else if (rc == DB_SUCCESS)
+        DisplayLog(LVL_EVENT, LISTMGR_TAG, "Index profile set to '%s'",
+                   index_profile2str(profile));
+    return rc;
+}
+
+int ListMgr_IndexAdvice(lmgr_t *p_mgr, index_advice_t **advice,
+                        unsigned int *count)
+{
+    int rc;
+ retry:
+    rc = index_advice(&p_mgr->conn, advice, count);
+    if (lmgr_delayed_retry(p_mgr, rc) == 1)
+        goto retry;
+    return rc;
+}
@@ -177,7 +177,7 @@ static void init_default_field_values(void)
     }
 }
 
-static const db_type_u *default_field_value(int attr_index)
+const db_type_u *default_field_value(int attr_index)
 {
     switch (attr_index) {
     case ATTR_INDEX_type:
@@ -1913,9 +1913,72 @@ static int check_table_acct(db_conn_t *pconn, bool *affects_trig)
     return rc;
 }
 
-static int populate_acct_table(db_conn_t *pconn)
+/** build a request that sums entries into ACCT_STAT, grouped by
+ * accounting key (only the entries in ids, if not NULL) */
+static void append_acct_insert_select(GString *request, const char *ids)
 {
-    int i, rc;
+    int i;
+
+    /* INSERT <fields>... */
+    g_string_append(request, "INSERT INTO " ACCT_TABLE "(");
+    attrmask2fieldlist(request, acct_pk_attr_set, T_ACCT, "", "", 0);
+    attrmask2fieldlist(request, acct_attr_set, T_ACCT, "", "", AOF_LEADING_SEP);
+    g_string_append(request, ", " ACCT_FIELD_COUNT);
+    append_size_range_fields(request, true, "");
+
+    /* ...SELECT <fields>... */
+    g_string_append(request, ") SELECT ");
+    attrmask2fieldlist(request, acct_pk_attr_set, T_ACCT, "", "", 0);
+    attrmask2fieldlist(request, acct_attr_set, T_ACCT, "SUM(", ")",
+                       AOF_LEADING_SEP);
+    g_string_append(request, ",COUNT(id),SUM(size=0)");
+    for (i = 1; i < SZ_PROFIL_COUNT - 1; i++)   /* 1 to 8 */
+        g_string_append_printf(request, ",SUM(" SZRANGE_FUNC "(size)=%u)",
+                               i - 1);
+    g_string_append_printf(request, ",SUM(" SZRANGE_FUNC "(size)>=%u)", i - 1);
+
+    /* FROM ... [WHERE ...] GROUP BY ... */
+    g_string_append_printf(request, " FROM %s ", acct_info_table);
+    if (ids != NULL)
+        g_string_append_printf(request, "WHERE id IN (%s) ", ids);
+    g_string_append(request, "GROUP BY ");
+    attrmask2fieldlist(request, acct_pk_attr_set, T_ACCT, "", "", 0);
+}
+
+int acct_table_sub(db_conn_t *pconn, const char *ids)
+{
+    GString *request;
+    int i, rc, cookie;
+
+    if (acct_info_table == NULL)
+        RBH_BUG("Can't update " ACCT_TABLE " with no source table");
+
+    /* accounted entries have a row: subtract their sums from it */
+    request = g_string_new(NULL);
+    append_acct_insert_select(request, ids);
+    g_string_append(request, " ON DUPLICATE KEY UPDATE ");
+
+    cookie = -1;
+    while ((i = attr_index_iter(0, &cookie)) != -1) {
+        if (!is_acct_field(i))
+            continue;
+        g_string_append_printf(request, "%s=CAST(%s as SIGNED)-VALUES(%s),",
+                               field_name(i), field_name(i), field_name(i));
+    }
+    g_string_append(request, ACCT_FIELD_COUNT "=CAST(" ACCT_FIELD_COUNT
+                    " as SIGNED)-VALUES(" ACCT_FIELD_COUNT ")");
+    for (i = 0; i < SZ_PROFIL_COUNT; i++)
+        g_string_append_printf(request, ",%s=CAST(%s as SIGNED)-VALUES(%s)",
+                               sz_field[i], sz_field[i], sz_field[i]);
+
+    rc = db_exec_sql(pconn, request->str, NULL);
+    g_string_free(request, TRUE);
+    return rc;
+}
+
+int populate_acct_table(db_conn_t *pconn)
+{
+    int rc;
     GString *request = NULL;
     char err_buf[1024];
     char timestr[256] = "";
@@ -1937,27 +2000,8 @@ static int populate_acct_table(db_conn_t *pconn)
     FlushLogs();
 
     /* Initial table population for already existing entries */
-    /* INSERT <fields>... */
-    request = g_string_new("INSERT INTO " ACCT_TABLE "(");
-    attrmask2fieldlist(request, acct_pk_attr_set, T_ACCT, "", "", 0);
-    attrmask2fieldlist(request, acct_attr_set, T_ACCT, "", "", AOF_LEADING_SEP);
-    g_string_append(request, ", " ACCT_FIELD_COUNT);
-    append_size_range_fields(request, true, "");
-
-    /* ...SELECT <fields>... */
-    g_string_append(request, ") SELECT ");
-    attrmask2fieldlist(request, acct_pk_attr_set, T_ACCT, "", "", 0);
-    attrmask2fieldlist(request, acct_attr_set, T_ACCT, "SUM(", ")",
-                       AOF_LEADING_SEP);
-    g_string_append(request, ",COUNT(id),SUM(size=0)");
-    for (i = 1; i < SZ_PROFIL_COUNT - 1; i++)   /* 1 to 8 */
-        g_string_append_printf(request, ",SUM(" SZRANGE_FUNC "(size)=%u)",
-                               i - 1);
-    g_string_append_printf(request, ",SUM(" SZRANGE_FUNC "(size)>=%u)", i - 1);
-
-    /* FROM ... GROUP BY ... */
-    g_string_append_printf(request, " FROM %s  GROUP BY ", acct_info_table);
-    attrmask2fieldlist(request, acct_pk_attr_set, T_ACCT, "", "", 0);
+    request = g_string_new(NULL);
+    append_acct_insert_select(request, NULL);
 
     rc = db_exec_sql(pconn, request->str, NULL);
     g_string_free(request, TRUE);
@@ -2041,6 +2085,95 @@ static int create_table_acct(db_conn_t *pconn, bool *affects_trig)
     return rc;
 }
 
+static int check_table_dirstat(db_conn_t *pconn, bool *affects_trig)
+{
+    int rc;
+    char strbuf[4096];
+    char *fieldtab[MAX_DB_FIELDS];
+
+    rc = db_list_table_info(pconn, DIR_STAT_TABLE, fieldtab, NULL, NULL,
+                            MAX_DB_FIELDS, strbuf, sizeof(strbuf));
+    if (rc == DB_SUCCESS) {
+        int curr_index = 0;
+
+        /* report only: use the table if the daemon maintains it */
+        if (report_only) {
+            lmgr_config.dir_stat = true;
+            return DB_SUCCESS;
+        }
+
+        /* it would become inconsistent if it is not maintained */
+        if (!lmgr_config.dir_stat) {
+            DisplayLog(LVL_MAJOR, LISTMGR_TAG,
+                       "dir_stat is disabled: dropping table " DIR_STAT_TABLE);
+
+            rc = db_drop_component(pconn, DBOBJ_TABLE, DIR_STAT_TABLE);
+            if (rc != DB_SUCCESS)
+                DisplayLog(LVL_CRIT, LISTMGR_TAG,
+                           "Failed to drop table: Error: %s",
+                           db_errmsg(pconn, strbuf, sizeof(strbuf)));
+            return rc;
+        }
+
+        if (check_field_name("id", &curr_index, DIR_STAT_TABLE, fieldtab)
+            || check_field_name(field_name(ATTR_INDEX_type), &curr_index,
+                                DIR_STAT_TABLE, fieldtab)
+            || check_field_name("count", &curr_index, DIR_STAT_TABLE,
+                                fieldtab)
+            || check_field_name("size", &curr_index, DIR_STAT_TABLE, fieldtab)
+            || check_field_name("blocks", &curr_index, DIR_STAT_TABLE,
+                                fieldtab)
+            || has_extra_field(curr_index, DIR_STAT_TABLE, fieldtab, true))
+            return DB_BAD_SCHEMA;
+    } else if (rc == DB_NOT_EXISTS) {
+        if (report_only) {
+            /* not maintained: rbh-du must walk the namespace */
+            lmgr_config.dir_stat = false;
+            return DB_SUCCESS;
+        }
+    } else {
+        DisplayLog(LVL_CRIT, LISTMGR_TAG,
+                   "Error checking database schema: %s",
+                   db_errmsg(pconn, strbuf, sizeof(strbuf)));
+    }
+    return rc;
+}
+
+static int create_table_dirstat(db_conn_t *pconn, bool *affects_trig)
+{
+    GString *request;
+    int rc;
+
+    if (!lmgr_config.dir_stat)
+        return DB_SUCCESS;
+
+    /* signed values, as they are updated with deltas */
+    request = g_string_new("CREATE TABLE " DIR_STAT_TABLE " (id " PK_TYPE);
+    append_field_def(pconn, ATTR_INDEX_type, request, false);
+    g_string_append_printf(request, ", count BIGINT DEFAULT 0, "
+                           "size BIGINT DEFAULT 0, blocks BIGINT DEFAULT 0, "
+                           "PRIMARY KEY (id, %s))", field_name(ATTR_INDEX_type));
+    append_engine(request);
+
+    rc = run_create_table(pconn, DIR_STAT_TABLE, request->str);
+    g_string_free(request, TRUE);
+    if (rc)
+        return rc;
+
+    /* now populate it */
+    rc = dirstat_populate(pconn);
+    if (rc) {
+        char err_buf[1024];
+
+        /* if DIR_STAT_TABLE exists, it must be populated */
+        if (db_drop_component(pconn, DBOBJ_TABLE, DIR_STAT_TABLE))
+            DisplayLog(LVL_CRIT, LISTMGR_TAG,
+                       "Failed to drop table: Error: %s",
+                       db_errmsg(pconn, err_buf, sizeof(err_buf)));
+    }
+    return rc;
+}
+
 static int check_table_softrm(db_conn_t *pconn, bool *affects_trig)
 {
     int rc, cookie;
@@ -2199,6 +2332,12 @@ static int set_functions_version(db_conn_t *conn)
     return rc;
 }
 
+/** indicate if accounting is maintained by triggers */
+static inline bool acct_triggers(void)
+{
+    return lmgr_config.acct && lmgr_config.acct_mode == ACCT_MODE_TRIGGERS;
+}
+
 static int check_triggers_version(db_conn_t *pconn, bool *affects_trig)
 {
     int rc;
@@ -2209,6 +2348,10 @@ static int check_triggers_version(db_conn_t *pconn, bool *affects_trig)
         DisplayLog(LVL_VERB, LISTMGR_TAG,
                    "Accounting is disabled: all triggers will be dropped.");
         return DB_SUCCESS;
+    } else if (!acct_triggers() && !report_only) {
+        DisplayLog(LVL_VERB, LISTMGR_TAG,
+                   "Accounting is batched: all triggers will be dropped.");
+        return DB_SUCCESS;
     } else if (report_only)
         return DB_SUCCESS;  /* don't care about triggers */
 
@@ -2256,8 +2399,8 @@ static int check_trig_acct_insert(db_conn_t *pconn, bool *affects_trig)
     int rc;
     char strbuf[4096];
 
-    if (!lmgr_config.acct) {
-        /* no acct: must delete trigger */
+    if (!acct_triggers()) {
+        /* no acct or batched acct: must delete trigger */
         if (!report_only) {
             DisplayLog(LVL_DEBUG, LISTMGR_TAG, "Dropping trigger %s",
                        ACCT_TRIGGER_INSERT);
@@ -2285,8 +2428,8 @@ static int check_trig_acct_delete(db_conn_t *pconn, bool *affects_trig)
 {
     int rc;
     char strbuf[4096];
-    if (!lmgr_config.acct) {
-        /* no acct: must delete trigger */
+    if (!acct_triggers()) {
+        /* no acct or batched acct: must delete trigger */
         if (!report_only) {
             DisplayLog(LVL_DEBUG, LISTMGR_TAG, "Dropping trigger %s",
                        ACCT_TRIGGER_DELETE);
@@ -2314,8 +2457,8 @@ static int check_trig_acct_update(db_conn_t *pconn, bool *affects_trig)
 {
     int rc;
     char strbuf[4096];
-    if (!lmgr_config.acct) {
-        /* no acct: must delete trigger */
+    if (!acct_triggers()) {
+        /* no acct or batched acct: must delete trigger */
         if (!report_only) {
             DisplayLog(LVL_DEBUG, LISTMGR_TAG, "Dropping trigger %s",
                        ACCT_TRIGGER_UPDATE);
@@ -2751,6 +2894,7 @@ static const dbobj_descr_t o_list[] = {
     {DBOBJ_FUNCTION, SZRANGE_FUNC, check_func_szrange, create_func_szrange},
 
     {DBOBJ_TABLE, ACCT_TABLE, check_table_acct, create_table_acct},
+    {DBOBJ_TABLE, DIR_STAT_TABLE, check_table_dirstat, create_table_dirstat},
 #ifdef _LUSTRE
     {DBOBJ_TABLE, STRIPE_INFO_TABLE, check_table_stripe_info,
      create_table_stripe_info},
@@ -2786,6 +2930,7 @@ int ListMgr_Init(enum lmgr_init_flags flags)
     bool create_all_functions = false;
     bool create_all_triggers = false;
     bool dummy;
+    char strbuf[128];
 
     /* store the parameter as a global variable */
     init_flags = flags;
@@ -2869,6 +3014,24 @@ int ListMgr_Init(enum lmgr_init_flags flags)
             goto close_conn;
     }
 
+    /* build the indexes dropped by an interrupted bulk load */
+    if (!report_only && lmgr_get_var(&conn, DEFERRED_INDEXES_VAR, strbuf,
+                                     sizeof(strbuf)) == DB_SUCCESS) {
+        DisplayLog(LVL_EVENT, LISTMGR_TAG, "Building secondary indexes "
+                   "(an initial load of the database was interrupted)");
+        rc = listmgr_apply_index_profile(&conn);
+        if (rc)
+            goto close_conn;
+        lmgr_set_var(&conn, DEFERRED_INDEXES_VAR, NULL);
+    }
+
+    /* recover accounting changes lost by a crashed process */
+    if (!report_only) {
+        rc = listmgr_acct_recover(&conn);
+        if (rc)
+            goto close_conn;
+    }
+
     rc = DB_SUCCESS;
 
  close_conn:
@@ -2907,6 +3070,11 @@ int ListMgr_InitAccess(lmgr_t *p_mgr)
     for (i = 0; i < OPCOUNT; i++)
         p_mgr->nbop[i] = 0;
 
+    p_mgr->dirstat_pending = NULL;
+
+    /* statements are prepared on first use */
+    p_mgr->stmt_cache = NULL;
+
     return 0;
 }
 
@@ -2914,9 +3082,19 @@ int ListMgr_CloseAccess(lmgr_t *p_mgr)
 {
     int rc;
 
+    /* write pending accounting changes */
+    listmgr_acct_close(p_mgr);
+    /* and filter usage counters */
+    listmgr_index_usage_flush(&p_mgr->conn, true);
+
     /* force to commit queued requests */
     rc = lmgr_flush_commit(p_mgr);
 
+    /* release prepared statements before closing the connection */
+    lmgr_stmt_cache_free(p_mgr);
+    /* usage changes reported for no transaction */
+    listmgr_dirstat_discard(p_mgr);
+
     /* close connexion */
     db_close_conn(&p_mgr->conn);
 
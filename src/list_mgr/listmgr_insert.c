@@ -80,6 +80,95 @@ static bool entry_filter(table_enum table, bool update,
     }
 }
 
+/**
+ * Insert a single entry in the given table, using a prepared statement.
+ * Arguments are the same as run_batch_insert().
+ * The request is identified by the table and the attribute mask:
+ * id_is_pk and extra_field_name only depend on the table.
+ */
+static int run_single_insert(lmgr_t *p_mgr,
+                             attr_mask_t full_mask,
+                             PK_ARG_T pk, const attr_set_t *p_attrs,
+                             table_enum table,
+                             bool update, bool id_is_pk,
+                             const char* extra_field_name,
+                             const char* extra_field_value)
+{
+    lmgr_stmt_op_e  op = update ? STMT_UPSERT : STMT_INSERT;
+    db_stmt_t      *stmt;
+    unsigned int    pos = 0;
+    db_type_u       u;
+    int             rc;
+
+    if (!entry_filter(table, update, pk, p_attrs))
+        return DB_SUCCESS;
+
+    stmt = lmgr_stmt_lookup(p_mgr, op, table, full_mask);
+    if (stmt == NULL)
+    {
+        GString *req = g_string_new("INSERT INTO ");
+
+        g_string_append_printf(req, "%s(id", table2name(table));
+
+        /* do nothing if no field is to be set */
+        if ((attrmask2fieldlist(req, full_mask, table, "", "",
+                                AOF_LEADING_SEP) <= 0)
+            && (extra_field_name == NULL))
+        {
+            g_string_free(req, TRUE);
+            return DB_SUCCESS;
+        }
+
+        if (extra_field_name != NULL)
+            g_string_append_printf(req,",%s) VALUES (?", extra_field_name);
+        else
+            g_string_append(req, ") VALUES (?");
+
+        attrset2valuelist(p_mgr, req, p_attrs, table,
+                          AOF_LEADING_SEP | AOF_PLACEHOLDER);
+
+        if (extra_field_value != NULL)
+            g_string_append_printf(req,",%s)", extra_field_value);
+        else
+            g_string_append(req,")");
+
+        if (update)
+        {
+            /* fake attribute struct, to write "field=VALUES(field)"
+             * based on full_mask attr mask */
+            attr_set_t  fake_attrs = *p_attrs;
+
+            g_string_append(req, " ON DUPLICATE KEY UPDATE ");
+            /* explicitely update the id if it is not part of the pk */
+            if (!id_is_pk)
+                g_string_append(req, "id=VALUES(id),");
+
+            fake_attrs.attr_mask = full_mask;
+            attrset2updatelist(p_mgr, req, &fake_attrs, table, AOF_GENERIC_VAL);
+        }
+
+        rc = lmgr_stmt_prepare(p_mgr, op, table, full_mask, req->str, &stmt);
+        g_string_free(req, TRUE);
+        if (rc)
+            return rc;
+    }
+
+    u.val_str = pk;
+    rc = db_stmt_bind(stmt, pos++, PK_DB_TYPE, &u);
+    if (rc)
+        return rc;
+
+    rc = attrset2bindlist(stmt, &pos, p_attrs, table);
+    if (rc < 0)
+        return -rc;
+
+    rc = db_stmt_exec(stmt);
+    db_stmt_reset(stmt);
+    if (rc)
+        lmgr_stmt_error(p_mgr, stmt, rc);
+    return rc;
+}
+
 /**
  * Build and execute a batch insert request for the given table.
  * @param full_mask     the sum of all entries attribute masks
@@ -105,6 +194,12 @@ static int run_batch_insert(lmgr_t *p_mgr,
     if (unlikely(extra_field_name != NULL && extra_field_value == NULL))
         return DB_INVALID_ARG;
 
+    /* the request for a single entry is always the same for a given mask */
+    if (count == 1)
+        return run_single_insert(p_mgr, full_mask, pklist[0], p_attrs[0],
+                                 table, update, id_is_pk, extra_field_name,
+                                 extra_field_value);
+
     /* build batch request for the table */
     req = g_string_new("INSERT INTO ");
     g_string_append_printf(req, "%s(id", table2name(table));
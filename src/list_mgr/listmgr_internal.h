@@ -87,11 +87,48 @@ int listmgr_batch_insert_no_tx(lmgr_t *p_mgr, entry_id_t **p_ids,
 int listmgr_remove_no_tx(lmgr_t *p_mgr, const entry_id_t *p_id,
                          const attr_set_t *p_attr_set, bool last);
 
+/** build the secondary indexes of the fields in mask, drop the others */
+int listmgr_set_indexes(db_conn_t *pconn, const attr_mask_t *mask);
+
+/** build and drop secondary indexes according to the current index
+ * profile (see ListMgr_SetIndexProfile) */
+int listmgr_apply_index_profile(db_conn_t *pconn);
+
+/** write the filter usage counters of this process to the database
+ * (if force is false, only if the last write is old enough) */
+void listmgr_index_usage_flush(db_conn_t *pconn, bool force);
+
+/** DB variable set while secondary indexes are dropped for a bulk load */
+#define DEFERRED_INDEXES_VAR "DeferredIndexes"
+/** prefix of DB variables set while a process has unwritten accounting
+ * changes (batched accounting) */
+#define ACCT_PENDING_VAR     "AcctPending_"
+/** DB variable for the current index profile */
+#define INDEX_PROFILE_VAR    "IndexProfile"
+/** prefix of DB variables counting filters on each field */
+#define INDEX_USAGE_VAR      "IndexUsage_"
+
+/** Result of a list request (iterator, report...), buffered in client memory
+ * or streamed from the database. */
+typedef struct lmgr_list_result_t {
+    result_handle_t     select_result;  /* buffered result */
+    struct db_stream   *stream;         /* streamed result (NULL if buffered) */
+} lmgr_list_result_t;
+
+/** execute a list request (streamed if stream is true) */
+int listmgr_list_exec(lmgr_t *p_mgr, const char *query, bool stream,
+                      bool quiet, lmgr_list_result_t *p_res);
+/** get the next record of a list request */
+int listmgr_list_next(lmgr_t *p_mgr, lmgr_list_result_t *p_res,
+                      char *outtab[], unsigned int outtabsize);
+/** free the result of a list request */
+void listmgr_list_free(lmgr_t *p_mgr, lmgr_list_result_t *p_res);
+
 typedef struct lmgr_iterator_t {
-    lmgr_t          *p_mgr;
-    lmgr_iter_opt_t  opt;
-    result_handle_t  select_result;
-    unsigned int     opt_is_set:1;
+    lmgr_t            *p_mgr;
+    lmgr_iter_opt_t    opt;
+    lmgr_list_result_t result;
+    unsigned int       opt_is_set:1;
 } lmgr_iterator_t;
 
 #ifdef _LUSTRE
@@ -195,6 +195,38 @@ static int select_all_request(lmgr_t *p_mgr, GString *req,
     return DB_SUCCESS;
 }
 
+int listmgr_list_exec(lmgr_t *p_mgr, const char *query, bool stream,
+                      bool quiet, lmgr_list_result_t *p_res)
+{
+    p_res->stream = NULL;
+
+    if (stream)
+        return db_stream_open(&p_mgr->conn, query, quiet, &p_res->stream);
+    else if (quiet)
+        return db_exec_sql_quiet(&p_mgr->conn, query, &p_res->select_result);
+    else
+        return db_exec_sql(&p_mgr->conn, query, &p_res->select_result);
+}
+
+int listmgr_list_next(lmgr_t *p_mgr, lmgr_list_result_t *p_res,
+                      char *outtab[], unsigned int outtabsize)
+{
+    if (p_res->stream != NULL)
+        return db_stream_next(p_res->stream, outtab, outtabsize);
+    else
+        return db_next_record(&p_mgr->conn, &p_res->select_result, outtab,
+                              outtabsize);
+}
+
+void listmgr_list_free(lmgr_t *p_mgr, lmgr_list_result_t *p_res)
+{
+    if (p_res->stream != NULL) {
+        db_stream_close(p_res->stream);
+        p_res->stream = NULL;
+    } else
+        db_result_free(&p_mgr->conn, &p_res->select_result);
+}
+
 /** get an iterator on a list of entries */
 struct lmgr_iterator_t *ListMgr_Iterator(lmgr_t *p_mgr,
                                          const lmgr_filter_t *p_filter,
@@ -346,7 +378,8 @@ struct lmgr_iterator_t *ListMgr_Iterator(lmgr_t *p_mgr,
     }
 
     /* execute request */
-    rc = db_exec_sql(&p_mgr->conn, req->str, &it->select_result);
+    rc = listmgr_list_exec(p_mgr, req->str, p_opt && p_opt->stream, false,
+                           &it->result);
     if (rc)
         goto free_it;
 
@@ -390,8 +423,7 @@ int ListMgr_GetNext(struct lmgr_iterator_t *p_iter, entry_id_t *p_id,
         entry_disappeared = false;
 
         idstr[0] = idstr[1] = idstr[2] = NULL;
-        rc = db_next_record(&p_iter->p_mgr->conn, &p_iter->select_result, idstr,
-                            3);
+        rc = listmgr_list_next(p_iter->p_mgr, &p_iter->result, idstr, 3);
 
         if (rc)
             return rc;
@@ -438,6 +470,8 @@ int ListMgr_GetNext(struct lmgr_iterator_t *p_iter, entry_id_t *p_id,
 
 void ListMgr_CloseIterator(struct lmgr_iterator_t *p_iter)
 {
-    db_result_free(&p_iter->p_mgr->conn, &p_iter->select_result);
+    listmgr_list_free(p_iter->p_mgr, &p_iter->result);
+    /* the connection is available again (streamed results) */
+    listmgr_index_usage_flush(&p_iter->p_mgr->conn, false);
     MemFree(p_iter);
 }
@@ -0,0 +1,480 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * vim:expandtab:shiftwidth=4:tabstop=4:
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the CeCILL License.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL license (http://www.cecill.info) and that you
+ * accept its terms.
+ */
+/**
+ * Client-side cache of directory paths.
+ *
+ * Instead of calling the this_path() stored function for each entry, which
+ * walks up the NAMES table for every path component, entry paths are built
+ * from their parent_id and name, using a LRU cache of directory paths.
+ * Only the directories that are not in cache are resolved in the database.
+ *
+ * Paths are cached in database format (relative path prefixed by the root
+ * id), so they are built exactly as this_path() does.
+ * The cache is shared by all the threads of the process. It is invalidated
+ * by the entry processor when it applies a directory rename or removal.
+ * As changes applied by other processes are not seen, the cache is only
+ * enabled in processes that run the entry processor (see
+ * ListMgr_EnablePathCache()). Other processes (e.g. policy runs apart from
+ * the changelog reader, or reporting commands) use this_path().
+ * It also keeps the parent of each directory, to walk up the ancestors of
+ * an entry (see the DIR_STAT table).
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "list_mgr.h"
+#include "listmgr_internal.h"
+#include "listmgr_common.h"
+#include "database.h"
+#include "rbh_logs.h"
+#include "rbh_misc.h"
+#include "Memory.h"
+
+#include <pthread.h>
+
+typedef struct path_node {
+    char   *key;    /* primary key of the directory */
+    char   *path;   /* path of the directory, in DB format */
+    pktype  parent; /* primary key of its parent */
+    bool    parent_top; /* the parent has no name in the database */
+    GList   link;   /* link in the LRU list (data points to the node) */
+} path_node_t;
+
+static struct path_cache {
+    pthread_mutex_t lock;
+    GHashTable     *nodes;  /* pk => path_node_t */
+    GQueue          lru;    /* most recently used first */
+    /* incremented by invalidations: paths resolved before an invalidation
+     * are not inserted in the cache */
+    unsigned int    generation;
+
+    /* statistics */
+    unsigned long long nb_hits;
+    unsigned long long nb_misses;
+    unsigned long long nb_db_lookups;
+    unsigned long long nb_invalidations;
+} path_cache = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .nodes = NULL,
+    .lru = G_QUEUE_INIT,
+};
+
+/** set by ListMgr_EnablePathCache() */
+static bool path_cache_enabled = false;
+
+/* one level walked up the namespace */
+typedef struct path_step {
+    pktype  pk;
+    char    name[RBH_NAME_MAX];
+} path_step_t;
+
+static void path_node_free(gpointer data)
+{
+    path_node_t *node = data;
+
+    free(node->key);
+    free(node->path);
+    MemFree(node);
+}
+
+/** must be called with the cache lock held */
+static void path_cache_init(void)
+{
+    if (path_cache.nodes == NULL)
+        path_cache.nodes = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                 NULL, path_node_free);
+}
+
+/**
+ * Get the path of a directory from the cache.
+ * @param[out] gen the cache generation at lookup time.
+ * @return true if the path was found.
+ */
+static bool path_cache_lookup(const char *pk, char *path, unsigned int *gen)
+{
+    path_node_t *node;
+    bool         found = false;
+
+    P(path_cache.lock);
+    path_cache_init();
+    *gen = path_cache.generation;
+
+    node = g_hash_table_lookup(path_cache.nodes, pk);
+    if (node != NULL) {
+        /* move it to the head of the LRU list */
+        g_queue_unlink(&path_cache.lru, &node->link);
+        g_queue_push_head_link(&path_cache.lru, &node->link);
+
+        strcpy(path, node->path);
+        path_cache.nb_hits++;
+        found = true;
+    } else
+        path_cache.nb_misses++;
+    V(path_cache.lock);
+
+    return found;
+}
+
+/**
+ * Get the parent of a directory from the cache.
+ * @param[out] top true if the parent has no name in the database.
+ * @return true if the directory was found.
+ */
+static bool path_cache_parent(const char *pk, char *parent, bool *top)
+{
+    path_node_t *node;
+    bool         found = false;
+
+    P(path_cache.lock);
+    path_cache_init();
+
+    node = g_hash_table_lookup(path_cache.nodes, pk);
+    if (node != NULL) {
+        strcpy(parent, node->parent);
+        *top = node->parent_top;
+        found = true;
+    }
+    V(path_cache.lock);
+
+    return found;
+}
+
+/**
+ * Insert the path of a directory in the cache, if it was not invalidated
+ * since the given generation.
+ */
+static void path_cache_insert(const char *pk, const char *parent,
+                              bool parent_top, const char *path,
+                              unsigned int gen)
+{
+    path_node_t *node;
+
+    P(path_cache.lock);
+    if (gen != path_cache.generation)
+        goto out;
+
+    node = g_hash_table_lookup(path_cache.nodes, pk);
+    if (node != NULL) {
+        if (strcmp(node->path, path) != 0) {
+            free(node->path);
+            node->path = strdup(path);
+        }
+        rh_strncpy(node->parent, parent, sizeof(node->parent));
+        node->parent_top = parent_top;
+        goto out;
+    }
+
+    node = MemAlloc(sizeof(*node));
+    if (node == NULL)
+        goto out;
+    node->key = strdup(pk);
+    node->path = strdup(path);
+    rh_strncpy(node->parent, parent, sizeof(node->parent));
+    node->parent_top = parent_top;
+    node->link.data = node;
+    node->link.prev = node->link.next = NULL;
+
+    g_hash_table_insert(path_cache.nodes, node->key, node);
+    g_queue_push_head_link(&path_cache.lru, &node->link);
+
+    /* drop the least recently used entry */
+    if (path_cache.lru.length > lmgr_config.path_cache_size) {
+        GList *last = g_queue_pop_tail_link(&path_cache.lru);
+
+        g_hash_table_remove(path_cache.nodes, ((path_node_t *)last->data)->key);
+    }
+out:
+    V(path_cache.lock);
+}
+
+void ListMgr_EnablePathCache(void)
+{
+    if (lmgr_config.path_cache_size == 0)
+        return;
+
+    path_cache_enabled = true;
+    DisplayLog(LVL_DEBUG, LISTMGR_TAG, "Path cache enabled (%u directories)",
+               lmgr_config.path_cache_size);
+}
+
+void ListMgr_InvalidatePath(const entry_id_t *p_id, bool subtree)
+{
+    DEF_PK(pk);
+
+    if (!path_cache_enabled)
+        return;
+
+    entry_id2pk(p_id, PTR_PK(pk));
+
+    P(path_cache.lock);
+    path_cache_init();
+    path_cache.generation++;
+    path_cache.nb_invalidations++;
+
+    if (subtree) {
+        /* cached paths don't keep track of their ancestors:
+         * drop all paths */
+        g_hash_table_remove_all(path_cache.nodes);
+        g_queue_init(&path_cache.lru);
+    } else {
+        path_node_t *node = g_hash_table_lookup(path_cache.nodes, pk);
+
+        if (node != NULL) {
+            g_queue_unlink(&path_cache.lru, &node->link);
+            g_hash_table_remove(path_cache.nodes, pk);
+        }
+    }
+    V(path_cache.lock);
+
+    DisplayLog(LVL_FULL, LISTMGR_TAG, "Path cache invalidated for "DPK
+               " (subtree=%s)", pk, bool2str(subtree));
+}
+
+void ListMgr_DumpPathCacheStats(void)
+{
+    unsigned long long hits, misses, lookups, inval;
+    unsigned int       count;
+
+    if (!path_cache_enabled)
+        return;
+
+    P(path_cache.lock);
+    hits = path_cache.nb_hits;
+    misses = path_cache.nb_misses;
+    lookups = path_cache.nb_db_lookups;
+    inval = path_cache.nb_invalidations;
+    count = path_cache.lru.length;
+    V(path_cache.lock);
+
+    DisplayLog(LVL_MAJOR, "STATS", "==== Path cache statistics ====");
+    DisplayLog(LVL_MAJOR, "STATS", "cached dirs = %u/%u", count,
+               lmgr_config.path_cache_size);
+    DisplayLog(LVL_MAJOR, "STATS", "hits        = %llu", hits);
+    DisplayLog(LVL_MAJOR, "STATS", "misses      = %llu", misses);
+    if (hits + misses > 0)
+        DisplayLog(LVL_MAJOR, "STATS", "hit ratio   = %.2f%%",
+                   100.0 * hits / (hits + misses));
+    DisplayLog(LVL_MAJOR, "STATS", "DB lookups  = %llu", lookups);
+    DisplayLog(LVL_MAJOR, "STATS", "invalidations = %llu", inval);
+}
+
+/**
+ * Get the parent and the name of a directory.
+ * @retval DB_NOT_EXISTS if the directory has no name in the database.
+ */
+static int get_parent_name(lmgr_t *p_mgr, PK_ARG_T pk, path_step_t *step)
+{
+    db_stmt_t  *stmt;
+    char       *res[2];
+    db_type_u   u;
+    int         rc;
+
+    stmt = lmgr_stmt_lookup(p_mgr, STMT_GET_PARENT, T_DNAMES, null_mask);
+    if (stmt == NULL) {
+        rc = lmgr_stmt_prepare(p_mgr, STMT_GET_PARENT, T_DNAMES, null_mask,
+                               "SELECT parent_id,name FROM " DNAMES_TABLE
+                               " WHERE id=? LIMIT 1", &stmt);
+        if (rc)
+            return rc;
+    }
+
+    u.val_str = pk;
+    rc = db_stmt_bind(stmt, 0, PK_DB_TYPE, &u);
+    if (rc)
+        return rc;
+
+    rc = db_stmt_exec(stmt);
+    if (rc == DB_SUCCESS)
+        rc = db_stmt_next(stmt, res, 2);
+
+    if (rc == DB_SUCCESS) {
+        if (res[0] == NULL || res[1] == NULL)
+            rc = DB_NOT_EXISTS;
+        else {
+            rh_strncpy(step->pk, res[0], sizeof(step->pk));
+            rh_strncpy(step->name, res[1], sizeof(step->name));
+        }
+    } else if (rc == DB_END_OF_LIST)
+        rc = DB_NOT_EXISTS;
+    db_stmt_reset(stmt);
+
+    __sync_fetch_and_add(&path_cache.nb_db_lookups, 1);
+
+    if (rc != DB_SUCCESS && rc != DB_NOT_EXISTS)
+        lmgr_stmt_error(p_mgr, stmt, rc);
+    return rc;
+}
+
+/**
+ * Build the path of a directory, in DB format (like this_path()).
+ * Directories that are not in cache are resolved in the database and
+ * added to the cache.
+ * @param[out] path buffer of RBH_PATH_MAX bytes.
+ * @retval DB_BUFFER_TOO_SMALL if the path is too long.
+ */
+static int dir_path(lmgr_t *p_mgr, PK_ARG_T dir_pk, char *path)
+{
+    GArray         *steps;
+    path_step_t     step;
+    unsigned int    gen, gen_tmp, len = 0;
+    bool            top = false;
+    int             i, rc = DB_SUCCESS;
+
+    if (path_cache_lookup(dir_pk, path, &gen))
+        return DB_SUCCESS;
+
+    /* walk up the namespace until a cached directory is found */
+    steps = g_array_new(FALSE, FALSE, sizeof(path_step_t));
+    rh_strncpy(step.pk, dir_pk, sizeof(step.pk));
+
+    for (;;) {
+        path_step_t parent;
+
+        rc = get_parent_name(p_mgr, step.pk, &parent);
+        if (rc == DB_NOT_EXISTS) {
+            /* like this_path(): the path starts with the id of the
+             * first unknown parent */
+            strcpy(path, step.pk);
+            top = true;
+            rc = DB_SUCCESS;
+            break;
+        } else if (rc)
+            goto out;
+
+        /* the name of step is the name of the current directory */
+        rh_strncpy(step.name, parent.name, sizeof(step.name));
+        g_array_append_val(steps, step);
+
+        /* also protects against loops in the namespace */
+        len += strlen(step.name) + 1;
+        if (len >= RBH_PATH_MAX) {
+            DisplayLog(LVL_MAJOR, LISTMGR_TAG, "Path of "DPK" is too long "
+                       "(loop in namespace?)", dir_pk);
+            rc = DB_BUFFER_TOO_SMALL;
+            goto out;
+        }
+
+        rh_strncpy(step.pk, parent.pk, sizeof(step.pk));
+        /* keep the generation of the first lookup */
+        if (path_cache_lookup(step.pk, path, &gen_tmp))
+            break;
+    }
+
+    if (strlen(path) + len >= RBH_PATH_MAX) {
+        DisplayLog(LVL_MAJOR, LISTMGR_TAG, "Path of "DPK" is too long",
+                   dir_pk);
+        rc = DB_BUFFER_TOO_SMALL;
+        goto out;
+    }
+
+    /* build the paths down to the directory, and cache them
+     * (step.pk is now the parent of the upper step) */
+    for (i = steps->len - 1; i >= 0; i--) {
+        path_step_t *s = &g_array_index(steps, path_step_t, i);
+
+        strcat(path, "/");
+        strcat(path, s->name);
+        path_cache_insert(s->pk, step.pk, top, path, gen);
+
+        rh_strncpy(step.pk, s->pk, sizeof(step.pk));
+        top = false;
+    }
+
+out:
+    g_array_free(steps, TRUE);
+    return rc;
+}
+
+int path_cache_ancestors(lmgr_t *p_mgr, PK_ARG_T dir_pk, GArray *ancestors)
+{
+    char        path[RBH_PATH_MAX];
+    pktype      pk;
+    path_step_t parent;
+    bool        top;
+    int         rc;
+
+    /* resolving the path of the directory loads its ancestors in cache */
+    if (path_cache_enabled) {
+        rc = dir_path(p_mgr, dir_pk, path);
+        if (rc)
+            return rc;
+    }
+
+    rh_strncpy(pk, dir_pk, sizeof(pk));
+    for (;;) {
+        g_array_append_val(ancestors, pk);
+
+        /* each level takes at least 2 characters in a path */
+        if (ancestors->len > RBH_PATH_MAX / 2) {
+            DisplayLog(LVL_MAJOR, LISTMGR_TAG, "Too many ancestors for "DPK
+                       " (loop in namespace?)", dir_pk);
+            return DB_BUFFER_TOO_SMALL;
+        }
+
+        if (path_cache_parent(pk, parent.pk, &top)) {
+            if (top) {
+                g_array_append_val(ancestors, parent.pk);
+                break;
+            }
+        } else {
+            rc = get_parent_name(p_mgr, pk, &parent);
+            if (rc == DB_NOT_EXISTS)
+                break;
+            else if (rc)
+                return rc;
+        }
+        rh_strncpy(pk, parent.pk, sizeof(pk));
+    }
+    return DB_SUCCESS;
+}
+
+bool path_cache_fix_mask(attr_mask_t *p_mask, attr_mask_t *p_added)
+{
+    *p_added = null_mask;
+
+    if (!path_cache_enabled || !(p_mask->std & ATTR_MASK_fullpath))
+        return false;
+
+    p_mask->std &= ~ATTR_MASK_fullpath;
+    p_added->std = (ATTR_MASK_parent_id | ATTR_MASK_name) & ~p_mask->std;
+    p_mask->std |= ATTR_MASK_parent_id | ATTR_MASK_name;
+    return true;
+}
+
+int path_cache_build(lmgr_t *p_mgr, attr_set_t *p_info, attr_mask_t added)
+{
+    char    path[RBH_PATH_MAX];
+    DEF_PK(parent_pk);
+    int     rc;
+
+    /* same as this_path(NULL, NULL) */
+    if (ATTR_MASK_TEST(p_info, parent_id) && ATTR_MASK_TEST(p_info, name)) {
+        entry_id2pk(&ATTR(p_info, parent_id), PTR_PK(parent_pk));
+
+        rc = dir_path(p_mgr, parent_pk, path);
+        if (rc == DB_SUCCESS
+            && strlen(path) + strlen(ATTR(p_info, name)) + 1 < RBH_PATH_MAX) {
+            strcat(path, "/");
+            strcat(path, ATTR(p_info, name));
+
+            fullpath_db2attr(path, ATTR(p_info, fullpath));
+            ATTR_MASK_SET(p_info, fullpath);
+        } else if (rc != DB_SUCCESS && rc != DB_BUFFER_TOO_SMALL)
+            return rc;
+    }
+
+    /* only return the fields the caller asked for */
+    p_info->attr_mask = attr_mask_and_not(&p_info->attr_mask, &added);
+    return DB_SUCCESS;
+}
@@ -423,7 +423,7 @@ struct lmgr_iterator_t *ListMgr_RecovResume(lmgr_t *p_mgr, const char *dir_path,
     it->p_mgr = p_mgr;
 
     /* execute request */
-    rc = db_exec_sql(&p_mgr->conn, query, &it->select_result);
+    rc = listmgr_list_exec(p_mgr, query, false, false, &it->result);
 
     if (rc) {
         MemFree(it);
@@ -470,7 +470,7 @@ struct lmgr_iterator_t *ListMgr_RecovList(lmgr_t *p_mgr, recov_type_e st)
     it->p_mgr = p_mgr;
 
     /* execute request */
-    rc = db_exec_sql(&p_mgr->conn, query, &it->select_result);
+    rc = listmgr_list_exec(p_mgr, query, false, false, &it->result);
 
     if (rc) {
         MemFree(it);
@@ -491,8 +491,8 @@ int ListMgr_RecovGetNext(struct lmgr_iterator_t *p_iter,
     do {
         entry_disappeared = false;
 
-        rc = db_next_record(&p_iter->p_mgr->conn, &p_iter->select_result,
-                            result_tab, RECOV_FIELD_COUNT + 2);
+        rc = listmgr_list_next(p_iter->p_mgr, &p_iter->result,
+                               result_tab, RECOV_FIELD_COUNT + 2);
         if (rc)
             return rc;
         if (result_tab[0] == NULL)  /* no id? */
@@ -29,22 +29,137 @@
 #include <pthread.h>
 
 
+/** range of primary keys for chunked mass removal */
+struct pk_range {
+    const char *after;  /**< exclusive lower bound */
+    const char *upto;   /**< inclusive upper bound (NULL if none) */
+};
+
+/** append a condition on a range of primary keys to a where clause */
+static void append_pk_range(GString *where, const char *prefix,
+                            const struct pk_range *range)
+{
+    if (range == NULL)
+        return;
+
+    g_string_append_printf(where, " AND %sid>"DPK, prefix, range->after);
+    if (range->upto != NULL)
+        g_string_append_printf(where, " AND %sid<="DPK, prefix, range->upto);
+}
+
+/** entries and names to be kept by a mass removal */
+struct rm_keep {
+    rm_keep_func_t  func;
+    void           *arg;
+};
+
+/** remove the names returned by a request, except those to be kept */
+static int clean_names_keep(lmgr_t *p_mgr, const char *select,
+                            const struct rm_keep *keep)
+{
+    result_handle_t result;
+    char           *field_tab[7];
+    GString        *req;
+    DEF_PK(pk);
+    DEF_PK(ppk);
+    int             rc;
+
+    rc = db_exec_sql(&p_mgr->conn, select, &result);
+    if (rc)
+        return rc;
+
+    req = g_string_new(NULL);
+
+    while ((rc = db_next_record(&p_mgr->conn, &result, field_tab, 7))
+                == DB_SUCCESS)
+    {
+        entry_id_t id, parent_id;
+
+        if (field_tab[0] == NULL || field_tab[1] == NULL
+            || field_tab[2] == NULL || field_tab[3] == NULL)
+            continue;
+
+        rc = parse_entry_id(p_mgr, field_tab[0], PTR_PK(pk), &id);
+        if (rc)
+            break;
+        rc = parse_entry_id(p_mgr, field_tab[1], PTR_PK(ppk), &parent_id);
+        if (rc)
+            break;
+
+        if (keep->func(&id, &parent_id, field_tab[2], keep->arg))
+            continue;
+
+        /* names with no entry account for nothing */
+        if (lmgr_config.dir_stat && field_tab[4] != NULL)
+        {
+            rc = listmgr_dirstat_sub_name(p_mgr, field_tab[1],
+                                          db2type(field_tab[4]), 1,
+                                          field_tab[5] ?
+                                            strtoll(field_tab[5], NULL, 10) : 0,
+                                          field_tab[6] ?
+                                            strtoll(field_tab[6], NULL, 10) : 0);
+            if (rc)
+                break;
+        }
+
+        g_string_printf(req, "DELETE FROM "DNAMES_TABLE" WHERE pkn='%s'",
+                        field_tab[3]);
+        rc = db_exec_sql(&p_mgr->conn, req->str, NULL);
+        if (rc)
+            break;
+    }
+
+    db_result_free(&p_mgr->conn, &result);
+    g_string_free(req, TRUE);
+
+    return (rc == DB_END_OF_LIST) ? DB_SUCCESS : rc;
+}
+
 static int clean_names(lmgr_t *p_mgr, const lmgr_filter_t *p_filter,
+                       const struct pk_range *range,
+                       const struct rm_keep *keep,
                        unsigned int *nb_filter_names)
 {
     int      rc = DB_SUCCESS;
-    GString *req;
+    GString *where, *req;
 
-    req = g_string_new("DELETE FROM "DNAMES_TABLE" WHERE ");
-    *nb_filter_names = filter2str(p_mgr, req, p_filter, T_DNAMES, 0);
+    where = g_string_new(NULL);
+    *nb_filter_names = filter2str(p_mgr, where, p_filter, T_DNAMES, 0);
 
     if (*nb_filter_names == 0)
+    {
+        g_string_free(where, TRUE);
+        return DB_SUCCESS;
+    }
+
+    append_pk_range(where, "", range);
+    req = g_string_new(NULL);
+
+    if (keep != NULL)
+    {
+        DisplayLog(LVL_DEBUG, LISTMGR_TAG, "Selective deletion in "DNAMES_TABLE" table");
+        /* with what each name accounts for in its ancestors */
+        g_string_printf(req, "SELECT N.id,N.parent_id,N.name,N.pkn,E.type,"
+                        "E.size,E.blocks FROM (SELECT id,parent_id,name,pkn"
+                        " FROM "DNAMES_TABLE" WHERE %s) N LEFT JOIN "MAIN_TABLE
+                        " E ON N.id=E.id", where->str);
+        rc = clean_names_keep(p_mgr, req->str, keep);
+        goto out;
+    }
+
+    /* subtract the removed names from their ancestors */
+    g_string_printf(req, "SELECT id,parent_id FROM "DNAMES_TABLE" WHERE %s",
+                    where->str);
+    rc = listmgr_dirstat_sub_names(p_mgr, req->str);
+    if (rc)
         goto out;
 
     DisplayLog(LVL_DEBUG, LISTMGR_TAG, "Direct deletion in "DNAMES_TABLE" table");
+    g_string_printf(req, "DELETE FROM "DNAMES_TABLE" WHERE %s", where->str);
     rc = db_exec_sql(&p_mgr->conn, req->str, NULL);
 out:
     g_string_free(req, TRUE);
+    g_string_free(where, TRUE);
     return rc;
 }
 
@@ -273,6 +388,22 @@ static int listmgr_rm_all(lmgr_t * p_mgr)
     if (rc)
         return rc;
 
+    if (lmgr_config.dir_stat)
+    {
+        listmgr_dirstat_discard(p_mgr);
+        rc = db_exec_sql(&p_mgr->conn, "DELETE FROM " DIR_STAT_TABLE, NULL);
+        if (rc)
+            return rc;
+    }
+
+    /* with triggers, it is updated by the deletion */
+    if (lmgr_acct_batched())
+    {
+        rc = db_exec_sql(&p_mgr->conn, "DELETE FROM " ACCT_TABLE, NULL);
+        if (rc)
+            return rc;
+    }
+
     return DB_SUCCESS;
 }
 
@@ -472,11 +603,67 @@ static int create_tmp_table_rm(lmgr_t *p_mgr, const lmgr_filter_t *p_filter,
 
 #define MAX_SOFTRM_FIELDS 128 /* id + std attributes + status + sminfo */
 
+/** remove the entries to be kept from the temporary table of a mass removal,
+ * so the removed entries can be accounted for by grouped requests */
+static int tmp_table_unkeep(lmgr_t *p_mgr, const char *tmp_table_name,
+                            const struct rm_keep *keep)
+{
+    result_handle_t result;
+    char           *field_tab[1];
+    GString        *req, *kept;
+    unsigned int    nb = 0;
+    DEF_PK(pk);
+    int             rc;
+
+    req = g_string_new(NULL);
+    g_string_printf(req, "SELECT id FROM %s", tmp_table_name);
+    rc = db_exec_sql(&p_mgr->conn, req->str, &result);
+    if (rc)
+        goto free_req;
+
+    kept = g_string_new(NULL);
+    while ((rc = db_next_record(&p_mgr->conn, &result, field_tab, 1))
+                == DB_SUCCESS && field_tab[0] != NULL)
+    {
+        entry_id_t id;
+
+        rc = parse_entry_id(p_mgr, field_tab[0], PTR_PK(pk), &id);
+        if (rc)
+            break;
+
+        if (!keep->func(&id, NULL, NULL, keep->arg))
+            continue;
+
+        g_string_append_printf(kept, "%s"DPK, nb == 0 ? "" : ",", pk);
+        nb++;
+    }
+    db_result_free(&p_mgr->conn, &result);
+
+    if ((rc == DB_SUCCESS || rc == DB_END_OF_LIST) && nb > 0)
+    {
+        DisplayLog(LVL_DEBUG, LISTMGR_TAG, "%u entries kept", nb);
+        g_string_printf(req, "DELETE FROM %s WHERE id IN (%s)", tmp_table_name,
+                        kept->str);
+        rc = db_exec_sql(&p_mgr->conn, req->str, NULL);
+    }
+    else if (rc == DB_END_OF_LIST)
+        rc = DB_SUCCESS;
+
+    g_string_free(kept, TRUE);
+free_req:
+    g_string_free(req, TRUE);
+    return rc;
+}
+
 /** Perform removal or soft removal for all entries matching a filter
  * (no transaction management).
+ * @param range  only process entries in this range of ids (NULL for all).
+ * @param keep   entries and names not to be removed (NULL for none).
  */
 static int listmgr_mass_remove_no_tx(lmgr_t *p_mgr, const lmgr_filter_t *p_filter,
                                      bool soft_rm, time_t rm_time, rm_cb_func_t cb_func,
+                                     const struct pk_range *range,
+                                     const struct rm_keep *keep,
                                      unsigned int *rm_count)
 {
     struct field_count counts = {0};
@@ -518,7 +705,7 @@ static int listmgr_mass_remove_no_tx(lmgr_t *p_mgr, const lmgr_filter_t *p_filte
          * 1) clean names if there is a filter on them.
          * 2) clean related entries in other tables if there is no remaining path.
          */
-        rc = clean_names(p_mgr, p_filter, &counts.nb_names);
+        rc = clean_names(p_mgr, p_filter, range, keep, &counts.nb_names);
         if (rc)
             return rc;
     }
@@ -545,7 +732,7 @@ static int listmgr_mass_remove_no_tx(lmgr_t *p_mgr, const lmgr_filter_t *p_filte
 
         /* filter is only on names table */
         if (soft_rm)
-            rc = clean_names(p_mgr, p_filter, &counts.nb_names);
+            rc = clean_names(p_mgr, p_filter, range, keep, &counts.nb_names);
         /* else (no softrm): name cleaning has been done at the beginning of the function */
         else
             rc = 0;
@@ -569,6 +756,17 @@ static int listmgr_mass_remove_no_tx(lmgr_t *p_mgr, const lmgr_filter_t *p_filte
         goto free_str;
     }
 
+    /* soft rm selects entries from the main table */
+    if (soft_rm)
+        append_pk_range(where, MAIN_TABLE".", range);
+    else
+    {
+        char prefix[128];
+
+        snprintf(prefix, sizeof(prefix), "%s.", table2name(query_tab));
+        append_pk_range(where, prefix, range);
+    }
+
     snprintf(tmp_table_name, sizeof(tmp_table_name), "TMP_TABLE_%u_%u",
         (unsigned int)getpid(), (unsigned int)pthread_self());
 
@@ -577,11 +775,43 @@ static int listmgr_mass_remove_no_tx(lmgr_t *p_mgr, const lmgr_filter_t *p_filte
     if (rc)
         goto free_str;
 
+    if (keep != NULL)
+    {
+        rc = tmp_table_unkeep(p_mgr, tmp_table_name, keep);
+        if (rc)
+            goto free_str;
+    }
+
     req = g_string_new(NULL);
 
+    /* subtract removed entries from the batched accounting, and their names
+     * from the usage of their ancestors, before anything is deleted */
+    if (lmgr_acct_batched())
+    {
+        g_string_printf(req, "SELECT id FROM %s", tmp_table_name);
+        rc = acct_table_sub(&p_mgr->conn, req->str);
+        if (rc)
+            goto free_str;
+    }
+    if (lmgr_config.dir_stat)
+    {
+        g_string_printf(req, "SELECT id,parent_id FROM "DNAMES_TABLE
+                        " WHERE id IN (SELECT id FROM %s)", tmp_table_name);
+        rc = listmgr_dirstat_sub_names(p_mgr, req->str);
+        if (rc)
+            goto free_str;
+
+        g_string_printf(req, "SELECT id FROM %s", tmp_table_name);
+        rc = listmgr_dirstat_rm_dirs(p_mgr, req->str);
+        if (rc)
+            goto free_str;
+    }
+
     /* If the filter is only a single table, entries can be directly deleted in it. */
     /* NOTE: can't delete directly in stripe_items with the select criteria. */
-    if ((nb_field_tables(&counts) == 1) && (query_tab != T_STRIPE_ITEMS))
+    /* NOTE: entries to be kept must be checked one by one. */
+    if ((nb_field_tables(&counts) == 1) && (query_tab != T_STRIPE_ITEMS)
+        && (keep == NULL))
     {
         DisplayLog(LVL_DEBUG, LISTMGR_TAG, "Direct deletion in %s table", table2name(query_tab));
         direct_del = true;
@@ -681,7 +911,7 @@ static int listmgr_mass_remove_no_tx(lmgr_t *p_mgr, const lmgr_filter_t *p_filte
 
     /* Condition on names only (partial scan cleans not found names). */
     if (soft_rm && filter_names)
-        rc = clean_names(p_mgr, p_filter, &counts.nb_names);
+        rc = clean_names(p_mgr, p_filter, range, keep, &counts.nb_names);
     /* else, it has been done at the beginning of the function */
 
     goto free_str;
@@ -703,9 +933,15 @@ free_str:
 }
 
 
-/** handles a mass_remove transaction */
+/** handles a mass_remove transaction
+ * @param range  only process entries in this range of ids (NULL for all).
+ * @param keep   entries and names not to be removed (NULL for none).
+ */
 static int listmgr_mass_remove(lmgr_t *p_mgr, const lmgr_filter_t *p_filter,
-                               bool soft_rm, time_t rm_time, rm_cb_func_t cb_func)
+                               bool soft_rm, time_t rm_time, rm_cb_func_t cb_func,
+                               const struct pk_range *range,
+                               const struct rm_keep *keep,
+                               unsigned int *rm_count)
 {
     int             rc;
     unsigned int    rmcount = 0;
@@ -718,7 +954,8 @@ retry:
     else if (rc)
         return rc;
 
-    rc = listmgr_mass_remove_no_tx(p_mgr, p_filter, soft_rm, rm_time, cb_func, &rmcount);
+    rc = listmgr_mass_remove_no_tx(p_mgr, p_filter, soft_rm, rm_time, cb_func,
+                                   range, keep, &rmcount);
 
     if (lmgr_delayed_retry(p_mgr, rc))
         goto retry;
@@ -729,8 +966,11 @@ retry:
     if (lmgr_delayed_retry(p_mgr, rc))
         goto retry;
 
-    if (rc == DB_SUCCESS)
+    if (rc == DB_SUCCESS) {
         p_mgr->nbop[OPIDX_RM] += rmcount;
+        if (rm_count != NULL)
+            *rm_count = rmcount;
+    }
 
     return rc;
 
@@ -743,14 +983,91 @@ int ListMgr_MassRemove(lmgr_t * p_mgr, const lmgr_filter_t * p_filter,
                         rm_cb_func_t cb_func)
 {
     /* not a soft rm */
-    return listmgr_mass_remove(p_mgr, p_filter, false, 0, cb_func);
+    return listmgr_mass_remove(p_mgr, p_filter, false, 0, cb_func, NULL, NULL,
+                               NULL);
 }
 
 int ListMgr_MassSoftRemove(lmgr_t *p_mgr, const lmgr_filter_t *p_filter,
                            time_t rm_time, rm_cb_func_t cb_func)
 {
     /* soft rm */
-    return listmgr_mass_remove(p_mgr, p_filter, true, rm_time, cb_func);
+    return listmgr_mass_remove(p_mgr, p_filter, true, rm_time, cb_func, NULL,
+                               NULL, NULL);
+}
+
+/** get the last id of the range of chunk_size entries after the given id
+ * @param[out] upto  empty string if there are less than chunk_size entries.
+ */
+static int next_range_end(lmgr_t *p_mgr, const char *after,
+                          unsigned int chunk_size, char *upto, size_t size)
+{
+    GString        *req;
+    result_handle_t result;
+    char           *str_val = NULL;
+    int             rc;
+
+    req = g_string_new(NULL);
+    g_string_printf(req, "SELECT id FROM "MAIN_TABLE" WHERE id>"DPK
+                    " ORDER BY id LIMIT %u,1", after, chunk_size - 1);
+retry:
+    rc = db_exec_sql(&p_mgr->conn, req->str, &result);
+    if (lmgr_delayed_retry(p_mgr, rc))
+        goto retry;
+    else if (rc)
+        goto free_str;
+
+    rc = db_next_record(&p_mgr->conn, &result, &str_val, 1);
+    if (rc == DB_END_OF_LIST || (rc == DB_SUCCESS && str_val == NULL))
+    {
+        upto[0] = '\0';
+        rc = DB_SUCCESS;
+    }
+    else if (rc == DB_SUCCESS)
+        rh_strncpy(upto, str_val, size);
+
+    db_result_free(&p_mgr->conn, &result);
+
+free_str:
+    g_string_free(req, TRUE);
+    return rc;
+}
+
+int ListMgr_MassRemoveRange(lmgr_t *p_mgr, const lmgr_filter_t *p_filter,
+                            bool soft_rm, time_t rm_time, rm_cb_func_t cb_func,
+                            unsigned int chunk_size, char *cursor,
+                            size_t cursor_size, unsigned int *rm_count,
+                            bool *last, rm_keep_func_t keep_func,
+                            void *keep_arg)
+{
+    struct pk_range range;
+    struct rm_keep keep = { .func = keep_func, .arg = keep_arg };
+    DEF_PK(upto);
+    int rc;
+
+    *rm_count = 0;
+
+    /* no range: process all entries at once */
+    if (chunk_size == 0 || no_filter(p_filter))
+    {
+        *last = true;
+        return listmgr_mass_remove(p_mgr, p_filter, soft_rm, rm_time, cb_func,
+                                   NULL, keep_func ? &keep : NULL, rm_count);
+    }
+
+    rc = next_range_end(p_mgr, cursor, chunk_size, upto, sizeof(upto));
+    if (rc)
+        return rc;
+
+    range.after = cursor;
+    range.upto = EMPTY_STRING(upto) ? NULL : upto;
+    *last = (range.upto == NULL);
+
+    rc = listmgr_mass_remove(p_mgr, p_filter, soft_rm, rm_time, cb_func,
+                             &range, keep_func ? &keep : NULL, rm_count);
+    if (rc == DB_SUCCESS && !*last)
+        rh_strncpy(cursor, upto, cursor_size);
+
+    return rc;
 }
 
 /**
@@ -838,13 +1155,14 @@ out:
 typedef struct lmgr_rm_list_t
 {
     lmgr_t        *p_mgr;
-    result_handle_t select_result;
+    lmgr_list_result_t result;
     unsigned int  result_len;
 } lmgr_rm_list_t;
 
 /* XXX selecting 'expired' entries is done using a rm_time criteria in p_filter */
 struct lmgr_rm_list_t *ListMgr_RmList(lmgr_t *p_mgr, lmgr_filter_t *p_filter,
-                                      const lmgr_sort_type_t *p_sort_type)
+                                      const lmgr_sort_type_t *p_sort_type,
+                                      const lmgr_iter_opt_t *p_opt)
 {
     int             rc, nb;
     lmgr_rm_list_t *p_list = MemAlloc(sizeof(lmgr_rm_list_t));
@@ -915,7 +1233,8 @@ struct lmgr_rm_list_t *ListMgr_RmList(lmgr_t *p_mgr, lmgr_filter_t *p_filter,
 
     /* execute request (retry on connexion error or deadlock) */
     do {
-        rc = db_exec_sql(&p_mgr->conn, req->str, &p_list->select_result);
+        rc = listmgr_list_exec(p_mgr, req->str, p_opt && p_opt->stream,
+                               false, &p_list->result);
     } while (lmgr_delayed_retry(p_mgr, rc));
 
     if (rc)
@@ -955,8 +1274,8 @@ int            ListMgr_GetNextRmEntry(struct lmgr_rm_list_t *p_iter,
     for (i=0; i < MAX_SOFTRM_FIELDS; i++)
         record[i] = NULL;
 
-    rc = db_next_record(&p_iter->p_mgr->conn, &p_iter->select_result, record,
-                        p_iter->result_len);
+    rc = listmgr_list_next(p_iter->p_mgr, &p_iter->result, record,
+                           p_iter->result_len);
     /* what to do on connexion error? */
 
     if (rc)
@@ -977,7 +1296,7 @@ int            ListMgr_GetNextRmEntry(struct lmgr_rm_list_t *p_iter,
 
 void           ListMgr_CloseRmList(struct lmgr_rm_list_t *p_iter)
 {
-    db_result_free(&p_iter->p_mgr->conn, &p_iter->select_result);
+    listmgr_list_free(p_iter->p_mgr, &p_iter->result);
     MemFree(p_iter);
 }
 
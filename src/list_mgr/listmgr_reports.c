@@ -34,7 +34,7 @@ struct result {
 
 typedef struct lmgr_report_t {
     lmgr_t *p_mgr;
-    result_handle_t select_result;
+    lmgr_list_result_t result_set;
 
     /* expected result content */
     struct result *result;
@@ -578,23 +578,18 @@ struct lmgr_report_t *ListMgr_Report(lmgr_t *p_mgr,
 
  retry:
     /* execute request (expect that ACCT table does not exists) */
-    if (use_acct_table)
-        rc = db_exec_sql_quiet(&p_mgr->conn, req->str,
-                               &p_report->select_result);
-    else
-        rc = db_exec_sql(&p_mgr->conn, req->str, &p_report->select_result);
+    rc = listmgr_list_exec(p_mgr, req->str, opt.stream, use_acct_table,
+                           &p_report->result_set);
 
     if (lmgr_delayed_retry(p_mgr, rc))
         goto retry;
 
     /* if the ACCT table does exist, switch to standard mode */
     if (use_acct_table && (rc == DB_NOT_EXISTS)) {
-        lmgr_iter_opt_t new_opt;
+        lmgr_iter_opt_t new_opt = LMGR_ITER_OPT_INIT;
 
         if (p_opt != NULL)
             new_opt = *p_opt;
-        else
-            new_opt.list_count_max = 0;
 
         new_opt.force_no_acct = true;
 
@@ -661,8 +656,8 @@ int ListMgr_GetNextReportItem(struct lmgr_report_t *p_iter,
             return DB_NO_MEMORY;
     }
 
-    rc = db_next_record(&p_iter->p_mgr->conn, &p_iter->select_result,
-                        p_iter->str_tab, p_iter->result_count);
+    rc = listmgr_list_next(p_iter->p_mgr, &p_iter->result_set,
+                           p_iter->str_tab, p_iter->result_count);
 
     if (rc)
         return rc;
@@ -720,7 +715,8 @@ int ListMgr_GetNextReportItem(struct lmgr_report_t *p_iter,
 
 void ListMgr_CloseReport(struct lmgr_report_t *p_iter)
 {
-    db_result_free(&p_iter->p_mgr->conn, &p_iter->select_result);
+    listmgr_list_free(p_iter->p_mgr, &p_iter->result_set);
+    listmgr_index_usage_flush(&p_iter->p_mgr->conn, false);
 
     if (p_iter->str_tab != NULL)
         MemFree(p_iter->str_tab);
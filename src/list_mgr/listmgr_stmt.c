@@ -0,0 +1,149 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * vim:expandtab:shiftwidth=4:tabstop=4:
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the CeCILL License.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL license (http://www.cecill.info) and that you
+ * accept its terms.
+ */
+/**
+ * Cache of prepared statements for the most frequent list manager requests
+ * (entry get, insert and update).
+ *
+ * The text of these requests only depends on the operation, the target table
+ * and the attribute mask. Preparing them once per connection saves building,
+ * escaping and parsing the request for each entry.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "list_mgr.h"
+#include "listmgr_common.h"
+#include "database.h"
+#include "rbh_logs.h"
+#include "Memory.h"
+
+/* number of slots in the cache (statements with the same hash replace
+ * each other) */
+#define STMT_CACHE_SIZE 64
+
+typedef struct lmgr_stmt_slot {
+    lmgr_stmt_op_e  op;
+    table_enum      table;
+    attr_mask_t     mask;
+    db_stmt_t      *stmt;   /* NULL if the slot is free */
+} lmgr_stmt_slot_t;
+
+struct lmgr_stmt_cache {
+    lmgr_stmt_slot_t slots[STMT_CACHE_SIZE];
+};
+
+static inline unsigned int stmt_hash(lmgr_stmt_op_e op, table_enum table,
+                                     attr_mask_t mask)
+{
+    uint64_t h;
+
+    h = ((uint64_t)mask.std * 31 + mask.status) * 31 + mask.sm_info;
+    h = (h * 31 + table) * 31 + op;
+    /* mix high bits with low bits */
+    h ^= h >> 29;
+    h *= 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 32;
+
+    return h % STMT_CACHE_SIZE;
+}
+
+static inline lmgr_stmt_slot_t *stmt_slot(lmgr_t *p_mgr, lmgr_stmt_op_e op,
+                                          table_enum table, attr_mask_t mask)
+{
+    return &p_mgr->stmt_cache->slots[stmt_hash(op, table, mask)];
+}
+
+db_stmt_t *lmgr_stmt_lookup(lmgr_t *p_mgr, lmgr_stmt_op_e op,
+                            table_enum table, attr_mask_t mask)
+{
+    lmgr_stmt_slot_t *slot;
+
+    if (p_mgr->stmt_cache == NULL)
+        return NULL;
+
+    slot = stmt_slot(p_mgr, op, table, mask);
+    if (slot->stmt != NULL && slot->op == op && slot->table == table
+        && attr_mask_equal(&slot->mask, &mask))
+        return slot->stmt;
+
+    return NULL;
+}
+
+int lmgr_stmt_prepare(lmgr_t *p_mgr, lmgr_stmt_op_e op, table_enum table,
+                      attr_mask_t mask, const char *query, db_stmt_t **p_stmt)
+{
+    lmgr_stmt_slot_t *slot;
+    int rc;
+
+    if (p_mgr->stmt_cache == NULL) {
+        p_mgr->stmt_cache = MemCalloc(1, sizeof(struct lmgr_stmt_cache));
+        if (p_mgr->stmt_cache == NULL)
+            return DB_NO_MEMORY;
+    }
+
+    rc = db_stmt_prepare(&p_mgr->conn, query, p_stmt);
+    if (rc)
+        return rc;
+
+    slot = stmt_slot(p_mgr, op, table, mask);
+    /* replace the previous statement in this slot */
+    if (slot->stmt != NULL)
+        db_stmt_close(slot->stmt);
+
+    slot->op = op;
+    slot->table = table;
+    slot->mask = mask;
+    slot->stmt = *p_stmt;
+
+    return DB_SUCCESS;
+}
+
+void lmgr_stmt_error(lmgr_t *p_mgr, db_stmt_t *stmt, int errcode)
+{
+    int i;
+
+    if (p_mgr->stmt_cache == NULL)
+        return;
+
+    /* statements are lost with the connection */
+    if (errcode == DB_CONNECT_FAILED) {
+        lmgr_stmt_cache_free(p_mgr);
+        return;
+    }
+
+    for (i = 0; i < STMT_CACHE_SIZE; i++) {
+        lmgr_stmt_slot_t *slot = &p_mgr->stmt_cache->slots[i];
+
+        if (slot->stmt == stmt) {
+            db_stmt_close(slot->stmt);
+            slot->stmt = NULL;
+            return;
+        }
+    }
+}
+
+void lmgr_stmt_cache_free(lmgr_t *p_mgr)
+{
+    int i;
+
+    if (p_mgr->stmt_cache == NULL)
+        return;
+
+    for (i = 0; i < STMT_CACHE_SIZE; i++)
+        if (p_mgr->stmt_cache->slots[i].stmt != NULL)
+            db_stmt_close(p_mgr->stmt_cache->slots[i].stmt);
+
+    MemFree(p_mgr->stmt_cache);
+    p_mgr->stmt_cache = NULL;
+}
@@ -193,11 +193,34 @@ int batch_insert_stripe_info(lmgr_t *p_mgr, pktype *pklist, int *validators,
     return rc;
 }
 
+/* stripe_count, stripe_size, pool_name, validator => 4 */
+#define STRIPE_INFO_COUNT 4
+
+/** set stripe info from a STRIPE_INFO record
+ * (stripe_count, stripe_size, pool_name, validator) */
+static int res2stripe_info(char **res, stripe_info_t *p_stripe_info)
+{
+    int i;
+
+    for (i = 0; i < STRIPE_INFO_COUNT; i++) {
+        DisplayLog(LVL_FULL, LISTMGR_TAG, "stripe_res[%u] = %s", i,
+                   res[i] ? res[i] : "<null>");
+        if (res[i] == NULL)
+            return DB_ATTR_MISSING;
+    }
+
+    p_stripe_info->stripe_count = atoi(res[0]);
+    p_stripe_info->stripe_size = atoi(res[1]);
+    rh_strncpy(p_stripe_info->pool_name, res[2], MAX_POOL_LEN);
+#ifdef HAVE_LLAPI_FSWAP_LAYOUTS
+    p_stripe_info->validator = atoi(res[3]);
+#endif
+    return DB_SUCCESS;
+}
+
 int get_stripe_info(lmgr_t *p_mgr, PK_ARG_T pk, stripe_info_t *p_stripe_info,
                     stripe_items_t *p_items)
 {
-/* stripe_count, stripe_size, pool_name, validator => 4 */
-#define STRIPE_INFO_COUNT 4
     char *res[STRIPE_INFO_COUNT];
     result_handle_t result;
     int i;
@@ -222,21 +245,9 @@ int get_stripe_info(lmgr_t *p_mgr, PK_ARG_T pk, stripe_info_t *p_stripe_info,
     if (rc)
         goto res_free;
 
-    for (i = 0; i < STRIPE_INFO_COUNT; i++) {
-        DisplayLog(LVL_FULL, LISTMGR_TAG, "stripe_res[%u] = %s", i,
-                   res[i] ? res[i] : "<null>");
-        if (res[i] == NULL) {
-            rc = DB_ATTR_MISSING;
-            goto res_free;
-        }
-    }
-
-    p_stripe_info->stripe_count = atoi(res[0]);
-    p_stripe_info->stripe_size = atoi(res[1]);
-    rh_strncpy(p_stripe_info->pool_name, res[2], MAX_POOL_LEN);
-#ifdef HAVE_LLAPI_FSWAP_LAYOUTS
-    p_stripe_info->validator = atoi(res[3]);
-#endif
+    rc = res2stripe_info(res, p_stripe_info);
+    if (rc)
+        goto res_free;
 
     db_result_free(&p_mgr->conn, &result);
 
@@ -317,6 +328,137 @@ int get_stripe_info(lmgr_t *p_mgr, PK_ARG_T pk, stripe_info_t *p_stripe_info,
     return rc;
 }
 
+/** move the stripe items accumulated in an array to an attribute set */
+static int set_stripe_items(attr_set_t *p_attrs, GArray *items)
+{
+    stripe_items_t *p_items = &ATTR(p_attrs, stripe_items);
+
+    p_items->count = items->len;
+    p_items->stripe = MemAlloc(items->len * sizeof(stripe_item_t));
+    if (p_items->stripe == NULL) {
+        p_items->count = 0;
+        return DB_NO_MEMORY;
+    }
+    memcpy(p_items->stripe, items->data, items->len * sizeof(stripe_item_t));
+    g_array_set_size(items, 0);
+    return DB_SUCCESS;
+}
+
+int get_stripe_info_batch(lmgr_t *p_mgr, pktype *pklist,
+                          attr_set_t **p_attrs, unsigned int count,
+                          bool *found)
+{
+    char *res[1 + STRIPE_INFO_COUNT];
+    result_handle_t result;
+    GHashTable *pk_index;
+    GArray *items;
+    GString *req;
+    unsigned int i, nb_items;
+    int rc, curr = -1;
+
+    /* pk => index in the arrays + 1 */
+    pk_index = g_hash_table_new(g_str_hash, g_str_equal);
+    items = g_array_new(FALSE, FALSE, sizeof(stripe_item_t));
+
+    req = g_string_new("SELECT id,stripe_count,stripe_size,pool_name,validator"
+                       " FROM " STRIPE_INFO_TABLE " WHERE id IN (");
+    for (i = 0; i < count; i++) {
+        found[i] = false;
+        g_hash_table_insert(pk_index, pklist[i], GUINT_TO_POINTER(i + 1));
+        g_string_append_printf(req, i == 0 ? DPK : "," DPK, pklist[i]);
+    }
+    g_string_append(req, ")");
+
+    rc = db_exec_sql(&p_mgr->conn, req->str, &result);
+    if (rc)
+        goto out;
+
+    while ((rc = db_next_record(&p_mgr->conn, &result, res,
+                                1 + STRIPE_INFO_COUNT)) == DB_SUCCESS) {
+        unsigned int idx;
+
+        if (res[0] == NULL)
+            continue;
+        idx = GPOINTER_TO_UINT(g_hash_table_lookup(pk_index, res[0]));
+        if (idx == 0)
+            continue;
+
+        if (res2stripe_info(res + 1, &ATTR(p_attrs[idx - 1], stripe_info))
+            == DB_SUCCESS)
+            found[idx - 1] = true;
+    }
+    db_result_free(&p_mgr->conn, &result);
+    if (rc != DB_END_OF_LIST)
+        goto out;
+
+    /* retrieve stripe lists of the entries that requested it */
+    g_string_assign(req, "SELECT id,stripe_index,ostidx,details FROM "
+                    STRIPE_ITEMS_TABLE " WHERE id IN (");
+    nb_items = 0;
+    for (i = 0; i < count; i++) {
+        if (!found[i] || !ATTR_MASK_TEST(p_attrs[i], stripe_items))
+            continue;
+
+        ATTR(p_attrs[i], stripe_items).count = 0;
+        ATTR(p_attrs[i], stripe_items).stripe = NULL;
+        g_string_append_printf(req, nb_items == 0 ? DPK : "," DPK,
+                               pklist[i]);
+        nb_items++;
+    }
+    if (nb_items == 0) {
+        rc = DB_SUCCESS;
+        goto out;
+    }
+    g_string_append(req, ") ORDER BY id,stripe_index ASC");
+
+    rc = db_exec_sql(&p_mgr->conn, req->str, &result);
+    if (rc)
+        goto out;
+
+    /* records of an entry are consecutive */
+    while ((rc = db_next_record(&p_mgr->conn, &result, res, 4))
+           == DB_SUCCESS) {
+        stripe_item_t item;
+        int idx;
+
+        if (res[0] == NULL || res[1] == NULL)
+            continue;
+        idx = (int)GPOINTER_TO_UINT(g_hash_table_lookup(pk_index, res[0])) - 1;
+        if (idx < 0)
+            continue;
+
+        if (idx != curr) {
+            if (curr >= 0) {
+                rc = set_stripe_items(p_attrs[curr], items);
+                if (rc)
+                    goto res_free;
+            }
+            curr = idx;
+        }
+
+        memset(&item, 0, sizeof(item));
+        item.ost_idx = atoi(res[2]);
+        /* raw copy of binary buffer (last 3 fields of stripe_item_t
+         *                            = address of ost_gen field) */
+        memcpy(&item.ost_gen, res[3], STRIPE_DETAIL_SZ);
+        g_array_append_val(items, item);
+    }
+    if (rc != DB_END_OF_LIST)
+        goto res_free;
+
+    rc = DB_SUCCESS;
+    if (curr >= 0)
+        rc = set_stripe_items(p_attrs[curr], items);
+
+ res_free:
+    db_result_free(&p_mgr->conn, &result);
+ out:
+    g_array_free(items, TRUE);
+    g_string_free(req, TRUE);
+    g_hash_table_destroy(pk_index);
+    return rc;
+}
+
 /** release stripe information */
 void free_stripe_items(stripe_items_t *p_stripe_items)
 {
@@ -31,6 +31,15 @@ int batch_insert_stripe_info(lmgr_t *p_mgr, pktype *pklist, int *validators,
 int get_stripe_info(lmgr_t *p_mgr, PK_ARG_T pk, stripe_info_t *p_stripe,
                     stripe_items_t *p_items);
 
+/**
+ * Retrieve stripe information of a set of entries (and their stripe items
+ * if requested in their attribute mask), with one request per table.
+ * @param[out] found indicates the entries that have stripe information.
+ */
+int get_stripe_info_batch(lmgr_t *p_mgr, pktype *pklist,
+                          attr_set_t **p_attrs, unsigned int count,
+                          bool *found);
+
 /** duplicate stripe information */
 int dup_stripe_items(stripe_items_t *p_stripe_out,
                      const stripe_items_t *p_stripe_in);
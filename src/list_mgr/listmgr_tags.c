@@ -188,7 +188,8 @@ struct lmgr_iterator_t *ListMgr_ListUntagged( lmgr_t * p_mgr,
 
     /* execute request */
 retry:
-    rc = db_exec_sql( &p_mgr->conn, query, &it->select_result );
+    rc = listmgr_list_exec(p_mgr, query, p_opt && p_opt->stream, false,
+                           &it->result);
     if (lmgr_delayed_retry(p_mgr, rc))
         goto retry;
     else if (rc)
@@ -27,11 +27,111 @@
 #include <unistd.h>
 #include <pthread.h>
 
+/**
+ * Update entry attributes in main or annex table.
+ * The request is run as a prepared statement.
+ */
+static int update_entry_table(lmgr_t *p_mgr, table_enum table, PK_ARG_T pk,
+                              const attr_set_t *p_update_set)
+{
+    db_stmt_t *stmt;
+    unsigned int pos = 0;
+    db_type_u u;
+    int rc;
+
+    stmt = lmgr_stmt_lookup(p_mgr, STMT_UPDATE, table,
+                            p_update_set->attr_mask);
+    if (stmt == NULL) {
+        GString *req = g_string_new("UPDATE ");
+
+        g_string_append_printf(req, "%s SET ", table2name(table));
+        rc = attrset2updatelist(p_mgr, req, p_update_set, table,
+                                AOF_PLACEHOLDER);
+        if (rc <= 0) {
+            /* error, or nothing to update */
+            g_string_free(req, TRUE);
+            return -rc;
+        }
+        g_string_append(req, " WHERE id=?");
+
+        rc = lmgr_stmt_prepare(p_mgr, STMT_UPDATE, table,
+                               p_update_set->attr_mask, req->str, &stmt);
+        g_string_free(req, TRUE);
+        if (rc)
+            return rc;
+    }
+
+    rc = attrset2bindlist(stmt, &pos, p_update_set, table);
+    if (rc < 0)
+        return -rc;
+
+    u.val_str = pk;
+    rc = db_stmt_bind(stmt, pos, PK_DB_TYPE, &u);
+    if (rc)
+        return rc;
+
+    rc = db_stmt_exec(stmt);
+    db_stmt_reset(stmt);
+    if (rc)
+        lmgr_stmt_error(p_mgr, stmt, rc);
+    return rc;
+}
+
+/**
+ * Insert or update the name of an entry in names table.
+ * The request is run as a prepared statement.
+ */
+static int update_entry_name(lmgr_t *p_mgr, PK_ARG_T pk,
+                             const attr_set_t *p_update_set)
+{
+    db_stmt_t *stmt;
+    unsigned int pos = 0;
+    db_type_u u;
+    int rc;
+
+    stmt = lmgr_stmt_lookup(p_mgr, STMT_SET_NAME, T_DNAMES,
+                            p_update_set->attr_mask);
+    if (stmt == NULL) {
+        GString *req = g_string_new("INSERT INTO " DNAMES_TABLE "(id");
+
+        attrmask2fieldlist(req, p_update_set->attr_mask, T_DNAMES, "", "",
+                           AOF_LEADING_SEP);
+        g_string_append(req, ",pkn) VALUES (?");
+        attrset2valuelist(p_mgr, req, p_update_set, T_DNAMES,
+                          AOF_LEADING_SEP | AOF_PLACEHOLDER);
+        g_string_append(req,
+                        "," HNAME_DEF
+                        ") ON DUPLICATE KEY UPDATE id=VALUES(id)");
+        attrset2updatelist(p_mgr, req, p_update_set, T_DNAMES,
+                           AOF_LEADING_SEP | AOF_GENERIC_VAL);
+
+        rc = lmgr_stmt_prepare(p_mgr, STMT_SET_NAME, T_DNAMES,
+                               p_update_set->attr_mask, req->str, &stmt);
+        g_string_free(req, TRUE);
+        if (rc)
+            return rc;
+    }
+
+    u.val_str = pk;
+    rc = db_stmt_bind(stmt, pos++, PK_DB_TYPE, &u);
+    if (rc)
+        return rc;
+
+    rc = attrset2bindlist(stmt, &pos, p_update_set, T_DNAMES);
+    if (rc < 0)
+        return -rc;
+
+    rc = db_stmt_exec(stmt);
+    db_stmt_reset(stmt);
+    if (rc)
+        lmgr_stmt_error(p_mgr, stmt, rc);
+    return rc;
+}
+
 int ListMgr_Update(lmgr_t *p_mgr, const entry_id_t *p_id,
                    const attr_set_t *p_update_set)
 {
     int rc;
-    GString *req;
     DEF_PK(pk);
 
     /* read only fields in info mask? */
@@ -46,8 +146,6 @@ int ListMgr_Update(lmgr_t *p_mgr, const entry_id_t *p_id,
 
     entry_id2pk(p_id, PTR_PK(pk));
 
-    req = g_string_new(NULL);
-
  retry:
     rc = lmgr_begin(p_mgr);
     if (lmgr_delayed_retry(p_mgr, rc))
@@ -55,37 +153,17 @@ int ListMgr_Update(lmgr_t *p_mgr, const entry_id_t *p_id,
 
     /* update fields in main table */
     if (main_fields(p_update_set->attr_mask)) {
-        g_string_assign(req, "UPDATE " MAIN_TABLE " SET ");
-
-        rc = attrset2updatelist(p_mgr, req, p_update_set, T_MAIN, 0);
-        if (rc < 0) {
-            rc = -rc;
-            goto free_str;
-        } else if (rc > 0) {
-            g_string_append_printf(req, " WHERE id=" DPK, pk);
-            rc = db_exec_sql(&p_mgr->conn, req->str, NULL);
-            if (lmgr_delayed_retry(p_mgr, rc))
-                goto retry;
-            else if (rc)
-                goto rollback;
-        }
+        rc = update_entry_table(p_mgr, T_MAIN, pk, p_update_set);
+        if (lmgr_delayed_retry(p_mgr, rc))
+            goto retry;
+        else if (rc)
+            goto rollback;
     }
 
     /* update names table */
     if (ATTR_MASK_TEST(p_update_set, name)
         && ATTR_MASK_TEST(p_update_set, parent_id)) {
-        g_string_assign(req, "INSERT INTO " DNAMES_TABLE "(id");
-        attrmask2fieldlist(req, p_update_set->attr_mask, T_DNAMES, "", "",
-                           AOF_LEADING_SEP);
-        g_string_append_printf(req, ",pkn) VALUES (" DPK, pk);
-        attrset2valuelist(p_mgr, req, p_update_set, T_DNAMES, AOF_LEADING_SEP);
-        g_string_append(req,
-                        "," HNAME_DEF
-                        ") ON DUPLICATE KEY UPDATE id=VALUES(id)");
-        attrset2updatelist(p_mgr, req, p_update_set, T_DNAMES,
-                           AOF_LEADING_SEP | AOF_GENERIC_VAL);
-
-        rc = db_exec_sql(&p_mgr->conn, req->str, NULL);
+        rc = update_entry_name(p_mgr, pk, p_update_set);
         if (lmgr_delayed_retry(p_mgr, rc))
             goto retry;
         else if (rc)
@@ -102,19 +180,11 @@ int ListMgr_Update(lmgr_t *p_mgr, const entry_id_t *p_id,
 
     /* update annex table */
     if (annex_fields(p_update_set->attr_mask)) {
-        g_string_assign(req, "UPDATE " ANNEX_TABLE " SET ");
-        rc = attrset2updatelist(p_mgr, req, p_update_set, T_ANNEX, 0);
-        if (rc < 0) {
-            rc = -rc;
-            goto free_str;
-        } else if (rc > 0) {
-            g_string_append_printf(req, " WHERE id=" DPK, pk);
-            rc = db_exec_sql(&p_mgr->conn, req->str, NULL);
-            if (lmgr_delayed_retry(p_mgr, rc))
-                goto retry;
-            else if (rc)
-                goto rollback;
-        }
+        rc = update_entry_table(p_mgr, T_ANNEX, pk, p_update_set);
+        if (lmgr_delayed_retry(p_mgr, rc))
+            goto retry;
+        else if (rc)
+            goto rollback;
     }
 #ifdef _LUSTRE
     if (ATTR_MASK_TEST(p_update_set, stripe_info)) {
@@ -145,12 +215,10 @@ int ListMgr_Update(lmgr_t *p_mgr, const entry_id_t *p_id,
     if (rc == DB_SUCCESS)
         p_mgr->nbop[OPIDX_UPDATE]++;
 
-    goto free_str;
+    return rc;
 
  rollback:
     lmgr_rollback(p_mgr);
- free_str:
-    g_string_free(req, TRUE);
     return rc;
 }
 
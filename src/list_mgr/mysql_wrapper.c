@@ -112,10 +112,47 @@ bool db_is_retryable(int db_err)
     }
 }
 
+/** data sent to the server by db_load_data() */
+struct load_data_src {
+    const char *data;
+    size_t      len;
+    size_t      offset;
+};
+
+static int load_data_init(void **ptr, const char *filename, void *userdata)
+{
+    *ptr = userdata;
+    /* only serve data from db_load_data(), never local files */
+    return (userdata == NULL) ? 1 : 0;
+}
+
+static int load_data_read(void *ptr, char *buf, unsigned int buf_len)
+{
+    struct load_data_src *src = ptr;
+    size_t len = MIN(buf_len, src->len - src->offset);
+
+    memcpy(buf, src->data + src->offset, len);
+    src->offset += len;
+    return len;
+}
+
+static void load_data_end(void *ptr)
+{
+}
+
+static int load_data_error(void *ptr, char *error_msg,
+                           unsigned int error_msg_len)
+{
+    rh_strncpy(error_msg, "Unexpected request for a local file",
+               error_msg_len);
+    return CR_UNKNOWN_ERROR;
+}
+
 /* create client connection */
 int db_connect(db_conn_t *conn)
 {
     my_bool reconnect = 1;
+    unsigned int local_infile = 1;
     unsigned int retry = 0;
 
     /* Connect to database */
@@ -131,6 +168,8 @@ int db_connect(db_conn_t *conn)
     /* older version */
     conn->reconnect = 1;
 #endif
+    /* for bulk loads (LOAD DATA LOCAL INFILE) */
+    mysql_options(conn, MYSQL_OPT_LOCAL_INFILE, &local_infile);
 
     while (1) {
         /* connect to server */
@@ -175,6 +214,10 @@ int db_connect(db_conn_t *conn)
     mysql_options(conn, MYSQL_OPT_RECONNECT, &reconnect);
 #endif
 
+    /* local files can't be read on server request */
+    mysql_set_local_infile_handler(conn, load_data_init, load_data_read,
+                                   load_data_end, load_data_error, NULL);
+
     DisplayLog(LVL_FULL, LISTMGR_TAG, "Logged on to database '%s' successfully",
                lmgr_config.db_config.db);
     return DB_SUCCESS;
@@ -259,6 +302,52 @@ int db_exec_sql(db_conn_t *conn, const char *query, result_handle_t *p_result)
     return _db_exec_sql(conn, query, p_result, false);
 }
 
+int db_load_data(db_conn_t *conn, const char *table, const char *fields,
+                 const char *set, const char *data, size_t len)
+{
+    struct load_data_src src = {.data = data, .len = len, .offset = 0 };
+    GString *query;
+    int rc, dberr;
+
+    query = g_string_new(NULL);
+    g_string_printf(query, "LOAD DATA LOCAL INFILE '%s' IGNORE INTO TABLE %s"
+                    " CHARACTER SET binary FIELDS TERMINATED BY ','"
+                    " OPTIONALLY ENCLOSED BY '\\'' ESCAPED BY '\\\\'"
+                    " LINES TERMINATED BY '\\n' (%s)", table, table, fields);
+    if (set != NULL)
+        g_string_append_printf(query, " SET %s", set);
+
+    /* serve the data for this request only */
+    mysql_set_local_infile_handler(conn, load_data_init, load_data_read,
+                                   load_data_end, load_data_error, &src);
+    rc = _db_exec_sql(conn, query->str, NULL, true);
+    dberr = mysql_errno(conn);
+    mysql_set_local_infile_handler(conn, load_data_init, load_data_read,
+                                   load_data_end, load_data_error, NULL);
+
+    if (rc != DB_SUCCESS) {
+        if (dberr == ER_NOT_ALLOWED_COMMAND
+#ifdef CR_LOAD_DATA_LOCAL_INFILE_REJECTED
+            || dberr == CR_LOAD_DATA_LOCAL_INFILE_REJECTED
+#endif
+#ifdef ER_CLIENT_LOCAL_FILES_DISABLED
+            || dberr == ER_CLIENT_LOCAL_FILES_DISABLED
+#endif
+            ) {
+            DisplayLog(LVL_EVENT, LISTMGR_TAG, "LOAD DATA LOCAL INFILE is "
+                       "disabled: %s", mysql_error(conn));
+            rc = DB_NOT_SUPPORTED;
+        } else if (!db_is_retryable(rc)) {
+            DisplayLog(LVL_MAJOR, LISTMGR_TAG,
+                       "Error %d loading data into %s: %s", rc, table,
+                       mysql_error(conn));
+        }
+    }
+
+    g_string_free(query, TRUE);
+    return rc;
+}
+
 /* free result resources */
 int db_result_free(db_conn_t *conn, result_handle_t *p_result)
 {
@@ -267,13 +356,34 @@ int db_result_free(db_conn_t *conn, result_handle_t *p_result)
     return DB_SUCCESS;
 }
 
+/** copy the fields of a row to the output array */
+static int row2tab(result_handle_t result, MYSQL_ROW row,
+                   char *outtab[], unsigned int outtabsize)
+{
+    int i;
+    unsigned int nb_fields;
+
+    nb_fields = mysql_num_fields(result);
+
+    for (i = 0; (i < outtabsize) && (i < nb_fields); i++)
+        outtab[i] = row[i];
+
+    if (nb_fields > outtabsize) {
+        DisplayLog(LVL_CRIT, LISTMGR_TAG,
+                   "Output array too small: size = %u, num_fields = %u",
+                   outtabsize, nb_fields);
+        return DB_BUFFER_TOO_SMALL;
+    }
+
+    return DB_SUCCESS;
+}
+
 /* get the next record from result */
 int db_next_record(db_conn_t *conn, result_handle_t *p_result,
                    char *outtab[], unsigned int outtabsize)
 {
     int i;
     MYSQL_ROW row;
-    unsigned int nb_fields;
 
     /* init ouput tab */
     for (i = 0; i < outtabsize; i++)
@@ -282,26 +392,438 @@ int db_next_record(db_conn_t *conn, result_handle_t *p_result,
     if (!(row = mysql_fetch_row(*p_result)))
         return DB_END_OF_LIST;
 
-    nb_fields = mysql_num_fields(*p_result);
+    return row2tab(*p_result, row, outtab, outtabsize);
+}
 
-    for (i = 0; (i < outtabsize) && (i < nb_fields); i++)
-        outtab[i] = row[i];
+/* retrieve number of records in result */
+int db_result_nb_records(db_conn_t *conn, result_handle_t *p_result)
+{
+    return mysql_num_rows(*p_result);
+}
 
-    if (nb_fields > outtabsize) {
+/** streamed result on a dedicated connection */
+struct db_stream {
+    db_conn_t       conn;
+    result_handle_t result;
+    bool            end_reached;    /**< all records have been read */
+};
+
+/* The client may take a long time to process streamed records, while
+ * the server waits for it to read the next ones (in seconds). */
+#define STREAM_NET_WRITE_TIMEOUT    86400
+
+int db_stream_open(db_conn_t *conn, const char *query, bool quiet,
+                   db_stream_t **p_stream)
+{
+    db_stream_t *stream;
+    char tmo_query[128];
+    int rc;
+
+    stream = MemAlloc(sizeof(*stream));
+    if (stream == NULL)
+        return DB_NO_MEMORY;
+
+    /* No other request can be run on a connection until the whole result
+     * is read: use a dedicated connection. */
+    rc = db_connect(&stream->conn);
+    if (rc)
+        goto free_stream;
+
+    rc = db_transaction_level(&stream->conn, TRANS_SESSION,
+                              TXL_READ_COMMITTED);
+    if (rc)
+        goto close_conn;
+
+    sprintf(tmo_query, "SET SESSION net_write_timeout=%u",
+            STREAM_NET_WRITE_TIMEOUT);
+    rc = _db_exec_sql(&stream->conn, tmo_query, NULL, false);
+    if (rc)
+        goto close_conn;
+
+    rc = _db_exec_sql(&stream->conn, query, NULL, quiet);
+    if (rc)
+        goto close_conn;
+
+    /* records will be fetched as they are read */
+    stream->result = mysql_use_result(&stream->conn);
+    if (stream->result == NULL) {
+        rc = DB_NOT_EXISTS;
+        goto close_conn;
+    }
+    stream->end_reached = false;
+
+    *p_stream = stream;
+    return DB_SUCCESS;
+
+ close_conn:
+    db_close_conn(&stream->conn);
+ free_stream:
+    MemFree(stream);
+    return rc;
+}
+
+int db_stream_next(db_stream_t *stream, char *outtab[],
+                   unsigned int outtabsize)
+{
+    int i;
+    MYSQL_ROW row;
+
+    /* init ouput tab */
+    for (i = 0; i < outtabsize; i++)
+        outtab[i] = NULL;
+
+    row = mysql_fetch_row(stream->result);
+    if (row == NULL) {
+        /* for streamed results, NULL is also returned on error */
+        int dberr = mysql_errno(&stream->conn);
+
+        if (dberr == 0) {
+            stream->end_reached = true;
+            return DB_END_OF_LIST;
+        }
+
+        DisplayLog(LVL_MAJOR, LISTMGR_TAG,
+                   "Error %d reading streamed result: %s", dberr,
+                   mysql_error(&stream->conn));
+        return mysql_error_convert(dberr, true);
+    }
+
+    return row2tab(stream->result, row, outtab, outtabsize);
+}
+
+void db_stream_close(db_stream_t *stream)
+{
+    if (stream->end_reached) {
+        /* the result refers to its connection: free it before closing it */
+        mysql_free_result(stream->result);
+        db_close_conn(&stream->conn);
+    } else {
+        /* Freeing an unfinished result would read all its remaining
+         * records. The connection is dedicated to the stream: close it
+         * first, so the client library cancels the fetch and the server
+         * aborts the query. The result can then be freed without reading
+         * anything. */
+        db_close_conn(&stream->conn);
+        mysql_free_result(stream->result);
+    }
+    MemFree(stream);
+}
+
+/** storage for a parameter or a result column of a prepared statement */
+struct stmt_value {
+    union {
+        long long           val_ll;
+        unsigned long long  val_ull;
+    } num;
+    char          *str;     /* string buffer */
+    unsigned long  str_size; /* allocated size of str */
+    unsigned long  length;
+    my_bool        is_null;
+    my_bool        error;
+};
+
+/** prepared statement with its parameter and result buffers */
+struct db_stmt {
+    MYSQL_STMT         *stmt;
+    char               *query;  /* for logging */
+    unsigned int        nb_params;
+    MYSQL_BIND         *params;
+    struct stmt_value  *param_vals;
+    unsigned int        nb_cols;
+    MYSQL_BIND         *cols;
+    struct stmt_value  *col_vals;
+};
+
+/* initial size of result buffers (extended if a value is larger) */
+#define STMT_COL_INIT_SIZE  256
+
+/** make sure a value buffer can store size bytes */
+static int stmt_value_reserve(struct stmt_value *val, unsigned long size)
+{
+    char *buff;
+
+    if (val->str_size >= size)
+        return DB_SUCCESS;
+
+    buff = MemRealloc(val->str, size);
+    if (buff == NULL)
+        return DB_NO_MEMORY;
+
+    val->str = buff;
+    val->str_size = size;
+    return DB_SUCCESS;
+}
+
+static int stmt_error(db_stmt_t *stmt, const char *what)
+{
+    int dberr = mysql_stmt_errno(stmt->stmt);
+
+    if (dberr == ER_DUP_ENTRY) {
+        DisplayLog(LVL_EVENT, LISTMGR_TAG,
+                   "A database record already exists for this entry: '%s' (%s)",
+                   stmt->query, mysql_stmt_error(stmt->stmt));
+        return mysql_error_convert(dberr, false);
+    }
+
+    DisplayLog(LVL_MAJOR, LISTMGR_TAG, "Error %d %s statement '%s': %s",
+               dberr, what, stmt->query, mysql_stmt_error(stmt->stmt));
+    return mysql_error_convert(dberr, true);
+}
+
+int db_stmt_prepare(db_conn_t *conn, const char *query, db_stmt_t **p_stmt)
+{
+    db_stmt_t *stmt;
+    unsigned int i;
+    int rc;
+
+#ifdef _DEBUG_DB
+    DisplayLog(LVL_FULL, LISTMGR_TAG, "SQL prepare: %s", query);
+#endif
+
+    stmt = MemCalloc(1, sizeof(*stmt));
+    if (stmt == NULL)
+        return DB_NO_MEMORY;
+
+    stmt->query = strdup(query);
+    stmt->stmt = mysql_stmt_init(conn);
+    if (stmt->query == NULL || stmt->stmt == NULL) {
+        rc = DB_NO_MEMORY;
+        goto free_stmt;
+    }
+
+    if (mysql_stmt_prepare(stmt->stmt, query, strlen(query))) {
+        rc = stmt_error(stmt, "preparing");
+        goto free_stmt;
+    }
+
+    stmt->nb_params = mysql_stmt_param_count(stmt->stmt);
+    stmt->nb_cols = mysql_stmt_field_count(stmt->stmt);
+
+    if (stmt->nb_params > 0) {
+        stmt->params = MemCalloc(stmt->nb_params, sizeof(MYSQL_BIND));
+        stmt->param_vals = MemCalloc(stmt->nb_params,
+                                     sizeof(struct stmt_value));
+        if (stmt->params == NULL || stmt->param_vals == NULL) {
+            rc = DB_NO_MEMORY;
+            goto free_stmt;
+        }
+    }
+
+    if (stmt->nb_cols > 0) {
+        stmt->cols = MemCalloc(stmt->nb_cols, sizeof(MYSQL_BIND));
+        stmt->col_vals = MemCalloc(stmt->nb_cols, sizeof(struct stmt_value));
+        if (stmt->cols == NULL || stmt->col_vals == NULL) {
+            rc = DB_NO_MEMORY;
+            goto free_stmt;
+        }
+
+        /* all values are retrieved as strings, like in db_next_record() */
+        for (i = 0; i < stmt->nb_cols; i++) {
+            struct stmt_value *val = &stmt->col_vals[i];
+
+            if (stmt_value_reserve(val, STMT_COL_INIT_SIZE)) {
+                rc = DB_NO_MEMORY;
+                goto free_stmt;
+            }
+            stmt->cols[i].buffer_type = MYSQL_TYPE_STRING;
+            stmt->cols[i].buffer = val->str;
+            /* keep room for the final '\0' */
+            stmt->cols[i].buffer_length = val->str_size - 1;
+            stmt->cols[i].length = &val->length;
+            stmt->cols[i].is_null = &val->is_null;
+            stmt->cols[i].error = &val->error;
+        }
+    }
+
+    *p_stmt = stmt;
+    return DB_SUCCESS;
+
+ free_stmt:
+    db_stmt_close(stmt);
+    return rc;
+}
+
+int db_stmt_bind(db_stmt_t *stmt, unsigned int pos, db_type_e type,
+                 const db_type_u *value)
+{
+    MYSQL_BIND *bind;
+    struct stmt_value *val;
+
+    if (pos >= stmt->nb_params)
+        return DB_INVALID_ARG;
+
+    bind = &stmt->params[pos];
+    val = &stmt->param_vals[pos];
+    memset(bind, 0, sizeof(*bind));
+
+    switch (type) {
+    case DB_TEXT:
+        if (value->val_str == NULL) {
+            bind->buffer_type = MYSQL_TYPE_NULL;
+            return DB_SUCCESS;
+        }
+        val->length = strlen(value->val_str);
+        if (stmt_value_reserve(val, val->length + 1))
+            return DB_NO_MEMORY;
+        memcpy(val->str, value->val_str, val->length + 1);
+
+        bind->buffer_type = MYSQL_TYPE_STRING;
+        bind->buffer = val->str;
+        bind->buffer_length = val->length;
+        bind->length = &val->length;
+        return DB_SUCCESS;
+
+    case DB_INT:
+        val->num.val_ll = value->val_int;
+        break;
+    case DB_UINT:
+        val->num.val_ull = value->val_uint;
+        bind->is_unsigned = 1;
+        break;
+    case DB_SHORT:
+        val->num.val_ll = value->val_short;
+        break;
+    case DB_USHORT:
+        val->num.val_ull = value->val_ushort;
+        bind->is_unsigned = 1;
+        break;
+    case DB_BIGINT:
+        val->num.val_ll = value->val_bigint;
+        break;
+    case DB_BIGUINT:
+        val->num.val_ull = value->val_biguint;
+        bind->is_unsigned = 1;
+        break;
+    case DB_BOOL:
+        val->num.val_ll = value->val_bool ? 1 : 0;
+        break;
+
+    default:
+        DisplayLog(LVL_CRIT, LISTMGR_TAG,
+                   "Error: unsupported type %d for statement parameter", type);
+        return DB_INVALID_ARG;
+    }
+
+    /* integers are all sent as 64 bits values */
+    bind->buffer_type = MYSQL_TYPE_LONGLONG;
+    bind->buffer = &val->num;
+    return DB_SUCCESS;
+}
+
+int db_stmt_exec(db_stmt_t *stmt)
+{
+#ifdef _DEBUG_DB
+    DisplayLog(LVL_FULL, LISTMGR_TAG, "SQL execute: %s", stmt->query);
+#endif
+
+    if (stmt->nb_params > 0 && mysql_stmt_bind_param(stmt->stmt, stmt->params))
+        return stmt_error(stmt, "binding parameters of");
+
+    if (mysql_stmt_execute(stmt->stmt))
+        return stmt_error(stmt, "executing");
+
+    if (stmt->nb_cols > 0) {
+        if (mysql_stmt_bind_result(stmt->stmt, stmt->cols))
+            return stmt_error(stmt, "binding result of");
+
+        /* fetch results to the client */
+        if (mysql_stmt_store_result(stmt->stmt))
+            return stmt_error(stmt, "fetching result of");
+    }
+    return DB_SUCCESS;
+}
+
+/** fetch the columns that did not fit in result buffers */
+static int stmt_fetch_truncated(db_stmt_t *stmt)
+{
+    unsigned int i;
+
+    for (i = 0; i < stmt->nb_cols; i++) {
+        struct stmt_value *val = &stmt->col_vals[i];
+        MYSQL_BIND *col = &stmt->cols[i];
+
+        if (!val->error)
+            continue;
+
+        if (stmt_value_reserve(val, val->length + 1))
+            return DB_NO_MEMORY;
+        col->buffer = val->str;
+        col->buffer_length = val->str_size - 1;
+
+        if (mysql_stmt_fetch_column(stmt->stmt, col, i, 0))
+            return stmt_error(stmt, "fetching column of");
+    }
+
+    /* take the new buffers into account for next records */
+    if (mysql_stmt_bind_result(stmt->stmt, stmt->cols))
+        return stmt_error(stmt, "binding result of");
+
+    return DB_SUCCESS;
+}
+
+int db_stmt_next(db_stmt_t *stmt, char *outtab[], unsigned int outtabsize)
+{
+    unsigned int i;
+    int rc;
+
+    /* init ouput tab */
+    for (i = 0; i < outtabsize; i++)
+        outtab[i] = NULL;
+
+    if (stmt->nb_cols > outtabsize) {
         DisplayLog(LVL_CRIT, LISTMGR_TAG,
                    "Output array too small: size = %u, num_fields = %u",
-                   outtabsize, nb_fields);
+                   outtabsize, stmt->nb_cols);
         return DB_BUFFER_TOO_SMALL;
     }
 
+    rc = mysql_stmt_fetch(stmt->stmt);
+    if (rc == MYSQL_NO_DATA)
+        return DB_END_OF_LIST;
+    else if (rc == MYSQL_DATA_TRUNCATED) {
+        rc = stmt_fetch_truncated(stmt);
+        if (rc)
+            return rc;
+    } else if (rc)
+        return stmt_error(stmt, "fetching record of");
+
+    for (i = 0; i < stmt->nb_cols; i++) {
+        struct stmt_value *val = &stmt->col_vals[i];
+
+        if (val->is_null)
+            continue;
+        val->str[val->length] = '\0';
+        outtab[i] = val->str;
+    }
     return DB_SUCCESS;
+}
 
+void db_stmt_reset(db_stmt_t *stmt)
+{
+    if (stmt->nb_cols > 0)
+        mysql_stmt_free_result(stmt->stmt);
 }
 
-/* retrieve number of records in result */
-int db_result_nb_records(db_conn_t *conn, result_handle_t *p_result)
+void db_stmt_close(db_stmt_t *stmt)
 {
-    return mysql_num_rows(*p_result);
+    unsigned int i;
+
+    if (stmt->stmt != NULL)
+        mysql_stmt_close(stmt->stmt);
+
+    if (stmt->param_vals != NULL)
+        for (i = 0; i < stmt->nb_params; i++)
+            MemFree(stmt->param_vals[i].str);
+    if (stmt->col_vals != NULL)
+        for (i = 0; i < stmt->nb_cols; i++)
+            MemFree(stmt->col_vals[i].str);
+
+    MemFree(stmt->params);
+    MemFree(stmt->param_vals);
+    MemFree(stmt->cols);
+    MemFree(stmt->col_vals);
+    free(stmt->query);
+    MemFree(stmt);
 }
 
 int db_list_table_info(db_conn_t *conn, const char *table,
@@ -19,6 +19,7 @@
 #include "list_mgr.h"
 #include "database.h"
 #include "rbh_logs.h"
+#include "Memory.h"
 #include <stdio.h>
 #include <unistd.h>
 
@@ -205,6 +206,272 @@ int db_result_nb_records(db_conn_t *conn, result_handle_t *p_result)
     return p_result->nb_rows;
 }
 
+/** streamed result (read on the client connection) */
+struct db_stream {
+    sqlite3        *conn;
+    sqlite3_stmt   *stmt;
+};
+
+int db_stream_open(db_conn_t *conn, const char *query, bool quiet,
+                   db_stream_t **p_stream)
+{
+    db_stream_t *stream;
+    int rc;
+
+#ifdef _DEBUG_DB
+    DisplayLog(LVL_FULL, LISTMGR_TAG, "SQL query: %s", query);
+#endif
+
+    stream = MemAlloc(sizeof(*stream));
+    if (stream == NULL)
+        return DB_NO_MEMORY;
+
+    stream->conn = *conn;
+
+    do {
+        rc = sqlite3_prepare_v2(*conn, query, -1, &stream->stmt, NULL);
+
+        if (db_is_busy_err(rc))
+            usleep(lmgr_config.db_config.retry_delay_microsec);
+    }
+    while (db_is_busy_err(rc));
+
+    if (rc != SQLITE_OK) {
+        DisplayLog(LVL_DEBUG, LISTMGR_TAG,
+                   "SQLite command failed (%d): %s: %s", rc,
+                   sqlite3_errmsg(*conn), query);
+        MemFree(stream);
+        return sqlite_error_convert(rc);
+    }
+
+    *p_stream = stream;
+    return DB_SUCCESS;
+}
+
+int db_stream_next(db_stream_t *stream, char *outtab[],
+                   unsigned int outtabsize)
+{
+    int i, rc;
+    int nb_cols;
+
+    for (i = 0; i < outtabsize; i++)
+        outtab[i] = NULL;
+
+    do {
+        rc = sqlite3_step(stream->stmt);
+
+        if (db_is_busy_err(rc))
+            usleep(lmgr_config.db_config.retry_delay_microsec);
+    }
+    while (db_is_busy_err(rc));
+
+    if (rc == SQLITE_DONE)
+        return DB_END_OF_LIST;
+    if (rc != SQLITE_ROW) {
+        DisplayLog(LVL_MAJOR, LISTMGR_TAG,
+                   "Error %d reading streamed result: %s", rc,
+                   sqlite3_errmsg(stream->conn));
+        return sqlite_error_convert(rc);
+    }
+
+    nb_cols = sqlite3_column_count(stream->stmt);
+    if (nb_cols > outtabsize)
+        return DB_BUFFER_TOO_SMALL;
+
+    /* values are valid until the next step */
+    for (i = 0; i < nb_cols; i++)
+        outtab[i] = (char *)sqlite3_column_text(stream->stmt, i);
+
+    return DB_SUCCESS;
+}
+
+void db_stream_close(db_stream_t *stream)
+{
+    sqlite3_finalize(stream->stmt);
+    MemFree(stream);
+}
+
+int db_load_data(db_conn_t *conn, const char *table, const char *fields,
+                 const char *set, const char *data, size_t len)
+{
+    /* no bulk load command: rows are inserted by large requests */
+    return DB_NOT_SUPPORTED;
+}
+
+/** prepared statement */
+struct db_stmt {
+    sqlite3        *conn;
+    sqlite3_stmt   *stmt;
+    int             step_rc;    /* result of the last step */
+    bool            row_pending; /* the last step returned a row that
+                                    has not been read yet */
+};
+
+static int stmt_step(db_stmt_t *stmt)
+{
+    int rc;
+
+    do {
+        rc = sqlite3_step(stmt->stmt);
+
+        if (db_is_busy_err(rc))
+            usleep(lmgr_config.db_config.retry_delay_microsec);
+    }
+    while (db_is_busy_err(rc));
+
+    stmt->step_rc = rc;
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        DisplayLog(LVL_DEBUG, LISTMGR_TAG,
+                   "SQLite command failed (%d): %s: %s", rc,
+                   sqlite3_errmsg(stmt->conn), sqlite3_sql(stmt->stmt));
+        /* the statement must be reset before it is used again */
+        sqlite3_reset(stmt->stmt);
+        return sqlite_error_convert(rc);
+    }
+    return DB_SUCCESS;
+}
+
+int db_stmt_prepare(db_conn_t *conn, const char *query, db_stmt_t **p_stmt)
+{
+    db_stmt_t *stmt;
+    int rc;
+
+#ifdef _DEBUG_DB
+    DisplayLog(LVL_FULL, LISTMGR_TAG, "SQL prepare: %s", query);
+#endif
+
+    stmt = MemCalloc(1, sizeof(*stmt));
+    if (stmt == NULL)
+        return DB_NO_MEMORY;
+
+    stmt->conn = *conn;
+
+    do {
+        rc = sqlite3_prepare_v2(*conn, query, -1, &stmt->stmt, NULL);
+
+        if (db_is_busy_err(rc))
+            usleep(lmgr_config.db_config.retry_delay_microsec);
+    }
+    while (db_is_busy_err(rc));
+
+    if (rc != SQLITE_OK) {
+        DisplayLog(LVL_DEBUG, LISTMGR_TAG,
+                   "SQLite command failed (%d): %s: %s", rc,
+                   sqlite3_errmsg(*conn), query);
+        MemFree(stmt);
+        return sqlite_error_convert(rc);
+    }
+
+    *p_stmt = stmt;
+    return DB_SUCCESS;
+}
+
+int db_stmt_bind(db_stmt_t *stmt, unsigned int pos, db_type_e type,
+                 const db_type_u *value)
+{
+    int rc;
+
+    /* sqlite parameters are numbered from 1 */
+    pos++;
+
+    switch (type) {
+    case DB_TEXT:
+        if (value->val_str == NULL)
+            rc = sqlite3_bind_null(stmt->stmt, pos);
+        else
+            rc = sqlite3_bind_text(stmt->stmt, pos, value->val_str, -1,
+                                   SQLITE_TRANSIENT);
+        break;
+    case DB_INT:
+        rc = sqlite3_bind_int64(stmt->stmt, pos, value->val_int);
+        break;
+    case DB_UINT:
+        rc = sqlite3_bind_int64(stmt->stmt, pos, value->val_uint);
+        break;
+    case DB_SHORT:
+        rc = sqlite3_bind_int64(stmt->stmt, pos, value->val_short);
+        break;
+    case DB_USHORT:
+        rc = sqlite3_bind_int64(stmt->stmt, pos, value->val_ushort);
+        break;
+    case DB_BIGINT:
+        rc = sqlite3_bind_int64(stmt->stmt, pos, value->val_bigint);
+        break;
+    case DB_BIGUINT:
+        rc = sqlite3_bind_int64(stmt->stmt, pos, value->val_biguint);
+        break;
+    case DB_BOOL:
+        rc = sqlite3_bind_int64(stmt->stmt, pos, value->val_bool ? 1 : 0);
+        break;
+    default:
+        DisplayLog(LVL_CRIT, LISTMGR_TAG,
+                   "Error: unsupported type %d for statement parameter", type);
+        return DB_INVALID_ARG;
+    }
+
+    if (rc != SQLITE_OK)
+        return sqlite_error_convert(rc);
+    return DB_SUCCESS;
+}
+
+int db_stmt_exec(db_stmt_t *stmt)
+{
+    int rc;
+
+#ifdef _DEBUG_DB
+    DisplayLog(LVL_FULL, LISTMGR_TAG, "SQL execute: %s",
+               sqlite3_sql(stmt->stmt));
+#endif
+
+    /* run the statement up to its first record */
+    rc = stmt_step(stmt);
+    stmt->row_pending = (rc == DB_SUCCESS && stmt->step_rc == SQLITE_ROW);
+    return rc;
+}
+
+int db_stmt_next(db_stmt_t *stmt, char *outtab[], unsigned int outtabsize)
+{
+    int i, rc;
+    int nb_cols;
+
+    for (i = 0; i < outtabsize; i++)
+        outtab[i] = NULL;
+
+    if (stmt->row_pending)
+        stmt->row_pending = false;
+    else if (stmt->step_rc == SQLITE_ROW) {
+        rc = stmt_step(stmt);
+        if (rc)
+            return rc;
+    }
+
+    if (stmt->step_rc != SQLITE_ROW)
+        return DB_END_OF_LIST;
+
+    nb_cols = sqlite3_column_count(stmt->stmt);
+    if (nb_cols > outtabsize)
+        return DB_BUFFER_TOO_SMALL;
+
+    /* values are valid until the next step */
+    for (i = 0; i < nb_cols; i++)
+        outtab[i] = (char *)sqlite3_column_text(stmt->stmt, i);
+
+    return DB_SUCCESS;
+}
+
+void db_stmt_reset(db_stmt_t *stmt)
+{
+    sqlite3_reset(stmt->stmt);
+    stmt->step_rc = SQLITE_DONE;
+    stmt->row_pending = false;
+}
+
+void db_stmt_close(db_stmt_t *stmt)
+{
+    sqlite3_finalize(stmt->stmt);
+    MemFree(stmt);
+}
+
 int db_close_conn(db_conn_t *conn)
 {
     /* XXX Ensure there is no pending transactions? */
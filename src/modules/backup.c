@@ -102,6 +102,7 @@ static void backup_cfg_set_default(void *module_config)
     conf->recovery_action.type = ACTION_UNSET;
     conf->recovery_action.action_u.func.name = "";
     conf->recovery_action.action_u.func.call = NULL;
+    conf->recovery_action.action_u.func.call_batch = NULL;
 }
 
 static void backup_cfg_write_default(FILE *output)
@@ -28,6 +28,7 @@
                           stripe_info_t... */
 #include "status_manager.h"
 
+#include <stddef.h>
 #include <stdbool.h>
 #include <glib.h>
 #include <sys/types.h>
@@ -113,22 +114,47 @@ static int lhsm_init(struct sm_instance *smi, run_flags_t flags)
     return init_action_global_info();
 }
 
-/** Trigger an HSM action */
-static int lhsm_action(enum hsm_user_action action, const entry_id_t *p_id,
-                       const attr_set_t *attrs, const action_params_t *params)
+/** max size of a single HSM request: llite rejects requests
+ * with hur_len() >= MDS_MAXREQSIZE / 3 */
+#ifdef MDS_MAXREQSIZE
+#define LHSM_MAX_REQ_SIZE   (MDS_MAXREQSIZE / 3)
+#else
+#define LHSM_MAX_REQ_SIZE   (5 * 1024 / 3)
+#endif
+
+/** max number of entries in a single HSM request with the given args */
+static unsigned int lhsm_max_req_items(const GString *args)
+{
+    size_t hdr_len = offsetof(struct hsm_user_request, hur_user_item);
+
+    if (!GSTRING_EMPTY(args))
+        hdr_len += args->len + 1;
+
+    if (hdr_len + sizeof(struct hsm_user_item) >= LHSM_MAX_REQ_SIZE)
+        return 1;
+
+    return (LHSM_MAX_REQ_SIZE - 1 - hdr_len) / sizeof(struct hsm_user_item);
+}
+
+/**
+ * Get the archive_id and the serialized parameters of an HSM action.
+ * @param[out] args  Parameters to pass to the copytool (to be freed by
+ *                   the caller, even on error).
+ */
+static int lhsm_action_args(enum hsm_user_action action,
+                            const attr_set_t *attrs,
+                            const action_params_t *params,
+                            unsigned int *p_archive_id, GString **args)
 {
-    struct hsm_user_request *req;
     int rc;
-    char *mpath;
-    unsigned int archive_id = DEFAULT_ARCHIVE_ID;   /* default */
-    GString *args = NULL;
-    const char *data = NULL;
-    int data_len = 0;
+
+    *p_archive_id = DEFAULT_ARCHIVE_ID;   /* default */
+    *args = g_string_new("");
 
     /* if archive_id is explicitely specified in action parameters, use it */
     rc = get_archive_id(params);
     if (rc == 0) {
-        archive_id = rc;
+        *p_archive_id = rc;
     } else if (rc == -ENOENT) {
         /* for HSM_REMOVE, try to get it from previous attrs */
         if (action == HUA_REMOVE) {
@@ -145,7 +171,7 @@ static int lhsm_action(enum hsm_user_action action, const entry_id_t *p_id,
                                "Unexpected type for 'lhsm.archive_id': %d",
                                def->db_type);
                 else
-                    archive_id = *tmp;
+                    *p_archive_id = *tmp;
             }
         }
         /* all other cases: keep default */
@@ -154,39 +180,47 @@ static int lhsm_action(enum hsm_user_action action, const entry_id_t *p_id,
 
     /* Serialize the parameters to pass them to the copytool.
      * exclude archive_id, which is for internal use. */
-    args = g_string_new("");
-    rc = rbh_params_serialize(params, args, exclude_params,
-                              RBH_PARAM_CSV | RBH_PARAM_COMPACT);
-    if (rc)
-        goto free_args;
+    return rbh_params_serialize(params, *args, exclude_params,
+                                RBH_PARAM_CSV | RBH_PARAM_COMPACT);
+}
+
+/** Send an HSM request for a set of entries */
+static int lhsm_request(enum hsm_user_action action, unsigned int archive_id,
+                        const GString *args, const entry_id_t **ids,
+                        unsigned int count)
+{
+    struct hsm_user_request *req;
+    const char *data = NULL;
+    int data_len = 0;
+    unsigned int i;
+    char *mpath;
+    int rc;
 
     if (!GSTRING_EMPTY(args)) {
         data = args->str;
         data_len = args->len + 1;
     }
 
-    DisplayLog(LVL_DEBUG, LHSM_TAG,
-               "action %s, fid=" DFID ", archive_id=%u, parameters='%s'",
-               hsm_user_action2name(action), PFID(p_id), archive_id, args->str);
-
-    req = llapi_hsm_user_request_alloc(1, data_len);
+    req = llapi_hsm_user_request_alloc(count, data_len);
     if (!req) {
         rc = -errno;
         DisplayLog(LVL_CRIT, LHSM_TAG, "Cannot create HSM request: %s",
                    strerror(-rc));
-        goto free_args;
+        return rc;
     }
 
     req->hur_request.hr_action = action;
     req->hur_request.hr_archive_id = archive_id;
     req->hur_request.hr_flags = 0;
 
-    req->hur_user_item[0].hui_fid = *p_id;
-    req->hur_user_item[0].hui_extent.offset = 0;
-    /* XXX for now, always transfer entire file */
-    req->hur_user_item[0].hui_extent.length = -1LL;
+    for (i = 0; i < count; i++) {
+        req->hur_user_item[i].hui_fid = *ids[i];
+        req->hur_user_item[i].hui_extent.offset = 0;
+        /* XXX for now, always transfer entire file */
+        req->hur_user_item[i].hui_extent.length = -1LL;
+    }
 
-    req->hur_request.hr_itemcount = 1;
+    req->hur_request.hr_itemcount = count;
     req->hur_request.hr_data_len = data_len;
 
     if (data)
@@ -201,13 +235,148 @@ static int lhsm_action(enum hsm_user_action action, const entry_id_t *p_id,
     if (rc)
         DisplayLog(LVL_CRIT, LHSM_TAG,
                    "ERROR performing HSM request(%s, root=%s, fid=" DFID
-                   "): %s", hsm_user_action2name(action), get_mount_point(NULL),
-                   PFID(p_id), strerror(-rc));
+                   "%s): %s", hsm_user_action2name(action),
+                   get_mount_point(NULL), PFID(ids[0]),
+                   count > 1 ? ", ..." : "", strerror(-rc));
+    return rc;
+}
+
+/** Trigger an HSM action */
+static int lhsm_action(enum hsm_user_action action, const entry_id_t *p_id,
+                       const attr_set_t *attrs, const action_params_t *params)
+{
+    unsigned int archive_id;
+    GString *args = NULL;
+    int rc;
+
+    rc = lhsm_action_args(action, attrs, params, &archive_id, &args);
+    if (rc)
+        goto free_args;
+
+    DisplayLog(LVL_DEBUG, LHSM_TAG,
+               "action %s, fid=" DFID ", archive_id=%u, parameters='%s'",
+               hsm_user_action2name(action), PFID(p_id), archive_id, args->str);
+
+    rc = lhsm_request(action, archive_id, args, &p_id, 1);
+
  free_args:
     g_string_free(args, TRUE);
     return rc;
 }
 
+/**
+ * Send an HSM request for a set of entries and set their return code.
+ * If the request is rejected as too large, it is split in halves.
+ * If it fails for another reason, its entries are sent again one by one,
+ * so an invalid entry doesn't make the others fail.
+ */
+static void lhsm_request_items(enum hsm_user_action action,
+                               unsigned int archive_id, const GString *args,
+                               const entry_id_t **ids,
+                               const unsigned int *req_idx, unsigned int n,
+                               action_item_t *items)
+{
+    unsigned int j, half;
+    int rc;
+
+    rc = lhsm_request(action, archive_id, args, ids, n);
+    if (rc == 0 || n == 1) {
+        for (j = 0; j < n; j++)
+            items[req_idx[j]].rc = rc;
+        return;
+    }
+
+    if (rc == -E2BIG || rc == -ENOMEM) {
+        half = n / 2;
+        DisplayLog(LVL_DEBUG, LHSM_TAG, "Splitting HSM request of %u "
+                   "entries", n);
+        lhsm_request_items(action, archive_id, args, ids, req_idx, half,
+                           items);
+        lhsm_request_items(action, archive_id, args, ids + half,
+                           req_idx + half, n - half, items);
+        return;
+    }
+
+    /* find out which entries make the request fail */
+    for (j = 0; j < n; j++)
+        items[req_idx[j]].rc = lhsm_request(action, archive_id, args,
+                                            &ids[j], 1);
+}
+
+/**
+ * Trigger an HSM action on a batch of entries.
+ * Entries with the same archive_id and parameters are sent in HSM requests
+ * of the largest size accepted by Lustre.
+ */
+static int lhsm_batch_action(enum hsm_user_action action,
+                             action_item_t *items, unsigned int count)
+{
+    unsigned int *archive_ids = NULL;
+    GString **args = NULL;
+    const entry_id_t **ids = NULL;
+    unsigned int *req_idx = NULL;
+    bool *done = NULL;
+    unsigned int i, j, n, max_items;
+    int rc = 0;
+
+    archive_ids = calloc(count, sizeof(*archive_ids));
+    args = calloc(count, sizeof(*args));
+    done = calloc(count, sizeof(*done));
+    ids = calloc(count, sizeof(*ids));
+    req_idx = calloc(count, sizeof(*req_idx));
+    if (!archive_ids || !args || !done || !ids || !req_idx) {
+        rc = -ENOMEM;
+        goto out_free;
+    }
+
+    for (i = 0; i < count; i++) {
+        items[i].rc = lhsm_action_args(action, items[i].attrs,
+                                       items[i].params, &archive_ids[i],
+                                       &args[i]);
+        /* don't send entries with invalid arguments */
+        done[i] = (items[i].rc != 0);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (done[i])
+            continue;
+
+        /* gather entries with the same request arguments */
+        max_items = lhsm_max_req_items(args[i]);
+        n = 0;
+        for (j = i; j < count && n < max_items; j++) {
+            if (done[j] || archive_ids[j] != archive_ids[i]
+                || !g_string_equal(args[j], args[i]))
+                continue;
+            req_idx[n] = j;
+            ids[n] = items[j].id;
+            n++;
+            done[j] = true;
+        }
+
+        DisplayLog(LVL_DEBUG, LHSM_TAG,
+                   "action %s, %u entries, archive_id=%u, parameters='%s'",
+                   hsm_user_action2name(action), n, archive_ids[i],
+                   args[i]->str);
+
+        lhsm_request_items(action, archive_ids[i], args[i], ids, req_idx, n,
+                           items);
+    }
+    rc = 0;
+
+ out_free:
+    if (args != NULL)
+        for (i = 0; i < count; i++)
+            if (args[i] != NULL)
+                g_string_free(args[i], TRUE);
+    free(archive_ids);
+    free(args);
+    free(done);
+    free(ids);
+    free(req_idx);
+    return rc;
+}
+
 /** perform hsm_release action */
 static int lhsm_release(const entry_id_t *p_entry_id, attr_set_t *p_attrs,
                         const action_params_t *params, post_action_e *after,
@@ -236,6 +405,27 @@ static int lhsm_remove(const entry_id_t *p_entry_id, attr_set_t *p_attrs,
     return rc;
 }
 
+/** perform hsm_release action on a batch of entries */
+static int lhsm_release_batch(action_item_t *items, unsigned int count,
+                              db_cb_func_t db_cb_fn, void *db_cb_arg)
+{
+    return lhsm_batch_action(HUA_RELEASE, items, count);
+}
+
+/** perform hsm_archive action on a batch of entries */
+static int lhsm_archive_batch(action_item_t *items, unsigned int count,
+                              db_cb_func_t db_cb_fn, void *db_cb_arg)
+{
+    return lhsm_batch_action(HUA_ARCHIVE, items, count);
+}
+
+/** perform hsm_remove action on a batch of entries */
+static int lhsm_remove_batch(action_item_t *items, unsigned int count,
+                             db_cb_func_t db_cb_fn, void *db_cb_arg)
+{
+    return lhsm_batch_action(HUA_REMOVE, items, count);
+}
+
 /** set of managed status */
 typedef enum {
     STATUS_NEW, /* file has no HSM flags (just created) */
@@ -1132,6 +1322,19 @@ status_manager_t *mod_get_status_manager(void)
     return &lhsm_sm;
 }
 
+action_batch_func_t mod_get_batch_action(const char *action_name)
+{
+    if (strcmp(action_name, "lhsm.archive") == 0)
+        return lhsm_archive_batch;
+    else if (strcmp(action_name, "lhsm.release") == 0)
+        return lhsm_release_batch;
+    else if (strcmp(action_name, "lhsm.hsm_remove") == 0
+             || strcmp(action_name, "lhsm.remove") == 0)
+        return lhsm_remove_batch;
+    else
+        return NULL;
+}
+
 action_func_t mod_get_action(const char *action_name)
 {
     if (strcmp(action_name, "lhsm.archive") == 0)
@@ -130,5 +130,7 @@ status_manager_t *mod_get_status_manager(void);
 
 action_func_t mod_get_action(const char *action_name);
 
+action_batch_func_t mod_get_batch_action(const char *action_name);
+
 action_scheduler_t *mod_get_scheduler(const char *sched_name);
 #endif
@@ -131,6 +131,7 @@ static void free_whitelist(whitelist_item_t *p_items, unsigned int count)
 
     /* free boolean expressions */
     for (i = 0; i < count; i++) {
+        free_bool_prog(p_items[i].prog);
         FreeBoolExpr(&p_items[i].bool_expr, false);
     }
 
@@ -208,6 +209,8 @@ int parse_policy_action(const char *name, const char *value,
             sprintf(msg_out, "%s: unknown function '%s'", name, value);
             return EINVAL;
         }
+        /* optional */
+        action->action_u.func.call_batch = module_get_batch_action(value);
         action->action_u.func.name = strdup(value);
         if (action->action_u.func.name == NULL)
             return ENOMEM;
@@ -1143,6 +1146,8 @@ static inline bool match_policy_action_params(const char *s)
 static void free_fileclass(fileset_item_t *fset)
 {
     /* free fileset definition */
+    free_bool_prog(fset->prog);
+    fset->prog = NULL;
     FreeBoolExpr(&fset->definition, false);
 
     /* free action params */
@@ -1776,6 +1781,7 @@ static void free_rules_list(rule_item_t *items, int count)
 
     for (i = 0; i < count; i++) {
         free(items[i].target_list);
+        free_bool_prog(items[i].prog);
         FreeBoolExpr(&items[i].condition, false);
         free_policy_action(&items[i].action);
         rbh_params_free(&items[i].action_params);
@@ -1805,6 +1811,12 @@ static void free_policy_descr(policy_descr_t *descr)
 {
     /** FIXME free sm_instance */
     free_policy_rules(&descr->rules);
+    free_bool_prog(descr->scope_prog);
+    descr->scope_prog = NULL;
+    if (descr->class_cases != NULL) {
+        g_hash_table_destroy(descr->class_cases);
+        descr->class_cases = NULL;
+    }
     FreeBoolExpr(&descr->scope, false);
     free(descr->implements);
     free_policy_action(&descr->default_action);
@@ -2066,6 +2078,38 @@ static int reload_policies(policies_t *p_policies)
     return 0;
 }
 
+/** compile all boolean expressions of policies and fileclasses */
+static void compile_policies(policies_t *p_policies)
+{
+    unsigned int i, j;
+
+    for (i = 0; i < p_policies->fileset_count; i++) {
+        fileset_item_t *fset = &p_policies->fileset_list[i];
+
+        fset->prog = compile_boolexpr(&fset->definition);
+    }
+    /* merge fileclass conditions once they are compiled */
+    p_policies->class_matcher = class_matcher_build(p_policies);
+
+    for (i = 0; i < p_policies->policy_count; i++) {
+        policy_descr_t *descr = &p_policies->policy_list[i];
+        policy_rules_t *rules = &descr->rules;
+
+        descr->scope_prog = compile_boolexpr(&descr->scope);
+
+        for (j = 0; j < rules->whitelist_count; j++)
+            rules->whitelist_rules[j].prog =
+                compile_boolexpr(&rules->whitelist_rules[j].bool_expr);
+
+        for (j = 0; j < rules->rule_count; j++)
+            rules->rules[j].prog = compile_boolexpr(&rules->rules[j].condition);
+
+        if (class_cases_build(descr))
+            DisplayLog(LVL_MAJOR, LOADER_TAG, "Failed to index policy cases of "
+                       "policy '%s'", descr->name);
+    }
+}
+
 static int set_policies(void *cfg, bool reload)
 {
     policies_t *p_policies = (policies_t *) cfg;
@@ -2077,6 +2121,9 @@ static int set_policies(void *cfg, bool reload)
 
         /* update status manager masks, once they are all loaded */
         smi_update_masks();
+
+        /* rules are not updated on reload: compile them once */
+        compile_policies(&policies);
     }
     return 0;
 }
@@ -2187,6 +2234,9 @@ static void policies_cfg_free(void *arg)
     cfg->policy_list = NULL;
     cfg->policy_count = 0;
 
+    class_matcher_free(cfg->class_matcher);
+    cfg->class_matcher = NULL;
+
     free_filesets(cfg);
     free(cfg);
 }
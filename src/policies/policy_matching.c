@@ -28,6 +28,8 @@
 #include "status_manager.h"
 
 #include <string.h>
+#include <stddef.h>
+#include <ctype.h>
 #include <libgen.h>
 #include <fnmatch.h>
 #include <sys/types.h>
@@ -1347,6 +1349,1130 @@ policy_match_t entry_matches(const entry_id_t *p_entry_id,
                           false);
 }
 
+/* ======================================================================
+ * Compiled boolean expressions.
+ * Rule, scope and fileclass expressions are compiled once at config load
+ * time into a flat program with conditional jumps, so matching an entry
+ * doesn't walk the expression tree. Conditions are specialized when
+ * possible: path patterns are joined to the filesystem root, a literal
+ * prefix of patterns is compared before calling fnmatch(), and attributes
+ * are read at precomputed offsets.
+ * ======================================================================*/
+
+enum prog_op {
+    OP_CONST,   /**< acc = constant */
+    OP_NOT,     /**< acc = !acc */
+    OP_AND,     /**< if acc != MATCH, jump (end of AND sequence) */
+    OP_OR,      /**< if acc != NO_MATCH, jump (end of OR sequence) */
+    OP_COND,    /**< generic condition: call eval_condition() */
+    OP_NAME,    /**< name (i)pattern */
+    OP_PATH,    /**< path pattern */
+    OP_TREE,    /**< tree pattern */
+    OP_TYPE,    /**< entry type */
+    OP_SIZE,    /**< size comparison */
+    OP_UINT,    /**< integer attribute comparison */
+    OP_AGE,     /**< time attribute comparison (now - attr) */
+};
+
+struct prog_insn {
+    enum prog_op op;
+    /** original condition (fallback, values, comparator) */
+    const compare_triplet_t *cond;
+    /** index of the condition in the class matcher (-1 if none) */
+    int slot;
+    union {
+        policy_match_t  cst;    /**< for OP_CONST */
+        unsigned int    jump;   /**< for OP_AND, OP_OR */
+        struct {
+            /** pattern joined to fs root for path and tree conditions */
+            char       *pattern;
+            /** length of the leading literal part of the pattern */
+            size_t      prefix_len;
+            int         fnm_flags;
+        } str;
+        struct {
+            /** standard attribute mask bit */
+            uint32_t    mask;
+            /** offset of the attribute in entry_info_t */
+            size_t      offset;
+        } num;
+        const char     *type;   /**< for OP_TYPE */
+    } u;
+};
+
+struct bool_prog {
+    struct prog_insn   *insn;
+    unsigned int        count;
+    unsigned int        size;
+    /** operands were reordered: the program is equivalent to the
+     * expression only if the entry has all these attributes */
+    bool                reordered;
+    attr_mask_t         need_mask;
+};
+
+/** allow disabling compiled programs (e.g. for benchmarking) */
+static bool compiled_matching = true;
+
+void set_compiled_matching(bool enable)
+{
+    compiled_matching = enable;
+}
+
+/** static information about a sub-expression */
+struct expr_info {
+    unsigned int    cost;
+    /** only returns MATCH or NO_MATCH if attributes in mask are set */
+    bool            pure;
+    attr_mask_t     mask;
+};
+
+/** estimated relative cost of evaluating a condition */
+static void cond_info(const compare_triplet_t *cond, struct expr_info *info)
+{
+    info->pure = true;
+    info->mask = null_mask;
+
+    switch (cond->crit) {
+    case CRITERIA_SIZE:
+        info->cost = 1;
+        info->mask.std = ATTR_MASK_size;
+        break;
+    case CRITERIA_DEPTH:
+        info->cost = 1;
+        info->mask.std = ATTR_MASK_depth;
+        break;
+    case CRITERIA_NLINK:
+        info->cost = 1;
+        info->mask.std = ATTR_MASK_nlink;
+        break;
+    case CRITERIA_DIRCOUNT:
+        info->cost = 2;
+        info->mask.std = ATTR_MASK_dircount;
+        break;
+    case CRITERIA_LAST_ACCESS:
+        info->cost = 1;
+        info->mask.std = ATTR_MASK_last_access;
+        break;
+    case CRITERIA_LAST_MOD:
+        info->cost = 1;
+        info->mask.std = ATTR_MASK_last_mod;
+        break;
+    case CRITERIA_LAST_MDCHANGE:
+        info->cost = 1;
+        info->mask.std = ATTR_MASK_last_mdchange;
+        break;
+    case CRITERIA_CREATION:
+        info->cost = 1;
+        info->mask.std = ATTR_MASK_creation_time;
+        break;
+    case CRITERIA_TYPE:
+        info->cost = 2;
+        info->mask.std = ATTR_MASK_type;
+        /* unknown type is an error */
+        info->pure = (type2db(cond->val.type) != NULL);
+        break;
+    case CRITERIA_OWNER:
+        info->cost = 3;
+        info->mask.std = ATTR_MASK_uid;
+        break;
+    case CRITERIA_GROUP:
+        info->cost = 3;
+        info->mask.std = ATTR_MASK_gid;
+        break;
+    case CRITERIA_NAME:
+    case CRITERIA_INAME:
+        info->cost = 4;
+        info->mask.std = ATTR_MASK_name;
+        break;
+    case CRITERIA_FILECLASS:
+        info->cost = 6;
+        break;
+    case CRITERIA_PATH:
+        info->cost = 8;
+        info->mask.std = ATTR_MASK_fullpath;
+        break;
+    case CRITERIA_TREE:
+        info->cost = 12;
+        info->mask.std = ATTR_MASK_fullpath;
+        break;
+#ifdef _LUSTRE
+    case CRITERIA_POOL:
+        info->cost = 4;
+        info->mask.std = ATTR_MASK_stripe_info;
+        break;
+    case CRITERIA_OST:
+        info->cost = 3;
+        info->mask.std = ATTR_MASK_stripe_items;
+        break;
+#endif
+    case CRITERIA_XATTR:
+        /* system call */
+        info->cost = 100;
+        info->pure = false;
+        break;
+    default:
+        /* status, sm_info, rm_time: depend on the status manager */
+        info->cost = 3;
+        info->pure = false;
+        break;
+    }
+}
+
+static void expr_info(const bool_node_t *node, struct expr_info *info)
+{
+    struct expr_info info2;
+
+    switch (node->node_type) {
+    case NODE_CONSTANT:
+        info->cost = 0;
+        info->pure = true;
+        info->mask = null_mask;
+        return;
+    case NODE_CONDITION:
+        cond_info(node->content_u.condition, info);
+        return;
+    case NODE_UNARY_EXPR:
+        expr_info(node->content_u.bool_expr.expr1, info);
+        return;
+    case NODE_BINARY_EXPR:
+        expr_info(node->content_u.bool_expr.expr1, info);
+        expr_info(node->content_u.bool_expr.expr2, &info2);
+        info->cost += info2.cost;
+        info->pure = info->pure && info2.pure;
+        info->mask = attr_mask_or(&info->mask, &info2.mask);
+        return;
+    }
+}
+
+static struct prog_insn *prog_emit(struct bool_prog *prog, enum prog_op op,
+                                   const compare_triplet_t *cond)
+{
+    struct prog_insn *insn;
+
+    if (prog->count == prog->size) {
+        unsigned int new_size = prog->size ? 2 * prog->size : 16;
+
+        insn = realloc(prog->insn, new_size * sizeof(*insn));
+        if (insn == NULL)
+            return NULL;
+        prog->insn = insn;
+        prog->size = new_size;
+    }
+    insn = &prog->insn[prog->count++];
+    memset(insn, 0, sizeof(*insn));
+    insn->op = op;
+    insn->cond = cond;
+    insn->slot = -1;
+    return insn;
+}
+
+/** length of the leading part of a pattern with no special character */
+static size_t literal_prefix_len(const char *pattern)
+{
+    return strcspn(pattern, "*?[\\");
+}
+
+static int compile_path_cond(struct prog_insn *insn,
+                             const compare_triplet_t *cond)
+{
+    const char *regexp = cond->val.str;
+    enum regexp_flags flags = cmpflg2regexpflg(cond->flags);
+    bool any_level = (flags & REGEXP_ANY_LEVEL);
+
+    /* same as TestPathRegexp(), once for all */
+    if (!IS_ABSOLUTE_PATH(regexp) && !(any_level && (regexp[0] == '*'))) {
+        if (asprintf(&insn->u.str.pattern, "%s/%s", global_config.fs_path,
+                     regexp) < 0)
+            return -ENOMEM;
+    } else {
+        insn->u.str.pattern = strdup(regexp);
+        if (insn->u.str.pattern == NULL)
+            return -ENOMEM;
+    }
+
+    if (flags & REGEXP_INSENSITIVE)
+        insn->u.str.fnm_flags |= FNM_CASEFOLD;
+    if (!any_level)
+        insn->u.str.fnm_flags |= FNM_PATHNAME;
+
+    insn->u.str.prefix_len = literal_prefix_len(insn->u.str.pattern);
+    return 0;
+}
+
+#define NUM_INSN(_insn, _op, _attr) do {                                  \
+                (_insn)->op = (_op);                                       \
+                (_insn)->u.num.mask = ATTR_MASK_##_attr;                   \
+                (_insn)->u.num.offset = offsetof(entry_info_t, _attr);     \
+            } while (0)
+
+static int compile_cond(struct bool_prog *prog, const compare_triplet_t *cond)
+{
+    struct prog_insn *insn;
+
+    insn = prog_emit(prog, OP_COND, cond);
+    if (insn == NULL)
+        return -ENOMEM;
+
+    switch (cond->crit) {
+    case CRITERIA_PATH:
+        insn->op = OP_PATH;
+        return compile_path_cond(insn, cond);
+    case CRITERIA_TREE:
+        insn->op = OP_TREE;
+        return compile_path_cond(insn, cond);
+    case CRITERIA_NAME:
+    case CRITERIA_INAME:
+        insn->op = OP_NAME;
+        insn->u.str.pattern = strdup(cond->val.str);
+        if (insn->u.str.pattern == NULL)
+            return -ENOMEM;
+        if (cond->flags & CMP_FLG_INSENSITIVE)
+            insn->u.str.fnm_flags = FNM_CASEFOLD;
+        insn->u.str.prefix_len = literal_prefix_len(cond->val.str);
+        return 0;
+    case CRITERIA_TYPE:
+        insn->u.type = type2db(cond->val.type);
+        /* else, let eval_condition() report the error */
+        if (insn->u.type != NULL)
+            insn->op = OP_TYPE;
+        return 0;
+    case CRITERIA_SIZE:
+        NUM_INSN(insn, OP_SIZE, size);
+        return 0;
+    case CRITERIA_DEPTH:
+        NUM_INSN(insn, OP_UINT, depth);
+        return 0;
+    case CRITERIA_NLINK:
+        NUM_INSN(insn, OP_UINT, nlink);
+        return 0;
+    case CRITERIA_LAST_ACCESS:
+        NUM_INSN(insn, OP_AGE, last_access);
+        return 0;
+    case CRITERIA_LAST_MOD:
+        NUM_INSN(insn, OP_AGE, last_mod);
+        return 0;
+    case CRITERIA_LAST_MDCHANGE:
+        NUM_INSN(insn, OP_AGE, last_mdchange);
+        return 0;
+    case CRITERIA_CREATION:
+        NUM_INSN(insn, OP_AGE, creation_time);
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+/** operand of a flattened AND/OR sequence */
+struct prog_operand {
+    const bool_node_t  *node;
+    struct expr_info    info;
+};
+
+static int operand_cost_cmp(const void *a, const void *b)
+{
+    const struct prog_operand *o1 = a;
+    const struct prog_operand *o2 = b;
+
+    if (o1->info.cost != o2->info.cost)
+        return o1->info.cost < o2->info.cost ? -1 : 1;
+    /* keep the original order (qsort is not stable) */
+    return o1->node < o2->node ? -1 : (o1->node > o2->node ? 1 : 0);
+}
+
+/** list operands of a sequence of the same boolean operator,
+ * in evaluation order */
+static int flatten_operands(const bool_node_t *node, bool_op_t op,
+                            struct prog_operand **list, unsigned int *count)
+{
+    int rc;
+
+    if (node->node_type == NODE_BINARY_EXPR
+        && node->content_u.bool_expr.bool_op == op) {
+        rc = flatten_operands(node->content_u.bool_expr.expr1, op, list,
+                              count);
+        if (rc)
+            return rc;
+        return flatten_operands(node->content_u.bool_expr.expr2, op, list,
+                                count);
+    }
+
+    /* grow by steps of 8 */
+    if ((*count % 8) == 0) {
+        struct prog_operand *new_list = realloc(*list, (*count + 8)
+                                                * sizeof(**list));
+        if (new_list == NULL)
+            return -ENOMEM;
+        *list = new_list;
+    }
+    (*list)[*count].node = node;
+    expr_info(node, &(*list)[*count].info);
+    (*count)++;
+    return 0;
+}
+
+static int compile_node(struct bool_prog *prog, const bool_node_t *node);
+
+/** compile a sequence of operands of the same boolean operator */
+static int compile_sequence(struct bool_prog *prog, const bool_node_t *node)
+{
+    bool_op_t op = node->content_u.bool_expr.bool_op;
+    struct prog_operand *list = NULL;
+    unsigned int count = 0, i, j, first_jump;
+    int rc;
+
+    rc = flatten_operands(node, op, &list, &count);
+    if (rc)
+        goto out;
+
+    /* Pure operands can be evaluated in any order with the same result,
+     * as long as attributes are set: sort each run of consecutive pure
+     * operands by cost. Other operands are evaluated in config order. */
+    for (i = 0; i < count; i = j + 1) {
+        for (j = i; j < count && list[j].info.pure; j++)
+            ;
+        if (j - i > 1) {
+            unsigned int k;
+            bool sorted = true;
+
+            for (k = i + 1; k < j; k++)
+                if (list[k].info.cost < list[k - 1].info.cost)
+                    sorted = false;
+
+            if (!sorted) {
+                qsort(&list[i], j - i, sizeof(*list), operand_cost_cmp);
+                prog->reordered = true;
+                for (k = i; k < j; k++)
+                    prog->need_mask = attr_mask_or(&prog->need_mask,
+                                                   &list[k].info.mask);
+            }
+        }
+    }
+
+    /* evaluate the first operand, then jump to the end as soon as the
+     * result is known */
+    first_jump = prog->count;
+    for (i = 0; i < count; i++) {
+        if (i > 0 && prog_emit(prog, op == BOOL_AND ? OP_AND : OP_OR,
+                               NULL) == NULL) {
+            rc = -ENOMEM;
+            goto out;
+        }
+        rc = compile_node(prog, list[i].node);
+        if (rc)
+            goto out;
+    }
+
+    /* set jump targets */
+    for (i = first_jump; i < prog->count; i++) {
+        if (prog->insn[i].op == OP_AND || prog->insn[i].op == OP_OR) {
+            /* skip nested sequences */
+            if (prog->insn[i].u.jump != 0)
+                continue;
+            prog->insn[i].u.jump = prog->count;
+        }
+    }
+
+ out:
+    free(list);
+    return rc;
+}
+
+static int compile_node(struct bool_prog *prog, const bool_node_t *node)
+{
+    struct prog_insn *insn;
+    int rc;
+
+    switch (node->node_type) {
+    case NODE_CONSTANT:
+        insn = prog_emit(prog, OP_CONST, NULL);
+        if (insn == NULL)
+            return -ENOMEM;
+        insn->u.cst = bool2policy_match(node->content_u.constant);
+        return 0;
+
+    case NODE_CONDITION:
+        return compile_cond(prog, node->content_u.condition);
+
+    case NODE_UNARY_EXPR:
+        /* BOOL_NOT is the only supported unary operator */
+        if (node->content_u.bool_expr.bool_op != BOOL_NOT)
+            return -EINVAL;
+        rc = compile_node(prog, node->content_u.bool_expr.expr1);
+        if (rc)
+            return rc;
+        if (prog_emit(prog, OP_NOT, NULL) == NULL)
+            return -ENOMEM;
+        return 0;
+
+    case NODE_BINARY_EXPR:
+        if (node->content_u.bool_expr.bool_op != BOOL_AND
+            && node->content_u.bool_expr.bool_op != BOOL_OR)
+            return -EINVAL;
+        return compile_sequence(prog, node);
+    }
+    return -EINVAL;
+}
+
+void free_bool_prog(struct bool_prog *prog)
+{
+    unsigned int i;
+
+    if (prog == NULL)
+        return;
+
+    for (i = 0; i < prog->count; i++) {
+        switch (prog->insn[i].op) {
+        case OP_NAME:
+        case OP_PATH:
+        case OP_TREE:
+            free(prog->insn[i].u.str.pattern);
+            break;
+        default:
+            break;
+        }
+    }
+    free(prog->insn);
+    free(prog);
+}
+
+struct bool_prog *compile_boolexpr(const bool_node_t *expr)
+{
+    struct bool_prog *prog;
+    int rc;
+
+    prog = calloc(1, sizeof(*prog));
+    if (prog == NULL)
+        return NULL;
+
+    rc = compile_node(prog, expr);
+    if (rc) {
+        char buff[1024];
+
+        BoolExpr2str((bool_node_t *)expr, buff, sizeof(buff));
+        DisplayLog(LVL_MAJOR, POLICY_TAG, "Failed to compile expression "
+                   "'%s': %s. It will be interpreted.", buff, strerror(-rc));
+        free_bool_prog(prog);
+        return NULL;
+    }
+    return prog;
+}
+
+static inline bool match_prefix(const char *str, const struct prog_insn *insn)
+{
+    if (insn->u.str.prefix_len == 0)
+        return true;
+
+    if (insn->u.str.fnm_flags & FNM_CASEFOLD)
+        return !strncasecmp(str, insn->u.str.pattern, insn->u.str.prefix_len);
+    else
+        return !strncmp(str, insn->u.str.pattern, insn->u.str.prefix_len);
+}
+
+/** Match a string against a compiled pattern.
+ * The condition is negated for '!=' and 'unlike' comparators. */
+static inline policy_match_t str_match(const struct prog_insn *insn, bool rc)
+{
+    if (insn->cond->op == COMP_EQUAL || insn->cond->op == COMP_LIKE)
+        return bool2policy_match(rc);
+    else
+        return bool2policy_match(!rc);
+}
+
+static policy_match_t exec_tree(const struct prog_insn *insn,
+                                const char *path)
+{
+    char tmpbuff[RBH_PATH_MAX];
+    const char *pattern = insn->u.str.pattern;
+    int flags = insn->u.str.fnm_flags;
+    bool rc;
+
+    /* the parent directory is a prefix of an absolute path */
+    if (path[0] == '/' && !match_prefix(path, insn))
+        return str_match(insn, false);
+
+    ExtractParentDir(path, tmpbuff);
+    rc = !fnmatch(pattern, tmpbuff, flags | FNM_LEADING_DIR);
+    if (!rc)    /* try matching root */
+        rc = !fnmatch(pattern, path, flags);
+
+    return str_match(insn, rc);
+}
+
+/** evaluate a specialized condition */
+static policy_match_t exec_insn(const struct prog_insn *insn,
+                                const entry_id_t *p_entry_id,
+                                const attr_set_t *p_entry_attr,
+                                const time_modifier_t *p_pol_mod,
+                                const sm_instance_t *smi, int no_warning,
+                                time_t now)
+{
+    const void *attr_ptr;
+
+    switch (insn->op) {
+    case OP_NAME:
+        if (!ATTR_MASK_TEST(p_entry_attr, name))
+            break;
+        if (!match_prefix(ATTR(p_entry_attr, name), insn))
+            return str_match(insn, false);
+        return str_match(insn, !fnmatch(insn->u.str.pattern,
+                                        ATTR(p_entry_attr, name),
+                                        insn->u.str.fnm_flags));
+    case OP_PATH:
+        if (!ATTR_MASK_TEST(p_entry_attr, fullpath))
+            break;
+        if (!match_prefix(ATTR(p_entry_attr, fullpath), insn))
+            return str_match(insn, false);
+        return str_match(insn, !fnmatch(insn->u.str.pattern,
+                                        ATTR(p_entry_attr, fullpath),
+                                        insn->u.str.fnm_flags));
+    case OP_TREE:
+        if (!ATTR_MASK_TEST(p_entry_attr, fullpath))
+            break;
+        return exec_tree(insn, ATTR(p_entry_attr, fullpath));
+
+    case OP_TYPE:
+        if (!ATTR_MASK_TEST(p_entry_attr, type))
+            break;
+        if (insn->cond->op == COMP_EQUAL)
+            return bool2policy_match(!strcmp(ATTR(p_entry_attr, type),
+                                             insn->u.type));
+        else
+            return bool2policy_match(strcmp(ATTR(p_entry_attr, type),
+                                            insn->u.type));
+
+    case OP_SIZE:
+        if (!(p_entry_attr->attr_mask.std & insn->u.num.mask))
+            break;
+        return bool2policy_match(size_compare(ATTR(p_entry_attr, size),
+                                              insn->cond->op,
+                                              insn->cond->val.size));
+    case OP_UINT:
+        if (!(p_entry_attr->attr_mask.std & insn->u.num.mask))
+            break;
+        attr_ptr = (const char *)&p_entry_attr->attr_values
+            + insn->u.num.offset;
+        return bool2policy_match(int_compare(*(const unsigned int *)attr_ptr,
+                                             insn->cond->op,
+                                             insn->cond->val.integer));
+    case OP_AGE:
+        if (!(p_entry_attr->attr_mask.std & insn->u.num.mask))
+            break;
+        attr_ptr = (const char *)&p_entry_attr->attr_values
+            + insn->u.num.offset;
+        return bool2policy_match(int_compare(now -
+                                             *(const unsigned int *)attr_ptr,
+                                             insn->cond->op,
+                                             time_modify(insn->cond->
+                                                         val.duration,
+                                                         p_pol_mod)));
+    default:
+        break;
+    }
+
+    /* generic condition, or missing attribute (let eval_condition()
+     * report it) */
+    return eval_condition(p_entry_id, p_entry_attr, insn->cond, p_pol_mod,
+                          smi, no_warning);
+}
+
+struct class_matcher;
+static policy_match_t slot_result(const struct class_matcher *cm,
+                                  int8_t *memo, int slot,
+                                  const entry_id_t *p_entry_id,
+                                  const attr_set_t *p_entry_attr,
+                                  time_t now);
+
+/**
+ * Run a compiled program.
+ * @param cm    If not NULL, conditions shared between fileclasses are
+ *              evaluated once per entry, and their result is saved in memo.
+ */
+static policy_match_t exec_prog(const struct bool_prog *prog,
+                                const entry_id_t *p_entry_id,
+                                const attr_set_t *p_entry_attr,
+                                const time_modifier_t *p_pol_mod,
+                                const sm_instance_t *smi, int no_warning,
+                                const struct class_matcher *cm, int8_t *memo)
+{
+    policy_match_t acc = POLICY_ERR;
+    time_t now = time(NULL);
+    unsigned int pc = 0;
+
+    while (pc < prog->count) {
+        const struct prog_insn *insn = &prog->insn[pc];
+
+        switch (insn->op) {
+        case OP_CONST:
+            acc = insn->u.cst;
+            break;
+        case OP_NOT:
+            acc = negate_match(acc);
+            break;
+        case OP_AND:
+            if (acc != POLICY_MATCH) {
+                pc = insn->u.jump;
+                continue;
+            }
+            break;
+        case OP_OR:
+            if (acc != POLICY_NO_MATCH) {
+                pc = insn->u.jump;
+                continue;
+            }
+            break;
+        default:
+            if (cm != NULL && insn->slot >= 0)
+                acc = slot_result(cm, memo, insn->slot, p_entry_id,
+                                  p_entry_attr, now);
+            else
+                acc = exec_insn(insn, p_entry_id, p_entry_attr, p_pol_mod,
+                                smi, no_warning, now);
+            break;
+        }
+        pc++;
+    }
+    return acc;
+}
+
+/** check if a compiled program can be used for the given entry */
+static inline bool prog_usable(const struct bool_prog *prog,
+                               const attr_set_t *p_entry_attr)
+{
+    if (prog == NULL || !compiled_matching)
+        return false;
+
+    /* reordered operands may change the result if attributes are
+     * missing: interpret the expression in this case */
+    return !prog->reordered
+        || attr_mask_is_null(attr_mask_and_not(&prog->need_mask,
+                                               &p_entry_attr->attr_mask));
+}
+
+/** match an expression using its compiled program if available */
+static policy_match_t expr_matches(const entry_id_t *p_entry_id,
+                                   const attr_set_t *p_entry_attr,
+                                   const bool_node_t *p_node,
+                                   const struct bool_prog *prog,
+                                   const time_modifier_t *p_pol_mod,
+                                   const sm_instance_t *smi, int no_warning)
+{
+    if (!p_entry_id || !p_entry_attr || !p_node)
+        return POLICY_ERR;
+
+    if (prog_usable(prog, p_entry_attr))
+        return exec_prog(prog, p_entry_id, p_entry_attr, p_pol_mod, smi,
+                         no_warning, NULL, NULL);
+
+    return _entry_matches(p_entry_id, p_entry_attr, p_node, p_pol_mod, smi,
+                          no_warning);
+}
+
+policy_match_t rule_matches(const entry_id_t *p_entry_id,
+                            const attr_set_t *p_entry_attr,
+                            const rule_item_t *rule,
+                            const time_modifier_t *p_pol_mod,
+                            const sm_instance_t *smi)
+{
+    return expr_matches(p_entry_id, p_entry_attr, &rule->condition,
+                        rule->prog, p_pol_mod, smi, false);
+}
+
+/* ======================================================================
+ * Fileclass matcher.
+ * Conditions of all fileclass definitions are merged into a single table,
+ * so a condition that appears in several fileclasses is evaluated once
+ * per entry. Name conditions like '*.ext', and tree or path conditions
+ * with no wildcard, are indexed by suffix or path: all of them are
+ * resolved at once with a few hash lookups.
+ * ======================================================================*/
+
+enum slot_index {
+    IDX_NONE,   /**< evaluated individually */
+    IDX_SUFFIX, /**< name pattern '*<literal>' */
+    IDX_TREE,   /**< literal tree */
+    IDX_PATH,   /**< literal path */
+};
+
+/** conditions resolved by the same index */
+struct slot_group {
+    /** key -> GSList of slots */
+    GHashTable   *index;
+    unsigned int *slots;
+    unsigned int  count;
+};
+
+struct class_matcher {
+    /** one instruction per distinct condition */
+    const struct prog_insn **slots;
+    enum slot_index *slot_idx;
+    unsigned int     slot_count;
+
+    struct slot_group suffix;
+    /** distinct suffix lengths */
+    unsigned int    *suffix_lens;
+    unsigned int     suffix_len_count;
+
+    struct slot_group tree;
+    struct slot_group path;
+};
+
+#define MEMO_UNSET  (-1)
+
+/** compare 2 conditions */
+static bool triplet_equal(const compare_triplet_t *c1,
+                          const compare_triplet_t *c2)
+{
+    if (c1 == c2)
+        return true;
+
+    if (c1->crit != c2->crit || c1->op != c2->op || c1->flags != c2->flags
+        || strcmp(c1->attr_name, c2->attr_name))
+        return false;
+
+    switch (c1->crit) {
+    case CRITERIA_SIZE:
+        return c1->val.size == c2->val.size;
+    case CRITERIA_LAST_ACCESS:
+    case CRITERIA_LAST_MOD:
+    case CRITERIA_LAST_MDCHANGE:
+    case CRITERIA_CREATION:
+    case CRITERIA_RMTIME:
+        return c1->val.duration == c2->val.duration;
+    case CRITERIA_TYPE:
+        return c1->val.type == c2->val.type;
+    case CRITERIA_DEPTH:
+    case CRITERIA_DIRCOUNT:
+    case CRITERIA_NLINK:
+#ifdef _LUSTRE
+    case CRITERIA_OST:
+#endif
+        return c1->val.integer == c2->val.integer;
+    case CRITERIA_OWNER:
+    case CRITERIA_GROUP:
+        if (global_config.uid_gid_as_numbers)
+            return c1->val.integer == c2->val.integer;
+        return !strcmp(c1->val.str, c2->val.str);
+    case CRITERIA_SM_INFO:
+        /* value type depends on the status manager */
+        return false;
+    default:
+        return !strcmp(c1->val.str, c2->val.str);
+    }
+}
+
+static bool is_literal(const char *pattern)
+{
+    return strpbrk(pattern, "*?[\\") == NULL;
+}
+
+/** determine which index can resolve a condition */
+static enum slot_index insn_index(const struct prog_insn *insn)
+{
+    switch (insn->op) {
+    case OP_NAME:
+        if ((insn->u.str.fnm_flags & FNM_CASEFOLD)
+            || insn->u.str.pattern[0] != '*'
+            || !is_literal(insn->u.str.pattern + 1))
+            return IDX_NONE;
+        return IDX_SUFFIX;
+
+    case OP_TREE:
+    case OP_PATH:
+        if ((insn->u.str.fnm_flags & FNM_CASEFOLD)
+            || insn->u.str.pattern[0] != '/'
+            || !is_literal(insn->u.str.pattern))
+            return IDX_NONE;
+        if (insn->op == OP_PATH)
+            return IDX_PATH;
+        /* a trailing slash doesn't behave as a directory prefix */
+        if (insn->u.str.pattern[strlen(insn->u.str.pattern) - 1] == '/')
+            return IDX_NONE;
+        return IDX_TREE;
+
+    default:
+        return IDX_NONE;
+    }
+}
+
+static void group_add(struct slot_group *grp, const char *key,
+                      unsigned int slot)
+{
+    GSList *list;
+
+    if (grp->index == NULL)
+        grp->index = g_hash_table_new(g_str_hash, g_str_equal);
+
+    list = g_hash_table_lookup(grp->index, key);
+    list = g_slist_prepend(list, GUINT_TO_POINTER(slot));
+    /* keys point to compiled patterns, which outlive the matcher */
+    g_hash_table_insert(grp->index, (gpointer)key, list);
+
+    grp->slots = realloc(grp->slots, (grp->count + 1) * sizeof(*grp->slots));
+    if (grp->slots == NULL)
+        RBH_BUG("Cannot allocate memory for class matcher");
+    grp->slots[grp->count++] = slot;
+}
+
+static void free_group_list(gpointer key, gpointer value, gpointer udata)
+{
+    g_slist_free(value);
+}
+
+static void group_free(struct slot_group *grp)
+{
+    if (grp->index != NULL) {
+        g_hash_table_foreach(grp->index, free_group_list, NULL);
+        g_hash_table_destroy(grp->index);
+    }
+    free(grp->slots);
+}
+
+void class_matcher_free(struct class_matcher *cm)
+{
+    if (cm == NULL)
+        return;
+
+    group_free(&cm->suffix);
+    group_free(&cm->tree);
+    group_free(&cm->path);
+    free(cm->suffix_lens);
+    free(cm->slots);
+    free(cm->slot_idx);
+    free(cm);
+}
+
+/** add a condition to the matcher, or share an existing one */
+static int matcher_add_insn(struct class_matcher *cm, struct prog_insn *insn)
+{
+    unsigned int i;
+    enum slot_index idx;
+
+    for (i = 0; i < cm->slot_count; i++) {
+        if (cm->slots[i]->op == insn->op
+            && triplet_equal(cm->slots[i]->cond, insn->cond)) {
+            insn->slot = i;
+            return 0;
+        }
+    }
+
+    if ((cm->slot_count % 64) == 0) {
+        const struct prog_insn **slots;
+        enum slot_index *slot_idx;
+
+        slots = realloc(cm->slots, (cm->slot_count + 64) * sizeof(*slots));
+        if (slots == NULL)
+            return -ENOMEM;
+        cm->slots = slots;
+        slot_idx = realloc(cm->slot_idx,
+                           (cm->slot_count + 64) * sizeof(*slot_idx));
+        if (slot_idx == NULL)
+            return -ENOMEM;
+        cm->slot_idx = slot_idx;
+    }
+
+    insn->slot = cm->slot_count;
+    cm->slots[cm->slot_count] = insn;
+
+    idx = insn_index(insn);
+    cm->slot_idx[cm->slot_count] = idx;
+
+    switch (idx) {
+    case IDX_SUFFIX:
+        {
+            /* skip leading '*' */
+            const char *suffix = insn->u.str.pattern + 1;
+            unsigned int len = strlen(suffix);
+
+            group_add(&cm->suffix, suffix, cm->slot_count);
+
+            for (i = 0; i < cm->suffix_len_count; i++)
+                if (cm->suffix_lens[i] == len)
+                    break;
+            if (i == cm->suffix_len_count) {
+                cm->suffix_lens = realloc(cm->suffix_lens, (i + 1)
+                                          * sizeof(*cm->suffix_lens));
+                if (cm->suffix_lens == NULL)
+                    return -ENOMEM;
+                cm->suffix_lens[cm->suffix_len_count++] = len;
+            }
+            break;
+        }
+    case IDX_TREE:
+        group_add(&cm->tree, insn->u.str.pattern, cm->slot_count);
+        break;
+    case IDX_PATH:
+        group_add(&cm->path, insn->u.str.pattern, cm->slot_count);
+        break;
+    case IDX_NONE:
+        break;
+    }
+
+    cm->slot_count++;
+    return 0;
+}
+
+struct class_matcher *class_matcher_build(const policies_t *p_policies)
+{
+    struct class_matcher *cm;
+    unsigned int i, j, indexed = 0;
+
+    cm = calloc(1, sizeof(*cm));
+    if (cm == NULL)
+        return NULL;
+
+    for (i = 0; i < p_policies->fileset_count; i++) {
+        const fileset_item_t *fset = &p_policies->fileset_list[i];
+
+        if (!fset->matchable || fset->prog == NULL)
+            continue;
+
+        for (j = 0; j < fset->prog->count; j++) {
+            struct prog_insn *insn = &fset->prog->insn[j];
+
+            if (insn->cond == NULL)
+                continue;
+
+            if (matcher_add_insn(cm, insn)) {
+                DisplayLog(LVL_MAJOR, POLICY_TAG, "Cannot allocate memory "
+                           "for fileclass matcher");
+                class_matcher_free(cm);
+                return NULL;
+            }
+        }
+    }
+
+    for (i = 0; i < cm->slot_count; i++)
+        if (cm->slot_idx[i] != IDX_NONE)
+            indexed++;
+
+    DisplayLog(LVL_DEBUG, POLICY_TAG, "Fileclass matcher: %u distinct "
+               "conditions (%u indexed) for %u fileclasses", cm->slot_count,
+               indexed, p_policies->fileset_count);
+    return cm;
+}
+
+/** set the result of a group of indexed conditions */
+static void group_set(const struct class_matcher *cm,
+                      const struct slot_group *grp, int8_t *memo,
+                      const char *key, bool match)
+{
+    GSList *list;
+
+    if (key == NULL) {
+        unsigned int i;
+
+        /* set all conditions of the group */
+        for (i = 0; i < grp->count; i++)
+            memo[grp->slots[i]] = str_match(cm->slots[grp->slots[i]], match);
+        return;
+    }
+
+    for (list = g_hash_table_lookup(grp->index, key); list != NULL;
+         list = g_slist_next(list)) {
+        unsigned int slot = GPOINTER_TO_UINT(list->data);
+
+        memo[slot] = str_match(cm->slots[slot], match);
+    }
+}
+
+/** resolve all '*<suffix>' name conditions */
+static void resolve_suffix(const struct class_matcher *cm, int8_t *memo,
+                           const char *name)
+{
+    unsigned int i, len = strlen(name);
+
+    group_set(cm, &cm->suffix, memo, NULL, false);
+
+    for (i = 0; i < cm->suffix_len_count; i++)
+        if (cm->suffix_lens[i] <= len)
+            group_set(cm, &cm->suffix, memo,
+                      name + len - cm->suffix_lens[i], true);
+}
+
+/** resolve all literal tree conditions:
+ * the entry is in the tree if the tree is its path or one of its
+ * ancestors. */
+static void resolve_tree(const struct class_matcher *cm, int8_t *memo,
+                         const char *path)
+{
+    char buff[RBH_PATH_MAX];
+    unsigned int i;
+
+    group_set(cm, &cm->tree, memo, NULL, false);
+    group_set(cm, &cm->tree, memo, path, true);
+
+    rh_strncpy(buff, path, sizeof(buff));
+    for (i = 1; buff[i] != '\0'; i++) {
+        if (buff[i] == '/') {
+            buff[i] = '\0';
+            group_set(cm, &cm->tree, memo, buff, true);
+            buff[i] = '/';
+        }
+    }
+}
+
+static policy_match_t slot_result(const struct class_matcher *cm,
+                                  int8_t *memo, int slot,
+                                  const entry_id_t *p_entry_id,
+                                  const attr_set_t *p_entry_attr, time_t now)
+{
+    const char *path;
+
+    if (memo[slot] != MEMO_UNSET)
+        return memo[slot];
+
+    switch (cm->slot_idx[slot]) {
+    case IDX_SUFFIX:
+        if (!ATTR_MASK_TEST(p_entry_attr, name))
+            break;
+        resolve_suffix(cm, memo, ATTR(p_entry_attr, name));
+        return memo[slot];
+
+    case IDX_TREE:
+        if (!ATTR_MASK_TEST(p_entry_attr, fullpath))
+            break;
+        path = ATTR(p_entry_attr, fullpath);
+        /* same as fnmatch() on absolute paths with no trailing slash */
+        if (path[0] != '/' || path[strlen(path) - 1] == '/')
+            break;
+        resolve_tree(cm, memo, path);
+        return memo[slot];
+
+    case IDX_PATH:
+        if (!ATTR_MASK_TEST(p_entry_attr, fullpath))
+            break;
+        group_set(cm, &cm->path, memo, NULL, false);
+        group_set(cm, &cm->path, memo, ATTR(p_entry_attr, fullpath), true);
+        return memo[slot];
+
+    case IDX_NONE:
+        break;
+    }
+
+    /* same context as match_classes() */
+    memo[slot] = exec_insn(cm->slots[slot], p_entry_id, p_entry_attr, NULL,
+                           NULL, true, now);
+    return memo[slot];
+}
+
+/** per-thread buffer for condition results */
+static __thread int8_t *memo_buff = NULL;
+static __thread unsigned int memo_size = 0;
+
+static int8_t *get_memo(unsigned int count)
+{
+    if (count > memo_size) {
+        int8_t *buff = realloc(memo_buff, count);
+
+        if (buff == NULL)
+            return NULL;
+        memo_buff = buff;
+        memo_size = count;
+    }
+    memset(memo_buff, MEMO_UNSET, count);
+    return memo_buff;
+}
+
 static policy_match_t _is_whitelisted(const policy_descr_t *policy,
                                       const entry_id_t *p_entry_id,
                                       const attr_set_t *p_entry_attr,
@@ -1368,9 +2494,9 @@ static policy_match_t _is_whitelisted(const policy_descr_t *policy,
     count = policy->rules.whitelist_count;
 
     for (i = 0; i < count; i++) {
-        switch (_entry_matches
-                (p_entry_id, p_entry_attr, &list[i].bool_expr, NULL,
-                 policy->status_mgr, no_warning)) {
+        switch (expr_matches
+                (p_entry_id, p_entry_attr, &list[i].bool_expr, list[i].prog,
+                 NULL, policy->status_mgr, no_warning)) {
         case POLICY_MATCH:
             /* TODO remember the entry is ignored for this policy? */
             return POLICY_MATCH;
@@ -1410,9 +2536,9 @@ static policy_match_t _is_whitelisted(const policy_descr_t *policy,
         printf("Checking if entry matches whitelisted fileset %s...\n",
                fs_list[i]->fileset_id);
 #endif
-        switch (_entry_matches
-                (p_entry_id, p_entry_attr, &fs_list[i]->definition, NULL,
-                 policy->status_mgr, no_warning)) {
+        switch (expr_matches
+                (p_entry_id, p_entry_attr, &fs_list[i]->definition,
+                 fs_list[i]->prog, NULL, policy->status_mgr, no_warning)) {
         case POLICY_MATCH:
             {
 #ifdef _DEBUG_POLICIES
@@ -1490,6 +2616,8 @@ int match_classes(const entry_id_t *id, attr_set_t *p_attrs_new,
     unsigned int i;
     int ok = 0;
     int left = sizeof(ATTR(p_attrs_new, fileclass));
+    const struct class_matcher *cm = policies.class_matcher;
+    int8_t *memo = NULL;
 
     /* initialize output fileclass */
     char *pcur = ATTR(p_attrs_new, fileclass);
@@ -1502,16 +2630,27 @@ int match_classes(const entry_id_t *id, attr_set_t *p_attrs_new,
     if (p_attrs_cached != NULL)
         ListMgr_MergeAttrSets(&attr_cp, p_attrs_cached, false);
 
+    /* evaluate conditions shared by several fileclasses only once */
+    if (cm != NULL && compiled_matching)
+        memo = get_memo(cm->slot_count);
+
     for (i = 0; i < policies.fileset_count; i++) {
         fileset_item_t *fset = &policies.fileset_list[i];
+        policy_match_t match;
 
         if (!fset->matchable) {
             ok++;
             continue;
         }
 
-        switch (_entry_matches
-                (id, &attr_cp, &fset->definition, NULL, NULL, true)) {
+        if (memo != NULL && prog_usable(fset->prog, &attr_cp))
+            match = exec_prog(fset->prog, id, &attr_cp, NULL, NULL, true,
+                              cm, memo);
+        else
+            match = expr_matches(id, &attr_cp, &fset->definition, fset->prog,
+                                 NULL, NULL, true);
+
+        switch (match) {
         case POLICY_MATCH:
             ok++;
             if (EMPTY_STRING(ATTR(p_attrs_new, fileclass))) {
@@ -1595,9 +2734,10 @@ rule_item_t *policy_case(const policy_descr_t *policy,
                    pol_list[i].target_list[j]->fileset_id);
 #endif
 
-            switch (entry_matches(p_entry_id, p_entry_attr,
-                                  &pol_list[i].target_list[j]->definition,
-                                  NULL, policy->status_mgr)) {
+            switch (expr_matches(p_entry_id, p_entry_attr,
+                                 &pol_list[i].target_list[j]->definition,
+                                 pol_list[i].target_list[j]->prog,
+                                 NULL, policy->status_mgr, false)) {
             case POLICY_MATCH:
                 DisplayLog(LVL_FULL, POLICY_TAG,
                            "Entry " F_ENT_ID
@@ -1649,6 +2789,61 @@ rule_item_t *policy_case(const policy_descr_t *policy,
     return NULL;
 }
 
+/** policy case of a fileclass */
+struct class_case {
+    rule_item_t    *rule;
+    fileset_item_t *fset;
+};
+
+/** fileclass names are case insensitive */
+static bool class_key(char *key, size_t size, const char *class_id)
+{
+    size_t i;
+
+    for (i = 0; class_id[i] != '\0'; i++) {
+        if (i >= size - 1)
+            return false;
+        key[i] = tolower(class_id[i]);
+    }
+    key[i] = '\0';
+    return true;
+}
+
+int class_cases_build(policy_descr_t *policy)
+{
+    char key[FILESET_ID_LEN];
+    unsigned int i, j;
+
+    policy->class_cases = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                g_free, g_free);
+    if (policy->class_cases == NULL)
+        return -ENOMEM;
+
+    for (i = 0; i < policy->rules.rule_count; i++) {
+        rule_item_t *rule = &policy->rules.rules[i];
+
+        /* the default case matches no fileclass */
+        if (!strcasecmp(rule->rule_id, "default"))
+            continue;
+
+        for (j = 0; j < rule->target_count; j++) {
+            struct class_case *cc;
+
+            if (!class_key(key, sizeof(key), rule->target_list[j]->fileset_id))
+                continue;
+            /* the first policy case targeting the class wins */
+            if (g_hash_table_lookup(policy->class_cases, key) != NULL)
+                continue;
+
+            cc = g_new(struct class_case, 1);
+            cc->rule = rule;
+            cc->fset = rule->target_list[j];
+            g_hash_table_insert(policy->class_cases, g_strdup(key), cc);
+        }
+    }
+    return 0;
+}
+
 /** get the policy case for the given fileclass.
  *  \param pp_fileset is set to the matching fileset
  *         or NULL for the default policy case
@@ -1660,6 +2855,24 @@ rule_item_t *class_policy_case(const policy_descr_t *policy,
     int count, i, j;
     rule_item_t *pol_list;
 
+    if (policy->class_cases != NULL) {
+        char key[FILESET_ID_LEN];
+        struct class_case *cc = NULL;
+
+        if (class_key(key, sizeof(key), class_id))
+            cc = g_hash_table_lookup(policy->class_cases, key);
+
+        if (cc != NULL) {
+            DisplayLog(LVL_FULL, POLICY_TAG,
+                       "FileClass '%s' is a target of policy '%s'",
+                       class_id, cc->rule->rule_id);
+            if (pp_fileset)
+                *pp_fileset = cc->fset;
+            return cc->rule;
+        }
+        goto not_found;
+    }
+
     count = policy->rules.rule_count;
     pol_list = policy->rules.rules;
 
@@ -1696,6 +2909,7 @@ rule_item_t *class_policy_case(const policy_descr_t *policy,
         }
     }
 
+not_found:
     DisplayLog(LVL_MAJOR, POLICY_TAG,
                "Saved fileclass '%s' is no longer used in %s policy. Refresh needed.",
                class_id, policy->name);
@@ -1771,9 +2985,10 @@ policy_match_t policy_match_all(const policy_descr_t *policy,
                    pol_list[i].target_list[j]->fileset_id);
 #endif
 
-            switch (_entry_matches(p_entry_id, p_entry_attr,
-                                   &pol_list[i].target_list[j]->definition,
-                                   time_mod, policy->status_mgr, true)) {
+            switch (expr_matches(p_entry_id, p_entry_attr,
+                                 &pol_list[i].target_list[j]->definition,
+                                 pol_list[i].target_list[j]->prog,
+                                 time_mod, policy->status_mgr, true)) {
             case POLICY_MATCH:
                 DisplayLog(LVL_FULL, POLICY_TAG,
                            "Entry matches target file class '%s' of policy '%s'",
@@ -1834,9 +3049,9 @@ policy_match_t policy_match_all(const policy_descr_t *policy,
          * - if we get NO_MATCH for the condition, this policy cannot be matched.
          * - if we get MISSING_ATTR for the condition, return MISSING_ATTR.
          */
-        switch (_entry_matches(p_entry_id, p_entry_attr,
-                               &pol_list[i].condition, time_mod,
-                               policy->status_mgr, true)) {
+        switch (expr_matches(p_entry_id, p_entry_attr,
+                             &pol_list[i].condition, pol_list[i].prog,
+                             time_mod, policy->status_mgr, true)) {
         case POLICY_NO_MATCH:
             /* the entry cannot match this item */
             break;
@@ -1880,9 +3095,10 @@ policy_match_t policy_match_all(const policy_descr_t *policy,
          * - if we get NO_MATCH for the condition, no policy is matched.
          * - if we get MISSING_ATTR for the condition, return MISSING_ATTR.
          */
-        switch (_entry_matches(p_entry_id, p_entry_attr,
-                               &pol_list[default_index].condition,
-                               time_mod, policy->status_mgr, true)) {
+        switch (expr_matches(p_entry_id, p_entry_attr,
+                             &pol_list[default_index].condition,
+                             pol_list[default_index].prog,
+                             time_mod, policy->status_mgr, true)) {
         case POLICY_NO_MATCH:
             return POLICY_NO_MATCH;
             break;
@@ -1914,7 +3130,8 @@ policy_match_t policy_match_all(const policy_descr_t *policy,
 policy_match_t match_scope(const policy_descr_t *pol, const entry_id_t *id,
                            const attr_set_t *attrs, bool warn)
 {
-    return _entry_matches(id, attrs, &pol->scope, NULL, pol->status_mgr, !warn);
+    return expr_matches(id, attrs, &pol->scope, pol->scope_prog, NULL,
+                        pol->status_mgr, !warn);
 }
 
 #define LOG_MATCH(_m, _id, _a, _p) do { \
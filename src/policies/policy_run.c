@@ -32,6 +32,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
+#include <stdlib.h>
 
 #define CHECK_QUEUE_INTERVAL    1
 
@@ -242,8 +243,43 @@ static int build_action_params(entry_context_t *ectx)
     return rc;
 }
 
-/** Execute a policy action. */
-static int policy_action(entry_context_t *ectx)
+/**
+ * Call the status manager action callback, if there is no status manager
+ * executor to wrap actions.
+ */
+static void call_action_cb(entry_context_t *ectx, int action_rc)
+{
+    policy_info_t *pol = ectx->policy;
+    sm_instance_t *smi = pol->descr->status_mgr;
+
+    if (smi != NULL && smi->sm->action_cb != NULL) {
+        int tmp_rc = smi->sm->action_cb(smi, pol->descr->implements,
+                                        action_rc, &ectx->item->entry_id,
+                                        &ectx->fresh_attrs,
+                                        &ectx->after_action);
+        if (tmp_rc)
+            DisplayLog(LVL_MAJOR, tag(pol),
+                       "Action callback failed for action '%s': rc=%d",
+                       pol->descr->implements ?  pol->descr->implements
+                            : "<null>", tmp_rc);
+    }
+}
+
+/** returned by policy_action() when the action runs asynchronously */
+#define ACTION_PENDING  (-EINPROGRESS)
+
+static void async_action_done(void *udata, int rc);
+static void batch_add(policy_info_t *pol, lmgr_t *lmgr,
+                      entry_context_t *ectx, const policy_action_t *action);
+static void batch_flush_idle(policy_info_t *pol, lmgr_t *lmgr);
+
+/**
+ * Execute a policy action.
+ * @return ACTION_PENDING if the action command was started asynchronously,
+ *         or if the entry was added to a batch: the entry is then finalized
+ *         by async_action_done() or batch_flush().
+ */
+static int policy_action(lmgr_t *lmgr, entry_context_t *ectx)
 {
     int rc = 0;
     policy_info_t         *pol = ectx->policy;
@@ -292,6 +328,17 @@ static int policy_action(entry_context_t *ectx)
     } else {
         switch (actionp->type) {
         case ACTION_FUNCTION:
+            /* Pass entries to the action by batches, unless the item
+             * belongs to a caller waiting for the action
+             * (single file run). */
+            if (actionp->action_u.func.call_batch != NULL
+                && pol->batch != NULL && ectx->free_item) {
+                DisplayLog(LVL_DEBUG, tag(pol), DFID ": action: %s (batched)",
+                           PFID(id), actionp->action_u.func.name);
+                batch_add(pol, lmgr, ectx, actionp);
+                return ACTION_PENDING;
+            }
+
             /* @TODO provide a DB callback */
             DisplayLog(LVL_DEBUG, tag(pol), DFID ": action: %s",
                        PFID(id), actionp->action_u.func.name);
@@ -332,6 +379,26 @@ static int policy_action(entry_context_t *ectx)
                         free(log_cmd);
                     }
 
+                    /* Run the command asynchronously, unless the item
+                     * belongs to a caller waiting for the action
+                     * (single file run). */
+                    if (pol->config->max_async_commands > 0
+                        && ectx->free_item) {
+                        /* wait for a free slot */
+                        sem_wait_safe(&pol->async_slots);
+                        rc = execute_shell_command_async(cmd,
+                                                         cb_stderr_to_log,
+                                                         (void *)LVL_DEBUG,
+                                                         async_action_done,
+                                                         ectx);
+                        g_strfreev(cmd);
+                        /* ectx now belongs to async_action_done() */
+                        if (rc == 0)
+                            return ACTION_PENDING;
+                        sem_post_safe(&pol->async_slots);
+                        break;
+                    }
+
                     rc = execute_shell_command(cmd, cb_stderr_to_log,
                                                (void *)LVL_DEBUG);
                     g_strfreev(cmd);
@@ -349,18 +416,7 @@ static int policy_action(entry_context_t *ectx)
             break;
         }
 
-        /* call action callback if there is no status manager executor to wrap
-         * actions */
-        if (smi != NULL && smi->sm->action_cb != NULL) {
-            int tmp_rc = smi->sm->action_cb(smi, pol->descr->implements,
-                                            rc, id, &ectx->fresh_attrs,
-                                            &ectx->after_action);
-            if (tmp_rc)
-                DisplayLog(LVL_MAJOR, tag(pol),
-                           "Action callback failed for action '%s': rc=%d",
-                           pol->descr->implements ?  pol->descr->implements
-                                : "<null>", tmp_rc);
-        }
+        call_action_cb(ectx, rc);
     }
 
     return rc;
@@ -808,6 +864,8 @@ static bool check_queue_limit(policy_info_t *pol,
                        "waiting %lums before re-checking.", ctr_ok.count,
                        ctr_in_flight.count, ctr_ok.vol, ctr_in_flight.vol,
                        check_delay / USEC_PER_MSEC);
+            /* entries may be waiting for a batch to be full */
+            batch_flush_idle(pol, NULL);
             rh_usleep(check_delay);
             continue;
         } else {
@@ -1128,6 +1186,9 @@ static int wait_queue_empty(policy_info_t *policy,
                        nb_action_in_flight - nb_in_queue,
                        (unsigned int)(time(NULL) - last_activity));
 
+            /* entries may be waiting for a batch to be full */
+            batch_flush_idle(policy, NULL);
+
             if (long_sleep)
                 rh_sleep(CHECK_QUEUE_INTERVAL);
             else
@@ -1157,6 +1218,16 @@ static attr_mask_t db_attr_mask(policy_info_t *policy,
     /* needed for posix operations, and for display */
     mask.std |= ATTR_MASK_fullpath;
 
+    /* needed to update the usage of ancestors of removed entries */
+    if (lmgr_dir_stat() && !policy->descr->manage_deleted)
+        mask.std |= DIRSTAT_ATTR_MASK;
+
+    /* needed to update the accounting of removed entries */
+    if (lmgr_acct_batched() && !policy->descr->manage_deleted) {
+        mask.std |= ACCT_ATTR_MASK;
+        mask.status |= all_status_mask();
+    }
+
     /* md_update and path_update are not present in SOFT_RM table */
     if (!policy->descr->manage_deleted) {
         /* needed if update params != never */
@@ -1525,7 +1596,7 @@ static inline int iter_open(lmgr_t *lmgr,
         break;
 
     case IT_RMD:
-        it->it.rmd_iter = ListMgr_RmList(lmgr, filter, sort_type);
+        it->it.rmd_iter = ListMgr_RmList(lmgr, filter, sort_type, opt);
         if (it->it.rmd_iter == NULL)
             return DB_REQUEST_FAILED;
         break;
@@ -1533,6 +1604,266 @@ static inline int iter_open(lmgr_t *lmgr,
     return DB_SUCCESS;
 }
 
+/**
+ * Double-buffered candidate fetcher:
+ * the next sorted request is performed by a helper thread on a secondary
+ * DB connection, while the end of the current result is still being pushed
+ * to the workers. As the queue is not drained between requests, entries
+ * already returned by the previous request are skipped using the last
+ * sort time and the list of entries returned with that sort time.
+ */
+struct cand_prefetch {
+    bool         enabled;
+    /** connections of the current (cur) and next (1 - cur) iterators */
+    lmgr_t      *conn[2];
+    lmgr_t       spare;
+    bool         spare_init;
+    int          cur;
+    /** start the next request after this count of returned entries */
+    unsigned int trigger;
+
+    /* request parameters and result (filled by the prefetch thread) */
+    pthread_t    thread;
+    bool         pending;
+    lmgr_filter_t *filter;
+    const lmgr_sort_type_t *sort_type;
+    const lmgr_iter_opt_t *opt;
+    struct policy_iter next;
+    int          next_rc;
+
+    /* dedup guard: entries returned with the last sort time */
+    int          bound_time;
+    entry_id_t  *bound_ids;
+    unsigned int bound_count;
+    unsigned int bound_sorted;
+    unsigned int bound_size;
+    bool         dedup;
+    unsigned int dup_count;
+};
+
+/** start prefetching when 1/PREFETCH_RATIO of the result remains */
+#define PREFETCH_RATIO  8
+#define BOUND_IDS_INIT  1024
+
+static void prefetch_init(struct cand_prefetch *pf, const policy_info_t *pol,
+                          lmgr_t *lmgr, lmgr_filter_t *filter,
+                          const lmgr_sort_type_t *sort_type,
+                          const lmgr_iter_opt_t *opt)
+{
+    memset(pf, 0, sizeof(*pf));
+    pf->conn[0] = lmgr;
+    pf->filter = filter;
+    pf->sort_type = sort_type;
+    pf->opt = opt;
+    pf->bound_time = -1;
+
+    /* the dedup guard relies on the sort order, and there is no
+     * next request for unlimited or SOFT_RM results */
+    pf->enabled = pol->config->db_prefetch
+        && (opt->list_count_max > 0)
+        && (pol->config->lru_sort_attr != LRU_ATTR_NONE)
+        && !pol->descr->manage_deleted;
+
+    pf->trigger = opt->list_count_max - opt->list_count_max / PREFETCH_RATIO;
+}
+
+static void prefetch_fini(const policy_info_t *pol, struct cand_prefetch *pf)
+{
+    if (pf->pending) {
+        pthread_join(pf->thread, NULL);
+        pf->pending = false;
+        if (pf->next_rc == DB_SUCCESS)
+            iter_close(&pf->next);
+    }
+    if (pf->spare_init) {
+        ListMgr_CloseAccess(&pf->spare);
+        pf->spare_init = false;
+    }
+    if (pf->dup_count > 0)
+        DisplayLog(LVL_DEBUG, tag(pol), "%u duplicate candidates skipped "
+                   "after prefetched requests", pf->dup_count);
+    if (pf->bound_ids != NULL)
+        MemFree(pf->bound_ids);
+    pf->bound_ids = NULL;
+}
+
+static int id_cmp(const void *a, const void *b)
+{
+    return memcmp(a, b, sizeof(entry_id_t));
+}
+
+/** remember entries returned with the max sort time */
+static void prefetch_track(struct cand_prefetch *pf, const entry_id_t *id,
+                           int sort_time)
+{
+    if (!pf->enabled || sort_time == -1)
+        return;
+
+    if (sort_time != pf->bound_time) {
+        pf->bound_time = sort_time;
+        pf->bound_count = 0;
+        pf->bound_sorted = 0;
+    }
+
+    if (pf->bound_count == pf->bound_size) {
+        unsigned int new_size = pf->bound_size ? 2 * pf->bound_size
+                                               : BOUND_IDS_INIT;
+        entry_id_t *ids = MemRealloc(pf->bound_ids,
+                                     new_size * sizeof(*ids));
+
+        if (ids == NULL)
+            /* just miss the dedup for this entry */
+            return;
+        pf->bound_ids = ids;
+        pf->bound_size = new_size;
+    }
+    pf->bound_ids[pf->bound_count++] = *id;
+}
+
+/** check if an entry of a prefetched result was already returned */
+static bool prefetch_skip(struct cand_prefetch *pf, const entry_id_t *id,
+                          int sort_time)
+{
+    if (!pf->dedup)
+        return false;
+
+    /* entries are sorted: everything before the boundary was returned
+     * by the previous request (NULL sort attrs come first) */
+    if (sort_time == -1 || sort_time < pf->bound_time)
+        goto dup;
+
+    if (sort_time == pf->bound_time) {
+        if (bsearch(id, pf->bound_ids, pf->bound_sorted, sizeof(entry_id_t),
+                    id_cmp) != NULL)
+            goto dup;
+        return false;
+    }
+
+    /* past the boundary: no more duplicates */
+    pf->dedup = false;
+    return false;
+
+ dup:
+    pf->dup_count++;
+    return true;
+}
+
+/** set filters on md_update and sort time for the next request */
+static int set_next_request_filter(policy_info_t *pol, lmgr_filter_t *filter,
+                                   const lmgr_iter_opt_t *req_opt,
+                                   int last_sort_time)
+{
+    filter_value_t fval;
+    int rc;
+
+    /* /!\ if there is already a filter on <sort_attr> or md_update
+     * only replace it, do not add a new filter.
+     */
+
+    /* no md_update filed in SOFT_RM */
+    if (!pol->descr->manage_deleted) {
+        /* don't retrieve just-updated entries
+         * (update>=first_request_time) */
+        fval.value.val_int = pol->progress.policy_start;
+        rc = lmgr_simple_filter_add_or_replace(filter,
+                                               ATTR_INDEX_md_update,
+                                               LESSTHAN_STRICT, fval,
+                                               FILTER_FLAG_ALLOW_NULL);
+        if (rc)
+            return rc;
+    }
+
+    /* filter on <sort_time> */
+    if (pol->config->lru_sort_attr != LRU_ATTR_NONE) {
+        fval.value.val_int = last_sort_time;
+        rc = lmgr_simple_filter_add_or_replace(filter,
+                                               pol->config->lru_sort_attr,
+                                               MORETHAN, fval,
+                                               FILTER_FLAG_ALLOW_NULL);
+        if (rc)
+            return rc;
+
+        DisplayLog(LVL_DEBUG, tag(pol),
+                   "Performing new request with a limit of %u entries"
+                   " and %s >= %d and md_update < %ld ",
+                   req_opt->list_count_max, sort_attr_name(pol),
+                   last_sort_time, pol->progress.policy_start);
+    } else {
+        DisplayLog(LVL_DEBUG, tag(pol),
+                   "Performing new request with a limit of %u entries"
+                   " and md_update < %ld ", req_opt->list_count_max,
+                   pol->progress.policy_start);
+    }
+    return 0;
+}
+
+static void *prefetch_thr(void *arg)
+{
+    struct cand_prefetch *pf = arg;
+
+    pf->next_rc = iter_open(pf->conn[1 - pf->cur], IT_LIST, &pf->next,
+                            pf->filter, pf->sort_type, pf->opt);
+    return NULL;
+}
+
+/** start the next request in background */
+static void prefetch_start(policy_info_t *pol, struct cand_prefetch *pf,
+                           int last_sort_time)
+{
+    int rc;
+
+    if (!pf->spare_init) {
+        rc = ListMgr_InitAccess(&pf->spare);
+        if (rc != DB_SUCCESS) {
+            DisplayLog(LVL_MAJOR, tag(pol), "Failed to open a secondary "
+                       "DB connection (error %d): disabling candidate "
+                       "prefetch", rc);
+            pf->enabled = false;
+            return;
+        }
+        pf->spare_init = true;
+        pf->conn[1] = &pf->spare;
+    }
+
+    /* the current iterator no longer uses the filter */
+    if (set_next_request_filter(pol, pf->filter, pf->opt, last_sort_time))
+        return;
+
+    rc = pthread_create(&pf->thread, NULL, prefetch_thr, pf);
+    if (rc) {
+        DisplayLog(LVL_MAJOR, tag(pol), "Failed to start prefetch thread: "
+                   "%s", strerror(rc));
+        return;
+    }
+    pf->pending = true;
+}
+
+/** replace the current iterator by the prefetched one */
+static int prefetch_switch(policy_info_t *pol, struct cand_prefetch *pf,
+                           struct policy_iter *it)
+{
+    pthread_join(pf->thread, NULL);
+    pf->pending = false;
+
+    if (pf->next_rc != DB_SUCCESS)
+        return pf->next_rc;
+
+    iter_close(it);
+    *it = pf->next;
+    memset(&pf->next, 0, sizeof(pf->next));
+    pf->cur = 1 - pf->cur;
+
+    /* skip entries already returned by the previous request */
+    qsort(pf->bound_ids, pf->bound_count, sizeof(entry_id_t), id_cmp);
+    pf->bound_sorted = pf->bound_count;
+    pf->dedup = true;
+
+    DisplayLog(LVL_DEBUG, tag(pol), "Switching to prefetched request "
+               "(%u entries with %s = %d already returned)",
+               pf->bound_count, sort_attr_name(pol), pf->bound_time);
+    return DB_SUCCESS;
+}
+
 /** return codes of fill_workers_queue() */
 typedef enum {
     PASS_EOL,
@@ -1551,7 +1882,7 @@ typedef enum {
 */
 static pass_status_e fill_workers_queue(policy_info_t *pol,
                                         const policy_param_t *p_param,
-                                        lmgr_t *lmgr,
+                                        struct cand_prefetch *pf,
                                         struct policy_iter *it,
                                         const lmgr_iter_opt_t *req_opt,
                                         const lmgr_sort_type_t *sort_type,
@@ -1566,7 +1897,6 @@ static pass_status_e fill_workers_queue(policy_info_t *pol,
     attr_set_t attr_set;
     entry_id_t entry_id;
     counters_t pushed_ctr;
-    filter_value_t fval;
     unsigned long long feedback_before[AF_ENUM_COUNT];
     unsigned long long feedback_after[AF_ENUM_COUNT];
     unsigned int status_tab_before[AS_ENUM_COUNT];
@@ -1624,6 +1954,20 @@ static pass_status_e fill_workers_queue(policy_info_t *pol,
                 break;
             }
 
+            /* the next request was already started: no need to wait
+             * for the queue to be empty, as duplicates are skipped */
+            if (pf->pending) {
+                rc = prefetch_switch(pol, pf, it);
+                if (rc != DB_SUCCESS) {
+                    DisplayLog(LVL_CRIT, tag(pol),
+                               "Error %d retrieving list of candidates from "
+                               "database. Policy run cancelled.", rc);
+                    return PASS_ERROR;
+                }
+                *db_current_list_count = 0;
+                continue;
+            }
+
             /* Free previous iterator */
             iter_close(it);
 
@@ -1636,49 +1980,13 @@ static pass_status_e fill_workers_queue(policy_info_t *pol,
                              status_tab_after, false);
 
             /* perform a new request with next entries */
-
-            /* /!\ if there is already a filter on <sort_attr> or md_update
-             * only replace it, do not add a new filter.
-             */
-
-            /* no md_update filed in SOFT_RM */
-            if (!pol->descr->manage_deleted) {
-                /* don't retrieve just-updated entries
-                 * (update>=first_request_time) */
-                fval.value.val_int = pol->progress.policy_start;
-                rc = lmgr_simple_filter_add_or_replace(filter,
-                                                       ATTR_INDEX_md_update,
-                                                       LESSTHAN_STRICT, fval,
-                                                       FILTER_FLAG_ALLOW_NULL);
-                if (rc)
-                    return PASS_ERROR;
-            }
-
-            /* filter on <sort_time> */
-            if (pol->config->lru_sort_attr != LRU_ATTR_NONE) {
-                fval.value.val_int = *last_sort_time;
-                rc = lmgr_simple_filter_add_or_replace(filter,
-                                               pol->config->lru_sort_attr,
-                                               MORETHAN, fval,
-                                               FILTER_FLAG_ALLOW_NULL);
-                if (rc)
-                    return PASS_ERROR;
-
-                DisplayLog(LVL_DEBUG, tag(pol),
-                           "Performing new request with a limit of %u entries"
-                           " and %s >= %d and md_update < %ld ",
-                           req_opt->list_count_max, sort_attr_name(pol),
-                           *last_sort_time, pol->progress.policy_start);
-            } else {
-                DisplayLog(LVL_DEBUG, tag(pol),
-                           "Performing new request with a limit of %u entries"
-                           " and md_update < %ld ", req_opt->list_count_max,
-                           pol->progress.policy_start);
-            }
+            if (set_next_request_filter(pol, filter, req_opt,
+                                        *last_sort_time))
+                return PASS_ERROR;
 
             *db_current_list_count = 0;
-            rc = iter_open(lmgr, it->it_type, it, filter, sort_type,
-                           req_opt);
+            rc = iter_open(pf->conn[pf->cur], it->it_type, it, filter,
+                           sort_type, req_opt);
             if (rc != DB_SUCCESS) {
                 DisplayLog(LVL_CRIT, tag(pol),
                            "Error %d retrieving list of candidates from "
@@ -1696,8 +2004,18 @@ static pass_status_e fill_workers_queue(policy_info_t *pol,
         (*db_current_list_count)++;
 
         rc = get_sort_attr(pol, &attr_set);
+        if (prefetch_skip(pf, &entry_id, rc)) {
+            ListMgr_FreeAttrs(&attr_set);
+            continue;
+        }
         if (rc != -1)
             *last_sort_time = rc;
+        prefetch_track(pf, &entry_id, rc);
+
+        /* start the next request before the end of this one */
+        if (pf->enabled && !pf->pending && (pf->bound_time != -1)
+            && (*db_current_list_count == pf->trigger))
+            prefetch_start(pol, pf, *last_sort_time);
 
         rc = entry2tgt_amount(p_param, &attr_set, &entry_amount);
         if (rc == -1) {
@@ -1879,6 +2197,7 @@ int run_policy(policy_info_t *p_pol_info, const policy_param_t *p_param,
     lmgr_filter_t filter;
     filter_value_t fval;
     lmgr_sort_type_t sort_type;
+    struct cand_prefetch pf;
     int last_sort_time = 0;
     /* XXX first_request_start = policy_start */
     attr_mask_t attr_mask;
@@ -1962,9 +2281,18 @@ int run_policy(policy_info_t *p_pol_info, const policy_param_t *p_param,
     /* Except for SOFT_RM: we can't split the result as it has no md_update field. */
     if (!p_pol_info->descr->manage_deleted)
         opt.list_count_max = p_pol_info->config->db_request_limit;
+#ifdef _MYSQL
+    /* unlimited result: stream it instead of loading it in memory.
+     * Only with MySQL, that reads it on a dedicated connection: with SQLite,
+     * the DB would remain read-locked during the whole policy run. */
+    if (opt.list_count_max == 0)
+        opt.stream = 1;
+#endif
     nb_returned = 0;
     total_returned = 0;
 
+    prefetch_init(&pf, p_pol_info, lmgr, &filter, &sort_type, &opt);
+
     rc = iter_open(lmgr,
                    p_pol_info->descr->manage_deleted ? IT_RMD : IT_LIST,
                    &it, &filter, &sort_type, &opt);
@@ -2013,7 +2341,7 @@ int run_policy(policy_info_t *p_pol_info, const policy_param_t *p_param,
 
         /* feed workers until the specified limit is reached or
          * end of list is reached */
-        st = fill_workers_queue(p_pol_info, p_param, lmgr, &it, &opt,
+        st = fill_workers_queue(p_pol_info, p_param, &pf, &it, &opt,
                                 &sort_type, &filter, attr_mask,
                                 &last_sort_time, &nb_returned,
                                 &total_returned);
@@ -2040,9 +2368,11 @@ int run_policy(policy_info_t *p_pol_info, const policy_param_t *p_param,
                           p_pol_info->progress.errors,
                           &p_param->target_ctr));
 
-    lmgr_simple_filter_free(&filter);
     /* iterator may have been closed in fill_workers_queue() */
     iter_close(&it);
+    /* wait for a pending request before releasing its filter */
+    prefetch_fini(p_pol_info, &pf);
+    lmgr_simple_filter_free(&filter);
 
     /* flush pending alerts */
     Alert_EndBatching();
@@ -2081,7 +2411,13 @@ static inline int invalidate_entry(const policy_info_t *pol, lmgr_t *lmgr,
     return rc;
 }
 
+/**
+ * Update an entry in the database.
+ * @param p_old_attrs attributes of the entry as currently stored in the
+ *                    database (used for batched accounting), or NULL.
+ */
 static inline int update_entry(lmgr_t *lmgr, const entry_id_t *p_entry_id,
+                               const attr_set_t *p_old_attrs,
                                const attr_set_t *p_attr_set)
 {
     int rc;
@@ -2103,10 +2439,16 @@ static inline int update_entry(lmgr_t *lmgr, const entry_id_t *p_entry_id,
     ATTR_MASK_UNSET(&tmp_attrset, creation_time);
 
     /* update DB and skip the entry */
+    ListMgr_ApplyBegin();
     rc = ListMgr_Update(lmgr, p_entry_id, &tmp_attrset);
     if (rc)
         DisplayLog(LVL_CRIT, TAG, "Error %d updating entry in database.",
                    rc);
+    else if (p_old_attrs != NULL && lmgr_acct_batched())
+        /* the previous accounting values of the entry were retrieved
+         * with the policy list (see db_attr_mask()) */
+        ListMgr_AcctUpdate(lmgr, p_old_attrs, &tmp_attrset);
+    ListMgr_ApplyEnd();
 
     return rc;
 }
@@ -2346,14 +2688,14 @@ static action_status_t check_entry_times(policy_info_t *pol, lmgr_t *lmgr,
                        " changed (missing attribute '%s'): skipping entry.",
                        sort_attr_name(pol));
             if (!pol->descr->manage_deleted)
-                update_entry(lmgr, p_id, p_attrs_new);
+                update_entry(lmgr, p_id, p_attrs_old, p_attrs_new);
             return AS_MISSING_MD;
         } else if (val1 != val2) {
             DisplayLog(LVL_DEBUG, tag(pol),
                        "%s has been accessed/modified since last md update. Skipping entry.",
                        ATTR(p_attrs_old, fullpath));
             if (!pol->descr->manage_deleted)
-                update_entry(lmgr, p_id, p_attrs_new);
+                update_entry(lmgr, p_id, p_attrs_old, p_attrs_new);
             return AS_ACCESSED;
         }
 
@@ -2367,7 +2709,7 @@ static action_status_t check_entry_times(policy_info_t *pol, lmgr_t *lmgr,
                        "%s has been modified since last md update (size changed). Skipping entry.",
                        ATTR(p_attrs_old, fullpath));
             if (!pol->descr->manage_deleted)
-                update_entry(lmgr, p_id, p_attrs_new);
+                update_entry(lmgr, p_id, p_attrs_old, p_attrs_new);
             return AS_ACCESSED;
         }
     }
@@ -2476,6 +2818,24 @@ static void free_entry_context(entry_context_t *ectx)
     free(ectx);
 }
 
+/** report the removal of an entry from DB to the usage of its ancestors
+ * (before it is applied, to be written in the same transaction) */
+static void rm_dir_stat(lmgr_t *lmgr, const entry_context_t *ectx, bool last)
+{
+    lmgr_dirstat_entry_t old_ent;
+    int rc;
+
+    /* must be based on the DB content = old attrs */
+    if (!dirstat_entry_from_attrs(&old_ent, &ectx->item->entry_attr, NULL))
+        return;
+
+    rc = ListMgr_DirStatUpdate(lmgr, &ectx->item->entry_id, &old_ent, NULL,
+                               last);
+    if (rc)
+        DisplayLog(LVL_MAJOR, tag(ectx->policy),
+                   "Error %d updating the usage of parent directories.", rc);
+}
+
 /**
  * Finilize action processing after an action has been executed.
  * Update entry status in DB and release resources.
@@ -2500,7 +2860,8 @@ static void action_fini(int action_rc, lmgr_t *lmgr,
 
         /* no update for deleted entries */
         if (!pol->descr->manage_deleted)
-            update_entry(lmgr, &ectx->item->entry_id, &ectx->fresh_attrs);
+            update_entry(lmgr, &ectx->item->entry_id,
+                         &ectx->item->entry_attr, &ectx->fresh_attrs);
 
         policy_ack(&pol->queue, AS_ERROR, &ectx->item->entry_attr,
                    ectx->item->targeted);
@@ -2523,28 +2884,41 @@ static void action_fini(int action_rc, lmgr_t *lmgr,
         case PA_NONE:
             break;
         case PA_UPDATE:
-            update_entry(lmgr, &ectx->item->entry_id, &ectx->fresh_attrs);
+            update_entry(lmgr, &ectx->item->entry_id,
+                         &ectx->item->entry_attr, &ectx->fresh_attrs);
             break;
 
         case PA_RM_ONE:
             lastrm = ATTR_MASK_TEST(&ectx->prev_attrs, nlink) ?
                      (ATTR(&ectx->prev_attrs, nlink) <= 1) : 0;
 
+            ListMgr_ApplyBegin();
+            rm_dir_stat(lmgr, ectx, lastrm);
             rc = ListMgr_Remove(lmgr, &ectx->item->entry_id,
                 /* must be based on the DB content = old attrs */
                                 &ectx->item->entry_attr, lastrm);
-            if (rc)
+            if (rc) {
                 DisplayLog(LVL_CRIT, tag(pol),
                            "Error %d removing entry from database.", rc);
+                ListMgr_DirStatCancel(lmgr);
+            } else if (lastrm)
+                ListMgr_AcctUpdate(lmgr, &ectx->item->entry_attr, NULL);
+            ListMgr_ApplyEnd();
             break;
 
         case PA_RM_ALL:
+            ListMgr_ApplyBegin();
+            rm_dir_stat(lmgr, ectx, true);
             rc = ListMgr_Remove(lmgr, &ectx->item->entry_id,
                  /* must be based on the DB content = old attrs */
                                 &ectx->item->entry_attr, 1);
-            if (rc)
+            if (rc) {
                 DisplayLog(LVL_CRIT, tag(pol),
                            "Error %d removing entry from database.", rc);
+                ListMgr_DirStatCancel(lmgr);
+            } else
+                ListMgr_AcctUpdate(lmgr, &ectx->item->entry_attr, NULL);
+            ListMgr_ApplyEnd();
             break;
         }
     }
@@ -2620,7 +2994,8 @@ static int refresh_and_match_entry(lmgr_t *lmgr, entry_context_t *ectx,
                    "Entry %s doesn't match scope of policy '%s'.",
                    path, tag(pol));
         if (!pol->descr->manage_deleted)
-            update_entry(lmgr, &ectx->item->entry_id, &ectx->fresh_attrs);
+            update_entry(lmgr, &ectx->item->entry_id,
+                         &ectx->item->entry_attr, &ectx->fresh_attrs);
 
         return AS_OUT_OF_SCOPE;
 
@@ -2630,7 +3005,8 @@ static int refresh_and_match_entry(lmgr_t *lmgr, entry_context_t *ectx,
                        "Warning: cannot determine if entry %s matches the "
                        "scope of policy '%s': skipping it.", path, tag(pol));
 
-            update_entry(lmgr, &ectx->item->entry_id, &ectx->fresh_attrs);
+            update_entry(lmgr, &ectx->item->entry_id,
+                         &ectx->item->entry_attr, &ectx->fresh_attrs);
             return AS_MISSING_MD;
         } else {
             /* For deleted entries, we expect missing attributes.
@@ -2658,7 +3034,8 @@ static int refresh_and_match_entry(lmgr_t *lmgr, entry_context_t *ectx,
                            "(ignore rule)");
 
             if (!pol->descr->manage_deleted)
-                update_entry(lmgr, &ectx->item->entry_id, &ectx->fresh_attrs);
+                update_entry(lmgr, &ectx->item->entry_id,
+                             &ectx->item->entry_attr, &ectx->fresh_attrs);
 
             return AS_WHITELISTED;
         } else if (match != POLICY_NO_MATCH) {
@@ -2669,7 +3046,8 @@ static int refresh_and_match_entry(lmgr_t *lmgr, entry_context_t *ectx,
                        "skipping it.", path);
 
             if (!pol->descr->manage_deleted)
-                update_entry(lmgr, &ectx->item->entry_id, &ectx->fresh_attrs);
+                update_entry(lmgr, &ectx->item->entry_id,
+                             &ectx->item->entry_attr, &ectx->fresh_attrs);
 
             return AS_MISSING_MD;
         }
@@ -2691,7 +3069,8 @@ static int refresh_and_match_entry(lmgr_t *lmgr, entry_context_t *ectx,
                    path);
 
         if (!pol->descr->manage_deleted)
-            update_entry(lmgr, &ectx->item->entry_id, &ectx->fresh_attrs);
+            update_entry(lmgr, &ectx->item->entry_id,
+                         &ectx->item->entry_attr, &ectx->fresh_attrs);
 
         return AS_NO_POLICY;
     }
@@ -2702,9 +3081,9 @@ static int refresh_and_match_entry(lmgr_t *lmgr, entry_context_t *ectx,
         return AS_OK;
 
     /* check if the entry matches the policy condition */
-    match = entry_matches(&ectx->item->entry_id, &ectx->fresh_attrs,
-                          &ectx->rule->condition, pol->time_modifier,
-                          pol->descr->status_mgr);
+    match = rule_matches(&ectx->item->entry_id, &ectx->fresh_attrs,
+                         ectx->rule, pol->time_modifier,
+                         pol->descr->status_mgr);
 
     switch (match) {
     case POLICY_MATCH:
@@ -2721,7 +3100,8 @@ static int refresh_and_match_entry(lmgr_t *lmgr, entry_context_t *ectx,
                    path, ectx->rule->rule_id);
 
         if (!pol->descr->manage_deleted)
-            update_entry(lmgr, &ectx->item->entry_id, &ectx->fresh_attrs);
+            update_entry(lmgr, &ectx->item->entry_id,
+                         &ectx->item->entry_attr, &ectx->fresh_attrs);
 
         return AS_WHITELISTED;
 
@@ -2733,7 +3113,8 @@ static int refresh_and_match_entry(lmgr_t *lmgr, entry_context_t *ectx,
                    path, ectx->rule->rule_id);
 
         if (!pol->descr->manage_deleted)
-            update_entry(lmgr, &ectx->item->entry_id, &ectx->fresh_attrs);
+            update_entry(lmgr, &ectx->item->entry_id,
+                         &ectx->item->entry_attr, &ectx->fresh_attrs);
 
         return AS_MISSING_MD;
     }
@@ -2741,6 +3122,12 @@ static int refresh_and_match_entry(lmgr_t *lmgr, entry_context_t *ectx,
     return AS_OK;
 }
 
+/**
+ * DB connection of threads that finalize entries outside of the policy
+ * workers: scheduler threads, and the command event loop. The latter is
+ * a single glib loop thread, so asynchronous action completions are
+ * processed one at a time, with a single connection.
+ */
 static __thread lmgr_t *sched_db_conn = NULL;
 
 static int init_sched_thread_conn(void)
@@ -2755,11 +3142,14 @@ static int init_sched_thread_conn(void)
         return -ENOMEM;
 
     rc = ListMgr_InitAccess(sched_db_conn);
-    if (rc)
+    if (rc) {
         DisplayLog(LVL_CRIT, __func__,
                    "Could not connect to database (error %d).",
                    rc);
-    else
+        /* retry on next call */
+        free(sched_db_conn);
+        sched_db_conn = NULL;
+    } else
         DisplayLog(LVL_FULL, __func__, "Initialized DB connection for "
                    "thread %Lx", (ull_t)pthread_self());
 
@@ -2783,7 +3173,12 @@ static void run_sched_cb(void *udata, sched_status_e st)
     DisplayLog(LVL_DEBUG, tag(pol), "Received callback from scheduler %d,"
                " status = %d", ectx->curr_sched, st);
 
-    init_sched_thread_conn();
+    if (init_sched_thread_conn()) {
+        policy_ack(&pol->queue, AS_ERROR, &ectx->item->entry_attr,
+                   ectx->item->targeted);
+        free_entry_context(ectx);
+        return;
+    }
 
     rc = st;
     if (rc == SCHED_OK) {
@@ -2801,8 +3196,9 @@ static void run_sched_cb(void *udata, sched_status_e st)
                 free_entry_context(ectx);
                 return;
             }
-            rc = policy_action(ectx);
-            action_fini(rc, sched_db_conn, ectx);
+            rc = policy_action(sched_db_conn, ectx);
+            if (rc != ACTION_PENDING)
+                action_fini(rc, sched_db_conn, ectx);
             return;
         }
         /* else, call the next scheduler */
@@ -2843,7 +3239,7 @@ static void run_sched_cb(void *udata, sched_status_e st)
     /* finalize current entry processing */
     if (!pol->descr->manage_deleted)
         update_entry(sched_db_conn, &ectx->item->entry_id,
-                     &ectx->fresh_attrs);
+                     &ectx->item->entry_attr, &ectx->fresh_attrs);
     policy_ack(&pol->queue, AS_NOT_SCHEDULED, &ectx->item->entry_attr,
                ectx->item->targeted);
 
@@ -2865,6 +3261,211 @@ static void run_sched_cb(void *udata, sched_status_e st)
     }
 }
 
+/**
+ * Called by the command event loop when an asynchronous action command
+ * terminates.
+ */
+static void async_action_done(void *udata, int rc)
+{
+    entry_context_t *ectx = udata;
+    policy_info_t *pol = ectx->policy;
+
+    call_action_cb(ectx, rc);
+
+    /* runs in the command loop thread, which needs its own DB connection
+     * to finalize actions */
+    if (init_sched_thread_conn()) {
+        DisplayLog(LVL_MAJOR, tag(pol), "Cannot update entry %s after "
+                   "action: no DB connection",
+                   ATTR(&ectx->fresh_attrs, fullpath));
+        policy_ack(&pol->queue, AS_ERROR, &ectx->item->entry_attr,
+                   ectx->item->targeted);
+        free_entry_context(ectx);
+    } else
+        action_fini(rc, sched_db_conn, ectx);
+
+    /* allow a new command to start */
+    sem_post_safe(&pol->async_slots);
+}
+
+/** entries waiting for a batch action */
+struct action_batch {
+    pthread_mutex_t          lock;
+    const policy_action_t   *action;    /**< action of pending entries */
+    entry_context_t        **ectx;
+    unsigned int             count;
+    unsigned int             size;
+};
+
+static int batch_init(policy_info_t *pol)
+{
+    struct action_batch *b;
+
+    b = calloc(1, sizeof(*b));
+    if (b == NULL)
+        return ENOMEM;
+
+    b->size = pol->config->action_batch_size;
+    b->ectx = calloc(b->size, sizeof(*b->ectx));
+    if (b->ectx == NULL) {
+        free(b);
+        return ENOMEM;
+    }
+    pthread_mutex_init(&b->lock, NULL);
+
+    pol->batch = b;
+    return 0;
+}
+
+/**
+ * Run the pending entries one by one with the single entry action,
+ * when memory is missing to run them as a batch.
+ */
+static void batch_flush_single(policy_info_t *pol, lmgr_t *lmgr)
+{
+    struct action_batch *b = pol->batch;
+    const policy_action_t *action;
+    entry_context_t *ectx;
+    unsigned int count;
+    int rc;
+
+    /* don't run entries added in the meantime (their thread flushes
+     * them) */
+    P(b->lock);
+    count = b->count;
+    V(b->lock);
+
+    for (; count > 0; count--) {
+        P(b->lock);
+        if (b->count == 0) {
+            V(b->lock);
+            break;
+        }
+        /* keep the order of entries */
+        ectx = b->ectx[0];
+        b->count--;
+        memmove(b->ectx, b->ectx + 1, b->count * sizeof(*b->ectx));
+        action = b->action;
+        V(b->lock);
+
+        DisplayLog(LVL_DEBUG, tag(pol), DFID ": action: %s",
+                   PFID(&ectx->item->entry_id), action->action_u.func.name);
+
+        /* @TODO provide a DB callback */
+        rc = action->action_u.func.call(&ectx->item->entry_id,
+                                        &ectx->fresh_attrs, &ectx->params,
+                                        &ectx->after_action, NULL, NULL);
+        call_action_cb(ectx, rc);
+        action_fini(rc, lmgr, ectx);
+    }
+}
+
+/** Run the batch action on all pending entries, and finalize them. */
+static void batch_flush(policy_info_t *pol, lmgr_t *lmgr)
+{
+    struct action_batch *b = pol->batch;
+    const policy_action_t *action;
+    entry_context_t **ectx;
+    action_item_t *items;
+    unsigned int count, i;
+    int rc;
+
+    /* allocate outside the lock */
+    ectx = calloc(b->size, sizeof(*ectx));
+    items = calloc(b->size, sizeof(*items));
+    if (ectx == NULL || items == NULL) {
+        /* pending entries must still be run, or batch_add() would wait
+         * for ever for room in the batch */
+        DisplayLog(LVL_CRIT, tag(pol), "Memory error in %s: running "
+                   "pending entries one by one", __func__);
+        batch_flush_single(pol, lmgr);
+        goto out_free;
+    }
+
+    /* take pending entries */
+    P(b->lock);
+    count = b->count;
+    action = b->action;
+    memcpy(ectx, b->ectx, count * sizeof(*ectx));
+    b->count = 0;
+    V(b->lock);
+
+    if (count == 0)
+        goto out_free;
+
+    for (i = 0; i < count; i++) {
+        items[i].id = &ectx[i]->item->entry_id;
+        items[i].attrs = &ectx[i]->fresh_attrs;
+        items[i].params = &ectx[i]->params;
+        items[i].what_after = &ectx[i]->after_action;
+    }
+
+    DisplayLog(LVL_DEBUG, tag(pol), "Running action %s on %u entries",
+               action->action_u.func.name, count);
+
+    /* @TODO provide a DB callback */
+    rc = action->action_u.func.call_batch(items, count, NULL, NULL);
+
+    for (i = 0; i < count; i++) {
+        int item_rc = rc ? rc : items[i].rc;
+
+        call_action_cb(ectx[i], item_rc);
+        action_fini(item_rc, lmgr, ectx[i]);
+    }
+
+out_free:
+    free(ectx);
+    free(items);
+}
+
+/** Add an entry to the pending batch, and run the batch when it is full */
+static void batch_add(policy_info_t *pol, lmgr_t *lmgr,
+                      entry_context_t *ectx, const policy_action_t *action)
+{
+    struct action_batch *b = pol->batch;
+    bool full;
+
+    P(b->lock);
+    /* a batch only holds entries for the same action */
+    while (b->count > 0 && (b->action != action || b->count >= b->size)) {
+        V(b->lock);
+        batch_flush(pol, lmgr);
+        P(b->lock);
+    }
+    b->action = action;
+    b->ectx[b->count++] = ectx;
+    full = (b->count >= b->size);
+    V(b->lock);
+
+    if (full)
+        batch_flush(pol, lmgr);
+}
+
+/**
+ * Run the pending batch if no more entries are waiting in the queue.
+ * @param lmgr  DB connection of the calling thread, or NULL to use
+ *              a connection dedicated to the thread.
+ */
+static void batch_flush_idle(policy_info_t *pol, lmgr_t *lmgr)
+{
+    unsigned int nb_in_queue;
+
+    if (pol->batch == NULL)
+        return;
+
+    RetrieveQueueStats(&pol->queue, NULL, &nb_in_queue, NULL, NULL, NULL,
+                       NULL, NULL);
+    if (nb_in_queue != 0)
+        return;
+
+    if (lmgr == NULL) {
+        if (init_sched_thread_conn())
+            return;
+        lmgr = sched_db_conn;
+    }
+    batch_flush(pol, lmgr);
+}
+
 /**
 * Manage an entry by path or by fid, depending on FS
 */
@@ -2924,7 +3525,8 @@ static void process_entry(policy_info_t *pol, lmgr_t *lmgr,
     rc = build_action_params(ectx);
     if (rc) {
         if (!pol->descr->manage_deleted)
-            update_entry(lmgr, &p_item->entry_id, &ectx->fresh_attrs);
+            update_entry(lmgr, &p_item->entry_id, &p_item->entry_attr,
+                         &ectx->fresh_attrs);
 
         policy_ack(&pol->queue, AS_ERROR, &p_item->entry_attr,
                    p_item->targeted);
@@ -2939,9 +3541,10 @@ static void process_entry(policy_info_t *pol, lmgr_t *lmgr,
     if (pol->config->sched_count == 0) {
 
         /* apply action to the entry! */
-        rc = policy_action(ectx);
+        rc = policy_action(lmgr, ectx);
 
-        action_fini(rc, lmgr, ectx);
+        if (rc != ACTION_PENDING)
+            action_fini(rc, lmgr, ectx);
         return;
     }
 
@@ -2975,8 +3578,11 @@ static void *thr_policy_run(void *arg)
         exit(rc);
     }
 
-    while (Queue_Get(&pol->queue, &p_queue_entry) == 0)
+    while (Queue_Get(&pol->queue, &p_queue_entry) == 0) {
         process_entry(pol, &lmgr, (queue_item_t *) p_queue_entry, true);
+        /* don't keep a partial batch waiting */
+        batch_flush_idle(pol, &lmgr);
+    }
 
     /* Error occurred in queue management... */
     DisplayLog(LVL_CRIT, tag(pol),
@@ -2996,6 +3602,20 @@ int start_worker_threads(policy_info_t *pol)
         return ENOMEM;
     }
 
+    if (pol->config->action_batch_size > 1 && batch_init(pol)) {
+        DisplayLog(LVL_CRIT, tag(pol), "Memory error in %s", __func__);
+        return ENOMEM;
+    }
+
+    /* bound the number of asynchronous action commands */
+    if (pol->config->max_async_commands > 0 &&
+        sem_init(&pol->async_slots, 0, pol->config->max_async_commands)) {
+        int rc = errno;
+        DisplayLog(LVL_CRIT, tag(pol), "Error %d initializing semaphore in "
+                   "%s: %s", rc, __func__, strerror(rc));
+        return rc;
+    }
+
     for (i = 0; i < pol->config->nb_threads; i++) {
         if (pthread_create(&pol->threads[i], NULL, thr_policy_run, pol) !=
             0) {
@@ -3033,6 +3653,7 @@ int check_current_actions(policy_info_t *pol, lmgr_t *lmgr,
     unsigned int nb_aborted = 0;
     attr_mask_t attr_mask_sav = { 0 };
     attr_mask_t tmp;
+    attr_set_t old_attrs = ATTR_SET_INIT;
 
     /* do nothing if this policy applies to deleted entries */
     if (pol->descr->manage_deleted)
@@ -3052,6 +3673,12 @@ int check_current_actions(policy_info_t *pol, lmgr_t *lmgr,
     q_item.entry_attr.attr_mask =
         attr_mask_or(&q_item.entry_attr.attr_mask, &tmp);
 
+    /* needed to update the accounting of the entries */
+    if (lmgr_acct_batched()) {
+        q_item.entry_attr.attr_mask.std |= ACCT_ATTR_MASK;
+        q_item.entry_attr.attr_mask.status |= all_status_mask();
+    }
+
     attr_mask_sav = q_item.entry_attr.attr_mask;
 
     rc = lmgr_simple_filter_init(&filter);
@@ -3106,6 +3733,10 @@ int check_current_actions(policy_info_t *pol, lmgr_t *lmgr,
             DisplayLog(LVL_VERB, tag(pol), "Updating status of '%s'...",
                        ATTR(&q_item.entry_attr, fullpath));
 
+        /* keep the accounting values of the entry, as stored in DB */
+        if (lmgr_acct_batched())
+            ListMgr_MergeAttrSets(&old_attrs, &q_item.entry_attr, false);
+
         /* check entry (force retrieving fresh attributes) */
         if (check_entry(pol, lmgr, &q_item, &q_item.entry_attr, MS_FORCE_UPDT)
             == AS_OK) {
@@ -3127,8 +3758,12 @@ int check_current_actions(policy_info_t *pol, lmgr_t *lmgr,
             }
 
             /* update entry status */
-            update_entry(lmgr, &q_item.entry_id, &q_item.entry_attr);
+            update_entry(lmgr, &q_item.entry_id,
+                         lmgr_acct_batched() ? &old_attrs : NULL,
+                         &q_item.entry_attr);
         }
+        ListMgr_FreeAttrs(&old_attrs);
+        ATTR_MASK_INIT(&old_attrs);
 
         /* reset attr_mask, if it was altered by last ListMgr_GetNext() call */
         memset(&q_item, 0, sizeof(queue_item_t));
@@ -40,6 +40,9 @@ static int polrun_set_default(const policy_descr_t *pol,
     cfg->nb_threads = 4;
     cfg->queue_size = 4096;
     cfg->db_request_limit = 100000;
+    cfg->db_prefetch = true;
+    cfg->max_async_commands = 0;    /* synchronous */
+    cfg->action_batch_size = 1;     /* no batching */
     cfg->max_action_nbr = 0;    /* unlimited */
     cfg->max_action_vol = 0;    /* unlimited */
 
@@ -137,6 +140,9 @@ static void policy_run_cfg_write_default(FILE *output)
     print_line(output, 1, "reschedule_delay_ms     : 100");
     print_line(output, 1, "queue_size              : 4096");
     print_line(output, 1, "db_result_size_max      : 100000");
+    print_line(output, 1, "db_prefetch             : yes");
+    print_line(output, 1, "max_async_commands      : 0 (disabled)");
+    print_line(output, 1, "action_batch_size       : 1");
     print_line(output, 1, "pre_maintenance_window  : 0 (disabled)");
     print_line(output, 1, "maint_min_apply_delay   : 30min");
     print_line(output, 1, "pre_sched_match         : cache_only");
@@ -196,6 +202,18 @@ static void policy_run_cfg_write_template(FILE *output)
     print_line(output, 1, "# delay for rescheduling a delayed entry");
     print_line(output, 1, "#reschedule_delay_ms = 100;");
     fprintf(output, "\n");
+    print_line(output, 1, "# run the next DB request for candidates while the");
+    print_line(output, 1, "# current list is being processed");
+    print_line(output, 1, "#db_prefetch = yes;");
+    fprintf(output, "\n");
+    print_line(output, 1, "# run action commands asynchronously, with at most");
+    print_line(output, 1, "# this number of commands running at once");
+    print_line(output, 1, "#max_async_commands = 1000;");
+    fprintf(output, "\n");
+    print_line(output, 1, "# number of entries passed at once to actions that");
+    print_line(output, 1, "# support it (e.g. lhsm.archive)");
+    print_line(output, 1, "#action_batch_size = 100;");
+    fprintf(output, "\n");
     print_line(output, 1, "# Command to execute before each run:");
     print_line(output, 1, "# pre_run_command = \"/path/to/script.sh -f {cfg} "
                           "-p {fspath}\" ;");
@@ -710,7 +728,9 @@ static int polrun_read_config(config_file_t config, const char *policy_name,
         "check_actions_interval", "check_actions_on_startup",
         "recheck_ignored_entries", "report_actions",
         "pre_maintenance_window", "maint_min_apply_delay", "queue_size",
-        "db_result_size_max", "action_params", "action", SCHED_PARAM_NAME,
+        "db_result_size_max", "db_prefetch", "max_async_commands",
+        "action_batch_size",
+        "action_params", "action", SCHED_PARAM_NAME,
         "pre_sched_match", "post_sched_match", "reschedule_delay_ms",
         "pre_run_command", "post_run_command",
         "recheck_ignored_classes",  /* for compat */
@@ -748,6 +768,11 @@ static int polrun_read_config(config_file_t config, const char *policy_name,
          &conf->queue_size, 0},
         {"db_result_size_max", PT_INT, PFLG_POSITIVE,
          &conf->db_request_limit, 0},
+        {"db_prefetch", PT_BOOL, 0, &conf->db_prefetch, 0},
+        {"max_async_commands", PT_INT, PFLG_POSITIVE,
+         &conf->max_async_commands, 0},
+        {"action_batch_size", PT_INT, PFLG_POSITIVE | PFLG_NOT_NULL,
+         &conf->action_batch_size, 0},
         {"reschedule_delay_ms", PT_INT, PFLG_POSITIVE,
          &conf->reschedule_delay_ms, 0},
         {"pre_run_command", PT_CMD, 0, &conf->pre_run_command, 0},
@@ -1186,6 +1211,12 @@ static int polrun_reload(const char *blkname, policy_run_config_t *cfg_tgt,
     if (cfg_tgt->queue_size != cfg_new->queue_size)
         no_param_updt_msg(blkname, "queue_size");
 
+    if (cfg_tgt->max_async_commands != cfg_new->max_async_commands)
+        no_param_updt_msg(blkname, "max_async_commands");
+
+    if (cfg_tgt->action_batch_size != cfg_new->action_batch_size)
+        no_param_updt_msg(blkname, "action_batch_size");
+
 // FIXME can change action functions, but not cmd string
 //    if (strcmp(cfg_new->default_action, cfg_tgt->default_action))
 //        no_param_updt_msg(blkname, "default_action");
@@ -1246,6 +1277,13 @@ static int polrun_reload(const char *blkname, policy_run_config_t *cfg_tgt,
         cfg_tgt->db_request_limit = cfg_new->db_request_limit;
     }
 
+    if (cfg_tgt->db_prefetch != cfg_new->db_prefetch) {
+        PARAM_UPDT_MSG(blkname, "db_prefetch", "%s",
+                       bool2str(cfg_tgt->db_prefetch),
+                       bool2str(cfg_new->db_prefetch));
+        cfg_tgt->db_prefetch = cfg_new->db_prefetch;
+    }
+
     if (cfg_tgt->pre_maintenance_window != cfg_new->pre_maintenance_window) {
         PARAM_UPDT_MSG(blkname, "pre_maintenance_window", "%lu",
                        cfg_tgt->pre_maintenance_window,
@@ -23,6 +23,7 @@
 
 #include <glib.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "uidgidcache.h"
 #include "cmd_helpers.h"
@@ -208,7 +209,7 @@ int rbh_scrub(lmgr_t *p_mgr, const wagon_t *id_list,
         }
 
         /* Call the callback func for each listed dir */
-        rc = cb_func(child_ids, child_attrs, res_count, arg);
+        rc = cb_func(p_mgr, child_ids, child_attrs, res_count, arg);
         if (rc)
             /* XXX break the scan? */
             last_err = rc;
@@ -241,6 +242,533 @@ int rbh_scrub(lmgr_t *p_mgr, const wagon_t *id_list,
     return last_err;
 }
 
+/*
+ * Parallel scrubbing: worker threads share a LIFO frontier of directories
+ * to be listed, each of them using its own DB connection.
+ */
+
+/** directory to be listed by a scrub worker */
+typedef struct scrub_task {
+    wagon_t             dir;
+    struct scrub_task  *parent; /**< only set in ordered mode */
+
+    /* result of the listing */
+    wagon_t            *child_ids;
+    attr_set_t         *child_attrs;
+    unsigned int        child_count;
+    void               *data;       /**< fetched by the caller (ordered) */
+    bool                done;
+
+    /* ordered mode: tasks for child directories, in listing order */
+    struct scrub_task **subtasks;
+    unsigned int        sub_count;
+    unsigned int        next_sub;   /**< next subtask to be delivered */
+} scrub_task_t;
+
+typedef struct scrub_ctx {
+    pthread_mutex_t  lock;  /**< protects the frontier and the counters */
+    pthread_cond_t   cond;
+    scrub_task_t   **frontier;
+    unsigned int     frontier_count;
+    unsigned int     frontier_size;
+    unsigned int     running;   /**< number of tasks being processed */
+    bool             abort;
+    int              last_err;
+
+    /* ordered mode: the data to be output is fetched by the workers as soon
+     * as a directory is listed. It is output in the same order as
+     * rbh_scrub() (depth first), by walking the tree of tasks. */
+    bool             ordered;
+    pthread_mutex_t  cb_lock;   /**< protects the tree of tasks */
+    scrub_task_t     root;      /**< parent of the input directories */
+    scrub_task_t    *cursor;    /**< last delivered task */
+    /* reorder buffer (protected by ctx->lock) */
+    unsigned int     pending;   /**< listed tasks, not delivered yet */
+    scrub_task_t    *blocking;  /**< next task to deliver, not listed yet */
+
+    lmgr_filter_t    filter;
+    attr_mask_t      dir_attr_mask;
+    scrub_callback_t cb_func;
+    scrub_fetch_t    fetch_func;
+    scrub_output_t   out_func;
+    void            *cb_arg;
+} scrub_ctx_t;
+
+/* max number of listed directories waiting for the output of previous ones
+ * (ordered mode) */
+#define SCRUB_MAX_PENDING 1024
+
+static scrub_task_t *scrub_task_new(const wagon_t *dir, scrub_task_t *parent)
+{
+    scrub_task_t *task = MemCalloc(1, sizeof(*task));
+
+    if (!task)
+        return NULL;
+
+    task->dir.id = dir->id;
+    task->dir.fullname = strdup(dir->fullname);
+    task->parent = parent;
+    return task;
+}
+
+static void scrub_task_free_result(scrub_task_t *task)
+{
+    int i;
+
+    if (task->child_attrs) {
+        for (i = 0; i < task->child_count; i++)
+            ListMgr_FreeAttrs(&task->child_attrs[i]);
+        MemFree(task->child_attrs);
+        task->child_attrs = NULL;
+    }
+    if (task->child_ids) {
+        free_wagon(task->child_ids, 0, task->child_count);
+        MemFree(task->child_ids);
+        task->child_ids = NULL;
+    }
+    task->child_count = 0;
+}
+
+static void scrub_task_free(scrub_task_t *task)
+{
+    scrub_task_free_result(task);
+    free(task->dir.fullname);
+    if (task->subtasks)
+        MemFree(task->subtasks);
+    MemFree(task);
+}
+
+/** free a task and all its remaining subtasks (ordered mode) */
+static void scrub_tree_free(scrub_task_t *task, bool is_root)
+{
+    int i;
+
+    for (i = 0; i < task->sub_count; i++)
+        if (task->subtasks[i] != NULL)
+            scrub_tree_free(task->subtasks[i], false);
+
+    if (is_root) {
+        if (task->subtasks)
+            MemFree(task->subtasks);
+    } else
+        scrub_task_free(task);
+}
+
+static void scrub_set_error(scrub_ctx_t *ctx, int rc, bool abort)
+{
+    P(ctx->lock);
+    ctx->last_err = rc;
+    if (abort) {
+        ctx->abort = true;
+        pthread_cond_broadcast(&ctx->cond);
+    }
+    V(ctx->lock);
+}
+
+/** push tasks to the frontier (must be called with ctx->lock held) */
+static int frontier_push(scrub_ctx_t *ctx, scrub_task_t **tasks,
+                         unsigned int count)
+{
+    int i;
+
+    if (ctx->frontier_count + count > ctx->frontier_size) {
+        size_t new_size = what_2_power(ctx->frontier_count + count);
+        scrub_task_t **new_frontier;
+
+        new_frontier = MemRealloc(ctx->frontier,
+                                  new_size * sizeof(scrub_task_t *));
+        if (!new_frontier)
+            return -ENOMEM;
+        ctx->frontier = new_frontier;
+        ctx->frontier_size = new_size;
+    }
+
+    /* push them in reverse order, so the first one is processed first */
+    for (i = count - 1; i >= 0; i--)
+        ctx->frontier[ctx->frontier_count++] = tasks[i];
+
+    pthread_cond_broadcast(&ctx->cond);
+    return 0;
+}
+
+/** remove a given task from the frontier (must be called with ctx->lock
+ * held) */
+static bool frontier_take(scrub_ctx_t *ctx, scrub_task_t *task)
+{
+    int i;
+
+    for (i = ctx->frontier_count - 1; i >= 0; i--) {
+        if (ctx->frontier[i] == task) {
+            memmove(&ctx->frontier[i], &ctx->frontier[i + 1],
+                    (ctx->frontier_count - i - 1) * sizeof(scrub_task_t *));
+            ctx->frontier_count--;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Output the completed tasks in depth-first order, starting from the last
+ * delivered one (must be called with ctx->cb_lock held).
+ */
+static void scrub_deliver(scrub_ctx_t *ctx)
+{
+    scrub_task_t *curr = ctx->cursor;
+    scrub_task_t *blocking = NULL;
+    unsigned int delivered = 0;
+    int rc;
+
+    for (;;) {
+        if (curr->next_sub < curr->sub_count) {
+            scrub_task_t *next = curr->subtasks[curr->next_sub];
+
+            /* wait for it to be listed */
+            if (!next->done) {
+                blocking = next;
+                break;
+            }
+
+            curr->next_sub++;
+            rc = ctx->out_func(next->child_ids, next->child_attrs,
+                               next->child_count, next->data, ctx->cb_arg);
+            if (rc)
+                scrub_set_error(ctx, rc, false);
+            next->data = NULL;
+            scrub_task_free_result(next);
+            delivered++;
+
+            /* then deliver its subdirectories */
+            curr = next;
+        } else if (curr == &ctx->root) {
+            /* all done */
+            break;
+        } else {
+            /* the whole subtree has been delivered */
+            scrub_task_t *parent = curr->parent;
+
+            parent->subtasks[parent->next_sub - 1] = NULL;
+            scrub_task_free(curr);
+            curr = parent;
+        }
+    }
+    ctx->cursor = curr;
+
+    P(ctx->lock);
+    ctx->pending -= delivered;
+    ctx->blocking = blocking;
+    if (delivered > 0)
+        pthread_cond_broadcast(&ctx->cond);
+    V(ctx->lock);
+}
+
+/** list a directory and push its subdirectories to the frontier */
+static int scrub_process(scrub_ctx_t *ctx, lmgr_t *p_mgr, scrub_task_t *task)
+{
+    scrub_task_t **subtasks = NULL;
+    int i, rc;
+
+    rc = ListMgr_GetChild(p_mgr, &ctx->filter, &task->dir, 1,
+                          ctx->dir_attr_mask, &task->child_ids,
+                          &task->child_attrs, &task->child_count);
+    if (rc) {
+        DisplayLog(LVL_CRIT, SCRUB_TAG,
+                   "ListMgr_GetChild() terminated with error %d", rc);
+        goto out;
+    }
+
+    if (task->child_count > 0) {
+        subtasks = MemCalloc(task->child_count, sizeof(scrub_task_t *));
+        if (!subtasks) {
+            rc = -ENOMEM;
+            goto out;
+        }
+
+        for (i = 0; i < task->child_count; i++) {
+            subtasks[i] = scrub_task_new(&task->child_ids[i],
+                                         ctx->ordered ? task : NULL);
+            if (!subtasks[i]) {
+                rc = -ENOMEM;
+                goto free_subtasks;
+            }
+        }
+
+        P(ctx->lock);
+        rc = frontier_push(ctx, subtasks, task->child_count);
+        V(ctx->lock);
+        if (rc)
+            goto free_subtasks;
+    }
+
+    if (ctx->ordered) {
+        /* the DB requests of the caller are done in parallel,
+         * only the output is serialized */
+        rc = ctx->fetch_func(p_mgr, task->child_ids, task->child_attrs,
+                             task->child_count, ctx->cb_arg, &task->data);
+        if (rc)
+            scrub_set_error(ctx, rc, false);
+
+        P(ctx->cb_lock);
+        task->subtasks = subtasks;
+        task->sub_count = task->child_count;
+        task->done = true;
+        P(ctx->lock);
+        ctx->pending++;
+        V(ctx->lock);
+        scrub_deliver(ctx);
+        V(ctx->cb_lock);
+        return 0;
+    }
+
+    /* unordered mode: results are delivered as soon as they are listed */
+    if (subtasks)
+        MemFree(subtasks);
+    rc = ctx->cb_func(p_mgr, task->child_ids, task->child_attrs,
+                      task->child_count, ctx->cb_arg);
+    if (rc)
+        scrub_set_error(ctx, rc, false);
+    scrub_task_free(task);
+    return 0;
+
+ free_subtasks:
+    for (i = 0; i < task->child_count; i++)
+        if (subtasks[i])
+            scrub_task_free(subtasks[i]);
+    MemFree(subtasks);
+ out:
+    /* in ordered mode, the task is released with the tree */
+    if (!ctx->ordered)
+        scrub_task_free(task);
+    return rc;
+}
+
+static void *scrub_worker(void *arg)
+{
+    scrub_ctx_t *ctx = arg;
+    lmgr_t lmgr;
+    int rc;
+
+    rc = ListMgr_InitAccess(&lmgr);
+    if (rc) {
+        DisplayLog(LVL_CRIT, SCRUB_TAG,
+                   "Could not connect to database (error %d)", rc);
+        scrub_set_error(ctx, rc, true);
+        return NULL;
+    }
+
+    for (;;) {
+        scrub_task_t *task;
+
+        P(ctx->lock);
+        for (;;) {
+            /* wait for directories, until no task can generate new ones */
+            while (ctx->frontier_count == 0 && ctx->running > 0
+                   && !ctx->abort)
+                pthread_cond_wait(&ctx->cond, &ctx->lock);
+
+            if (ctx->abort || ctx->frontier_count == 0) {
+                task = NULL;
+                break;
+            }
+
+            if (!ctx->ordered || ctx->pending < SCRUB_MAX_PENDING) {
+                task = ctx->frontier[--ctx->frontier_count];
+                break;
+            }
+
+            /* reorder buffer is full: only list the directory that
+             * the output is waiting for */
+            task = ctx->blocking;
+            if (task != NULL && frontier_take(ctx, task))
+                break;
+
+            /* it is being listed: wait for the output to progress */
+            pthread_cond_wait(&ctx->cond, &ctx->lock);
+        }
+        if (task == NULL) {
+            V(ctx->lock);
+            break;
+        }
+        ctx->running++;
+        V(ctx->lock);
+
+        rc = scrub_process(ctx, &lmgr, task);
+
+        P(ctx->lock);
+        ctx->running--;
+        if (rc) {
+            ctx->last_err = rc;
+            ctx->abort = true;
+        }
+        pthread_cond_broadcast(&ctx->cond);
+        V(ctx->lock);
+    }
+
+    ListMgr_CloseAccess(&lmgr);
+    return NULL;
+}
+
+/** run a parallel scrub (the callbacks of ctx are set by the caller) */
+static int scrub_parallel(scrub_ctx_t *ctx, const wagon_t *id_list,
+                          unsigned int id_count, unsigned int nb_threads)
+{
+    bool ordered = ctx->ordered;
+    scrub_task_t **tasks;
+    pthread_t *threads;
+    filter_value_t fv;
+    unsigned int started;
+    int i, rc = 0;
+
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->cond, NULL);
+    pthread_mutex_init(&ctx->cb_lock, NULL);
+
+    /* only get subdirs (for scanning) */
+    fv.value.val_str = STR_TYPE_DIR;
+    lmgr_simple_filter_init(&ctx->filter);
+    lmgr_simple_filter_add(&ctx->filter, ATTR_INDEX_type, EQUAL, fv, 0);
+
+    tasks = MemCalloc(id_count, sizeof(scrub_task_t *));
+    if (!tasks) {
+        rc = -ENOMEM;
+        goto out;
+    }
+    for (i = 0; i < id_count; i++) {
+        tasks[i] = scrub_task_new(&id_list[i], ordered ? &ctx->root : NULL);
+        if (!tasks[i]) {
+            rc = -ENOMEM;
+            break;
+        }
+    }
+    if (rc == 0)
+        rc = frontier_push(ctx, tasks, id_count);
+    if (rc) {
+        for (i = 0; i < id_count; i++)
+            if (tasks[i])
+                scrub_task_free(tasks[i]);
+        MemFree(tasks);
+        goto out;
+    }
+
+    if (ordered) {
+        ctx->root.subtasks = tasks;
+        ctx->root.sub_count = id_count;
+        ctx->root.done = true;
+        ctx->cursor = &ctx->root;
+    } else
+        MemFree(tasks);
+
+    threads = MemCalloc(nb_threads, sizeof(pthread_t));
+    if (!threads) {
+        rc = -ENOMEM;
+        goto free_tasks;
+    }
+
+    for (started = 0; started < nb_threads; started++) {
+        rc = pthread_create(&threads[started], NULL, scrub_worker, ctx);
+        if (rc) {
+            rc = -rc;
+            DisplayLog(LVL_CRIT, SCRUB_TAG,
+                       "Failed to start scrub thread: %s", strerror(-rc));
+            break;
+        }
+    }
+    /* go on with the started threads, if any */
+    if (started > 0)
+        rc = 0;
+
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    MemFree(threads);
+
+    if (rc == 0)
+        rc = ctx->last_err;
+
+ free_tasks:
+    /* release the tasks left by an aborted scrub */
+    if (ordered)
+        scrub_tree_free(&ctx->root, true);
+    else
+        for (i = 0; i < ctx->frontier_count; i++)
+            scrub_task_free(ctx->frontier[i]);
+ out:
+    if (ctx->frontier)
+        MemFree(ctx->frontier);
+    lmgr_simple_filter_free(&ctx->filter);
+    pthread_mutex_destroy(&ctx->cb_lock);
+    pthread_cond_destroy(&ctx->cond);
+    pthread_mutex_destroy(&ctx->lock);
+    return rc;
+}
+
+int rbh_scrub_parallel(lmgr_t *p_mgr, const wagon_t *id_list,
+                       unsigned int id_count, attr_mask_t dir_attr_mask,
+                       unsigned int nb_threads, scrub_callback_t cb_func,
+                       void *arg)
+{
+    scrub_ctx_t ctx;
+
+    if (nb_threads <= 1)
+        return rbh_scrub(p_mgr, id_list, id_count, dir_attr_mask, cb_func,
+                         arg);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.dir_attr_mask = dir_attr_mask;
+    ctx.cb_func = cb_func;
+    ctx.cb_arg = arg;
+
+    return scrub_parallel(&ctx, id_list, id_count, nb_threads);
+}
+
+/** fetch and output callbacks, for a sequential ordered scrub */
+struct scrub_ordered_arg {
+    scrub_fetch_t   fetch_func;
+    scrub_output_t  out_func;
+    void           *arg;
+};
+
+static int scrub_ordered_cb(lmgr_t *p_mgr, wagon_t *id_list,
+                            attr_set_t *attr_list, unsigned int entry_count,
+                            void *arg)
+{
+    struct scrub_ordered_arg *cb = arg;
+    void *data = NULL;
+    int rc, rc2;
+
+    rc = cb->fetch_func(p_mgr, id_list, attr_list, entry_count, cb->arg,
+                        &data);
+    rc2 = cb->out_func(id_list, attr_list, entry_count, data, cb->arg);
+    return rc ? rc : rc2;
+}
+
+int rbh_scrub_ordered(lmgr_t *p_mgr, const wagon_t *id_list,
+                      unsigned int id_count, attr_mask_t dir_attr_mask,
+                      unsigned int nb_threads, scrub_fetch_t fetch_func,
+                      scrub_output_t out_func, void *arg)
+{
+    scrub_ctx_t ctx;
+
+    if (nb_threads <= 1) {
+        struct scrub_ordered_arg cb = {
+            .fetch_func = fetch_func,
+            .out_func = out_func,
+            .arg = arg
+        };
+
+        return rbh_scrub(p_mgr, id_list, id_count, dir_attr_mask,
+                         scrub_ordered_cb, &cb);
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.ordered = true;
+    ctx.dir_attr_mask = dir_attr_mask;
+    ctx.fetch_func = fetch_func;
+    ctx.out_func = out_func;
+    ctx.cb_arg = arg;
+
+    return scrub_parallel(&ctx, id_list, id_count, nb_threads);
+}
+
 int Path2Id(const char *path, entry_id_t *id)
 {
     int rc;
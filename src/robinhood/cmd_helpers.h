@@ -38,8 +38,10 @@
 /** initialize internal resources (glib, llapi, internal resources...) */
 int rbh_init_internals(void);
 
-/** The caller's function to be called for scanned entries */
-typedef int (*scrub_callback_t) (wagon_t *id_list,
+/** The caller's function to be called for scanned entries.
+ * p_mgr is the DB connection of the calling thread.
+ */
+typedef int (*scrub_callback_t) (lmgr_t *p_mgr, wagon_t *id_list,
                                  attr_set_t *attr_list,
                                  unsigned int entry_count, void *arg);
 
@@ -50,6 +52,42 @@ int rbh_scrub(lmgr_t *p_mgr, const wagon_t *id_list,
               unsigned int id_count, attr_mask_t dir_attr_mask,
               scrub_callback_t cb_func, void *arg);
 
+/** scan sets of directories using nb_threads threads, each one with its own
+ *  DB connection (same as rbh_scrub() if nb_threads <= 1).
+ *  cb_func is called concurrently from all threads, as soon as a directory
+ *  is listed.
+ */
+int rbh_scrub_parallel(lmgr_t *p_mgr, const wagon_t *id_list,
+                       unsigned int id_count, attr_mask_t dir_attr_mask,
+                       unsigned int nb_threads, scrub_callback_t cb_func,
+                       void *arg);
+
+/** For ordered scans: the caller's function to retrieve the data to be
+ * output for scanned entries. It is called concurrently from all threads.
+ * p_mgr is the DB connection of the calling thread.
+ */
+typedef int (*scrub_fetch_t) (lmgr_t *p_mgr, wagon_t *id_list,
+                              attr_set_t *attr_list,
+                              unsigned int entry_count, void *arg,
+                              void **p_data);
+
+/** For ordered scans: the caller's function to output scanned entries and
+ * the data fetched for them (to be released by this function).
+ * It is called one at a time.
+ */
+typedef int (*scrub_output_t) (wagon_t *id_list, attr_set_t *attr_list,
+                               unsigned int entry_count, void *data,
+                               void *arg);
+
+/** same as rbh_scrub_parallel(), but entries are output in the same order as
+ *  rbh_scrub(). Directories are listed and their data is fetched in parallel,
+ *  only the output is serialized.
+ */
+int rbh_scrub_ordered(lmgr_t *p_mgr, const wagon_t *id_list,
+                      unsigned int id_count, attr_mask_t dir_attr_mask,
+                      unsigned int nb_threads, scrub_fetch_t fetch_func,
+                      scrub_output_t out_func, void *arg);
+
 int Path2Id(const char *path, entry_id_t *id);
 
 /** Free the content of a wagon list. */
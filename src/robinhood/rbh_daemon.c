@@ -506,6 +506,8 @@ static void dump_stats(lmgr_t *lmgr, const int *module_mask,
         EntryProcessor_DumpCurrentStages();
     }
 
+    ListMgr_DumpPathCacheStats();
+
     if (*module_mask & MODULE_MASK_POLICY_RUN
         && *p_policy_mask != 0LL && policy_run_cpt != 0 && policy_run != NULL) {
         int i;
@@ -1767,12 +1769,18 @@ int main(int argc, char **argv)
      */
 
     if (!terminate_sig && action_mask & ACTION_MASK_SCAN) {
+        run_flags_t scan_flags = options.flags;
+
+        /* changelog records could refer to entries that the initial scan
+         * has not loaded yet */
+        if (action_mask & ACTION_MASK_HANDLE_EVENTS)
+            scan_flags |= RUNFLG_NO_BULK_LOAD;
 
         /* Start FS scan */
         if (options.partial_scan)
-            rc = FSScan_Start(options.flags, options.partial_scan_path);
+            rc = FSScan_Start(scan_flags, options.partial_scan_path);
         else
-            rc = FSScan_Start(options.flags, NULL);
+            rc = FSScan_Start(scan_flags, NULL);
 
         if (rc) {
             DisplayLog(LVL_CRIT, MAIN_TAG,
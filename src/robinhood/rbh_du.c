@@ -53,6 +53,9 @@ static struct option option_tab[] = {
     {"human-readable", no_argument, NULL, 'H'},
     {"details", no_argument, NULL, 'd'},
 
+    /* behavior options */
+    {"threads", required_argument, NULL, 'T'},
+
     /* config file options */
     {"config-file", required_argument, NULL, 'f'},
 
@@ -67,7 +70,7 @@ static struct option option_tab[] = {
 
 };
 
-#define SHORT_OPT_STRING    "u:g:t:S:scbkmHdf:l:hV"
+#define SHORT_OPT_STRING    "u:g:t:S:scbkmHdT:f:l:hV"
 #define TYPE_HELP "'f' (file), 'd' (dir), 'l' (symlink), 'b' (block), "\
                   "'c' (char), 'p' (named pipe/FIFO), 's' (socket)"
 
@@ -99,6 +102,7 @@ struct du_opt {
     display_mode disp_what;
     display_unit disp_how;
     unsigned int sum:1;
+    unsigned int threads; /**< number of scrub threads */
 
 } prog_options = {
     .disp_what = disp_usage, .disp_how = disp_kilo
@@ -106,8 +110,6 @@ struct du_opt {
 
 /** filter on entries to be summed */
 static lmgr_filter_t    entry_filter;
-/** same as entry_filter + condition on parent id */
-static lmgr_filter_t    parent_filter;
 
 /* filter for root entries */
 static bool_node_t      match_expr;
@@ -291,7 +293,6 @@ static int mkfilters(void)
 
     /* create DB filters */
     lmgr_simple_filter_init(&entry_filter);
-    lmgr_simple_filter_init(&parent_filter);
 
     if (is_expr) {
         char expr[RBH_PATH_MAX];
@@ -303,8 +304,6 @@ static int mkfilters(void)
         /* Do not use 'OR' expression there */
         convert_boolexpr_to_simple_filter(&match_expr, &entry_filter,
                                           prog_options.smi, NULL, 0, BOOL_AND);
-        convert_boolexpr_to_simple_filter(&match_expr, &parent_filter,
-                                          prog_options.smi, NULL, 0, BOOL_AND);
     }
 
     return 0;
@@ -337,6 +336,10 @@ static const char *help_string =
     "       show detailed stats: type, count, size, disk usage\n"
     "       (display in bytes by default)\n"
     "\n"
+    _B "Behavior:" B_ "\n"
+    "    " _B "-T" B_ " " _U "count" U_ ", " _B "--threads" B_ "=" _U "count" U_ "\n"
+    "       browse the namespace using the given number of threads\n"
+    "\n"
     _B "Program options:" B_ "\n"
     "    " _B "-f" B_ " " _U "config_file" U_ "\n"
     "    " _B "-l" B_ " " _U "log_level" U_ "\n"
@@ -450,16 +453,26 @@ static report_field_descr_t dir_info[REPCNT] = {
 };
 
 /* directory callback */
-static int dircb(wagon_t *id_list, attr_set_t *attr_list,
+/* protects stats against parallel scrub threads */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int dircb(lmgr_t *p_mgr, wagon_t *id_list, attr_set_t *attr_list,
                  unsigned int entry_count, void *arg)
 {
     /* sum child entries stats for all directories */
-    int i, rc;
+    int i, rc = 0;
     filter_value_t fv;
     struct lmgr_report_t *it;
     db_value_t result[REPCNT];
     unsigned int result_count;
     stats_du_t *stats = (stats_du_t *) arg;
+    /** same as entry_filter + condition on parent id */
+    lmgr_filter_t parent_filter;
+
+    lmgr_simple_filter_init(&parent_filter);
+    if (is_expr)
+        convert_boolexpr_to_simple_filter(&match_expr, &parent_filter,
+                                          prog_options.smi, NULL, 0, BOOL_AND);
 
     /* filter on parent_id */
 
@@ -469,28 +482,66 @@ static int dircb(wagon_t *id_list, attr_set_t *attr_list,
                                                ATTR_INDEX_parent_id,
                                                EQUAL, fv, 0);
         if (rc)
-            return rc;
+            goto out;
 
-        it = ListMgr_Report(&lmgr, dir_info, REPCNT, NULL, &parent_filter,
+        it = ListMgr_Report(p_mgr, dir_info, REPCNT, NULL, &parent_filter,
                             NULL);
-        if (it == NULL)
-            return -1;
+        if (it == NULL) {
+            rc = -1;
+            goto out;
+        }
 
         result_count = REPCNT;
         while ((rc =
                 ListMgr_GetNextReportItem(it, result, &result_count,
                                           NULL)) == DB_SUCCESS) {
             unsigned int idx = db2type(result[0].value_u.val_str);
+
+            P(stats_lock);
             stats[idx].count += result[1].value_u.val_biguint;
             stats[idx].blocks += result[2].value_u.val_biguint;
             stats[idx].size += result[3].value_u.val_biguint;
+            V(stats_lock);
 
             result_count = REPCNT;
         }
 
         ListMgr_CloseReport(it);
     }
+    rc = 0;
+
+ out:
+    lmgr_simple_filter_free(&parent_filter);
+    return rc;
+}
 
+/**
+ * Sum the usage of everything under a directory from the DIR_STAT table,
+ * instead of walking its subtree.
+ * @retval DB_NOT_SUPPORTED if the table can't be used.
+ */
+static int dirstat_sum(const entry_id_t *id, stats_du_t *stats)
+{
+    lmgr_dir_usage_t usage[TYPE_COUNT];
+    int i, rc;
+
+    /* DIR_STAT can only be filtered by type */
+    if (prog_options.match_user || prog_options.match_group
+        || prog_options.match_status)
+        return DB_NOT_SUPPORTED;
+
+    rc = ListMgr_GetDirStat(&lmgr, id, usage);
+    if (rc)
+        return rc;
+
+    for (i = 0; i < TYPE_COUNT; i++) {
+        if (prog_options.match_type && db2type(prog_options.type) != i)
+            continue;
+
+        stats[i].count += usage[i].count;
+        stats[i].blocks += usage[i].blocks;
+        stats[i].size += usage[i].size;
+    }
     return 0;
 }
 
@@ -567,9 +618,10 @@ static int list_content(char **id_list, int id_count)
 {
     wagon_t *ids;
     int i, rc;
+    int scrub_count = 0;
     attr_set_t root_attrs;
     entry_id_t root_id;
-    bool is_id;
+    bool is_id, by_dirstat;
     stats_du_t stats[TYPE_COUNT];
 
     if (prog_options.sum)
@@ -618,15 +670,23 @@ static int list_content(char **id_list, int id_count)
             rc = list_all(stats, !prog_options.sum);
             if (rc)
                 goto out;
+            ids[scrub_count++] = ids[i];
             continue;
         }
 
+        /* get the usage of the whole subtree at once, if it is maintained */
+        by_dirstat = (dirstat_sum(&ids[i].id, stats) == 0);
+        if (by_dirstat)
+            DisplayLog(LVL_DEBUG, DU_TAG, "Optimization: getting usage of %s"
+                       " from directory stats", id_list[i]);
+
         /* get root attrs to print it (if it matches program options) */
         root_attrs.attr_mask = attr_mask_or(&disp_mask, &query_mask);
         rc = ListMgr_Get(&lmgr, &ids[i].id, &root_attrs);
-        if (rc == 0)
-            dircb(&ids[i], &root_attrs, 1, stats);
-        else {
+        if (rc == 0) {
+            if (!by_dirstat)
+                dircb(&lmgr, &ids[i], &root_attrs, 1, stats);
+        } else {
             DisplayLog(LVL_VERB, DU_TAG, "Notice: no attrs in DB for %s",
                        id_list[i]);
 
@@ -655,7 +715,8 @@ static int list_content(char **id_list, int id_count)
                 }
             }
 
-            dircb(&ids[i], &root_attrs, 1, stats);
+            if (!by_dirstat)
+                dircb(&lmgr, &ids[i], &root_attrs, 1, stats);
         }
 
         /* sum root if it matches */
@@ -670,17 +731,23 @@ static int list_content(char **id_list, int id_count)
 
         if (!prog_options.sum) {
             /* if not group all, run and display stats now */
-            rc = rbh_scrub(&lmgr, &ids[i], 1, disp_mask, dircb, stats);
+            if (!by_dirstat)
+                rc = rbh_scrub_parallel(&lmgr, &ids[i], 1, disp_mask,
+                                        prog_options.threads, dircb, stats);
 
             if (rc)
                 goto out;
 
             print_stats(ids[i].fullname, stats);
-        }
+        } else if (!by_dirstat)
+            /* keep it in the list of directories to walk */
+            ids[scrub_count++] = ids[i];
     }
 
     if (prog_options.sum) {
-        rc = rbh_scrub(&lmgr, ids, id_count, disp_mask, dircb, stats);
+        if (scrub_count > 0)
+            rc = rbh_scrub_parallel(&lmgr, ids, scrub_count, disp_mask,
+                                    prog_options.threads, dircb, stats);
         if (rc)
             goto out;
         print_stats("total", stats);
@@ -742,6 +809,16 @@ int main(int argc, char **argv)
         case 'H':
             prog_options.disp_how = disp_human;
             break;
+        case 'T':
+            prog_options.threads = str2int(optarg);
+            if (prog_options.threads == (unsigned int)-1
+                || prog_options.threads == 0) {
+                fprintf(stderr,
+                        "invalid threads value '%s': positive integer "
+                        "expected\n", optarg);
+                exit(1);
+            }
+            break;
 
         case 'u':
             prog_options.match_user = 1;
@@ -46,6 +46,8 @@
 #define INAME_OPT   264
 #define PRINT0_OPT  265
 #define NLINK_OPT   266
+#define THREADS_OPT 267
+#define UNORDERED_OPT 268
 
 static struct option option_tab[] = {
     {"user", required_argument, NULL, 'u'},
@@ -85,6 +87,8 @@ static struct option option_tab[] = {
     /* query options */
     {"not", no_argument, NULL, '!'},
     {"nobulk", no_argument, NULL, 'b'},
+    {"threads", required_argument, NULL, THREADS_OPT},
+    {"unordered", no_argument, NULL, UNORDERED_OPT},
 
     /* config file options */
     {"config-file", required_argument, NULL, 'f'},
@@ -518,7 +522,14 @@ static const char *help_string =
     "       to bulk DB request instead of browsing the namespace from the DB.\n"
     "       This speeds up the query, but this may result in an arbitrary output ordering,\n"
     "       and a single path may be displayed in case of multiple hardlinks.\n"
-    "       Use -nobulk to disable this optimization.\n" "\n" _B
+    "       Use -nobulk to disable this optimization.\n"
+    "    " _B "-threads" B_ " " _U "count" U_ "\n"
+    "       Browse the namespace using the given number of threads, each one with\n"
+    "       its own DB connection.\n"
+    "    " _B "-unordered" B_ "\n"
+    "       With -threads, display entries as soon as they are retrieved, in an arbitrary\n"
+    "       order. This is faster than keeping the same order as a single thread.\n"
+    "\n" _B
     "Program options:" B_ "\n" "    " _B "-f" B_ " " _U "config_file" U_ "\n"
     "    " _B "-d" B_ " " _U "log_level" U_ "\n"
     "       CRIT, MAJOR, EVENT, VERB, DEBUG, FULL\n" "    " _B "-h" B_ ", " _B
@@ -1002,18 +1013,40 @@ static void print_entry(const wagon_t *id, const attr_set_t *attrs)
         g_string_free(osts, TRUE);
 }
 
-/* directory callback */
-static int dircb(wagon_t *id_list, attr_set_t *attr_list,
-                 unsigned int entry_count, void *dummy)
+/* serializes the output of parallel scrub threads */
+static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void print_entry_locked(const wagon_t *id, const attr_set_t *attrs)
 {
-    /* retrieve child entries for all directories */
-    int i, rc;
+    P(print_lock);
+    print_entry(id, attrs);
+    V(print_lock);
+}
+
+/** entries of a directory to be displayed */
+typedef struct dir_entries {
+    bool         print_dir;
+    wagon_t     *chids;
+    attr_set_t  *chattrs;
+    bool        *chmatch;
+    unsigned int chcount;
+} dir_entries_t;
+
+/* retrieve and match child entries of a set of directories
+ * (DB requests are done here, in parallel for ordered output) */
+static int dir_fetch(lmgr_t *p_mgr, wagon_t *id_list, attr_set_t *attr_list,
+                     unsigned int entry_count, void *dummy, void **p_data)
+{
+    dir_entries_t *dirs;
+    int i, j, rc;
+
+    dirs = MemCalloc(entry_count, sizeof(*dirs));
+    *p_data = dirs;
+    if (!dirs)
+        return -ENOMEM;
 
     for (i = 0; i < entry_count; i++) {
-        wagon_t *chids = NULL;
-        attr_set_t *chattrs = NULL;
-        unsigned int chcount = 0;
-        int j;
+        dir_entries_t *d = &dirs[i];
 
         /* match condition on dirs parent */
         if (!is_expr || (entry_matches(&id_list[i].id, &attr_list[i],
@@ -1021,39 +1054,83 @@ static int dircb(wagon_t *id_list, attr_set_t *attr_list,
                                        prog_options.filter_smi)
                          == POLICY_MATCH)) {
             /* don't display dirs if no_dir is specified */
-            if (!(prog_options.no_dir && ATTR_MASK_TEST(&attr_list[i], type)
-                  && !strcasecmp(ATTR(&attr_list[i], type), STR_TYPE_DIR)))
-                print_entry(&id_list[i], &attr_list[i]);
+            d->print_dir = !(prog_options.no_dir
+                             && ATTR_MASK_TEST(&attr_list[i], type)
+                             && !strcasecmp(ATTR(&attr_list[i], type),
+                                            STR_TYPE_DIR));
         }
 
-        if (!prog_options.dir_only) {
-            rc = ListMgr_GetChild(&lmgr, &entry_filter, id_list + i, 1,
-                                  attr_mask_or(&disp_mask, &query_mask),
-                                  &chids, &chattrs, &chcount);
-            if (rc) {
-                DisplayLog(LVL_MAJOR, FIND_TAG,
-                           "ListMgr_GetChild() failed with error %d", rc);
-                return rc;
-            }
+        if (prog_options.dir_only)
+            continue;
 
-            for (j = 0; j < chcount; j++) {
-                if (!is_expr || (entry_matches(&chids[j].id, &chattrs[j],
-                                               &match_expr, NULL,
-                                               prog_options.filter_smi)
-                                 == POLICY_MATCH))
-                    print_entry(&chids[j], &chattrs[j]);
+        rc = ListMgr_GetChild(p_mgr, &entry_filter, id_list + i, 1,
+                              attr_mask_or(&disp_mask, &query_mask),
+                              &d->chids, &d->chattrs, &d->chcount);
+        if (rc) {
+            DisplayLog(LVL_MAJOR, FIND_TAG,
+                       "ListMgr_GetChild() failed with error %d", rc);
+            return rc;
+        }
 
-                ListMgr_FreeAttrs(&chattrs[j]);
-            }
+        d->chmatch = MemCalloc(d->chcount, sizeof(bool));
+        if (d->chcount > 0 && !d->chmatch)
+            return -ENOMEM;
+
+        for (j = 0; j < d->chcount; j++)
+            d->chmatch[j] = !is_expr
+                || (entry_matches(&d->chids[j].id, &d->chattrs[j],
+                                  &match_expr, NULL, prog_options.filter_smi)
+                    == POLICY_MATCH);
+    }
+    return 0;
+}
+
+/* display the entries retrieved by dir_fetch() and release them */
+static int dir_output(wagon_t *id_list, attr_set_t *attr_list,
+                      unsigned int entry_count, void *data, void *dummy)
+{
+    dir_entries_t *dirs = data;
+    int i, j;
+
+    if (!dirs)
+        return 0;
 
-            free_wagon(chids, 0, chcount);
-            MemFree(chids);
-            MemFree(chattrs);
+    for (i = 0; i < entry_count; i++) {
+        dir_entries_t *d = &dirs[i];
+
+        if (d->print_dir)
+            print_entry_locked(&id_list[i], &attr_list[i]);
+
+        for (j = 0; j < d->chcount; j++) {
+            if (d->chmatch != NULL && d->chmatch[j])
+                print_entry_locked(&d->chids[j], &d->chattrs[j]);
+            ListMgr_FreeAttrs(&d->chattrs[j]);
         }
+
+        free_wagon(d->chids, 0, d->chcount);
+        if (d->chids)
+            MemFree(d->chids);
+        if (d->chattrs)
+            MemFree(d->chattrs);
+        if (d->chmatch)
+            MemFree(d->chmatch);
     }
+    MemFree(dirs);
     return 0;
 }
 
+/* directory callback */
+static int dircb(lmgr_t *p_mgr, wagon_t *id_list, attr_set_t *attr_list,
+                 unsigned int entry_count, void *dummy)
+{
+    void *data = NULL;
+    int rc;
+
+    rc = dir_fetch(p_mgr, id_list, attr_list, entry_count, dummy, &data);
+    dir_output(id_list, attr_list, entry_count, data, dummy);
+    return rc;
+}
+
 /**
  *  Get id of root dir
  */
@@ -1086,6 +1163,7 @@ static int list_bulk(void)
     int rc;
     struct stat st;
     struct lmgr_iterator_t *it;
+    lmgr_iter_opt_t opt = LMGR_ITER_OPT_INIT;
 
     /* no transversal => no wagon
      * so we need the path from the DB.
@@ -1125,8 +1203,9 @@ static int list_bulk(void)
         }
     }
 
-    /* list all, including dirs */
-    it = ListMgr_Iterator(&lmgr, &entry_filter, NULL, NULL);
+    /* list all, including dirs (stream the result, as it can be huge) */
+    opt.stream = 1;
+    it = ListMgr_Iterator(&lmgr, &entry_filter, NULL, &opt);
     if (!it) {
         DisplayLog(LVL_MAJOR, FIND_TAG,
                    "ERROR: cannot retrieve entry list from database");
@@ -1230,7 +1309,7 @@ static int list_contents(char **id_list, int id_count)
         root_attrs.attr_mask = attr_mask_or(&disp_mask, &query_mask);
         rc = ListMgr_Get(&lmgr, &ids[i].id, &root_attrs);
         if (rc == 0)
-            dircb(&ids[i], &root_attrs, 1, NULL);
+            dircb(&lmgr, &ids[i], &root_attrs, 1, NULL);
         else {
             DisplayLog(LVL_VERB, FIND_TAG, "Notice: no attrs in DB for %s",
                        id_list[i]);
@@ -1269,11 +1348,18 @@ static int list_contents(char **id_list, int id_count)
                 ATTR(&root_attrs, name)[0] = '\0';
             }
 
-            dircb(&ids[i], &root_attrs, 1, NULL);
+            dircb(&lmgr, &ids[i], &root_attrs, 1, NULL);
         }
 
-        rc = rbh_scrub(&lmgr, &ids[i], 1, attr_mask_or(&disp_mask, &query_mask),
-                       dircb, NULL);
+        if (prog_options.unordered)
+            rc = rbh_scrub_parallel(&lmgr, &ids[i], 1,
+                                    attr_mask_or(&disp_mask, &query_mask),
+                                    prog_options.threads, dircb, NULL);
+        else
+            rc = rbh_scrub_ordered(&lmgr, &ids[i], 1,
+                                   attr_mask_or(&disp_mask, &query_mask),
+                                   prog_options.threads, dir_fetch,
+                                   dir_output, NULL);
     }
 
  out:
@@ -1602,6 +1688,21 @@ int main(int argc, char **argv)
             prog_options.bulk = force_nobulk;
             break;
 
+        case THREADS_OPT:
+            prog_options.threads = str2int(optarg);
+            if (prog_options.threads == (unsigned int)-1
+                || prog_options.threads == 0) {
+                fprintf(stderr,
+                        "invalid threads value '%s': positive integer "
+                        "expected\n", optarg);
+                exit(1);
+            }
+            break;
+
+        case UNORDERED_OPT:
+            prog_options.unordered = 1;
+            break;
+
         case 'h':
             display_help(bin);
             exit(0);
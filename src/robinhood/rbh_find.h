@@ -65,6 +65,7 @@ struct find_opt {
         force_bulk,
         force_nobulk
     } bulk;
+    unsigned int    threads; /* number of scrub threads */
 
     /* output flags */
     unsigned int ls:1;
@@ -106,6 +107,7 @@ struct find_opt {
     /* behavior flags */
     unsigned int no_dir:1;   /* if -t != dir => no dir to be displayed */
     unsigned int dir_only:1; /* if -t dir => only display dir */
+    unsigned int unordered:1; /* don't keep output order with threads */
 
     /* actions */
     unsigned int exec:1;
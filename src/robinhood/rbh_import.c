@@ -21,6 +21,7 @@
 #endif
 
 #include "list_mgr.h"
+#include "status_manager.h"
 #include "rbh_cfg.h"
 #include "rbh_logs.h"
 #include "rbh_misc.h"
@@ -161,6 +162,8 @@ static int import_helper(const char *backend_path, char *tgt_path,  /* in/out */
     entry_id_t old_id, new_id;
     recov_status_t st;
     attr_set_t attrs, new_attrs, src_attrs;
+    attr_set_t old_attrs = ATTR_SET_INIT;
+    const attr_set_t *p_old = NULL;
     int rc;
 
     /* to check src path */
@@ -236,12 +239,22 @@ static int import_helper(const char *backend_path, char *tgt_path,  /* in/out */
         /* don't insert readonly attrs */
         new_attrs.attr_mask &= ~readonly_attr_set;
 
+        /* accounting of the entry, if it is already in the db */
+        if (lmgr_acct_batched()) {
+            old_attrs.attr_mask.std = ACCT_ATTR_MASK;
+            old_attrs.attr_mask.status = all_status_mask();
+            if (ListMgr_Get(&lmgr, &new_id, &old_attrs) == DB_SUCCESS)
+                p_old = &old_attrs;
+        }
+
         /* insert or update it in the db */
         rc = ListMgr_Insert(&lmgr, &new_id, &new_attrs, true);
-        if (rc == 0)
+        if (rc == 0) {
+            ListMgr_AcctUpdate(&lmgr, p_old, &new_attrs);
             printf("\tEntry successfully updated in the dabatase\n");
-        else
+        } else
             fprintf(stderr, "ERROR %d inserting entry in the database\n", rc);
+        ListMgr_FreeAttrs(&old_attrs);
         return rc;
     } else {
         fprintf(stderr, "ERROR importing '%s' as '%s'\n", backend_path,
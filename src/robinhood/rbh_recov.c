@@ -415,7 +415,8 @@ static int recov_resume(int retry_errors)
                 fprintf(stderr, "DB insert failure for '%s'\n",
                         ATTR(&new_attrs, fullpath));
                 st = RS_ERROR;
-            }
+            } else
+                ListMgr_AcctUpdate(&lmgr, NULL, &new_attrs);
         }
 
         /* old id must be used for impacting recovery table */
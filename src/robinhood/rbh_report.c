@@ -67,6 +67,9 @@
 #define OPT_SIZE_PROFILE  330
 #define OPT_BY_SZ_RATIO   331
 
+#define OPT_INDEX_PROFILE 340
+#define OPT_INDEX_ADVICE  341
+
 /* options flags */
 #define OPT_FLAG_CSV        0x0001
 #define OPT_FLAG_NOHEADER   0x0002
@@ -168,6 +171,10 @@ static struct option option_tab[] = {
     {"next-maintenance", optional_argument, NULL, SET_NEXT_MAINT},
     {"cancel-maintenance", no_argument, NULL, CLEAR_NEXT_MAINT},
 
+    /* index management */
+    {"index-profile", optional_argument, NULL, OPT_INDEX_PROFILE},
+    {"index-advice", no_argument, NULL, OPT_INDEX_ADVICE},
+
     /* config file options */
     {"config-file", required_argument, NULL, 'f'},
 
@@ -248,6 +255,19 @@ static const char *maintenance_help =
     "    " _B "--cancel-maintenance" B_ "\n"
     "        Cancel the next scheduled maintenance.\n";
 
+static const char *index_help =
+    _B "Database index management:" B_ "\n"
+    "    " _B "--index-profile[=" B_ _U "profile" U_ "]\n"
+    "        Set/display the set of secondary indexes maintained in the database.\n"
+    "        Indexes are built or dropped immediately.\n"
+    "        " _U "profile" U_ " can be:\n"
+    "           minimal: fastest ingest (scans, changelogs), slower reports.\n"
+    "           full: default indexes + indexes advised by --index-advice.\n"
+    "           advised: only indexes advised by --index-advice.\n"
+    "    " _B "--index-advice" B_ "\n"
+    "        Display the number of filter conditions on each field in reports\n"
+    "        and policies, and the resulting index advice.\n";
+
 static const char *filter_help =
     _B "Filter options:" B_ "\n"
     "    The following filters can be specified for reports:\n"
@@ -321,6 +341,7 @@ static inline void display_help(const char *bin_name)
     printf("\n");
     printf("%s\n", stats_help);
     printf("%s\n", maintenance_help);
+    printf("%s\n", index_help);
     printf("%s\n", filter_help);
     printf("%s\n", acct_help);
     printf("%s\n", cfg_help);
@@ -1310,6 +1331,7 @@ static void dump_entries(type_dump type, int int_arg, char *str_arg,
     lmgr_filter_t filter;
     filter_value_t fv;
     struct lmgr_iterator_t *it;
+    lmgr_iter_opt_t opt = LMGR_ITER_OPT_INIT;
     attr_set_t attrs;
     entry_id_t id;
     int custom_len = 0;
@@ -1435,7 +1457,9 @@ static void dump_entries(type_dump type, int int_arg, char *str_arg,
     ATTR_MASK_INIT(&attrs);
     mask_sav = attrs.attr_mask = list2mask(list, list_cnt);
 
-    it = ListMgr_Iterator(&lmgr, &filter, NULL, NULL);
+    /* stream the result, as it can be huge */
+    opt.stream = 1;
+    it = ListMgr_Iterator(&lmgr, &filter, NULL, &opt);
 
     lmgr_simple_filter_free(&filter);
 
@@ -1545,7 +1569,7 @@ static void report_fs_info(int flags)
         {ATTR_INDEX_size, REPORT_MAX, SORT_NONE, false, 0, FV_NULL},
         {ATTR_INDEX_size, REPORT_AVG, SORT_NONE, false, 0, FV_NULL},
     };
-    lmgr_iter_opt_t opt;
+    lmgr_iter_opt_t opt = LMGR_ITER_OPT_INIT;
     profile_u prof;
     bool display_header = !NOHEADER(flags);
 
@@ -1711,7 +1735,7 @@ static void report_usergroup_info(char *name, int flags)
     bool is_filter = false;
     bool display_header = !NOHEADER(flags);
     unsigned long long total_size, total_used, total_count;
-    lmgr_iter_opt_t opt;
+    lmgr_iter_opt_t opt = LMGR_ITER_OPT_INIT;
 #define USERINFOCOUNT_MAX 10
     db_value_t result[USERINFOCOUNT_MAX];
     profile_u prof;
@@ -1887,7 +1911,7 @@ static void report_topdirs(unsigned int count, int flags)
     lmgr_sort_type_t sorttype;
     lmgr_filter_t filter;
     filter_value_t fv;
-    lmgr_iter_opt_t opt;
+    lmgr_iter_opt_t opt = LMGR_ITER_OPT_INIT;
     struct lmgr_iterator_t *it;
     attr_set_t attrs;
     entry_id_t id;
@@ -1983,7 +2007,7 @@ static void report_topsize(unsigned int count, int flags)
     lmgr_sort_type_t sorttype;
     lmgr_filter_t filter;
     filter_value_t fv;
-    lmgr_iter_opt_t opt;
+    lmgr_iter_opt_t opt = LMGR_ITER_OPT_INIT;
     struct lmgr_iterator_t *it;
     attr_set_t attrs;
     entry_id_t id;
@@ -2057,7 +2081,7 @@ static void report_oldest(obj_type_t type, unsigned int count, int flags)
     lmgr_sort_type_t sorttype;
     lmgr_filter_t filter;
     filter_value_t fv;
-    lmgr_iter_opt_t opt;
+    lmgr_iter_opt_t opt = LMGR_ITER_OPT_INIT;
     struct lmgr_iterator_t *it;
     attr_set_t attrs;
     entry_id_t id;
@@ -2162,7 +2186,7 @@ static void report_topuser(unsigned int count, int flags)
 {
     unsigned int result_count;
     struct lmgr_report_t *it;
-    lmgr_iter_opt_t opt;
+    lmgr_iter_opt_t opt = LMGR_ITER_OPT_INIT;
     int rc;
     unsigned int rank = 1;
     lmgr_filter_t filter;
@@ -2260,6 +2284,7 @@ static void report_deferred_rm(int flags)
 {
     int rc;
     struct lmgr_rm_list_t *rmlist;
+    lmgr_iter_opt_t opt = LMGR_ITER_OPT_INIT;
     entry_id_t id;
     attr_set_t attrs = ATTR_SET_INIT;
 
@@ -2295,7 +2320,8 @@ static void report_deferred_rm(int flags)
     sort.attr_index = ATTR_INDEX_rm_time;
     sort.order = REVERSE(flags) ? SORT_DESC : SORT_ASC;
 
-    rmlist = ListMgr_RmList(&lmgr, is_filter ? &filter : NULL, &sort);
+    opt.stream = 1;
+    rmlist = ListMgr_RmList(&lmgr, is_filter ? &filter : NULL, &sort, &opt);
 
     lmgr_simple_filter_free(&filter);
 
@@ -2426,7 +2452,7 @@ static void report_status_info(int smi_index, const char *val, int flags)
 
     struct lmgr_report_t *it;
     lmgr_filter_t filter;
-    lmgr_iter_opt_t opt;
+    lmgr_iter_opt_t opt = LMGR_ITER_OPT_INIT;
     int rc;
     bool header;
     unsigned int result_count;
@@ -2597,6 +2623,86 @@ static void maintenance_set(int flags, time_t when)
     }
 }
 
+static void index_profile_get(int flags)
+{
+    index_profile_e profile;
+    int rc;
+
+    rc = ListMgr_GetIndexProfile(&lmgr, &profile);
+    if (rc) {
+        DisplayLog(LVL_CRIT, REPORT_TAG,
+                   "ERROR retrieving index profile from database");
+        return;
+    }
+
+    if (CSV(flags))
+        printf("index_profile, %s\n", index_profile2str(profile));
+    else
+        printf("Index profile: %s\n", index_profile2str(profile));
+}
+
+static void index_profile_set(index_profile_e profile)
+{
+    int rc;
+
+    rc = ListMgr_SetIndexProfile(&lmgr, profile);
+    if (rc == DB_SUCCESS)
+        DisplayLog(LVL_EVENT, REPORT_TAG,
+                   "Index profile has been set successfully");
+    else
+        DisplayLog(LVL_CRIT, REPORT_TAG,
+                   "ERROR setting index profile '%s': %s",
+                   index_profile2str(profile), lmgr_err2str(rc));
+}
+
+static void report_index_advice(int flags)
+{
+    index_advice_t *advice;
+    unsigned int i, count;
+    int rc;
+
+    rc = ListMgr_IndexAdvice(&lmgr, &advice, &count);
+    if (rc) {
+        DisplayLog(LVL_CRIT, REPORT_TAG,
+                   "ERROR retrieving index advice from database: %s",
+                   lmgr_err2str(rc));
+        return;
+    }
+
+    if (!NOHEADER(flags)) {
+        if (CSV(flags))
+            printf("%12s, %20s, %10s, %7s, %6s\n", "table", "field", "uses",
+                   "indexed", "advice");
+        else
+            printf("%-12s  %-20s  %10s  %-7s  %s\n", "table", "field",
+                   "uses", "indexed", "advice");
+    }
+
+    for (i = 0; i < count; i++) {
+        const char *str_advice;
+
+        if (advice[i].advised)
+            str_advice = advice[i].indexed ? "keep" : "create";
+        else
+            str_advice = advice[i].indexed ? "drop" : "-";
+
+        if (CSV(flags))
+            printf("%12s, %20s, %10llu, %7s, %6s\n", advice[i].table,
+                   advice[i].field, advice[i].uses,
+                   bool2str(advice[i].indexed), str_advice);
+        else
+            printf("%-12s  %-20s  %10llu  %-7s  %s\n", advice[i].table,
+                   advice[i].field, advice[i].uses,
+                   bool2str(advice[i].indexed), str_advice);
+    }
+
+    if (!NOHEADER(flags) && !CSV(flags))
+        printf("\n'drop' is only applied by the 'advised' profile: "
+               "default indexes are kept by the 'full' profile.\n");
+
+    MemFree(advice);
+}
+
 #define MAX_OPT_LEN 1024
 
 /**
@@ -2650,6 +2756,10 @@ int main(int argc, char **argv)
     bool get_next_maint = false;
     bool cancel_next_maint = false;
 
+    int set_index_profile = -1;
+    bool get_index_profile = false;
+    bool index_advice = false;
+
     int flags = 0;
     int rc;
     char err_msg[4096];
@@ -2883,6 +2993,22 @@ int main(int argc, char **argv)
             get_next_maint = true;
             break;
 
+        case OPT_INDEX_PROFILE:
+            if (optarg) {   /* optional argument */
+                set_index_profile = str2index_profile(optarg);
+                if (set_index_profile == -1) {
+                    fprintf(stderr, "Invalid index profile '%s': minimal, "
+                            "full or advised expected\n", optarg);
+                    exit(1);
+                }
+            }
+            /* in all cases, display the current profile */
+            get_index_profile = true;
+            break;
+        case OPT_INDEX_ADVICE:
+            index_advice = true;
+            break;
+
         case 'f':
             rh_strncpy(config_file, optarg, MAX_OPT_LEN);
             break;
@@ -2973,7 +3099,8 @@ int main(int argc, char **argv)
 #ifdef _LUSTRE
         && !dump_ost
 #endif
-        && !next_maint && !get_next_maint && !cancel_next_maint) {
+        && !next_maint && !get_next_maint && !cancel_next_maint
+        && !get_index_profile && !index_advice) {
         display_help(bin);
         exit(1);
     }
@@ -3124,6 +3251,15 @@ int main(int argc, char **argv)
     if (get_next_maint)
         maintenance_get(flags);
 
+    if (index_advice)
+        report_index_advice(flags);
+
+    if (set_index_profile != -1)
+        index_profile_set(set_index_profile);
+
+    if (get_index_profile)
+        index_profile_get(flags);
+
     ListMgr_CloseAccess(&lmgr);
 
     return 0;   /* for compiler */
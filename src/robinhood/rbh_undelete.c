@@ -267,6 +267,7 @@ static int list_rm(void)
     } else {    /* list of entries */
 
         struct lmgr_rm_list_t *rm_list;
+        lmgr_iter_opt_t opt = LMGR_ITER_OPT_INIT;
         lmgr_filter_t filter = { 0 };
         bool filter_init = false;
 
@@ -274,7 +275,9 @@ static int list_rm(void)
         mk_path_filter(&filter, false, &filter_init);
 
         /* list all deferred rm */
-        rm_list = ListMgr_RmList(&lmgr, filter_init ? &filter : NULL, NULL);
+        opt.stream = 1;
+        rm_list = ListMgr_RmList(&lmgr, filter_init ? &filter : NULL, NULL,
+                                 &opt);
 
         if (filter_init)
             lmgr_simple_filter_free(&filter);
@@ -322,6 +325,8 @@ static void undelete_helper(const entry_id_t *id, const attr_set_t *attrs)
     entry_id_t new_id = { 0 };
     recov_status_t st;
     attr_set_t new_attrs = ATTR_SET_INIT;
+    attr_set_t old_attrs = ATTR_SET_INIT;
+    const attr_set_t *p_old = NULL;
     int rc;
 
     printf("Restoring '%s'...", ATTR(attrs, fullpath));
@@ -369,14 +374,24 @@ static void undelete_helper(const entry_id_t *id, const attr_set_t *attrs)
         /* clean read-only attrs */
         attr_mask_unset_readonly(&new_attrs.attr_mask);
 
+        /* accounting of the entry, if it is already in the db */
+        if (lmgr_acct_batched()) {
+            old_attrs.attr_mask.std = ACCT_ATTR_MASK;
+            old_attrs.attr_mask.status = all_status_mask();
+            if (ListMgr_Get(&lmgr, &new_id, &old_attrs) == DB_SUCCESS)
+                p_old = &old_attrs;
+        }
+
         /* insert or update it in the db */
         rc = ListMgr_Insert(&lmgr, &new_id, &new_attrs, true);
-        if (rc == 0)
+        if (rc == 0) {
+            ListMgr_AcctUpdate(&lmgr, p_old, &new_attrs);
             printf("\tEntry successfully updated in the dabatase\n");
-        else {
+        } else {
             db_err++;
             fprintf(stderr, "\tERROR %d inserting entry in the database\n", rc);
         }
+        ListMgr_FreeAttrs(&old_attrs);
     }
 }
 
@@ -384,6 +399,7 @@ static int undelete(void)
 {
     int rc;
     struct lmgr_rm_list_t *list;
+    lmgr_iter_opt_t opt = LMGR_ITER_OPT_INIT;
     entry_id_t id;
     attr_set_t attrs = ATTR_SET_INIT;
     attr_mask_t mask;
@@ -417,7 +433,9 @@ static int undelete(void)
         mk_path_filter(&filter, false, &filter_init);
 
         /* list files to be recovered */
-        list = ListMgr_RmList(&lmgr, filter_init ? &filter : NULL, NULL);
+        opt.stream = 1;
+        list = ListMgr_RmList(&lmgr, filter_init ? &filter : NULL, NULL,
+                              &opt);
 
         if (filter_init)
             lmgr_simple_filter_free(&filter);
@@ -0,0 +1,307 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * vim:expandtab:shiftwidth=4:tabstop=4:
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the CeCILL License.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL license (http://www.cecill.info) and that you
+ * accept its terms.
+ */
+
+/**
+ * Measure the classification rate of synthetic entries against the
+ * fileclasses and policy scopes of a configuration file, using compiled
+ * boolean expressions and the expression interpreter.
+ */
+
+#define TAG "bench_matching"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "list_mgr.h"
+#include "policy_rules.h"
+#include "global_config.h"
+#include "rbh_cfg.h"
+#include "rbh_logs.h"
+#include "rbh_misc.h"
+#include "rbh_basename.h"
+#include "../robinhood/cmd_helpers.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define OPT_STRING    "f:n:r:s:h"
+#define MAX_OPT_LEN   1024
+
+static const char *help_string =
+    _B "Usage:" B_ " %s [options]\n"
+    "\n"
+    "Match synthetic entries against fileclasses and policy scopes,\n"
+    "with compiled expressions and with the expression interpreter.\n"
+    "\n"
+    _B "Options:" B_ "\n"
+    "    " _B "-f" B_ " " _U "cfg_file" U_ "\n"
+    "        Configuration file to load fileclasses and policies from.\n"
+    "    " _B "-n" B_ " " _U "count" U_ "\n"
+    "        Number of entries to generate (default: 100000).\n"
+    "    " _B "-r" B_ " " _U "rounds" U_ "\n"
+    "        Number of matching rounds for each mode (default: 3).\n"
+    "    " _B "-s" B_ " " _U "seed" U_ "\n"
+    "        Random seed (default: 1).\n";
+
+static inline void display_help(const char *bin_name)
+{
+    printf(help_string, bin_name);
+}
+
+static const char *const exts[] = {
+    "", ".txt", ".log", ".dat", ".h5", ".tar", ".gz", ".o", ".core", ".tmp"
+};
+#define EXT_COUNT (sizeof(exts) / sizeof(*exts))
+
+static const char *const users[] = { "root", "foo", "bar", "charlie" };
+#define USER_COUNT (sizeof(users) / sizeof(*users))
+
+/** generate random POSIX attributes for an entry */
+static void gen_entry(entry_id_t *id, attr_set_t *attrs, unsigned int i,
+                      time_t now)
+{
+    unsigned int user = random() % USER_COUNT;
+    bool dir = (random() % 10 == 0);
+
+    memset(id, 0, sizeof(*id));
+#ifdef FID_PK
+    id->f_seq = 0x200000400ULL;
+    id->f_oid = i + 1;
+#else
+    id->inode = i + 1;
+#endif
+
+    memset(attrs, 0, sizeof(*attrs));
+    snprintf(ATTR(attrs, name), sizeof(ATTR(attrs, name)), "%s%u%s",
+             dir ? "dir" : "file", i, dir ? "" : exts[random() % EXT_COUNT]);
+    ATTR_MASK_SET(attrs, name);
+
+    ATTR(attrs, depth) = 1 + random() % 4;
+    ATTR_MASK_SET(attrs, depth);
+    switch (ATTR(attrs, depth)) {
+    case 1:
+        snprintf(ATTR(attrs, fullpath), RBH_PATH_MAX, "%s/%s",
+                 global_config.fs_path, ATTR(attrs, name));
+        break;
+    case 2:
+        snprintf(ATTR(attrs, fullpath), RBH_PATH_MAX, "%s/%s/%s",
+                 global_config.fs_path, users[user], ATTR(attrs, name));
+        break;
+    default:
+        snprintf(ATTR(attrs, fullpath), RBH_PATH_MAX, "%s/%s/dir%lu/%s",
+                 global_config.fs_path, users[user], random() % 100,
+                 ATTR(attrs, name));
+        break;
+    }
+    ATTR_MASK_SET(attrs, fullpath);
+
+    strcpy(ATTR(attrs, type), dir ? STR_TYPE_DIR : STR_TYPE_FILE);
+    ATTR_MASK_SET(attrs, type);
+
+    if (global_config.uid_gid_as_numbers) {
+        ATTR(attrs, uid).num = user;
+        ATTR(attrs, gid).num = user;
+    } else {
+        strcpy(ATTR(attrs, uid).txt, users[user]);
+        strcpy(ATTR(attrs, gid).txt, users[user]);
+    }
+    ATTR_MASK_SET(attrs, uid);
+    ATTR_MASK_SET(attrs, gid);
+
+    /* log-uniform size, up to 1TB */
+    ATTR(attrs, size) = dir ? 4096 : (1ULL << (random() % 40)) +
+        random() % 1024;
+    ATTR(attrs, blocks) = (ATTR(attrs, size) + 511) / 512;
+    ATTR(attrs, nlink) = dir ? 2 : 1;
+    ATTR_MASK_SET(attrs, size);
+    ATTR_MASK_SET(attrs, blocks);
+    ATTR_MASK_SET(attrs, nlink);
+
+    /* up to 1 year old */
+    ATTR(attrs, creation_time) = now - random() % (365 * 86400);
+    ATTR(attrs, last_mod) = ATTR(attrs, creation_time)
+        + random() % (now - ATTR(attrs, creation_time) + 1);
+    ATTR(attrs, last_access) = ATTR(attrs, last_mod)
+        + random() % (now - ATTR(attrs, last_mod) + 1);
+    ATTR(attrs, last_mdchange) = ATTR(attrs, last_mod);
+    ATTR_MASK_SET(attrs, creation_time);
+    ATTR_MASK_SET(attrs, last_mod);
+    ATTR_MASK_SET(attrs, last_access);
+    ATTR_MASK_SET(attrs, last_mdchange);
+}
+
+static double elapsed(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec)
+        + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * Match all entries against fileclasses and policy scopes.
+ * @param classes  Resulting fileclasses, compared between modes.
+ * @return matching time in seconds.
+ */
+static double match_all(const entry_id_t *ids, const attr_set_t *attrs,
+                        unsigned long count, unsigned int rounds,
+                        attr_set_t *classes, unsigned long *in_scope)
+{
+    struct timespec start;
+    unsigned long i;
+    unsigned int r, p;
+
+    *in_scope = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < count; i++) {
+            memset(&classes[i], 0, sizeof(classes[i]));
+            match_classes(&ids[i], &classes[i], &attrs[i]);
+
+            for (p = 0; p < policies.policy_count; p++)
+                if (match_scope(&policies.policy_list[p], &ids[i], &attrs[i],
+                                false) == POLICY_MATCH)
+                    (*in_scope)++;
+        }
+    }
+    return elapsed(&start);
+}
+
+int main(int argc, char **argv)
+{
+    const char *bin = rh_basename(argv[0]);
+    char config_file[MAX_OPT_LEN] = "";
+    char err_msg[4096];
+    unsigned long count = 100000;
+    unsigned int rounds = 3;
+    unsigned int seed = 1;
+    bool chgd = false;
+    entry_id_t *ids;
+    attr_set_t *attrs, *classes_interp, *classes_comp;
+    unsigned long i, diff = 0, scope_interp, scope_comp;
+    double t_interp, t_comp;
+    time_t now;
+    int c, rc;
+
+    while ((c = getopt(argc, argv, OPT_STRING)) != -1) {
+        switch (c) {
+        case 'f':
+            rh_strncpy(config_file, optarg, MAX_OPT_LEN);
+            break;
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            rounds = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'h':
+            display_help(bin);
+            exit(0);
+        default:
+            display_help(bin);
+            exit(EINVAL);
+        }
+    }
+
+    if (optind != argc || count == 0 || rounds == 0) {
+        display_help(bin);
+        exit(EINVAL);
+    }
+
+    rc = rbh_init_internals();
+    if (rc != 0)
+        exit(rc);
+
+    if (SearchConfig(config_file, config_file, &chgd, err_msg,
+                     MAX_OPT_LEN) != 0) {
+        fprintf(stderr, "No config file (or too many) found matching %s\n",
+                err_msg);
+        exit(ENOENT);
+    } else if (chgd) {
+        fprintf(stderr, "Using config file '%s'.\n", config_file);
+    }
+
+    /* only read common config (fileclasses, policies...) */
+    if (rbh_cfg_load(0, config_file, err_msg)) {
+        fprintf(stderr, "Error reading configuration file '%s': %s\n",
+                config_file, err_msg);
+        exit(EINVAL);
+    }
+
+    if (!log_config.force_debug_level)
+        log_config.debug_level = LVL_MAJOR;
+    strcpy(log_config.log_file, "stderr");
+    strcpy(log_config.report_file, "stderr");
+    strcpy(log_config.alert_file, "stderr");
+
+    rc = InitializeLogs(bin);
+    if (rc) {
+        fprintf(stderr, "Error opening log files: rc=%d, errno=%d: %s\n",
+                rc, errno, strerror(errno));
+        exit(rc);
+    }
+
+    ids = calloc(count, sizeof(*ids));
+    attrs = calloc(count, sizeof(*attrs));
+    classes_interp = calloc(count, sizeof(*classes_interp));
+    classes_comp = calloc(count, sizeof(*classes_comp));
+    if (!ids || !attrs || !classes_interp || !classes_comp) {
+        fprintf(stderr, "Cannot allocate memory for %lu entries\n", count);
+        exit(ENOMEM);
+    }
+
+    srandom(seed);
+    now = time(NULL);
+    for (i = 0; i < count; i++)
+        gen_entry(&ids[i], &attrs[i], i, now);
+
+    printf("%lu entries, %u fileclasses, %u policies, %u rounds\n", count,
+           policies.fileset_count, policies.policy_count, rounds);
+
+    set_compiled_matching(false);
+    t_interp = match_all(ids, attrs, count, rounds, classes_interp,
+                         &scope_interp);
+
+    set_compiled_matching(true);
+    t_comp = match_all(ids, attrs, count, rounds, classes_comp, &scope_comp);
+
+    for (i = 0; i < count; i++)
+        if (strcmp(ATTR(&classes_interp[i], fileclass),
+                   ATTR(&classes_comp[i], fileclass)))
+            diff++;
+
+    printf("interpreted: %.3fs, %.0f entries/sec\n", t_interp,
+           count * rounds / t_interp);
+    printf("compiled:    %.3fs, %.0f entries/sec (x%.2f)\n", t_comp,
+           count * rounds / t_comp, t_interp / t_comp);
+
+    if (diff != 0 || scope_interp != scope_comp) {
+        fprintf(stderr, "ERROR: results differ (%lu fileclasses, "
+                "%lu/%lu scope matches)\n", diff, scope_interp, scope_comp);
+        rc = EFAULT;
+    }
+
+    free(ids);
+    free(attrs);
+    free(classes_interp);
+    free(classes_comp);
+    return rc;
+}
@@ -0,0 +1,369 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * vim:expandtab:shiftwidth=4:tabstop=4:
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the CeCILL License.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL license (http://www.cecill.info) and that you
+ * accept its terms.
+ */
+
+/**
+ * Apply a mix of create/unlink/rename/setattr operations in a directory
+ * of a Lustre filesystem, and write the matching changelog records to a
+ * file, to be replayed by the changelog reader (see 'source_file' in MDT
+ * blocks).
+ * Records refer to the real fids of the entries, so the replay goes
+ * through the whole pipeline (attributes, paths, database).
+ */
+
+#define TAG "gen_changelog"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "rbh_logs.h"
+#include "rbh_misc.h"
+#include "rbh_basename.h"
+#include "../chglog_reader/chglog_source.h"
+#include "../robinhood/cmd_helpers.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define OPT_STRING    "n:d:m:s:i:h"
+
+static const char *help_string =
+    _B "Usage:" B_ " %s [options] <dir> <output_file>\n"
+    "\n"
+    "Apply a mix of operations in <dir> (an existing empty directory of a\n"
+    "Lustre filesystem) and write the matching changelog records to\n"
+    "<output_file>, to be replayed using 'source_file' parameter of\n"
+    "ChangeLog::MDT configuration blocks.\n"
+    "\n"
+    _B "Options:" B_ "\n"
+    "    " _B "-n" B_ " " _U "count" U_ "\n"
+    "        Number of operations to generate (default: 100000).\n"
+    "    " _B "-d" B_ " " _U "dirs" U_ "\n"
+    "        Number of directories to create first (default: 100).\n"
+    "    " _B "-m" B_ " " _U "create" U_ ":" _U "unlink" U_ ":" _U "rename" U_
+    ":" _U "setattr" U_ "\n"
+    "        Relative weights of operations (default: 40:20:10:30).\n"
+    "    " _B "-s" B_ " " _U "seed" U_ "\n"
+    "        Random seed (default: 1).\n"
+    "    " _B "-i" B_ " " _U "index" U_ "\n"
+    "        Index of the first record (default: 1).\n";
+
+static inline void display_help(const char *bin_name)
+{
+    printf(help_string, bin_name);
+}
+
+enum gen_op { GEN_CREATE, GEN_UNLINK, GEN_RENAME, GEN_SETATTR, GEN_OP_COUNT };
+
+/** generated file (directories are named after their index) */
+typedef struct gen_entry {
+    entry_id_t   fid;
+    unsigned int parent;  /**< index in the directory array */
+    unsigned int name;
+    mode_t       mode;
+} gen_entry_t;
+
+/** generator state */
+static struct {
+    FILE          *out;
+    const char    *root_path;
+    entry_id_t     root;
+    uint64_t       index;
+    uint64_t       rec_count;
+    unsigned int   next_name;
+    entry_id_t    *dirs;
+    unsigned int   dir_count;
+    gen_entry_t   *files;
+    unsigned int   file_count;
+} gen;
+
+static void dir_name(char *name, unsigned int dir)
+{
+    snprintf(name, NAME_MAX, "d%u", dir);
+}
+
+static void file_name(char *name, const gen_entry_t *f)
+{
+    snprintf(name, NAME_MAX, "f%u", f->name);
+}
+
+static void file_path(char *path, const gen_entry_t *f)
+{
+    snprintf(path, RBH_PATH_MAX, "%s/d%u/f%u", gen.root_path, f->parent,
+             f->name);
+}
+
+/** write a record without extension */
+static int emit(unsigned int type, uint16_t flags, const entry_id_t *tfid,
+                const entry_id_t *pfid, const char *name)
+{
+    char buff[sizeof(CL_REC_TYPE) + NAME_MAX + 1];
+    CL_REC_TYPE *rec = (CL_REC_TYPE *)buff;
+    struct timespec now;
+    int rc;
+
+    memset(buff, 0, sizeof(buff));
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    rec->cr_type = type;
+    rec->cr_flags = flags;
+    rec->cr_index = gen.index++;
+    rec->cr_time = ((uint64_t)now.tv_sec << 30) | now.tv_nsec;
+    if (tfid)
+        rec->cr_tfid = *tfid;
+    if (pfid) {
+        rec->cr_pfid = *pfid;
+        rec->cr_namelen = snprintf(rh_get_cl_cr_name(rec), NAME_MAX,
+                                   "%s", name);
+    }
+
+    rc = cl_file_write_rec(gen.out, rec);
+    if (rc)
+        fprintf(stderr, "Failed to write record: %s\n", strerror(-rc));
+    else
+        gen.rec_count++;
+    return rc;
+}
+
+/** report a failed filesystem operation */
+static int op_error(const char *op, const char *path, int rc)
+{
+    fprintf(stderr, "%s(%s) failed: %s\n", op, path, strerror(-rc));
+    return rc;
+}
+
+static int gen_mkdir(unsigned int i)
+{
+    char path[RBH_PATH_MAX];
+    char name[NAME_MAX];
+    int rc;
+
+    dir_name(name, i);
+    snprintf(path, sizeof(path), "%s/%s", gen.root_path, name);
+
+    if (mkdir(path, 0755) != 0)
+        return op_error("mkdir", path, -errno);
+    rc = Lustre_GetFidFromPath(path, &gen.dirs[i]);
+    if (rc)
+        return op_error("path2fid", path, rc);
+
+    return emit(CL_MKDIR, 0, &gen.dirs[i], &gen.root, name);
+}
+
+static int gen_create(void)
+{
+    gen_entry_t *f = &gen.files[gen.file_count];
+    char path[RBH_PATH_MAX];
+    char name[NAME_MAX];
+    int fd, rc;
+
+    f->parent = random() % gen.dir_count;
+    f->name = gen.next_name++;
+    f->mode = 0644;
+    file_path(path, f);
+
+    fd = open(path, O_CREAT | O_EXCL | O_WRONLY, f->mode);
+    if (fd < 0)
+        return op_error("open", path, -errno);
+    rc = Lustre_GetFidByFd(fd, &f->fid);
+    close(fd);
+    if (rc)
+        return op_error("fd2fid", path, rc);
+
+    gen.file_count++;
+    file_name(name, f);
+    return emit(CL_CREATE, 0, &f->fid, &gen.dirs[f->parent], name);
+}
+
+static int gen_unlink(void)
+{
+    unsigned int i = random() % gen.file_count;
+    gen_entry_t f = gen.files[i];
+    char path[RBH_PATH_MAX];
+    char name[NAME_MAX];
+
+    file_path(path, &f);
+    if (unlink(path) != 0)
+        return op_error("unlink", path, -errno);
+
+    /* fill the hole with the last entry */
+    gen.files[i] = gen.files[--gen.file_count];
+
+    file_name(name, &f);
+    return emit(CL_UNLINK, CLF_UNLINK_LAST, &f.fid, &gen.dirs[f.parent],
+                name);
+}
+
+static int gen_rename(void)
+{
+    gen_entry_t *f = &gen.files[random() % gen.file_count];
+    gen_entry_t src = *f;
+    char src_path[RBH_PATH_MAX];
+    char tgt_path[RBH_PATH_MAX];
+    char name[NAME_MAX];
+    entry_id_t zero = { 0 };
+    int rc;
+
+    f->parent = random() % gen.dir_count;
+    f->name = gen.next_name++;
+
+    file_path(src_path, &src);
+    file_path(tgt_path, f);
+    if (rename(src_path, tgt_path) != 0) {
+        rc = -errno;
+        *f = src;
+        return op_error("rename", src_path, rc);
+    }
+
+    /* old style rename: RENAME (source) + EXT (target) */
+    file_name(name, &src);
+    rc = emit(CL_RENAME, 0, &f->fid, &gen.dirs[src.parent], name);
+    if (rc)
+        return rc;
+
+    file_name(name, f);
+    return emit(CL_EXT, 0, &zero, &gen.dirs[f->parent], name);
+}
+
+static int gen_setattr(void)
+{
+    gen_entry_t *f = &gen.files[random() % gen.file_count];
+    char path[RBH_PATH_MAX];
+
+    /* toggle group write permission */
+    file_path(path, f);
+    if (chmod(path, f->mode ^ S_IWGRP) != 0)
+        return op_error("chmod", path, -errno);
+    f->mode ^= S_IWGRP;
+
+    return emit(CL_SETATTR, 0, &f->fid, NULL, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    const char *bin = rh_basename(argv[0]);
+    unsigned long count = 100000;
+    unsigned int weights[GEN_OP_COUNT] = { 40, 20, 10, 30 };
+    unsigned int total_weight;
+    unsigned int seed = 1;
+    unsigned long i;
+    int c, rc = 0;
+
+    gen.index = 1;
+    gen.dir_count = 100;
+
+    while ((c = getopt(argc, argv, OPT_STRING)) != -1) {
+        switch (c) {
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            gen.dir_count = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            if (sscanf(optarg, "%u:%u:%u:%u", &weights[GEN_CREATE],
+                       &weights[GEN_UNLINK], &weights[GEN_RENAME],
+                       &weights[GEN_SETATTR]) != GEN_OP_COUNT) {
+                fprintf(stderr, "Invalid operation mix '%s'\n", optarg);
+                exit(EINVAL);
+            }
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            gen.index = strtoull(optarg, NULL, 0);
+            break;
+        case 'h':
+            display_help(bin);
+            exit(0);
+        default:
+            display_help(bin);
+            exit(EINVAL);
+        }
+    }
+
+    total_weight = weights[GEN_CREATE] + weights[GEN_UNLINK]
+        + weights[GEN_RENAME] + weights[GEN_SETATTR];
+    if (optind != argc - 2 || gen.dir_count == 0 || total_weight == 0) {
+        display_help(bin);
+        exit(EINVAL);
+    }
+
+    gen.root_path = argv[optind];
+    rc = Lustre_GetFidFromPath(gen.root_path, &gen.root);
+    if (rc) {
+        op_error("path2fid", gen.root_path, rc);
+        exit(-rc);
+    }
+
+    gen.out = cl_file_open_write(argv[optind + 1]);
+    if (gen.out == NULL)
+        exit(EIO);
+
+    gen.dirs = calloc(gen.dir_count, sizeof(entry_id_t));
+    gen.files = calloc(count, sizeof(gen_entry_t));
+    if (gen.dirs == NULL || gen.files == NULL) {
+        fprintf(stderr, "Cannot allocate memory\n");
+        exit(ENOMEM);
+    }
+    srandom(seed);
+
+    for (i = 0; i < gen.dir_count && rc == 0; i++)
+        rc = gen_mkdir(i);
+
+    for (i = 0; i < count && rc == 0; i++) {
+        unsigned int r = random() % total_weight;
+        enum gen_op op;
+
+        for (op = GEN_CREATE; op < GEN_SETATTR; op++) {
+            if (r < weights[op])
+                break;
+            r -= weights[op];
+        }
+
+        /* nothing to modify yet */
+        if (gen.file_count == 0)
+            op = GEN_CREATE;
+
+        switch (op) {
+        case GEN_CREATE:
+            rc = gen_create();
+            break;
+        case GEN_UNLINK:
+            rc = gen_unlink();
+            break;
+        case GEN_RENAME:
+            rc = gen_rename();
+            break;
+        default:
+            rc = gen_setattr();
+            break;
+        }
+    }
+
+    if (fclose(gen.out) != 0 && rc == 0)
+        rc = -errno;
+
+    if (rc == 0)
+        printf("%" PRIu64 " records written to %s\n", gen.rec_count,
+               argv[optind + 1]);
+
+    free(gen.dirs);
+    free(gen.files);
+    return rc ? -rc : 0;
+}
@@ -0,0 +1,127 @@
+#!/bin/bash
+
+# Benchmark of changelog processing without a live MDT reader:
+# a file of changelog records is replayed through the changelog reader,
+# the pipeline and the database (SQLite or MySQL, depending on the
+# robinhood build), then the end-to-end ingest rate is reported in
+# records/sec (robinhood exits once all records are committed to the DB).
+#
+# By default, gen_changelog applies the operations in a new directory
+# of fs_path and writes the matching records, so the replay processes
+# entries that exist in the filesystem. The entry count in the database
+# is then checked against this directory.
+# A record file saved by a running robinhood ('record_file') can also be
+# replayed with -f; it must come from the filesystem given as fs_path.
+
+function usage
+{
+	echo "Usage: $0 [options] <fs_path>"
+	echo "Options:"
+	echo "    -f <file>   replay the given record file (else, generate one in fs_path)"
+	echo "    -n <count>  number of operations to generate (default: 100000)"
+	echo "    -m <mix>    create:unlink:rename:setattr weights (default: 40:20:10:30)"
+	echo "    -c <file>   configuration to include (EntryProcessor, ChangeLog tuning...)"
+	echo "    -k          keep the working and generated directories"
+	echo "Environment:"
+	echo "    RBH_BIN, REPORT_BIN, GEN_BIN: robinhood, rbh-report and gen_changelog commands"
+	echo "    RBH_DB: MySQL database to be (re)created (default: robinhood_bench)"
+	exit 1
+}
+
+srcdir=$(readlink -f $(dirname $0)/..)
+RBH_BIN=${RBH_BIN:-$srcdir/src/robinhood/robinhood}
+REPORT_BIN=${REPORT_BIN:-$srcdir/src/robinhood/rbh-report}
+GEN_BIN=${GEN_BIN:-$srcdir/src/tools/gen_changelog}
+RBH_DB=${RBH_DB:-robinhood_bench}
+
+count=100000
+mix=40:20:10:30
+rec_file=""
+include_cfg=""
+keep=0
+
+while getopts "f:n:m:c:k" opt; do
+	case $opt in
+	f) rec_file=$(readlink -f $OPTARG) ;;
+	n) count=$OPTARG ;;
+	m) mix=$OPTARG ;;
+	c) include_cfg=$(readlink -f $OPTARG) ;;
+	k) keep=1 ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ -n "$1" ] || usage
+fs_path=$(readlink -f $1)
+tree=""
+
+workdir=$(mktemp -d /tmp/chglog_bench.XXXXXX) || exit 1
+[ $keep = 1 ] || trap 'rm -rf $workdir $tree' EXIT
+
+if [ -z "$rec_file" ]; then
+	tree=$(mktemp -d $fs_path/chglog_bench.XXXXXX) || exit 1
+	rec_file=$workdir/records.cl
+	$GEN_BIN -n $count -m $mix $tree $rec_file || exit 1
+fi
+
+# start from an empty database
+if $RBH_BIN -V | grep -q "binding: MySQL"; then
+	mysql -e "DROP DATABASE IF EXISTS $RBH_DB; CREATE DATABASE $RBH_DB;" \
+		|| exit 1
+fi
+
+cat > $workdir/bench.conf << EOF
+General {
+	fs_path = "$fs_path";
+	check_mounted = no;
+}
+Log {
+	log_file = "$workdir/robinhood.log";
+	report_file = "/dev/null";
+	alert_file = "/dev/null";
+}
+ListManager {
+	MySQL {
+		server = "localhost";
+		db = "$RBH_DB";
+		user = "robinhood";
+		password = "robinhood";
+	}
+	SQLite {
+		db_file = "$workdir/robinhood_sqlite_db";
+	}
+}
+ChangeLog {
+	MDT {
+		mdt_name = "MDT0000";
+		reader_id = "cl1";
+		source_file = "$rec_file";
+	}
+}
+EOF
+[ -n "$include_cfg" ] && echo "%include \"$include_cfg\"" >> $workdir/bench.conf
+
+# robinhood only exits when all records are committed to the database
+start=$(date +%s.%N)
+$RBH_BIN -f $workdir/bench.conf --readlog --once || exit 1
+end=$(date +%s.%N)
+
+grep -E "records (read|processed)|suppressed records" $workdir/robinhood.log \
+	| sed -e "s/.*STATS | *//"
+elapsed=$(echo "$end - $start" | bc -l)
+rec_count=$(grep "records read" $workdir/robinhood.log | tail -1 \
+	| awk '{print $NF}')
+echo "Total run time: $elapsed sec"
+echo "DB ingest rate: $(echo "${rec_count:-0} / $elapsed" | bc -l) records/sec"
+
+# check the database matches the generated tree
+db_count=$($REPORT_BIN -f $workdir/bench.conf -i --csv -q \
+	| awk -F, '{n += $2} END {print n + 0}')
+echo "Entries in DB: $db_count"
+if [ -n "$tree" ]; then
+	fs_count=$(find $tree -mindepth 1 | wc -l)
+	if [ "$db_count" != "$fs_count" ]; then
+		echo "ERROR: $fs_count entries in $tree, $db_count in DB" >&2
+		exit 1
+	fi
+fi
@@ -2357,6 +2357,34 @@ function test_rh_report
 	done
 }
 
+# compare top-user reports with and without accounting table
+function check_acct_report
+{
+        config_file=$1
+
+        $REPORT -f $RBH_CFG_DIR/$config_file -l MAJOR --csv --force-no-acct --top-user > rh_no_acct_report.log
+        $REPORT -f $RBH_CFG_DIR/$config_file -l MAJOR --csv --top-user > rh_acct_report.log
+
+        nbrowacct=` awk -F ',' 'END {print NF}' rh_acct_report.log`;
+        nbrownoacct=` awk -F ',' 'END {print NF}' rh_no_acct_report.log`;
+        for i in `seq 1 $nbrowacct`; do
+                rowchecked=0;
+                for j in `seq 1 $nbrownoacct`; do
+                        if [[ `cut -d "," -f $i rh_acct_report.log` == `cut -d "," -f $j rh_no_acct_report.log`  ]]; then
+                                rowchecked=1
+                                break
+                        fi
+                done
+                if (( $rowchecked == 1 )); then
+                        echo "Row `awk -F ',' 'NR == 1 {print $'$i';}' rh_acct_report.log | tr -d ' '` OK"
+                else
+                        error "Row `awk -F ',' 'NR == 1 {print $'$i';}' rh_acct_report.log | tr -d ' '` is different with acct "
+                fi
+        done
+        rm -f rh_no_acct_report.log
+        rm -f rh_acct_report.log
+}
+
 #test report using accounting table
 function test_rh_acct_report
 {
@@ -2385,27 +2413,7 @@ function test_rh_acct_report
 	check_db_error rh_scan.log
 
         echo "3.Checking reports..."
-        $REPORT -f $RBH_CFG_DIR/$config_file -l MAJOR --csv --force-no-acct --top-user > rh_no_acct_report.log
-        $REPORT -f $RBH_CFG_DIR/$config_file -l MAJOR --csv --top-user > rh_acct_report.log
-
-        nbrowacct=` awk -F ',' 'END {print NF}' rh_acct_report.log`;
-        nbrownoacct=` awk -F ',' 'END {print NF}' rh_no_acct_report.log`;
-        for i in `seq 1 $nbrowacct`; do
-                rowchecked=0;
-                for j in `seq 1 $nbrownoacct`; do
-                        if [[ `cut -d "," -f $i rh_acct_report.log` == `cut -d "," -f $j rh_no_acct_report.log`  ]]; then
-                                rowchecked=1
-                                break
-                        fi
-                done
-                if (( $rowchecked == 1 )); then
-                        echo "Row `awk -F ',' 'NR == 1 {print $'$i';}' rh_acct_report.log | tr -d ' '` OK"
-                else
-                        error "Row `awk -F ',' 'NR == 1 {print $'$i';}' rh_acct_report.log | tr -d ' '` is different with acct "
-                fi
-        done
-        rm -f rh_no_acct_report.log
-        rm -f rh_acct_report.log
+        check_acct_report $config_file
 }
 
 #test --split-user-groups option
@@ -2513,7 +2521,19 @@ function test_acct_table
         $RH -f $RBH_CFG_DIR/$config_file --scan -l VERB -L rh_scan.log  --once || error "scanning filesystem"
 	check_db_error rh_scan.log
 
-        if [[ "$ACCT_SWITCH" != "no" ]]; then
+        if [[ "$ACCT_SWITCH" != "no" ]] && grep -q "accounting_mode *= *batched" $RBH_CFG_DIR/$config_file; then
+            echo "3.Checking acct table creation (batched accounting)"
+            grep -q "Table ACCT_STAT created successfully" rh_scan.log && echo "ACCT table creation: OK" || error "creating ACCT table"
+            grep -q "Trigger ACCT_ENTRY_.* created successfully" rh_scan.log && error "ACCT trigger created with batched accounting"
+            check_acct_report $config_file
+
+            echo "4-Removing entries and scanning again..."
+            rm -rf $RH_ROOT/dir.1 $RH_ROOT/dir.$dircount/file.1
+            dd if=/dev/zero of=$RH_ROOT/dir.2/file.1 bs=1M count=2 >/dev/null 2>/dev/null || error "writing $RH_ROOT/dir.2/file.1"
+            $RH -f $RBH_CFG_DIR/$config_file --scan -l VERB -L rh_scan.log  --once || error "scanning filesystem"
+            check_db_error rh_scan.log
+            check_acct_report $config_file
+        elif [[ "$ACCT_SWITCH" != "no" ]]; then
             echo "3.Checking acct table and triggers creation"
             grep -q "Table ACCT_STAT created successfully" rh_scan.log && echo "ACCT table creation: OK" || error "creating ACCT table"
             grep -q "Trigger ACCT_ENTRY_INSERT created successfully" rh_scan.log && echo "ACCT_ENTRY_INSERT trigger creation: OK" || error "creating ACCT_ENTRY_INSERT trigger"
@@ -2539,6 +2559,13 @@ function test_acct_borderline
     # create DB schema
     $RH -f $RBH_CFG_DIR/$config_file --alter-db -L rh.log
 
+    # with batched accounting, ACCT_STAT is not maintained by triggers
+    # on direct DB changes: only check it is correctly populated
+    if grep -q "accounting_mode *= *batched" $RBH_CFG_DIR/$config_file; then
+        acct_borderline_populate $config_file
+        return
+    fi
+
     # insert 2 records with NULL uid, gid, size...
     mysql $RH_DB -e "INSERT INTO ENTRIES (id, type) VALUES ('id1','file')" || error "INSERT ERROR"
     mysql $RH_DB -e "INSERT INTO ENTRIES (id, type) VALUES ('id2','file')" || error "INSERT ERROR"
@@ -2624,6 +2651,14 @@ function test_acct_borderline
     line_values=($(grep "unknown,    unknown" rh_report.log | tr ',' ' '))
     [ -z "$line_values" ] || [[ "${line_values[3]}" == 0 ]] || error "no entries expected for unknown/unknown (${line_values[3]})"
 
+    acct_borderline_populate $config_file
+}
+
+# check ACCT_STAT is correctly populated from borderline records
+function acct_borderline_populate
+{
+    config_file=$1
+
     # Add new records and check ACCT is correctly populated
     mysql $RH_DB -e "INSERT INTO ENTRIES (id, type) VALUES ('id3','file')" || error "INSERT ERROR"
     mysql $RH_DB -e "INSERT INTO ENTRIES (id, type) VALUES ('id4','file')" || error "INSERT ERROR"
@@ -8036,6 +8071,102 @@ function test_hardlinks
     rm -f report.out find.out
 }
 
+# check the namespace in DB matches the filesystem
+# and there is one inode per path, except for hardlinks
+function check_seen_set_db
+{
+    local cfg=$1
+    local nb_ln=$2
+    local count_nb count_path
+
+    $FIND -f $cfg $RH_ROOT -nobulk -ls > find.out || error "$FIND"
+    [ "$DEBUG" = "1" ] && cat find.out
+    $REPORT -f $cfg --dump-all -q > report.out || error "$REPORT"
+    [ "$DEBUG" = "1" ] && cat report.out
+
+    awk '{print $NF}' find.out | sort > find.db
+    find $RH_ROOT -path $RH_ROOT/.lustre -prune -o -print | sort > find.fs
+    diff find.fs find.db || error "namespace in DB differs from filesystem"
+
+    count_nb=$(wc -l report.out | awk '{print $1}')
+    count_path=$(grep -v "$RH_ROOT$" find.out | wc -l)
+    echo "nbr_inodes=$count_nb, nb_paths=$count_path, nb_ln=$nb_ln"
+    (( $count_path == $count_nb + $nb_ln )) || error "nb path != nb_inode + nb_ln"
+
+    rm -f find.db find.fs
+}
+
+function test_seen_set_rescan
+{
+    config_file=$1
+    cfg=$RBH_CFG_DIR/$config_file
+
+    clean_logs
+
+    echo "1. Creating initial objects..."
+    mkdir $RH_ROOT/dir.1 $RH_ROOT/dir.2 $RH_ROOT/dir.3 $RH_ROOT/dir.3/subdir ||
+        error "creating directories"
+    for d in dir.1 dir.2 dir.3/subdir; do
+        for i in $(seq 1 10); do
+            touch $RH_ROOT/$d/file.$i || error "creating $d/file.$i"
+        done
+    done
+    ln $RH_ROOT/dir.1/file.10 $RH_ROOT/dir.2/link.10 || error "hardlink"
+    nb_ln=1
+
+    # the 2nd scan finds unchanged entries and only records them as seen
+    echo "2. Scanning twice..."
+    for i in 1 2; do
+        $RH -f $cfg --scan --once -l DEBUG -L rh_scan.log || error "scanning"
+        check_db_error rh_scan.log
+    done
+    grep "Removing old entries" rh_scan.log | tail -1 |
+        grep -E "\([1-9][0-9]* unchanged entries seen\)" ||
+        error "no unchanged entry recorded in the seen set"
+    check_seen_set_db $cfg $nb_ln
+
+    echo "3. Removing, renaming and linking objects..."
+    deleted="$RH_ROOT/dir.1/file.1 $RH_ROOT/dir.1/file.2 $RH_ROOT/dir.2/file.3"
+    rmids=""
+    for f in $deleted; do
+        rmids="$rmids `get_id $f`"
+    done
+    rm -f $deleted || error "removing $deleted"
+    # remove one name of a hardlinked entry
+    rm -f $RH_ROOT/dir.1/file.10 || error "removing link"
+    ((nb_ln--))
+    # renames
+    mv $RH_ROOT/dir.1/file.4 $RH_ROOT/dir.1/file.4.rnm || error "renaming"
+    mv $RH_ROOT/dir.1/file.5 $RH_ROOT/dir.2/file.5.rnm || error "renaming"
+    mv $RH_ROOT/dir.3/subdir $RH_ROOT/dir.2/subdir.rnm || error "renaming"
+    # new hardlinks
+    ln $RH_ROOT/dir.2/file.6 $RH_ROOT/dir.1/link.6 || error "hardlink"
+    ln $RH_ROOT/dir.2/subdir.rnm/file.1 $RH_ROOT/dir.3/link.1 || error "hardlink"
+    ((nb_ln+=2))
+    old_names="$deleted $RH_ROOT/dir.1/file.10 $RH_ROOT/dir.1/file.4
+               $RH_ROOT/dir.1/file.5 $RH_ROOT/dir.3/subdir"
+
+    # namespace GC needs 1s difference
+    sleep 1
+
+    echo "4. Scanning again..."
+    $RH -f $cfg --scan --once -l DEBUG -L rh_scan.log || error "scanning"
+    check_db_error rh_scan.log
+    grep "Removing old entries" rh_scan.log | tail -1 |
+        grep -E "\([1-9][0-9]* unchanged entries seen\)" ||
+        error "no unchanged entry recorded in the seen set"
+    check_seen_set_db $cfg $nb_ln
+
+    for f in $rmids; do
+        grep "\[$f\]" find.out && error "deleted id ($f) found in find output"
+    done
+    for n in $old_names; do
+        grep -E " $n$" find.out && error "removed name $n found in find output"
+    done
+
+    rm -f report.out find.out
+}
+
 function test_hl_count
 {
 	local config_file=$1
@@ -9827,6 +9958,103 @@ function test_du
 
 }
 
+# compare rbh-du results answered from DIR_STAT with the ones got
+# by scrubbing the namespace (a user filter disables DIR_STAT)
+function check_dirstat_du
+{
+    local cfg=$1
+    shift
+    local d t o ds sc
+
+    for d in "$@"; do
+        $DU -f $cfg -l DEBUG -t f -c $d 2>&1 | grep -q "from directory stats" ||
+            error "usage of $d was not got from DIR_STAT"
+
+        for t in f d l; do
+            for o in -c -b; do
+                ds=$($DU -f $cfg -t $t $o $d | awk '{print $1}')
+                sc=$($DU -f $cfg -u '*' -t $t $o $d | awk '{print $1}')
+                echo "$d: type=$t $o: dirstat=$ds scrub=$sc"
+                [[ -n "$ds" && "$ds" = "$sc" ]] ||
+                    error "$d: DIR_STAT gives $ds for type=$t $o ($sc expected)"
+            done
+        done
+    done
+
+    # check the number of files is the real one
+    ds=$($DU -f $cfg -t f -c $RH_ROOT | awk '{print $1}')
+    sc=$(find $RH_ROOT -path $RH_ROOT/.lustre -prune -o -type f -print | wc -l)
+    [[ "$ds" = "$sc" ]] || error "DIR_STAT gives $ds files in $RH_ROOT ($sc expected)"
+}
+
+function test_du_dirstat
+{
+    config_file=$1
+    flavor=$2
+    cfg=$RBH_CFG_DIR/$config_file
+
+    clean_logs
+
+    if (( $no_log )) && [ "$flavor" = "readlog" ]; then
+        echo "Changelogs not supported on this config: skipped"
+        set_skipped
+        return 1
+    fi
+
+    echo "1. Populating filesystem..."
+    populate 500
+    for i in 1 2 3; do
+        ln -s "content$i" $RH_ROOT/dir.$i/link.$i || error "creating symlink"
+    done
+    dd if=/dev/zero of=$RH_ROOT/dir.2/subdir.2/big bs=1M count=1 2>/dev/null ||
+        error "creating file"
+
+    echo "2. Initial scan..."
+    $RH -f $cfg --scan --once -l DEBUG -L rh_scan.log || error "scanning"
+    check_db_error rh_scan.log
+    if [ "$flavor" = "readlog" ]; then
+        # consume creation records
+        $RH -f $cfg --readlog --once -l DEBUG -L rh_chglogs.log ||
+            error "reading changelog"
+        check_db_error rh_chglogs.log
+    fi
+    check_dirstat_du $cfg $RH_ROOT $RH_ROOT/dir.1 $RH_ROOT/dir.2 \
+        $RH_ROOT/dir.3
+
+    echo "3. Renaming and removing entries..."
+    # subtree rename to another parent
+    mv $RH_ROOT/dir.1 $RH_ROOT/dir.2/dir.1.rnm || error "renaming dir.1"
+    # file moves and renames
+    mv $RH_ROOT/dir.4/subdir.4/file.4 $RH_ROOT/dir.2/file.4.rnm ||
+        error "renaming file.4"
+    mv $RH_ROOT/dir.2/subdir.2/big $RH_ROOT/dir.4/big.rnm ||
+        error "renaming big"
+    # single unlinks
+    rm -f $RH_ROOT/dir.4/subdir.14/file.14 $RH_ROOT/dir.2/link.2 ||
+        error "removing files"
+    # mass removal
+    rm -rf $RH_ROOT/dir.3 || error "removing dir.3"
+
+    if [ "$flavor" = "readlog" ]; then
+        echo "4. Reading changelogs..."
+        $RH -f $cfg --readlog --once -l DEBUG -L rh_chglogs.log ||
+            error "reading changelog"
+        check_db_error rh_chglogs.log
+    else
+        echo "4. Scanning..."
+        $RH -f $cfg --scan --once -l DEBUG -L rh_scan.log || error "scanning"
+        check_db_error rh_scan.log
+    fi
+    check_dirstat_du $cfg $RH_ROOT $RH_ROOT/dir.2 $RH_ROOT/dir.2/dir.1.rnm \
+        $RH_ROOT/dir.4
+
+    echo "5. Rescanning..."
+    $RH -f $cfg --scan --once -l DEBUG -L rh_scan.log || error "scanning"
+    check_db_error rh_scan.log
+    check_dirstat_du $cfg $RH_ROOT $RH_ROOT/dir.2 $RH_ROOT/dir.2/dir.1.rnm \
+        $RH_ROOT/dir.4
+}
+
 function check_disabled
 {
        config_file=$1
@@ -13322,6 +13550,7 @@ run_test 102	update_test test_updt.conf 3 14 "db update policy"
 run_test 103a    test_acct_table common.conf 5 "" "Acct table and triggers creation (default)"
 run_test 103b    test_acct_table acct.conf 5 "yes" "Acct table and triggers creation (accounting ON)"
 run_test 103c    test_acct_table acct.conf 5 "no" "Acct table and triggers creation (accounting OFF)"
+run_test 103d    test_acct_table acct_batched.conf 5 "yes" "Acct table creation and update (batched accounting)"
 run_test 104     test_size_updt test_updt.conf 1 "test size update"
 run_test 105     test_enoent test_pipeline.conf "readlog with continuous create/unlink"
 run_test 106a    test_diff info_collect2.conf "diff" "rbh-diff"
@@ -13343,6 +13572,7 @@ run_test 109b    test_hardlinks info_collect.conf readlog "hardlinks management
 run_test 109c    test_hardlinks info_collect.conf partial "hardlinks management (partial scans)"
 run_test 109d    test_hardlinks info_collect.conf diff "hardlinks management (diff+apply)"
 run_test 109e    test_hardlinks info_collect.conf partdiff "hardlinks management (partial diffs+apply)"
+run_test 109f    test_seen_set_rescan seen_set.conf "removals, renames and hardlinks between scans (seen set)"
 run_test 110     test_unlink info_collect.conf "unlink (readlog)"
 run_test 111     test_layout info_collect.conf "layout changes"
 run_test 112     test_hl_count info_collect.conf "reports with hardlinks"
@@ -13379,7 +13609,8 @@ run_test 119 uid_gid_as_numbers uidgidnum.conf "Store UIDs and GIDs as numbers"
 run_test 120 posix_acmtime common.conf "Test for posix ctimes"
 run_test 121 db_schema_convert "" "Test DB schema conversion"
 run_test 122 random_names common.conf "Test random file names"
-run_test 123 test_acct_borderline acct.conf "yes" "Test borderline ACCT cases"
+run_test 123a test_acct_borderline acct.conf "yes" "Test borderline ACCT cases"
+run_test 123b test_acct_borderline acct_batched.conf "yes" "Test borderline ACCT cases (batched accounting)"
 run_test 124 test_commit_update commit_update.conf "Update of last committed changelog"
 run_test 125a test_path_gc1 test_rm1.conf "Test namespace garbage collection with partial scans"
 run_test 125b test_path_gc2 test_rm1.conf "Test namespace garbage collection after rename"
@@ -13515,6 +13746,8 @@ run_test 404   test_dircount_report common.conf 20  "dircount reports"
 
 run_test 405    test_find   common.conf ""  "rbh-find command"
 run_test 406    test_du   common.conf ""    "rbh-du command"
+run_test 407a   test_du_dirstat dir_stat.conf scan "rbh-du from DIR_STAT (scan)"
+run_test 407b   test_du_dirstat dir_stat.conf readlog "rbh-du from DIR_STAT (readlog)"
 
 #### misc, internals #####
 run_test 500a	test_logs log1.conf file_nobatch 	"file logging without alert batching"